@@ -42,6 +42,7 @@
 #include "spirv.hpp"
 #include "GlslangToSpv.h"
 #include "SpvBuilder.h"
+#include "SPVRemapper.h"
 namespace spv {
    #include "GLSL.std.450.h"
 }
@@ -50,13 +51,19 @@ namespace spv {
 #include "../glslang/MachineIndependent/localintermediate.h"
 #include "../glslang/MachineIndependent/SymbolTable.h"
 #include "../glslang/Include/Common.h"
+#include "../glslang/Include/InitializeGlobals.h"
 
+#include <chrono>
 #include <string>
 #include <map>
 #include <list>
 #include <vector>
 #include <stack>
 #include <fstream>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 
 namespace {
 
@@ -67,9 +74,14 @@ const int GlslangMagic = 0x51a;
 //
 // Derives from the AST walking base class.
 //
+// With more than one thread, the function bodies other than main() are
+// translated by forks of the traverser (and its builder), then joined back in
+// order (see visitFunctionsInParallel()).
+//
 class TGlslangToSpvTraverser : public glslang::TIntermTraverser {
 public:
-    TGlslangToSpvTraverser(const glslang::TIntermediate*);
+    TGlslangToSpvTraverser(const glslang::TIntermediate*, const glslang::SpvOptions& = glslang::SpvOptions());
+    TGlslangToSpvTraverser(const TGlslangToSpvTraverser& parent, spv::Id firstId);
     virtual ~TGlslangToSpvTraverser();
 
     bool visitAggregate(glslang::TVisit, glslang::TIntermAggregate*);
@@ -82,13 +94,27 @@ public:
     bool visitLoop(glslang::TVisit, glslang::TIntermLoop*);
     bool visitBranch(glslang::TVisit visit, glslang::TIntermBranch*);
 
+    void simplifySpv(bool forwardLoadsAndStores, bool eliminateCommonSubexpressions)
+    {
+        builder.simplify(forwardLoadsAndStores, eliminateCommonSubexpressions);
+    }
+    void stripDebugSpv(bool keepNames) { builder.stripDebug(keepNames); }
     void dumpSpv(std::vector<unsigned int>& out) { builder.dump(out); }
+    void dumpSpv(spv::WordSink& sink) { builder.dump(sink); }
+    int getNumInstructions() const { return builder.getNumInstructions(); }
 
 protected:
     spv::Id createSpvVariable(const glslang::TIntermSymbol*);
     spv::Id getSampledType(const glslang::TSampler&);
     spv::Id convertGlslangToSpvType(const glslang::TType& type);
     spv::Id convertGlslangToSpvType(const glslang::TType& type, bool explicitLayout);
+    bool isLowered(const glslang::TType& type) const;
+    spv::Id getWideType(spv::Id typeId);
+    spv::Id getAccessChainType(const glslang::TType& type);
+    spv::Id accessChainLoad(const glslang::TType& type);
+    void accessChainStore(spv::Id rvalue);
+    spv::Id convertToWidth(spv::Id value, int width);
+    spv::Id convertToWidthOf(spv::Id value, spv::Id typeId);
     bool requiresExplicitLayout(const glslang::TType& type) const;
     int getArrayStride(const glslang::TType& arrayType);
     int getMatrixStride(const glslang::TType& matrixType);
@@ -96,8 +122,32 @@ protected:
 
     bool isShaderEntrypoint(const glslang::TIntermAggregate* node);
     void makeFunctions(const glslang::TIntermSequence&);
+    void makeImports(const glslang::TIntermSequence&);
     void makeGlobalInitializers(const glslang::TIntermSequence&);
     void visitFunctions(const glslang::TIntermSequence&);
+
+    // In a fork, what another fork might make too: a struct type or a global variable.
+    struct TMade {
+        const glslang::TTypeList* glslangStruct;  // or else
+        int symbolId;
+        spv::Builder::ForkMark begin;
+        spv::Builder::ForkMark end;
+        spv::Id id;
+    };
+    // A function body a fork translated.
+    struct TForked {
+        TGlslangToSpvTraverser* fork;
+        spv::Function* body;
+        spv::Builder::ForkMark begin;
+        spv::Builder::ForkMark end;
+        size_t madeBegin;
+        size_t madeEnd;
+    };
+    void visitFunctionsInParallel(const std::vector<glslang::TIntermAggregate*>&);
+    void translateFunction(glslang::TIntermAggregate*, TForked&);
+    void joinFork(const TForked&);
+    int beginMade(const glslang::TTypeList*, int symbolId);
+    void endMade(int made, spv::Id);
     void handleFunctionEntry(const glslang::TIntermAggregate* node);
     void translateArguments(const glslang::TIntermAggregate& node, std::vector<spv::Id>& arguments);
     void translateArguments(glslang::TIntermUnary& node, std::vector<spv::Id>& arguments);
@@ -114,8 +164,10 @@ protected:
     spv::Id getSymbolId(const glslang::TIntermSymbol* node);
     void addDecoration(spv::Id id, spv::Decoration dec);
     void addMemberDecoration(spv::Id id, int member, spv::Decoration dec);
-    spv::Id createSpvConstant(const glslang::TType& type, const glslang::TConstUnionArray&, int& nextConst);
+    spv::Id createSpvConstant(const glslang::TType& type, const glslang::TConstUnionArray&, int& nextConst, bool specConstant = false);
+    spv::Id createSpvSpecConstantComposite(spv::Id typeId, const std::vector<spv::Id>& constituents);
     bool isTrivialLeaf(const glslang::TIntermTyped* node);
+    bool isBreakOnly(TIntermNode* segment);
     bool isTrivial(const glslang::TIntermTyped* node);
     spv::Id createShortCircuit(glslang::TOperator, glslang::TIntermTyped& left, glslang::TIntermTyped& right);
 
@@ -127,16 +179,28 @@ protected:
     bool inMain;
     bool mainTerminated;
     bool linkageOnly;
+    bool library;                    // export the functions made, import those called but not made
     const glslang::TIntermediate* glslangIntermediate;
     spv::Id stdBuiltins;
 
     std::unordered_map<int, spv::Id> symbolValues;
     std::unordered_set<int> constReadOnlyParameters;  // set of formal function parameters that have glslang qualifier constReadOnly, so we know they are not local function "const" that are write-once
     std::unordered_map<std::string, spv::Function*> functionMap;
+    std::string entryPoint;          // the function made the module's entry point; see SpvOptions::entryPoint
+    std::unordered_set<std::string> reachableFunctions;  // functions the entry point can call; the rest aren't translated
     std::unordered_map<const glslang::TTypeList*, spv::Id> structMap;
     std::unordered_map<const glslang::TTypeList*, std::vector<int> > memberRemapper;  // for mapping glslang block indices to spv indices (e.g., due to hidden members)
     std::stack<bool> breakForLoop;  // false means break for switch
     std::stack<glslang::TIntermTyped*> loopTerminal;  // code from the last part of a for loop: for(...; ...; terminal), needed for e.g., continue };
+
+    int numThreads;                  // for function bodies, 0 for one per core
+    bool streaming;                  // each function streamed once finished (see SpvOptions::streamFunctions)
+    bool forwardLoadsAndStores;      // as each streamed function is simplified
+    bool eliminateCommonSubexpressions;
+    bool mediump16;                  // see SpvOptions::mediump16, and isLowered()
+    bool forked;
+    spv::Function* forkBody;         // of a fork, the body being translated
+    std::vector<TMade> made;         // by a fork, in the order begun
 };
 
 //
@@ -222,7 +286,7 @@ spv::Dim TranslateDimensionality(const glslang::TSampler& sampler)
 spv::Decoration TranslatePrecisionDecoration(const glslang::TType& type)
 {
     switch (type.getQualifier().precision) {
-    case glslang::EpqLow:    return spv::DecorationRelaxedPrecision; // TODO: Map instead to 16-bit types?
+    case glslang::EpqLow:    return spv::DecorationRelaxedPrecision; // and 16 bits wide, with SpvOptions::mediump16
     case glslang::EpqMedium: return spv::DecorationRelaxedPrecision;
     case glslang::EpqHigh:   return spv::NoPrecision;
     default:
@@ -314,6 +378,59 @@ spv::Decoration TranslateInvariantDecoration(const glslang::TType& type)
         return (spv::Decoration)spv::BadValue;
 }
 
+// Translate glslang loop unrolling hint to SPIR-V loop control.
+spv::LoopControlMask TranslateLoopControl(glslang::TLoopControl control)
+{
+    switch (control) {
+    case glslang::ELoopControlUnroll:     return spv::LoopControlUnrollMask;
+    case glslang::ELoopControlDontUnroll: return spv::LoopControlDontUnrollMask;
+    default:                              return spv::LoopControlMaskNone;
+    }
+}
+
+// Whether a one-operand operation has a 16-bit form: its operand and result the
+// same width, whatever that is.
+bool HasAnyWidthForm(glslang::TOperator op)
+{
+    switch (op) {
+    case glslang::EOpNegative:
+    case glslang::EOpBitwiseNot:
+    case glslang::EOpRadians:
+    case glslang::EOpDegrees:
+    case glslang::EOpSin:
+    case glslang::EOpCos:
+    case glslang::EOpTan:
+    case glslang::EOpAcos:
+    case glslang::EOpAsin:
+    case glslang::EOpAtan:
+    case glslang::EOpAcosh:
+    case glslang::EOpAsinh:
+    case glslang::EOpAtanh:
+    case glslang::EOpTanh:
+    case glslang::EOpCosh:
+    case glslang::EOpSinh:
+    case glslang::EOpLength:
+    case glslang::EOpNormalize:
+    case glslang::EOpExp:
+    case glslang::EOpLog:
+    case glslang::EOpExp2:
+    case glslang::EOpLog2:
+    case glslang::EOpSqrt:
+    case glslang::EOpInverseSqrt:
+    case glslang::EOpFloor:
+    case glslang::EOpTrunc:
+    case glslang::EOpRound:
+    case glslang::EOpRoundEven:
+    case glslang::EOpCeil:
+    case glslang::EOpFract:
+    case glslang::EOpAbs:
+    case glslang::EOpSign:
+        return true;
+    default:
+        return false;
+    }
+}
+
 // Translate glslang built-in variable to SPIR-V built in decoration.
 spv::BuiltIn TranslateBuiltInDecoration(glslang::TBuiltInVariable builtIn)
 {
@@ -412,26 +529,60 @@ spv::ImageFormat TranslateImageFormat(const glslang::TType& type)
 // Implement the TGlslangToSpvTraverser class.
 //
 
-TGlslangToSpvTraverser::TGlslangToSpvTraverser(const glslang::TIntermediate* glslangIntermediate)
+TGlslangToSpvTraverser::TGlslangToSpvTraverser(const glslang::TIntermediate* glslangIntermediate, const glslang::SpvOptions& options)
     : TIntermTraverser(true, false, true), shaderEntry(0), sequenceDepth(0),
       builder(GlslangMagic),
-      inMain(false), mainTerminated(false), linkageOnly(false),
-      glslangIntermediate(glslangIntermediate)
+      inMain(false), mainTerminated(false), linkageOnly(false), library(glslangIntermediate->isLibrary()),
+      glslangIntermediate(glslangIntermediate),
+      numThreads(options.streamFunctions ? 1 : options.numThreads), streaming(options.streamFunctions),
+      forwardLoadsAndStores(options.forwardLoadsAndStores),
+      eliminateCommonSubexpressions(options.eliminateCommonSubexpressions), mediump16(options.mediump16),
+      forked(false), forkBody(0)
 {
+    if (streaming)
+        builder.setStreamingFunctions();
+
     spv::ExecutionModel executionModel = TranslateExecutionModel(glslangIntermediate->getStage());
 
+    entryPoint = options.entryPoint ? options.entryPoint : glslangIntermediate->getEntryPoints().front();
+    glslangIntermediate->getReachableFunctions(reachableFunctions, entryPoint);
+
     builder.clearAccessChain();
     builder.setSource(TranslateSourceLanguage(glslangIntermediate->getProfile()), glslangIntermediate->getVersion());
     stdBuiltins = builder.import("GLSL.std.450");
     builder.setMemoryModel(spv::AddressingModelLogical, spv::MemoryModelGLSL450);
-    shaderEntry = builder.makeMain();
-    builder.addEntryPoint(executionModel, shaderEntry, "main");
+    if (glslangIntermediate->isEntryPointDefined(entryPoint)) {
+        shaderEntry = builder.makeMain(entryPoint.c_str());
+        builder.addEntryPoint(executionModel, shaderEntry, entryPoint.c_str());
+    }
+    if (library)
+        builder.addCapability(spv::CapabilityLinkage);
 
     // Add the source extensions
     const auto& sourceExtensions = glslangIntermediate->getRequestedExtensions();
     for (auto it = sourceExtensions.begin(); it != sourceExtensions.end(); ++it)
         builder.addSourceExtension(it->c_str());
 
+    // A library with no main() has no entry point to give modes to, just the
+    // capability its stage needs.
+    if (shaderEntry == 0) {
+        mainTerminated = true;
+        switch (glslangIntermediate->getStage()) {
+        case EShLangTessControl:
+        case EShLangTessEvaluation:
+            builder.addCapability(spv::CapabilityTessellation);
+            break;
+        case EShLangGeometry:
+            builder.addCapability(spv::CapabilityGeometry);
+            break;
+        default:
+            builder.addCapability(spv::CapabilityShader);
+            break;
+        }
+
+        return;
+    }
+
     // Add the top-level modes for this shader.
 
     if (glslangIntermediate->getXfbMode())
@@ -545,6 +696,21 @@ TGlslangToSpvTraverser::TGlslangToSpvTraverser(const glslang::TIntermediate* gls
 
 }
 
+// A fork, for translating function bodies once the parent has made the
+// functions and global initializers.
+TGlslangToSpvTraverser::TGlslangToSpvTraverser(const TGlslangToSpvTraverser& parent, spv::Id firstId)
+    : TIntermTraverser(true, false, true), shaderEntry(0), sequenceDepth(parent.sequenceDepth),
+      builder(parent.builder, firstId),
+      inMain(false), mainTerminated(true), linkageOnly(false), library(parent.library),
+      glslangIntermediate(parent.glslangIntermediate), stdBuiltins(parent.stdBuiltins),
+      symbolValues(parent.symbolValues), constReadOnlyParameters(parent.constReadOnlyParameters),
+      functionMap(parent.functionMap), entryPoint(parent.entryPoint), reachableFunctions(parent.reachableFunctions),
+      structMap(parent.structMap), memberRemapper(parent.memberRemapper),
+      numThreads(1), streaming(false), forwardLoadsAndStores(false), eliminateCommonSubexpressions(false),
+      mediump16(parent.mediump16), forked(true), forkBody(0)
+{
+}
+
 TGlslangToSpvTraverser::~TGlslangToSpvTraverser()
 {
     if (! mainTerminated) {
@@ -586,9 +752,12 @@ void TGlslangToSpvTraverser::visitSymbol(glslang::TIntermSymbol* symbol)
         // For now, we consider all user variables as being in memory, so they are pointers,
         // except for "const in" arguments to a function, which are an intermediate object.
         // See comments in handleUserFunctionCall().
+        // Specialization constants are not in memory either.
         glslang::TStorageQualifier qualifier = symbol->getQualifier().storage;
         if (qualifier == glslang::EvqConstReadOnly && constReadOnlyParameters.find(symbol->getId()) != constReadOnlyParameters.end())
             builder.setAccessChainRValue(id);
+        else if (symbol->getQualifier().hasSpecConstantId())
+            builder.setAccessChainRValue(id);
         else
             builder.setAccessChainLValue(id);
     }
@@ -626,12 +795,12 @@ bool TGlslangToSpvTraverser::visitBinary(glslang::TVisit /* visit */, glslang::T
             // evaluate the right
             builder.clearAccessChain();
             node->getRight()->traverse(this);
-            spv::Id rValue = builder.accessChainLoad(convertGlslangToSpvType(node->getRight()->getType()));
+            spv::Id rValue = accessChainLoad(node->getRight()->getType());
 
             if (node->getOp() != glslang::EOpAssign) {
                 // the left is also an r-value
                 builder.setAccessChain(lValue);
-                spv::Id leftRValue = builder.accessChainLoad(convertGlslangToSpvType(node->getLeft()->getType()));
+                spv::Id leftRValue = accessChainLoad(node->getLeft()->getType());
 
                 // do the operation
                 rValue = createBinaryOperation(node->getOp(), TranslatePrecisionDecoration(node->getType()), 
@@ -645,7 +814,7 @@ bool TGlslangToSpvTraverser::visitBinary(glslang::TVisit /* visit */, glslang::T
 
             // store the result
             builder.setAccessChain(lValue);
-            builder.accessChainStore(rValue);
+            accessChainStore(rValue);
 
             // assignments are expressions having an rValue after they are evaluated...
             builder.clearAccessChain();
@@ -683,7 +852,7 @@ bool TGlslangToSpvTraverser::visitBinary(glslang::TVisit /* visit */, glslang::T
                 // so short circuit the access-chain stuff with a swizzle.
                 std::vector<unsigned> swizzle;
                 swizzle.push_back(node->getRight()->getAsConstantUnion()->getConstArray()[0].getIConst());
-                builder.accessChainPushSwizzle(swizzle, convertGlslangToSpvType(node->getLeft()->getType()));
+                builder.accessChainPushSwizzle(swizzle, getAccessChainType(node->getLeft()->getType()));
             } else {
                 // normal case for indexing array or structure or block
                 builder.accessChainPush(builder.makeIntConstant(index));
@@ -707,13 +876,13 @@ bool TGlslangToSpvTraverser::visitBinary(glslang::TVisit /* visit */, glslang::T
             // compute the next index in the chain
             builder.clearAccessChain();
             node->getRight()->traverse(this);
-            spv::Id index = builder.accessChainLoad(convertGlslangToSpvType(node->getRight()->getType()));
+            spv::Id index = convertToWidth(accessChainLoad(node->getRight()->getType()), 32);
 
             // restore the saved access chain
             builder.setAccessChain(partial);
 
             if (! node->getLeft()->getType().isArray() && node->getLeft()->getType().isVector())
-                builder.accessChainPushComponent(index, convertGlslangToSpvType(node->getLeft()->getType()));
+                builder.accessChainPushComponent(index, getAccessChainType(node->getLeft()->getType()));
             else
                 builder.accessChainPush(index);
         }
@@ -725,7 +894,7 @@ bool TGlslangToSpvTraverser::visitBinary(glslang::TVisit /* visit */, glslang::T
             std::vector<unsigned> swizzle;
             for (int i = 0; i < (int)swizzleSequence.size(); ++i)
                 swizzle.push_back(swizzleSequence[i]->getAsConstantUnion()->getConstArray()[0].getIConst());
-            builder.accessChainPushSwizzle(swizzle, convertGlslangToSpvType(node->getLeft()->getType()));
+            builder.accessChainPushSwizzle(swizzle, getAccessChainType(node->getLeft()->getType()));
         }
         return false;
     case glslang::EOpLogicalOr:
@@ -752,11 +921,11 @@ bool TGlslangToSpvTraverser::visitBinary(glslang::TVisit /* visit */, glslang::T
     // Get the operands
     builder.clearAccessChain();
     node->getLeft()->traverse(this);
-    spv::Id left = builder.accessChainLoad(convertGlslangToSpvType(node->getLeft()->getType()));
+    spv::Id left = accessChainLoad(node->getLeft()->getType());
 
     builder.clearAccessChain();
     node->getRight()->traverse(this);
-    spv::Id right = builder.accessChainLoad(convertGlslangToSpvType(node->getRight()->getType()));
+    spv::Id right = accessChainLoad(node->getRight()->getType());
 
     spv::Id result;
     spv::Decoration precision = TranslatePrecisionDecoration(node->getType());
@@ -822,7 +991,7 @@ bool TGlslangToSpvTraverser::visitUnary(glslang::TVisit /* visit */, glslang::TI
         node->getOp() == glslang::EOpAtomicCounter)
         operand = builder.accessChainGetLValue(); // Special case l-value operands
     else
-        operand = builder.accessChainLoad(convertGlslangToSpvType(node->getOperand()->getType()));
+        operand = accessChainLoad(node->getOperand()->getType());
 
     spv::Decoration precision = TranslatePrecisionDecoration(node->getType());
 
@@ -867,7 +1036,7 @@ bool TGlslangToSpvTraverser::visitUnary(glslang::TVisit /* visit */, glslang::TI
 
             // The result of operation is always stored, but conditionally the
             // consumed result.  The consumed result is always an r-value.
-            builder.accessChainStore(result);
+            accessChainStore(result);
             builder.clearAccessChain();
             if (node->getOp() == glslang::EOpPreIncrement ||
                 node->getOp() == glslang::EOpPreDecrement)
@@ -976,8 +1145,15 @@ bool TGlslangToSpvTraverser::visitAggregate(glslang::TVisit visit, glslang::TInt
         } else {
             if (inMain)
                 mainTerminated = true;
+            spv::Function& function = builder.getBuildPoint()->getParent();
             builder.leaveFunction();
             inMain = false;
+
+            if (streaming) {
+                if (forwardLoadsAndStores || eliminateCommonSubexpressions)
+                    builder.simplify(function, forwardLoadsAndStores, eliminateCommonSubexpressions);
+                builder.streamFunction(function);
+            }
         }
 
         return true;
@@ -1047,8 +1223,15 @@ bool TGlslangToSpvTraverser::visitAggregate(glslang::TVisit visit, glslang::TInt
         std::vector<spv::Id> arguments;
         translateArguments(*node, arguments);
         spv::Id resultTypeId = convertGlslangToSpvType(node->getType());
-        spv::Id constructed;
-        if (node->getOp() == glslang::EOpConstructStruct || node->getType().isArray()) {
+        if (mediump16) {
+            bool aggregate = builder.isAggregateType(resultTypeId);
+            for (int c = 0; c < (int)arguments.size(); ++c)
+                arguments[c] = convertToWidthOf(arguments[c], aggregate ? builder.getContainedTypeId(resultTypeId, c) : resultTypeId);
+        }
+        spv::Id constructed = isMatrix ? spv::NoResult : createSpvSpecConstantComposite(resultTypeId, arguments);
+        if (constructed != spv::NoResult) {
+            // it was made of specialization constants
+        } else if (node->getOp() == glslang::EOpConstructStruct || node->getType().isArray()) {
             std::vector<spv::Id> constituents;
             for (int c = 0; c < (int)arguments.size(); ++c)
                 constituents.push_back(arguments[c]);
@@ -1160,11 +1343,11 @@ bool TGlslangToSpvTraverser::visitAggregate(glslang::TVisit visit, glslang::TInt
 
         builder.clearAccessChain();
         left->traverse(this);
-        spv::Id leftId = builder.accessChainLoad(convertGlslangToSpvType(left->getType()));
+        spv::Id leftId = accessChainLoad(left->getType());
 
         builder.clearAccessChain();
         right->traverse(this);
-        spv::Id rightId = builder.accessChainLoad(convertGlslangToSpvType(right->getType()));
+        spv::Id rightId = accessChainLoad(right->getType());
 
         result = createBinaryOperation(binOp, precision, 
                                        convertGlslangToSpvType(node->getType()), leftId, rightId, 
@@ -1217,7 +1400,7 @@ bool TGlslangToSpvTraverser::visitAggregate(glslang::TVisit visit, glslang::TInt
         if (lvalue)
             operands.push_back(builder.accessChainGetLValue());
         else
-            operands.push_back(builder.accessChainLoad(convertGlslangToSpvType(glslangOperands[arg]->getAsTyped()->getType())));
+            operands.push_back(accessChainLoad(glslangOperands[arg]->getAsTyped()->getType()));
     }
 
     if (atomic) {
@@ -1257,23 +1440,25 @@ bool TGlslangToSpvTraverser::visitSelection(glslang::TVisit /* visit */, glslang
     // The if-then-else has a node type of void, while
     // ?: has a non-void node type
     spv::Id result = 0;
+    spv::Id resultTypeId = 0;
     if (node->getBasicType() != glslang::EbtVoid) {
         // don't handle this as just on-the-fly temporaries, because there will be two names
         // and better to leave SSA to later passes
-        result = builder.createVariable(spv::StorageClassFunction, convertGlslangToSpvType(node->getType()));
+        resultTypeId = convertGlslangToSpvType(node->getType());
+        result = builder.createVariable(spv::StorageClassFunction, resultTypeId);
     }
 
     // emit the condition before doing anything with selection
     node->getCondition()->traverse(this);
 
     // make an "if" based on the value created by the condition
-    spv::Builder::If ifBuilder(builder.accessChainLoad(convertGlslangToSpvType(node->getCondition()->getType())), builder);
+    spv::Builder::If ifBuilder(accessChainLoad(node->getCondition()->getType()), builder);
 
     if (node->getTrueBlock()) {
         // emit the "then" statement
         node->getTrueBlock()->traverse(this);
         if (result)
-            builder.createStore(builder.accessChainLoad(convertGlslangToSpvType(node->getTrueBlock()->getAsTyped()->getType())), result);
+            builder.createStore(convertToWidthOf(accessChainLoad(node->getTrueBlock()->getAsTyped()->getType()), resultTypeId), result);
     }
 
     if (node->getFalseBlock()) {
@@ -1281,7 +1466,7 @@ bool TGlslangToSpvTraverser::visitSelection(glslang::TVisit /* visit */, glslang
         // emit the "else" statement
         node->getFalseBlock()->traverse(this);
         if (result)
-            builder.createStore(builder.accessChainLoad(convertGlslangToSpvType(node->getFalseBlock()->getAsTyped()->getType())), result);
+            builder.createStore(convertToWidthOf(accessChainLoad(node->getFalseBlock()->getAsTyped()->getType()), resultTypeId), result);
     }
 
     ifBuilder.makeEndIf();
@@ -1302,7 +1487,7 @@ bool TGlslangToSpvTraverser::visitSwitch(glslang::TVisit /* visit */, glslang::T
 {
     // emit and get the condition before doing anything with switch
     node->getCondition()->traverse(this);
-    spv::Id selector = builder.accessChainLoad(convertGlslangToSpvType(node->getCondition()->getAsTyped()->getType()));
+    spv::Id selector = convertToWidth(accessChainLoad(node->getCondition()->getAsTyped()->getType()), 32);
 
     // browse the children to sort out code segments
     int defaultSegment = -1;
@@ -1327,6 +1512,18 @@ bool TGlslangToSpvTraverser::visitSwitch(glslang::TVisit /* visit */, glslang::T
         (int)codeSegments.size() == defaultSegment)
         codeSegments.push_back(nullptr);
 
+    // Segments that only break are all the same: labels on them go straight to the
+    // merge block, and so does falling through into one, so none gets a block.
+    std::vector<bool> breakOnly(codeSegments.size());
+    for (unsigned int s = 0; s < codeSegments.size(); ++s)
+        breakOnly[s] = isBreakOnly(codeSegments[s]);
+    for (unsigned int v = 0; v < caseValues.size(); ++v) {
+        if (breakOnly[valueIndexToSegment[v]])
+            valueIndexToSegment[v] = -1;
+    }
+    if (defaultSegment >= 0 && breakOnly[defaultSegment])
+        defaultSegment = -1;
+
     // make the switch statement
     std::vector<spv::Block*> segmentBlocks; // returned, as the blocks allocated in the call
     builder.makeSwitch(selector, (int)codeSegments.size(), caseValues, valueIndexToSegment, defaultSegment, segmentBlocks);
@@ -1334,6 +1531,11 @@ bool TGlslangToSpvTraverser::visitSwitch(glslang::TVisit /* visit */, glslang::T
     // emit all the code in the segments
     breakForLoop.push(false);
     for (unsigned int s = 0; s < codeSegments.size(); ++s) {
+        if (breakOnly[s]) {
+            if (! builder.getBuildPoint()->isTerminated())
+                builder.addSwitchBreak();
+            continue;
+        }
         builder.nextSwitchSegment(segmentBlocks, s);
         if (codeSegments[s])
             codeSegments[s]->traverse(this);
@@ -1361,12 +1563,12 @@ bool TGlslangToSpvTraverser::visitLoop(glslang::TVisit /* visit */, glslang::TIn
     // body emission needs to know what the for-loop terminal is when it sees a "continue"
     loopTerminal.push(node->getTerminal());
 
-    builder.makeNewLoop(node->testFirst());
+    builder.makeNewLoop(node->testFirst(), TranslateLoopControl(node->getLoopControl()));
 
     if (node->getTest()) {
         node->getTest()->traverse(this);
         // the AST only contained the test computation, not the branch, we have to add it
-        spv::Id condition = builder.accessChainLoad(convertGlslangToSpvType(node->getTest()->getType()));
+        spv::Id condition = accessChainLoad(node->getTest()->getType());
         builder.createLoopTestBranch(condition);
     } else {
         builder.createBranchToBody();
@@ -1410,7 +1612,8 @@ bool TGlslangToSpvTraverser::visitBranch(glslang::TVisit /* visit */, glslang::T
         break;
     case glslang::EOpReturn:
         if (node->getExpression())
-            builder.makeReturn(false, builder.accessChainLoad(convertGlslangToSpvType(node->getExpression()->getType())));
+            builder.makeReturn(false, convertToWidthOf(accessChainLoad(node->getExpression()->getType()),
+                                                       builder.getBuildPoint()->getParent().getReturnType()));
         else
             builder.makeReturn(false);
 
@@ -1429,9 +1632,9 @@ spv::Id TGlslangToSpvTraverser::createSpvVariable(const glslang::TIntermSymbol*
 {
     // First, steer off constants, which are not SPIR-V variables, but 
     // can still have a mapping to a SPIR-V Id.
-    if (node->getQualifier().storage == glslang::EvqConst) {
+    if (node->getQualifier().storage == glslang::EvqConst || node->getQualifier().hasSpecConstantId()) {
         int nextConst = 0;
-        return createSpvConstant(node->getType(), node->getConstArray(), nextConst);
+        return createSpvConstant(node->getType(), node->getConstArray(), nextConst, node->getQualifier().hasSpecConstantId());
     }
 
     // Now, handle actual variables
@@ -1462,7 +1665,86 @@ spv::Id TGlslangToSpvTraverser::getSampledType(const glslang::TSampler& sampler)
 // recursive version of this function.
 spv::Id TGlslangToSpvTraverser::convertGlslangToSpvType(const glslang::TType& type)
 {
-    return convertGlslangToSpvType(type, requiresExplicitLayout(type));
+    spv::Id spvType = convertGlslangToSpvType(type, requiresExplicitLayout(type));
+    if (isLowered(type))
+        spvType = builder.makeTypeOfWidth(spvType, 16);
+
+    return spvType;
+}
+
+// With mediump16, whether values of 'type' are 16 bits wide.  Only the mediump and
+// lowp int, uint, and float scalars and vectors that are temporaries or variables of
+// the shader's own are: what the API or other stages see, the contents of arrays,
+// structures, and matrices, constants, and the parameters and return values of
+// functions all stay 32 bits wide.  Values are converted as they go from one to the
+// other, so each is loaded as it's held, and converted to the width of its type.
+bool TGlslangToSpvTraverser::isLowered(const glslang::TType& type) const
+{
+    if (! mediump16 || type.isArray() || type.isMatrix())
+        return false;
+
+    switch (type.getBasicType()) {
+    case glslang::EbtFloat:
+    case glslang::EbtInt:
+    case glslang::EbtUint:
+        break;
+    default:
+        return false;
+    }
+
+    if (type.getQualifier().precision != glslang::EpqMedium && type.getQualifier().precision != glslang::EpqLow)
+        return false;
+
+    return type.getQualifier().storage == glslang::EvqTemporary || type.getQualifier().storage == glslang::EvqGlobal;
+}
+
+// With mediump16, the 32-bit type of a 16-bit 'typeId'; otherwise 'typeId'.
+spv::Id TGlslangToSpvTraverser::getWideType(spv::Id typeId)
+{
+    if (mediump16 && builder.getScalarTypeWidth(typeId) == 16)
+        return builder.makeTypeOfWidth(typeId, 32);
+
+    return typeId;
+}
+
+// The type of what the access chain refers to, of glslang 'type'; with mediump16,
+// it can be held at a width other than that of 'type'.
+spv::Id TGlslangToSpvTraverser::getAccessChainType(const glslang::TType& type)
+{
+    return mediump16 ? builder.accessChainGetInferredType() : convertGlslangToSpvType(type);
+}
+
+// Load the r-value of glslang 'type' the access chain refers to.
+spv::Id TGlslangToSpvTraverser::accessChainLoad(const glslang::TType& type)
+{
+    spv::Id typeId = convertGlslangToSpvType(type);
+    if (! mediump16)
+        return builder.accessChainLoad(typeId);
+
+    return builder.createWidthConversion(builder.accessChainLoad(builder.accessChainGetInferredType()),
+                                         builder.getScalarTypeWidth(typeId));
+}
+
+// Store 'rvalue' to what the access chain refers to, converted to its width.
+void TGlslangToSpvTraverser::accessChainStore(spv::Id rvalue)
+{
+    if (mediump16)
+        rvalue = builder.createWidthConversion(rvalue, builder.getScalarTypeWidth(builder.accessChainGetInferredType()));
+
+    builder.accessChainStore(rvalue);
+}
+
+// With mediump16, 'value' converted to be 'width' bits wide, if it's an int or float
+// scalar or vector of 16 or 32 bits (see spv::Builder::createWidthConversion()).
+spv::Id TGlslangToSpvTraverser::convertToWidth(spv::Id value, int width)
+{
+    return mediump16 ? builder.createWidthConversion(value, width) : value;
+}
+
+// As above, to the width of 'typeId'.
+spv::Id TGlslangToSpvTraverser::convertToWidthOf(spv::Id value, spv::Id typeId)
+{
+    return mediump16 ? builder.createWidthConversion(value, builder.getScalarTypeWidth(typeId)) : value;
 }
 
 // Do full recursive conversion of an arbitrary glslang type to a SPIR-V Id.
@@ -1517,6 +1799,7 @@ spv::Id TGlslangToSpvTraverser::convertGlslangToSpvType(const glslang::TType& ty
                 break;
 
             // else, we haven't seen it...
+            int madeStruct = beginMade(glslangStruct, 0);
 
             // Create a vector of struct types for SPIR-V to consume
             int memberDelta = 0;  // how much the member's index changes from glslang to SPIR-V, normally 0, except sometimes for blocks
@@ -1590,6 +1873,7 @@ spv::Id TGlslangToSpvTraverser::convertGlslangToSpvType(const glslang::TType& ty
                 if (type.getQualifier().hasXfbBuffer())
                     builder.addDecoration(spvType, spv::DecorationXfbBuffer, type.getQualifier().layoutXfbBuffer);
             }
+            endMade(madeStruct, spvType);
         }
         break;
     default:
@@ -1701,17 +1985,28 @@ void TGlslangToSpvTraverser::updateMemberOffset(const glslang::TType& structType
 
 bool TGlslangToSpvTraverser::isShaderEntrypoint(const glslang::TIntermAggregate* node)
 {
-    return node->getName() == "main(";
+    const glslang::TString& name = node->getName();
+    return name.size() == entryPoint.size() + 1 && name.compare(0, entryPoint.size(), entryPoint.c_str()) == 0 &&
+           name[entryPoint.size()] == '(';
 }
 
 // Make all the functions, skeletally, without actually visiting their bodies.
 void TGlslangToSpvTraverser::makeFunctions(const glslang::TIntermSequence& glslFunctions)
 {
+    // declarations go before definitions
+    if (library)
+        makeImports(glslFunctions);
+
     for (int f = 0; f < (int)glslFunctions.size(); ++f) {
         glslang::TIntermAggregate* glslFunction = glslFunctions[f]->getAsAggregate();
         if (! glslFunction || glslFunction->getOp() != glslang::EOpFunction || isShaderEntrypoint(glslFunction))
             continue;
 
+        // Nothing can call it, so don't translate it at all; a library's functions
+        // are all for modules linking it to call.
+        if (! library && reachableFunctions.find(glslFunction->getName().c_str()) == reachableFunctions.end())
+            continue;
+
         // We're on a user function.  Set up the basic interface for the function now,
         // so that it's available to call.
         // Translating the body will happen later.
@@ -1741,11 +2036,13 @@ void TGlslangToSpvTraverser::makeFunctions(const glslang::TIntermSequence& glslF
         }
 
         spv::Block* functionBlock;
-        spv::Function *function = builder.makeFunctionEntry(convertGlslangToSpvType(glslFunction->getType()), glslFunction->getName().c_str(),
+        spv::Function *function = builder.makeFunctionEntry(getWideType(convertGlslangToSpvType(glslFunction->getType())), glslFunction->getName().c_str(),
                                                               paramTypes, &functionBlock);
 
         // Track function to emit/call later
         functionMap[glslFunction->getName().c_str()] = function;
+        if (library)
+            builder.addLinkage(function->getId(), glslFunction->getName().c_str(), spv::LinkageTypeExport);
 
         // Set the parameter id's
         for (int p = 0; p < (int)parameters.size(); ++p) {
@@ -1756,13 +2053,78 @@ void TGlslangToSpvTraverser::makeFunctions(const glslang::TIntermSequence& glslF
     }
 }
 
+// Finds the calls to functions with no body here, for a library to import.
+class TImportFinder : public glslang::TIntermTraverser {
+public:
+    TImportFinder(const std::unordered_set<std::string>& defined) : names(defined) { }
+
+    virtual bool visitAggregate(glslang::TVisit, glslang::TIntermAggregate* node)
+    {
+        if (node->getOp() == glslang::EOpFunctionCall && node->isUserDefined() &&
+            names.insert(node->getName().c_str()).second)
+            calls.push_back(node);
+
+        return true;
+    }
+
+    std::vector<const glslang::TIntermAggregate*> calls;  // the first call of each
+
+protected:
+    std::unordered_set<std::string> names;  // defined, or already called
+};
+
+// Declare, without bodies, the functions called but not defined, importing them
+// from whatever the module gets linked with.  A call has the types of the
+// parameters: its arguments were converted to them, and its qualifier list
+// gives how each is passed (see makeFunctions()).
+void TGlslangToSpvTraverser::makeImports(const glslang::TIntermSequence& glslFunctions)
+{
+    std::unordered_set<std::string> defined;
+    for (int f = 0; f < (int)glslFunctions.size(); ++f) {
+        glslang::TIntermAggregate* glslFunction = glslFunctions[f]->getAsAggregate();
+        if (glslFunction && glslFunction->getOp() == glslang::EOpFunction)
+            defined.insert(glslFunction->getName().c_str());
+    }
+
+    TImportFinder finder(defined);
+    for (int f = 0; f < (int)glslFunctions.size(); ++f) {
+        glslang::TIntermAggregate* glslFunction = glslFunctions[f]->getAsAggregate();
+        if (glslFunction && glslFunction->getOp() == glslang::EOpFunction)
+            glslFunction->traverse(&finder);
+    }
+
+    for (size_t c = 0; c < finder.calls.size(); ++c) {
+        const glslang::TIntermAggregate* call = finder.calls[c];
+        const glslang::TIntermSequence& args = call->getSequence();
+        const glslang::TQualifierList& qualifiers = call->getQualifierList();
+
+        std::vector<spv::Id> paramTypes;
+        for (int a = 0; a < (int)args.size(); ++a) {
+            spv::Id typeId = getWideType(convertGlslangToSpvType(args[a]->getAsTyped()->getType()));
+            if (qualifiers[a] != glslang::EvqConstReadOnly)
+                typeId = builder.makePointer(spv::StorageClassFunction, typeId);
+            paramTypes.push_back(typeId);
+        }
+
+        spv::Function *function = builder.makeFunctionEntry(getWideType(convertGlslangToSpvType(call->getType())), call->getName().c_str(),
+                                                              paramTypes, 0);
+        functionMap[call->getName().c_str()] = function;
+        builder.addLinkage(function->getId(), call->getName().c_str(), spv::LinkageTypeImport);
+    }
+}
+
 // Process all the initializers, while skipping the functions and link objects
 void TGlslangToSpvTraverser::makeGlobalInitializers(const glslang::TIntermSequence& initializers)
 {
-    builder.setBuildPoint(shaderEntry->getLastBlock());
+    if (shaderEntry)
+        builder.setBuildPoint(shaderEntry->getLastBlock());
     for (int i = 0; i < (int)initializers.size(); ++i) {
         glslang::TIntermAggregate* initializer = initializers[i]->getAsAggregate();
         if (initializer && initializer->getOp() != glslang::EOpFunction && initializer->getOp() != glslang::EOpLinkerObjects) {
+            if (! shaderEntry) {
+                spv::MissingFunctionality("global initializer in a library without main()");
+                continue;
+            }
 
             // We're on a top-level node that's not a function.  Treat as an initializer, whose
             // code goes into the beginning of main.
@@ -1774,11 +2136,195 @@ void TGlslangToSpvTraverser::makeGlobalInitializers(const glslang::TIntermSequen
 // Process all the functions, while skipping initializers.
 void TGlslangToSpvTraverser::visitFunctions(const glslang::TIntermSequence& glslFunctions)
 {
+    std::vector<glslang::TIntermAggregate*> nodes;
+    int numForkable = 0;
     for (int f = 0; f < (int)glslFunctions.size(); ++f) {
         glslang::TIntermAggregate* node = glslFunctions[f]->getAsAggregate();
-        if (node && (node->getOp() == glslang::EOpFunction || node->getOp() == glslang ::EOpLinkerObjects))
-            node->traverse(this);
+        if (node && (node->getOp() == glslang::EOpFunction || node->getOp() == glslang ::EOpLinkerObjects)) {
+            if (node->getOp() == glslang::EOpFunction && functionMap.find(node->getName().c_str()) == functionMap.end() &&
+                ! isShaderEntrypoint(node))
+                continue;
+            nodes.push_back(node);
+            if (node->getOp() == glslang::EOpFunction && ! isShaderEntrypoint(node))
+                ++numForkable;
+        }
     }
+
+    if (numThreads != 1 && numForkable > 1) {
+        visitFunctionsInParallel(nodes);
+        return;
+    }
+
+    for (int n = 0; n < (int)nodes.size(); ++n)
+        nodes[n]->traverse(this);
+}
+
+//
+// Translate the function bodies other than main() in forks, on up to
+// numThreads threads, each fork taking the next body not yet taken.  A fork
+// sees everything made before the bodies, numbers what it makes itself apart,
+// and notes what another fork might make too.  Then, in the order a single
+// traverser would have translated them, join each fork's body (giving it this
+// builder's next ids, and mapping the struct types and global variables already
+// here), or translate main() and the linker objects here in place.  So the
+// module is the same as a single traverser makes, whatever the threads do.
+//
+void TGlslangToSpvTraverser::visitFunctionsInParallel(const std::vector<glslang::TIntermAggregate*>& nodes)
+{
+    std::vector<int> forkable;
+    for (int n = 0; n < (int)nodes.size(); ++n) {
+        if (nodes[n]->getOp() == glslang::EOpFunction && ! isShaderEntrypoint(nodes[n]))
+            forkable.push_back(n);
+    }
+
+    int numForks = numThreads > 0 ? numThreads : (int)std::thread::hardware_concurrency();
+    numForks = std::max(1, std::min(numForks, (int)forkable.size()));
+
+    std::vector<TForked> translated(nodes.size());
+    for (size_t n = 0; n < translated.size(); ++n)
+        translated[n].fork = 0;
+    std::atomic<int> nextForkable(0);
+    std::mutex mutex;
+    std::condition_variable changed;
+    int numTranslating = numForks - 1;
+    bool joined = false;
+
+    const auto translateForkable = [&](TGlslangToSpvTraverser& fork) {
+        for (int f = nextForkable++; f < (int)forkable.size(); f = nextForkable++)
+            fork.translateFunction(nodes[forkable[f]], translated[forkable[f]]);
+    };
+
+    // The other forks each have a thread and pool of their own, and stay until joined.
+    std::vector<std::thread> threads;
+    for (int t = 1; t < numForks; ++t) {
+        threads.push_back(std::thread([&] {
+            glslang::InitializeMemoryPools();
+            {
+                TGlslangToSpvTraverser fork(*this, spv::Builder::forkIds);
+                translateForkable(fork);
+
+                std::unique_lock<std::mutex> lock(mutex);
+                --numTranslating;
+                changed.notify_all();
+                changed.wait(lock, [&] { return joined; });
+            }
+            glslang::FreeGlobalPools();
+        }));
+    }
+
+    TGlslangToSpvTraverser fork(*this, spv::Builder::forkIds);
+    translateForkable(fork);
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return numTranslating == 0; });
+    }
+
+    std::vector<TGlslangToSpvTraverser*> forks;
+    for (int n = 0; n < (int)nodes.size(); ++n) {
+        if (translated[n].fork) {
+            joinFork(translated[n]);
+            if (std::find(forks.begin(), forks.end(), translated[n].fork) == forks.end())
+                forks.push_back(translated[n].fork);
+        } else
+            nodes[n]->traverse(this);
+    }
+    for (size_t f = 0; f < forks.size(); ++f)
+        builder.adoptFork(forks[f]->builder);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        joined = true;
+    }
+    changed.notify_all();
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+}
+
+// In a fork, translate one function body.
+void TGlslangToSpvTraverser::translateFunction(glslang::TIntermAggregate* node, TForked& translated)
+{
+    translated.fork = this;
+    translated.begin = builder.getForkMark();
+    translated.madeBegin = made.size();
+    node->traverse(this);
+    translated.body = forkBody;
+    translated.end = builder.getForkMark();
+    translated.madeEnd = made.size();
+}
+
+// Join a body a fork translated (see visitFunctionsInParallel()).
+void TGlslangToSpvTraverser::joinFork(const TForked& translated)
+{
+    TGlslangToSpvTraverser& fork = *translated.fork;
+
+    // What the fork made that's here already, from an earlier join or main()
+    std::vector<spv::Builder::ForkSpan> found;
+    std::vector<bool> isFound(translated.madeEnd - translated.madeBegin, false);
+    for (size_t m = translated.madeBegin; m < translated.madeEnd; ++m) {
+        const TMade& made = fork.made[m];
+        if (! found.empty() && made.begin.id < found.back().end.id)
+            continue;  // inside what's found
+
+        spv::Id id = 0;
+        if (made.glslangStruct) {
+            auto it = structMap.find(made.glslangStruct);
+            if (it != structMap.end())
+                id = it->second;
+        } else {
+            auto it = symbolValues.find(made.symbolId);
+            if (it != symbolValues.end())
+                id = it->second;
+        }
+        if (id) {
+            spv::Builder::ForkSpan span = { made.begin, made.end, made.id, id };
+            found.push_back(span);
+            isFound[m - translated.madeBegin] = true;
+        }
+    }
+
+    builder.join(fork.builder, translated.body, translated.begin, translated.end, found);
+
+    // What's here now
+    for (size_t m = translated.madeBegin; m < translated.madeEnd; ++m) {
+        const TMade& made = fork.made[m];
+        if (isFound[m - translated.madeBegin])
+            continue;
+        spv::Id id = builder.getJoinedId(fork.builder, made.id);
+        if (made.glslangStruct) {
+            if (structMap[made.glslangStruct] != 0)
+                continue;  // inside what's found
+            structMap[made.glslangStruct] = id;
+            auto remapper = fork.memberRemapper.find(made.glslangStruct);
+            if (remapper != fork.memberRemapper.end())
+                memberRemapper[made.glslangStruct] = remapper->second;
+        } else
+            symbolValues.insert(std::make_pair(made.symbolId, id));
+    }
+}
+
+// In a fork, note the start of making something another fork might make too.
+int TGlslangToSpvTraverser::beginMade(const glslang::TTypeList* glslangStruct, int symbolId)
+{
+    if (! forked)
+        return -1;
+
+    TMade thing;
+    thing.glslangStruct = glslangStruct;
+    thing.symbolId = symbolId;
+    thing.begin = builder.getForkMark();
+    thing.id = 0;
+    made.push_back(thing);
+
+    return (int)made.size() - 1;
+}
+
+void TGlslangToSpvTraverser::endMade(int thing, spv::Id id)
+{
+    if (thing < 0)
+        return;
+
+    made[thing].end = builder.getForkMark();
+    made[thing].id = id;
 }
 
 void TGlslangToSpvTraverser::handleFunctionEntry(const glslang::TIntermAggregate* node)
@@ -1786,6 +2332,10 @@ void TGlslangToSpvTraverser::handleFunctionEntry(const glslang::TIntermAggregate
     // SPIR-V functions should already be in the functionMap from the prepass 
     // that called makeFunctions().
     spv::Function* function = functionMap[node->getName().c_str()];
+    if (forked) {
+        forkBody = builder.makeFunctionBody(*function);
+        return;
+    }
     spv::Block* functionBlock = function->getEntryBlock();
     builder.setBuildPoint(functionBlock);
 }
@@ -1818,7 +2368,7 @@ void TGlslangToSpvTraverser::translateArguments(const glslang::TIntermAggregate&
         if (lvalue)
             arguments.push_back(builder.accessChainGetLValue());
         else
-            arguments.push_back(builder.accessChainLoad(convertGlslangToSpvType(glslangArguments[i]->getAsTyped()->getType())));
+            arguments.push_back(accessChainLoad(glslangArguments[i]->getAsTyped()->getType()));
     }
 }
 
@@ -1826,7 +2376,7 @@ void TGlslangToSpvTraverser::translateArguments(glslang::TIntermUnary& node, std
 {
     builder.clearAccessChain();
     node.getOperand()->traverse(this);
-    arguments.push_back(builder.accessChainLoad(convertGlslangToSpvType(node.getOperand()->getType())));
+    arguments.push_back(accessChainLoad(node.getOperand()->getType()));
 }
 
 spv::Id TGlslangToSpvTraverser::createImageTextureFunctionCall(glslang::TIntermOperator* node)
@@ -1845,6 +2395,13 @@ spv::Id TGlslangToSpvTraverser::createImageTextureFunctionCall(glslang::TIntermO
         translateArguments(*node->getAsUnaryNode(), arguments);
     spv::Decoration precision = TranslatePrecisionDecoration(node->getType());
 
+    // images and textures are read and written 32 bits at a time
+    if (mediump16) {
+        for (int a = 0; a < (int)arguments.size(); ++a)
+            arguments[a] = builder.createWidthConversion(arguments[a], 32);
+    }
+    spv::Id resultTypeId = getWideType(convertGlslangToSpvType(node->getType()));
+
     spv::Builder::TextureParameters params = { };
     params.sampler = arguments[0];
 
@@ -1885,7 +2442,7 @@ spv::Id TGlslangToSpvTraverser::createImageTextureFunctionCall(glslang::TIntermO
             operands.push_back(*(opIt++));
         // TODO: add 'sample' operand
         if (node->getOp() == glslang::EOpImageLoad) {
-            return builder.createOp(spv::OpImageRead, convertGlslangToSpvType(node->getType()), operands);
+            return builder.createOp(spv::OpImageRead, resultTypeId, operands);
         } else if (node->getOp() == glslang::EOpImageStore) {
             builder.createNoResultOp(spv::OpImageWrite, operands);
             return spv::NoResult;
@@ -1894,17 +2451,17 @@ spv::Id TGlslangToSpvTraverser::createImageTextureFunctionCall(glslang::TIntermO
 
             // GLSL "IMAGE_PARAMS" will involve in constructing an image texel pointer and this pointer,
             // as the first source operand, is required by SPIR-V atomic operations.
-            operands.push_back(sampler.ms ? *(opIt++) : 0); // For non-MS, the value should be 0
+            operands.push_back(sampler.ms ? *(opIt++) : builder.makeUintConstant(0)); // For non-MS, the value should be 0
 
-            spv::Id resultTypeId = builder.makePointer(spv::StorageClassImage, convertGlslangToSpvType(node->getType()));
-            spv::Id pointer = builder.createOp(spv::OpImageTexelPointer, resultTypeId, operands);
+            spv::Id pointerTypeId = builder.makePointer(spv::StorageClassImage, resultTypeId);
+            spv::Id pointer = builder.createOp(spv::OpImageTexelPointer, pointerTypeId, operands);
 
             std::vector<spv::Id> operands;
             operands.push_back(pointer);
             for (; opIt != arguments.end(); ++opIt)
                 operands.push_back(*opIt);
 
-            return createAtomicOperation(node->getOp(), precision, convertGlslangToSpvType(node->getType()), operands, node->getBasicType());
+            return createAtomicOperation(node->getOp(), precision, resultTypeId, operands, node->getBasicType());
         }
     }
 
@@ -1967,7 +2524,7 @@ spv::Id TGlslangToSpvTraverser::createImageTextureFunctionCall(glslang::TIntermO
         ++extraArgs;
     }
 
-    return builder.createTextureCall(precision, convertGlslangToSpvType(node->getType()), cracked.fetch, cracked.proj, params);
+    return builder.createTextureCall(precision, resultTypeId, cracked.fetch, cracked.proj, params);
 }
 
 spv::Id TGlslangToSpvTraverser::handleUserFunctionCall(const glslang::TIntermAggregate* node)
@@ -1989,21 +2546,20 @@ spv::Id TGlslangToSpvTraverser::handleUserFunctionCall(const glslang::TIntermAgg
     // 4. Copy back the results
 
     // 1. Evaluate the arguments
+    // The parameters are 32 bits wide when the arguments are 16 (see isLowered()).
     std::vector<spv::Builder::AccessChain> lValues;
     std::vector<spv::Id> rValues;
-    std::vector<spv::Id> argTypes;
     for (int a = 0; a < (int)glslangArgs.size(); ++a) {
         // build l-value
         builder.clearAccessChain();
         glslangArgs[a]->traverse(this);
-        argTypes.push_back(convertGlslangToSpvType(glslangArgs[a]->getAsTyped()->getType()));
         // keep outputs as l-values, evaluate input-only as r-values
         if (qualifiers[a] != glslang::EvqConstReadOnly) {
             // save l-value
             lValues.push_back(builder.getAccessChain());
         } else {
             // process r-value
-            rValues.push_back(builder.accessChainLoad(argTypes.back()));
+            rValues.push_back(convertToWidth(accessChainLoad(glslangArgs[a]->getAsTyped()->getType()), 32));
         }
     }
 
@@ -2019,11 +2575,11 @@ spv::Id TGlslangToSpvTraverser::handleUserFunctionCall(const glslang::TIntermAgg
         if (qualifiers[a] != glslang::EvqConstReadOnly) {
             // need space to hold the copy
             const glslang::TType& paramType = glslangArgs[a]->getAsTyped()->getType();
-            arg = builder.createVariable(spv::StorageClassFunction, convertGlslangToSpvType(paramType), "param");
+            arg = builder.createVariable(spv::StorageClassFunction, getWideType(convertGlslangToSpvType(paramType)), "param");
             if (qualifiers[a] == glslang::EvqIn || qualifiers[a] == glslang::EvqInOut) {
                 // need to copy the input into output space
                 builder.setAccessChain(lValues[lValueCount]);
-                spv::Id copy = builder.accessChainLoad(argTypes[a]);
+                spv::Id copy = convertToWidth(accessChainLoad(paramType), 32);
                 builder.createStore(copy, arg);
             }
             ++lValueCount;
@@ -2044,7 +2600,7 @@ spv::Id TGlslangToSpvTraverser::handleUserFunctionCall(const glslang::TIntermAgg
             if (qualifiers[a] == glslang::EvqOut || qualifiers[a] == glslang::EvqInOut) {
                 spv::Id copy = builder.createLoad(spvArgs[a]);
                 builder.setAccessChain(lValues[lValueCount]);
-                builder.accessChainStore(copy);
+                accessChainStore(copy);
             }
             ++lValueCount;
         }
@@ -2061,6 +2617,20 @@ spv::Id TGlslangToSpvTraverser::createBinaryOperation(glslang::TOperator op, spv
     bool isUnsigned = typeProxy == glslang::EbtUint;
     bool isFloat = typeProxy == glslang::EbtFloat || typeProxy == glslang::EbtDouble;
 
+    // With mediump16, the operands are made the width of the result, or for a
+    // comparison, the wider of theirs.  Matrices stay 32 bits wide, so an operation
+    // on one is done at 32 bits.
+    if (mediump16) {
+        int width = builder.getScalarTypeWidth(typeId);
+        if (builder.isMatrix(left) || builder.isMatrix(right)) {
+            width = 32;
+            typeId = getWideType(typeId);
+        } else if (width == 0)
+            width = std::max(builder.getScalarTypeWidth(builder.getTypeId(left)), builder.getScalarTypeWidth(builder.getTypeId(right)));
+        left = builder.createWidthConversion(left, width);
+        right = builder.createWidthConversion(right, width);
+    }
+
     spv::Op binOp = spv::OpNop;
     bool needMatchingVectors = true;  // for non-matrix ops, would a scalar need to smear to match a vector?
     bool comparison = false;
@@ -2549,6 +3119,17 @@ spv::Id TGlslangToSpvTraverser::createUnaryOperation(glslang::TOperator op, spv:
         return 0;
     }
 
+    // With mediump16, an operation with a 16-bit form takes the operand at the width
+    // of the result; the rest are done at 32 bits.
+    if (mediump16 && builder.getScalarTypeWidth(typeId) != 0) {
+        if (HasAnyWidthForm(op))
+            operand = builder.createWidthConversion(operand, builder.getScalarTypeWidth(typeId));
+        else {
+            operand = builder.createWidthConversion(operand, 32);
+            typeId = getWideType(typeId);
+        }
+    }
+
     spv::Id id;
     if (libCall >= 0) {
         std::vector<spv::Id> args;
@@ -2574,12 +3155,12 @@ spv::Id TGlslangToSpvTraverser::createConversion(glslang::TOperator op, spv::Dec
     case glslang::EOpConvIntToBool:
     case glslang::EOpConvUintToBool:
         zero = builder.makeUintConstant(0);
-        zero = makeSmearedConstant(zero, vectorSize);
+        zero = convertToWidthOf(makeSmearedConstant(zero, vectorSize), builder.getTypeId(operand));
         return builder.createBinOp(spv::OpINotEqual, destType, operand, zero);
 
     case glslang::EOpConvFloatToBool:
         zero = builder.makeFloatConstant(0.0F);
-        zero = makeSmearedConstant(zero, vectorSize);
+        zero = convertToWidthOf(makeSmearedConstant(zero, vectorSize), builder.getTypeId(operand));
         return builder.createBinOp(spv::OpFOrdNotEqual, destType, operand, zero);
 
     case glslang::EOpConvDoubleToBool:
@@ -2631,6 +3212,7 @@ spv::Id TGlslangToSpvTraverser::createConversion(glslang::TOperator op, spv::Dec
     case glslang::EOpConvUintToInt:
     case glslang::EOpConvIntToUint:
         convOp = spv::OpBitcast;
+        operand = convertToWidthOf(operand, destType);
         break;
 
     case glslang::EOpConvFloatToUint:
@@ -2646,8 +3228,8 @@ spv::Id TGlslangToSpvTraverser::createConversion(glslang::TOperator op, spv::Dec
         return result;
 
     if (convOp == spv::OpSelect) {
-        zero = makeSmearedConstant(zero, vectorSize);
-        one  = makeSmearedConstant(one, vectorSize);
+        zero = convertToWidthOf(makeSmearedConstant(zero, vectorSize), destType);
+        one  = convertToWidthOf(makeSmearedConstant(one, vectorSize), destType);
         result = builder.createTriOp(convOp, destType, operand, one, zero);
     } else
         result = builder.createUnaryOp(convOp, destType, operand);
@@ -2721,6 +3303,13 @@ spv::Id TGlslangToSpvTraverser::createAtomicOperation(glslang::TOperator op, spv
         break;
     }
 
+    // atomics are on 32-bit memory, so are done at 32 bits
+    if (mediump16) {
+        typeId = getWideType(typeId);
+        for (int o = 0; o < (int)operands.size(); ++o)
+            operands[o] = builder.createWidthConversion(operands[o], 32);
+    }
+
     // Sort out the operands
     //  - mapping from glslang -> SPV
     //  - there are extra SPV operands with no glslang source
@@ -2823,6 +3412,18 @@ spv::Id TGlslangToSpvTraverser::createMiscOperation(glslang::TOperator op, spv::
         return 0;
     }
 
+    // With mediump16, these all take their operands at the width of the result,
+    // but for modf(), which is done at the width of its out operand.
+    if (mediump16 && builder.getScalarTypeWidth(typeId) != 0) {
+        int width = builder.getScalarTypeWidth(typeId);
+        if (op == glslang::EOpModf) {
+            width = builder.getScalarTypeWidth(builder.getContainedTypeId(builder.getTypeId(operands[1])));
+            typeId = builder.makeTypeOfWidth(typeId, width);
+        }
+        for (int o = 0; o < (int)operands.size(); ++o)
+            operands[o] = builder.createWidthConversion(operands[o], width);
+    }
+
     spv::Id id = 0;
     if (libCall >= 0)
         id = builder.createBuiltinCall(precision, typeId, stdBuiltins, libCall, operands);
@@ -2904,6 +3505,11 @@ spv::Id TGlslangToSpvTraverser::getSymbolId(const glslang::TIntermSymbol* symbol
     }
 
     // it was not found, create it
+    int madeVariable = -1;
+    if (forked && (symbol->getQualifier().hasSpecConstantId() ||
+                   (symbol->getQualifier().storage != glslang::EvqConst &&
+                    TranslateStorageClass(symbol->getType()) != spv::StorageClassFunction)))
+        madeVariable = beginMade(nullptr, symbol->getId());
     id = createSpvVariable(symbol);
     symbolValues[symbol->getId()] = id;
 
@@ -2933,6 +3539,8 @@ spv::Id TGlslangToSpvTraverser::getSymbolId(const glslang::TIntermSymbol* symbol
         builder.addDecoration(id, spv::DecorationDescriptorSet, symbol->getQualifier().layoutSet);
     if (symbol->getQualifier().hasBinding())
         builder.addDecoration(id, spv::DecorationBinding, symbol->getQualifier().layoutBinding);
+    if (symbol->getQualifier().hasSpecConstantId())
+        builder.addDecoration(id, spv::DecorationSpecId, symbol->getQualifier().getSpecConstantId());
     if (glslangIntermediate->getXfbMode()) {
         if (symbol->getQualifier().hasXfbStride())
             builder.addDecoration(id, spv::DecorationXfbStride, symbol->getQualifier().layoutXfbStride);
@@ -2945,9 +3553,11 @@ spv::Id TGlslangToSpvTraverser::getSymbolId(const glslang::TIntermSymbol* symbol
     if (builtIn != spv::BadValue)
         builder.addDecoration(id, spv::DecorationBuiltIn, (int)builtIn);
 
-    if (linkageOnly)
+    if (linkageOnly && ! symbol->getQualifier().hasSpecConstantId())
         builder.addDecoration(id, spv::DecorationNoStaticUse);
 
+    endMade(madeVariable, id);
+
     return id;
 }
 
@@ -2969,13 +3579,13 @@ void TGlslangToSpvTraverser::addMemberDecoration(spv::Id id, int member, spv::De
 // If there are not enough elements present in 'consts', 0 will be substituted;
 // an empty 'consts' can be used to create a fully zeroed SPIR-V constant.
 //
-spv::Id TGlslangToSpvTraverser::createSpvConstant(const glslang::TType& glslangType, const glslang::TConstUnionArray& consts, int& nextConst)
+spv::Id TGlslangToSpvTraverser::createSpvConstant(const glslang::TType& glslangType, const glslang::TConstUnionArray& consts, int& nextConst, bool specConstant)
 {
     // vector of constants for SPIR-V
     std::vector<spv::Id> spvConsts;
 
-    // Type is used for struct and array constants
-    spv::Id typeId = convertGlslangToSpvType(glslangType);
+    // Type is used for struct and array constants, which are made 32 bits wide
+    spv::Id typeId = getWideType(convertGlslangToSpvType(glslangType));
 
     if (glslangType.isArray()) {
         glslang::TType elementType(glslangType, 0);
@@ -2994,19 +3604,19 @@ spv::Id TGlslangToSpvTraverser::createSpvConstant(const glslang::TType& glslangT
             bool zero = nextConst >= consts.size();
             switch (glslangType.getBasicType()) {
             case glslang::EbtInt:
-                spvConsts.push_back(builder.makeIntConstant(zero ? 0 : consts[nextConst].getIConst()));
+                spvConsts.push_back(builder.makeIntConstant(zero ? 0 : consts[nextConst].getIConst(), specConstant));
                 break;
             case glslang::EbtUint:
-                spvConsts.push_back(builder.makeUintConstant(zero ? 0 : consts[nextConst].getUConst()));
+                spvConsts.push_back(builder.makeUintConstant(zero ? 0 : consts[nextConst].getUConst(), specConstant));
                 break;
             case glslang::EbtFloat:
-                spvConsts.push_back(builder.makeFloatConstant(zero ? 0.0F : (float)consts[nextConst].getDConst()));
+                spvConsts.push_back(builder.makeFloatConstant(zero ? 0.0F : (float)consts[nextConst].getDConst(), specConstant));
                 break;
             case glslang::EbtDouble:
-                spvConsts.push_back(builder.makeDoubleConstant(zero ? 0.0 : consts[nextConst].getDConst()));
+                spvConsts.push_back(builder.makeDoubleConstant(zero ? 0.0 : consts[nextConst].getDConst(), specConstant));
                 break;
             case glslang::EbtBool:
-                spvConsts.push_back(builder.makeBoolConstant(zero ? false : consts[nextConst].getBConst()));
+                spvConsts.push_back(builder.makeBoolConstant(zero ? false : consts[nextConst].getBConst(), specConstant));
                 break;
             default:
                 spv::MissingFunctionality("constant vector type");
@@ -3020,19 +3630,19 @@ spv::Id TGlslangToSpvTraverser::createSpvConstant(const glslang::TType& glslangT
         spv::Id scalar = 0;
         switch (glslangType.getBasicType()) {
         case glslang::EbtInt:
-            scalar = builder.makeIntConstant(zero ? 0 : consts[nextConst].getIConst());
+            scalar = builder.makeIntConstant(zero ? 0 : consts[nextConst].getIConst(), specConstant);
             break;
         case glslang::EbtUint:
-            scalar = builder.makeUintConstant(zero ? 0 : consts[nextConst].getUConst());
+            scalar = builder.makeUintConstant(zero ? 0 : consts[nextConst].getUConst(), specConstant);
             break;
         case glslang::EbtFloat:
-            scalar = builder.makeFloatConstant(zero ? 0.0F : (float)consts[nextConst].getDConst());
+            scalar = builder.makeFloatConstant(zero ? 0.0F : (float)consts[nextConst].getDConst(), specConstant);
             break;
         case glslang::EbtDouble:
-            scalar = builder.makeDoubleConstant(zero ? 0.0 : consts[nextConst].getDConst());
+            scalar = builder.makeDoubleConstant(zero ? 0.0 : consts[nextConst].getDConst(), specConstant);
             break;
         case glslang::EbtBool:
-            scalar = builder.makeBoolConstant(zero ? false : consts[nextConst].getBConst());
+            scalar = builder.makeBoolConstant(zero ? false : consts[nextConst].getBConst(), specConstant);
             break;
         default:
             spv::MissingFunctionality("constant scalar type");
@@ -3045,6 +3655,56 @@ spv::Id TGlslangToSpvTraverser::createSpvConstant(const glslang::TType& glslangT
     return builder.makeCompositeConstant(typeId, spvConsts);
 }
 
+// If a vector, array, or structure is being constructed purely from constants,
+// at least one a specialization constant, return it as an OpSpecConstantComposite,
+// so it still specializes.  Otherwise, return NoResult and let it be computed.
+spv::Id TGlslangToSpvTraverser::createSpvSpecConstantComposite(spv::Id typeId, const std::vector<spv::Id>& arguments)
+{
+    bool specialized = false;
+    for (int a = 0; a < (int)arguments.size(); ++a) {
+        if (! builder.isConstant(arguments[a]))
+            return spv::NoResult;
+        if (builder.isSpecConstant(arguments[a]))
+            specialized = true;
+    }
+    if (! specialized)
+        return spv::NoResult;
+
+    std::vector<spv::Id> constituents(arguments.begin(), arguments.end());
+    if (builder.isVectorType(typeId)) {
+        // only scalars of the component type, one per component or one to smear
+        int numComponents = builder.getNumTypeComponents(typeId);
+        spv::Id componentTypeId = builder.getScalarTypeId(typeId);
+        for (int c = 0; c < (int)constituents.size(); ++c) {
+            if (builder.getTypeId(constituents[c]) != componentTypeId)
+                return spv::NoResult;
+        }
+        if (constituents.size() == 1)
+            constituents.resize(numComponents, constituents.front());
+        else if ((int)constituents.size() != numComponents)
+            return spv::NoResult;
+    } else if (! builder.isAggregateType(typeId))
+        return spv::NoResult;
+
+    return builder.makeCompositeConstant(typeId, constituents, true);
+}
+
+// Return true if the switch-statement code segment does nothing but break
+// (a missing segment is an implicit break).
+bool TGlslangToSpvTraverser::isBreakOnly(TIntermNode* segment)
+{
+    if (segment == nullptr)
+        return true;
+
+    glslang::TIntermAggregate* sequence = segment->getAsAggregate();
+    if (sequence && sequence->getOp() == glslang::EOpSequence && sequence->getSequence().size() == 1)
+        segment = sequence->getSequence()[0];
+
+    glslang::TIntermBranch* branch = segment->getAsBranchNode();
+
+    return branch && branch->getFlowOp() == glslang::EOpBreak;
+}
+
 // Return true if the node is a constant or symbol whose reading has no
 // non-trivial observable cost or effect.
 bool TGlslangToSpvTraverser::isTrivialLeaf(const glslang::TIntermTyped* node)
@@ -3185,21 +3845,61 @@ void GetSpirvVersion(std::string& version)
 }
 
 // Write SPIR-V out to a binary file
-void OutputSpv(const std::vector<unsigned int>& spirv, const char* baseName)
+bool OutputSpv(const std::vector<unsigned int>& spirv, const char* baseName)
 {
     std::ofstream out;
     out.open(baseName, std::ios::binary | std::ios::out);
-    for (int i = 0; i < (int)spirv.size(); ++i) {
-        unsigned int word = spirv[i];
-        out.write((const char*)&word, 4);
-    }
+    if (! out)
+        return false;
+    out.write((const char*)spirv.data(), spirv.size() * sizeof(unsigned int));
     out.close();
+
+    return ! out.fail();
+}
+
+//
+// Dump the traverser's module to 'out', remapping it there with options.remap.
+//
+static double DumpSpv(TGlslangToSpvTraverser& it, std::vector<unsigned int>& out, const SpvOptions& options)
+{
+    size_t start = out.size();
+    it.dumpSpv(out);
+    if (options.remap == 0)
+        return 0.0;
+
+    auto dumped = std::chrono::steady_clock::now();
+    spv::spirvbin_t remapper;
+    out.resize(start + remapper.remap(out.data() + start, out.size() - start, options.remap));
+    if (options.counters) {
+        for (size_t pass = 0; pass < remapper.getStats().size(); ++pass)
+            options.counters->remapInstructions += (int)remapper.getStats()[pass].instructions;
+    }
+
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - dumped).count();
+}
+
+// Remapping needs the whole module at once, so for that, it's dumped to
+// words first and handed to 'sink' in one piece.
+static double DumpSpv(TGlslangToSpvTraverser& it, spv::WordSink& sink, const SpvOptions& options)
+{
+    if (options.remap == 0) {
+        it.dumpSpv(sink);
+        return 0.0;
+    }
+
+    std::vector<unsigned int> spirv;
+    double seconds = DumpSpv(it, spirv, options);
+    sink.write(spirv.data(), spirv.size());
+
+    return seconds;
 }
 
 //
 // Set up the glslang traversal
 //
-void GlslangToSpv(const glslang::TIntermediate& intermediate, std::vector<unsigned int>& spirv)
+template<class Out>
+static void TranslateToSpv(const glslang::TIntermediate& intermediate, Out& out, const SpvOptions& options,
+                           SpvPhaseSeconds* seconds = nullptr)
 {
     TIntermNode* root = intermediate.getTreeRoot();
 
@@ -3208,13 +3908,124 @@ void GlslangToSpv(const glslang::TIntermediate& intermediate, std::vector<unsign
 
     glslang::GetThreadPoolAllocator().push();
 
-    TGlslangToSpvTraverser it(&intermediate);
+    auto start = std::chrono::steady_clock::now();
+
+    TGlslangToSpvTraverser it(&intermediate, options);
 
     root->traverse(&it);
 
-    it.dumpSpv(spirv);
+    if (options.forwardLoadsAndStores || options.eliminateCommonSubexpressions)
+        it.simplifySpv(options.forwardLoadsAndStores, options.eliminateCommonSubexpressions);
+
+    // the remapper hashes names into IDs, so keeps them until then
+    if (options.remap & spv::spirvbin_t::STRIP)
+        it.stripDebugSpv((options.remap & spv::spirvbin_t::MAP_NAMES) != 0);
+
+    auto translated = std::chrono::steady_clock::now();
+
+    double remapSeconds = DumpSpv(it, out, options);
+    if (options.counters)
+        options.counters->spvInstructions += it.getNumInstructions();
+
+    if (seconds) {
+        seconds->translate += std::chrono::duration<double>(translated - start).count();
+        seconds->dump += std::chrono::duration<double>(std::chrono::steady_clock::now() - translated).count() - remapSeconds;
+        seconds->remap += remapSeconds;
+    }
 
     glslang::GetThreadPoolAllocator().pop();
 }
 
+void GlslangToSpv(const glslang::TIntermediate& intermediate, std::vector<unsigned int>& spirv, const SpvOptions& options)
+{
+    TranslateToSpv(intermediate, spirv, options);
+}
+
+void GlslangToSpv(const glslang::TIntermediate& intermediate, std::vector<unsigned int>& spirv, const SpvOptions& options,
+                  SpvPhaseSeconds& seconds)
+{
+    TranslateToSpv(intermediate, spirv, options, &seconds);
+}
+
+void GlslangToSpv(const glslang::TIntermediate& intermediate, spv::WordSink& sink, const SpvOptions& options)
+{
+    TranslateToSpv(intermediate, sink, options);
+}
+
+namespace {
+
+// Writes streamed words to a binary file.
+class TFileWordSink : public spv::WordSink {
+public:
+    explicit TFileWordSink(std::ofstream& out) : out(out) { }
+    virtual void write(const unsigned int* words, size_t count)
+    {
+        out.write((const char*)words, count * sizeof(unsigned int));
+    }
+
+protected:
+    TFileWordSink& operator=(const TFileWordSink&);
+
+    std::ofstream& out;
+};
+
+};  // end anonymous namespace
+
+bool OutputSpv(const glslang::TIntermediate& intermediate, const char* baseName)
+{
+    std::ofstream out;
+    out.open(baseName, std::ios::binary | std::ios::out);
+    if (! out)
+        return false;
+    TFileWordSink sink(out);
+    GlslangToSpv(intermediate, sink);
+    out.close();
+
+    return ! out.fail();
+}
+
+//
+// Make the SPIR-V of each compiled permutation on the thread that compiled it;
+// permutations sharing a compile get copies.
+//
+bool PermutationsToSpv(TPermutations& permutations, const TBuiltInResource* resources, int defaultVersion,
+                       EProfile defaultProfile, bool forwardCompatible, EShMessages messages,
+                       std::vector<std::vector<unsigned int> >& spirv, int numThreads, const SpvOptions& options)
+{
+    spirv.clear();
+    spirv.resize(permutations.getNumPermutations());
+    TPermutations::TLinked toSpv = [&](int permutation, TProgram& program) {
+        GlslangToSpv(*program.getIntermediate(permutations.getStage()), spirv[permutation], options);
+        return true;
+    };
+    bool success = permutations.compile(resources, defaultVersion, defaultProfile, forwardCompatible, messages,
+                                        toSpv, numThreads);
+
+    for (int p = 0; p < permutations.getNumPermutations(); ++p) {
+        if (! permutations.succeeded(p))
+            spirv[p].clear();
+        else if (permutations.getCompiledAs(p) != p)
+            spirv[p] = spirv[permutations.getCompiledAs(p)];
+    }
+
+    return success;
+}
+
+bool BatchToSpv(TBatch& batch, int numThreads)
+{
+    return batch.compile(LinkedToSpv, numThreads);
+}
+
+bool LinkedToSpv(int /*job*/, TProgram& program, TBatch::TResult& result)
+{
+    for (int stage = 0; stage < EShLangCount; ++stage) {
+        if (program.getIntermediate((EShLanguage)stage)) {
+            GlslangToSpv(*program.getIntermediate((EShLanguage)stage), result.spirv);
+            return true;
+        }
+    }
+
+    return false;
+}
+
 }; // end namespace glslang
@@ -32,12 +32,106 @@
 //ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 //POSSIBILITY OF SUCH DAMAGE.
 
+#ifndef GlslangToSpv_H
+#define GlslangToSpv_H
+
 #include "../glslang/Include/intermediate.h"
+#include "../glslang/Public/ShaderLang.h"
+
+namespace spv {
+    class WordSink;
+};
 
 namespace glslang {
 
 void GetSpirvVersion(std::string&);
-void GlslangToSpv(const glslang::TIntermediate& intermediate, std::vector<unsigned int>& spirv);
-void OutputSpv(const std::vector<unsigned int>& spirv, const char* baseName);
 
+// How GlslangToSpv() goes about it.
+struct SpvOptions {
+    SpvOptions() : numThreads(1), forwardLoadsAndStores(false), eliminateCommonSubexpressions(false), remap(0),
+                   counters(nullptr), streamFunctions(false), mediump16(false), entryPoint(nullptr) { }
+
+    // Other than 1, the function bodies other than main() are translated on up
+    // to that many threads (0 for one per core); the SPIR-V is the same either way.
+    int numThreads;
+
+    // Promote locals to SSA values and reuse loaded values (see
+    // spv::Builder::forwardLoadsAndStores()).
+    bool forwardLoadsAndStores;
+
+    // Reuse identical access chains and pure operations within a block (see
+    // spv::Builder::eliminateCommonSubexpressions()).
+    bool eliminateCommonSubexpressions;
+
+    // Other than 0, the spv::spirvbin_t options to remap the SPIR-V with, as
+    // spirv-remap would, before it's handed back.  The debug information STRIP
+    // removes is left out of the module rather than written and then found again,
+    // and the words are remapped where they were dumped.
+    unsigned int remap;
+
+    // Other than null, where to add the instructions the builder made, and those
+    // the remapper walked; usually the compile's own (see EShMsgCounters).
+    ShCounterStats* counters;
+
+    // Dump each function to words as soon as it's translated (and simplified),
+    // freeing its IR, so the peak memory is that of the largest function, not
+    // the whole module.  The function bodies are then translated on one thread.
+    // The SPIR-V is the same either way, but for the numbering of the ids that
+    // simplification makes, which come before those of later functions.
+    bool streamFunctions;
+
+    // Hold mediump and lowp values in 16-bit ints and floats (with the Int16 and
+    // Float16 capabilities), for the ALUs and registers of GPUs that have them.
+    // What's in memory others see, arrays, structures, matrices, and function
+    // parameters stay 32 bits wide, and values are converted to and from them.
+    bool mediump16;
+
+    // Other than null, which of the shader's entry points (see
+    // TShader::setEntryPoints()) to make the module's; otherwise the first,
+    // main() by default.  Only the functions it can call are translated.
+    const char* entryPoint;
 };
+
+// Where the time of a GlslangToSpv() call goes, for benchmarking.
+struct SpvPhaseSeconds {
+    SpvPhaseSeconds() : translate(0.0), dump(0.0), remap(0.0) { }
+
+    double translate;   // traversing the AST into the builder, including any simplification
+    double dump;        // writing the builder's module out as words
+    double remap;       // remapping the words, for SpvOptions::remap
+};
+
+void GlslangToSpv(const glslang::TIntermediate& intermediate, std::vector<unsigned int>& spirv,
+                  const SpvOptions& options = SpvOptions());
+
+// As above, adding the seconds spent in each phase into 'seconds'.
+void GlslangToSpv(const glslang::TIntermediate& intermediate, std::vector<unsigned int>& spirv,
+                  const SpvOptions& options, SpvPhaseSeconds& seconds);
+
+// Write the SPIR-V to a binary file; false if it can't be written.
+bool OutputSpv(const std::vector<unsigned int>& spirv, const char* baseName);
+
+// Stream the SPIR-V to 'sink' as it is made, rather than into one vector.
+void GlslangToSpv(const glslang::TIntermediate& intermediate, spv::WordSink& sink,
+                  const SpvOptions& options = SpvOptions());
+
+// Stream the SPIR-V straight to a binary file; false if it can't be written.
+bool OutputSpv(const glslang::TIntermediate& intermediate, const char* baseName);
+
+// Compile all the permutations (see TPermutations::compile()), making one SPIR-V
+// module per permutation, empty for those that failed.
+bool PermutationsToSpv(TPermutations&, const TBuiltInResource*, int defaultVersion, EProfile defaultProfile,
+                       bool forwardCompatible, EShMessages, std::vector<std::vector<unsigned int> >& spirv,
+                       int numThreads = 0, const SpvOptions& options = SpvOptions());
+
+// Compile all the jobs (see TBatch::compile()), filling in the SPIR-V of each
+// result that compiled.
+bool BatchToSpv(TBatch&, int numThreads = 0);
+
+// A TBatch::TLinked function filling in the result's SPIR-V from the program's
+// one stage, as for a TAsyncCompiler.
+bool LinkedToSpv(int job, TProgram&, TBatch::TResult&);
+
+};
+
+#endif // GlslangToSpv_H
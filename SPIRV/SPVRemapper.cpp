@@ -42,6 +42,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include "../glslang/Include/Common.h"
 
 namespace spv {
@@ -89,7 +90,8 @@ namespace spv {
         case spv::OpTypeVector:       // fall through
         case spv::OpTypeMatrix:       // ...
         case spv::OpTypePipe:         return range_t(3, 4);
-        case spv::OpConstant:         return range_t(3, maxCount);
+        case spv::OpConstant:         // fall through
+        case spv::OpSpecConstant:     return range_t(3, maxCount);
         default:                      return range_t(0, 0);
         }
     }
@@ -122,8 +124,9 @@ namespace spv {
         switch (opCode) {
         case spv::OpTypeArray:         // fall through...
         case spv::OpTypeRuntimeArray:  return range_t(3, 4);
-        case spv::OpConstantComposite: return range_t(3, maxCount);
-        default:                       return range_t(0, 0);
+        case spv::OpConstantComposite:     // fall through
+        case spv::OpSpecConstantComposite: return range_t(3, maxCount);
+        default:                           return range_t(0, 0);
         }
     }
 
@@ -194,7 +197,11 @@ namespace spv {
         case spv::OpConstantTrue:
         case spv::OpConstantFalse:
         case spv::OpConstantComposite:
-        case spv::OpConstant:         return true;
+        case spv::OpConstant:
+        case spv::OpSpecConstantTrue:
+        case spv::OpSpecConstantFalse:
+        case spv::OpSpecConstantComposite:
+        case spv::OpSpecConstant:     return true;
         default:                      return false;
         }
     }
@@ -238,6 +245,7 @@ namespace spv {
             msg(4, 4, std::string("map: ") + std::to_string(id) + " -> " + std::to_string(newId));
             setMapped(newId);
             largestNewId = std::max(largestNewId, newId);
+            ++idsMapped;
         }
 
         return idMapL[id] = newId;
@@ -324,8 +332,6 @@ namespace spv {
         idMapL.clear();
 //      preserve nameMap, so we don't clear that.
         fnPos.clear();
-        fnPosDCE.clear();
-        fnCalls.clear();
         typeConstPos.clear();
         typeConstPosR.clear();
         entryPoint = spv::NoResult;
@@ -348,8 +354,6 @@ namespace spv {
                     const std::string  name = literalString(start+2);
                     nameMap[name] = target;
 
-                } else if (opCode == spv::Op::OpFunctionCall) {
-                    ++fnCalls[asId(start + 3)];
                 } else if (opCode == spv::Op::OpEntryPoint) {
                     entryPoint = asId(start + 2);
                 } else if (opCode == spv::Op::OpFunction) {
@@ -400,129 +404,6 @@ namespace spv {
     }
 
 
-    int spirvbin_t::processInstruction(unsigned word, instfn_t instFn, idfn_t idFn)
-    {
-        const auto     instructionStart = word;
-        const unsigned wordCount = asWordCount(instructionStart);
-        const spv::Op  opCode    = asOpCode(instructionStart);
-        const int      nextInst  = word++ + wordCount;
-
-        if (nextInst > int(spv.size()))
-            error("spir instruction terminated too early");
-
-        // Base for computing number of operands; will be updated as more is learned
-        unsigned numOperands = wordCount - 1;
-
-        if (instFn(opCode, instructionStart))
-            return nextInst;
-
-        // Read type and result ID from instruction desc table
-        if (spv::InstructionDesc[opCode].hasType()) {
-            idFn(asId(word++));
-            --numOperands;
-        }
-
-        if (spv::InstructionDesc[opCode].hasResult()) {
-            idFn(asId(word++));
-            --numOperands;
-        }
-
-        // Extended instructions: currently, assume everything is an ID.
-        // TODO: add whatever data we need for exceptions to that
-        if (opCode == spv::OpExtInst) {
-            word        += 2; // instruction set, and instruction from set
-            numOperands -= 2;
-
-            for (unsigned op=0; op < numOperands; ++op)
-                idFn(asId(word++)); // ID
-
-            return nextInst;
-        }
-
-        // Store IDs from instruction in our map
-        for (int op = 0; op < spv::InstructionDesc[opCode].operands.getNum(); ++op, --numOperands) {
-            switch (spv::InstructionDesc[opCode].operands.getClass(op)) {
-            case spv::OperandId:
-                idFn(asId(word++));
-                break;
-
-            case spv::OperandOptionalId:
-            case spv::OperandVariableIds:
-                for (unsigned i = 0; i < numOperands; ++i)
-                    idFn(asId(word++));
-                return nextInst;
-
-            case spv::OperandVariableLiterals:
-                // for clarity
-                // if (opCode == spv::OpDecorate && asDecoration(word - 1) == spv::DecorationBuiltIn) {
-                //     ++word;
-                //     --numOperands;
-                // }
-                // word += numOperands;
-                return nextInst;
-
-            case spv::OperandVariableLiteralId:
-                while (numOperands > 0) {
-                    ++word;             // immediate
-                    idFn(asId(word++)); // ID
-                    numOperands -= 2;
-                }
-                return nextInst;
-
-            case spv::OperandLiteralString:
-                // word += literalStringWords(literalString(word)); // for clarity
-                return nextInst;
-
-                // Single word operands we simply ignore, as they hold no IDs
-            case spv::OperandLiteralNumber:
-            case spv::OperandSource:
-            case spv::OperandExecutionModel:
-            case spv::OperandAddressing:
-            case spv::OperandMemory:
-            case spv::OperandExecutionMode:
-            case spv::OperandStorage:
-            case spv::OperandDimensionality:
-            case spv::OperandDecoration:
-            case spv::OperandBuiltIn:
-            case spv::OperandSelect:
-            case spv::OperandLoop:
-            case spv::OperandFunction:
-            case spv::OperandMemorySemantics:
-            case spv::OperandMemoryAccess:
-            case spv::OperandScope:
-            case spv::OperandGroupOperation:
-            case spv::OperandKernelEnqueueFlags:
-            case spv::OperandKernelProfilingInfo:
-                ++word;
-                break;
-
-            default:
-                break;
-            }
-        }
-
-        return nextInst;
-    }
-
-    // Make a pass over all the instructions and process them given appropriate functions
-    spirvbin_t& spirvbin_t::process(instfn_t instFn, idfn_t idFn, unsigned begin, unsigned end)
-    {
-        // For efficiency, reserve name map space.  It can grow if needed.
-        nameMap.reserve(32);
-
-        // If begin or end == 0, use defaults
-        begin = (begin == 0 ? header_size          : begin);
-        end   = (end   == 0 ? unsigned(spv.size()) : end);
-
-        // basic parsing and InstructionDesc table borrowed from SpvDisassemble.cpp...
-        unsigned nextInst = unsigned(spv.size());
-
-        for (unsigned word = begin; word < end; word = nextInst)
-            nextInst = processInstruction(word, instFn, idFn);
-
-        return *this;
-    }
-
     // Apply global name mapping to a single module
     void spirvbin_t::mapNames()
     {
@@ -798,110 +679,110 @@ namespace spv {
     }
 
     // remove bodies of uncalled functions
-    void spirvbin_t::dceFuncs()
+    // Remove dead functions, variables, and types and constants, as the options
+    // ask.  Every ID's uses are counted in one walk.  Removing something uncounts
+    // the uses inside it, and whatever that leaves used by nothing but its own
+    // definition is removed in turn, so one pass reaches the fixpoint: a type
+    // only used by a variable only used in a dead function goes with them.
+    // Names and decorations aren't uses; they go with what they annotate.
+    void spirvbin_t::dce()
     {
-        msg(3, 2, std::string("Removing Dead Functions: "));
+        msg(3, 2, std::string("DCE: "));
 
-        // TODO: There are more efficient ways to do this.
-        bool changed = true;
+        // Indexed by ID: the number of times it appears, its definition included,
+        // and, if it's something the options let us remove, the words defining it
+        std::vector<int>     useCount(bound(), 0);
+        std::vector<range_t> definition(bound(), range_t(0, 0));
+        std::vector<bool>    removed(bound(), false);
 
-        while (changed) {
-            changed = false;
+        // Debug names and decorations of each ID, to remove with it
+        std::unordered_map<spv::Id, std::vector<unsigned>> annotations;
 
-            for (auto fn = fnPos.begin(); fn != fnPos.end(); ) {
-                if (fn->first == entryPoint) { // don't DCE away the entry point!
-                    ++fn;
-                    continue;
-                }
-
-                const auto call_it = fnCalls.find(fn->first);
-
-                if (call_it == fnCalls.end() || call_it->second == 0) {
-                    changed = true;
-                    stripRange.push_back(fn->second);
-                    fnPosDCE.insert(*fn);
-
-                    // decrease counts of called functions
-                    process(
-                        [&](spv::Op opCode, unsigned start) {
-                            if (opCode == spv::Op::OpFunctionCall) {
-                                const auto call_it = fnCalls.find(asId(start + 3));
-                                if (call_it != fnCalls.end()) {
-                                    if (--call_it->second <= 0)
-                                        fnCalls.erase(call_it);
-                                }
-                            }
-
-                            return true;
-                        },
-                        op_fn_nop,
-                        fn->second.first,
-                        fn->second.second);
-
-                    fn = fnPos.erase(fn);
-                } else ++fn;
+        if (options & DCE_FUNCS) {
+            for (const auto& fn : fnPos) {
+                if (fn.first != entryPoint) // don't DCE away the entry point!
+                    definition[fn.first] = fn.second;
             }
         }
-    }
 
-    // remove unused function variables + decorations
-    void spirvbin_t::dceVars()
-    {
-        msg(3, 2, std::string("DCE Vars: "));
-
-        std::unordered_map<spv::Id, int> varUseCount;
+        if (options & DCE_TYPES) {
+            for (const auto typeStart : typeConstPos)
+                definition[asTypeConstId(typeStart)] = range_t(typeStart, typeStart + asWordCount(typeStart));
+        }
 
-        // Count function variable use
         process(
             [&](spv::Op opCode, unsigned start) {
-                if (opCode == spv::OpVariable) { ++varUseCount[asId(start+2)]; return true; }
-                return false;
+                switch (opCode) {
+                case spv::OpDecorate:
+                    // what other modules link to is in use
+                    if (asDecoration(start + 2) == spv::DecorationLinkageAttributes)
+                        return false;
+                    annotations[asId(start + 1)].push_back(start);
+                    return true;
+                case spv::OpName:
+                case spv::OpMemberName:
+                case spv::OpMemberDecorate:
+                    annotations[asId(start + 1)].push_back(start);
+                    return true;
+                case spv::OpVariable:
+                    if (options & DCE_VARS)
+                        definition[asId(start + 2)] = range_t(start, start + asWordCount(start));
+                    return false;
+                default:
+                    return false;
+                }
             },
-
-            [&](spv::Id& id) { if (varUseCount[id]) ++varUseCount[id]; }
+            [&](spv::Id& id) { ++useCount[id]; }
         );
 
-        // Remove single-use function variables + associated decorations and names
-        process(
-            [&](spv::Op opCode, unsigned start) {
-                if ((opCode == spv::OpVariable && varUseCount[asId(start+2)] == 1)  ||
-                    (opCode == spv::OpDecorate && varUseCount[asId(start+1)] == 1)  ||
-                    (opCode == spv::OpName     && varUseCount[asId(start+1)] == 1)) {
-                        stripInst(start);
-                }
-                return true;
-            },
-            op_fn_nop);
-    }
+        const auto isDead = [&](spv::Id id) {
+            return useCount[id] == 1 && definition[id].second != 0 && ! removed[id];
+        };
 
-    // remove unused types
-    void spirvbin_t::dceTypes()
-    {
-        std::vector<bool> isType(bound(), false);
+        std::vector<spv::Id> worklist;
+        for (spv::Id id = 0; id < bound(); ++id) {
+            if (isDead(id))
+                worklist.push_back(id);
+        }
 
-        // for speed, make O(1) way to get to type query (map is log(n))
-        for (const auto typeStart : typeConstPos)
-            isType[asTypeConstId(typeStart)] = true;
+        while (! worklist.empty()) {
+            const spv::Id id = worklist.back();
+            worklist.pop_back();
 
-        std::unordered_map<spv::Id, int> typeUseCount;
+            // re-check: it may since have gone with a function it was local to
+            if (! isDead(id))
+                continue;
 
-        // Count total type usage
-        process(inst_fn_nop,
-            [&](spv::Id& id) { if (isType[id]) ++typeUseCount[id]; }
-        );
+            const range_t range = definition[id];
+            stripRange.push_back(range);
+
+            // Everything defined in the range goes, and what it used is
+            // dead if that was its last use.  Only look once the whole range has
+            // been uncounted, so IDs local to it are seen as unused, not dead.
+            // A local variable already removed was already uncounted.
+            process(
+                [&](spv::Op opCode, unsigned start) {
+                    const spv::InstructionParameters& desc = spv::InstructionDesc[opCode];
+                    if (! desc.hasResult())
+                        return false;
+
+                    const spv::Id result = asId(start + (desc.hasType() ? 2 : 1));
+                    if (removed[result])
+                        return true;
+                    removed[result] = true;
+                    return false;
+                },
+                [&](spv::Id& use) {
+                    if (--useCount[use] == 1)
+                        worklist.push_back(use);
+                },
+                range.first, range.second);
+        }
 
-        // Remove types from deleted code
-        for (const auto& fn : fnPosDCE)
-            process(inst_fn_nop,
-            [&](spv::Id& id) { if (isType[id]) --typeUseCount[id]; },
-            fn.second.first, fn.second.second);
-
-        // Remove single reference types
-        for (const auto typeStart : typeConstPos) {
-            const spv::Id typeId = asTypeConstId(typeStart);
-            if (typeUseCount[typeId] == 1) {
-                --typeUseCount[typeId];
-                stripInst(typeStart);
+        for (const auto& annotation : annotations) {
+            if (removed[annotation.first]) {
+                for (const auto start : annotation.second)
+                    stripInst(start);
             }
         }
     }
@@ -1064,6 +945,23 @@ namespace spv {
                 return hash;
             }
 
+        case spv::OpSpecConstantTrue:    return 300009;
+        case spv::OpSpecConstantFalse:   return 300010;
+        case spv::OpSpecConstantComposite:
+            {
+                std::uint32_t hash = 300012 + hashType(typePos(spv[typeStart+1]));
+                for (unsigned w=3; w < wordCount; ++w)
+                    hash += w * hashType(typePos(spv[typeStart+w]));
+                return hash;
+            }
+        case spv::OpSpecConstant:
+            {
+                std::uint32_t hash = 500011 + hashType(typePos(spv[typeStart+1]));
+                for (unsigned w=3; w < wordCount; ++w)
+                    hash += w * spv[typeStart+w];
+                return hash;
+            }
+
         default:
             error("unknown type opcode");
             return 0;
@@ -1089,8 +987,9 @@ namespace spv {
     }
 
 
-    // Strip a single binary by removing ranges given in stripRange
-    void spirvbin_t::strip()
+    // Strip a single binary by removing ranges given in stripRange.  The local
+    // maps are rebuilt for the passes that follow, unless there are none.
+    void spirvbin_t::strip(bool rebuildMaps)
     {
         if (stripRange.empty()) // nothing to do
             return;
@@ -1104,7 +1003,8 @@ namespace spv {
 
         int strippedPos = 0;
         for (unsigned word = 0; word < unsigned(spv.size()); ++word) {
-            if (strip_it != stripRange.end() && word >= strip_it->second)
+            // ranges can nest, as a dead function's dead local variable does
+            while (strip_it != stripRange.end() && word >= strip_it->second)
                 ++strip_it;
 
             if (strip_it == stripRange.end() || word < strip_it->first || word >= strip_it->second)
@@ -1114,44 +1014,98 @@ namespace spv {
         spv.resize(strippedPos);
         stripRange.clear();
 
-        buildLocalMaps();
+        if (rebuildMaps)
+            buildLocalMaps();
+    }
+
+    // Count the words in the strip ranges, which can nest or overlap
+    size_t spirvbin_t::stripWords() const
+    {
+        std::vector<range_t> ranges(stripRange);
+        std::sort(ranges.begin(), ranges.end());
+
+        size_t   words = 0;
+        unsigned end   = 0;
+        for (const auto& range : ranges) {
+            if (range.second > end) {
+                words += range.second - std::max(range.first, end);
+                end = range.second;
+            }
+        }
+
+        return words;
+    }
+
+    // Run one pass of remap(), recording what it did in stats
+    void spirvbin_t::runPass(const char* name, const std::function<void()>& pass)
+    {
+        const size_t wordsBefore  = spv.size() - stripWords();
+        const size_t idsBefore    = idsMapped;
+        const size_t walkedBefore = instructionsWalked;
+        const auto   start        = std::chrono::steady_clock::now();
+
+        pass();
+
+        passstats_t passStats;
+        passStats.name         = name;
+        passStats.seconds      = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        passStats.wordsRemoved = wordsBefore - std::min(wordsBefore, spv.size() - stripWords());
+        passStats.idsMapped    = idsMapped - idsBefore;
+        passStats.instructions = instructionsWalked - walkedBefore;
+        stats.push_back(passStats);
     }
 
     // Strip a single binary by removing ranges given in stripRange
     void spirvbin_t::remap(std::uint32_t opts)
     {
         options = opts;
+        stats.clear();
+        idsMapped = 0;
+        instructionsWalked = 0;
 
         // Set up opcode tables from SpvDoc
         spv::Parameterize();
 
-        validate();  // validate header
-        buildLocalMaps();
+        // reading the module marks the debug instructions if we're stripping them
+        runPass("stripDebug", [&]() {
+            validate();  // validate header
+            buildLocalMaps();
+
+            msg(3, 4, std::string("ID bound: ") + std::to_string(bound()));
 
-        msg(3, 4, std::string("ID bound: ") + std::to_string(bound()));
+            strip();     // strip out data we decided to eliminate
+        });
 
-        strip();        // strip out data we decided to eliminate
+        if (options & OPT_LOADSTORE) runPass("optLoadStore",      [&]() { optLoadStore(); });
+        if (options & OPT_FWD_LS)    runPass("forwardLoadStores", [&]() { forwardLoadStores(); });
+        if (options & DCE_ALL)       runPass("dce",               [&]() { dce(); });
+        if (options & MAP_TYPES)     runPass("mapTypeConst",      [&]() { mapTypeConst(); });
+        if (options & MAP_NAMES)     runPass("mapNames",          [&]() { mapNames(); });
+        if (options & MAP_FUNCS)     runPass("mapFnBodies",       [&]() { mapFnBodies(); });
 
-        if (options & OPT_LOADSTORE) optLoadStore();
-        if (options & OPT_FWD_LS)    forwardLoadStores();
-        if (options & DCE_FUNCS)     dceFuncs();
-        if (options & DCE_VARS)      dceVars();
-        if (options & DCE_TYPES)     dceTypes();
-        if (options & MAP_TYPES)     mapTypeConst();
-        if (options & MAP_NAMES)     mapNames();
-        if (options & MAP_FUNCS)     mapFnBodies();
+        runPass("mapRemainder", [&]() { mapRemainder(); }); // map any unmapped IDs
+        runPass("applyMap",     [&]() { applyMap(); });     // Now remap each shader to the new IDs we've come up with
 
-        mapRemainder(); // map any unmapped IDs
-        applyMap();     // Now remap each shader to the new IDs we've come up with
-        strip();        // strip out data we decided to eliminate
+        // strip out data we decided to eliminate; nothing needs the maps after
+        runPass("compact", [&]() { strip(false); });
     }
 
     // remap from a memory image
     void spirvbin_t::remap(std::vector<std::uint32_t>& in_spv, std::uint32_t opts)
     {
-        spv.swap(in_spv);
+        in_spv.resize(remap(in_spv.data(), in_spv.size(), opts));
+    }
+
+    // remap a memory image in place
+    size_t spirvbin_t::remap(std::uint32_t* in_spv, size_t count, std::uint32_t opts)
+    {
+        spv = words_t(in_spv, count);
         remap(opts);
-        spv.swap(in_spv);
+
+        const size_t remapped = spv.size();
+        spv = words_t();
+
+        return remapped;
     }
 
 } // namespace SPV
@@ -103,6 +103,7 @@ public:
 
 #include "spirv.hpp"
 #include "spvIR.h"
+#include "doc.h"
 
 namespace spv {
 
@@ -110,11 +111,30 @@ namespace spv {
 class spirvbin_t : public spirvbin_base_t
 {
 public:
-   spirvbin_t(int verbose = 0) : entryPoint(spv::NoResult), largestNewId(0), verbose(verbose) { }
+   spirvbin_t(int verbose = 0) : entryPoint(spv::NoResult), largestNewId(0), idsMapped(0), instructionsWalked(0),
+                                 verbose(verbose) { }
    
    // remap on an existing binary in memory
    void remap(std::vector<std::uint32_t>& spv, std::uint32_t opts = DO_EVERYTHING);
 
+   // remap the 'count' words at 'spv' in place, returning how many are left;
+   // remapping only ever shrinks a binary, so nothing is copied or allocated for it
+   size_t remap(std::uint32_t* spv, size_t count, std::uint32_t opts = DO_EVERYTHING);
+
+   // What one pass of remap() did, and how long it took.  Most passes only mark
+   // words for removal, and are credited with them; the last pass, "compact",
+   // removes them all.
+   struct passstats_t {
+      const char* name;
+      double      seconds;
+      size_t      wordsRemoved; // words the pass removed, or marked for removal
+      size_t      idsMapped;    // IDs the pass gave new values
+      size_t      instructions; // instructions the pass walked
+   };
+
+   // The passes of the last remap(), in the order they ran
+   const std::vector<passstats_t>& getStats() const { return stats; }
+
    // Type for error/log handler functions
    typedef std::function<void(const std::string&)> errorfn_t;
    typedef std::function<void(const std::string&)> logfn_t;
@@ -127,7 +147,9 @@ protected:
    // This can be overridden to provide other message behavior if needed
    virtual void msg(int minVerbosity, int indent, const std::string& txt) const;
 
-private:
+   // The rest is protected too, so other walkers of a module, like SpvToReflection(),
+   // can share the parsing.
+
    // Local to global, or global to local ID map
    typedef std::unordered_map<spv::Id, spv::Id> idmap_t;
    typedef std::unordered_set<spv::Id>          idset_t;
@@ -139,6 +161,25 @@ private:
 
    typedef std::uint32_t spirword_t;
 
+   // The words being remapped, in memory owned by the caller of remap().
+   // They can be shrunk in place, but never grown.
+   class words_t {
+   public:
+      words_t() : base(nullptr), count(0) { }
+      words_t(spirword_t* base, size_t count) : base(base), count(count) { }
+
+      size_t            size() const                    { return count; }
+      spirword_t*       data()                          { return base; }
+      const spirword_t* data() const                    { return base; }
+      spirword_t&       operator[](size_t word)         { return base[word]; }
+      const spirword_t& operator[](size_t word) const   { return base[word]; }
+      void              resize(size_t size)             { assert(size <= count); count = size; }
+
+   private:
+      spirword_t* base;
+      size_t      count;
+   };
+
    typedef std::pair<unsigned, unsigned> range_t;
    typedef std::function<void(spv::Id&)>                idfn_t;
    typedef std::function<bool(spv::Op, unsigned start)> instfn_t;
@@ -216,16 +257,20 @@ private:
    // spv::Id findType(const globaltypes_t& globalTypes, spv::Id lt) const;
    std::uint32_t hashType(unsigned typeStart) const;
 
-   spirvbin_t& process(instfn_t, idfn_t, unsigned begin = 0, unsigned end = 0);
-   int         processInstruction(unsigned word, instfn_t, idfn_t);
+   // Walk the instructions in [begin, end), calling instFn(opCode, start) for
+   // each and, unless that returns true, idFn(id) for each of its IDs.  The
+   // functions are template parameters, rather than instfn_t and idfn_t, so
+   // each walk's lambdas are called directly rather than through std::function.
+   template<class InstFn, class IdFn>
+   spirvbin_t& process(InstFn&& instFn, IdFn&& idFn, unsigned begin = 0, unsigned end = 0);
+   template<class InstFn, class IdFn>
+   int         processInstruction(unsigned word, InstFn& instFn, IdFn& idFn);
 
    void        validate() const;
    void        mapTypeConst();
    void        mapFnBodies();
    void        optLoadStore();
-   void        dceFuncs();
-   void        dceVars();
-   void        dceTypes();
+   void        dce();      // remove dead functions, variables, and types, to a fixpoint
    void        mapNames();
    void        foldIds();  // fold IDs to smallest space
    void        forwardLoadStores(); // load store forwarding (EXPERIMENTAL)
@@ -234,9 +279,12 @@ private:
    void        applyMap();            // remap per local name map
    void        mapRemainder();        // map any IDs we haven't touched yet
    void        stripDebug();          // strip debug info
-   void        strip();               // remove debug symbols
+   void        strip(bool rebuildMaps = true); // remove stripRange, then rebuild the local maps
+
+   size_t      stripWords() const;  // how many words stripRange covers
+   void        runPass(const char* name, const std::function<void()>& pass); // run and record in stats
    
-   std::vector<spirword_t> spv;      // SPIR words
+   words_t                 spv;      // SPIR words
 
    namemap_t               nameMap;  // ID names from OpName
 
@@ -258,11 +306,7 @@ private:
    // Function start and end.  use unordered_map because we'll have
    // many fewer functions than IDs.
    std::unordered_map<spv::Id, range_t> fnPos;
-   std::unordered_map<spv::Id, range_t> fnPosDCE; // deleted functions
 
-   // Which functions are called, anywhere in the module, with a call count
-   std::unordered_map<spv::Id, int> fnCalls;
-   
    posmap_t     typeConstPos;   // word positions that define types & consts (ordered)
    posmap_rev_t typeConstPosR;  // reverse map from IDs to positions
    
@@ -274,6 +318,10 @@ private:
    // Sections of the binary to strip, given as [begin,end)
    std::vector<range_t> stripRange;
 
+   std::vector<passstats_t> stats;              // of each pass of the last remap()
+   size_t                   idsMapped;          // IDs given new values so far
+   size_t                   instructionsWalked; // by processInstruction() so far
+
    // processing options:
    std::uint32_t options;
    int           verbose;     // verbosity level
@@ -282,6 +330,155 @@ private:
    static logfn_t   logHandler;
 };
 
+template<class InstFn, class IdFn>
+int spirvbin_t::processInstruction(unsigned word, InstFn& instFn, IdFn& idFn)
+{
+    const auto     instructionStart = word;
+    const unsigned wordCount = asWordCount(instructionStart);
+    const spv::Op  opCode    = asOpCode(instructionStart);
+    const int      nextInst  = word++ + wordCount;
+    const spv::InstructionParameters& desc = spv::InstructionDesc[opCode];
+
+    ++instructionsWalked;
+
+    if (nextInst > int(spv.size()))
+        error("spir instruction terminated too early");
+
+    // Base for computing number of operands; will be updated as more is learned
+    unsigned numOperands = wordCount - 1;
+
+    if (instFn(opCode, instructionStart))
+        return nextInst;
+
+    // Read type and result ID from instruction desc table
+    if (desc.hasType()) {
+        idFn(asId(word++));
+        --numOperands;
+    }
+
+    if (desc.hasResult()) {
+        idFn(asId(word++));
+        --numOperands;
+    }
+
+    // Extended instructions: currently, assume everything is an ID.
+    // TODO: add whatever data we need for exceptions to that
+    if (opCode == spv::OpExtInst) {
+        word        += 2; // instruction set, and instruction from set
+        numOperands -= 2;
+
+        for (unsigned op=0; op < numOperands; ++op)
+            idFn(asId(word++)); // ID
+
+        return nextInst;
+    }
+
+    // Store IDs from instruction in our map
+    for (int op = 0; op < desc.operands.getNum(); ++op, --numOperands) {
+        switch (desc.operands.getClass(op)) {
+        case spv::OperandId:
+        case spv::OperandScope:
+        case spv::OperandMemorySemantics:
+            // glslang makes scopes and semantics constants
+            idFn(asId(word++));
+            break;
+
+        case spv::OperandOptionalId:
+        case spv::OperandVariableIds:
+            for (unsigned i = 0; i < numOperands; ++i)
+                idFn(asId(word++));
+            return nextInst;
+
+        case spv::OperandOptionalImage:
+            // an image operands mask, then the IDs it calls for
+            if (numOperands > 0) {
+                ++word;
+                for (unsigned i = 1; i < numOperands; ++i)
+                    idFn(asId(word++));
+            }
+            return nextInst;
+
+        case spv::OperandVariableLiterals:
+            // for clarity
+            // if (opCode == spv::OpDecorate && asDecoration(word - 1) == spv::DecorationBuiltIn) {
+            //     ++word;
+            //     --numOperands;
+            // }
+            // word += numOperands;
+            return nextInst;
+
+        case spv::OperandVariableLiteralId:
+            while (numOperands > 0) {
+                ++word;             // immediate
+                idFn(asId(word++)); // ID
+                numOperands -= 2;
+            }
+            return nextInst;
+
+        case spv::OperandLiteralString:
+            // word += literalStringWords(literalString(word)); // for clarity
+            return nextInst;
+
+            // Single word operands we simply ignore, as they hold no IDs
+        case spv::OperandLiteralNumber:
+        case spv::OperandSource:
+        case spv::OperandExecutionModel:
+        case spv::OperandAddressing:
+        case spv::OperandMemory:
+        case spv::OperandExecutionMode:
+        case spv::OperandStorage:
+        case spv::OperandDimensionality:
+        case spv::OperandSamplerAddressingMode:
+        case spv::OperandSamplerFilterMode:
+        case spv::OperandSamplerImageFormat:
+        case spv::OperandImageChannelOrder:
+        case spv::OperandImageChannelDataType:
+        case spv::OperandImageOperands:
+        case spv::OperandFPFastMath:
+        case spv::OperandFPRoundingMode:
+        case spv::OperandLinkageType:
+        case spv::OperandAccessQualifier:
+        case spv::OperandFuncParamAttr:
+        case spv::OperandDecoration:
+        case spv::OperandBuiltIn:
+        case spv::OperandSelect:
+        case spv::OperandLoop:
+        case spv::OperandFunction:
+        case spv::OperandMemoryAccess:
+        case spv::OperandGroupOperation:
+        case spv::OperandKernelEnqueueFlags:
+        case spv::OperandKernelProfilingInfo:
+            ++word;
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    return nextInst;
+}
+
+// Make a pass over all the instructions and process them given appropriate functions
+template<class InstFn, class IdFn>
+spirvbin_t& spirvbin_t::process(InstFn&& instFn, IdFn&& idFn, unsigned begin, unsigned end)
+{
+    // For efficiency, reserve name map space.  It can grow if needed.
+    nameMap.reserve(32);
+
+    // If begin or end == 0, use defaults
+    begin = (begin == 0 ? header_size          : begin);
+    end   = (end   == 0 ? unsigned(spv.size()) : end);
+
+    // basic parsing and InstructionDesc table borrowed from SpvDisassemble.cpp...
+    unsigned nextInst = unsigned(spv.size());
+
+    for (unsigned word = begin; word < end; word = nextInst)
+        nextInst = processInstruction(word, instFn, idFn);
+
+    return *this;
+}
+
 } // namespace SPV
 
 #endif // defined (use_cpp11)
@@ -44,10 +44,14 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <unordered_set>
+#include <mutex>
+#include <functional>
 
 #include "SpvBuilder.h"
+#include "doc.h"
 
 #ifndef _WIN32
     #include <cstdio>
@@ -65,11 +69,32 @@ Builder::Builder(unsigned int userNumber) :
     builderNumber(userNumber << 16 | SpvBuilderMagic),
     buildPoint(0),
     uniqueId(0),
-    mainFunction(0)
+    mainFunction(0),
+    streamingFunctions(false),
+    forkParent(nullptr),
+    firstForkId(0)
 {
     clearAccessChain();
 }
 
+Builder::Builder(const Builder& parent, Id firstId) :
+    source(parent.source),
+    sourceVersion(parent.sourceVersion),
+    addressModel(parent.addressModel),
+    memoryModel(parent.memoryModel),
+    builderNumber(parent.builderNumber),
+    module(parent.module, firstId),
+    buildPoint(0),
+    uniqueId(firstId - 1),
+    mainFunction(0),
+    streamingFunctions(false),
+    forkParent(&parent),
+    firstForkId(firstId)
+{
+    assert(parent.uniqueId < firstId);
+    clearAccessChain();
+}
+
 Builder::Builder(Builder&&) = default;
 Builder& Builder::operator=(Builder&&) = default;
 
@@ -79,38 +104,95 @@ Builder::~Builder()
 
 Id Builder::import(const char* name)
 {
-    Instruction* import = new Instruction(getUniqueId(), NoType, OpExtInstImport);
+    Instruction* import = newInstruction(getUniqueId(), NoType, OpExtInstImport);
     import->addStringOperand(name);
     
     imports.push_back(import);
     return import->getResultId();
 }
 
-// For creating new groupedTypes (will return old type if the requested one was already made).
+size_t Builder::GroupedKeyHash::operator()(const std::vector<unsigned int>& key) const
+{
+    // FNV-1a over the words
+    size_t hash = 2166136261u;
+    for (size_t w = 0; w < key.size(); ++w) {
+        hash ^= key[w];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+void Builder::makeGroupedKey(Op opCode, Id typeId, const unsigned* operands, int numOperands) const
+{
+    groupedKey.clear();
+    groupedKey.push_back(opCode);
+    groupedKey.push_back(typeId);
+    groupedKey.insert(groupedKey.end(), operands, operands + numOperands);
+}
+
+// Find the type or constant already made with exactly this opcode, type, and operands.
+Instruction* Builder::findGrouped(Op opCode, Id typeId, const unsigned* operands, int numOperands) const
+{
+    makeGroupedKey(opCode, typeId, operands, numOperands);
+
+    auto it = grouped.find(groupedKey);
+    if (it != grouped.end())
+        return it->second;
+
+    // a fork also has what its parent made
+    if (forkParent) {
+        it = forkParent->grouped.find(groupedKey);
+        if (it != forkParent->grouped.end())
+            return it->second;
+    }
+
+    return nullptr;
+}
+
+// Whether this builder made 'instruction' with addGrouped().
+bool Builder::isGrouped(const Instruction* instruction) const
+{
+    makeGroupedKey(instruction->getOpCode(), instruction->getTypeId(), instruction->getOperands(), instruction->getNumOperands());
+    auto it = grouped.find(groupedKey);
+
+    return it != grouped.end() && it->second == instruction;
+}
+
+// Make a new type or constant findable by findGrouped(), and emit it.
+void Builder::addGrouped(Instruction* instruction)
+{
+    std::vector<unsigned int> key;
+    key.reserve(2 + instruction->getNumOperands());
+    key.push_back(instruction->getOpCode());
+    key.push_back(instruction->getTypeId());
+    for (int op = 0; op < instruction->getNumOperands(); ++op)
+        key.push_back(instruction->getImmediateOperand(op));
+    grouped[key] = instruction;
+
+    constantsTypesGlobals.push_back(instruction);
+    module.mapInstruction(instruction);
+}
+
+// For creating new types (will return old type if the requested one was already made).
 Id Builder::makeVoidType()
 {
-    Instruction* type;
-    if (groupedTypes[OpTypeVoid].size() == 0) {
-        type = new Instruction(getUniqueId(), NoType, OpTypeVoid);
-        groupedTypes[OpTypeVoid].push_back(type);
-        constantsTypesGlobals.push_back(type);
-        module.mapInstruction(type);
-    } else
-        type = groupedTypes[OpTypeVoid].back();
+    Instruction* type = findGrouped(OpTypeVoid, NoType, nullptr, 0);
+    if (! type) {
+        type = newInstruction(getUniqueId(), NoType, OpTypeVoid);
+        addGrouped(type);
+    }
 
     return type->getResultId();
 }
 
 Id Builder::makeBoolType()
 {
-    Instruction* type;
-    if (groupedTypes[OpTypeBool].size() == 0) {
-        type = new Instruction(getUniqueId(), NoType, OpTypeBool);
-        groupedTypes[OpTypeBool].push_back(type);
-        constantsTypesGlobals.push_back(type);
-        module.mapInstruction(type);
-    } else
-        type = groupedTypes[OpTypeBool].back();
+    Instruction* type = findGrouped(OpTypeBool, NoType, nullptr, 0);
+    if (! type) {
+        type = newInstruction(getUniqueId(), NoType, OpTypeBool);
+        addGrouped(type);
+    }
 
     return type->getResultId();
 }
@@ -118,21 +200,16 @@ Id Builder::makeBoolType()
 Id Builder::makePointer(StorageClass storageClass, Id pointee)
 {
     // try to find it
-    Instruction* type;
-    for (int t = 0; t < (int)groupedTypes[OpTypePointer].size(); ++t) {
-        type = groupedTypes[OpTypePointer][t];
-        if (type->getImmediateOperand(0) == (unsigned)storageClass &&
-            type->getIdOperand(1) == pointee)
-            return type->getResultId();
-    }
+    const unsigned operands[] = { (unsigned)storageClass, pointee };
+    Instruction* type = findGrouped(OpTypePointer, NoType, operands, 2);
+    if (type)
+        return type->getResultId();
 
     // not found, make it
-    type = new Instruction(getUniqueId(), NoType, OpTypePointer);
+    type = newInstruction(getUniqueId(), NoType, OpTypePointer);
     type->addImmediateOperand(storageClass);
     type->addIdOperand(pointee);
-    groupedTypes[OpTypePointer].push_back(type);
-    constantsTypesGlobals.push_back(type);
-    module.mapInstruction(type);
+    addGrouped(type);
 
     return type->getResultId();
 }
@@ -140,21 +217,19 @@ Id Builder::makePointer(StorageClass storageClass, Id pointee)
 Id Builder::makeIntegerType(int width, bool hasSign)
 {
     // try to find it
-    Instruction* type;
-    for (int t = 0; t < (int)groupedTypes[OpTypeInt].size(); ++t) {
-        type = groupedTypes[OpTypeInt][t];
-        if (type->getImmediateOperand(0) == (unsigned)width &&
-            type->getImmediateOperand(1) == (hasSign ? 1u : 0u))
-            return type->getResultId();
-    }
+    const unsigned operands[] = { (unsigned)width, hasSign ? 1u : 0u };
+    Instruction* type = findGrouped(OpTypeInt, NoType, operands, 2);
+    if (type)
+        return type->getResultId();
 
     // not found, make it
-    type = new Instruction(getUniqueId(), NoType, OpTypeInt);
+    type = newInstruction(getUniqueId(), NoType, OpTypeInt);
     type->addImmediateOperand(width);
     type->addImmediateOperand(hasSign ? 1 : 0);
-    groupedTypes[OpTypeInt].push_back(type);
-    constantsTypesGlobals.push_back(type);
-    module.mapInstruction(type);
+    addGrouped(type);
+
+    if (width == 16 && ! hasCapability(CapabilityInt16))
+        addCapability(CapabilityInt16);
 
     return type->getResultId();
 }
@@ -162,30 +237,28 @@ Id Builder::makeIntegerType(int width, bool hasSign)
 Id Builder::makeFloatType(int width)
 {
     // try to find it
-    Instruction* type;
-    for (int t = 0; t < (int)groupedTypes[OpTypeFloat].size(); ++t) {
-        type = groupedTypes[OpTypeFloat][t];
-        if (type->getImmediateOperand(0) == (unsigned)width)
-            return type->getResultId();
-    }
+    const unsigned operands[] = { (unsigned)width };
+    Instruction* type = findGrouped(OpTypeFloat, NoType, operands, 1);
+    if (type)
+        return type->getResultId();
 
     // not found, make it
-    type = new Instruction(getUniqueId(), NoType, OpTypeFloat);
+    type = newInstruction(getUniqueId(), NoType, OpTypeFloat);
     type->addImmediateOperand(width);
-    groupedTypes[OpTypeFloat].push_back(type);
-    constantsTypesGlobals.push_back(type);
-    module.mapInstruction(type);
+    addGrouped(type);
+
+    if (width == 16)
+        addCapability(CapabilityFloat16);
 
     return type->getResultId();
 }
 
+// Structs are never shared, as each gets its own names and decorations.
 Id Builder::makeStructType(std::vector<Id>& members, const char* name)
 {
-    // not found, make it
-    Instruction* type = new Instruction(getUniqueId(), NoType, OpTypeStruct);
+    Instruction* type = newInstruction(getUniqueId(), NoType, OpTypeStruct);
     for (int op = 0; op < (int)members.size(); ++op)
         type->addIdOperand(members[op]);
-    groupedTypes[OpTypeStruct].push_back(type);
     constantsTypesGlobals.push_back(type);
     module.mapInstruction(type);
     addName(type->getResultId(), name);
@@ -196,21 +269,16 @@ Id Builder::makeStructType(std::vector<Id>& members, const char* name)
 Id Builder::makeVectorType(Id component, int size)
 {
     // try to find it
-    Instruction* type;
-    for (int t = 0; t < (int)groupedTypes[OpTypeVector].size(); ++t) {
-        type = groupedTypes[OpTypeVector][t];
-        if (type->getIdOperand(0) == component &&
-            type->getImmediateOperand(1) == (unsigned)size)
-            return type->getResultId();
-    }
+    const unsigned operands[] = { component, (unsigned)size };
+    Instruction* type = findGrouped(OpTypeVector, NoType, operands, 2);
+    if (type)
+        return type->getResultId();
 
     // not found, make it
-    type = new Instruction(getUniqueId(), NoType, OpTypeVector);
+    type = newInstruction(getUniqueId(), NoType, OpTypeVector);
     type->addIdOperand(component);
     type->addImmediateOperand(size);
-    groupedTypes[OpTypeVector].push_back(type);
-    constantsTypesGlobals.push_back(type);
-    module.mapInstruction(type);
+    addGrouped(type);
 
     return type->getResultId();
 }
@@ -222,21 +290,16 @@ Id Builder::makeMatrixType(Id component, int cols, int rows)
     Id column = makeVectorType(component, rows);
 
     // try to find it
-    Instruction* type;
-    for (int t = 0; t < (int)groupedTypes[OpTypeMatrix].size(); ++t) {
-        type = groupedTypes[OpTypeMatrix][t];
-        if (type->getIdOperand(0) == column &&
-            type->getImmediateOperand(1) == (unsigned)cols)
-            return type->getResultId();
-    }
+    const unsigned operands[] = { column, (unsigned)cols };
+    Instruction* type = findGrouped(OpTypeMatrix, NoType, operands, 2);
+    if (type)
+        return type->getResultId();
 
     // not found, make it
-    type = new Instruction(getUniqueId(), NoType, OpTypeMatrix);
+    type = newInstruction(getUniqueId(), NoType, OpTypeMatrix);
     type->addIdOperand(column);
     type->addImmediateOperand(cols);
-    groupedTypes[OpTypeMatrix].push_back(type);
-    constantsTypesGlobals.push_back(type);
-    module.mapInstruction(type);
+    addGrouped(type);
 
     return type->getResultId();
 }
@@ -247,28 +310,23 @@ Id Builder::makeArrayType(Id element, unsigned size)
     Id sizeId = makeUintConstant(size);
 
     // try to find existing type
-    Instruction* type;
-    for (int t = 0; t < (int)groupedTypes[OpTypeArray].size(); ++t) {
-        type = groupedTypes[OpTypeArray][t];
-        if (type->getIdOperand(0) == element &&
-            type->getIdOperand(1) == sizeId)
-            return type->getResultId();
-    }
+    const unsigned operands[] = { element, sizeId };
+    Instruction* type = findGrouped(OpTypeArray, NoType, operands, 2);
+    if (type)
+        return type->getResultId();
 
     // not found, make it
-    type = new Instruction(getUniqueId(), NoType, OpTypeArray);
+    type = newInstruction(getUniqueId(), NoType, OpTypeArray);
     type->addIdOperand(element);
     type->addIdOperand(sizeId);
-    groupedTypes[OpTypeArray].push_back(type);
-    constantsTypesGlobals.push_back(type);
-    module.mapInstruction(type);
+    addGrouped(type);
 
     return type->getResultId();
 }
 
 Id Builder::makeRuntimeArray(Id element)
 {
-    Instruction* type = new Instruction(getUniqueId(), NoType, OpTypeRuntimeArray);
+    Instruction* type = newInstruction(getUniqueId(), NoType, OpTypeRuntimeArray);
     type->addIdOperand(element);
     constantsTypesGlobals.push_back(type);
     module.mapInstruction(type);
@@ -279,30 +337,18 @@ Id Builder::makeRuntimeArray(Id element)
 Id Builder::makeFunctionType(Id returnType, std::vector<Id>& paramTypes)
 {
     // try to find it
-    Instruction* type;
-    for (int t = 0; t < (int)groupedTypes[OpTypeFunction].size(); ++t) {
-        type = groupedTypes[OpTypeFunction][t];
-        if (type->getIdOperand(0) != returnType || (int)paramTypes.size() != type->getNumOperands() - 1)
-            continue;
-        bool mismatch = false;
-        for (int p = 0; p < (int)paramTypes.size(); ++p) {
-            if (paramTypes[p] != type->getIdOperand(p + 1)) {
-                mismatch = true;
-                break;
-            }
-        }
-        if (! mismatch)
-            return type->getResultId();
-    }
+    std::vector<unsigned> operands(1, returnType);
+    operands.insert(operands.end(), paramTypes.begin(), paramTypes.end());
+    Instruction* type = findGrouped(OpTypeFunction, NoType, operands.data(), (int)operands.size());
+    if (type)
+        return type->getResultId();
 
     // not found, make it
-    type = new Instruction(getUniqueId(), NoType, OpTypeFunction);
+    type = newInstruction(getUniqueId(), NoType, OpTypeFunction);
     type->addIdOperand(returnType);
     for (int p = 0; p < (int)paramTypes.size(); ++p)
         type->addIdOperand(paramTypes[p]);
-    groupedTypes[OpTypeFunction].push_back(type);
-    constantsTypesGlobals.push_back(type);
-    module.mapInstruction(type);
+    addGrouped(type);
 
     return type->getResultId();
 }
@@ -310,21 +356,14 @@ Id Builder::makeFunctionType(Id returnType, std::vector<Id>& paramTypes)
 Id Builder::makeImageType(Id sampledType, Dim dim, bool depth, bool arrayed, bool ms, unsigned sampled, ImageFormat format)
 {
     // try to find it
-    Instruction* type;
-    for (int t = 0; t < (int)groupedTypes[OpTypeImage].size(); ++t) {
-        type = groupedTypes[OpTypeImage][t];
-        if (type->getIdOperand(0) == sampledType &&
-            type->getImmediateOperand(1) == (unsigned int)dim &&
-            type->getImmediateOperand(2) == (  depth ? 1u : 0u) &&
-            type->getImmediateOperand(3) == (arrayed ? 1u : 0u) &&
-            type->getImmediateOperand(4) == (     ms ? 1u : 0u) &&
-            type->getImmediateOperand(5) == sampled &&
-            type->getImmediateOperand(6) == (unsigned int)format)
-            return type->getResultId();
-    }
+    const unsigned operands[] = { sampledType, (unsigned)dim, depth ? 1u : 0u, arrayed ? 1u : 0u, ms ? 1u : 0u,
+                                  sampled, (unsigned)format };
+    Instruction* type = findGrouped(OpTypeImage, NoType, operands, 7);
+    if (type)
+        return type->getResultId();
 
     // not found, make it
-    type = new Instruction(getUniqueId(), NoType, OpTypeImage);
+    type = newInstruction(getUniqueId(), NoType, OpTypeImage);
     type->addIdOperand(sampledType);
     type->addImmediateOperand(   dim);
     type->addImmediateOperand(  depth ? 1 : 0);
@@ -332,10 +371,7 @@ Id Builder::makeImageType(Id sampledType, Dim dim, bool depth, bool arrayed, boo
     type->addImmediateOperand(     ms ? 1 : 0);
     type->addImmediateOperand(sampled);
     type->addImmediateOperand((unsigned int)format);
-
-    groupedTypes[OpTypeImage].push_back(type);
-    constantsTypesGlobals.push_back(type);
-    module.mapInstruction(type);
+    addGrouped(type);
 
     return type->getResultId();
 }
@@ -343,24 +379,38 @@ Id Builder::makeImageType(Id sampledType, Dim dim, bool depth, bool arrayed, boo
 Id Builder::makeSampledImageType(Id imageType)
 {
     // try to find it
-    Instruction* type;
-    for (int t = 0; t < (int)groupedTypes[OpTypeSampledImage].size(); ++t) {
-        type = groupedTypes[OpTypeSampledImage][t];
-        if (type->getIdOperand(0) == imageType)
-            return type->getResultId();
-    }
+    const unsigned operands[] = { imageType };
+    Instruction* type = findGrouped(OpTypeSampledImage, NoType, operands, 1);
+    if (type)
+        return type->getResultId();
 
     // not found, make it
-    type = new Instruction(getUniqueId(), NoType, OpTypeSampledImage);
+    type = newInstruction(getUniqueId(), NoType, OpTypeSampledImage);
     type->addIdOperand(imageType);
-
-    groupedTypes[OpTypeSampledImage].push_back(type);
-    constantsTypesGlobals.push_back(type);
-    module.mapInstruction(type);
+    addGrouped(type);
 
     return type->getResultId();
 }
 
+// Comments in header
+Id Builder::makeTypeOfWidth(Id typeId, int width)
+{
+    Instruction* instr = module.getInstruction(typeId);
+
+    switch (instr->getOpCode()) {
+    case OpTypeInt:
+        return makeIntegerType(width, instr->getImmediateOperand(1) != 0);
+    case OpTypeFloat:
+        return makeFloatType(width);
+    case OpTypeVector:
+        return makeVectorType(makeTypeOfWidth(instr->getIdOperand(0), width), instr->getImmediateOperand(1));
+    case OpTypeMatrix:
+        return makeMatrixType(makeTypeOfWidth(getScalarTypeId(typeId), width), getTypeNumColumns(typeId), getTypeNumRows(typeId));
+    default:
+        return typeId;
+    }
+}
+
 Id Builder::getDerefTypeId(Id resultId) const
 {
     Id typeId = getTypeId(resultId);
@@ -442,6 +492,21 @@ Id Builder::getScalarTypeId(Id typeId) const
     }
 }
 
+// Comments in header
+int Builder::getScalarTypeWidth(Id typeId) const
+{
+    Op typeClass = getTypeClass(typeId);
+    if (typeClass == OpTypeVector || typeClass == OpTypeMatrix) {
+        typeId = getScalarTypeId(typeId);
+        typeClass = getTypeClass(typeId);
+    }
+
+    if (typeClass != OpTypeInt && typeClass != OpTypeFloat)
+        return 0;
+
+    return module.getInstruction(typeId)->getImmediateOperand(0);
+}
+
 // Return the type of 'member' of a composite.
 Id Builder::getContainedTypeId(Id typeId, int member) const
 {
@@ -473,34 +538,20 @@ Id Builder::getContainedTypeId(Id typeId) const
 
 // See if a scalar constant of this type has already been created, so it
 // can be reused rather than duplicated.  (Required by the specification).
-Id Builder::findScalarConstant(Op typeClass, Id typeId, unsigned value) const
+Id Builder::findScalarConstant(Id typeId, unsigned value) const
 {
-    Instruction* constant;
-    for (int i = 0; i < (int)groupedConstants[typeClass].size(); ++i) {
-        constant = groupedConstants[typeClass][i];
-        if (constant->getNumOperands() == 1 &&
-            constant->getTypeId() == typeId &&
-            constant->getImmediateOperand(0) == value)
-            return constant->getResultId();
-    }
+    Instruction* constant = findGrouped(OpConstant, typeId, &value, 1);
 
-    return 0;
+    return constant ? constant->getResultId() : 0;
 }
 
 // Version of findScalarConstant (see above) for scalars that take two operands (e.g. a 'double').
-Id Builder::findScalarConstant(Op typeClass, Id typeId, unsigned v1, unsigned v2) const
+Id Builder::findScalarConstant(Id typeId, unsigned v1, unsigned v2) const
 {
-    Instruction* constant;
-    for (int i = 0; i < (int)groupedConstants[typeClass].size(); ++i) {
-        constant = groupedConstants[typeClass][i];
-        if (constant->getNumOperands() == 2 &&
-            constant->getTypeId() == typeId &&
-            constant->getImmediateOperand(0) == v1 &&
-            constant->getImmediateOperand(1) == v2)
-            return constant->getResultId();
-    }
+    const unsigned operands[] = { v1, v2 };
+    Instruction* constant = findGrouped(OpConstant, typeId, operands, 2);
 
-    return 0;
+    return constant ? constant->getResultId() : 0;
 }
 
 // Return true if consuming 'opcode' means consuming a constant.
@@ -527,115 +578,196 @@ bool Builder::isConstantOpCode(Op opcode) const
     }
 }
 
-Id Builder::makeBoolConstant(bool b)
+// Is the value one that is only known once specialized?
+bool Builder::isSpecConstantOpCode(Op opcode) const
+{
+    switch (opcode) {
+    case OpSpecConstantTrue:
+    case OpSpecConstantFalse:
+    case OpSpecConstant:
+    case OpSpecConstantComposite:
+    case OpSpecConstantOp:
+        return true;
+    default:
+        return false;
+    }
+}
+
+Id Builder::makeBoolConstant(bool b, bool specConstant)
 {
     Id typeId = makeBoolType();
-    Instruction* constant;
+    Op opcode = specConstant ? (b ? OpSpecConstantTrue : OpSpecConstantFalse) : (b ? OpConstantTrue : OpConstantFalse);
 
     // See if we already made it
-    Id existing = 0;
-    for (int i = 0; i < (int)groupedConstants[OpTypeBool].size(); ++i) {
-        constant = groupedConstants[OpTypeBool][i];
-        if (constant->getTypeId() == typeId &&
-            (b ? (constant->getOpCode() == OpConstantTrue) : 
-                 (constant->getOpCode() == OpConstantFalse)))
-            existing = constant->getResultId();
+    if (! specConstant) {
+        Instruction* existing = findGrouped(opcode, typeId, nullptr, 0);
+        if (existing)
+            return existing->getResultId();
     }
 
-    if (existing)
-        return existing;
-
     // Make it
-    Instruction* c = new Instruction(getUniqueId(), typeId, b ? OpConstantTrue : OpConstantFalse);
-    constantsTypesGlobals.push_back(c);
-    groupedConstants[OpTypeBool].push_back(c);
-    module.mapInstruction(c);
+    Instruction* c = newInstruction(getUniqueId(), typeId, opcode);
+    if (specConstant)
+        addSpecConstant(c);
+    else
+        addGrouped(c);
 
     return c->getResultId();
 }
 
-Id Builder::makeIntConstant(Id typeId, unsigned value)
+Id Builder::makeIntConstant(Id typeId, unsigned value, bool specConstant)
 {
-    Id existing = findScalarConstant(OpTypeInt, typeId, value);
-    if (existing)
-        return existing;
+    if (! specConstant) {
+        Id existing = findScalarConstant(typeId, value);
+        if (existing)
+            return existing;
+    }
 
-    Instruction* c = new Instruction(getUniqueId(), typeId, OpConstant);
+    Instruction* c = newInstruction(getUniqueId(), typeId, specConstant ? OpSpecConstant : OpConstant);
     c->addImmediateOperand(value);
-    constantsTypesGlobals.push_back(c);
-    groupedConstants[OpTypeInt].push_back(c);
-    module.mapInstruction(c);
+    if (specConstant)
+        addSpecConstant(c);
+    else
+        addGrouped(c);
 
     return c->getResultId();
 }
 
-Id Builder::makeFloatConstant(float f)
+Id Builder::makeFloatConstant(float f, bool specConstant)
 {
     Id typeId = makeFloatType(32);
     unsigned value = *(unsigned int*)&f;
-    Id existing = findScalarConstant(OpTypeFloat, typeId, value);
-    if (existing)
-        return existing;
+    if (! specConstant) {
+        Id existing = findScalarConstant(typeId, value);
+        if (existing)
+            return existing;
+    }
 
-    Instruction* c = new Instruction(getUniqueId(), typeId, OpConstant);
+    Instruction* c = newInstruction(getUniqueId(), typeId, specConstant ? OpSpecConstant : OpConstant);
     c->addImmediateOperand(value);
-    constantsTypesGlobals.push_back(c);
-    groupedConstants[OpTypeFloat].push_back(c);
-    module.mapInstruction(c);
+    if (specConstant)
+        addSpecConstant(c);
+    else
+        addGrouped(c);
 
     return c->getResultId();
 }
 
-Id Builder::makeDoubleConstant(double d)
+namespace {
+
+// The bits of the IEEE 754 half nearest to those of the single 'f', ties to even.
+unsigned int FloatToHalf(unsigned int f)
+{
+    unsigned int sign = (f >> 16) & 0x8000;
+    int exponent = (int)((f >> 23) & 0xff);
+    unsigned int mantissa = f & 0x7fffff;
+
+    // infinity, or NaN, kept quiet
+    if (exponent == 0xff)
+        return sign | 0x7c00 | (mantissa ? 0x200 | (mantissa >> 13) : 0);
+
+    // too big for a half
+    exponent -= 127 - 15;
+    if (exponent >= 0x1f)
+        return sign | 0x7c00;
+
+    // shift out what doesn't fit, with the implicit one for a half denormal
+    int shift = 13;
+    if (exponent <= 0) {
+        if (exponent < -10)
+            return sign;
+        mantissa |= 0x800000;
+        shift = 14 - exponent;
+        exponent = 0;
+    }
+    unsigned int half = ((unsigned int)exponent << 10) + (mantissa >> shift);
+    unsigned int rest = mantissa & ((1u << shift) - 1);
+    unsigned int halfway = 1u << (shift - 1);
+
+    // rounding up can carry into the exponent, which is still right
+    if (rest > halfway || (rest == halfway && (half & 1)))
+        ++half;
+
+    return sign | half;
+}
+
+// The bits of the IEEE 754 single equal to the half 'h'.
+unsigned int HalfToFloat(unsigned int h)
+{
+    unsigned int sign = (h & 0x8000) << 16;
+    int exponent = (int)((h >> 10) & 0x1f);
+    unsigned int mantissa = h & 0x3ff;
+
+    // infinity or NaN
+    if (exponent == 0x1f)
+        return sign | 0x7f800000 | (mantissa << 13);
+
+    // zero, or a denormal to normalize
+    if (exponent == 0) {
+        if (mantissa == 0)
+            return sign;
+        exponent = 1;
+        while ((mantissa & 0x400) == 0) {
+            mantissa <<= 1;
+            --exponent;
+        }
+        mantissa &= 0x3ff;
+    }
+
+    return sign | ((unsigned int)(exponent + 127 - 15) << 23) | (mantissa << 13);
+}
+
+}  // end anonymous namespace
+
+// A half constant's literal is its 16 bits, in the low-order half of the word.
+Id Builder::makeFloat16Constant(float f, bool specConstant)
+{
+    unsigned int bits;
+    memcpy(&bits, &f, sizeof(bits));
+
+    return makeIntConstant(makeFloatType(16), FloatToHalf(bits), specConstant);
+}
+
+Id Builder::makeDoubleConstant(double d, bool specConstant)
 {
     Id typeId = makeFloatType(64);
     unsigned long long value = *(unsigned long long*)&d;
     unsigned op1 = value & 0xFFFFFFFF;
     unsigned op2 = value >> 32;
-    Id existing = findScalarConstant(OpTypeFloat, typeId, op1, op2);
-    if (existing)
-        return existing;
+    if (! specConstant) {
+        Id existing = findScalarConstant(typeId, op1, op2);
+        if (existing)
+            return existing;
+    }
 
-    Instruction* c = new Instruction(getUniqueId(), typeId, OpConstant);
+    Instruction* c = newInstruction(getUniqueId(), typeId, specConstant ? OpSpecConstant : OpConstant);
     c->addImmediateOperand(op1);
     c->addImmediateOperand(op2);
-    constantsTypesGlobals.push_back(c);
-    groupedConstants[OpTypeFloat].push_back(c);
-    module.mapInstruction(c);
+    if (specConstant)
+        addSpecConstant(c);
+    else
+        addGrouped(c);
 
     return c->getResultId();
 }
 
-Id Builder::findCompositeConstant(Op typeClass, std::vector<Id>& comps) const
+// Specialization constants stay out of the grouping; two of them with the
+// same default value are still two distinct constants.
+void Builder::addSpecConstant(Instruction* constant)
 {
-    Instruction* constant = 0;
-    bool found = false;
-    for (int i = 0; i < (int)groupedConstants[typeClass].size(); ++i) {
-        constant = groupedConstants[typeClass][i];
-
-        // same shape?
-        if (constant->getNumOperands() != (int)comps.size())
-            continue;
+    constantsTypesGlobals.push_back(constant);
+    module.mapInstruction(constant);
+}
 
-        // same contents?
-        bool mismatch = false;
-        for (int op = 0; op < constant->getNumOperands(); ++op) {
-            if (constant->getIdOperand(op) != comps[op]) {
-                mismatch = true;
-                break;
-            }
-        }
-        if (! mismatch) {
-            found = true;
-            break;
-        }
-    }
+Id Builder::findCompositeConstant(Op opcode, Id typeId, std::vector<Id>& comps) const
+{
+    Instruction* constant = findGrouped(opcode, typeId, comps.data(), (int)comps.size());
 
-    return found ? constant->getResultId() : NoResult;
+    return constant ? constant->getResultId() : NoResult;
 }
 
 // Comments in header
-Id Builder::makeCompositeConstant(Id typeId, std::vector<Id>& members)
+Id Builder::makeCompositeConstant(Id typeId, std::vector<Id>& members, bool specConstant)
 {
     assert(typeId);
     Op typeClass = getTypeClass(typeId);
@@ -651,23 +783,24 @@ Id Builder::makeCompositeConstant(Id typeId, std::vector<Id>& members)
         return makeFloatConstant(0.0);
     }
 
-    Id existing = findCompositeConstant(typeClass, members);
+    // A composite is only a function of its constituents' ids, so even
+    // a specialization-constant composite can be shared.
+    Op opcode = specConstant ? OpSpecConstantComposite : OpConstantComposite;
+    Id existing = findCompositeConstant(opcode, typeId, members);
     if (existing)
         return existing;
 
-    Instruction* c = new Instruction(getUniqueId(), typeId, OpConstantComposite);
+    Instruction* c = newInstruction(getUniqueId(), typeId, opcode);
     for (int op = 0; op < (int)members.size(); ++op)
         c->addIdOperand(members[op]);
-    constantsTypesGlobals.push_back(c);
-    groupedConstants[typeClass].push_back(c);
-    module.mapInstruction(c);
+    addGrouped(c);
 
     return c->getResultId();
 }
 
 void Builder::addEntryPoint(ExecutionModel model, Function* function, const char* name)
 {
-    Instruction* entryPoint = new Instruction(OpEntryPoint);
+    Instruction* entryPoint = newInstruction(OpEntryPoint);
     entryPoint->addImmediateOperand(model);
     entryPoint->addIdOperand(function->getId());
     entryPoint->addStringOperand(name);
@@ -678,7 +811,7 @@ void Builder::addEntryPoint(ExecutionModel model, Function* function, const char
 // Currently relying on the fact that all 'value' of interest are small non-negative values.
 void Builder::addExecutionMode(Function* entryPoint, ExecutionMode mode, int value1, int value2, int value3)
 {
-    Instruction* instr = new Instruction(OpExecutionMode);
+    Instruction* instr = newInstruction(OpExecutionMode);
     instr->addIdOperand(entryPoint->getId());
     instr->addImmediateOperand(mode);
     if (value1 >= 0)
@@ -693,7 +826,7 @@ void Builder::addExecutionMode(Function* entryPoint, ExecutionMode mode, int val
 
 void Builder::addName(Id id, const char* string)
 {
-    Instruction* name = new Instruction(OpName);
+    Instruction* name = newInstruction(OpName);
     name->addIdOperand(id);
     name->addStringOperand(string);
 
@@ -702,7 +835,7 @@ void Builder::addName(Id id, const char* string)
 
 void Builder::addMemberName(Id id, int memberNumber, const char* string)
 {
-    Instruction* name = new Instruction(OpMemberName);
+    Instruction* name = newInstruction(OpMemberName);
     name->addIdOperand(id);
     name->addImmediateOperand(memberNumber);
     name->addStringOperand(string);
@@ -712,7 +845,7 @@ void Builder::addMemberName(Id id, int memberNumber, const char* string)
 
 void Builder::addLine(Id target, Id fileName, int lineNum, int column)
 {
-    Instruction* line = new Instruction(OpLine);
+    Instruction* line = newInstruction(OpLine);
     line->addIdOperand(target);
     line->addIdOperand(fileName);
     line->addImmediateOperand(lineNum);
@@ -723,7 +856,7 @@ void Builder::addLine(Id target, Id fileName, int lineNum, int column)
 
 void Builder::addDecoration(Id id, Decoration decoration, int num)
 {
-    Instruction* dec = new Instruction(OpDecorate);
+    Instruction* dec = newInstruction(OpDecorate);
     dec->addIdOperand(id);
     dec->addImmediateOperand(decoration);
     if (num >= 0)
@@ -732,9 +865,30 @@ void Builder::addDecoration(Id id, Decoration decoration, int num)
     decorations.push_back(dec);
 }
 
+// The name precedes the linkage type, so it goes in as literal words rather than
+// as the instruction's (trailing) string operand.
+void Builder::addLinkage(Id id, const char* name, LinkageType linkage)
+{
+    Instruction* dec = newInstruction(OpDecorate);
+    dec->addIdOperand(id);
+    dec->addImmediateOperand(DecorationLinkageAttributes);
+
+    // nul terminated, padded with 0s to whole words
+    size_t length = strlen(name) + 1;
+    for (size_t w = 0; w < (length + 3) / 4; ++w) {
+        unsigned int word = 0;
+        for (size_t c = 0; c < 4 && w * 4 + c < length; ++c)
+            word |= (unsigned int)(unsigned char)name[w * 4 + c] << (8 * c);
+        dec->addImmediateOperand(word);
+    }
+    dec->addImmediateOperand(linkage);
+
+    decorations.push_back(dec);
+}
+
 void Builder::addMemberDecoration(Id id, unsigned int member, Decoration decoration, int num)
 {
-    Instruction* dec = new Instruction(OpMemberDecorate);
+    Instruction* dec = newInstruction(OpMemberDecorate);
     dec->addIdOperand(id);
     dec->addImmediateOperand(member);
     dec->addImmediateOperand(decoration);
@@ -745,14 +899,14 @@ void Builder::addMemberDecoration(Id id, unsigned int member, Decoration decorat
 }
 
 // Comments in header
-Function* Builder::makeMain()
+Function* Builder::makeMain(const char* name)
 {
     assert(! mainFunction);
 
     Block* entry;
     std::vector<Id> params;
 
-    mainFunction = makeFunctionEntry(makeVoidType(), "main", params, &entry);
+    mainFunction = makeFunctionEntry(makeVoidType(), name, params, &entry);
 
     return mainFunction;
 }
@@ -762,10 +916,11 @@ Function* Builder::makeFunctionEntry(Id returnType, const char* name, std::vecto
 {
     Id typeId = makeFunctionType(returnType, paramTypes);
     Id firstParamId = paramTypes.size() == 0 ? 0 : getUniqueIds((int)paramTypes.size());
-    Function* function = new Function(getUniqueId(), returnType, typeId, firstParamId, module);
+    Arena* blockArena = streamingFunctions && entry ? &module.makeBlockArena() : nullptr;
+    Function* function = new(module.getArena()) Function(getUniqueId(), returnType, typeId, firstParamId, module, blockArena);
 
     if (entry) {
-        *entry = new Block(getUniqueId(), *function);
+        *entry = new(function->getArena()) Block(getUniqueId(), *function);
         function->addBlock(*entry);
         setBuildPoint(*entry);
     }
@@ -780,11 +935,11 @@ Function* Builder::makeFunctionEntry(Id returnType, const char* name, std::vecto
 void Builder::makeReturn(bool implicit, Id retVal)
 {
     if (retVal) {
-        Instruction* inst = new Instruction(NoResult, NoType, OpReturnValue);
+        Instruction* inst = newLocalInstruction(NoResult, NoType, OpReturnValue);
         inst->addIdOperand(retVal);
         buildPoint->addInstruction(inst);
     } else
-        buildPoint->addInstruction(new Instruction(NoResult, NoType, OpReturn));
+        buildPoint->addInstruction(newLocalInstruction(NoResult, NoType, OpReturn));
 
     if (! implicit)
         createAndSetNoPredecessorBlock("post-return");
@@ -821,10 +976,732 @@ void Builder::leaveFunction()
     }
 }
 
+// Comments in header
+void Builder::streamFunction(Function& function)
+{
+    assert(&function.getArena() != &module.getArena());
+    if (buildPoint && &buildPoint->getParent() == &function)
+        buildPoint = 0;
+    module.streamFunction(function);
+}
+
+// Comments in header
+Function* Builder::makeFunctionBody(const Function& declared)
+{
+    assert(forkParent);
+    Id firstParamId = declared.getNumParameters() == 0 ? 0 : declared.getParamId(0);
+    Function* body = new(module.getArena()) Function(declared.getId(), declared.getReturnType(), declared.getFunctionType(),
+                                                     firstParamId, module);
+    Block* entry = new(module.getArena()) Block(declared.getEntryBlock()->getId(), *body);
+    body->addBlock(entry);
+    setBuildPoint(entry);
+
+    return body;
+}
+
+namespace {
+
+// Call 'idOperand' with the index of each <id> operand (not the type or result)
+// of 'instruction', as classified by the grammar in doc.h.
+template<class IdOperand>
+void ForEachIdOperand(const Instruction& instruction, IdOperand idOperand)
+{
+    static const bool parameterized = (Parameterize(), true);
+    (void)parameterized;
+
+    const OperandParameters& operands = InstructionDesc[instruction.getOpCode()].operands;
+    const int numOperands = instruction.getNumOperands();
+    int op = 0;
+    for (int o = 0; o < operands.getNum() && op < numOperands; ++o) {
+        switch (operands.getClass(o)) {
+        case OperandId:
+        case OperandScope:
+        case OperandMemorySemantics:
+            // scopes and semantics are made as constants, see createControlBarrier()
+            idOperand(op++);
+            break;
+        case OperandOptionalId:
+        case OperandVariableIds:
+            for (; op < numOperands; ++op)
+                idOperand(op);
+            return;
+        case OperandOptionalImage:
+            // the image operands mask, then their ids
+            for (++op; op < numOperands; ++op)
+                idOperand(op);
+            return;
+        case OperandVariableIdLiteral:
+            for (; op < numOperands; op += 2)
+                idOperand(op);
+            return;
+        case OperandVariableLiteralId:
+            for (++op; op < numOperands; op += 2)
+                idOperand(op);
+            return;
+        case OperandVariableLiterals:
+        case OperandLiteralString:
+            return;
+        default:
+            // a single literal word
+            ++op;
+            break;
+        }
+    }
+}
+
+};  // end anonymous namespace
+
+// Comments in header
+Id Builder::getJoinedId(const Builder& fork, Id forkId) const
+{
+    if (forkId < fork.firstForkId)
+        return forkId;
+
+    assert(forkId - fork.firstForkId < fork.joinedIds.size() && fork.joinedIds[forkId - fork.firstForkId] != NoResult);
+    return fork.joinedIds[forkId - fork.firstForkId];
+}
+
+// Map what the fork made for a found span to what this builder has, by walking
+// the fork's instruction alongside ours.
+void Builder::joinCorresponding(Builder& fork, Id forkId, Id id, const ForkSpan& span)
+{
+    if (forkId < span.begin.id || forkId >= span.end.id || fork.joinedIds[forkId - fork.firstForkId] != NoResult)
+        return;
+    fork.joinedIds[forkId - fork.firstForkId] = id;
+
+    const Instruction* forkInstruction = fork.module.findInstruction(forkId);
+    const Instruction* instruction = module.findInstruction(id);
+    if (! forkInstruction || ! instruction || forkInstruction->getOpCode() != instruction->getOpCode() ||
+        forkInstruction->getNumOperands() != instruction->getNumOperands())
+        return;
+
+    if (forkInstruction->getTypeId())
+        joinCorresponding(fork, forkInstruction->getTypeId(), instruction->getTypeId(), span);
+    ForEachIdOperand(*forkInstruction, [&](int op) {
+        joinCorresponding(fork, forkInstruction->getIdOperand(op), instruction->getIdOperand(op), span);
+    });
+}
+
+// Comments in header
+void Builder::join(Builder& fork, Function* body, const ForkMark& begin, const ForkMark& end,
+                   const std::vector<ForkSpan>& found)
+{
+    assert(fork.forkParent == this && uniqueId < fork.firstForkId);
+    if (fork.joinedIds.size() < end.id - fork.firstForkId)
+        fork.joinedIds.resize(end.id - fork.firstForkId, NoResult);
+
+    const auto joinIds = [&](Instruction& instruction) {
+        if (instruction.getResultId())
+            instruction.setResultId(getJoinedId(fork, instruction.getResultId()));
+        if (instruction.getTypeId())
+            instruction.setTypeId(getJoinedId(fork, instruction.getTypeId()));
+        ForEachIdOperand(instruction, [&](int op) {
+            instruction.setIdOperand(op, getJoinedId(fork, instruction.getIdOperand(op)));
+        });
+    };
+    const auto inFound = [&](size_t ForkMark::* list, size_t position) {
+        for (size_t s = 0; s < found.size(); ++s) {
+            if (position >= found[s].begin.*list && position < found[s].end.*list)
+                return true;
+        }
+        return false;
+    };
+
+    // Number the fork's ids in the order it made them.  Its types, constants
+    // and globals, which only refer to earlier ids, join ours as they go,
+    // unless we have them already.
+    size_t global = begin.constantsTypesGlobals;
+    size_t span = 0;
+    for (Id id = begin.id; id < end.id; ++id) {
+        while (span < found.size() && id >= found[span].end.id)
+            ++span;
+        if (span < found.size() && id == found[span].begin.id)
+            joinCorresponding(fork, found[span].forkId, found[span].id, found[span]);
+
+        Instruction* instruction = nullptr;
+        if (global < end.constantsTypesGlobals && fork.constantsTypesGlobals[global]->getResultId() == id)
+            instruction = fork.constantsTypesGlobals[global++];
+
+        Id& joinedId = fork.joinedIds[id - fork.firstForkId];
+        if (joinedId != NoResult)
+            continue;
+
+        if (instruction) {
+            bool grouped = fork.isGrouped(instruction);
+            instruction->setResultId(NoResult);
+            joinIds(*instruction);
+            if (grouped) {
+                Instruction* existing = findGrouped(instruction->getOpCode(), instruction->getTypeId(),
+                                                    instruction->getOperands(), instruction->getNumOperands());
+                if (existing) {
+                    joinedId = existing->getResultId();
+                    continue;
+                }
+            }
+            joinedId = getUniqueId();
+            instruction->setResultId(joinedId);
+            if (grouped)
+                addGrouped(instruction);
+            else {
+                constantsTypesGlobals.push_back(instruction);
+                module.mapInstruction(instruction);
+            }
+        } else
+            joinedId = getUniqueId();
+    }
+
+    // Now everything can refer to anything.
+    const auto joinBody = [&](Instruction& instruction) {
+        joinIds(instruction);
+        if (instruction.getResultId())
+            module.mapInstruction(&instruction);
+    };
+    for (Block* block : body->getBlocks()) {
+        for (Instruction* instruction : block->getLocalVariables())
+            joinBody(*instruction);
+        for (Instruction* instruction : *block)
+            joinBody(*instruction);
+    }
+    for (size_t n = begin.names; n < end.names; ++n) {
+        if (! inFound(&ForkMark::names, n)) {
+            joinIds(*fork.names[n]);
+            names.push_back(fork.names[n]);
+        }
+    }
+    for (size_t d = begin.decorations; d < end.decorations; ++d) {
+        if (! inFound(&ForkMark::decorations, d)) {
+            joinIds(*fork.decorations[d]);
+            decorations.push_back(fork.decorations[d]);
+        }
+    }
+    for (size_t c = begin.capabilities; c < end.capabilities; ++c) {
+        if (! inFound(&ForkMark::capabilities, c) && ! hasCapability(fork.capabilities[c]))
+            capabilities.push_back(fork.capabilities[c]);
+    }
+
+    module.replaceFunction(body);
+}
+
+namespace {
+
+// What 'id' was forwarded to, following the whole chain (and shortening it).
+Id Forwarded(std::unordered_map<Id, Id>& forwarded, Id id)
+{
+    Id to = id;
+    for (auto it = forwarded.find(to); it != forwarded.end(); it = forwarded.find(to))
+        to = it->second;
+    while (id != to) {
+        Id& next = forwarded[id];
+        id = next;
+        next = to;
+    }
+
+    return to;
+}
+
+// The blocks branched to by the terminator of 'block', if it has one.
+template<class Target>
+void ForEachSuccessor(Block& block, Target target)
+{
+    const Instruction& terminator = **(block.end() - 1);
+    switch (terminator.getOpCode()) {
+    case OpBranch:
+        target(terminator.getIdOperand(0));
+        break;
+    case OpBranchConditional:
+        target(terminator.getIdOperand(1));
+        target(terminator.getIdOperand(2));
+        break;
+    case OpSwitch:
+        target(terminator.getIdOperand(1));
+        for (int op = 3; op < terminator.getNumOperands(); op += 2)
+            target(terminator.getIdOperand(op));
+        break;
+    default:
+        break;
+    }
+}
+
+};  // end anonymous namespace
+
+// Comments in header
+void Builder::simplify(bool forwardLoadsAndStores, bool eliminateCommonSubexpressions)
+{
+    std::unordered_set<Id> unforwardable;
+    std::unordered_set<Id> relaxed;
+    getSimplifyDecorations(unforwardable, relaxed);
+
+    for (Function* function : module.getFunctions()) {
+        if (! function->isStreamed())
+            simplifyFunction(*function, forwardLoadsAndStores, eliminateCommonSubexpressions, unforwardable, relaxed);
+    }
+
+    // don't name or decorate what's gone
+    const auto targetRemoved = [&](const Instruction* instruction) {
+        return simplifiedAway.find(instruction->getIdOperand(0)) != simplifiedAway.end();
+    };
+    names.erase(std::remove_if(names.begin(), names.end(), targetRemoved), names.end());
+    lines.erase(std::remove_if(lines.begin(), lines.end(), targetRemoved), lines.end());
+    decorations.erase(std::remove_if(decorations.begin(), decorations.end(), [&](const Instruction* decoration) {
+        return decoration->getOpCode() == OpDecorate && targetRemoved(decoration);
+    }), decorations.end());
+    simplifiedAway.clear();
+}
+
+// Comments in header
+void Builder::simplify(Function& function, bool forwardLoadsAndStores, bool eliminateCommonSubexpressions)
+{
+    std::unordered_set<Id> unforwardable;
+    std::unordered_set<Id> relaxed;
+    getSimplifyDecorations(unforwardable, relaxed);
+    simplifyFunction(function, forwardLoadsAndStores, eliminateCommonSubexpressions, unforwardable, relaxed);
+}
+
+// Ids whose memory can't be assumed to stay as last loaded or stored,
+// and those whose values can be kept at lower precision.
+void Builder::getSimplifyDecorations(std::unordered_set<Id>& unforwardable, std::unordered_set<Id>& relaxed) const
+{
+    for (const Instruction* decoration : decorations) {
+        if (decoration->getOpCode() != OpDecorate)
+            continue;
+        switch (decoration->getImmediateOperand(1)) {
+        case DecorationVolatile:
+        case DecorationCoherent:
+            unforwardable.insert(decoration->getIdOperand(0));
+            break;
+        case DecorationRelaxedPrecision:
+            relaxed.insert(decoration->getIdOperand(0));
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void Builder::simplifyFunction(Function& function, bool forwardLoadsAndStores, bool eliminateCommonSubexpressions,
+                               const std::unordered_set<Id>& unforwardable, const std::unordered_set<Id>& relaxed)
+{
+    std::unordered_map<Id, Id> forwarded;  // what each removed load, phi, or operation is now
+    if (forwardLoadsAndStores)
+        promoteLocalVariables(function, forwarded, simplifiedAway, relaxed);
+    simplifyBlocks(function, forwarded, simplifiedAway, unforwardable, relaxed,
+                   forwardLoadsAndStores, eliminateCommonSubexpressions);
+
+    // use what the removed results were forwarded to
+    for (Block* block : function.getBlocks()) {
+        for (Instruction* instruction : *block) {
+            ForEachIdOperand(*instruction, [&](int op) {
+                instruction->setIdOperand(op, Forwarded(forwarded, instruction->getIdOperand(op)));
+            });
+        }
+    }
+}
+
+//
+// Replace the loads of each local scalar or vector that's only loaded and
+// stored (so, never passed or indexed) with the value last stored to it, and
+// then remove the variable and its stores.  Where the paths into a block
+// store different values, the value is an OpPhi of them, made as needed by
+// looking back along the predecessors (so a loop header's phi is made before
+// walking around the loop).  Phis that turn out to merge just one value are
+// replaced by it.  Loads of what was never stored become OpUndef.
+//
+void Builder::promoteLocalVariables(Function& function, std::unordered_map<Id, Id>& forwarded,
+                                    std::unordered_set<Id>& removed, const std::unordered_set<Id>& relaxed)
+{
+    if (function.getBlocks().empty())
+        return;
+
+    // The variables that could be promoted
+    std::unordered_map<Id, int> variableIndex;
+    std::vector<Instruction*> variables;
+    for (Instruction* variable : function.getEntryBlock()->getLocalVariables()) {
+        Id pointee = getDerefTypeId(variable->getResultId());
+        if (variable->getNumOperands() == 1 && (isScalarType(pointee) || isVectorType(pointee))) {
+            variableIndex[variable->getResultId()] = (int)variables.size();
+            variables.push_back(variable);
+        }
+    }
+    if (variables.empty())
+        return;
+
+    // Keep only those used just as the pointer of non-volatile whole loads and stores.
+    std::vector<bool> promoted(variables.size(), true);
+    std::vector<Block*> blocks;
+    std::unordered_map<Id, int> blockIndex;
+    for (Block* block : function.getBlocks()) {
+        if (! block->isDumped())
+            continue;
+        blockIndex[block->getId()] = (int)blocks.size();
+        blocks.push_back(block);
+        for (const Instruction* instruction : *block) {
+            const Op opCode = instruction->getOpCode();
+            ForEachIdOperand(*instruction, [&](int op) {
+                auto variable = variableIndex.find(instruction->getIdOperand(op));
+                if (variable == variableIndex.end())
+                    return;
+                const int memoryAccess = opCode == OpLoad ? 1 : 2;
+                if ((opCode != OpLoad && opCode != OpStore) || op != 0 ||
+                    (instruction->getNumOperands() > memoryAccess &&
+                     (instruction->getImmediateOperand(memoryAccess) & MemoryAccessVolatileMask)))
+                    promoted[variable->second] = false;
+            });
+        }
+    }
+
+    // The predecessors of each block, from the branches, skipping what isn't dumped
+    std::vector<std::vector<int> > predecessors(blocks.size());
+    for (int b = 0; b < (int)blocks.size(); ++b) {
+        ForEachSuccessor(*blocks[b], [&](Id target) {
+            auto successor = blockIndex.find(target);
+            if (successor == blockIndex.end())
+                return;
+            std::vector<int>& preds = predecessors[successor->second];
+            if (std::find(preds.begin(), preds.end(), b) == preds.end())
+                preds.push_back(b);
+        });
+    }
+    if (blocks[0] != function.getEntryBlock() || ! predecessors[0].empty())
+        return;  // nowhere to put a phi before the variables
+
+    // The value each block leaves in each variable it stores to
+    std::vector<std::unordered_map<int, Id> > stored(blocks.size());
+    for (int b = 0; b < (int)blocks.size(); ++b) {
+        for (const Instruction* instruction : *blocks[b]) {
+            if (instruction->getOpCode() != OpStore)
+                continue;
+            auto variable = variableIndex.find(instruction->getIdOperand(0));
+            if (variable != variableIndex.end() && promoted[variable->second])
+                stored[b][variable->second] = instruction->getIdOperand(1);
+        }
+    }
+
+    // The value each variable has entering each block, found (and phis made) as needed
+    struct Phi {
+        Instruction* instruction;
+        int block;
+        int variable;
+        bool live;
+    };
+    std::vector<Phi> phis;
+    std::vector<std::unordered_map<int, Id> > entering(blocks.size());
+    std::function<Id(int, int)> valueEntering;
+    const auto valueLeaving = [&](int variable, int b) {
+        auto value = stored[b].find(variable);
+        return value != stored[b].end() ? value->second : valueEntering(variable, b);
+    };
+    valueEntering = [&](int variable, int b) -> Id {
+        auto value = entering[b].find(variable);
+        if (value != entering[b].end())
+            return value->second != NoResult ? value->second : makeUndefined(getDerefTypeId(variables[variable]->getResultId()));
+
+        const std::vector<int>& preds = predecessors[b];
+        Id id;
+        if (preds.empty())
+            id = makeUndefined(getDerefTypeId(variables[variable]->getResultId()));
+        else if (preds.size() == 1) {
+            entering[b][variable] = NoResult;  // only reached again around an unreachable cycle
+            id = valueLeaving(variable, preds[0]);
+        } else {
+            Id phiType = getDerefTypeId(variables[variable]->getResultId());
+            Instruction* phi = new(function.getArena()) Instruction(getUniqueId(), phiType, OpPhi, &function.getArena());
+            Phi made = { phi, b, variable, true };
+            phis.push_back(made);
+            entering[b][variable] = phi->getResultId();
+            for (int pred : preds) {
+                phi->addIdOperand(valueLeaving(variable, pred));
+                phi->addIdOperand(blocks[pred]->getId());
+            }
+            id = phi->getResultId();
+        }
+        entering[b][variable] = id;
+
+        return id;
+    };
+
+    // Forward the loads, and remove them, the stores, and the variables.
+    const auto forward = [&](Id from, Id to) {
+        to = Forwarded(forwarded, to);
+        if (to == from)  // around an unreachable cycle
+            to = makeUndefined(getTypeId(from));
+        forwarded[from] = to;
+    };
+    std::unordered_set<const Instruction*> removedInstructions;
+    for (int b = 0; b < (int)blocks.size(); ++b) {
+        std::unordered_map<int, Id> current;
+        for (const Instruction* instruction : *blocks[b]) {
+            const Op opCode = instruction->getOpCode();
+            if (opCode != OpLoad && opCode != OpStore)
+                continue;
+            auto variable = variableIndex.find(instruction->getIdOperand(0));
+            if (variable == variableIndex.end() || ! promoted[variable->second])
+                continue;
+            if (opCode == OpStore)
+                current[variable->second] = instruction->getIdOperand(1);
+            else {
+                auto value = current.find(variable->second);
+                forward(instruction->getResultId(), value != current.end() ? value->second : valueEntering(variable->second, b));
+                removed.insert(instruction->getResultId());
+            }
+            removedInstructions.insert(instruction);
+        }
+    }
+    for (int v = 0; v < (int)variables.size(); ++v) {
+        if (promoted[v]) {
+            removedInstructions.insert(variables[v]);
+            removed.insert(variables[v]->getResultId());
+        }
+    }
+
+    // Replace the phis merging just one value (besides themselves) with that value.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (Phi& phi : phis) {
+            if (! phi.live)
+                continue;
+            const Id id = phi.instruction->getResultId();
+            Id only = NoResult;
+            bool trivial = true;
+            for (int op = 0; op < phi.instruction->getNumOperands() && trivial; op += 2) {
+                Id value = Forwarded(forwarded, phi.instruction->getIdOperand(op));
+                if (value == id || value == only)
+                    continue;
+                if (only == NoResult)
+                    only = value;
+                else
+                    trivial = false;
+            }
+            if (trivial) {
+                phi.live = false;
+                forward(id, only != NoResult ? only : makeUndefined(phi.instruction->getTypeId()));
+                changed = true;
+            }
+        }
+    }
+
+    for (Block* block : blocks)
+        block->removeInstructions([&](const Instruction* instruction) { return removedInstructions.count(instruction) > 0; });
+    for (const Phi& phi : phis) {
+        if (phi.live) {
+            blocks[phi.block]->addInstructionAtFront(phi.instruction);
+            if (relaxed.count(variables[phi.variable]->getResultId()) > 0)
+                addDecoration(phi.instruction->getResultId(), DecorationRelaxedPrecision);
+        }
+    }
+}
+
+namespace {
+
+// Whether an instruction's result depends on nothing but its opcode, type and
+// operands (given it isn't passed a pointer it might read through).
+bool IsPure(Op opCode)
+{
+    switch (opCode) {
+    case OpAccessChain:
+    case OpInBoundsAccessChain:
+    case OpExtInst:
+    case OpConvertFToU:
+    case OpConvertFToS:
+    case OpConvertSToF:
+    case OpConvertUToF:
+    case OpUConvert:
+    case OpSConvert:
+    case OpFConvert:
+    case OpQuantizeToF16:
+    case OpSatConvertSToU:
+    case OpSatConvertUToS:
+    case OpBitcast:
+        return true;
+    default:
+        return (opCode >= OpVectorExtractDynamic && opCode <= OpTranspose) ||
+               (opCode >= OpSNegate && opCode <= OpIMulExtended) ||
+               (opCode >= OpAny && opCode <= OpBitCount) ||
+               (opCode >= OpDPdx && opCode <= OpFwidthCoarse);
+    }
+}
+
+// Whether the two operands of 'opCode' can be swapped without changing its result.
+bool IsCommutative(Op opCode)
+{
+    switch (opCode) {
+    case OpIAdd:
+    case OpFAdd:
+    case OpIMul:
+    case OpFMul:
+    case OpDot:
+    case OpLogicalEqual:
+    case OpLogicalNotEqual:
+    case OpLogicalOr:
+    case OpLogicalAnd:
+    case OpIEqual:
+    case OpINotEqual:
+    case OpFOrdEqual:
+    case OpFUnordEqual:
+    case OpFOrdNotEqual:
+    case OpFUnordNotEqual:
+    case OpBitwiseOr:
+    case OpBitwiseXor:
+    case OpBitwiseAnd:
+        return true;
+    default:
+        return false;
+    }
+}
+
+};  // end anonymous namespace
+
+//
+// Within each block, with 'forwardLoads', replace a load from a pointer with
+// the value last loaded from or stored to that pointer there, until something
+// might write memory.  Memory shared with other invocations, or decorated as
+// changing unseen, is always loaded.
+//
+// With 'numberValues', also replace an access chain or pure operation with an
+// earlier one in the block having the same opcode, type, precision and
+// operands (in either order, for commutative ones).  Operands are numbered
+// by what they were forwarded to, so, e.g., two chains indexed by two loads
+// of one variable become one.
+//
+void Builder::simplifyBlocks(Function& function, std::unordered_map<Id, Id>& forwarded, std::unordered_set<Id>& removed,
+                             const std::unordered_set<Id>& unforwardable, const std::unordered_set<Id>& relaxed,
+                             bool forwardLoads, bool numberValues)
+{
+    // Whether memory through 'pointer' stays as last loaded or stored, when nothing writes it
+    const auto forwardable = [&](Id pointer) {
+        StorageClass storageClass = module.getStorageClass(getTypeId(pointer));
+        if (storageClass == StorageClassWorkgroupLocal || storageClass == StorageClassWorkgroupGlobal)
+            return false;
+        for (;;) {
+            if (unforwardable.count(pointer) > 0)
+                return false;
+            const Instruction* instruction = module.getInstruction(pointer);
+            if (instruction->getOpCode() != OpAccessChain && instruction->getOpCode() != OpInBoundsAccessChain)
+                return true;
+            pointer = instruction->getIdOperand(0);
+        }
+    };
+
+    for (Block* block : function.getBlocks()) {
+        if (! block->isDumped())
+            continue;
+
+        std::unordered_map<Id, Id> known;  // pointer -> value
+        std::unordered_map<std::vector<unsigned int>, Id, GroupedKeyHash> values;
+        std::vector<unsigned int> key;
+        std::unordered_set<const Instruction*> removedInstructions;
+        const auto replace = [&](Instruction* instruction, Id id) {
+            forwarded[instruction->getResultId()] = id;
+            removed.insert(instruction->getResultId());
+            removedInstructions.insert(instruction);
+        };
+        for (Instruction* instruction : *block) {
+            bool givenPointer = false;
+            ForEachIdOperand(*instruction, [&](int op) {
+                Id id = Forwarded(forwarded, instruction->getIdOperand(op));
+                instruction->setIdOperand(op, id);
+                givenPointer = givenPointer || isPointerValue(id);
+            });
+
+            const Op opCode = instruction->getOpCode();
+            if (numberValues && IsPure(opCode) && (! givenPointer || opCode == OpAccessChain || opCode == OpInBoundsAccessChain)) {
+                const unsigned int* operands = instruction->getOperands();
+                const int numOperands = instruction->getNumOperands();
+                key.assign(1, opCode);
+                key.push_back(instruction->getTypeId());
+                key.push_back(relaxed.count(instruction->getResultId()) > 0);
+                if (IsCommutative(opCode) && operands[1] < operands[0]) {
+                    key.push_back(operands[1]);
+                    key.push_back(operands[0]);
+                } else
+                    key.insert(key.end(), operands, operands + numOperands);
+
+                auto value = values.find(key);
+                if (value != values.end())
+                    replace(instruction, value->second);
+                else
+                    values[key] = instruction->getResultId();
+                continue;
+            }
+
+            if (! forwardLoads)
+                continue;
+
+            switch (opCode) {
+            case OpLoad:
+            case OpStore:
+            {
+                const int memoryAccess = opCode == OpLoad ? 1 : 2;
+                const bool isVolatile = instruction->getNumOperands() > memoryAccess &&
+                                        (instruction->getImmediateOperand(memoryAccess) & MemoryAccessVolatileMask);
+                const Id pointer = instruction->getIdOperand(0);
+                if (opCode == OpStore)
+                    known.clear();
+                else {
+                    auto value = known.find(pointer);
+                    if (value != known.end() && ! isVolatile) {
+                        replace(instruction, value->second);
+                        break;
+                    }
+                }
+                if (! isVolatile && forwardable(pointer))
+                    known[pointer] = opCode == OpLoad ? instruction->getResultId() : instruction->getIdOperand(1);
+                break;
+            }
+            case OpAccessChain:
+            case OpInBoundsAccessChain:
+                break;
+            case OpFunctionCall:
+            case OpImageWrite:
+            case OpControlBarrier:
+            case OpMemoryBarrier:
+            case OpEmitVertex:
+            case OpEndPrimitive:
+            case OpEmitStreamVertex:
+            case OpEndStreamPrimitive:
+                known.clear();
+                break;
+            default:
+                // anything else given a pointer might write through it (e.g., atomics, modf())
+                if (givenPointer)
+                    known.clear();
+                break;
+            }
+        }
+        if (! removedInstructions.empty())
+            block->removeInstructions([&](const Instruction* instruction) { return removedInstructions.count(instruction) > 0; });
+    }
+}
+
+// Whether 'id' is a pointer (so isn't, e.g., a block label or extended instruction set).
+bool Builder::isPointerValue(Id id) const
+{
+    const Instruction* instruction = module.findInstruction(id);
+    if (! instruction || ! instruction->getTypeId())
+        return false;
+    const Instruction* type = module.findInstruction(instruction->getTypeId());
+
+    return type && type->getOpCode() == OpTypePointer;
+}
+
+// A module-scope undefined value of 'type', made once.
+Id Builder::makeUndefined(Id type)
+{
+    Id& undef = undefined[type];
+    if (undef == NoResult) {
+        Instruction* inst = newInstruction(getUniqueId(), type, OpUndef);
+        constantsTypesGlobals.push_back(inst);
+        module.mapInstruction(inst);
+        undef = inst->getResultId();
+    }
+
+    return undef;
+}
+
 // Comments in header
 void Builder::makeDiscard()
 {
-    buildPoint->addInstruction(new Instruction(OpKill));
+    buildPoint->addInstruction(newLocalInstruction(OpKill));
     createAndSetNoPredecessorBlock("post-discard");
 }
 
@@ -832,7 +1709,8 @@ void Builder::makeDiscard()
 Id Builder::createVariable(StorageClass storageClass, Id type, const char* name)
 {
     Id pointerType = makePointer(storageClass, type);
-    Instruction* inst = new Instruction(getUniqueId(), pointerType, OpVariable);
+    Instruction* inst = storageClass == StorageClassFunction ? newLocalInstruction(getUniqueId(), pointerType, OpVariable)
+                                                             : newInstruction(getUniqueId(), pointerType, OpVariable);
     inst->addImmediateOperand(storageClass);
 
     switch (storageClass) {
@@ -867,7 +1745,7 @@ Id Builder::createVariable(StorageClass storageClass, Id type, const char* name)
 // Comments in header
 Id Builder::createUndefined(Id type)
 {
-  Instruction* inst = new Instruction(getUniqueId(), type, OpUndef);
+  Instruction* inst = newLocalInstruction(getUniqueId(), type, OpUndef);
   buildPoint->addInstruction(inst);
   return inst->getResultId();
 }
@@ -875,7 +1753,7 @@ Id Builder::createUndefined(Id type)
 // Comments in header
 void Builder::createStore(Id rValue, Id lValue)
 {
-    Instruction* store = new Instruction(OpStore);
+    Instruction* store = newLocalInstruction(OpStore);
     store->addIdOperand(lValue);
     store->addIdOperand(rValue);
     buildPoint->addInstruction(store);
@@ -884,7 +1762,7 @@ void Builder::createStore(Id rValue, Id lValue)
 // Comments in header
 Id Builder::createCopyObject(Id value)
 {
-  Instruction* copy = new Instruction(getUniqueId(), getTypeId(value), OpCopyObject);
+  Instruction* copy = newLocalInstruction(getUniqueId(), getTypeId(value), OpCopyObject);
   copy->addIdOperand(value);
   buildPoint->addInstruction(copy);
 
@@ -894,7 +1772,7 @@ Id Builder::createCopyObject(Id value)
 // Comments in header
 Id Builder::createLoad(Id lValue)
 {
-    Instruction* load = new Instruction(getUniqueId(), getDerefTypeId(lValue), OpLoad);
+    Instruction* load = newLocalInstruction(getUniqueId(), getDerefTypeId(lValue), OpLoad);
     load->addIdOperand(lValue);
     buildPoint->addInstruction(load);
 
@@ -918,7 +1796,7 @@ Id Builder::createAccessChain(StorageClass storageClass, Id base, std::vector<Id
     typeId = makePointer(storageClass, typeId);
 
     // Make the instruction
-    Instruction* chain = new Instruction(getUniqueId(), typeId, OpAccessChain);
+    Instruction* chain = newLocalInstruction(getUniqueId(), typeId, OpAccessChain);
     chain->addIdOperand(base);
     for (int i = 0; i < (int)offsets.size(); ++i)
         chain->addIdOperand(offsets[i]);
@@ -929,7 +1807,7 @@ Id Builder::createAccessChain(StorageClass storageClass, Id base, std::vector<Id
 
 Id Builder::createArrayLength(Id base, unsigned int member)
 {
-    Instruction* length = new Instruction(getUniqueId(), makeIntType(32), OpArrayLength);
+    Instruction* length = newLocalInstruction(getUniqueId(), makeIntType(32), OpArrayLength);
     length->addIdOperand(base);
     length->addImmediateOperand(member);
     buildPoint->addInstruction(length);
@@ -939,7 +1817,7 @@ Id Builder::createArrayLength(Id base, unsigned int member)
 
 Id Builder::createCompositeExtract(Id composite, Id typeId, unsigned index)
 {
-    Instruction* extract = new Instruction(getUniqueId(), typeId, OpCompositeExtract);
+    Instruction* extract = newLocalInstruction(getUniqueId(), typeId, OpCompositeExtract);
     extract->addIdOperand(composite);
     extract->addImmediateOperand(index);
     buildPoint->addInstruction(extract);
@@ -949,7 +1827,7 @@ Id Builder::createCompositeExtract(Id composite, Id typeId, unsigned index)
 
 Id Builder::createCompositeExtract(Id composite, Id typeId, std::vector<unsigned>& indexes)
 {
-    Instruction* extract = new Instruction(getUniqueId(), typeId, OpCompositeExtract);
+    Instruction* extract = newLocalInstruction(getUniqueId(), typeId, OpCompositeExtract);
     extract->addIdOperand(composite);
     for (int i = 0; i < (int)indexes.size(); ++i)
         extract->addImmediateOperand(indexes[i]);
@@ -960,7 +1838,7 @@ Id Builder::createCompositeExtract(Id composite, Id typeId, std::vector<unsigned
 
 Id Builder::createCompositeInsert(Id object, Id composite, Id typeId, unsigned index)
 {
-    Instruction* insert = new Instruction(getUniqueId(), typeId, OpCompositeInsert);
+    Instruction* insert = newLocalInstruction(getUniqueId(), typeId, OpCompositeInsert);
     insert->addIdOperand(object);
     insert->addIdOperand(composite);
     insert->addImmediateOperand(index);
@@ -971,7 +1849,7 @@ Id Builder::createCompositeInsert(Id object, Id composite, Id typeId, unsigned i
 
 Id Builder::createCompositeInsert(Id object, Id composite, Id typeId, std::vector<unsigned>& indexes)
 {
-    Instruction* insert = new Instruction(getUniqueId(), typeId, OpCompositeInsert);
+    Instruction* insert = newLocalInstruction(getUniqueId(), typeId, OpCompositeInsert);
     insert->addIdOperand(object);
     insert->addIdOperand(composite);
     for (int i = 0; i < (int)indexes.size(); ++i)
@@ -983,7 +1861,7 @@ Id Builder::createCompositeInsert(Id object, Id composite, Id typeId, std::vecto
 
 Id Builder::createVectorExtractDynamic(Id vector, Id typeId, Id componentIndex)
 {
-    Instruction* extract = new Instruction(getUniqueId(), typeId, OpVectorExtractDynamic);
+    Instruction* extract = newLocalInstruction(getUniqueId(), typeId, OpVectorExtractDynamic);
     extract->addIdOperand(vector);
     extract->addIdOperand(componentIndex);
     buildPoint->addInstruction(extract);
@@ -993,7 +1871,7 @@ Id Builder::createVectorExtractDynamic(Id vector, Id typeId, Id componentIndex)
 
 Id Builder::createVectorInsertDynamic(Id vector, Id typeId, Id component, Id componentIndex)
 {
-    Instruction* insert = new Instruction(getUniqueId(), typeId, OpVectorInsertDynamic);
+    Instruction* insert = newLocalInstruction(getUniqueId(), typeId, OpVectorInsertDynamic);
     insert->addIdOperand(vector);
     insert->addIdOperand(component);
     insert->addIdOperand(componentIndex);
@@ -1005,14 +1883,14 @@ Id Builder::createVectorInsertDynamic(Id vector, Id typeId, Id component, Id com
 // An opcode that has no operands, no result id, and no type
 void Builder::createNoResultOp(Op opCode)
 {
-    Instruction* op = new Instruction(opCode);
+    Instruction* op = newLocalInstruction(opCode);
     buildPoint->addInstruction(op);
 }
 
 // An opcode that has one operand, no result id, and no type
 void Builder::createNoResultOp(Op opCode, Id operand)
 {
-    Instruction* op = new Instruction(opCode);
+    Instruction* op = newLocalInstruction(opCode);
     op->addIdOperand(operand);
     buildPoint->addInstruction(op);
 }
@@ -1020,7 +1898,7 @@ void Builder::createNoResultOp(Op opCode, Id operand)
 // An opcode that has one operand, no result id, and no type
 void Builder::createNoResultOp(Op opCode, const std::vector<Id>& operands)
 {
-    Instruction* op = new Instruction(opCode);
+    Instruction* op = newLocalInstruction(opCode);
     for (auto operand : operands)
         op->addIdOperand(operand);
     buildPoint->addInstruction(op);
@@ -1028,7 +1906,7 @@ void Builder::createNoResultOp(Op opCode, const std::vector<Id>& operands)
 
 void Builder::createControlBarrier(Scope execution, Scope memory, MemorySemanticsMask semantics)
 {
-    Instruction* op = new Instruction(OpControlBarrier);
+    Instruction* op = newLocalInstruction(OpControlBarrier);
     op->addImmediateOperand(makeUintConstant(execution));
     op->addImmediateOperand(makeUintConstant(memory));
     op->addImmediateOperand(makeUintConstant(semantics));
@@ -1037,7 +1915,7 @@ void Builder::createControlBarrier(Scope execution, Scope memory, MemorySemantic
 
 void Builder::createMemoryBarrier(unsigned executionScope, unsigned memorySemantics)
 {
-    Instruction* op = new Instruction(OpMemoryBarrier);
+    Instruction* op = newLocalInstruction(OpMemoryBarrier);
     op->addImmediateOperand(makeUintConstant(executionScope));
     op->addImmediateOperand(makeUintConstant(memorySemantics));
     buildPoint->addInstruction(op);
@@ -1046,7 +1924,7 @@ void Builder::createMemoryBarrier(unsigned executionScope, unsigned memorySemant
 // An opcode that has one operands, a result id, and a type
 Id Builder::createUnaryOp(Op opCode, Id typeId, Id operand)
 {
-    Instruction* op = new Instruction(getUniqueId(), typeId, opCode);
+    Instruction* op = newLocalInstruction(getUniqueId(), typeId, opCode);
     op->addIdOperand(operand);
     buildPoint->addInstruction(op);
 
@@ -1055,7 +1933,7 @@ Id Builder::createUnaryOp(Op opCode, Id typeId, Id operand)
 
 Id Builder::createBinOp(Op opCode, Id typeId, Id left, Id right)
 {
-    Instruction* op = new Instruction(getUniqueId(), typeId, opCode);
+    Instruction* op = newLocalInstruction(getUniqueId(), typeId, opCode);
     op->addIdOperand(left);
     op->addIdOperand(right);
     buildPoint->addInstruction(op);
@@ -1065,7 +1943,7 @@ Id Builder::createBinOp(Op opCode, Id typeId, Id left, Id right)
 
 Id Builder::createTriOp(Op opCode, Id typeId, Id op1, Id op2, Id op3)
 {
-    Instruction* op = new Instruction(getUniqueId(), typeId, opCode);
+    Instruction* op = newLocalInstruction(getUniqueId(), typeId, opCode);
     op->addIdOperand(op1);
     op->addIdOperand(op2);
     op->addIdOperand(op3);
@@ -1076,7 +1954,7 @@ Id Builder::createTriOp(Op opCode, Id typeId, Id op1, Id op2, Id op3)
 
 Id Builder::createOp(Op opCode, Id typeId, const std::vector<Id>& operands)
 {
-    Instruction* op = new Instruction(getUniqueId(), typeId, opCode);
+    Instruction* op = newLocalInstruction(getUniqueId(), typeId, opCode);
     for (auto operand : operands)
         op->addIdOperand(operand);
     buildPoint->addInstruction(op);
@@ -1086,7 +1964,7 @@ Id Builder::createOp(Op opCode, Id typeId, const std::vector<Id>& operands)
 
 Id Builder::createFunctionCall(spv::Function* function, std::vector<spv::Id>& args)
 {
-    Instruction* op = new Instruction(getUniqueId(), function->getReturnType(), OpFunctionCall);
+    Instruction* op = newLocalInstruction(getUniqueId(), function->getReturnType(), OpFunctionCall);
     op->addIdOperand(function->getId());
     for (int a = 0; a < (int)args.size(); ++a)
         op->addIdOperand(args[a]);
@@ -1101,7 +1979,7 @@ Id Builder::createRvalueSwizzle(Id typeId, Id source, std::vector<unsigned>& cha
     if (channels.size() == 1)
         return createCompositeExtract(source, typeId, channels.front());
 
-    Instruction* swizzle = new Instruction(getUniqueId(), typeId, OpVectorShuffle);
+    Instruction* swizzle = newLocalInstruction(getUniqueId(), typeId, OpVectorShuffle);
     assert(isVector(source));
     swizzle->addIdOperand(source);
     swizzle->addIdOperand(source);
@@ -1119,7 +1997,7 @@ Id Builder::createLvalueSwizzle(Id typeId, Id target, Id source, std::vector<uns
     if (channels.size() == 1 && getNumComponents(source) == 1)
         return createCompositeInsert(source, target, typeId, channels.front());
 
-    Instruction* swizzle = new Instruction(getUniqueId(), typeId, OpVectorShuffle);
+    Instruction* swizzle = newLocalInstruction(getUniqueId(), typeId, OpVectorShuffle);
     assert(isVector(source));
     assert(isVector(target));
     swizzle->addIdOperand(target);
@@ -1165,7 +2043,7 @@ Id Builder::smearScalar(Decoration /*precision*/, Id scalar, Id vectorType)
     if (numComponents == 1)
         return scalar;
 
-    Instruction* smear = new Instruction(getUniqueId(), vectorType, OpCompositeConstruct);
+    Instruction* smear = newLocalInstruction(getUniqueId(), vectorType, OpCompositeConstruct);
     for (int c = 0; c < numComponents; ++c)
         smear->addIdOperand(scalar);
     buildPoint->addInstruction(smear);
@@ -1176,7 +2054,7 @@ Id Builder::smearScalar(Decoration /*precision*/, Id scalar, Id vectorType)
 // Comments in header
 Id Builder::createBuiltinCall(Decoration /*precision*/, Id resultType, Id builtins, int entryPoint, std::vector<Id>& args)
 {
-    Instruction* inst = new Instruction(getUniqueId(), resultType, OpExtInst);
+    Instruction* inst = newLocalInstruction(getUniqueId(), resultType, OpExtInst);
     inst->addIdOperand(builtins);
     inst->addImmediateOperand(entryPoint);
     for (int arg = 0; arg < (int)args.size(); ++arg)
@@ -1294,7 +2172,7 @@ Id Builder::createTextureCall(Decoration precision, Id resultType, bool fetch, b
         }
     }
 
-    Instruction* textureInst = new Instruction(getUniqueId(), resultType, opCode);
+    Instruction* textureInst = newLocalInstruction(getUniqueId(), resultType, opCode);
     for (int op = 0; op < optArgNum; ++op)
         textureInst->addIdOperand(texArgs[op]);
     if (optArgNum < numArgs)
@@ -1361,7 +2239,7 @@ Id Builder::createTextureQueryCall(Op opCode, const TextureParameters& parameter
         MissingFunctionality("Texture query op code");
     }
 
-    Instruction* query = new Instruction(getUniqueId(), resultType, opCode);
+    Instruction* query = newLocalInstruction(getUniqueId(), resultType, opCode);
     query->addIdOperand(parameters.sampler);
     if (parameters.coords)
         query->addIdOperand(parameters.coords);
@@ -1615,7 +2493,7 @@ Id Builder::createCompositeConstruct(Id typeId, std::vector<Id>& constituents)
 {
     assert(isAggregateType(typeId) || (getNumTypeComponents(typeId) > 1 && getNumTypeComponents(typeId) == (int)constituents.size()));
 
-    Instruction* op = new Instruction(getUniqueId(), typeId, OpCompositeConstruct);
+    Instruction* op = newLocalInstruction(getUniqueId(), typeId, OpCompositeConstruct);
     for (int c = 0; c < (int)constituents.size(); ++c)
         op->addIdOperand(constituents[c]);
     buildPoint->addInstruction(op);
@@ -1623,6 +2501,43 @@ Id Builder::createCompositeConstruct(Id typeId, std::vector<Id>& constituents)
     return op->getResultId();
 }
 
+// Comments in header
+Id Builder::createWidthConversion(Id value, int width)
+{
+    Id typeId = getTypeId(value);
+    int valueWidth = getScalarTypeWidth(typeId);
+    if (! (valueWidth == 16 && width == 32) && ! (valueWidth == 32 && width == 16))
+        return value;
+    assert(! isMatrixType(typeId));
+
+    Id convertedTypeId = makeTypeOfWidth(typeId, width);
+    Instruction* scalarType = module.getInstruction(getScalarTypeId(typeId));
+    bool isFloat = scalarType->getOpCode() == OpTypeFloat;
+    bool isSigned = ! isFloat && scalarType->getImmediateOperand(1) != 0;
+
+    // A literal narrower than its word is in the low-order bits, the high-order
+    // ones sign extended for a signed int, and 0 otherwise.
+    Instruction* instr = module.getInstruction(value);
+    if (instr->getOpCode() == OpConstant) {
+        unsigned int bits = instr->getImmediateOperand(0);
+        if (isFloat)
+            bits = width == 16 ? FloatToHalf(bits) : HalfToFloat(bits);
+        else if (width == 16)
+            bits = isSigned ? (unsigned int)(int)(short)(bits & 0xffff) : bits & 0xffff;
+
+        return makeIntConstant(convertedTypeId, bits);
+    }
+    if (instr->getOpCode() == OpConstantComposite) {
+        std::vector<Id> constituents;
+        for (int c = 0; c < instr->getNumOperands(); ++c)
+            constituents.push_back(createWidthConversion(instr->getIdOperand(c), width));
+
+        return makeCompositeConstant(convertedTypeId, constituents);
+    }
+
+    return createUnaryOp(isFloat ? OpFConvert : (isSigned ? OpSConvert : OpUConvert), convertedTypeId, value);
+}
+
 // Vector or scalar constructor
 Id Builder::createConstructor(Decoration precision, const std::vector<Id>& sources, Id resultTypeId)
 {
@@ -1770,8 +2685,8 @@ Builder::If::If(Id cond, Builder& gb) :
     // make the blocks, but only put the then-block into the function,
     // the else-block and merge-block will be added later, in order, after
     // earlier code is emitted
-    thenBlock = new Block(builder.getUniqueId(), *function);
-    mergeBlock = new Block(builder.getUniqueId(), *function);
+    thenBlock = new(function->getArena()) Block(builder.getUniqueId(), *function);
+    mergeBlock = new(function->getArena()) Block(builder.getUniqueId(), *function);
 
     // Save the current block, so that we can add in the flow control split when
     // makeEndIf is called.
@@ -1788,7 +2703,7 @@ void Builder::If::makeBeginElse()
     builder.createBranch(mergeBlock);
 
     // Make the first else block and add it to the function
-    elseBlock = new Block(builder.getUniqueId(), *function);
+    elseBlock = new(function->getArena()) Block(builder.getUniqueId(), *function);
     function->addBlock(elseBlock);
 
     // Start building the else block
@@ -1822,23 +2737,45 @@ void Builder::makeSwitch(Id selector, int numSegments, std::vector<int>& caseVal
 
     // make all the blocks
     for (int s = 0; s < numSegments; ++s)
-        segmentBlocks.push_back(new Block(getUniqueId(), function));
+        segmentBlocks.push_back(new(function.getArena()) Block(getUniqueId(), function));
 
-    Block* mergeBlock = new Block(getUniqueId(), function);
+    Block* mergeBlock = new(function.getArena()) Block(getUniqueId(), function);
 
     // make and insert the switch's selection-merge instruction
     createMerge(OpSelectionMerge, mergeBlock, SelectionControlMaskNone);
 
-    // make the switch instruction
-    Instruction* switchInst = new Instruction(NoResult, NoType, OpSwitch);
-    switchInst->addIdOperand(selector);
-    switchInst->addIdOperand(defaultSegment >= 0 ? segmentBlocks[defaultSegment]->getId() : mergeBlock->getId());
+    // Make the switch instruction.  Cases going where the default goes are left
+    // out, and the rest are listed by increasing value, which is what a jump table
+    // or a search wants.  A segment < 0 means straight to the merge block.
+    Block* defaultTarget = defaultSegment >= 0 ? segmentBlocks[defaultSegment] : mergeBlock;
+    std::vector<std::pair<unsigned int, Block*> > cases;
+    cases.reserve(caseValues.size());
     for (int i = 0; i < (int)caseValues.size(); ++i) {
-        switchInst->addImmediateOperand(caseValues[i]);
-        Block* target = segmentBlocks[valueIndexToSegment[i]];
-        switchInst->addIdOperand(target->getId());
-        target->addPredecessor(buildPoint);
-        buildPoint->addSuccessor(target);
+        Block* target = valueIndexToSegment[i] >= 0 ? segmentBlocks[valueIndexToSegment[i]] : mergeBlock;
+        if (target != defaultTarget)
+            cases.push_back(std::make_pair((unsigned int)caseValues[i], target));
+    }
+    bool isSigned = module.getInstruction(getTypeId(selector))->getImmediateOperand(1) != 0;
+    std::sort(cases.begin(), cases.end(), [isSigned](const std::pair<unsigned int, Block*>& a, const std::pair<unsigned int, Block*>& b) {
+        return isSigned ? (int)a.first < (int)b.first : a.first < b.first;
+    });
+
+    Instruction* switchInst = newLocalInstruction(NoResult, NoType, OpSwitch);
+    switchInst->addIdOperand(selector);
+    switchInst->addIdOperand(defaultTarget->getId());
+    // each target is a successor once, however many cases share it
+    std::unordered_set<Block*> targets;
+    const auto addTarget = [&](Block* target) {
+        if (targets.insert(target).second) {
+            target->addPredecessor(buildPoint);
+            buildPoint->addSuccessor(target);
+        }
+    };
+    addTarget(defaultTarget);
+    for (const auto& c : cases) {
+        switchInst->addImmediateOperand(c.first);
+        switchInst->addIdOperand(c.second->getId());
+        addTarget(c.second);
     }
     buildPoint->addInstruction(switchInst);
 
@@ -1882,9 +2819,9 @@ void Builder::endSwitch(std::vector<Block*>& /*segmentBlock*/)
 }
 
 // Comments in header
-void Builder::makeNewLoop(bool loopTestFirst)
+void Builder::makeNewLoop(bool loopTestFirst, LoopControlMask control)
 {
-    loops.push(Loop(*this, loopTestFirst));
+    loops.push(Loop(*this, loopTestFirst, control));
     const Loop& loop = loops.top();
 
     // The loop test is always emitted before the loop body.
@@ -1914,13 +2851,13 @@ void Builder::makeNewLoop(bool loopTestFirst)
         getBuildPoint()->addInstruction(loop.isFirstIteration);
 
         // Mark the end of the structured loop. This must exist in the loop header block.
-        createMerge(OpLoopMerge, loop.merge, LoopControlMaskNone);
+        createMerge(OpLoopMerge, loop.merge, loop.control);
 
         // Generate code to see if this is the first iteration of the loop.
         // It needs to be in its own block, since the loop merge and
         // the selection merge instructions can't both be in the same
         // (header) block.
-        Block* firstIterationCheck = new Block(getUniqueId(), *loop.function);
+        Block* firstIterationCheck = new(loop.function->getArena()) Block(getUniqueId(), *loop.function);
         createBranch(firstIterationCheck);
         loop.function->addBlock(firstIterationCheck);
         setBuildPoint(firstIterationCheck);
@@ -1930,7 +2867,7 @@ void Builder::makeNewLoop(bool loopTestFirst)
         // construct because it can transfer control to the loop merge block.
         createMerge(OpSelectionMerge, loop.body, SelectionControlMaskNone);
 
-        Block* loopTest = new Block(getUniqueId(), *loop.function);
+        Block* loopTest = new(loop.function->getArena()) Block(getUniqueId(), *loop.function);
         createConditionalBranch(loop.isFirstIteration->getResultId(), loop.body, loopTest);
 
         loop.function->addBlock(loopTest);
@@ -1946,7 +2883,7 @@ void Builder::createLoopTestBranch(Id condition)
     // the body, then this is a loop merge.  Otherwise the loop merge
     // has already been generated and this is a conditional merge.
     if (loop.testFirst) {
-        createMerge(OpLoopMerge, loop.merge, LoopControlMaskNone);
+        createMerge(OpLoopMerge, loop.merge, loop.control);
         // Branching to the "body" block will keep control inside
         // the loop.
         createConditionalBranch(condition, loop.body, loop.merge);
@@ -1958,7 +2895,7 @@ void Builder::createLoopTestBranch(Id condition)
         // continue to loop.body block.  Since that is already the target
         // of a merge instruction, and a block can't be the target of more
         // than one merge instruction, we need to make an intermediate block.
-        Block* stayInLoopBlock = new Block(getUniqueId(), *loop.function);
+        Block* stayInLoopBlock = new(loop.function->getArena()) Block(getUniqueId(), *loop.function);
         createMerge(OpSelectionMerge, stayInLoopBlock, SelectionControlMaskNone);
 
         // This is the loop test.
@@ -2169,14 +3106,93 @@ Id Builder::accessChainGetLValue()
     return lvalue;
 }
 
+// Comments in header
+Id Builder::accessChainGetInferredType()
+{
+    if (accessChain.base == NoResult)
+        return NoType;
+
+    // dereference the base, and then each index
+    Id type = getTypeId(accessChain.base);
+    if (! accessChain.isRValue)
+        type = getContainedTypeId(type);
+    for (int i = 0; i < (int)accessChain.indexChain.size(); ++i) {
+        if (isStructType(type))
+            type = getContainedTypeId(type, getConstantScalar(accessChain.indexChain[i]));
+        else
+            type = getContainedTypeId(type);
+    }
+
+    // then the swizzle, and the component selection
+    if (accessChain.swizzle.size()) {
+        type = getScalarTypeId(type);
+        if (accessChain.swizzle.size() > 1)
+            type = makeVectorType(type, (int)accessChain.swizzle.size());
+    }
+    if (accessChain.component != NoResult)
+        type = getScalarTypeId(type);
+
+    return type;
+}
+
+void Builder::stripDebug(bool keepNames)
+{
+    source = SourceLanguageUnknown;
+    extensions.clear();
+    lines.clear();
+    if (! keepNames)
+        names.clear();
+}
+
+size_t Builder::getWordCount() const
+{
+    // Header
+    size_t wordCount = 5;
+
+    // First instructions, as made on the spot by dump()
+    if (source != SourceLanguageUnknown)
+        wordCount += 3;
+    for (int e = 0; e < (int)extensions.size(); ++e)
+        wordCount += 1 + (strlen(extensions[e]) + 4) / 4;
+    wordCount += 2 * capabilities.size();
+    wordCount += getWordCount(imports);
+    wordCount += 3;
+
+    // Instructions saved up while building, then the functions
+    wordCount += getWordCount(entryPoints);
+    wordCount += getWordCount(executionModes);
+    wordCount += getWordCount(names);
+    wordCount += getWordCount(lines);
+    wordCount += getWordCount(decorations);
+    wordCount += getWordCount(constantsTypesGlobals);
+    wordCount += getWordCount(externals);
+
+    return wordCount + module.getWordCount();
+}
+
 void Builder::dump(std::vector<unsigned int>& out) const
+{
+    size_t start = out.size();
+    size_t wordCount = getWordCount();
+    out.resize(start + wordCount);
+    WordStream stream(out.data() + start, wordCount);
+    dump(stream);
+}
+
+void Builder::dump(WordSink& sink) const
+{
+    WordStream stream(sink);
+    dump(stream);
+}
+
+void Builder::dump(WordStream& out) const
 {
     // Header, before first instructions:
-    out.push_back(MagicNumber);
-    out.push_back(Version);
-    out.push_back(builderNumber);
-    out.push_back(uniqueId + 1);
-    out.push_back(0);
+    out.put(MagicNumber);
+    out.put(Version);
+    out.put(builderNumber);
+    out.put(uniqueId + 1);
+    out.put(0);
 
     // First instructions, some created on the spot here:
     if (source != SourceLanguageUnknown) {
@@ -2290,7 +3306,7 @@ void Builder::mergeAccessChainSwizzle()
 // block proceeding them (e.g. instructions after a discard, etc).
 void Builder::createAndSetNoPredecessorBlock(const char* /*name*/)
 {
-    Block* block = new Block(getUniqueId(), buildPoint->getParent());
+    Block* block = new(buildPoint->getParent().getArena()) Block(getUniqueId(), buildPoint->getParent());
     block->setUnreachable();
     buildPoint->getParent().addBlock(block);
     setBuildPoint(block);
@@ -2302,7 +3318,7 @@ void Builder::createAndSetNoPredecessorBlock(const char* /*name*/)
 // Comments in header
 void Builder::createBranch(Block* block)
 {
-    Instruction* branch = new Instruction(OpBranch);
+    Instruction* branch = newLocalInstruction(OpBranch);
     branch->addIdOperand(block->getId());
     buildPoint->addInstruction(branch);
     block->addPredecessor(buildPoint);
@@ -2311,7 +3327,7 @@ void Builder::createBranch(Block* block)
 
 void Builder::createMerge(Op mergeCode, Block* mergeBlock, unsigned int control)
 {
-    Instruction* merge = new Instruction(mergeCode);
+    Instruction* merge = newLocalInstruction(mergeCode);
     merge->addIdOperand(mergeBlock->getId());
     merge->addImmediateOperand(control);
     buildPoint->addInstruction(merge);
@@ -2319,7 +3335,7 @@ void Builder::createMerge(Op mergeCode, Block* mergeBlock, unsigned int control)
 
 void Builder::createConditionalBranch(Id condition, Block* thenBlock, Block* elseBlock)
 {
-    Instruction* branch = new Instruction(OpBranchConditional);
+    Instruction* branch = newLocalInstruction(OpBranchConditional);
     branch->addIdOperand(condition);
     branch->addIdOperand(thenBlock->getId());
     branch->addIdOperand(elseBlock->getId());
@@ -2330,17 +3346,29 @@ void Builder::createConditionalBranch(Id condition, Block* thenBlock, Block* els
     buildPoint->addSuccessor(elseBlock);
 }
 
-void Builder::dumpInstructions(std::vector<unsigned int>& out, const std::vector<Instruction*>& instructions) const
+size_t Builder::getWordCount(const std::vector<Instruction*>& instructions) const
+{
+    size_t wordCount = 0;
+    for (int i = 0; i < (int)instructions.size(); ++i)
+        wordCount += instructions[i]->getWordCount();
+    return wordCount;
+}
+
+void Builder::dumpInstructions(WordStream& out, const std::vector<Instruction*>& instructions) const
 {
     for (int i = 0; i < (int)instructions.size(); ++i) {
         instructions[i]->dump(out);
     }
 }
 
+// Parallel forks of a builder can report at the same time.
+static std::mutex reportMutex;
+
 void TbdFunctionality(const char* tbd)
 {
     static std::unordered_set<const char*> issued;
 
+    std::lock_guard<std::mutex> guard(reportMutex);
     if (issued.find(tbd) == issued.end()) {
         printf("TBD functionality: %s\n", tbd);
         issued.insert(tbd);
@@ -2349,27 +3377,30 @@ void TbdFunctionality(const char* tbd)
 
 void MissingFunctionality(const char* fun)
 {
+    // the first to report exits; any others wait for that
+    reportMutex.lock();
     printf("Missing functionality: %s\n", fun);
     exit(1);
 }
 
-Builder::Loop::Loop(Builder& builder, bool testFirstArg)
+Builder::Loop::Loop(Builder& builder, bool testFirstArg, LoopControlMask controlArg)
   : function(&builder.getBuildPoint()->getParent()),
-    header(new Block(builder.getUniqueId(), *function)),
-    merge(new Block(builder.getUniqueId(), *function)),
-    body(new Block(builder.getUniqueId(), *function)),
+    header(new(function->getArena()) Block(builder.getUniqueId(), *function)),
+    merge(new(function->getArena()) Block(builder.getUniqueId(), *function)),
+    body(new(function->getArena()) Block(builder.getUniqueId(), *function)),
     testFirst(testFirstArg),
+    control(controlArg),
     isFirstIteration(nullptr)
 {
     if (!testFirst)
     {
 // You may be tempted to rewrite this as
-// new Instruction(builder.getUniqueId(), builder.makeBoolType(), OpPhi);
+// builder.newInstruction(builder.getUniqueId(), builder.makeBoolType(), OpPhi);
 // This will cause subtle test failures because builder.getUniqueId(),
 // and builder.makeBoolType() can then get run in a compiler-specific
 // order making tests fail for certain configurations.
         Id instructionId = builder.getUniqueId();
-        isFirstIteration = new Instruction(instructionId, builder.makeBoolType(), OpPhi);
+        isFirstIteration = builder.newLocalInstruction(instructionId, builder.makeBoolType(), OpPhi);
     }
 }
 
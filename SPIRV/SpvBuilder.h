@@ -54,17 +54,25 @@
 #include <algorithm>
 #include <stack>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace spv {
 
 class Builder {
 public:
     Builder(unsigned int userNumber);
+    // A fork of 'parent', for building function bodies at the same time as other
+    // forks (see join()).  It sees everything 'parent' had made, which mustn't
+    // change until the forks are joined, and numbers what it makes itself from
+    // 'firstId', above any id the parent will use (e.g., forkIds).
+    Builder(const Builder& parent, Id firstId);
     Builder(Builder&&);
     Builder& operator=(Builder&&);
     virtual ~Builder();
 
     static const int maxMatrixSize = 4;
+    static const Id forkIds = 0x40000000;
 
     void setSource(spv::SourceLanguage lang, int version)
     {
@@ -80,6 +88,10 @@ public:
     }
 
     void addCapability(spv::Capability cap) { capabilities.push_back(cap); }
+    bool hasCapability(spv::Capability cap) const
+    {
+        return std::find(capabilities.begin(), capabilities.end(), cap) != capabilities.end();
+    }
 
     // To get a new <id> for anything needing a new one.
     Id getUniqueId() { return ++uniqueId; }
@@ -109,6 +121,10 @@ public:
     Id makeImageType(Id sampledType, Dim, bool depth, bool arrayed, bool ms, unsigned sampled, ImageFormat format);
     Id makeSampledImageType(Id imageType);
 
+    // The int or float scalar, vector, or matrix type like 'typeId', but with
+    // components 'width' bits wide; any other type is returned as it is.
+    Id makeTypeOfWidth(Id typeId, int width);
+
     // For querying about types.
     Id getTypeId(Id resultId) const { return module.getTypeId(resultId); }
     Id getDerefTypeId(Id resultId) const;
@@ -121,6 +137,10 @@ public:
     Id getContainedTypeId(Id typeId) const;
     Id getContainedTypeId(Id typeId, int) const;
 
+    // How many bits wide the components of an int or float scalar, vector,
+    // or matrix type are; 0 for any other type.
+    int getScalarTypeWidth(Id typeId) const;
+
     bool isPointer(Id resultId)     const { return isPointerType(getTypeId(resultId)); }
     bool isScalar(Id resultId)      const { return isScalarType(getTypeId(resultId)); }
     bool isVector(Id resultId)      const { return isVectorType(getTypeId(resultId)); }
@@ -140,6 +160,8 @@ public:
 
     bool isConstantOpCode(Op opcode) const;
     bool isConstant(Id resultId) const { return isConstantOpCode(getOpCode(resultId)); }
+    bool isSpecConstantOpCode(Op opcode) const;
+    bool isSpecConstant(Id resultId) const { return isSpecConstantOpCode(getOpCode(resultId)); }
     bool isConstantScalar(Id resultId) const { return getOpCode(resultId) == OpConstant; }
     unsigned int getConstantScalar(Id resultId) const { return module.getInstruction(resultId)->getImmediateOperand(0); }
 
@@ -174,15 +196,18 @@ public:
     }
 
     // For making new constants (will return old constant if the requested one was already made).
-    Id makeBoolConstant(bool b);
-    Id makeIntConstant(Id typeId, unsigned value);
-    Id makeIntConstant(int i)         { return makeIntConstant(makeIntType(32),  (unsigned)i); }
-    Id makeUintConstant(unsigned u)   { return makeIntConstant(makeUintType(32),           u); }
-    Id makeFloatConstant(float f);
-    Id makeDoubleConstant(double d);
+    // A specialization constant is always new, as it is specialized independently of any other.
+    Id makeBoolConstant(bool b, bool specConstant = false);
+    Id makeIntConstant(Id typeId, unsigned value, bool specConstant = false);
+    Id makeIntConstant(int i, bool specConstant = false)       { return makeIntConstant(makeIntType(32),  (unsigned)i, specConstant); }
+    Id makeUintConstant(unsigned u, bool specConstant = false) { return makeIntConstant(makeUintType(32),           u, specConstant); }
+    Id makeFloatConstant(float f, bool specConstant = false);
+    Id makeFloat16Constant(float f, bool specConstant = false);  // rounded to the nearest half
+    Id makeDoubleConstant(double d, bool specConstant = false);
 
     // Turn the array of constants into a proper spv constant of the requested type.
-    Id makeCompositeConstant(Id type, std::vector<Id>& comps);
+    // With specConstant, some of the constants are specialization constants.
+    Id makeCompositeConstant(Id type, std::vector<Id>& comps, bool specConstant = false);
 
     // Methods for adding information outside the CFG.
     void addEntryPoint(ExecutionModel, Function*, const char* name);
@@ -192,13 +217,14 @@ public:
     void addLine(Id target, Id fileName, int line, int column);
     void addDecoration(Id, Decoration, int num = -1);
     void addMemberDecoration(Id, unsigned int member, Decoration, int num = -1);
+    void addLinkage(Id, const char* name, LinkageType);
 
     // At the end of what block do the next create*() instructions go?
     void setBuildPoint(Block* bp) { buildPoint = bp; }
     Block* getBuildPoint() const { return buildPoint; }
 
-    // Make the main function.
-    Function* makeMain();
+    // Make the main function, 'name' in the debug information.
+    Function* makeMain(const char* name = "main");
 
     // Make a shader-style function, and create its entry block if entry is non-zero.
     // Return the function, pass back the entry.
@@ -211,6 +237,58 @@ public:
     // Generate all the code needed to finish up a function.
     void leaveFunction();
 
+    // Give each function made from now on blocks of its own to let go of (see
+    // streamFunction()), rather than keeping them with the rest of the module.
+    void setStreamingFunctions() { streamingFunctions = true; }
+
+    // Once 'function' is finished (and simplified, if it will be), dump it to
+    // words kept in its place, freeing its IR, so the whole module's IR is
+    // never held at once.  The function must have been made after
+    // setStreamingFunctions(), and nothing it made locally can be used again.
+    void streamFunction(Function& function);
+
+    // In a fork, start the body of a function the parent declared with
+    // makeFunctionEntry(), and build at its entry.
+    Function* makeFunctionBody(const Function& declared);
+
+    // Where a fork is at: its next id and the length of each list joins take from.
+    struct ForkMark {
+        Id id;
+        size_t names;
+        size_t decorations;
+        size_t constantsTypesGlobals;
+        size_t capabilities;
+    };
+    ForkMark getForkMark() const
+    {
+        ForkMark mark = { uniqueId + 1, names.size(), decorations.size(), constantsTypesGlobals.size(), capabilities.size() };
+        return mark;
+    }
+
+    // What a fork made between two marks that this builder turns out to have
+    // already, as 'id' (e.g., a struct type or global variable another fork
+    // made first).  A join maps all of it to this builder's, rather than adding it.
+    struct ForkSpan {
+        ForkMark begin;
+        ForkMark end;
+        Id forkId;
+        Id id;
+    };
+
+    // Join the function 'body' a fork built between two marks into this
+    // builder, numbering what it made with this builder's next ids, in the
+    // order it made them; 'found' are the spans to map rather than add, in
+    // order.  Joining each fork's functions in the order a single builder would
+    // have built them gives the same module that builder would have.
+    void join(Builder& fork, Function* body, const ForkMark& begin, const ForkMark& end,
+              const std::vector<ForkSpan>& found);
+
+    // The id a join gave to a fork's id.
+    Id getJoinedId(const Builder& fork, Id forkId) const;
+
+    // Once a fork's functions are all joined, keep its IR for as long as this builder's.
+    void adoptFork(Builder& fork) { module.adoptArena(fork.module); }
+
     // Create a discard.
     void makeDiscard();
 
@@ -321,6 +399,11 @@ public:
     // OpCompositeConstruct
     Id createCompositeConstruct(Id typeId, std::vector<Id>& constituents);
 
+    // Convert an int or float scalar or vector between 16 and 32 bits wide; a
+    // constant is remade at the new width.  If it's not one of those, or it's
+    // already 'width' bits wide, 'value' is returned as it is.
+    Id createWidthConversion(Id value, int width);
+
     // vector or scalar constructor
     Id createConstructor(Decoration precision, const std::vector<Id>& sources, Id resultTypeId);
 
@@ -357,6 +440,9 @@ public:
     // The SPIR-V Builder will maintain the stack of post-switch merge blocks for nested switches.
     //
     // Use a defaultSegment < 0 if there is no default segment (to branch to post switch).
+    // Likewise, a case whose segment is < 0 branches to post switch, as for a segment that only breaks.
+    //
+    // The OpSwitch lists its cases in increasing value, leaving out those that go where the default does.
     //
     // Returns the right set of basic blocks to start each code segment with, so that the caller's
     // recursion stack can hold the memory for it.
@@ -377,7 +463,8 @@ public:
     // generate code for the loop test.
     // The loopTestFirst parameter is true when the loop test executes before
     // the body.  (It is false for do-while loops.)
-    void makeNewLoop(bool loopTestFirst);
+    // The control is the unrolling hint for the loop's OpLoopMerge.
+    void makeNewLoop(bool loopTestFirst, LoopControlMask control = LoopControlMaskNone);
 
     // Add the branch for the loop test, based on the given condition.
     // The true branch goes to the first block in the loop body, and
@@ -492,12 +579,83 @@ public:
     // get the direct pointer for an l-value
     Id accessChainGetLValue();
 
-    void dump(std::vector<unsigned int>&) const;
+    // the type of what the access chain, as it is so far, refers to
+    Id accessChainGetInferredType();
+
+    // Once the module is built: promote each function's local scalars and
+    // vectors that are only ever loaded and stored whole to SSA values (with
+    // OpPhi where paths meet), and within each block, use a pointer's last
+    // loaded or stored value instead of loading it again.
+    void forwardLoadsAndStores() { simplify(true, false); }
+
+    // Once the module is built: within each block, use the result of an
+    // earlier identical access chain or pure operation instead of making it again.
+    void eliminateCommonSubexpressions() { simplify(false, true); }
+
+    // Both (or either) of the above, in one pass that lets each expose more for the other.
+    void simplify(bool forwardLoadsAndStores, bool eliminateCommonSubexpressions);
+
+    // As simplify(), for one finished function, so it can be streamed: the
+    // names and decorations of what it removes go at the next simplify(),
+    // which leaves the streamed functions as they are.
+    void simplify(Function&, bool forwardLoadsAndStores, bool eliminateCommonSubexpressions);
+
+    // Drop the source language and extensions and the lines, and unless
+    // 'keepNames', the names, so dump() leaves them out; they are for debugging.
+    void stripDebug(bool keepNames);
+
+    // Number of words dump() makes.
+    size_t getWordCount() const;
+
+    // Number of instructions made, including those of joined forks and any
+    // simplify() removed.
+    int getNumInstructions() const { return module.getNumInstructions(); }
+
+    // Append the binary to 'out', sized once up front.
+    void dump(std::vector<unsigned int>& out) const;
+
+    // Stream the binary to 'sink' as it is made, in buffer-sized pieces.
+    void dump(WordSink& sink) const;
 
 protected:
-    Id findScalarConstant(Op typeClass, Id typeId, unsigned value) const;
-    Id findScalarConstant(Op typeClass, Id typeId, unsigned v1, unsigned v2) const;
-    Id findCompositeConstant(Op typeClass, std::vector<Id>& comps) const;
+    // Instructions of the module, allocated from its arena.
+    Instruction* newInstruction(Id resultId, Id typeId, Op opCode)
+    {
+        return new(module.getArena()) Instruction(resultId, typeId, opCode, &module.getArena());
+    }
+    Instruction* newInstruction(Op opCode) { return new(module.getArena()) Instruction(opCode, &module.getArena()); }
+
+    // Instructions for the function being built, allocated with its blocks.
+    Instruction* newLocalInstruction(Id resultId, Id typeId, Op opCode)
+    {
+        Arena& arena = buildPoint->getParent().getArena();
+        return new(arena) Instruction(resultId, typeId, opCode, &arena);
+    }
+    Instruction* newLocalInstruction(Op opCode)
+    {
+        Arena& arena = buildPoint->getParent().getArena();
+        return new(arena) Instruction(opCode, &arena);
+    }
+
+    Id findScalarConstant(Id typeId, unsigned value) const;
+    Id findScalarConstant(Id typeId, unsigned v1, unsigned v2) const;
+    Id findCompositeConstant(Op opcode, Id typeId, std::vector<Id>& comps) const;
+    void addSpecConstant(Instruction*);
+    void makeGroupedKey(Op opCode, Id typeId, const unsigned* operands, int numOperands) const;
+    Instruction* findGrouped(Op opCode, Id typeId, const unsigned* operands, int numOperands) const;
+    bool isGrouped(const Instruction*) const;
+    void addGrouped(Instruction*);
+    void joinCorresponding(Builder& fork, Id forkId, Id id, const ForkSpan&);
+    void promoteLocalVariables(Function&, std::unordered_map<Id, Id>& forwarded, std::unordered_set<Id>& removed,
+                               const std::unordered_set<Id>& relaxed);
+    void simplifyBlocks(Function&, std::unordered_map<Id, Id>& forwarded, std::unordered_set<Id>& removed,
+                        const std::unordered_set<Id>& unforwardable, const std::unordered_set<Id>& relaxed,
+                        bool forwardLoads, bool numberValues);
+    void getSimplifyDecorations(std::unordered_set<Id>& unforwardable, std::unordered_set<Id>& relaxed) const;
+    void simplifyFunction(Function&, bool forwardLoadsAndStores, bool eliminateCommonSubexpressions,
+                          const std::unordered_set<Id>& unforwardable, const std::unordered_set<Id>& relaxed);
+    bool isPointerValue(Id) const;
+    Id makeUndefined(Id type);
     Id collapseAccessChain();
     void simplifyAccessChainSwizzle();
     void mergeAccessChainSwizzle();
@@ -505,7 +663,9 @@ protected:
     void createBranch(Block* block);
     void createMerge(Op, Block*, unsigned int control);
     void createConditionalBranch(Id condition, Block* thenBlock, Block* elseBlock);
-    void dumpInstructions(std::vector<unsigned int>&, const std::vector<Instruction*>&) const;
+    void dump(WordStream&) const;
+    size_t getWordCount(const std::vector<Instruction*>&) const;
+    void dumpInstructions(WordStream&, const std::vector<Instruction*>&) const;
 
     struct Loop; // Defined below.
     void createBranchToLoopHeaderFromInside(const Loop& loop);
@@ -533,9 +693,27 @@ protected:
     std::vector<Instruction*> constantsTypesGlobals;
     std::vector<Instruction*> externals;
 
-     // not output, internally used for quick & dirty canonical (unique) creation
-    std::vector<Instruction*> groupedConstants[OpConstant];  // all types appear before OpConstant
-    std::vector<Instruction*> groupedTypes[OpConstant];
+     // not output, internally used for canonical (unique) creation of types and
+     // constants: each is keyed by its opcode, type id, and operand words
+    struct GroupedKeyHash {
+        size_t operator()(const std::vector<unsigned int>& key) const;
+    };
+    std::unordered_map<std::vector<unsigned int>, Instruction*, GroupedKeyHash> grouped;
+    mutable std::vector<unsigned int> groupedKey;  // scratch key for lookups
+
+    // one module-scope OpUndef per type, made by simplify()
+    std::unordered_map<Id, Id> undefined;
+
+    // what simplify() of a function removed, to drop the names and decorations of
+    std::unordered_set<Id> simplifiedAway;
+
+    // for setStreamingFunctions()
+    bool streamingFunctions;
+
+    // of a fork: its parent, and the id a join gave each of its own (from firstForkId)
+    const Builder* forkParent;
+    Id firstForkId;
+    std::vector<Id> joinedIds;
 
     // stack of switches
     std::stack<Block*> switchMerges;
@@ -549,7 +727,7 @@ protected:
         // also create a phi instruction whose value indicates whether we're on
         // the first iteration of the loop.  The phi instruction is initialized
         // with no values or predecessor operands.
-        Loop(Builder& builder, bool testFirst);
+        Loop(Builder& builder, bool testFirst, LoopControlMask control);
 
         // The function containing the loop.
         Function* const function;
@@ -572,6 +750,8 @@ protected:
         Block* const body;
         // True when the loop test executes before the body.
         const bool testFirst;
+        // The loop control operand for the loop merge.
+        const LoopControlMask control;
         // When the test executes after the body, this is defined as the phi
         // instruction that tells us whether we are on the first iteration of
         // the loop.  Otherwise this is null. This is non-const because
@@ -0,0 +1,276 @@
+//
+//Copyright (C) 2014-2015 LunarG, Inc.
+//
+//All rights reserved.
+//
+//Redistribution and use in source and binary forms, with or without
+//modification, are permitted provided that the following conditions
+//are met:
+//
+//    Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+//    Redistributions in binary form must reproduce the above
+//    copyright notice, this list of conditions and the following
+//    disclaimer in the documentation and/or other materials provided
+//    with the distribution.
+//
+//    Neither the name of 3Dlabs Inc. Ltd. nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+//THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+//FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+//COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+//BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+//LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+//ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//POSSIBILITY OF SUCH DAMAGE.
+
+//
+// Content-addressed cache of SPIR-V results, and store of SPIR-V sections;
+// see SpvCache.h.
+//
+
+#include "SpvCache.h"
+#include "spirv.hpp"
+#include "../glslang/Include/revision.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+namespace glslang {
+
+namespace {
+
+const unsigned long long FnvBasis = 14695981039346656037ULL;
+
+void Fnv(unsigned long long& hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t b = 0; b < size; ++b) {
+        hash ^= bytes[b];
+        hash *= 1099511628211ULL;
+    }
+}
+
+std::string HexName(unsigned long long hash)
+{
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", hash);
+
+    return name;
+}
+
+bool ReadWords(const std::string& fileName, std::vector<unsigned int>& spirv)
+{
+    FILE* in = fopen(fileName.c_str(), "rb");
+    if (in == nullptr)
+        return false;
+
+    spirv.clear();
+    unsigned int words[1024];
+    size_t count;
+    while ((count = fread(words, sizeof(words[0]), sizeof(words) / sizeof(words[0]), in)) > 0)
+        spirv.insert(spirv.end(), words, words + count);
+    fclose(in);
+
+    return true;
+}
+
+// Write under a temporary name and rename it into place, so concurrent
+// compiles sharing the directory never see a partial file.
+bool WriteWords(const std::string& fileName, const unsigned int* spirv, size_t count)
+{
+    const unsigned long long unique = (unsigned long long)std::chrono::high_resolution_clock::now().time_since_epoch().count() ^
+                                      (unsigned long long)(size_t)spirv;
+    const std::string tempName = fileName + ".tmp" + std::to_string(unique);
+    FILE* out = fopen(tempName.c_str(), "wb");
+    if (out == nullptr)
+        return false;
+
+    bool written = fwrite(spirv, sizeof(spirv[0]), count, out) == count;
+    written = fclose(out) == 0 && written;
+    if (written && rename(tempName.c_str(), fileName.c_str()) == 0)
+        return true;
+
+    remove(tempName.c_str());
+    return false;
+}
+
+} // end anonymous namespace
+
+//
+// 64-bit FNV-1a, seeded with the versions of everything that produces the
+// SPIR-V, so upgrading glslang invalidates old entries.
+//
+TSpvCacheKey::TSpvCacheKey() : hash(FnvBasis)
+{
+    const char* revision = GLSLANG_REVISION;
+    add(revision, strlen(revision));
+    const unsigned int versions[] = { spv::Version, spv::Revision };
+    add(versions, sizeof(versions));
+}
+
+void TSpvCacheKey::add(const void* data, size_t size)
+{
+    Fnv(hash, data, size);
+}
+
+void TSpvCacheKey::addShader(EShLanguage stage, const char* const* strings, const int* lengths, int count)
+{
+    const int header[] = { (int)stage, count };
+    add(header, sizeof(header));
+    for (int s = 0; s < count; ++s) {
+        // the length goes in too, so moving text between strings changes the key
+        size_t length = (lengths && lengths[s] >= 0) ? (size_t)lengths[s] : strlen(strings[s]);
+        add(&length, sizeof(length));
+        add(strings[s], length);
+    }
+}
+
+void TSpvCacheKey::addSettings(int defaultVersion, EProfile defaultProfile, bool forwardCompatible,
+                               EShMessages messages, const TBuiltInResource& resources)
+{
+    const int settings[] = { defaultVersion, (int)defaultProfile, forwardCompatible ? 1 : 0, (int)messages };
+    add(settings, sizeof(settings));
+
+    // The integer limits, then the boolean ones, skipping any padding between them.
+    add(&resources, offsetof(TBuiltInResource, limits));
+    add(&resources.limits, sizeof(resources.limits));
+}
+
+void TSpvCacheKey::addSpvOptions(const SpvOptions& options)
+{
+    // neither the number of threads nor streaming changes the SPIR-V
+    const int settings[] = { options.forwardLoadsAndStores ? 1 : 0, options.eliminateCommonSubexpressions ? 1 : 0,
+                             (int)options.remap, options.mediump16 ? 1 : 0 };
+    add(settings, sizeof(settings));
+    if (options.entryPoint)
+        add(options.entryPoint, strlen(options.entryPoint) + 1);
+}
+
+std::string TSpvCacheKey::getName() const
+{
+    return HexName(hash);
+}
+
+std::string TSpvCache::getFileName(const TSpvCacheKey& key, EShLanguage stage) const
+{
+    return directory + "/" + key.getName() + "." + std::to_string((int)stage) + ".spv";
+}
+
+bool TSpvCache::lookup(const TSpvCacheKey& key, EShLanguage stage, std::vector<unsigned int>& spirv) const
+{
+    if (! ReadWords(getFileName(key, stage), spirv))
+        return false;
+
+    // don't trust a truncated or foreign file
+    return spirv.size() > 5 && spirv[0] == spv::MagicNumber;
+}
+
+bool TSpvCache::store(const TSpvCacheKey& key, EShLanguage stage, const std::vector<unsigned int>& spirv) const
+{
+    return WriteWords(getFileName(key, stage), spirv.data(), spirv.size());
+}
+
+std::string TSpvStore::getFileName(const std::string& section) const
+{
+    return directory + "/" + section + ".sec";
+}
+
+bool TSpvStore::add(const unsigned int* spirv, size_t count, std::vector<std::string>& sections) const
+{
+    sections.clear();
+
+    // Find where each section starts: the header, the first type or constant,
+    // and each function.
+    std::vector<size_t> starts(1, 0);
+    bool inTypes = false;
+    for (size_t word = 5; word < count; ) {
+        const spv::Op opCode = (spv::Op)(spirv[word] & spv::OpCodeMask);
+        const unsigned int wordCount = spirv[word] >> spv::WordCountShift;
+        if (wordCount == 0 || word + wordCount > count)
+            return false;
+
+        if (! inTypes && opCode >= spv::OpTypeVoid && opCode <= spv::OpSpecConstantOp) {
+            inTypes = true;
+            starts.push_back(word);
+        } else if (opCode == spv::OpFunction)
+            starts.push_back(word);
+
+        word += wordCount;
+    }
+    starts.push_back(count);
+
+    std::vector<unsigned int> existing;
+    for (size_t s = 0; s + 1 < starts.size(); ++s) {
+        const unsigned int* words = spirv + starts[s];
+        const size_t size = starts[s + 1] - starts[s];
+
+        // the length goes in too, so a section is never mistaken for another's prefix
+        unsigned long long hash = FnvBasis;
+        Fnv(hash, &size, sizeof(size));
+        Fnv(hash, words, size * sizeof(words[0]));
+        sections.push_back(HexName(hash));
+
+        const std::string fileName = getFileName(sections.back());
+        if (ReadWords(fileName, existing)) {
+            if (existing.size() != size || memcmp(existing.data(), words, size * sizeof(words[0])) != 0)
+                return false;
+        } else if (! WriteWords(fileName, words, size))
+            return false;
+    }
+
+    return true;
+}
+
+bool TSpvStore::assemble(const std::vector<std::string>& sections, std::vector<unsigned int>& spirv) const
+{
+    spirv.clear();
+    std::vector<unsigned int> words;
+    for (size_t s = 0; s < sections.size(); ++s) {
+        if (! ReadWords(getFileName(sections[s]), words))
+            return false;
+        spirv.insert(spirv.end(), words.begin(), words.end());
+    }
+
+    return spirv.size() > 5 && spirv[0] == spv::MagicNumber;
+}
+
+bool TSpvStore::writeManifest(const std::string& fileName, const std::vector<std::string>& sections)
+{
+    FILE* out = fopen(fileName.c_str(), "w");
+    if (out == nullptr)
+        return false;
+
+    bool written = true;
+    for (size_t s = 0; s < sections.size(); ++s)
+        written = fprintf(out, "%s\n", sections[s].c_str()) > 0 && written;
+
+    return fclose(out) == 0 && written;
+}
+
+bool TSpvStore::readManifest(const std::string& fileName, std::vector<std::string>& sections)
+{
+    FILE* in = fopen(fileName.c_str(), "r");
+    if (in == nullptr)
+        return false;
+
+    sections.clear();
+    char name[64];
+    while (fscanf(in, "%63s", name) == 1)
+        sections.push_back(name);
+    fclose(in);
+
+    return ! sections.empty();
+}
+
+};  // end namespace glslang
@@ -0,0 +1,133 @@
+//
+//Copyright (C) 2014-2015 LunarG, Inc.
+//
+//All rights reserved.
+//
+//Redistribution and use in source and binary forms, with or without
+//modification, are permitted provided that the following conditions
+//are met:
+//
+//    Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+//    Redistributions in binary form must reproduce the above
+//    copyright notice, this list of conditions and the following
+//    disclaimer in the documentation and/or other materials provided
+//    with the distribution.
+//
+//    Neither the name of 3Dlabs Inc. Ltd. nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+//THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+//FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+//COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+//BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+//LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+//ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//POSSIBILITY OF SUCH DAMAGE.
+
+//
+// Content-addressed cache of SPIR-V results, so an unchanged compile
+// can skip parsing, linking, and SPIR-V generation.
+//
+// A key hashes everything that affects the generated SPIR-V: the shader
+// strings of each stage, the compile settings, the built-in resources,
+// and the glslang and SPIR-V versions.  Entries are files named
+// <key>.<stage>.spv in the cache directory, in the same format OutputSpv()
+// writes.
+//
+// A TSpvStore is content addressed at a finer grain: modules are split into
+// sections that are stored once each, however many modules share them.
+//
+
+#pragma once
+#ifndef SpvCache_H
+#define SpvCache_H
+
+#include <string>
+#include <vector>
+
+#include "../glslang/Public/ShaderLang.h"
+#include "GlslangToSpv.h"
+
+namespace glslang {
+
+class TSpvCacheKey {
+public:
+    TSpvCacheKey();
+
+    // Add the strings of one stage of the program.
+    void addShader(EShLanguage stage, const char* const* strings, const int* lengths, int count);
+
+    // Add the settings the stages were (or will be) compiled with.
+    void addSettings(int defaultVersion, EProfile defaultProfile, bool forwardCompatible,
+                     EShMessages messages, const TBuiltInResource& resources);
+
+    // Add the SPIR-V generation options that change what's generated.
+    void addSpvOptions(const SpvOptions& options);
+
+    // Hex form of the key, used in cache file names.
+    std::string getName() const;
+
+protected:
+    void add(const void* data, size_t size);
+
+    unsigned long long hash;
+};
+
+class TSpvCache {
+public:
+    explicit TSpvCache(const std::string& directory) : directory(directory) { }
+
+    // Returns true and fills in 'spirv' when 'stage' of 'key' is cached.
+    bool lookup(const TSpvCacheKey& key, EShLanguage stage, std::vector<unsigned int>& spirv) const;
+
+    // Returns false if the entry couldn't be written; the cache is then simply not used.
+    bool store(const TSpvCacheKey& key, EShLanguage stage, const std::vector<unsigned int>& spirv) const;
+
+protected:
+    std::string getFileName(const TSpvCacheKey& key, EShLanguage stage) const;
+
+    std::string directory;
+};
+
+//
+// Store of module sections, named by the hash of their words: the header and
+// debug and annotation instructions, the types, constants, and global
+// variables, and then each function.  A module is its list of section names,
+// which the store reassembles it from.
+//
+// Sections only match between modules whose IDs agree, so modules should be
+// canonicalized with spv::spirvbin_t::remap() (spirv-remap) before being added.
+//
+class TSpvStore {
+public:
+    explicit TSpvStore(const std::string& directory) : directory(directory) { }
+
+    // Store whichever sections of the module aren't already, and return the
+    // names to reassemble it from.  Returns false if a section couldn't be
+    // written, or if its name is taken by different words.
+    bool add(const unsigned int* spirv, size_t count, std::vector<std::string>& sections) const;
+
+    // Reassemble a module from the names add() returned; false if a section is missing.
+    bool assemble(const std::vector<std::string>& sections, std::vector<unsigned int>& spirv) const;
+
+    // A module's section names, one per line.
+    static bool writeManifest(const std::string& fileName, const std::vector<std::string>& sections);
+    static bool readManifest(const std::string& fileName, std::vector<std::string>& sections);
+
+protected:
+    std::string getFileName(const std::string& section) const;
+
+    std::string directory;
+};
+
+};  // end namespace glslang
+
+#endif // SpvCache_H
@@ -0,0 +1,352 @@
+//
+//Copyright (C) 2014-2015 LunarG, Inc.
+//
+//All rights reserved.
+//
+//Redistribution and use in source and binary forms, with or without
+//modification, are permitted provided that the following conditions
+//are met:
+//
+//    Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+//    Redistributions in binary form must reproduce the above
+//    copyright notice, this list of conditions and the following
+//    disclaimer in the documentation and/or other materials provided
+//    with the distribution.
+//
+//    Neither the name of 3Dlabs Inc. Ltd. nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+//THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+//FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+//COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+//BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+//LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+//ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//POSSIBILITY OF SUCH DAMAGE.
+
+
+//
+// Compact encoding of SPIR-V binaries; see SpvEncoding.h.
+//
+
+#include "SpvEncoding.h"
+#include "spirv.hpp"
+#include "doc.h"
+
+#include <cstring>
+
+namespace spv {
+
+namespace {
+
+// "SPVe", in the byte order it's written
+const unsigned char EncodedMagic[] = { 'S', 'P', 'V', 'e' };
+const size_t HeaderWords = 5;
+
+enum TWordKind : unsigned char {
+    WordLiteral,
+    WordId,
+    WordString,
+};
+
+// Say what each of an instruction's operand words is.  This has to depend
+// only on the opcode and word count, which are decoded first, and it walks the
+// operands the way spirvbin_t::processInstruction() does.  Anything it gets
+// wrong only costs size, since encoding and decoding agree.
+void ClassifyWords(unsigned opCode, unsigned wordCount, std::vector<unsigned char>& kinds)
+{
+    kinds.assign(wordCount, WordLiteral);
+    if (opCode >= (unsigned)OpcodeCeiling)
+        return;
+
+    const InstructionParameters& desc = InstructionDesc[opCode];
+    unsigned word = 1;
+
+    if (desc.hasType() && word < wordCount)
+        kinds[word++] = WordId;
+    if (desc.hasResult() && word < wordCount)
+        kinds[word++] = WordId;
+
+    if (opCode == OpExtInst) {
+        // instruction set, and instruction from set, then IDs
+        for (word += 2; word < wordCount; ++word)
+            kinds[word] = WordId;
+        return;
+    }
+
+    for (int op = 0; op < desc.operands.getNum() && word < wordCount; ++op) {
+        switch (desc.operands.getClass(op)) {
+        case OperandId:
+        case OperandScope:
+        case OperandMemorySemantics:
+            kinds[word++] = WordId;
+            break;
+
+        case OperandOptionalId:
+        case OperandVariableIds:
+            for (; word < wordCount; ++word)
+                kinds[word] = WordId;
+            return;
+
+        case OperandOptionalImage:
+            // an image operands mask, then the IDs it calls for
+            for (++word; word < wordCount; ++word)
+                kinds[word] = WordId;
+            return;
+
+        case OperandVariableIdLiteral:
+            for (; word < wordCount; word += 2)
+                kinds[word] = WordId;
+            return;
+
+        case OperandVariableLiteralId:
+            for (++word; word < wordCount; word += 2)
+                kinds[word] = WordId;
+            return;
+
+        case OperandLiteralString:
+            // the string, and whatever follows it
+            for (; word < wordCount; ++word)
+                kinds[word] = WordString;
+            return;
+
+        case OperandVariableLiterals:
+            return;
+
+        default:
+            // single word operands holding no IDs
+            ++word;
+            break;
+        }
+    }
+}
+
+inline void PutNumber(std::uint32_t value, std::vector<unsigned char>& encoded)
+{
+    while (value >= 0x80) {
+        encoded.push_back((unsigned char)(value | 0x80));
+        value >>= 7;
+    }
+    encoded.push_back((unsigned char)value);
+}
+
+// Read a number PutNumber() wrote; false if it runs past 'end'.
+inline bool GetNumber(const unsigned char*& next, const unsigned char* end, std::uint32_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 35 && next < end; shift += 7) {
+        const unsigned char byte = *next++;
+        value |= std::uint32_t(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+// IDs are written as their difference from the previous one, folded so small
+// negative differences are small numbers too.
+inline std::uint32_t FoldDelta(std::uint32_t id, std::uint32_t previous)
+{
+    const std::uint32_t delta = id - previous;
+    return (delta << 1) ^ (std::uint32_t)-(std::int32_t)(delta >> 31);
+}
+
+inline std::uint32_t UnfoldDelta(std::uint32_t folded, std::uint32_t previous)
+{
+    return previous + ((folded >> 1) ^ (std::uint32_t)-(std::int32_t)(folded & 1));
+}
+
+// The IDs used most recently, most recent first.  Remapped IDs are hashes,
+// so the difference between unrelated ones is no smaller than they are, but
+// the same few types and values are used over and over.
+class TRecentIds {
+public:
+    TRecentIds() : size(0) { }
+
+    // Where 'id' is, or -1, moving it to the front either way.
+    int find(std::uint32_t id)
+    {
+        int index = 0;
+        while (index < size && ids[index] != id)
+            ++index;
+        const int found = index < size ? index : -1;
+        if (found < 0 && size < Capacity)
+            ++size;
+        for (index = (found < 0 ? size - 1 : found); index > 0; --index)
+            ids[index] = ids[index - 1];
+        ids[0] = id;
+
+        return found;
+    }
+
+    // The ID at 'index', moving it to the front; false if there is none.
+    bool get(int index, std::uint32_t& id)
+    {
+        if (index >= size)
+            return false;
+        id = ids[index];
+        for (; index > 0; --index)
+            ids[index] = ids[index - 1];
+        ids[0] = id;
+
+        return true;
+    }
+
+    // Put an ID not in the list at the front.
+    void add(std::uint32_t id)
+    {
+        if (size < Capacity)
+            ++size;
+        for (int index = size - 1; index > 0; --index)
+            ids[index] = ids[index - 1];
+        ids[0] = id;
+    }
+
+    static const int Capacity = 64;
+
+protected:
+    std::uint32_t ids[Capacity];
+    int size;
+};
+
+} // end anonymous namespace
+
+bool EncodeSpv(const std::uint32_t* spirv, size_t count, std::vector<unsigned char>& encoded)
+{
+    if (count < HeaderWords || spirv[0] != MagicNumber)
+        return false;
+
+    Parameterize();
+
+    const size_t start = encoded.size();
+    encoded.insert(encoded.end(), EncodedMagic, EncodedMagic + sizeof(EncodedMagic));
+    PutNumber((std::uint32_t)count, encoded);
+    for (size_t word = 0; word < HeaderWords; ++word)
+        PutNumber(spirv[word], encoded);
+
+    std::vector<unsigned char> kinds;
+    std::uint32_t previousId = 0;
+    TRecentIds recent;
+    for (size_t word = HeaderWords; word < count; ) {
+        const unsigned opCode = spirv[word] & OpCodeMask;
+        const unsigned wordCount = spirv[word] >> WordCountShift;
+        if (wordCount == 0 || word + wordCount > count) {
+            encoded.resize(start);
+            return false;
+        }
+
+        PutNumber(opCode, encoded);
+        PutNumber(wordCount, encoded);
+
+        ClassifyWords(opCode, wordCount, kinds);
+        for (unsigned w = 1; w < wordCount; ++w) {
+            const std::uint32_t value = spirv[word + w];
+            switch (kinds[w]) {
+            case WordId:
+            {
+                const int index = recent.find(value);
+                if (index >= 0)
+                    PutNumber(std::uint32_t(index) << 1, encoded);
+                else
+                    PutNumber((FoldDelta(value, previousId) << 1) | 1, encoded);
+                previousId = value;
+                break;
+            }
+            case WordString:
+                for (int byte = 0; byte < 4; ++byte)
+                    encoded.push_back((unsigned char)(value >> (8 * byte)));
+                break;
+            default:
+                PutNumber(value, encoded);
+                break;
+            }
+        }
+
+        word += wordCount;
+    }
+
+    return true;
+}
+
+bool IsEncodedSpv(const unsigned char* encoded, size_t size)
+{
+    return size >= sizeof(EncodedMagic) && memcmp(encoded, EncodedMagic, sizeof(EncodedMagic)) == 0;
+}
+
+bool DecodeSpv(const unsigned char* encoded, size_t size, std::vector<std::uint32_t>& spirv)
+{
+    spirv.clear();
+    if (! IsEncodedSpv(encoded, size))
+        return false;
+
+    const unsigned char* next = encoded + sizeof(EncodedMagic);
+    const unsigned char* end = encoded + size;
+
+    // every word takes at least a byte, which bounds what a corrupt count can allocate
+    std::uint32_t count;
+    if (! GetNumber(next, end, count) || count < HeaderWords || count > size_t(end - next))
+        return false;
+
+    Parameterize();
+
+    spirv.resize(count);
+    for (size_t word = 0; word < HeaderWords; ++word) {
+        if (! GetNumber(next, end, spirv[word]))
+            return false;
+    }
+
+    std::vector<unsigned char> kinds;
+    std::uint32_t previousId = 0;
+    TRecentIds recent;
+    for (size_t word = HeaderWords; word < count; ) {
+        std::uint32_t opCode;
+        std::uint32_t wordCount;
+        if (! GetNumber(next, end, opCode) || ! GetNumber(next, end, wordCount) ||
+            opCode > OpCodeMask || wordCount == 0 || wordCount > count - word)
+            return false;
+
+        spirv[word] = (wordCount << WordCountShift) | opCode;
+
+        ClassifyWords(opCode, wordCount, kinds);
+        for (unsigned w = 1; w < wordCount; ++w) {
+            std::uint32_t& value = spirv[word + w];
+            switch (kinds[w]) {
+            case WordId:
+                if (! GetNumber(next, end, value))
+                    return false;
+                if (value & 1) {
+                    value = UnfoldDelta(value >> 1, previousId);
+                    recent.add(value);
+                } else if (! recent.get(int(value >> 1), value))
+                    return false;
+                previousId = value;
+                break;
+            case WordString:
+                if (end - next < 4)
+                    return false;
+                value = next[0] | (next[1] << 8) | (next[2] << 16) | (std::uint32_t(next[3]) << 24);
+                next += 4;
+                break;
+            default:
+                if (! GetNumber(next, end, value))
+                    return false;
+                break;
+            }
+        }
+
+        word += wordCount;
+    }
+
+    return next == end;
+}
+
+}  // end namespace spv
@@ -0,0 +1,73 @@
+//
+//Copyright (C) 2014-2015 LunarG, Inc.
+//
+//All rights reserved.
+//
+//Redistribution and use in source and binary forms, with or without
+//modification, are permitted provided that the following conditions
+//are met:
+//
+//    Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+//    Redistributions in binary form must reproduce the above
+//    copyright notice, this list of conditions and the following
+//    disclaimer in the documentation and/or other materials provided
+//    with the distribution.
+//
+//    Neither the name of 3Dlabs Inc. Ltd. nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+//THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+//FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+//COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+//BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+//LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+//ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//POSSIBILITY OF SUCH DAMAGE.
+
+
+//
+// A compact encoding of SPIR-V binaries, for storing them, rather than for
+// handing them to a driver.
+//
+// Each word is written as a variable-length number, in 7-bit groups.  An ID
+// is written as its place among the IDs used just before it, or failing that,
+// as its signed difference from the last one; other operands are written as
+// they are, and literal strings are copied.  Which words are IDs is known from
+// each instruction's opcode and word count, so the stream needs nothing else.
+// The encoding is lossless for any well-formed module; it is tuned for modules
+// coming out of spv::spirvbin_t::remap(), whose hashed IDs are large but
+// reused a few at a time.
+//
+
+#pragma once
+#ifndef SpvEncoding_H
+#define SpvEncoding_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace spv {
+
+// Append the encoding of the 'count' words of a module to 'encoded'.
+// Returns false, having appended nothing, if they aren't a module.
+bool EncodeSpv(const std::uint32_t* spirv, size_t count, std::vector<unsigned char>& encoded);
+
+// Whether 'size' bytes begin an encoded module
+bool IsEncodedSpv(const unsigned char* encoded, size_t size);
+
+// Decode 'size' bytes of EncodeSpv() output into 'spirv'.
+// Returns false if they are not an encoded module, or are truncated.
+bool DecodeSpv(const unsigned char* encoded, size_t size, std::vector<std::uint32_t>& spirv);
+
+}  // end namespace spv
+
+#endif // SpvEncoding_H
@@ -0,0 +1,472 @@
+//
+//Copyright (C) 2014-2015 LunarG, Inc.
+//
+//All rights reserved.
+//
+//Redistribution and use in source and binary forms, with or without
+//modification, are permitted provided that the following conditions
+//are met:
+//
+//    Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+//    Redistributions in binary form must reproduce the above
+//    copyright notice, this list of conditions and the following
+//    disclaimer in the documentation and/or other materials provided
+//    with the distribution.
+//
+//    Neither the name of 3Dlabs Inc. Ltd. nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+//THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+//FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+//COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+//BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+//LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+//ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//POSSIBILITY OF SUCH DAMAGE.
+
+//
+// Linking of SPIR-V modules; see SpvLinker.h.
+//
+// Each module's instructions are sorted into the sections of the module
+// layout, with whole functions as single entries, and the linked module is
+// those sections, each in module order, less what was made one with an
+// earlier module's.  Since a module only refers to globals it defined before,
+// or to ones made one with an earlier module's, that order stays valid.
+//
+
+#include "SpvLinker.h"
+#include "SPVRemapper.h"
+#include "doc.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+class TSpvLinker : public spv::spirvbin_t {
+public:
+    TSpvLinker(const std::vector<std::vector<unsigned int> >& modules) : modules(modules), maxId(0)
+    {
+        options = NONE;
+    }
+
+    bool link(std::vector<unsigned int>& linked, std::string& errors);
+
+protected:
+    // The sections of a module, in the order the linked module needs them (as
+    // Builder::dump() makes them)
+    enum TSection {
+        SectionSource,
+        SectionCapabilities,
+        SectionExtensions,
+        SectionExtInstImports,
+        SectionMemoryModel,
+        SectionEntryPoints,
+        SectionExecutionModes,
+        SectionDebug,
+        SectionAnnotations,
+        SectionGlobals,
+        SectionDeclarations,   // functions without bodies, which come first
+        SectionDefinitions,
+        SectionCount
+    };
+
+    // The words [start, end) of one of the modules: an instruction, or a whole function
+    struct TInst {
+        TInst(int module, unsigned start, unsigned end) : module(module), start(start), end(end) { }
+        int module;
+        unsigned start;
+        unsigned end;
+    };
+
+    void select(int module) { spv = words_t(modules[module].data(), modules[module].size()); }
+    bool read(int module, spv::Id offset, std::string& errors);
+    void unify();
+    bool resolve(std::string& errors);
+    void removeAnnotations(bool complete);
+    void replaceIds(const TInst&);
+    spv::Id replacement(spv::Id id) const
+    {
+        const auto replaced = replacements.find(id);
+        return replaced == replacements.end() ? id : replaced->second;
+    }
+    bool isLinkage(unsigned start) const
+    {
+        return asOpCode(start) == spv::OpDecorate && asDecoration(start + 2) == spv::DecorationLinkageAttributes;
+    }
+
+    std::vector<std::vector<unsigned int> > modules;  // copies, which get their IDs changed
+    std::vector<TInst> sections[SectionCount];
+    std::unordered_map<spv::Id, spv::Id> replacements; // IDs made one with another, to that other
+    std::unordered_set<spv::Id> dropped;               // IDs no longer defined, whose names and decorations go too
+    spv::Id maxId;                                     // of the linked module
+};
+
+// Move the module's IDs past 'offset', and sort its instructions into sections.
+bool TSpvLinker::read(int module, spv::Id offset, std::string& errors)
+{
+    select(module);
+    if (spv.size() < (size_t)header_size || magic() != spv::MagicNumber || bound() == 0) {
+        errors += "module " + std::to_string(module) + " is not SPIR-V\n";
+        return false;
+    }
+
+    bool inFunction = false;
+    bool hasBody = false;
+    unsigned functionStart = 0;
+
+    process(
+        [&](spv::Op opCode, unsigned start) {
+            const unsigned end = start + asWordCount(start);
+            if (end == start)
+                error("instruction with no words");
+
+            // the instruction set, which process() doesn't give
+            if (opCode == spv::OpExtInst)
+                asId(start + 3) += offset;
+
+            if (inFunction) {
+                if (opCode == spv::OpLabel)
+                    hasBody = true;
+                else if (opCode == spv::OpFunctionEnd) {
+                    sections[hasBody ? SectionDefinitions : SectionDeclarations].push_back(TInst(module, functionStart, end));
+                    inFunction = false;
+                }
+                return false;
+            }
+
+            TSection section;
+            switch (opCode) {
+            case spv::OpCapability:        section = SectionCapabilities;   break;
+            case spv::OpExtension:         section = SectionExtensions;     break;
+            case spv::OpExtInstImport:     section = SectionExtInstImports; break;
+            case spv::OpMemoryModel:       section = SectionMemoryModel;    break;
+            case spv::OpEntryPoint:        section = SectionEntryPoints;    break;
+            case spv::OpExecutionMode:     section = SectionExecutionModes; break;
+
+            case spv::OpSource:
+            case spv::OpSourceExtension:   section = SectionSource;         break;
+
+            case spv::OpString:
+            case spv::OpLine:
+            case spv::OpName:
+            case spv::OpMemberName:        section = SectionDebug;          break;
+
+            case spv::OpDecorate:
+            case spv::OpMemberDecorate:
+            case spv::OpDecorationGroup:
+            case spv::OpGroupDecorate:
+            case spv::OpGroupMemberDecorate: section = SectionAnnotations;  break;
+
+            case spv::OpFunction:
+                inFunction = true;
+                hasBody = false;
+                functionStart = start;
+                return false;
+
+            default:                       section = SectionGlobals;        break;
+            }
+            sections[section].push_back(TInst(module, start, end));
+
+            return false;
+        },
+        [&](spv::Id& id) { id += offset; }
+    );
+
+    if (inFunction) {
+        errors += "module " + std::to_string(module) + " ends within a function\n";
+        return false;
+    }
+
+    return true;
+}
+
+// Make one of each extended instruction set, and of each type, constant, and
+// named global variable, that modules have in common: the same words, other than
+// the result ID, and the same decorations.  Within a module, they're left as
+// they are, so distinct blocks of one module that look alike stay distinct.
+void TSpvLinker::unify()
+{
+    std::unordered_map<spv::Id, std::vector<std::vector<unsigned int> > > decorations;
+    for (const auto& inst : sections[SectionAnnotations]) {
+        select(inst.module);
+        const spv::Op opCode = asOpCode(inst.start);
+        if (opCode == spv::OpDecorate || opCode == spv::OpMemberDecorate) {
+            std::vector<unsigned int> decoration(spv.data() + inst.start, spv.data() + inst.end);
+            decoration[1] = 0;
+            decorations[asId(inst.start + 1)].push_back(decoration);
+        }
+    }
+
+    std::unordered_map<spv::Id, std::string> names;
+    for (const auto& inst : sections[SectionDebug]) {
+        select(inst.module);
+        if (asOpCode(inst.start) == spv::OpName)
+            names[asId(inst.start + 1)] = literalString(inst.start + 2);
+    }
+
+    std::map<std::string, spv::Id> sets;
+    std::vector<TInst> kept;
+    for (const auto& inst : sections[SectionExtInstImports]) {
+        select(inst.module);
+        const spv::Id id = asId(inst.start + 1);
+        const auto set = sets.insert(std::make_pair(literalString(inst.start + 2), id));
+        if (set.second)
+            kept.push_back(inst);
+        else {
+            replacements[id] = set.first->second;
+            dropped.insert(id);
+        }
+    }
+    sections[SectionExtInstImports].swap(kept);
+
+    // Types, constants, and variables, by everything but their IDs, to the ID
+    // and module of the first made.  Operands are made one first, so a
+    // composite matches if its parts do.
+    std::map<std::vector<unsigned int>, std::pair<spv::Id, int> > made;
+    kept.clear();
+    for (const auto& inst : sections[SectionGlobals]) {
+        replaceIds(inst);
+
+        const spv::Op opCode = asOpCode(inst.start);
+        const bool isType = isTypeOp(opCode);
+        if (! isType && ! isConstOp(opCode) && opCode != spv::OpVariable) {
+            kept.push_back(inst);
+            continue;
+        }
+
+        // A struct or variable is what GLSL links by name; without one it's unique.
+        const unsigned resultWord = inst.start + (isType ? 1 : 2);
+        const spv::Id id = asId(resultWord);
+        const bool linkedByName = opCode == spv::OpTypeStruct || opCode == spv::OpVariable;
+        const auto name = names.find(id);
+        if (linkedByName && name == names.end()) {
+            kept.push_back(inst);
+            continue;
+        }
+
+        std::vector<unsigned int> key(spv.data() + inst.start, spv.data() + inst.end);
+        key.erase(key.begin() + (resultWord - inst.start));
+
+        const auto decoration = decorations.find(id);
+        if (decoration != decorations.end()) {
+            std::sort(decoration->second.begin(), decoration->second.end());
+            for (const auto& words : decoration->second)
+                key.insert(key.end(), words.begin(), words.end());
+        }
+
+        if (linkedByName) {
+            key.push_back((unsigned int)name->second.size());
+            key.insert(key.end(), name->second.begin(), name->second.end());
+        }
+
+        const auto previous = made.insert(std::make_pair(key, std::make_pair(id, inst.module))).first;
+        if (previous->second.second != inst.module) {
+            replacements[id] = previous->second.first;
+            dropped.insert(id);
+        } else
+            kept.push_back(inst);
+    }
+    sections[SectionGlobals].swap(kept);
+}
+
+// Replace each import with the export of its name, dropping the declarations
+// that were imported.
+bool TSpvLinker::resolve(std::string& errors)
+{
+    std::unordered_map<std::string, spv::Id> exports;
+    std::vector<std::pair<std::string, spv::Id> > imports;
+    bool resolved = true;
+
+    for (const auto& inst : sections[SectionAnnotations]) {
+        select(inst.module);
+        if (! isLinkage(inst.start))
+            continue;
+
+        const std::string name = literalString(inst.start + 3);
+        const spv::Id id = asId(inst.start + 1);
+        if (spv[inst.end - 1] == spv::LinkageTypeExport) {
+            if (! exports.insert(std::make_pair(name, id)).second) {
+                errors += "function exported more than once: " + name + "\n";
+                resolved = false;
+            }
+        } else
+            imports.push_back(std::make_pair(name, id));
+    }
+
+    // the function type of each function, to check an import against its export
+    std::unordered_map<spv::Id, spv::Id> functionTypes;
+    for (int section = SectionDeclarations; section <= SectionDefinitions; ++section) {
+        for (const auto& inst : sections[section]) {
+            select(inst.module);
+            functionTypes[asId(inst.start + 2)] = replacement(asId(inst.start + 4));
+        }
+    }
+
+    const bool complete = ! sections[SectionEntryPoints].empty();
+    for (const auto& import : imports) {
+        const auto exported = exports.find(import.first);
+        if (exported == exports.end()) {
+            if (complete) {
+                errors += "unresolved import: " + import.first + "\n";
+                resolved = false;
+            }
+        } else if (functionTypes[import.second] != functionTypes[exported->second]) {
+            errors += "function imported with a different type than exported: " + import.first + "\n";
+            resolved = false;
+        } else {
+            replacements[import.second] = exported->second;
+            dropped.insert(import.second);
+        }
+    }
+
+    // the declarations imports were resolved by, and so their parameters
+    std::vector<TInst> kept;
+    for (const auto& inst : sections[SectionDeclarations]) {
+        select(inst.module);
+        if (dropped.find(asId(inst.start + 2)) == dropped.end()) {
+            kept.push_back(inst);
+            continue;
+        }
+        for (unsigned word = inst.start; word < inst.end; word += asWordCount(word)) {
+            if (asOpCode(word) == spv::OpFunctionParameter)
+                dropped.insert(asId(word + 2));
+        }
+    }
+    sections[SectionDeclarations].swap(kept);
+
+    removeAnnotations(complete);
+
+    return resolved;
+}
+
+// Remove the names and decorations of dropped IDs, what the modules repeat
+// of each other's capabilities, extensions, memory model, and source, and,
+// from a complete module, the linkage decorations and capability.
+void TSpvLinker::removeAnnotations(bool complete)
+{
+    std::set<std::vector<unsigned int> > seen;
+    const auto firstSeen = [&](const TInst& inst) {
+        return seen.insert(std::vector<unsigned int>(spv.data() + inst.start, spv.data() + inst.end)).second;
+    };
+    bool haveMemoryModel = false;
+    int sourceModule = -1;
+
+    for (int section = SectionSource; section <= SectionAnnotations; ++section) {
+        std::vector<TInst> kept;
+        for (const auto& inst : sections[section]) {
+            select(inst.module);
+            bool keep;
+            switch (asOpCode(inst.start)) {
+            case spv::OpCapability:
+                keep = ! (complete && spv[inst.start + 1] == spv::CapabilityLinkage) && firstSeen(inst);
+                break;
+            case spv::OpExtension:
+            case spv::OpSourceExtension:
+                keep = firstSeen(inst);
+                break;
+            case spv::OpMemoryModel:
+                keep = ! haveMemoryModel;
+                haveMemoryModel = true;
+                break;
+            case spv::OpSource:
+                if (sourceModule < 0)
+                    sourceModule = inst.module;
+                keep = inst.module == sourceModule;
+                break;
+            case spv::OpName:
+            case spv::OpMemberName:
+            case spv::OpDecorate:
+            case spv::OpMemberDecorate:
+                keep = dropped.find(asId(inst.start + 1)) == dropped.end() && ! (complete && isLinkage(inst.start));
+                break;
+            default:
+                keep = true;
+                break;
+            }
+            if (keep)
+                kept.push_back(inst);
+        }
+        sections[section].swap(kept);
+    }
+}
+
+// Give the instructions the IDs their IDs were made one with, noting the largest
+void TSpvLinker::replaceIds(const TInst& inst)
+{
+    select(inst.module);
+    process(
+        [&](spv::Op opCode, unsigned start) {
+            if (opCode == spv::OpExtInst) {
+                asId(start + 3) = replacement(asId(start + 3));
+                maxId = std::max(maxId, asId(start + 3));
+            }
+            return false;
+        },
+        [&](spv::Id& id) {
+            id = replacement(id);
+            maxId = std::max(maxId, id);
+        },
+        inst.start, inst.end
+    );
+}
+
+bool TSpvLinker::link(std::vector<unsigned int>& linked, std::string& errors)
+{
+    if (modules.empty()) {
+        errors += "no modules to link\n";
+        return false;
+    }
+
+    spv::Id offset = 0;
+    for (int m = 0; m < (int)modules.size(); ++m) {
+        if (! read(m, offset, errors))
+            return false;
+        offset += bound() - 1;
+    }
+
+    unify();
+    if (! resolve(errors))
+        return false;
+
+    // the first module's version and generator
+    linked.assign(modules[0].begin(), modules[0].begin() + header_size);
+    linked[4] = 0;
+
+    maxId = 0;
+    for (int section = 0; section < SectionCount; ++section) {
+        for (const auto& inst : sections[section]) {
+            replaceIds(inst);
+            linked.insert(linked.end(), spv.data() + inst.start, spv.data() + inst.end);
+        }
+    }
+    linked[3] = maxId + 1;
+
+    return true;
+}
+
+} // end anonymous namespace
+
+namespace spv {
+
+bool LinkSpv(const std::vector<std::vector<unsigned int> >& modules, std::vector<unsigned int>& linked, std::string& errors)
+{
+    Parameterize();
+
+    TSpvLinker linker(modules);
+
+    return linker.link(linked, errors);
+}
+
+} // end namespace spv
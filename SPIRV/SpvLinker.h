@@ -0,0 +1,70 @@
+//
+//Copyright (C) 2014-2015 LunarG, Inc.
+//
+//All rights reserved.
+//
+//Redistribution and use in source and binary forms, with or without
+//modification, are permitted provided that the following conditions
+//are met:
+//
+//    Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+//    Redistributions in binary form must reproduce the above
+//    copyright notice, this list of conditions and the following
+//    disclaimer in the documentation and/or other materials provided
+//    with the distribution.
+//
+//    Neither the name of 3Dlabs Inc. Ltd. nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+//THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+//FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+//COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+//BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+//LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+//ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//POSSIBILITY OF SUCH DAMAGE.
+
+//
+// Linking of SPIR-V modules, so that a library of functions can be compiled
+// once (glslangValidator --library) and linked into every module calling it,
+// rather than being compiled again as part of each.
+//
+// A library decorates the functions it defines with LinkageAttributes Export,
+// and declares, with LinkageAttributes Import, those it calls but doesn't
+// define; each import is resolved to the export of the same (mangled) name.
+//
+
+#pragma once
+#ifndef SpvLinker_H
+#define SpvLinker_H
+
+#include <string>
+#include <vector>
+
+namespace spv {
+
+// Link 'modules' into 'linked'.  The IDs of each module are moved past those of
+// the modules before it, and then the types, constants, and extended instruction
+// set imports the modules have in common are made one, as are their global
+// variables of the same name, type, and decorations.
+//
+// If the result has an entry point, it's complete: every import must be
+// resolved, and the linkage decorations and capability are removed.  If not,
+// it's a library still, which can be linked again.
+//
+// Returns false, with what went wrong in 'errors', if a module isn't SPIR-V,
+// a function is exported twice or imported with a different type, or an import
+// of a complete result wasn't resolved.
+bool LinkSpv(const std::vector<std::vector<unsigned int> >& modules, std::vector<unsigned int>& linked, std::string& errors);
+
+}  // end namespace spv
+
+#endif // SpvLinker_H
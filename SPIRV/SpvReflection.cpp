@@ -0,0 +1,576 @@
+//
+//Copyright (C) 2014-2015 LunarG, Inc.
+//
+//All rights reserved.
+//
+//Redistribution and use in source and binary forms, with or without
+//modification, are permitted provided that the following conditions
+//are met:
+//
+//    Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+//    Redistributions in binary form must reproduce the above
+//    copyright notice, this list of conditions and the following
+//    disclaimer in the documentation and/or other materials provided
+//    with the distribution.
+//
+//    Neither the name of 3Dlabs Inc. Ltd. nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+//THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+//FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+//COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+//BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+//LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+//ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//POSSIBILITY OF SUCH DAMAGE.
+
+//
+// Reflection of a SPIR-V module; see SpvReflection.h.
+//
+// Rather than duplicating the reflection rules, this rebuilds, from the module,
+// glslang types for the uniform variables and a small stand-in AST for main()
+// holding each use of them, and gives that to the same TReflection code that
+// reflects real ASTs.  Uses are collected from the functions reachable from the
+// entry point, skipping the blocks of branches on constant conditions, in the
+// order the AST liveness traversal would have found them.
+//
+
+#include "SpvReflection.h"
+#include "SPVRemapper.h"
+#include "doc.h"
+#include "../glslang/MachineIndependent/localintermediate.h"
+#include "../glslang/MachineIndependent/reflection.h"
+
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+class TSpvReflector : public spv::spirvbin_t {
+public:
+    TSpvReflector(const std::vector<unsigned int>& spirv) : words(spirv), intermediate(nullptr), anonymousBlocks(0)
+    {
+        spv = words_t(words.data(), words.size());
+        options = NONE;
+    }
+
+    bool buildStage(glslang::TIntermediate&);
+
+protected:
+    // What an access chain on a uniform variable selects.
+    struct TChain {
+        spv::Id variable;
+        std::vector<spv::Id> indexes;
+        bool used;
+    };
+
+    // A basic block of a function's body.
+    struct TBlock {
+        unsigned start;
+        unsigned end;
+        std::vector<spv::Id> successors;
+    };
+
+    void findGlobals();
+    glslang::TType* convertType(spv::Id typeId);
+    glslang::TLayoutPacking findPacking(const glslang::TTypeList& members, bool buffer) const;
+    bool hasLayout(const glslang::TTypeList& members, bool std140) const;
+    void addVariable(spv::Id variable, spv::Id pointerType, spv::StorageClass);
+    void addFunctionUses(spv::Id function, std::vector<spv::Id>& functionStack, std::unordered_set<spv::Id>& liveFunctions);
+    void addUse(spv::Id variable, const std::vector<spv::Id>& indexes);
+    bool getConstant(spv::Id id, int& value) const;
+
+    std::vector<unsigned int> words;                            // the module, which spv points into
+    std::unordered_map<spv::Id, std::string> names;
+    std::map<std::pair<spv::Id, int>, std::string> memberNames;
+    std::map<std::pair<spv::Id, int>, int> memberOffsets;
+    std::set<std::pair<spv::Id, int> > rowMajorMembers;
+    std::set<std::pair<spv::Id, int> > columnMajorMembers;
+    std::unordered_set<spv::Id> blockTypes;
+    std::unordered_set<spv::Id> bufferBlockTypes;
+    std::unordered_map<spv::Id, int> constants;                 // 32-bit scalar constants
+    std::unordered_map<spv::Id, bool> boolConstants;
+    std::unordered_map<spv::Id, glslang::TType*> types;         // converted so far
+    std::unordered_map<spv::Id, glslang::TType*> variableTypes; // uniform variable to its glslang type
+    std::unordered_map<spv::Id, glslang::TString> variableNames;
+    std::unordered_map<spv::Id, TChain> chains;                 // access chain result to what it selects
+    const glslang::TIntermediate* intermediate;                 // being built, which lays out the blocks
+    glslang::TIntermAggregate* body;                            // of the stand-in main()
+    int anonymousBlocks;
+};
+
+// Record the names, decorations, constants, and uniform variables of the module.
+void TSpvReflector::findGlobals()
+{
+    std::vector<std::pair<spv::Id, spv::Id> > variables;
+    std::vector<spv::StorageClass> storages;
+
+    process(
+        [&](spv::Op opCode, unsigned start) {
+            switch (opCode) {
+            case spv::OpName:
+                names[asId(start + 1)] = literalString(start + 2);
+                break;
+            case spv::OpMemberName:
+                memberNames[std::make_pair(asId(start + 1), (int)asId(start + 2))] = literalString(start + 3);
+                break;
+            case spv::OpDecorate:
+                if (asDecoration(start + 2) == spv::DecorationBlock)
+                    blockTypes.insert(asId(start + 1));
+                else if (asDecoration(start + 2) == spv::DecorationBufferBlock)
+                    bufferBlockTypes.insert(asId(start + 1));
+                break;
+            case spv::OpMemberDecorate:
+            {
+                std::pair<spv::Id, int> member(asId(start + 1), (int)asId(start + 2));
+                if (asDecoration(start + 3) == spv::DecorationOffset)
+                    memberOffsets[member] = (int)asId(start + 4);
+                else if (asDecoration(start + 3) == spv::DecorationRowMajor)
+                    rowMajorMembers.insert(member);
+                else if (asDecoration(start + 3) == spv::DecorationColMajor)
+                    columnMajorMembers.insert(member);
+                break;
+            }
+            case spv::OpConstant:
+            case spv::OpSpecConstant:
+                if (asWordCount(start) == 4)
+                    constants[asId(start + 2)] = (int)asId(start + 3);
+                break;
+            case spv::OpConstantTrue:
+                boolConstants[asId(start + 2)] = true;
+                break;
+            case spv::OpConstantFalse:
+                boolConstants[asId(start + 2)] = false;
+                break;
+            case spv::OpVariable:
+                switch (spv::StorageClass(asId(start + 3))) {
+                case spv::StorageClassUniformConstant:
+                case spv::StorageClassUniform:
+                case spv::StorageClassAtomicCounter:
+                    variables.push_back(std::make_pair(asId(start + 2), asId(start + 1)));
+                    storages.push_back(spv::StorageClass(asId(start + 3)));
+                    break;
+                default:
+                    break;
+                }
+                break;
+            default:
+                break;
+            }
+
+            return true;
+        },
+        [](spv::Id&) { });
+
+    // the types need all the decorations first
+    for (size_t v = 0; v < variables.size(); ++v)
+        addVariable(variables[v].first, variables[v].second, storages[v]);
+}
+
+bool TSpvReflector::getConstant(spv::Id id, int& value) const
+{
+    std::unordered_map<spv::Id, int>::const_iterator it = constants.find(id);
+    if (it == constants.end())
+        return false;
+
+    value = it->second;
+
+    return true;
+}
+
+// Make the glslang type, with the qualifiers reflection looks at, for a SPIR-V type.
+glslang::TType* TSpvReflector::convertType(spv::Id typeId)
+{
+    std::unordered_map<spv::Id, glslang::TType*>::const_iterator it = types.find(typeId);
+    if (it != types.end())
+        return it->second;
+
+    glslang::TType* type = nullptr;
+    const unsigned start = typePos(typeId);
+    switch (asOpCode(start)) {
+    case spv::OpTypeBool:
+        type = new glslang::TType(glslang::EbtBool);
+        break;
+    case spv::OpTypeInt:
+        type = new glslang::TType(asId(start + 3) ? glslang::EbtInt : glslang::EbtUint);
+        break;
+    case spv::OpTypeFloat:
+        type = new glslang::TType(asId(start + 2) == 64 ? glslang::EbtDouble : glslang::EbtFloat);
+        break;
+    case spv::OpTypeVector:
+        type = new glslang::TType(convertType(asId(start + 2))->getBasicType(), glslang::EvqTemporary, (int)asId(start + 3));
+        break;
+    case spv::OpTypeMatrix:
+    {
+        const glslang::TType* column = convertType(asId(start + 2));
+        type = new glslang::TType(column->getBasicType(), glslang::EvqTemporary, 0, (int)asId(start + 3), column->getVectorSize());
+        break;
+    }
+    case spv::OpTypeImage:
+    case spv::OpTypeSampledImage:
+    {
+        // an image, or a sampler made from the image it samples
+        const bool image = asOpCode(start) == spv::OpTypeImage;
+        const unsigned imageStart = image ? start : typePos(asId(start + 2));
+        glslang::TBasicType sampledType = convertType(asId(imageStart + 2))->getBasicType();
+        glslang::TSamplerDim dim;
+        switch (spv::Dim(asId(imageStart + 3))) {
+        case spv::Dim1D:     dim = glslang::Esd1D;     break;
+        case spv::Dim2D:     dim = glslang::Esd2D;     break;
+        case spv::Dim3D:     dim = glslang::Esd3D;     break;
+        case spv::DimCube:   dim = glslang::EsdCube;   break;
+        case spv::DimRect:   dim = glslang::EsdRect;   break;
+        case spv::DimBuffer: dim = glslang::EsdBuffer; break;
+        default:             dim = glslang::EsdNone;   break;
+        }
+        const bool shadow = asId(imageStart + 4) == 1;
+        const bool arrayed = asId(imageStart + 5) != 0;
+        const bool ms = asId(imageStart + 6) != 0;
+
+        glslang::TPublicType publicType;
+        publicType.init(glslang::TSourceLoc());
+        publicType.basicType = glslang::EbtSampler;
+        if (image)
+            publicType.sampler.setImage(sampledType, dim, arrayed, shadow, ms);
+        else
+            publicType.sampler.set(sampledType, dim, arrayed, shadow, ms);
+        type = new glslang::TType(publicType);
+        break;
+    }
+    case spv::OpTypeArray:
+    case spv::OpTypeRuntimeArray:
+    {
+        // SPIR-V nests arrays of arrays outer to inner; glslang lists their sizes
+        const glslang::TType* element = convertType(asId(start + 2));
+        glslang::TArraySizes sizes;
+        int size;
+        if (asOpCode(start) == spv::OpTypeArray && getConstant(asId(start + 3), size))
+            sizes.addInnerSize(size);
+        else
+            sizes.addInnerSize();
+        if (element->isArray()) {
+            for (int d = 0; d < element->getArraySizes()->getNumDims(); ++d)
+                sizes.addInnerSize(element->getArraySizes()->getDimSize(d));
+        }
+        type = new glslang::TType;
+        type->shallowCopy(*element);
+        type->newArraySizes(sizes);
+        break;
+    }
+    case spv::OpTypeStruct:
+    {
+        // Like the front end, only a block's own members have offsets and the block's
+        // packing; those of structures within it are computed as reflection goes.
+        const bool buffer = bufferBlockTypes.find(typeId) != bufferBlockTypes.end();
+        const bool block = buffer || blockTypes.find(typeId) != blockTypes.end();
+        glslang::TTypeList* members = new glslang::TTypeList;
+        for (int m = 0; m < (int)asWordCount(start) - 2; ++m) {
+            std::pair<spv::Id, int> member(typeId, m);
+            glslang::TTypeLoc typeLoc;
+            typeLoc.loc.init();
+            typeLoc.type = new glslang::TType;
+            typeLoc.type->shallowCopy(*convertType(asId(start + 2 + m)));
+            typeLoc.type->setFieldName(memberNames[member].c_str());
+            std::map<std::pair<spv::Id, int>, int>::const_iterator offset = memberOffsets.find(member);
+            if (block && offset != memberOffsets.end())
+                typeLoc.type->getQualifier().layoutOffset = offset->second;
+            if (rowMajorMembers.find(member) != rowMajorMembers.end())
+                typeLoc.type->getQualifier().layoutMatrix = glslang::ElmRowMajor;
+            else if (columnMajorMembers.find(member) != columnMajorMembers.end())
+                typeLoc.type->getQualifier().layoutMatrix = glslang::ElmColumnMajor;
+            members->push_back(typeLoc);
+        }
+
+        if (block) {
+            glslang::TQualifier qualifier;
+            qualifier.clear();
+            qualifier.storage = buffer ? glslang::EvqBuffer : glslang::EvqUniform;
+            qualifier.layoutPacking = findPacking(*members, buffer);
+            for (size_t m = 0; m < members->size(); ++m)
+                (*members)[m].type->getQualifier().layoutPacking = qualifier.layoutPacking;
+            type = new glslang::TType(members, names[typeId].c_str(), qualifier);
+        } else
+            type = new glslang::TType(members, names[typeId].c_str());
+        break;
+    }
+    default:
+        type = new glslang::TType;
+        break;
+    }
+
+    types[typeId] = type;
+
+    return type;
+}
+
+// Whether the members' offsets are the ones std140 (or std430) gives.
+bool TSpvReflector::hasLayout(const glslang::TTypeList& members, bool std140) const
+{
+    int offset = 0;
+    for (size_t m = 0; m < members.size(); ++m) {
+        int memberSize;
+        int memberAlignment = intermediate->getBaseAlignment(*members[m].type, memberSize, std140);
+        glslang::RoundToPow2(offset, memberAlignment);
+        if (members[m].type->getQualifier().layoutOffset != offset)
+            return false;
+        offset += memberSize;
+    }
+
+    return true;
+}
+
+// The module only has the offsets a packing gave, and only for std140 and std430,
+// so tell those two apart by their offsets, preferring what the kind of block
+// is most often declared with when both fit.
+glslang::TLayoutPacking TSpvReflector::findPacking(const glslang::TTypeList& members, bool buffer) const
+{
+    if (members.empty() || ! members[0].type->getQualifier().hasOffset())
+        return glslang::ElpShared;
+
+    if (buffer)
+        return hasLayout(members, false) || ! hasLayout(members, true) ? glslang::ElpStd430 : glslang::ElpStd140;
+    else
+        return hasLayout(members, true) || ! hasLayout(members, false) ? glslang::ElpStd140 : glslang::ElpStd430;
+}
+
+void TSpvReflector::addVariable(spv::Id variable, spv::Id pointerType, spv::StorageClass storage)
+{
+    const glslang::TType* pointee = convertType(asId(typePos(pointerType) + 3));
+    glslang::TType* type;
+    if (storage == spv::StorageClassAtomicCounter) {
+        type = new glslang::TType(glslang::EbtAtomicUint, glslang::EvqUniform);
+        if (pointee->isArray())
+            type->newArraySizes(*pointee->getArraySizes());
+    } else {
+        type = new glslang::TType;
+        type->shallowCopy(*pointee);
+        if (type->getBasicType() != glslang::EbtBlock)
+            type->getQualifier().storage = glslang::EvqUniform;
+    }
+    variableTypes[variable] = type;
+
+    glslang::TString name = names[variable].c_str();
+    if (type->getBasicType() == glslang::EbtBlock && name.empty())
+        name = glslang::AnonymousPrefix + glslang::String(anonymousBlocks++);
+    variableNames[variable] = name;
+}
+
+// Add an expression using a uniform variable, or what an access chain on it selects.
+void TSpvReflector::addUse(spv::Id variable, const std::vector<spv::Id>& indexes)
+{
+    const glslang::TType& variableType = *variableTypes[variable];
+    glslang::TIntermTyped* node = new glslang::TIntermSymbol(variable, variableNames[variable], variableType);
+    for (size_t i = 0; i < indexes.size(); ++i) {
+        const glslang::TType& leftType = node->getType();
+        int index;
+        const bool constant = getConstant(indexes[i], index);
+        glslang::TOperator op;
+        if (leftType.isArray() || leftType.isMatrix() || leftType.isVector())
+            op = constant ? glslang::EOpIndexDirect : glslang::EOpIndexIndirect;
+        else if ((leftType.getBasicType() == glslang::EbtStruct || leftType.getBasicType() == glslang::EbtBlock) && constant)
+            op = glslang::EOpIndexDirectStruct;
+        else
+            break;
+
+        glslang::TIntermBinary* binary = new glslang::TIntermBinary(op);
+        binary->setLeft(node);
+        if (constant) {
+            glslang::TConstUnionArray unionArray(1);
+            unionArray[0].setIConst(index);
+            binary->setRight(new glslang::TIntermConstantUnion(unionArray, glslang::TType(glslang::EbtInt, glslang::EvqConst)));
+        } else
+            binary->setRight(new glslang::TIntermSymbol(0, "", glslang::TType(glslang::EbtInt)));
+        binary->setType(glslang::TType(leftType, constant ? index : 0));
+        node = binary;
+    }
+
+    body->getSequence().push_back(node);
+}
+
+// Add the uses of uniforms within a function's live blocks, and push the functions
+// it calls that haven't been seen yet onto 'functionStack'.
+void TSpvReflector::addFunctionUses(spv::Id function, std::vector<spv::Id>& functionStack,
+                                    std::unordered_set<spv::Id>& liveFunctions)
+{
+    const range_t range = fnPos[function];
+
+    // find the blocks, and the blocks each can branch to, ignoring those a
+    // constant condition rules out
+    std::vector<TBlock> blocks;
+    std::unordered_map<spv::Id, int> blockIndexes;
+    process(
+        [&](spv::Op opCode, unsigned start) {
+            switch (opCode) {
+            case spv::OpLabel:
+                blockIndexes[asId(start + 1)] = (int)blocks.size();
+                blocks.push_back(TBlock());
+                blocks.back().start = start + asWordCount(start);
+                blocks.back().end = blocks.back().start;
+                return true;
+            case spv::OpBranch:
+                blocks.back().successors.push_back(asId(start + 1));
+                break;
+            case spv::OpBranchConditional:
+            {
+                std::unordered_map<spv::Id, bool>::const_iterator condition = boolConstants.find(asId(start + 1));
+                if (condition == boolConstants.end() || condition->second)
+                    blocks.back().successors.push_back(asId(start + 2));
+                if (condition == boolConstants.end() || ! condition->second)
+                    blocks.back().successors.push_back(asId(start + 3));
+                break;
+            }
+            case spv::OpSwitch:
+                blocks.back().successors.push_back(asId(start + 2));
+                for (unsigned word = start + 4; word < start + asWordCount(start); word += 2)
+                    blocks.back().successors.push_back(asId(word));
+                break;
+            default:
+                break;
+            }
+            if (! blocks.empty())
+                blocks.back().end = start + asWordCount(start);
+            return true;
+        },
+        [](spv::Id&) { },
+        range.first, range.second);
+
+    std::vector<bool> live(blocks.size(), false);
+    std::vector<int> worklist;
+    if (! blocks.empty()) {
+        live[0] = true;
+        worklist.push_back(0);
+    }
+    while (! worklist.empty()) {
+        const TBlock& block = blocks[worklist.back()];
+        worklist.pop_back();
+        for (size_t s = 0; s < block.successors.size(); ++s) {
+            int successor = blockIndexes[block.successors[s]];
+            if (! live[successor]) {
+                live[successor] = true;
+                worklist.push_back(successor);
+            }
+        }
+    }
+
+    // Each use of a uniform variable, or the first use of an access chain on one,
+    // other than to make a longer chain, is an expression for reflection.
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        if (! live[b])
+            continue;
+
+        process(
+            [&](spv::Op opCode, unsigned start) {
+                if (opCode == spv::OpAccessChain || opCode == spv::OpInBoundsAccessChain) {
+                    const spv::Id base = asId(start + 3);
+                    TChain chain;
+                    if (variableTypes.find(base) != variableTypes.end())
+                        chain.variable = base;
+                    else if (chains.find(base) != chains.end()) {
+                        chain.variable = chains[base].variable;
+                        chain.indexes = chains[base].indexes;
+                    } else
+                        return true;
+                    for (unsigned word = start + 4; word < start + asWordCount(start); ++word)
+                        chain.indexes.push_back(asId(word));
+                    chain.used = false;
+                    chains[asId(start + 2)] = chain;
+                    return true;
+                }
+                if (opCode == spv::OpFunctionCall && liveFunctions.insert(asId(start + 3)).second)
+                    functionStack.push_back(asId(start + 3));
+                return false;
+            },
+            [&](spv::Id& id) {
+                if (variableTypes.find(id) != variableTypes.end())
+                    addUse(id, std::vector<spv::Id>());
+                else {
+                    std::unordered_map<spv::Id, TChain>::iterator chain = chains.find(id);
+                    if (chain != chains.end() && ! chain->second.used) {
+                        chain->second.used = true;
+                        addUse(chain->second.variable, chain->second.indexes);
+                    }
+                }
+            },
+            blocks[b].start, blocks[b].end);
+    }
+}
+
+// Build the types and the stand-in AST into 'intermediate'.
+bool TSpvReflector::buildStage(glslang::TIntermediate& intermediate)
+{
+    if (spv.size() < (size_t)header_size || magic() != spv::MagicNumber)
+        return false;
+
+    spv::Parameterize();
+    validate();
+    buildLocalMaps();
+    if (entryPoint == spv::NoResult || fnPos.find(entryPoint) == fnPos.end())
+        return false;
+
+    this->intermediate = &intermediate;
+    findGlobals();
+
+    body = new glslang::TIntermAggregate(glslang::EOpSequence);
+    glslang::TIntermAggregate* mainFunction = new glslang::TIntermAggregate(glslang::EOpFunction);
+    mainFunction->setName("main(");
+    mainFunction->getSequence().push_back(body);
+    glslang::TIntermAggregate* root = new glslang::TIntermAggregate(glslang::EOpSequence);
+    root->getSequence().push_back(mainFunction);
+    intermediate.setTreeRoot(root);
+    intermediate.addMainCount();
+
+    // like the AST traversal, finish each function before the last one it called
+    std::vector<spv::Id> functionStack(1, entryPoint);
+    std::unordered_set<spv::Id> liveFunctions;
+    liveFunctions.insert(entryPoint);
+    while (! functionStack.empty()) {
+        spv::Id function = functionStack.back();
+        functionStack.pop_back();
+        if (fnPos.find(function) != fnPos.end())
+            addFunctionUses(function, functionStack, liveFunctions);
+    }
+
+    return true;
+}
+
+} // end anonymous namespace
+
+namespace glslang {
+
+bool SpvToReflection(const std::vector<unsigned int>& spirv, TReflection& reflection)
+{
+    // The types, the stand-in AST, and reflection's own names for them all go in a
+    // pool of their own; merging copies the names reflection keeps.
+    TPoolAllocator& previousAllocator = GetThreadPoolAllocator();
+    TPoolAllocator* pool = new TPoolAllocator();
+    SetThreadPoolAllocator(*pool);
+
+    bool success;
+    TReflection* stageReflection = new TReflection;
+    {
+        TSpvReflector reflector(spirv);
+        TIntermediate intermediate(EShLangVertex);
+        success = reflector.buildStage(intermediate) && stageReflection->collectStage(intermediate);
+    }
+
+    SetThreadPoolAllocator(previousAllocator);
+    if (success)
+        reflection.merge(*stageReflection);
+
+    delete stageReflection;
+    delete pool;
+
+    return success;
+}
+
+} // end namespace glslang
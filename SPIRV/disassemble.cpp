@@ -70,10 +70,17 @@ enum ExtInstSet {
 };
 
 // Container class for a single instance of a SPIR-V stream, with methods for disassembly.
+//
+// The text is built up in a string and written to the std::ostream in large
+// pieces, rather than through the stream's formatting a piece at a time.
 class SpirvStream {
 public:
-    SpirvStream(std::ostream& out, const std::vector<unsigned int>& stream) : out(out), stream(stream), word(0), nextNestedControl(0) { }
-    virtual ~SpirvStream() { }
+    SpirvStream(std::ostream& out, const std::vector<unsigned int>& stream) : out(out), stream(stream), word(0),
+        firstFunction(0), endFunction(-1), functionCount(0), printing(true), nextNestedControl(0) { }
+    virtual ~SpirvStream() { flush(); }
+
+    // only show functions [first, end), counted from 0 in module order
+    void setFunctions(int first, int end) { firstFunction = first; endFunction = end; printing = false; }
 
     void validate();
     void processInstructions();
@@ -84,8 +91,15 @@ protected:
     Op getOpCode(int id) const { return idInstruction[id] ? (Op)(stream[idInstruction[id]] & OpCodeMask) : OpNop; }
 
     // Output methods
+    void put(const char* s) { text.append(s); }
+    void put(const std::string& s) { text.append(s); }
+    void put(char c) { text.push_back(c); }
+    void putNumber(unsigned int n);
+    void putRightAligned(size_t start, size_t width);
+    void flush();
+    void kill(const char* message) { flush(); Kill(out, message); }
     void outputIndent();
-    void formatId(Id id, std::stringstream&);
+    void formatId(Id id);
     void outputResultId(Id id);
     void outputTypeId(Id id);
     void outputId(Id id);
@@ -97,10 +111,17 @@ protected:
 
     // Data
     std::ostream& out;                       // where to write the disassembly
+    std::string text;                        // disassembly not yet written to 'out'
     const std::vector<unsigned int>& stream; // the actual word stream
     int size;                                // the size of the word stream
     int word;                                // the next word of the stream to read
 
+    // which functions to show, and whether the current instruction is shown
+    int firstFunction;
+    int endFunction;                         // -1 for no limit
+    int functionCount;                       // functions started so far
+    bool printing;
+
     // map each <id> to the instruction that created it
     Id bound;
     std::vector<unsigned int> idInstruction;  // the word offset into the stream where the instruction for result [id] starts; 0 if not yet seen (forward reference or function parameter)
@@ -115,35 +136,75 @@ protected:
     Id nextNestedControl;         // need a slight delay for when we are nested
 };
 
+void SpirvStream::putNumber(unsigned int n)
+{
+    char digits[10];
+    int count = 0;
+    do {
+        digits[count++] = (char)('0' + n % 10);
+        n /= 10;
+    } while (n > 0);
+
+    while (count > 0)
+        text.push_back(digits[--count]);
+}
+
+// right-align what was put since 'start' in a field of 'width'
+void SpirvStream::putRightAligned(size_t start, size_t width)
+{
+    const size_t length = text.size() - start;
+    if (length < width)
+        text.insert(start, width - length, ' ');
+}
+
+void SpirvStream::flush()
+{
+    out.write(text.data(), text.size());
+    text.clear();
+}
+
 void SpirvStream::validate()
 {
     size = (int)stream.size();
     if (size < 4)
-        Kill(out, "stream is too short");
+        kill("stream is too short");
 
     // Magic number
     if (stream[word++] != MagicNumber) {
-        out << "Bad magic number";
+        put("Bad magic number");
         return;
     }
 
     // Version
-    out << "// Module Version " << stream[word++] << std::endl;
+    put("// Module Version ");
+    putNumber(stream[word++]);
+    put('\n');
 
     // Generator's magic number
-    out << "// Generated by (magic number): " << std::setbase(16) << stream[word++] << std::setbase(10) << std::endl;
+    char generator[16];
+    snprintf(generator, sizeof(generator), "%x", stream[word++]);
+    put("// Generated by (magic number): ");
+    put(generator);
+    put('\n');
 
     // Result <id> bound
     bound = stream[word++];
     idInstruction.resize(bound);
     idDescriptor.resize(bound);
-    out << "// Id's are bound by " << bound << std::endl;
-    out << std::endl;
+    put("// Id's are bound by ");
+    putNumber(bound);
+    put('\n');
+    put('\n');
 
     // Reserved schema, must be 0 for now
     schema = stream[word++];
     if (schema != 0)
-        Kill(out, "bad schema, must be 0");
+        kill("bad schema, must be 0");
+
+    if (! printing) {
+        // skipped along with everything else outside the functions shown
+        text.clear();
+    }
 }
 
 // Loop over all the instructions, in order, processing each.
@@ -163,7 +224,17 @@ void SpirvStream::processInstructions()
 
         // Presence of full instruction
         if (nextInst > size)
-            Kill(out, "stream instruction terminated too early");
+            kill("stream instruction terminated too early");
+
+        // Showing only some functions: everything else is still disassembled,
+        // for the names and types it gives IDs, but the text is dropped
+        if (opCode == OpFunction) {
+            if (functionCount == endFunction)
+                break;
+            printing = functionCount >= firstFunction;
+            ++functionCount;
+        }
+        const size_t textStart = text.size();
 
         // Base for computing number of operands; will be updated as more is learned
         unsigned numOperands = wordCount - 1;
@@ -192,41 +263,54 @@ void SpirvStream::processInstructions()
         // Hand off the Op and all its operands
         disassembleInstruction(resultId, typeId, opCode, numOperands);
         if (word != nextInst) {
-            out << " ERROR, incorrect number of operands consumed.  At " << word << " instead of " << nextInst << " instruction start was " << instructionStart;
+            put(" ERROR, incorrect number of operands consumed.  At ");
+            putNumber(word);
+            put(" instead of ");
+            putNumber(nextInst);
+            put(" instruction start was ");
+            putNumber(instructionStart);
             word = nextInst;
         }
-        out << std::endl;
+        put('\n');
+
+        if (! printing)
+            text.resize(textStart);
+        else if (text.size() > 64 * 1024)
+            flush();
     }
 }
 
 void SpirvStream::outputIndent()
 {
     for (int i = 0; i < (int)nestedControl.size(); ++i)
-        out << "  ";
+        put("  ");
 }
 
-void SpirvStream::formatId(Id id, std::stringstream& idStream)
+void SpirvStream::formatId(Id id)
 {
     if (id >= bound)
-        Kill(out, "Bad <id>");
+        kill("Bad <id>");
 
     if (id != 0) {
-        idStream << id;
-        if (idDescriptor[id].size() > 0)
-            idStream << "(" << idDescriptor[id] << ")";
+        putNumber(id);
+        if (idDescriptor[id].size() > 0) {
+            put('(');
+            put(idDescriptor[id]);
+            put(')');
+        }
     }
 }
 
 void SpirvStream::outputResultId(Id id)
 {
     const int width = 16;
-    std::stringstream idStream;
-    formatId(id, idStream);
-    out << std::setw(width) << std::right << idStream.str();
+    const size_t start = text.size();
+    formatId(id);
+    putRightAligned(start, width);
     if (id != 0)
-        out << ":";
+        put(":");
     else
-        out << " ";
+        put(" ");
 
     if (nestedControl.size() && id == nestedControl.top())
         nestedControl.pop();
@@ -235,29 +319,35 @@ void SpirvStream::outputResultId(Id id)
 void SpirvStream::outputTypeId(Id id)
 {
     const int width = 12;
-    std::stringstream idStream;
-    formatId(id, idStream);
-    out << std::setw(width) << std::right << idStream.str() << " ";
+    const size_t start = text.size();
+    formatId(id);
+    putRightAligned(start, width);
+    put(" ");
 }
 
 void SpirvStream::outputId(Id id)
 {
     if (id >= bound)
-        Kill(out, "Bad <id>");
+        kill("Bad <id>");
 
-    out << id;
-    if (idDescriptor[id].size() > 0)
-        out << "(" << idDescriptor[id] << ")";
+    putNumber(id);
+    if (idDescriptor[id].size() > 0) {
+        put('(');
+        put(idDescriptor[id]);
+        put(')');
+    }
 }
 
 void SpirvStream::outputMask(OperandClass operandClass, unsigned mask)
 {
     if (mask == 0)
-        out << "None";
+        put("None");
     else {
         for (int m = 0; m < OperandClassParams[operandClass].ceiling; ++m) {
-            if (mask & (1 << m))
-                out << OperandClassParams[operandClass].getName(m) << " ";
+            if (mask & (1 << m)) {
+                put(OperandClassParams[operandClass].getName(m));
+                put(" ");
+            }
         }
     }
 }
@@ -265,9 +355,9 @@ void SpirvStream::outputMask(OperandClass operandClass, unsigned mask)
 void SpirvStream::disassembleImmediates(int numOperands)
 {
     for (int i = 0; i < numOperands; ++i) {
-        out << stream[word++];
+        putNumber(stream[word++]);
         if (i < numOperands - 1)
-            out << " ";
+            put(" ");
     }
 }
 
@@ -276,13 +366,13 @@ void SpirvStream::disassembleIds(int numOperands)
     for (int i = 0; i < numOperands; ++i) {
         outputId(stream[word++]);
         if (i < numOperands - 1)
-            out << " ";
+            put(" ");
     }
 }
 
 void SpirvStream::disassembleString()
 {
-    out << " \"";
+    put(" \"");
 
     char* wordString;
     bool done = false;
@@ -294,19 +384,19 @@ void SpirvStream::disassembleString()
                 done = true;
                 break;
             }
-            out << *(wordString++);
+            put(*(wordString++));
         }
         ++word;
     } while (! done);
 
-    out << "\"";
+    put("\"");
 }
 
 void SpirvStream::disassembleInstruction(Id resultId, Id /*typeId*/, Op opCode, int numOperands)
 {
     // Process the opcode
 
-    out << (OpcodeString(opCode) + 2);  // leave out the "Op"
+    put(OpcodeString(opCode) + 2);  // leave out the "Op"
 
     if (opCode == OpLoopMerge || opCode == OpSelectionMerge)
         nextNestedControl = stream[word];
@@ -361,28 +451,31 @@ void SpirvStream::disassembleInstruction(Id resultId, Id /*typeId*/, Op opCode,
 
     // Handle images specially, so can put out helpful strings.
     if (opCode == OpTypeImage) {
-        out << " ";
+        put(" ");
         disassembleIds(1);
-        out << " " << DimensionString((Dim)stream[word++]);
-        out << (stream[word++] != 0 ? " depth" : "");
-        out << (stream[word++] != 0 ? " array" : "");
-        out << (stream[word++] != 0 ? " multi-sampled" : "");
+        put(" ");
+        put(DimensionString((Dim)stream[word++]));
+        put(stream[word++] != 0 ? " depth" : "");
+        put(stream[word++] != 0 ? " array" : "");
+        put(stream[word++] != 0 ? " multi-sampled" : "");
         switch (stream[word++]) {
-        case 0: out << " runtime";    break;
-        case 1: out << " sampled";    break;
-        case 2: out << " nonsampled"; break;
+        case 0: put(" runtime");    break;
+        case 1: put(" sampled");    break;
+        case 2: put(" nonsampled"); break;
         }
-        out << " format:" << ImageFormatString((ImageFormat)stream[word++]);
+        put(" format:");
+        put(ImageFormatString((ImageFormat)stream[word++]));
 
         if (numOperands == 8) {
-            out << " " << AccessQualifierString(stream[word++]);
+            put(" ");
+            put(AccessQualifierString(stream[word++]));
         }
         return;
     }
 
     // Handle all the parameterized operands
     for (int op = 0; op < InstructionDesc[opCode].operands.getNum() && numOperands > 0; ++op) {
-        out << " ";
+        put(" ");
         OperandClass operandClass = InstructionDesc[opCode].operands.getClass(op);
         switch (operandClass) {
         case OperandId:
@@ -406,34 +499,44 @@ void SpirvStream::disassembleInstruction(Id resultId, Id /*typeId*/, Op opCode,
         case OperandVariableLiterals:
             if (opCode == OpDecorate && stream[word - 1] == DecorationBuiltIn ||
                 opCode == OpMemberDecorate && stream[word - 1] == DecorationBuiltIn) {
-                out << BuiltInString(stream[word++]);
+                put(BuiltInString(stream[word++]));
                 --numOperands;
                 ++op;
+            } else if (opCode == OpDecorate && stream[word - 1] == DecorationLinkageAttributes && numOperands > 1) {
+                // the name, then the linkage type
+                int start = word;
+                disassembleString();
+                numOperands -= word - start;
+                if (numOperands > 0) {
+                    put(" ");
+                    put(OperandClassParams[OperandLinkageType].getName(stream[word++]));
+                    --numOperands;
+                }
             }
             disassembleImmediates(numOperands);
             return;
         case OperandVariableIdLiteral:
             while (numOperands > 0) {
-                out << std::endl;
+                put('\n');
                 outputResultId(0);
                 outputTypeId(0);
                 outputIndent();
-                out << "     Type ";
+                put("     Type ");
                 disassembleIds(1);
-                out << ", member ";
+                put(", member ");
                 disassembleImmediates(1);
                 numOperands -= 2;
             }
             return;
         case OperandVariableLiteralId:
             while (numOperands > 0) {
-                out << std::endl;
+                put('\n');
                 outputResultId(0);
                 outputTypeId(0);
                 outputIndent();
-                out << "     case ";
+                put("     case ");
                 disassembleImmediates(1);
-                out << ": ";
+                put(": ");
                 disassembleIds(1);
                 numOperands -= 2;
             }
@@ -448,7 +551,9 @@ void SpirvStream::disassembleInstruction(Id resultId, Id /*typeId*/, Op opCode,
                 unsigned entrypoint = stream[word - 1];
                 if (extInstSet == GLSL450Inst) {
                     if (entrypoint < spv::GLSLstd450Count) {
-                        out << "(" << GlslStd450DebugNames[entrypoint] << ")";
+                        put("(");
+                        put(GlslStd450DebugNames[entrypoint]);
+                        put(")");
                     }
                 }
             }
@@ -462,7 +567,7 @@ void SpirvStream::disassembleInstruction(Id resultId, Id /*typeId*/, Op opCode,
             if (OperandClassParams[operandClass].bitmask)
                 outputMask(operandClass, stream[word++]);
             else
-                out << OperandClassParams[operandClass].getName(stream[word++]);
+                put(OperandClassParams[operandClass].getName(stream[word++]));
 
             break;
         }
@@ -561,7 +666,18 @@ void GLSLstd450GetDebugNames(const char** names)
 
 void Disassemble(std::ostream& out, const std::vector<unsigned int>& stream)
 {
+    Parameterize();
+    SpirvStream SpirvStream(out, stream);
+    GLSLstd450GetDebugNames(GlslStd450DebugNames);
+    SpirvStream.validate();
+    SpirvStream.processInstructions();
+}
+
+void Disassemble(std::ostream& out, const std::vector<unsigned int>& stream, int firstFunction, int functionCount)
+{
+    Parameterize();
     SpirvStream SpirvStream(out, stream);
+    SpirvStream.setFunctions(firstFunction, firstFunction + functionCount);
     GLSLstd450GetDebugNames(GlslStd450DebugNames);
     SpirvStream.validate();
     SpirvStream.processInstructions();
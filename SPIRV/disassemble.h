@@ -51,6 +51,11 @@ namespace spv {
 
     void Disassemble(std::ostream& out, const std::vector<unsigned int>&);
 
+    // Disassemble just 'functionCount' functions, starting with 'firstFunction',
+    // counting from 0 in the order the module has them.  The module's header and
+    // declarations aren't shown, but still give the IDs their descriptions.
+    void Disassemble(std::ostream& out, const std::vector<unsigned int>&, int firstFunction, int functionCount);
+
 };  // end namespace spv
 
 #endif // disassembler_H
@@ -1100,14 +1100,8 @@ EnumParameters KernelProfilingInfoParams[KernelProfilingInfoCeiling];
 EnumParameters CapabilityParams[CapabilityCeiling];
 
 // Set up all the parameterizing descriptions of the opcodes, operands, etc.
-void Parameterize()
+static void ParameterizeOnce()
 {
-    // only do this once.
-    static bool initialized = false;
-    if (initialized)
-        return;
-    initialized = true;
-
     // Exceptions to having a result <id> and a resulting type <id>.
     // (Everything is initialized to have both).
 
@@ -2373,4 +2367,11 @@ void Parameterize()
     InstructionDesc[OpEnqueueMarker].operands.push(OperandId, "'Ret Event'");
 }
 
+// Only the first call, from whichever thread, does the work; the others wait for it.
+void Parameterize()
+{
+    static const bool initialized = (ParameterizeOnce(), true);
+    (void)initialized;
+}
+
 }; // end spv namespace
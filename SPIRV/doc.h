@@ -40,6 +40,9 @@
 // Parameterize the SPIR-V enumerants.
 //
 
+#ifndef spvDoc_H
+#define spvDoc_H
+
 #include "spirv.hpp"
 
 #include <vector>
@@ -256,3 +259,5 @@ const char* AccessQualifierString(int attr);
 void PrintOperands(const OperandParameters& operands, int reservedOperands);
 
 };  // end namespace spv
+
+#endif // spvDoc_H
@@ -45,6 +45,9 @@
 //      - Block, which is a list of 
 //        - Instruction
 //
+// All of a module's IR is allocated from the module's Arena, and is freed
+// with it, all at once, without running destructors.
+//
 
 #pragma once
 #ifndef spvIR_H
@@ -52,9 +55,13 @@
 
 #include "spirv.hpp"
 
+#include <algorithm>
 #include <vector>
 #include <iostream>
+#include <memory>
+#include <new>
 #include <assert.h>
+#include <string.h>
 
 namespace spv {
 
@@ -68,58 +75,198 @@ const unsigned int BadValue = 0xFFFFFFFF;
 const Decoration NoPrecision = (Decoration)BadValue;
 const MemorySemanticsMask MemorySemanticsAllMemory = (MemorySemanticsMask)0x3FF;
 
+//
+// Bump allocator for the IR of one module.  Memory is only given back by
+// destroying the arena, which frees everything allocated from it at once.
+//
+
+class Arena {
+public:
+    Arena() : next(nullptr), end(nullptr), numInstructions(0) { }
+    virtual ~Arena()
+    {
+        for (int c = 0; c < (int)chunks.size(); ++c)
+            ::operator delete(chunks[c]);
+    }
+
+    void* allocate(size_t bytes)
+    {
+        bytes = (bytes + alignment - 1) & ~(alignment - 1);
+        if (bytes > (size_t)(end - next)) {
+            // big requests get a chunk of their own, leaving the current one in use
+            if (bytes > chunkSize / 4) {
+                chunks.push_back((char*)::operator new(bytes));
+                return chunks.back();
+            }
+            chunks.push_back((char*)::operator new(chunkSize));
+            next = chunks.back();
+            end = next + chunkSize;
+        }
+        void* memory = next;
+        next += bytes;
+
+        return memory;
+    }
+
+    // allocate(), with the instructions counted, for ShCounterStats
+    void* allocateInstruction(size_t bytes)
+    {
+        ++numInstructions;
+        return allocate(bytes);
+    }
+    int getNumInstructions() const { return numInstructions; }
+
+protected:
+    Arena(const Arena&);
+    Arena& operator=(const Arena&);
+
+    static const size_t alignment = 16;
+    static const size_t chunkSize = 64 * 1024;
+    std::vector<char*> chunks;
+    char* next;
+    char* end;
+    int numInstructions;
+};
+
+// Lets standard containers of the IR allocate from an Arena; freeing is a no-op.
+template<class T> class ArenaAllocator {
+public:
+    typedef T value_type;
+
+    explicit ArenaAllocator(Arena& arena) : arena(&arena) { }
+    template<class U> ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) { }
+
+    T* allocate(size_t n) { return (T*)arena->allocate(n * sizeof(T)); }
+    void deallocate(T*, size_t) { }
+
+    template<class U> bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template<class U> bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+
+    Arena* arena;
+};
+
+//
+// Where a module's words go as they are made (see Builder::dump()): a file, a
+// hash, a network connection, ... without materializing the whole binary.
+//
+
+class WordSink {
+public:
+    virtual ~WordSink() { }
+    virtual void write(const unsigned int* words, size_t count) = 0;
+};
+
+//
+// What the IR dumps into: either memory already sized for all the words (see
+// getWordCount()), or a fixed buffer handed to a WordSink each time it fills.
+//
+
+class WordStream {
+public:
+    WordStream(unsigned int* memory, size_t size) : sink(nullptr), next(memory), end(memory + size) { }
+    explicit WordStream(WordSink& sink) : sink(&sink), next(buffer), end(buffer + bufferSize) { }
+    ~WordStream() { flush(); }
+
+    void put(unsigned int word)
+    {
+        if (next == end)
+            overflow();
+        *next++ = word;
+    }
+    void put(const unsigned int* words, int count)
+    {
+        while (count > 0) {
+            if (next == end)
+                overflow();
+            int n = std::min(count, (int)(end - next));
+            memcpy(next, words, n * sizeof(unsigned int));
+            next += n;
+            words += n;
+            count -= n;
+        }
+    }
+    // Hand what's buffered to the sink; memory needs no flushing.
+    void flush()
+    {
+        if (sink && next != buffer) {
+            sink->write(buffer, next - buffer);
+            next = buffer;
+        }
+    }
+
+protected:
+    WordStream(const WordStream&);
+    WordStream& operator=(const WordStream&);
+
+    void overflow()
+    {
+        // memory is sized by getWordCount(), so only a buffer fills up
+        assert(sink);
+        flush();
+    }
+
+    static const int bufferSize = 4096;
+
+    WordSink* sink;
+    unsigned int* next;
+    unsigned int* end;
+    unsigned int buffer[bufferSize];
+};
+
 //
 // SPIR-V IR instruction.
 //
+// The first few operands are held inline; longer operand lists and string
+// operands go to the arena given at construction, or the heap without one.
+// Make instructions of a module with new(arena) and that module's arena.
+//
 
 class Instruction {
 public:
-    Instruction(Id resultId, Id typeId, Op opCode) : resultId(resultId), typeId(typeId), opCode(opCode), string(0) { }
-    explicit Instruction(Op opCode) : resultId(NoResult), typeId(NoType), opCode(opCode), string(0) { }
+    Instruction(Id resultId, Id typeId, Op opCode, Arena* arena = nullptr) :
+        resultId(resultId), typeId(typeId), opCode(opCode), operands(inlineOperands), numOperands(0),
+        capacity(numInlineOperands), string(nullptr), numStringWords(0), arena(arena) { }
+    explicit Instruction(Op opCode, Arena* arena = nullptr) :
+        resultId(NoResult), typeId(NoType), opCode(opCode), operands(inlineOperands), numOperands(0),
+        capacity(numInlineOperands), string(nullptr), numStringWords(0), arena(arena) { }
     virtual ~Instruction()
     {
-        delete string;
+        if (! arena) {
+            if (operands != inlineOperands)
+                delete [] operands;
+            delete [] string;
+        }
     }
-    void addIdOperand(Id id) { operands.push_back(id); }
-    void addImmediateOperand(unsigned int immediate) { operands.push_back(immediate); }
+    static void* operator new(size_t size, Arena& arena) { return arena.allocateInstruction(size); }
+    static void operator delete(void*, Arena&) { }
+    static void* operator new(size_t size) { return ::operator new(size); }
+    static void operator delete(void* memory) { ::operator delete(memory); }
+
+    void addIdOperand(Id id) { addOperand(id); }
+    void addImmediateOperand(unsigned int immediate) { addOperand(immediate); }
     void addStringOperand(const char* str)
     {
-        originalString = str;
-        string = new std::vector<unsigned int>;
-        unsigned int word;
-        char* wordString = (char*)&word;
-        char* wordPtr = wordString;
-        int charCount = 0;
-        char c;
-        do {
-            c = *(str++);
-            *(wordPtr++) = c;
-            ++charCount;
-            if (charCount == 4) {
-                string->push_back(word);
-                wordPtr = wordString;
-                charCount = 0;
-            }
-        } while (c != 0);
-
-        // deal with partial last word
-        if (charCount > 0) {
-            // pad with 0s
-            for (; charCount < 4; ++charCount)
-                *(wordPtr++) = 0;
-            string->push_back(word);
-        }
+        // nul terminated, padded with 0s to whole words
+        size_t length = strlen(str) + 1;
+        numStringWords = (int)((length + 3) / 4);
+        string = allocateWords(numStringWords);
+        string[numStringWords - 1] = 0;
+        memcpy(string, str, length);
     }
+    void setResultId(Id id) { resultId = id; }
+    void setTypeId(Id id) { typeId = id; }
+    void setIdOperand(int op, Id id) { operands[op] = id; }
     Op getOpCode() const { return opCode; }
-    int getNumOperands() const { return (int)operands.size(); }
+    int getNumOperands() const { return numOperands; }
     Id getResultId() const { return resultId; }
     Id getTypeId() const { return typeId; }
     Id getIdOperand(int op) const { return operands[op]; }
     unsigned int getImmediateOperand(int op) const { return operands[op]; }
-    const char* getStringOperand() const { return originalString.c_str(); }
+    const unsigned int* getOperands() const { return operands; }
+    const char* getStringOperand() const { return string ? (const char*)string : ""; }
     void rewriteOperands(Id oldOperand, Id newOperand)
     {
-        for(auto i = 0u; i < operands.size(); ++i)
+        for(auto i = 0u; i < (unsigned)numOperands; ++i)
         {
             rewriteOperand(oldOperand, newOperand, i);
         }
@@ -130,57 +277,81 @@ public:
             operands[index] = newOperand;
     }
 
-    // Write out the binary form.
-    void dump(std::vector<unsigned int>& out) const
+    // Number of words in the binary form.
+    size_t getWordCount() const
     {
-        // Compute the wordCount
-        unsigned int wordCount = 1;
+        size_t wordCount = 1;
         if (typeId)
             ++wordCount;
         if (resultId)
             ++wordCount;
-        wordCount += (unsigned int)operands.size();
-        if (string)
-            wordCount += (unsigned int)string->size();
+        return wordCount + numOperands + numStringWords;
+    }
 
+    // Write out the binary form.
+    void dump(WordStream& out) const
+    {
         // Write out the beginning of the instruction
-        out.push_back(((wordCount) << WordCountShift) | opCode);
+        out.put(((unsigned int)getWordCount() << WordCountShift) | opCode);
         if (typeId)
-            out.push_back(typeId);
+            out.put(typeId);
         if (resultId)
-            out.push_back(resultId);
+            out.put(resultId);
 
         // Write out the operands
-        for (int op = 0; op < (int)operands.size(); ++op)
-            out.push_back(operands[op]);
-        if (string)
-            for (int op = 0; op < (int)string->size(); ++op)
-                out.push_back((*string)[op]);
+        out.put(operands, numOperands);
+        out.put(string, numStringWords);
     }
 
 protected:
     Instruction(const Instruction&);
+    Instruction& operator=(const Instruction&);
+
+    unsigned int* allocateWords(int count)
+    {
+        return arena ? (unsigned int*)arena->allocate(count * sizeof(unsigned int)) : new unsigned int[count];
+    }
+    void addOperand(unsigned int word)
+    {
+        if (numOperands == capacity) {
+            unsigned int* grown = allocateWords(2 * capacity);
+            memcpy(grown, operands, numOperands * sizeof(unsigned int));
+            if (! arena && operands != inlineOperands)
+                delete [] operands;
+            operands = grown;
+            capacity *= 2;
+        }
+        operands[numOperands++] = word;
+    }
+
+    static const int numInlineOperands = 4;
+
     Id resultId;
     Id typeId;
     Op opCode;
-    std::vector<Id> operands;
-    std::vector<unsigned int>* string; // usually non-existent
-    std::string originalString;        // could be optimized away; convenience for getting string operand
+    Id* operands;              // inlineOperands, until there are more
+    int numOperands;
+    int capacity;
+    Id inlineOperands[numInlineOperands];
+    unsigned int* string;      // usually non-existent
+    int numStringWords;
+    Arena* arena;
 };
 
 //
-// SPIR-V IR block.
+// SPIR-V IR block.  Make blocks with new(arena), using the arena of the function
+// (see Function::getArena()).
 //
 
 class Block {
-  using Instructions = std::vector<Instruction*>;
+  using Instructions = std::vector<Instruction*, ArenaAllocator<Instruction*> >;
 
 public:
     Block(Id id, Function& parent);
-    virtual ~Block()
-    {
-        // TODO: free instructions
-    }
+    virtual ~Block() { }
+    static void* operator new(size_t size, Arena& arena) { return arena.allocate(size); }
+    static void operator delete(void*, Arena&) { }
+    static void operator delete(void*) { }     // the arena frees it
     
     Id getId() { return instructions.front()->getResultId(); }
 
@@ -194,6 +365,13 @@ public:
     void addPredecessor(Block* pred) { predecessors.push_back(pred); }
     void addSuccessor(Block* succ) { successors.push_back(succ); }
     void addLocalVariable(Instruction* inst) { localVariables.push_back(inst); }
+    // Remove the local variables and instructions 'remove' is true for.
+    template<class Remove> void removeInstructions(Remove remove)
+    {
+        localVariables.erase(std::remove_if(localVariables.begin(), localVariables.end(), remove), localVariables.end());
+        instructions.erase(std::remove_if(instructions.begin(), instructions.end(), remove), instructions.end());
+    }
+    const std::vector<Instruction*, ArenaAllocator<Instruction*> >& getLocalVariables() const { return localVariables; }
     int getNumPredecessors() const { return (int)predecessors.size(); }
     int getNumSuccessors() const { return (int)successors.size(); }
     int getNumInstructions() const { return (int)instructions.size(); }
@@ -230,12 +408,27 @@ public:
         }
     }
 
-    void dump(std::vector<unsigned int>& out) const
+    // skip the degenerate unreachable blocks
+    // TODO: code gen: skip all unreachable blocks (transitive closure)
+    //                 (but, until that's done safer to keep non-degenerate unreachable blocks, in case others depend on something)
+    bool isDumped() const { return ! unreachable || instructions.size() > 2; }
+
+    size_t getWordCount() const
     {
-        // skip the degenerate unreachable blocks
-        // TODO: code gen: skip all unreachable blocks (transitive closure)
-        //                 (but, until that's done safer to keep non-degenerate unreachable blocks, in case others depend on something)
-        if (unreachable && instructions.size() <= 2)
+        if (! isDumped())
+            return 0;
+
+        size_t wordCount = 0;
+        for (int i = 0; i < (int)localVariables.size(); ++i)
+            wordCount += localVariables[i]->getWordCount();
+        for (int i = 0; i < (int)instructions.size(); ++i)
+            wordCount += instructions[i]->getWordCount();
+        return wordCount;
+    }
+
+    void dump(WordStream& out) const
+    {
+        if (! isDumped())
             return;
 
         instructions[0]->dump(out);
@@ -253,9 +446,9 @@ protected:
     friend Function;
 
     Instructions instructions;
-    std::vector<Block*> predecessors;
-    std::vector<Block*> successors;
-    std::vector<Instruction*> localVariables;
+    std::vector<Block*, ArenaAllocator<Block*> > predecessors;
+    std::vector<Block*, ArenaAllocator<Block*> > successors;
+    std::vector<Instruction*, ArenaAllocator<Instruction*> > localVariables;
     Function& parent;
 
     // track whether this block is known to be uncreachable (not necessarily 
@@ -265,32 +458,61 @@ protected:
 };
 
 //
-// SPIR-V IR Function.
+// SPIR-V IR Function.  Make functions with new(arena), using the module's arena.
+// The blocks go in 'blockArena' if given, so they can be let go of before the
+// module, once streamed (see Module::streamFunction()).
 //
 
 class Function {
 public:
-    Function(Id id, Id resultType, Id functionType, Id firstParam, Module& parent);
-    virtual ~Function()
-    {
-        for (int i = 0; i < (int)parameterInstructions.size(); ++i)
-            delete parameterInstructions[i];
+    Function(Id id, Id resultType, Id functionType, Id firstParam, Module& parent, Arena* blockArena = nullptr);
+    virtual ~Function() { }
+    static void* operator new(size_t size, Arena& arena) { return arena.allocate(size); }
+    static void operator delete(void*, Arena&) { }
+    static void operator delete(void*) { }     // the arena frees it
 
-        for (int i = 0; i < (int)blocks.size(); ++i)
-            delete blocks[i];
-    }
     Id getId() const { return functionInstruction.getResultId(); }
-    Id getParamId(int p) { return parameterInstructions[p]->getResultId(); }
+    Id getParamId(int p) const { return parameterInstructions[p]->getResultId(); }
 
     void addBlock(Block* block) { blocks.push_back(block); }
     void popBlock(Block*) { blocks.pop_back(); }
 
-    Module& getParent() const { return parent; }
+    Module& getParent() const { return *parent; }
+    void setParent(Module& module) { parent = &module; }
     Block* getEntryBlock() const { return blocks.front(); }
     Block* getLastBlock() const { return blocks.back(); }
     void addLocalVariable(Instruction* inst);
     Id getReturnType() const { return functionInstruction.getTypeId(); }
-    void dump(std::vector<unsigned int>& out) const
+    Id getFunctionType() const { return functionInstruction.getIdOperand(1); }
+    int getNumParameters() const { return (int)parameterInstructions.size(); }
+    const std::vector<Block*, ArenaAllocator<Block*> >& getBlocks() const { return blocks; }
+    // Where the blocks, and the instructions made for them, are allocated.
+    Arena& getArena() const { return *blockArena; }
+
+    // Whether the function is words already, with no blocks left.
+    bool isStreamed() const { return streamed; }
+    void setStreamed(size_t start, size_t count)
+    {
+        blocks.clear();
+        streamed = true;
+        streamedStart = start;
+        streamedWordCount = count;
+    }
+
+    size_t getWordCount() const
+    {
+        if (streamed)
+            return streamedWordCount;
+
+        size_t wordCount = functionInstruction.getWordCount();
+        for (int p = 0; p < (int)parameterInstructions.size(); ++p)
+            wordCount += parameterInstructions[p]->getWordCount();
+        for (int b = 0; b < (int)blocks.size(); ++b)
+            wordCount += blocks[b]->getWordCount();
+        return wordCount + 1;  // OpFunctionEnd
+    }
+    void dump(WordStream& out) const;
+    void dumpIR(WordStream& out) const
     {
         // OpFunction
         functionInstruction.dump(out);
@@ -302,18 +524,21 @@ public:
         // Blocks
         for (int b = 0; b < (int)blocks.size(); ++b)
             blocks[b]->dump(out);
-        Instruction end(0, 0, OpFunctionEnd);
-        end.dump(out);
+        out.put((1 << WordCountShift) | OpFunctionEnd);
     }
 
 protected:
     Function(const Function&);
     Function& operator=(Function&);
 
-    Module& parent;
+    Module* parent;
     Instruction functionInstruction;
-    std::vector<Instruction*> parameterInstructions;
-    std::vector<Block*> blocks;
+    std::vector<Instruction*, ArenaAllocator<Instruction*> > parameterInstructions;
+    std::vector<Block*, ArenaAllocator<Block*> > blocks;
+    Arena* blockArena;
+    bool streamed;
+    size_t streamedStart;      // of its words in the module's streamed words
+    size_t streamedWordCount;
 };
 
 //
@@ -322,29 +547,82 @@ protected:
 
 class Module {
 public:
-    Module() {}
+    Module() : arena(new Arena), parent(nullptr), firstId(0), streamedInstructions(0) {}
+    // A fork (see Builder) seeing 'parent's instructions, and numbering its own from 'firstId'.
+    Module(const Module& parent, Id firstId) : arena(new Arena), parent(&parent), firstId(firstId), streamedInstructions(0) {}
     Module(Module&&) = default;
     Module& operator=(Module&&) = default;
     virtual ~Module()
     {
-        // TODO delete things
+        // the arena frees the functions, blocks, and instructions
     }
 
+    // Held by pointer, so the IR's references to it survive moving the module.
+    Arena& getArena() const { return *arena; }
+
     void addFunction(Function *fun) { functions.push_back(fun); }
+    const std::vector<Function*>& getFunctions() const { return functions; }
+
+    // Put 'body' in place of the function having its id.
+    void replaceFunction(Function* body);
+
+    // Keep a joined fork's IR (see Builder::join()) for as long as this module.
+    void adoptArena(Module& fork) { adoptedArenas.push_back(std::move(fork.arena)); }
+
+    // An arena for the blocks of one function, kept until the function is streamed.
+    Arena& makeBlockArena()
+    {
+        blockArenas.push_back(std::unique_ptr<Arena>(new Arena));
+        return *blockArenas.back();
+    }
+
+    // Dump 'function', which must have been made with a block arena, to words
+    // held by the module in its place, and free its blocks and their
+    // instructions.  Then the IR of the whole module is never held at once.
+    void streamFunction(Function& function);
+    const std::vector<unsigned int>& getStreamedWords() const { return streamedWords; }
+
+    // Instructions made in the arena, and in those of joined forks and functions.
+    int getNumInstructions() const
+    {
+        int count = arena->getNumInstructions() + streamedInstructions;
+        for (size_t a = 0; a < adoptedArenas.size(); ++a)
+            count += adoptedArenas[a]->getNumInstructions();
+        for (size_t a = 0; a < blockArenas.size(); ++a)
+            count += blockArenas[a]->getNumInstructions();
+        return count;
+    }
 
     void mapInstruction(Instruction *instruction)
     {
         spv::Id resultId = instruction->getResultId();
-        // map the instruction's result id
+        if (resultId < firstId)
+            return;  // the parent's
+        resultId -= firstId;
+        // map the instruction's result id, growing geometrically
         if (resultId >= idToInstruction.size())
-            idToInstruction.resize(resultId + 16);
+            idToInstruction.resize(std::max<size_t>(resultId + 16, 2 * idToInstruction.size()));
         idToInstruction[resultId] = instruction;
     }
 
-    Instruction* getInstruction(Id id) const { return idToInstruction[id]; }
-    spv::Id getTypeId(Id resultId) const { return idToInstruction[resultId]->getTypeId(); }
-    StorageClass getStorageClass(Id typeId) const { return (StorageClass)idToInstruction[typeId]->getImmediateOperand(0); }
-    void dump(std::vector<unsigned int>& out) const
+    Instruction* getInstruction(Id id) const { return id < firstId ? parent->getInstruction(id) : idToInstruction[id - firstId]; }
+    // As getInstruction(), but null for an id with no instruction.
+    Instruction* findInstruction(Id id) const
+    {
+        if (id < firstId)
+            return parent->findInstruction(id);
+        return id - firstId < idToInstruction.size() ? idToInstruction[id - firstId] : nullptr;
+    }
+    spv::Id getTypeId(Id resultId) const { return getInstruction(resultId)->getTypeId(); }
+    StorageClass getStorageClass(Id typeId) const { return (StorageClass)getInstruction(typeId)->getImmediateOperand(0); }
+    size_t getWordCount() const
+    {
+        size_t wordCount = 0;
+        for (int f = 0; f < (int)functions.size(); ++f)
+            wordCount += functions[f]->getWordCount();
+        return wordCount;
+    }
+    void dump(WordStream& out) const
     {
         for (int f = 0; f < (int)functions.size(); ++f)
             functions[f]->dump(out);
@@ -352,7 +630,14 @@ public:
 
 protected:
     Module(const Module&);
+    std::unique_ptr<Arena> arena;
+    std::vector<std::unique_ptr<Arena> > adoptedArenas;
+    std::vector<std::unique_ptr<Arena> > blockArenas;   // of functions not yet streamed
     std::vector<Function*> functions;
+    const Module* parent;      // of a fork
+    Id firstId;                // of a fork's own ids
+    std::vector<unsigned int> streamedWords;  // of the streamed functions, in the order streamed
+    int streamedInstructions;  // made in the block arenas since freed
 
     // map from result id to instruction having that result id
     std::vector<Instruction*> idToInstruction;
@@ -367,8 +652,11 @@ protected:
 // Add both
 // - the OpFunction instruction
 // - all the OpFunctionParameter instructions
-__inline Function::Function(Id id, Id resultType, Id functionType, Id firstParamId, Module& parent)
-    : parent(parent), functionInstruction(id, resultType, OpFunction)
+__inline Function::Function(Id id, Id resultType, Id functionType, Id firstParamId, Module& parent, Arena* blockArena)
+    : parent(&parent), functionInstruction(id, resultType, OpFunction, &parent.getArena()),
+      parameterInstructions(ArenaAllocator<Instruction*>(parent.getArena())),
+      blocks(ArenaAllocator<Block*>(parent.getArena())),
+      blockArena(blockArena ? blockArena : &parent.getArena()), streamed(false), streamedStart(0), streamedWordCount(0)
 {
     // OpFunction
     functionInstruction.addImmediateOperand(FunctionControlMaskNone);
@@ -380,21 +668,76 @@ __inline Function::Function(Id id, Id resultType, Id functionType, Id firstParam
     Instruction* typeInst = parent.getInstruction(functionType);
     int numParams = typeInst->getNumOperands() - 1;
     for (int p = 0; p < numParams; ++p) {
-        Instruction* param = new Instruction(firstParamId + p, typeInst->getIdOperand(p + 1), OpFunctionParameter);
+        Instruction* param = new(parent.getArena()) Instruction(firstParamId + p, typeInst->getIdOperand(p + 1),
+                                                                OpFunctionParameter, &parent.getArena());
         parent.mapInstruction(param);
         parameterInstructions.push_back(param);
     }
 }
 
+__inline void Function::dump(WordStream& out) const
+{
+    if (streamed)
+        out.put(parent->getStreamedWords().data() + streamedStart, (int)streamedWordCount);
+    else
+        dumpIR(out);
+}
+
+__inline void Module::streamFunction(Function& function)
+{
+    const size_t start = streamedWords.size();
+    const size_t count = function.getWordCount();
+    streamedWords.resize(start + count);
+    {
+        WordStream out(streamedWords.data() + start, count);
+        function.dumpIR(out);
+    }
+
+    // nothing can look up what's about to be freed
+    const auto unmap = [this](const Instruction* instruction) {
+        const Id id = instruction->getResultId();
+        if (id >= firstId && id - firstId < idToInstruction.size() && idToInstruction[id - firstId] == instruction)
+            idToInstruction[id - firstId] = nullptr;
+    };
+    for (const Block* block : function.getBlocks()) {
+        std::for_each(block->getLocalVariables().begin(), block->getLocalVariables().end(), unmap);
+        std::for_each(block->begin(), block->end(), unmap);
+    }
+
+    function.setStreamed(start, count);
+    for (size_t a = 0; a < blockArenas.size(); ++a) {
+        if (blockArenas[a].get() == &function.getArena()) {
+            streamedInstructions += blockArenas[a]->getNumInstructions();
+            blockArenas.erase(blockArenas.begin() + a);
+            break;
+        }
+    }
+}
+
+__inline void Module::replaceFunction(Function* body)
+{
+    for (int f = 0; f < (int)functions.size(); ++f) {
+        if (functions[f]->getId() == body->getId())
+            functions[f] = body;
+    }
+    body->setParent(*this);
+}
+
 __inline void Function::addLocalVariable(Instruction* inst)
 {
     blocks[0]->addLocalVariable(inst);
-    parent.mapInstruction(inst);
+    parent->mapInstruction(inst);
 }
 
-__inline Block::Block(Id id, Function& parent) : parent(parent), unreachable(false)
+__inline Block::Block(Id id, Function& parent) :
+    instructions(ArenaAllocator<Instruction*>(parent.getArena())),
+    predecessors(ArenaAllocator<Block*>(parent.getArena())),
+    successors(ArenaAllocator<Block*>(parent.getArena())),
+    localVariables(ArenaAllocator<Instruction*>(parent.getArena())),
+    parent(parent), unreachable(false)
 {
-    instructions.push_back(new Instruction(id, NoType, OpLabel));
+    Arena& arena = parent.getArena();
+    instructions.push_back(new(arena) Instruction(id, NoType, OpLabel, &arena));
 }
 
 __inline void Block::addInstruction(Instruction* inst)
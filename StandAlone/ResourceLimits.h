@@ -0,0 +1,60 @@
+//
+//Copyright (C) 2002-2005  3Dlabs Inc. Ltd.
+//Copyright (C) 2013 LunarG, Inc.
+//
+//All rights reserved.
+//
+//Redistribution and use in source and binary forms, with or without
+//modification, are permitted provided that the following conditions
+//are met:
+//
+//    Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+//    Redistributions in binary form must reproduce the above
+//    copyright notice, this list of conditions and the following
+//    disclaimer in the documentation and/or other materials provided
+//    with the distribution.
+//
+//    Neither the name of 3Dlabs Inc. Ltd. nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+//THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+//FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+//COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+//BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+//LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+//ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//POSSIBILITY OF SUCH DAMAGE.
+//
+
+//
+// The resource limits of the stand-alone tools, as "<name> <value>" pairs in
+// the format of a glslangValidator .conf file.
+//
+
+#ifndef STANDALONE_RESOURCE_LIMITS_H_INCLUDED
+#define STANDALONE_RESOURCE_LIMITS_H_INCLUDED
+
+#include "../glslang/Include/ResourceLimits.h"
+
+namespace glslang {
+
+// The limits used when no .conf file is given, which is also the template
+// printed by glslangValidator -c.
+extern const char* const DefaultConfig;
+
+// Set the limits named in 'config' in 'resources', leaving the others as they
+// are.  'config' is overwritten.  Returns false, after reporting it, if a name
+// isn't followed by a number; an unknown name is only warned about.
+bool DecodeResourceLimits(TBuiltInResource* resources, char* config);
+
+} // end namespace glslang
+
+#endif // STANDALONE_RESOURCE_LIMITS_H_INCLUDED
@@ -37,17 +37,31 @@
 // this only applies to the standalone wrapper, not the front end in general
 #define _CRT_SECURE_NO_WARNINGS
 
+#include "ResourceLimits.h"
 #include "Worklist.h"
 #include "./../glslang/Include/ShHandle.h"
 #include "./../glslang/Include/revision.h"
 #include "./../glslang/Public/ShaderLang.h"
+#include "./../glslang/MachineIndependent/reflection.h"
 #include "../SPIRV/GlslangToSpv.h"
 #include "../SPIRV/GLSL.std.450.h"
 #include "../SPIRV/doc.h"
 #include "../SPIRV/disassemble.h"
+#include "../SPIRV/SpvCache.h"
+#include "../SPIRV/SpvReflection.h"
+#include "../SPIRV/SPVRemapper.h"
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
+#include <limits.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
 
 #include "osinclude.h"
 
@@ -74,6 +88,19 @@ enum TOptions {
     EOptionVulkanRules        = 0x2000,
     EOptionDefaultDesktop     = 0x4000,
     EOptionOutputPreprocessed = 0x8000,
+    EOptionTiming             = 0x10000,
+    EOptionTimingJson         = 0x20000,
+    EOptionOptimizeSpv        = 0x40000,
+    EOptionLibrary            = 0x80000,
+    EOptionRemapSpv           = 0x100000,
+    EOptionServer             = 0x200000,
+    EOptionSkipUnchanged      = 0x400000,
+    EOptionTrimInterface      = 0x800000,
+    EOptionInline             = 0x1000000,
+    EOptionCounters           = 0x2000000,
+    EOptionStreamFunctions    = 0x4000000,
+    EOptionMediump16          = 0x8000000,
+    EOptionNuma               = 0x10000000,
 };
 
 //
@@ -93,10 +120,13 @@ enum TFailCode {
 // Forward declarations.
 //
 EShLanguage FindLanguage(const std::string& name);
+bool FindStage(const std::string& name, EShLanguage& stage);
 void CompileFile(const char* fileName, ShHandle);
 void usage();
 void FreeFileData(char** data);
 char** ReadFileData(const char* fileName);
+const char* MapFileData(const char* fileName, int& length);
+void UnmapFileData(const char* data, int length);
 void InfoLogMsg(const char* msg, const char* name, const int num);
 
 // Globally track if any compile or link failure.
@@ -111,108 +141,7 @@ TBuiltInResource Resources;
 std::string ConfigFile;
 
 //
-// These are the default resources for TBuiltInResources, used for both
-//  - parsing this string for the case where the user didn't supply one
-//  - dumping out a template for user construction of a config file
-//
-const char* DefaultConfig =
-    "MaxLights 32\n"
-    "MaxClipPlanes 6\n"
-    "MaxTextureUnits 32\n"
-    "MaxTextureCoords 32\n"
-    "MaxVertexAttribs 64\n"
-    "MaxVertexUniformComponents 4096\n"
-    "MaxVaryingFloats 64\n"
-    "MaxVertexTextureImageUnits 32\n"
-    "MaxCombinedTextureImageUnits 80\n"
-    "MaxTextureImageUnits 32\n"
-    "MaxFragmentUniformComponents 4096\n"
-    "MaxDrawBuffers 32\n"
-    "MaxVertexUniformVectors 128\n"
-    "MaxVaryingVectors 8\n"
-    "MaxFragmentUniformVectors 16\n"
-    "MaxVertexOutputVectors 16\n"
-    "MaxFragmentInputVectors 15\n"
-    "MinProgramTexelOffset -8\n"
-    "MaxProgramTexelOffset 7\n"
-    "MaxClipDistances 8\n"
-    "MaxComputeWorkGroupCountX 65535\n"
-    "MaxComputeWorkGroupCountY 65535\n"
-    "MaxComputeWorkGroupCountZ 65535\n"
-    "MaxComputeWorkGroupSizeX 1024\n"
-    "MaxComputeWorkGroupSizeY 1024\n"
-    "MaxComputeWorkGroupSizeZ 64\n"
-    "MaxComputeUniformComponents 1024\n"
-    "MaxComputeTextureImageUnits 16\n"
-    "MaxComputeImageUniforms 8\n"
-    "MaxComputeAtomicCounters 8\n"
-    "MaxComputeAtomicCounterBuffers 1\n"
-    "MaxVaryingComponents 60\n" 
-    "MaxVertexOutputComponents 64\n"
-    "MaxGeometryInputComponents 64\n"
-    "MaxGeometryOutputComponents 128\n"
-    "MaxFragmentInputComponents 128\n"
-    "MaxImageUnits 8\n"
-    "MaxCombinedImageUnitsAndFragmentOutputs 8\n"
-    "MaxCombinedShaderOutputResources 8\n"
-    "MaxImageSamples 0\n"
-    "MaxVertexImageUniforms 0\n"
-    "MaxTessControlImageUniforms 0\n"
-    "MaxTessEvaluationImageUniforms 0\n"
-    "MaxGeometryImageUniforms 0\n"
-    "MaxFragmentImageUniforms 8\n"
-    "MaxCombinedImageUniforms 8\n"
-    "MaxGeometryTextureImageUnits 16\n"
-    "MaxGeometryOutputVertices 256\n"
-    "MaxGeometryTotalOutputComponents 1024\n"
-    "MaxGeometryUniformComponents 1024\n"
-    "MaxGeometryVaryingComponents 64\n"
-    "MaxTessControlInputComponents 128\n"
-    "MaxTessControlOutputComponents 128\n"
-    "MaxTessControlTextureImageUnits 16\n"
-    "MaxTessControlUniformComponents 1024\n"
-    "MaxTessControlTotalOutputComponents 4096\n"
-    "MaxTessEvaluationInputComponents 128\n"
-    "MaxTessEvaluationOutputComponents 128\n"
-    "MaxTessEvaluationTextureImageUnits 16\n"
-    "MaxTessEvaluationUniformComponents 1024\n"
-    "MaxTessPatchComponents 120\n"
-    "MaxPatchVertices 32\n"
-    "MaxTessGenLevel 64\n"
-    "MaxViewports 16\n"
-    "MaxVertexAtomicCounters 0\n"
-    "MaxTessControlAtomicCounters 0\n"
-    "MaxTessEvaluationAtomicCounters 0\n"
-    "MaxGeometryAtomicCounters 0\n"
-    "MaxFragmentAtomicCounters 8\n"
-    "MaxCombinedAtomicCounters 8\n"
-    "MaxAtomicCounterBindings 1\n"
-    "MaxVertexAtomicCounterBuffers 0\n"
-    "MaxTessControlAtomicCounterBuffers 0\n"
-    "MaxTessEvaluationAtomicCounterBuffers 0\n"
-    "MaxGeometryAtomicCounterBuffers 0\n"
-    "MaxFragmentAtomicCounterBuffers 1\n"
-    "MaxCombinedAtomicCounterBuffers 1\n"
-    "MaxAtomicCounterBufferSize 16384\n"
-    "MaxTransformFeedbackBuffers 4\n"
-    "MaxTransformFeedbackInterleavedComponents 64\n"
-    "MaxCullDistances 8\n"
-    "MaxCombinedClipAndCullDistances 8\n"
-    "MaxSamples 4\n"
-
-    "nonInductiveForLoops 1\n"
-    "whileLoops 1\n"
-    "doWhileLoops 1\n"
-    "generalUniformIndexing 1\n"
-    "generalAttributeMatrixVectorIndexing 1\n"
-    "generalVaryingIndexing 1\n"
-    "generalSamplerIndexing 1\n"
-    "generalVariableIndexing 1\n"
-    "generalConstantMatrixVectorIndexing 1\n"
-    ;
-
-//
-// Parse either a .conf file provided by the user or the default string above.
+// Parse either a .conf file provided by the user or the default configuration.
 //
 void ProcessConfigFile()
 {
@@ -229,210 +158,12 @@ void ProcessConfigFile()
     }
 
     if (config == 0) {
-        config = new char[strlen(DefaultConfig) + 1];
-        strcpy(config, DefaultConfig);
+        config = new char[strlen(glslang::DefaultConfig) + 1];
+        strcpy(config, glslang::DefaultConfig);
     }
 
-    const char* delims = " \t\n\r";
-    const char* token = strtok(config, delims);
-    while (token) {
-        const char* valueStr = strtok(0, delims);
-        if (valueStr == 0 || ! (valueStr[0] == '-' || (valueStr[0] >= '0' && valueStr[0] <= '9'))) {
-            printf("Error: '%s' bad .conf file.  Each name must be followed by one number.\n", valueStr ? valueStr : "");
-            return;
-        }
-        int value = atoi(valueStr);
-
-        if (strcmp(token, "MaxLights") == 0)
-            Resources.maxLights = value;
-        else if (strcmp(token, "MaxClipPlanes") == 0)
-            Resources.maxClipPlanes = value;
-        else if (strcmp(token, "MaxTextureUnits") == 0)
-            Resources.maxTextureUnits = value;
-        else if (strcmp(token, "MaxTextureCoords") == 0)
-            Resources.maxTextureCoords = value;
-        else if (strcmp(token, "MaxVertexAttribs") == 0)
-            Resources.maxVertexAttribs = value;
-        else if (strcmp(token, "MaxVertexUniformComponents") == 0)
-            Resources.maxVertexUniformComponents = value;
-        else if (strcmp(token, "MaxVaryingFloats") == 0)
-            Resources.maxVaryingFloats = value;
-        else if (strcmp(token, "MaxVertexTextureImageUnits") == 0)
-            Resources.maxVertexTextureImageUnits = value;
-        else if (strcmp(token, "MaxCombinedTextureImageUnits") == 0)
-            Resources.maxCombinedTextureImageUnits = value;
-        else if (strcmp(token, "MaxTextureImageUnits") == 0)
-            Resources.maxTextureImageUnits = value;
-        else if (strcmp(token, "MaxFragmentUniformComponents") == 0)
-            Resources.maxFragmentUniformComponents = value;
-        else if (strcmp(token, "MaxDrawBuffers") == 0)
-            Resources.maxDrawBuffers = value;
-        else if (strcmp(token, "MaxVertexUniformVectors") == 0)
-            Resources.maxVertexUniformVectors = value;
-        else if (strcmp(token, "MaxVaryingVectors") == 0)
-            Resources.maxVaryingVectors = value;
-        else if (strcmp(token, "MaxFragmentUniformVectors") == 0)
-            Resources.maxFragmentUniformVectors = value;
-        else if (strcmp(token, "MaxVertexOutputVectors") == 0)
-            Resources.maxVertexOutputVectors = value;
-        else if (strcmp(token, "MaxFragmentInputVectors") == 0)
-            Resources.maxFragmentInputVectors = value;
-        else if (strcmp(token, "MinProgramTexelOffset") == 0)
-            Resources.minProgramTexelOffset = value;
-        else if (strcmp(token, "MaxProgramTexelOffset") == 0)
-            Resources.maxProgramTexelOffset = value;
-        else if (strcmp(token, "MaxClipDistances") == 0)
-            Resources.maxClipDistances = value;
-        else if (strcmp(token, "MaxComputeWorkGroupCountX") == 0)
-            Resources.maxComputeWorkGroupCountX = value;
-        else if (strcmp(token, "MaxComputeWorkGroupCountY") == 0)
-            Resources.maxComputeWorkGroupCountY = value;
-        else if (strcmp(token, "MaxComputeWorkGroupCountZ") == 0)
-            Resources.maxComputeWorkGroupCountZ = value;
-        else if (strcmp(token, "MaxComputeWorkGroupSizeX") == 0)
-            Resources.maxComputeWorkGroupSizeX = value;
-        else if (strcmp(token, "MaxComputeWorkGroupSizeY") == 0)
-            Resources.maxComputeWorkGroupSizeY = value;
-        else if (strcmp(token, "MaxComputeWorkGroupSizeZ") == 0)
-            Resources.maxComputeWorkGroupSizeZ = value;
-        else if (strcmp(token, "MaxComputeUniformComponents") == 0)
-            Resources.maxComputeUniformComponents = value;
-        else if (strcmp(token, "MaxComputeTextureImageUnits") == 0)
-            Resources.maxComputeTextureImageUnits = value;
-        else if (strcmp(token, "MaxComputeImageUniforms") == 0)
-            Resources.maxComputeImageUniforms = value;
-        else if (strcmp(token, "MaxComputeAtomicCounters") == 0)
-            Resources.maxComputeAtomicCounters = value;
-        else if (strcmp(token, "MaxComputeAtomicCounterBuffers") == 0)
-            Resources.maxComputeAtomicCounterBuffers = value;
-        else if (strcmp(token, "MaxVaryingComponents") == 0)
-            Resources.maxVaryingComponents = value;
-        else if (strcmp(token, "MaxVertexOutputComponents") == 0)
-            Resources.maxVertexOutputComponents = value;
-        else if (strcmp(token, "MaxGeometryInputComponents") == 0)
-            Resources.maxGeometryInputComponents = value;
-        else if (strcmp(token, "MaxGeometryOutputComponents") == 0)
-            Resources.maxGeometryOutputComponents = value;
-        else if (strcmp(token, "MaxFragmentInputComponents") == 0)
-            Resources.maxFragmentInputComponents = value;
-        else if (strcmp(token, "MaxImageUnits") == 0)
-            Resources.maxImageUnits = value;
-        else if (strcmp(token, "MaxCombinedImageUnitsAndFragmentOutputs") == 0)
-            Resources.maxCombinedImageUnitsAndFragmentOutputs = value;
-        else if (strcmp(token, "MaxCombinedShaderOutputResources") == 0)
-            Resources.maxCombinedShaderOutputResources = value;
-        else if (strcmp(token, "MaxImageSamples") == 0)
-            Resources.maxImageSamples = value;
-        else if (strcmp(token, "MaxVertexImageUniforms") == 0)
-            Resources.maxVertexImageUniforms = value;
-        else if (strcmp(token, "MaxTessControlImageUniforms") == 0)
-            Resources.maxTessControlImageUniforms = value;
-        else if (strcmp(token, "MaxTessEvaluationImageUniforms") == 0)
-            Resources.maxTessEvaluationImageUniforms = value;
-        else if (strcmp(token, "MaxGeometryImageUniforms") == 0)
-            Resources.maxGeometryImageUniforms = value;
-        else if (strcmp(token, "MaxFragmentImageUniforms") == 0)
-            Resources.maxFragmentImageUniforms = value;
-        else if (strcmp(token, "MaxCombinedImageUniforms") == 0)
-            Resources.maxCombinedImageUniforms = value;
-        else if (strcmp(token, "MaxGeometryTextureImageUnits") == 0)
-            Resources.maxGeometryTextureImageUnits = value;
-        else if (strcmp(token, "MaxGeometryOutputVertices") == 0)
-            Resources.maxGeometryOutputVertices = value;
-        else if (strcmp(token, "MaxGeometryTotalOutputComponents") == 0)
-            Resources.maxGeometryTotalOutputComponents = value;
-        else if (strcmp(token, "MaxGeometryUniformComponents") == 0)
-            Resources.maxGeometryUniformComponents = value;
-        else if (strcmp(token, "MaxGeometryVaryingComponents") == 0)
-            Resources.maxGeometryVaryingComponents = value;
-        else if (strcmp(token, "MaxTessControlInputComponents") == 0)
-            Resources.maxTessControlInputComponents = value;
-        else if (strcmp(token, "MaxTessControlOutputComponents") == 0)
-            Resources.maxTessControlOutputComponents = value;
-        else if (strcmp(token, "MaxTessControlTextureImageUnits") == 0)
-            Resources.maxTessControlTextureImageUnits = value;
-        else if (strcmp(token, "MaxTessControlUniformComponents") == 0)
-            Resources.maxTessControlUniformComponents = value;
-        else if (strcmp(token, "MaxTessControlTotalOutputComponents") == 0)
-            Resources.maxTessControlTotalOutputComponents = value;
-        else if (strcmp(token, "MaxTessEvaluationInputComponents") == 0)
-            Resources.maxTessEvaluationInputComponents = value;
-        else if (strcmp(token, "MaxTessEvaluationOutputComponents") == 0)
-            Resources.maxTessEvaluationOutputComponents = value;
-        else if (strcmp(token, "MaxTessEvaluationTextureImageUnits") == 0)
-            Resources.maxTessEvaluationTextureImageUnits = value;
-        else if (strcmp(token, "MaxTessEvaluationUniformComponents") == 0)
-            Resources.maxTessEvaluationUniformComponents = value;
-        else if (strcmp(token, "MaxTessPatchComponents") == 0)
-            Resources.maxTessPatchComponents = value;
-        else if (strcmp(token, "MaxPatchVertices") == 0)
-            Resources.maxPatchVertices = value;
-        else if (strcmp(token, "MaxTessGenLevel") == 0)
-            Resources.maxTessGenLevel = value;
-        else if (strcmp(token, "MaxViewports") == 0)
-            Resources.maxViewports = value;
-        else if (strcmp(token, "MaxVertexAtomicCounters") == 0)
-            Resources.maxVertexAtomicCounters = value;
-        else if (strcmp(token, "MaxTessControlAtomicCounters") == 0)
-            Resources.maxTessControlAtomicCounters = value;
-        else if (strcmp(token, "MaxTessEvaluationAtomicCounters") == 0)
-            Resources.maxTessEvaluationAtomicCounters = value;
-        else if (strcmp(token, "MaxGeometryAtomicCounters") == 0)
-            Resources.maxGeometryAtomicCounters = value;
-        else if (strcmp(token, "MaxFragmentAtomicCounters") == 0)
-            Resources.maxFragmentAtomicCounters = value;
-        else if (strcmp(token, "MaxCombinedAtomicCounters") == 0)
-            Resources.maxCombinedAtomicCounters = value;
-        else if (strcmp(token, "MaxAtomicCounterBindings") == 0)
-            Resources.maxAtomicCounterBindings = value;
-        else if (strcmp(token, "MaxVertexAtomicCounterBuffers") == 0)
-            Resources.maxVertexAtomicCounterBuffers = value;
-        else if (strcmp(token, "MaxTessControlAtomicCounterBuffers") == 0)
-            Resources.maxTessControlAtomicCounterBuffers = value;
-        else if (strcmp(token, "MaxTessEvaluationAtomicCounterBuffers") == 0)
-            Resources.maxTessEvaluationAtomicCounterBuffers = value;
-        else if (strcmp(token, "MaxGeometryAtomicCounterBuffers") == 0)
-            Resources.maxGeometryAtomicCounterBuffers = value;
-        else if (strcmp(token, "MaxFragmentAtomicCounterBuffers") == 0)
-            Resources.maxFragmentAtomicCounterBuffers = value;
-        else if (strcmp(token, "MaxCombinedAtomicCounterBuffers") == 0)
-            Resources.maxCombinedAtomicCounterBuffers = value;
-        else if (strcmp(token, "MaxAtomicCounterBufferSize") == 0)
-            Resources.maxAtomicCounterBufferSize = value;
-        else if (strcmp(token, "MaxTransformFeedbackBuffers") == 0)
-            Resources.maxTransformFeedbackBuffers = value;
-        else if (strcmp(token, "MaxTransformFeedbackInterleavedComponents") == 0)
-            Resources.maxTransformFeedbackInterleavedComponents = value;
-        else if (strcmp(token, "MaxCullDistances") == 0)
-            Resources.maxCullDistances = value;
-        else if (strcmp(token, "MaxCombinedClipAndCullDistances") == 0)
-            Resources.maxCombinedClipAndCullDistances = value;
-        else if (strcmp(token, "MaxSamples") == 0)
-            Resources.maxSamples = value;
-
-        else if (strcmp(token, "nonInductiveForLoops") == 0)
-            Resources.limits.nonInductiveForLoops = (value != 0);
-        else if (strcmp(token, "whileLoops") == 0)
-            Resources.limits.whileLoops = (value != 0);
-        else if (strcmp(token, "doWhileLoops") == 0)
-            Resources.limits.doWhileLoops = (value != 0);
-        else if (strcmp(token, "generalUniformIndexing") == 0)
-            Resources.limits.generalUniformIndexing = (value != 0);
-        else if (strcmp(token, "generalAttributeMatrixVectorIndexing") == 0)
-            Resources.limits.generalAttributeMatrixVectorIndexing = (value != 0);
-        else if (strcmp(token, "generalVaryingIndexing") == 0)
-            Resources.limits.generalVaryingIndexing = (value != 0);
-        else if (strcmp(token, "generalSamplerIndexing") == 0)
-            Resources.limits.generalSamplerIndexing = (value != 0);
-        else if (strcmp(token, "generalVariableIndexing") == 0)
-            Resources.limits.generalVariableIndexing = (value != 0);
-        else if (strcmp(token, "generalConstantMatrixVectorIndexing") == 0)
-            Resources.limits.generalConstantMatrixVectorIndexing = (value != 0);
-        else
-            printf("Warning: unrecognized limit (%s) in configuration file.\n", token);
+    glslang::DecodeResourceLimits(&Resources, config);
 
-        token = strtok(0, delims);
-    }
     if (configStrings)
         FreeFileData(configStrings);
 }
@@ -447,6 +178,36 @@ int NumWorkItems = 0;
 int Options = 0;
 const char* ExecutableName = nullptr;
 const char* binaryFileName = nullptr;
+const char* CacheDirectory = nullptr;
+const char* DepfileName = nullptr;
+const char* AstFileName = nullptr;
+
+// With --builtins, the snapshot to read the built-in symbol tables from, and
+// with --write-builtins, the one to write.
+const char* BuiltInsFileName = nullptr;
+const char* WriteBuiltInsFileName = nullptr;
+
+// With --entry-point, the functions to make SPIR-V modules of, instead of main().
+std::vector<const char*> EntryPoints;
+
+// With --permutation, the #define sets to compile the one input under, each
+// a comma-separated list of NAME or NAME=VALUE.
+std::vector<const char*> Permutations;
+
+// Number of worker threads for -t; 0 means one per hardware thread.
+int NumThreads = 0;
+
+// With --benchmark, how many times to generate each stage's SPIR-V.
+int BenchmarkIterations = 0;
+
+// Per-worker statistics for multi-threaded mode, reported with -v.
+struct TWorkerStats {
+    TWorkerStats() : shaders(0), seconds(0.0) { }
+    int shaders;
+    double seconds;
+};
+std::vector<TWorkerStats> WorkerStats;
+std::atomic<int> NextWorker(0);
 
 //
 // Create the default name for saving a binary if -o is not provided.
@@ -514,6 +275,98 @@ void ProcessArguments(int argc, char* argv[])
     for (; argc >= 1; argc--, argv++) {
         if (argv[0][0] == '-') {
             switch (argv[0][1]) {
+            case '-':
+                if (strcmp(argv[0], "--benchmark") == 0) {
+                    if (argc > 1) {
+                        BenchmarkIterations = atoi(argv[1]);
+                        argc--;
+                        argv++;
+                    } else
+                        Error("no <n> provided for --benchmark");
+                    if (BenchmarkIterations < 1)
+                        Error("--benchmark <n> must be positive");
+                } else if (strcmp(argv[0], "--builtins") == 0) {
+                    if (argc > 1) {
+                        BuiltInsFileName = argv[1];
+                        argc--;
+                        argv++;
+                    } else
+                        Error("no <file> provided for --builtins");
+                } else if (strcmp(argv[0], "--write-builtins") == 0) {
+                    if (argc > 1) {
+                        WriteBuiltInsFileName = argv[1];
+                        argc--;
+                        argv++;
+                    } else
+                        Error("no <file> provided for --write-builtins");
+                } else if (strcmp(argv[0], "--cache-dir") == 0) {
+                    if (argc > 1) {
+                        CacheDirectory = argv[1];
+                        argc--;
+                        argv++;
+                    } else
+                        Error("no <dir> provided for --cache-dir");
+                } else if (strcmp(argv[0], "--ast-file") == 0) {
+                    if (argc > 1) {
+                        AstFileName = argv[1];
+                        argc--;
+                        argv++;
+                    } else
+                        Error("no <file> provided for --ast-file");
+                    Options |= EOptionIntermediate;
+                } else if (strcmp(argv[0], "--entry-point") == 0) {
+                    if (argc > 1) {
+                        EntryPoints.push_back(argv[1]);
+                        argc--;
+                        argv++;
+                    } else
+                        Error("no <name> provided for --entry-point");
+                } else if (strcmp(argv[0], "--permutation") == 0) {
+                    if (argc > 1) {
+                        Permutations.push_back(argv[1]);
+                        argc--;
+                        argv++;
+                    } else
+                        Error("no <defines> provided for --permutation");
+                } else if (strcmp(argv[0], "--depfile") == 0) {
+                    if (argc > 1) {
+                        DepfileName = argv[1];
+                        argc--;
+                        argv++;
+                    } else
+                        Error("no <file> provided for --depfile");
+                } else if (strcmp(argv[0], "--skip-unchanged") == 0)
+                    Options |= EOptionSkipUnchanged;
+                else if (strcmp(argv[0], "--library") == 0)
+                    Options |= EOptionLibrary;
+                else if (strcmp(argv[0], "--remap") == 0)
+                    Options |= EOptionRemapSpv;
+                else if (strcmp(argv[0], "--server") == 0)
+                    Options |= EOptionServer;
+                else if (strcmp(argv[0], "--trim-interface") == 0)
+                    Options |= EOptionTrimInterface;
+                else if (strcmp(argv[0], "--inline") == 0)
+                    Options |= EOptionInline;
+                else if (strcmp(argv[0], "--counters") == 0)
+                    Options |= EOptionCounters;
+                else if (strcmp(argv[0], "--stream-functions") == 0)
+                    Options |= EOptionStreamFunctions;
+                else if (strcmp(argv[0], "--mediump-16bit") == 0)
+                    Options |= EOptionMediump16;
+                else if (strcmp(argv[0], "--numa") == 0)
+                    Options |= EOptionNuma;
+                else
+                    usage();
+                break;
+            case 'J':
+                Options |= EOptionTimingJson;
+                // fall through to -T
+            case 'T':
+                Options |= EOptionTiming;
+                break;
+            case 'O':
+                Options |= EOptionOptimizeSpv;
+                break;
             case 'H':
                 Options |= EOptionHumanReadableSpv;
                 // fall through to -V
@@ -541,6 +394,17 @@ void ProcessArguments(int argc, char* argv[])
             case 'i':
                 Options |= EOptionIntermediate;
                 break;
+            case 'j':
+                if (argc > 1) {
+                    NumThreads = atoi(argv[1]);
+                    argc--;
+                    argv++;
+                } else
+                    Error("no <n> provided for -j");
+                if (NumThreads < 0)
+                    Error("-j <n> must not be negative");
+                Options |= EOptionMultiThreaded;
+                break;
             case 'l':
                 Options |= EOptionLinkProgram;
                 break;
@@ -565,9 +429,7 @@ void ProcessArguments(int argc, char* argv[])
                 Options |= EOptionSuppressInfolog;
                 break;
             case 't':
-                #ifdef _WIN32
-                    Options |= EOptionMultiThreaded;
-                #endif
+                Options |= EOptionMultiThreaded;
                 break;
             case 'v':
                 Options |= EOptionDumpVersions;
@@ -595,6 +457,78 @@ void ProcessArguments(int argc, char* argv[])
     // -o makes no sense if there is no target binary
     if (binaryFileName && (Options & EOptionSpv) == 0)
         Error("no binary generation requested (e.g., -V)");
+
+    if ((Options & EOptionOptimizeSpv) && (Options & EOptionSpv) == 0)
+        Error("-O requires a binary option (e.g., -V)");
+
+    // only SPIR-V is cached
+    if (CacheDirectory && (Options & EOptionSpv) == 0)
+        Error("--cache-dir requires a binary option (e.g., -V)");
+
+    if (BenchmarkIterations > 0 && (Options & EOptionSpv) == 0)
+        Error("--benchmark requires a binary option (e.g., -V)");
+    if (BenchmarkIterations > 0 && CacheDirectory)
+        Error("can't use --cache-dir with --benchmark");
+
+    if ((Options & EOptionLibrary) && (Options & EOptionLinkProgram) == 0)
+        Error("--library requires linking (e.g., -l or -V)");
+
+    if (AstFileName && (Options & EOptionLinkProgram) == 0)
+        Error("--ast-file requires linking (e.g., -l or -V)");
+    if ((Options & EOptionTrimInterface) && (Options & EOptionLinkProgram) == 0)
+        Error("--trim-interface requires linking (e.g., -l or -V)");
+    if ((Options & EOptionInline) && (Options & EOptionLinkProgram) == 0)
+        Error("--inline requires linking (e.g., -l or -V)");
+    if (! EntryPoints.empty() && (Options & EOptionLinkProgram) == 0)
+        Error("--entry-point requires linking (e.g., -l or -V)");
+    // each entry point's SPIR-V is its own output, which these don't know about
+    if (! EntryPoints.empty() && (BenchmarkIterations > 0 || CacheDirectory || DepfileName ||
+                                  (Options & (EOptionSkipUnchanged | EOptionServer))))
+        Error("can't use --entry-point with --benchmark, --cache-dir, --depfile, --server, or --skip-unchanged");
+    if (! Permutations.empty() && (Options & EOptionLinkProgram) == 0)
+        Error("--permutation requires linking (e.g., -l or -V)");
+    if (! Permutations.empty() && Worklist.size() != 1)
+        Error("--permutation takes exactly one input file");
+    // each permutation is its own compile, which these don't know about
+    if (! Permutations.empty() && (! EntryPoints.empty() || BenchmarkIterations > 0 || CacheDirectory || DepfileName ||
+                                   AstFileName || (Options & (EOptionSkipUnchanged | EOptionServer | EOptionDumpReflection |
+                                                              EOptionIntermediate))))
+        Error("can't use --permutation with -i, -q, --ast-file, --benchmark, --cache-dir, --depfile, --entry-point, "
+              "--server, or --skip-unchanged");
+    // the shaders' trees would interleave in the file if parsed concurrently
+    if (AstFileName && (Options & EOptionMultiThreaded))
+        Error("can't use -t with --ast-file");
+    if ((Options & EOptionNuma) && (Options & EOptionMultiThreaded) == 0)
+        Error("--numa requires -t");
+
+    if ((Options & EOptionRemapSpv) && (Options & EOptionSpv) == 0)
+        Error("--remap requires a binary option (e.g., -V)");
+    if ((Options & EOptionStreamFunctions) && (Options & EOptionSpv) == 0)
+        Error("--stream-functions requires a binary option (e.g., -V)");
+    if ((Options & EOptionMediump16) && (Options & EOptionSpv) == 0)
+        Error("--mediump-16bit requires a binary option (e.g., -V)");
+
+    if (DepfileName && (Options & EOptionSpv) == 0)
+        Error("--depfile requires a binary option (e.g., -V)");
+    if ((Options & EOptionSkipUnchanged) && (Options & EOptionSpv) == 0)
+        Error("--skip-unchanged requires a binary option (e.g., -V)");
+    if ((DepfileName || (Options & EOptionSkipUnchanged)) && BenchmarkIterations > 0)
+        Error("can't use --depfile or --skip-unchanged with --benchmark");
+
+    if (WriteBuiltInsFileName && (! Worklist.empty() || BuiltInsFileName))
+        Error("--write-builtins takes no input files, and can't be used with --builtins");
+
+    if (Options & EOptionServer) {
+        if ((Options & EOptionSpv) == 0)
+            Error("--server requires a binary option (e.g., -V)");
+        if (! Worklist.empty() || binaryFileName)
+            Error("--server reads its shaders from its requests, and writes their SPIR-V back");
+        if ((Options & (EOptionIntermediate | EOptionDumpReflection | EOptionHumanReadableSpv | EOptionTiming |
+                        EOptionCounters)) ||
+            BenchmarkIterations > 0 || CacheDirectory || DepfileName || (Options & EOptionSkipUnchanged))
+            Error("can't use -H, -i, -q, -T, --benchmark, --cache-dir, --counters, --depfile, or --skip-unchanged "
+                  "with --server");
+    }
 }
 
 //
@@ -614,6 +548,107 @@ void SetMessageOptions(EShMessages& messages)
         messages = (EShMessages)(messages | EShMsgVulkanRules);
     if (Options & EOptionOutputPreprocessed)
         messages = (EShMessages)(messages | EShMsgOnlyPreprocessor);
+    if (Options & EOptionTiming)
+        messages = (EShMessages)(messages | EShMsgTiming);
+    if (Options & EOptionLibrary)
+        messages = (EShMessages)(messages | EShMsgLibrary);
+    if (Options & EOptionTrimInterface)
+        messages = (EShMessages)(messages | EShMsgTrimInterface);
+    if (Options & EOptionInline)
+        messages = (EShMessages)(messages | EShMsgInline);
+    if (Options & EOptionCounters)
+        messages = (EShMessages)(messages | EShMsgCounters);
+}
+
+//
+// Format per-phase timing as a table, or as JSON for -J.  'spirvSeconds' is
+// the time spent in GlslangToSpv(), or negative if SPIR-V wasn't generated.
+//
+std::string FormatTimingStats(const ShTimingStats& stats, double spirvSeconds)
+{
+    static const char* const phaseNames[EShPhaseCount] = {
+        "built-ins", "preprocess", "parse", "final-check", "link", "reflection"
+    };
+    const bool json = (Options & EOptionTimingJson) != 0;
+
+    std::string text = json ? "{" : "Phase            Seconds  Allocations\n";
+    char line[128];
+    for (int phase = 0; phase < EShPhaseCount; ++phase) {
+        if (json)
+            snprintf(line, sizeof(line), "%s\"%s\": { \"seconds\": %.6f, \"allocations\": %d }", phase > 0 ? ", " : "",
+                     phaseNames[phase], stats.seconds[phase], stats.poolAllocations[phase]);
+        else
+            snprintf(line, sizeof(line), "%-12s %11.6f  %11d\n", phaseNames[phase], stats.seconds[phase], stats.poolAllocations[phase]);
+        text += line;
+    }
+    if (spirvSeconds >= 0.0) {
+        if (json)
+            snprintf(line, sizeof(line), ", \"spirv\": { \"seconds\": %.6f }", spirvSeconds);
+        else
+            snprintf(line, sizeof(line), "%-12s %11.6f\n", "spirv", spirvSeconds);
+        text += line;
+    }
+    if (json)
+        text += "}\n";
+
+    return text;
+}
+
+// Add the phases of 'stats' into 'total'.
+void AccumulateTimingStats(ShTimingStats& total, const ShTimingStats& stats)
+{
+    for (int phase = 0; phase < EShPhaseCount; ++phase) {
+        total.seconds[phase] += stats.seconds[phase];
+        total.poolAllocations[phase] += stats.poolAllocations[phase];
+    }
+}
+
+//
+// Format the inner-loop counts of --counters as a table, or as JSON with -J.
+//
+std::string FormatCounterStats(const ShCounterStats& stats)
+{
+    const struct {
+        const char* name;
+        int count;
+    } counters[] = {
+        { "tokens", stats.tokens },
+        { "macro-expansions", stats.macroExpansions },
+        { "symbol-lookups", stats.symbolLookups },
+        { "symbol-misses", stats.symbolMisses },
+        { "overload-candidates", stats.overloadCandidates },
+        { "nodes", stats.nodes },
+        { "spv-instructions", stats.spvInstructions },
+        { "remap-instructions", stats.remapInstructions },
+    };
+    const bool json = (Options & EOptionTimingJson) != 0;
+
+    std::string text = json ? "{" : "Counter                  Count\n";
+    char line[128];
+    for (size_t c = 0; c < sizeof(counters) / sizeof(counters[0]); ++c) {
+        if (json)
+            snprintf(line, sizeof(line), "%s\"%s\": %d", c > 0 ? ", " : "", counters[c].name, counters[c].count);
+        else
+            snprintf(line, sizeof(line), "%-20s %9d\n", counters[c].name, counters[c].count);
+        text += line;
+    }
+    if (json)
+        text += "}\n";
+
+    return text;
+}
+
+// Add the counts of 'stats' into 'total'.
+void AccumulateCounterStats(ShCounterStats& total, const ShCounterStats& stats)
+{
+    total.tokens += stats.tokens;
+    total.macroExpansions += stats.macroExpansions;
+    total.symbolLookups += stats.symbolLookups;
+    total.symbolMisses += stats.symbolMisses;
+    total.overloadCandidates += stats.overloadCandidates;
+    total.nodes += stats.nodes;
+    total.spvInstructions += stats.spvInstructions;
+    total.remapInstructions += stats.remapInstructions;
 }
 
 //
@@ -627,6 +662,12 @@ unsigned int
 #endif
 CompileShaders(void*)
 {
+    const int worker = NextWorker++;
+    auto start = std::chrono::steady_clock::now();
+
+    if ((Options & EOptionNuma) && glslang::GetNumaNodeCount() > 1)
+        glslang::SetThreadNumaNode(worker % glslang::GetNumaNodeCount());
+
     glslang::TWorkItem* workItem;
     while (Worklist.remove(workItem)) {
         ShHandle compiler = ShConstructCompiler(FindLanguage(workItem->name), Options);
@@ -638,12 +679,69 @@ CompileShaders(void*)
         if (! (Options & EOptionSuppressInfolog))
             workItem->results = ShGetInfoLog(compiler);
 
+        if (Options & EOptionTiming) {
+            ShTimingStats timingStats;
+            ShGetTimingStats(compiler, &timingStats);
+            workItem->results += FormatTimingStats(timingStats, -1.0);
+        }
+
+        if (Options & EOptionCounters) {
+            ShCounterStats counterStats;
+            ShGetCounterStats(compiler, &counterStats);
+            workItem->results += FormatCounterStats(counterStats);
+        }
+
         ShDestruct(compiler);
+
+        if (worker < (int)WorkerStats.size())
+            ++WorkerStats[worker].shaders;
     }
 
+    if (worker < (int)WorkerStats.size())
+        WorkerStats[worker].seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
     return 0;
 }
 
+//
+// Run CompileShaders() on a pool of worker threads, sized by -j, or by the
+// number of hardware threads, but never more than there are shaders.
+//
+// Returns false if a thread could not be created.
+//
+bool CompileShadersMultiThreaded()
+{
+    int numThreads = NumThreads;
+    if (numThreads == 0)
+        numThreads = (int)std::thread::hardware_concurrency();
+    if (numThreads > Worklist.size())
+        numThreads = Worklist.size();
+    if (numThreads < 1)
+        numThreads = 1;
+
+    WorkerStats.resize(numThreads);
+
+    std::vector<void*> threads(numThreads);
+    for (int t = 0; t < numThreads; ++t) {
+        threads[t] = glslang::OS_CreateThread(&CompileShaders);
+        if (! threads[t]) {
+            printf("Failed to create thread\n");
+            return false;
+        }
+    }
+    glslang::OS_WaitForAllThreads(threads.data(), numThreads);
+
+    if (Options & EOptionDumpVersions) {
+        for (int t = 0; t < numThreads; ++t) {
+            const double seconds = WorkerStats[t].seconds;
+            printf("Worker %d: %d shaders in %.3f s (%.1f shaders/s)\n", t, WorkerStats[t].shaders, seconds,
+                   seconds > 0.0 ? WorkerStats[t].shaders / seconds : 0.0);
+        }
+    }
+
+    return true;
+}
+
 // Outputs the given string, but only if it is non-null and non-empty.
 // This prevents erroneous newlines from appearing.
 void PutsIfNonEmpty(const char* str)
@@ -662,6 +760,248 @@ void StderrIfNonEmpty(const char* str)
     }
 }
 
+//
+// Hash everything that goes into the program's SPIR-V: each input file,
+// the stage it is compiled as, and the compile settings.
+//
+// How the command line asks for SPIR-V to be generated.
+glslang::SpvOptions GetSpvOptions()
+{
+    glslang::SpvOptions options;
+    if (Options & EOptionMultiThreaded)
+        options.numThreads = NumThreads;
+    options.forwardLoadsAndStores = (Options & EOptionOptimizeSpv) != 0;
+    options.eliminateCommonSubexpressions = (Options & EOptionOptimizeSpv) != 0;
+    if (Options & EOptionRemapSpv)
+        options.remap = spv::spirvbin_t::DO_EVERYTHING;
+    options.streamFunctions = (Options & EOptionStreamFunctions) != 0;
+    options.mediump16 = (Options & EOptionMediump16) != 0;
+
+    return options;
+}
+
+bool ComputeCacheKey(const std::vector<glslang::TWorkItem*>& workItems, EShMessages messages,
+                     glslang::TSpvCacheKey& key)
+{
+    for (size_t w = 0; w < workItems.size(); ++w) {
+        int length;
+        const char* text = MapFileData(workItems[w]->name.c_str(), length);
+        if (text == nullptr)
+            return false;
+        key.addShader(FindLanguage(workItems[w]->name), &text, &length, 1);
+        UnmapFileData(text, length);
+    }
+
+    // timing and counting don't change what gets generated
+    const EShMessages keyMessages = (EShMessages)(messages & ~(EShMsgTiming | EShMsgCounters));
+    key.addSettings(Options & EOptionDefaultDesktop ? 110 : 100, ENoProfile, false, keyMessages, Resources);
+    key.addSpvOptions(GetSpvOptions());
+
+    return true;
+}
+
+// The first input file compiled as 'stage'.
+const char* GetStageFileName(EShLanguage stage, const std::vector<glslang::TWorkItem*>& workItems)
+{
+    for (size_t w = 0; w < workItems.size(); ++w) {
+        if (FindLanguage(workItems[w]->name) == stage)
+            return workItems[w]->name.c_str();
+    }
+
+    return GetBinaryName(stage);
+}
+
+// Write out, and optionally disassemble, the SPIR-V of one stage.
+void OutputStageSpv(EShLanguage stage, const std::vector<unsigned int>& spirv, const char* prefix = nullptr)
+{
+    // an entry point's or permutation's module goes next to the stage's, its
+    // file name prefixed with the entry point's name or permutation's number:
+    // out/k.spv becomes out/k1.k.spv
+    std::string name = GetBinaryName(stage);
+    if (prefix) {
+        size_t slash = name.find_last_of("/\\");
+        name.insert(slash == std::string::npos ? 0 : slash + 1, std::string(prefix) + ".");
+    }
+    if (! glslang::OutputSpv(spirv, name.c_str()))
+        Error(("unable to write " + name).c_str());
+    if (Options & EOptionHumanReadableSpv) {
+        spv::Parameterize();
+        spv::Disassemble(std::cout, spirv);
+    }
+}
+
+// Number of instructions in a SPIR-V module, skipping the header.
+int CountSpvInstructions(const std::vector<unsigned int>& spirv)
+{
+    int count = 0;
+    for (size_t word = 5; word < spirv.size(); word += spirv[word] >> spv::WordCountShift) {
+        if ((spirv[word] >> spv::WordCountShift) == 0)
+            break;
+        ++count;
+    }
+
+    return count;
+}
+
+//
+// For --benchmark: generate the SPIR-V of one stage BenchmarkIterations times,
+// timing the translation from the AST, the dump of the module to words, and
+// remapping those words (spirv-remap's defaults) separately.  With --remap,
+// the remapping is GlslangToSpv()'s own.  Prints one line of per-iteration
+// averages; nothing is written out.
+//
+void BenchmarkStageSpv(const char* name, const glslang::TIntermediate& intermediate)
+{
+    glslang::SpvPhaseSeconds seconds;
+    double remapSeconds = 0.0;
+    std::vector<unsigned int> spirv;
+    std::vector<unsigned int> remapped;
+    for (int i = 0; i < BenchmarkIterations; ++i) {
+        spirv.clear();
+        glslang::GlslangToSpv(intermediate, spirv, GetSpvOptions(), seconds);
+        if (Options & EOptionRemapSpv)
+            continue;
+
+        remapped = spirv;
+        auto start = std::chrono::steady_clock::now();
+        spv::spirvbin_t().remap(remapped, spv::spirvbin_t::DO_EVERYTHING);
+        remapSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    if (Options & EOptionRemapSpv)
+        remapSeconds = seconds.remap;
+
+    const int instructions = CountSpvInstructions(spirv);
+    const double generateSeconds = seconds.translate + seconds.dump;
+    printf("%s: %d words, %d instructions; ms per iteration: translate %.4f dump %.4f remap %.4f; "
+           "instructions/s: generate %.0f remap %.0f\n",
+           name, (int)spirv.size(), instructions,
+           1000.0 * seconds.translate / BenchmarkIterations, 1000.0 * seconds.dump / BenchmarkIterations,
+           1000.0 * remapSeconds / BenchmarkIterations,
+           generateSeconds > 0.0 ? instructions * (double)BenchmarkIterations / generateSeconds : 0.0,
+           remapSeconds > 0.0 ? instructions * (double)BenchmarkIterations / remapSeconds : 0.0);
+}
+
+//
+// Output the program's SPIR-V straight from the cache, if every stage
+// is there.  Returns false, having output nothing, on a miss.
+//
+bool OutputCachedSpv(const glslang::TSpvCache& cache, const glslang::TSpvCacheKey& key,
+                     const std::vector<glslang::TWorkItem*>& workItems)
+{
+    std::vector<unsigned int> spirv[EShLangCount];
+    bool present[EShLangCount] = { };
+    for (size_t w = 0; w < workItems.size(); ++w) {
+        EShLanguage stage = FindLanguage(workItems[w]->name);
+        if (! present[stage] && ! cache.lookup(key, stage, spirv[stage]))
+            return false;
+        present[stage] = true;
+    }
+
+    if (! (Options & EOptionSuppressInfolog)) {
+        for (size_t w = 0; w < workItems.size(); ++w)
+            PutsIfNonEmpty(workItems[w]->name.c_str());
+    }
+    for (int stage = 0; stage < EShLangCount; ++stage) {
+        if (present[stage])
+            OutputStageSpv((EShLanguage)stage, spirv[stage]);
+    }
+
+    return true;
+}
+
+//
+// For --depfile: write a Make rule naming the inputs the program's SPIR-V
+// was made from, and so is out of date without, for Make or Ninja to track.
+// Input files can't #include, so the shader files and config file are all.
+//
+std::string EscapeMakePath(const std::string& path)
+{
+    std::string escaped;
+    for (size_t c = 0; c < path.size(); ++c) {
+        if (path[c] == ' ' || path[c] == '#')
+            escaped += '\\';
+        else if (path[c] == '$')
+            escaped += '$';
+        escaped += path[c];
+    }
+
+    return escaped;
+}
+
+bool WriteDepfile(const std::vector<glslang::TWorkItem*>& workItems)
+{
+    std::string rule;
+    std::set<std::string> outputs;
+    for (size_t w = 0; w < workItems.size(); ++w) {
+        const std::string output = GetBinaryName(FindLanguage(workItems[w]->name));
+        if (outputs.insert(output).second)
+            rule += (rule.empty() ? "" : " ") + EscapeMakePath(output);
+    }
+    rule += ":";
+    for (size_t w = 0; w < workItems.size(); ++w)
+        rule += " \\\n  " + EscapeMakePath(workItems[w]->name);
+    if (! ConfigFile.empty())
+        rule += " \\\n  " + EscapeMakePath(ConfigFile);
+    rule += "\n";
+
+    FILE* out = fopen(DepfileName, "wb");
+    if (out == nullptr)
+        return false;
+    const bool written = fwrite(rule.data(), 1, rule.size(), out) == rule.size();
+
+    return fclose(out) == 0 && written;
+}
+
+//
+// For --skip-unchanged: next to each SPIR-V output file is a manifest,
+// <output>.hash, holding the cache key (see ComputeCacheKey()) of the inputs
+// and settings it was made from.  When every output of the program has one,
+// matching the current key, nothing has changed, and nothing need be compiled.
+//
+std::string GetManifestName(EShLanguage stage)
+{
+    return std::string(GetBinaryName(stage)) + ".hash";
+}
+
+bool OutputsUpToDate(const glslang::TSpvCacheKey& key, const std::vector<glslang::TWorkItem*>& workItems)
+{
+    for (size_t w = 0; w < workItems.size(); ++w) {
+        const EShLanguage stage = FindLanguage(workItems[w]->name);
+        size_t size;
+        const char* manifest = glslang::OS_MapFile(GetManifestName(stage).c_str(), size);
+        if (manifest == nullptr)
+            return false;
+        const bool matches = std::string(manifest, size) == key.getName() + "\n";
+        glslang::OS_UnmapFile(manifest, size);
+
+        const char* output = glslang::OS_MapFile(GetBinaryName(stage), size);
+        if (output == nullptr)
+            return false;
+        glslang::OS_UnmapFile(output, size);
+
+        if (! matches)
+            return false;
+    }
+
+    return true;
+}
+
+void WriteManifest(const glslang::TSpvCacheKey& key, EShLanguage stage)
+{
+    FILE* out = fopen(GetManifestName(stage).c_str(), "wb");
+    if (out == nullptr)
+        return;
+    fprintf(out, "%s\n", key.getName().c_str());
+    fclose(out);
+}
+
+// TLogWriter for --ast-file
+void WriteToFile(void* file, const char* text, size_t length)
+{
+    fwrite(text, 1, length, (FILE*)file);
+}
+
 //
 // For linking mode: Will independently parse each item in the worklist, but then put them
 // in the same program and link them together.
@@ -676,27 +1016,87 @@ void CompileAndLinkShaders()
     EShMessages messages = EShMsgDefault;
     SetMessageOptions(messages);
 
+    std::vector<glslang::TWorkItem*> workItems;
+    glslang::TWorkItem* workItem;
+    while (Worklist.remove(workItem))
+        workItems.push_back(workItem);
+
+    //
+    // With --cache-dir, a program whose inputs and settings were already
+    // compiled needs nothing but its SPIR-V copied out.  The AST and
+    // reflection aren't cached, so -i and -q always compile.
+    //
+    // With --skip-unchanged, a program whose outputs' manifests match needs
+    // nothing done at all, unless asked for more than SPIR-V.
+    //
+    glslang::TSpvCache cache(CacheDirectory ? CacheDirectory : "");
+    glslang::TSpvCacheKey cacheKey;
+    const bool onlySpv = ! (Options & (EOptionIntermediate | EOptionDumpReflection));
+    const bool keyed = (CacheDirectory || (Options & EOptionSkipUnchanged)) &&
+                       ComputeCacheKey(workItems, messages, cacheKey);
+    const bool useCache = CacheDirectory && onlySpv && keyed;
+    const bool useManifests = (Options & EOptionSkipUnchanged) && keyed;
+    if (useManifests && onlySpv && ! (Options & EOptionHumanReadableSpv) && OutputsUpToDate(cacheKey, workItems)) {
+        if (! (Options & EOptionSuppressInfolog)) {
+            for (size_t w = 0; w < workItems.size(); ++w)
+                PutsIfNonEmpty(workItems[w]->name.c_str());
+        }
+        if (DepfileName && ! WriteDepfile(workItems))
+            Error("unable to write the depfile");
+        return;
+    }
+    if (useCache && OutputCachedSpv(cache, cacheKey, workItems)) {
+        if (useManifests) {
+            for (size_t w = 0; w < workItems.size(); ++w)
+                WriteManifest(cacheKey, FindLanguage(workItems[w]->name));
+        }
+        if (DepfileName && ! WriteDepfile(workItems))
+            Error("unable to write the depfile");
+        return;
+    }
+
     //
     // Per-shader processing...
     //
 
     glslang::TProgram& program = *new glslang::TProgram;
-    glslang::TWorkItem* workItem;
-    while (Worklist.remove(workItem)) {
+    ShTimingStats timingStats;
+    memset(&timingStats, 0, sizeof(timingStats));
+    double spirvSeconds = -1.0;
+    ShCounterStats counterStats;
+    memset(&counterStats, 0, sizeof(counterStats));
+    const int defaultVersion = Options & EOptionDefaultDesktop? 110: 100;
+
+    // with --ast-file, the trees go to the file as they're printed, each shader's
+    // after its name
+    FILE* astFile = nullptr;
+    if (AstFileName) {
+        astFile = fopen(AstFileName, "w");
+        if (astFile == nullptr)
+            Error("unable to open the --ast-file");
+    }
+
+    // with -t, the stages are parsed together, after they've all been set up
+    const bool parseConcurrently = (Options & EOptionMultiThreaded) && ! (Options & EOptionOutputPreprocessed);
+    std::vector<const char*> shaderStrings(workItems.size());
+    std::vector<int> shaderLengths(workItems.size());
+    for (size_t w = 0; w < workItems.size(); ++w) {
+        workItem = workItems[w];
         EShLanguage stage = FindLanguage(workItem->name);
         glslang::TShader* shader = new glslang::TShader(stage);
         shaders.push_back(shader);
-    
-        char** shaderStrings = ReadFileData(workItem->name.c_str());
-        if (! shaderStrings) {
-            usage();
-            delete &program;
-
-            return;
+        if (astFile) {
+            fprintf(astFile, "%s\n", workItem->name.c_str());
+            shader->setDebugLogWriter(WriteToFile, astFile);
         }
-        const int defaultVersion = Options & EOptionDefaultDesktop? 110: 100;
+    
+        const char*& shaderString = shaderStrings[w];
+        int& shaderLength = shaderLengths[w];
+        shaderString = MapFileData(workItem->name.c_str(), shaderLength);
 
-        shader->setStrings(shaderStrings, 1);
+        shader->setStringsWithLengths(&shaderString, &shaderLength, 1);
+        if (! EntryPoints.empty())
+            shader->setEntryPoints(EntryPoints.data(), (int)EntryPoints.size());
         if (Options & EOptionOutputPreprocessed) {
             std::string str;
             if (shader->preprocess(&Resources, defaultVersion, ENoProfile, false, false,
@@ -707,36 +1107,58 @@ void CompileAndLinkShaders()
             }
             StderrIfNonEmpty(shader->getInfoLog());
             StderrIfNonEmpty(shader->getInfoDebugLog());
-            FreeFileData(shaderStrings);
+            AccumulateTimingStats(timingStats, shader->getTimingStats());
+            AccumulateCounterStats(counterStats, shader->getCounterStats());
+            UnmapFileData(shaderString, shaderLength);
             continue;
         }
-        if (! shader->parse(&Resources, defaultVersion, false, messages))
+        if (! parseConcurrently && ! shader->parse(&Resources, defaultVersion, false, messages))
             CompileFailed = true;
 
         program.addShader(shader);
+    }
 
-        if (! (Options & EOptionSuppressInfolog)) {
-            PutsIfNonEmpty(workItem->name.c_str());
-            PutsIfNonEmpty(shader->getInfoLog());
-            PutsIfNonEmpty(shader->getInfoDebugLog());
-        }
+    if (parseConcurrently && ! program.parseShaders(&Resources, defaultVersion, false, messages, NumThreads))
+        CompileFailed = true;
+
+    if (! (Options & EOptionOutputPreprocessed)) {
+        std::list<glslang::TShader*>::const_iterator shader = shaders.begin();
+        for (size_t w = 0; w < workItems.size(); ++w, ++shader) {
+            AccumulateTimingStats(timingStats, (*shader)->getTimingStats());
+            AccumulateCounterStats(counterStats, (*shader)->getCounterStats());
+
+            if (! (Options & EOptionSuppressInfolog)) {
+                PutsIfNonEmpty(workItems[w]->name.c_str());
+                PutsIfNonEmpty((*shader)->getInfoLog());
+                PutsIfNonEmpty((*shader)->getInfoDebugLog());
+            }
 
-        FreeFileData(shaderStrings);
+            UnmapFileData(shaderStrings[w], shaderLengths[w]);
+        }
     }
 
     //
     // Program-level processing...
     //
 
+    if (astFile) {
+        fprintf(astFile, "\nLinked program:\n\n");
+        program.setDebugLogWriter(WriteToFile, astFile);
+    }
+
     if (! (Options & EOptionOutputPreprocessed) && ! program.link(messages))
         LinkFailed = true;
 
+    if (astFile && fclose(astFile) != 0)
+        Error("unable to write the --ast-file");
+
     if (! (Options & EOptionSuppressInfolog)) {
         PutsIfNonEmpty(program.getInfoLog());
         PutsIfNonEmpty(program.getInfoDebugLog());
     }
 
-    if (Options & EOptionDumpReflection) {
+    // with -V, reflection comes from the SPIR-V instead, once it's generated
+    if ((Options & EOptionDumpReflection) && ! (Options & EOptionSpv)) {
         program.buildReflection();
         program.dumpReflection();
     }
@@ -745,20 +1167,70 @@ void CompileAndLinkShaders()
         if (CompileFailed || LinkFailed)
             printf("SPIR-V is not generated for failed compile or link\n");
         else {
+            glslang::TReflection spvReflection;
             for (int stage = 0; stage < EShLangCount; ++stage) {
-                if (program.getIntermediate((EShLanguage)stage)) {
-                    std::vector<unsigned int> spirv;
-                    glslang::GlslangToSpv(*program.getIntermediate((EShLanguage)stage), spirv);
-                    glslang::OutputSpv(spirv, GetBinaryName((EShLanguage)stage));
-                    if (Options & EOptionHumanReadableSpv) {
-                        spv::Parameterize();
-                        spv::Disassemble(std::cout, spirv);
+                if (program.getIntermediate((EShLanguage)stage) && BenchmarkIterations > 0) {
+                    BenchmarkStageSpv(GetStageFileName((EShLanguage)stage, workItems),
+                                      *program.getIntermediate((EShLanguage)stage));
+                } else if (program.getIntermediate((EShLanguage)stage) && ! EntryPoints.empty()) {
+                    // one module per entry point, each from the same linked tree
+                    if (spirvSeconds < 0.0)
+                        spirvSeconds = 0.0;
+                    for (size_t e = 0; e < EntryPoints.size(); ++e) {
+                        std::vector<unsigned int> spirv;
+                        glslang::SpvOptions spvOptions = GetSpvOptions();
+                        if (Options & EOptionCounters)
+                            spvOptions.counters = &counterStats;
+                        spvOptions.entryPoint = EntryPoints[e];
+                        auto start = std::chrono::steady_clock::now();
+                        glslang::GlslangToSpv(*program.getIntermediate((EShLanguage)stage), spirv, spvOptions);
+                        spirvSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                        OutputStageSpv((EShLanguage)stage, spirv, EntryPoints[e]);
                     }
+                } else if (program.getIntermediate((EShLanguage)stage)) {
+                    std::vector<unsigned int> spirv;
+                    if (spirvSeconds < 0.0)
+                        spirvSeconds = 0.0;
+                    glslang::SpvOptions spvOptions = GetSpvOptions();
+                    if (Options & EOptionCounters)
+                        spvOptions.counters = &counterStats;
+                    auto start = std::chrono::steady_clock::now();
+                    glslang::GlslangToSpv(*program.getIntermediate((EShLanguage)stage), spirv, spvOptions);
+                    spirvSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                    OutputStageSpv((EShLanguage)stage, spirv);
+                    if (useCache)
+                        cache.store(cacheKey, (EShLanguage)stage, spirv);
+                    if (useManifests)
+                        WriteManifest(cacheKey, (EShLanguage)stage);
+                    if ((Options & EOptionDumpReflection) && ! glslang::SpvToReflection(spirv, spvReflection))
+                        Error("unable to reflect the SPIR-V");
                 }
             }
+            if (Options & EOptionDumpReflection)
+                spvReflection.dump();
+            if (DepfileName && ! WriteDepfile(workItems))
+                Error("unable to write the depfile");
         }
     }
 
+    if (BenchmarkIterations > 0)
+        printf("peak memory: %.1f MB\n", glslang::OS_GetPeakMemory() / (1024.0 * 1024.0));
+
+    if (Options & EOptionTiming) {
+        AccumulateTimingStats(timingStats, program.getTimingStats());
+        if (Options & EOptionTimingJson)
+            printf("%s", FormatTimingStats(timingStats, spirvSeconds).c_str());
+        else
+            PutsIfNonEmpty(FormatTimingStats(timingStats, spirvSeconds).c_str());
+    }
+
+    if (Options & EOptionCounters) {
+        if (Options & EOptionTimingJson)
+            printf("%s", FormatCounterStats(counterStats).c_str());
+        else
+            PutsIfNonEmpty(FormatCounterStats(counterStats).c_str());
+    }
+
     // Free everything up, program has to go before the shaders
     // because it might have merged stuff from the shaders, and
     // the stuff from the shaders has to have its destructors called
@@ -770,12 +1242,271 @@ void CompileAndLinkShaders()
     }
 }
 
+//
+// For --permutation: compile the one input file under each set of #defines,
+// through TPermutations, and print each permutation's info log, or which
+// permutation's compile it shares.  With -V, save (and with -H, print) each
+// permutation's SPIR-V.
+//
+void CompilePermutations()
+{
+    EShMessages messages = EShMsgDefault;
+    SetMessageOptions(messages);
+
+    glslang::TWorkItem* workItem;
+    Worklist.remove(workItem);
+    const EShLanguage stage = FindLanguage(workItem->name);
+
+    int length;
+    const char* text = MapFileData(workItem->name.c_str(), length);
+    if (text == nullptr)
+        usage();
+    glslang::TPermutations permutations(stage, std::string(text, length).c_str());
+    UnmapFileData(text, length);
+
+    for (size_t p = 0; p < Permutations.size(); ++p) {
+        glslang::TPermutations::TDefines defines;
+        std::string list = Permutations[p];
+        for (size_t start = 0; start < list.size(); ) {
+            size_t end = std::min(list.find(',', start), list.size());
+            std::string define = list.substr(start, end - start);
+            size_t equals = define.find('=');
+            if (equals == std::string::npos)
+                defines.push_back(std::make_pair(define, std::string()));
+            else
+                defines.push_back(std::make_pair(define.substr(0, equals), define.substr(equals + 1)));
+            start = end + 1;
+        }
+        permutations.addPermutation(defines);
+    }
+
+    const int defaultVersion = Options & EOptionDefaultDesktop ? 110 : 100;
+    const int numThreads = Options & EOptionMultiThreaded ? NumThreads : 1;
+    std::vector<std::vector<unsigned int> > spirv;
+    if (Options & EOptionSpv) {
+        glslang::PermutationsToSpv(permutations, &Resources, defaultVersion, ENoProfile, false, messages, spirv,
+                                   numThreads, GetSpvOptions());
+    } else
+        permutations.compile(&Resources, defaultVersion, ENoProfile, false, messages, glslang::TPermutations::TLinked(),
+                             numThreads);
+
+    for (int p = 0; p < permutations.getNumPermutations(); ++p) {
+        if (! (Options & EOptionSuppressInfolog)) {
+            printf("permutation %d: %s\n", p, Permutations[p]);
+            if (permutations.getCompiledAs(p) != p)
+                printf("same as permutation %d\n", permutations.getCompiledAs(p));
+            else
+                PutsIfNonEmpty(permutations.getInfoLog(p));
+        }
+        if (! permutations.succeeded(p))
+            CompileFailed = true;
+        else if (Options & EOptionSpv)
+            OutputStageSpv(stage, spirv[p], std::to_string(p).c_str());
+    }
+}
+
+//
+// For --server: compile shaders as requests for them come in on stdin,
+// writing each one's log and SPIR-V back on stdout, so a build pays for
+// process start-up, the config file, and the built-in symbol tables once,
+// instead of once per shader.  Requests are lines of one of:
+//
+//   compile <file>               compile the file <file>
+//   source <bytes> <name>        compile the <bytes> bytes following the line;
+//                                <name> picks the stage and names it in the log
+//   quit                         stop, as does the end of stdin
+//
+// Each is answered, in the order asked, with a line
+//
+//   <status> <log bytes> <spirv bytes>
+//
+// where <status> is "ok" or "failed", followed by the log and then the SPIR-V
+// words, in the machine's byte order.  With -t or -j, requests compile
+// concurrently, on that many threads.  Nothing else is written to stdout;
+// messages from outside the compiles, like those of missing SPIR-V
+// functionality, which still exit the process, go to stderr.
+//
+namespace {
+
+// Responses to write, in request order, as the compiles finish in any order.
+class TServerResponses {
+public:
+    explicit TServerResponses(FILE* out) : out(out), next(0) { }
+
+    void done(int request, bool success, const std::string& log, const std::vector<unsigned int>& spirv)
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        TResponse& response = finished[request];
+        response.success = success;
+        response.log = log;
+        response.spirv = spirv;
+
+        for (auto it = finished.find(next); it != finished.end(); it = finished.find(++next)) {
+            write(it->second);
+            finished.erase(it);
+        }
+        fflush(out);
+    }
+
+protected:
+    struct TResponse {
+        bool success;
+        std::string log;
+        std::vector<unsigned int> spirv;
+    };
+
+    void write(const TResponse& response)
+    {
+        fprintf(out, "%s %u %u\n", response.success ? "ok" : "failed", (unsigned int)response.log.size(),
+               (unsigned int)(response.spirv.size() * sizeof(unsigned int)));
+        fwrite(response.log.data(), 1, response.log.size(), out);
+        fwrite(response.spirv.data(), sizeof(unsigned int), response.spirv.size(), out);
+    }
+
+    FILE* out;
+    std::mutex mutex;
+    std::map<int, TResponse> finished;
+    int next;
+};
+
+// Read a request line, without its newline; false at the end of stdin.
+bool ReadRequestLine(std::string& line)
+{
+    line.clear();
+    int c;
+    while ((c = getchar()) != EOF && c != '\n')
+        line += (char)c;
+    if (! line.empty() && line.back() == '\r')
+        line.pop_back();
+
+    return c != EOF || ! line.empty();
+}
+
+};  // end anonymous namespace
+
+int ServeCompiles()
+{
+    EShMessages messages = EShMsgDefault;
+    SetMessageOptions(messages);
+
+    glslang::TBatch::TJob job;
+    job.resources = &Resources;
+    job.defaultVersion = Options & EOptionDefaultDesktop ? 110 : 100;
+    job.messages = messages;
+    job.reflection = false;
+
+    const glslang::SpvOptions spvOptions = GetSpvOptions();
+    auto linked = [&spvOptions](int, glslang::TProgram& program, glslang::TBatch::TResult& result) {
+        for (int stage = 0; stage < EShLangCount; ++stage) {
+            if (program.getIntermediate((EShLanguage)stage)) {
+                glslang::GlslangToSpv(*program.getIntermediate((EShLanguage)stage), result.spirv, spvOptions);
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // only responses go to stdout; anything else printed goes to stderr
+    FILE* out = glslang::OS_TakeStdout();
+    if (out == nullptr) {
+        printf("Failed to set up stdout for responses\n");
+        return EFailUsage;
+    }
+    TServerResponses responses(out);
+    glslang::TAsyncCompiler compiler((Options & EOptionMultiThreaded) ? NumThreads : 1, linked);
+
+    std::string line;
+    for (int request = 0; ReadRequestLine(line) && line != "quit"; ++request) {
+        std::string name;
+        bool valid = true;
+        if (line.compare(0, 8, "compile ") == 0) {
+            name = line.substr(8);
+            size_t size;
+            const char* data = glslang::OS_MapFile(name.c_str(), size);
+            valid = data != nullptr;
+            if (valid) {
+                job.source.assign(data, size);
+                glslang::OS_UnmapFile(data, size);
+            }
+        } else if (line.compare(0, 7, "source ") == 0) {
+            char* end;
+            unsigned long bytes = strtoul(line.c_str() + 7, &end, 10);
+            valid = end != line.c_str() + 7 && *end == ' ';
+            if (valid) {
+                name = end + 1;
+                job.source.resize(bytes);
+                valid = fread(&job.source[0], 1, bytes, stdin) == bytes;
+            }
+        } else
+            valid = false;
+
+        if (! valid || ! FindStage(name, job.stage)) {
+            responses.done(request, false, "Error: bad request: " + line + "\n", std::vector<unsigned int>());
+            continue;
+        }
+
+        compiler.submit(job, [&responses, request](int, const glslang::TBatch::TResult& result) {
+            responses.done(request, result.success, result.infoLog, result.spirv);
+        });
+    }
+
+    compiler.wait();
+    fclose(out);
+
+    return ESuccess;
+}
+
+//
+// With --builtins, have the built-in symbol tables read from the snapshot rather
+// than parsed.
+//
+void LoadBuiltIns()
+{
+    if (BuiltInsFileName && ! glslang::LoadBuiltInSnapshot(BuiltInsFileName))
+        Error((std::string("unable to load the built-ins of ") + BuiltInsFileName).c_str());
+}
+
+//
+// For --write-builtins: write the built-in symbol tables of every version and
+// profile to a snapshot.
+//
+bool WriteBuiltIns()
+{
+    std::vector<std::pair<int, EProfile> > versionProfiles;
+    const int esVersions[] = { 100, 300, 310 };
+    for (int v = 0; v < (int)(sizeof(esVersions) / sizeof(esVersions[0])); ++v)
+        versionProfiles.push_back(std::make_pair(esVersions[v], EEsProfile));
+    const int versions[] = { 110, 120, 130, 140 };
+    for (int v = 0; v < (int)(sizeof(versions) / sizeof(versions[0])); ++v)
+        versionProfiles.push_back(std::make_pair(versions[v], ENoProfile));
+    const int profileVersions[] = { 150, 330, 400, 410, 420, 430, 440, 450 };
+    for (int v = 0; v < (int)(sizeof(profileVersions) / sizeof(profileVersions[0])); ++v) {
+        versionProfiles.push_back(std::make_pair(profileVersions[v], ECoreProfile));
+        versionProfiles.push_back(std::make_pair(profileVersions[v], ECompatibilityProfile));
+    }
+
+    return glslang::SaveBuiltInSnapshot(WriteBuiltInsFileName, versionProfiles);
+}
+
+//
+// Exit without running destructors: the process-lifetime structures are left
+// for the exit to reclaim (see FinalizeProcessForExit()), so the output is
+// flushed here rather than when the streams are destroyed.
+//
+void FastExit(int code)
+{
+    std::cout.flush();
+    fflush(stdout);
+    fflush(stderr);
+    _Exit(code);
+}
+
 int C_DECL main(int argc, char* argv[])
 {
     ProcessArguments(argc, argv);
 
     if (Options & EOptionDumpConfig) {
-        printf("%s", DefaultConfig);
+        printf("%s", glslang::DefaultConfig);
         if (Worklist.empty())
             return ESuccess;
     }
@@ -792,6 +1523,28 @@ int C_DECL main(int argc, char* argv[])
             return ESuccess;
     }
 
+    if (Options & EOptionNuma)
+        glslang::SetNumaSharding(true);
+
+    if (WriteBuiltInsFileName) {
+        glslang::InitializeProcess();
+        if (! WriteBuiltIns())
+            Error((std::string("unable to write the built-ins to ") + WriteBuiltInsFileName).c_str());
+        glslang::FinalizeProcessForExit();
+        FastExit(ESuccess);
+        return ESuccess;
+    }
+
+    if (Options & EOptionServer) {
+        ProcessConfigFile();
+        glslang::InitializeProcess();
+        LoadBuiltIns();
+        const int result = ServeCompiles();
+        glslang::FinalizeProcessForExit();
+        FastExit(result);
+        return result;
+    }
+
     if (Worklist.empty()) {
         usage();
     }
@@ -806,24 +1559,21 @@ int C_DECL main(int argc, char* argv[])
     if (Options & EOptionLinkProgram ||
         Options & EOptionOutputPreprocessed) {
         glslang::InitializeProcess();
-        CompileAndLinkShaders();
-        glslang::FinalizeProcess();
+        LoadBuiltIns();
+        if (Permutations.empty())
+            CompileAndLinkShaders();
+        else
+            CompilePermutations();
+        glslang::FinalizeProcessForExit();
     } else {
         ShInitialize();
+        LoadBuiltIns();
 
         bool printShaderNames = Worklist.size() > 1;
 
         if (Options & EOptionMultiThreaded) {
-            const int NumThreads = 16;
-            void* threads[NumThreads];
-            for (int t = 0; t < NumThreads; ++t) {
-                threads[t] = glslang::OS_CreateThread(&CompileShaders);
-                if (! threads[t]) {
-                    printf("Failed to create thread\n");
-                    return EFailThreadCreate;
-                }
-            }
-            glslang::OS_WaitForAllThreads(threads, NumThreads);
+            if (! CompileShadersMultiThreaded())
+                return EFailThreadCreate;
         } else
             CompileShaders(0);
 
@@ -837,15 +1587,17 @@ int C_DECL main(int argc, char* argv[])
             }
         }
 
-        ShFinalize();
+        glslang::FinalizeProcessForExit();
     }
 
+    int result = ESuccess;
     if (CompileFailed)
-        return EFailCompile;
-    if (LinkFailed)
-        return EFailLink;
+        result = EFailCompile;
+    else if (LinkFailed)
+        result = EFailLink;
 
-    return 0;
+    FastExit(result);
+    return result;
 }
 
 //
@@ -861,28 +1613,39 @@ int C_DECL main(int argc, char* argv[])
 //
 EShLanguage FindLanguage(const std::string& name)
 {
-    size_t ext = name.rfind('.');
-    if (ext == std::string::npos) {
+    EShLanguage stage;
+    if (! FindStage(name, stage))
         usage();
-        return EShLangVertex;
-    }
+
+    return stage;
+}
+
+// As FindLanguage(), but returning false for a name of no stage, rather than exiting.
+bool FindStage(const std::string& name, EShLanguage& stage)
+{
+    stage = EShLangVertex;
+
+    size_t ext = name.rfind('.');
+    if (ext == std::string::npos)
+        return false;
 
     std::string suffix = name.substr(ext + 1, std::string::npos);
     if (suffix == "vert")
-        return EShLangVertex;
+        stage = EShLangVertex;
     else if (suffix == "tesc")
-        return EShLangTessControl;
+        stage = EShLangTessControl;
     else if (suffix == "tese")
-        return EShLangTessEvaluation;
+        stage = EShLangTessEvaluation;
     else if (suffix == "geom")
-        return EShLangGeometry;
+        stage = EShLangGeometry;
     else if (suffix == "frag")
-        return EShLangFragment;
+        stage = EShLangFragment;
     else if (suffix == "comp")
-        return EShLangCompute;
+        stage = EShLangCompute;
+    else
+        return false;
 
-    usage();
-    return EShLangVertex;
+    return true;
 }
 
 //
@@ -960,6 +1723,10 @@ void usage()
            "  -G          create SPIR-V binary, under OpenGL semantics; turns on -l;\n"
            "              default file name is <stage>.spv (-o overrides this)\n"
            "  -H          print human readable form of SPIR-V; turns on -V\n"
+           "  -O          promote locals to SSA values, and reuse loaded values and common\n"
+           "              subexpressions in SPIR-V; requires a binary option (e.g., -V)\n"
+           "  -J          like -T, but as JSON\n"
+           "  -T          print the time and pool allocations spent in each phase\n"
            "  -E          print pre-processed GLSL; cannot be used with -l;\n"
            "              errors will appear on stderr.\n"
            "  -c          configuration dump;\n"
@@ -968,15 +1735,76 @@ void usage()
            "              (default is ES version 100)\n"
            "  -h          print this usage message\n"
            "  -i          intermediate tree (glslang AST) is printed out\n"
+           "  -j  <n>     use <n> threads in multi-threaded mode; turns on -t;\n"
+           "              0 (the default) uses one thread per hardware thread\n"
            "  -l          link all input files together to form a single module\n"
            "  -m          memory leak mode\n"
            "  -o  <file>  save binary into <file>, requires a binary option (e.g., -V)\n"
-           "  -q          dump reflection query database\n"
+           "  -q          dump reflection query database (with -V, from the SPIR-V)\n"
            "  -r          relaxed semantic error-checking mode\n"
            "  -s          silent mode\n"
-           "  -t          multi-threaded mode\n"
-           "  -v          print version strings\n"
+           "  -t          multi-threaded mode; with -l, parses the linked files concurrently\n"
+           "              and, with -V, generates their functions' SPIR-V concurrently\n"
+           "  -v          print version strings; with -t, also per-thread statistics\n"
            "  -w          suppress warnings (except as required by #extension : warn)\n"
+           "  --benchmark <n>  generate each stage's SPIR-V <n> times instead of saving it,\n"
+           "              printing the time spent translating, dumping, and remapping it,\n"
+           "              and the peak memory used; requires a binary option (e.g., -V)\n"
+           "  --builtins <file>  read the built-in symbol tables from <file>, a snapshot\n"
+           "              --write-builtins wrote, instead of parsing them; any it doesn't\n"
+           "              have, or has of other built-ins, are still parsed\n"
+           "  --write-builtins <file>  write the built-in symbol tables of every version\n"
+           "              and profile to <file>, for --builtins; takes no input files\n"
+           "  --cache-dir <dir>  reuse SPIR-V from <dir> for unchanged inputs and settings,\n"
+           "              and save newly generated SPIR-V there; requires a binary option\n"
+           "  --ast-file <file>  like -i, but write the intermediate trees to <file> as\n"
+           "              they're printed, instead of holding them for the info log;\n"
+           "              requires linking (e.g., -l or -V)\n"
+           "  --entry-point <name>  make <name>() an entry point, in place of main();\n"
+           "              given more than once, the shaders are parsed once, and each\n"
+           "              entry point's SPIR-V, without what only the others call, is\n"
+           "              saved to the output's directory as <name>.<output file name>;\n"
+           "              requires linking (e.g., -l or -V)\n"
+           "  --depfile <file>  write a Make rule to <file> listing the inputs of the\n"
+           "              SPIR-V, for Make or Ninja; requires a binary option (e.g., -V)\n"
+           "  --skip-unchanged  do nothing if each SPIR-V output's <output>.hash file\n"
+           "              says it's of the same inputs and settings, and otherwise write\n"
+           "              one with the output; requires a binary option (e.g., -V)\n"
+           "  --permutation <defines>  compile the one input file once for each\n"
+           "              --permutation given, under its comma-separated NAME or NAME=VALUE\n"
+           "              #defines, sharing what doesn't depend on them (see TPermutations);\n"
+           "              with -V, permutation <n>'s SPIR-V is saved as <n>.<output file\n"
+           "              name>; requires linking (e.g., -l or -V)\n"
+           "  --library   link a library: main() is optional, and the SPIR-V exports its\n"
+           "              functions and imports those it calls without defining them\n"
+           "              (see spirv-remap --link); requires linking (e.g., -l or -V)\n"
+           "  --server    compile shaders requested on stdin, answering with their logs\n"
+           "              and SPIR-V on stdout (see ServeCompiles()); takes no input files,\n"
+           "              and requires a binary option (e.g., -V)\n"
+           "  --remap     canonicalize, strip, and dead-code eliminate the SPIR-V as it's\n"
+           "              generated, as spirv-remap --do-everything would afterwards;\n"
+           "              requires a binary option (e.g., -V)\n"
+           "  --trim-interface  make each stage's outputs that the next stage linked\n"
+           "              doesn't read private to the stage, removing the stores to\n"
+           "              them; requires linking (e.g., -l or -V)\n"
+           "  --inline    inline functions returning a small expression of their 'in'\n"
+           "              parameters, folding the constants that propagates, through\n"
+           "              locals too; requires linking (e.g., -l or -V)\n"
+           "  --counters  print counts of the compiler's inner-loop work: tokens, macro\n"
+           "              expansions, symbol lookups and misses, overload candidates,\n"
+           "              AST nodes, and SPIR-V instructions built and remapped; as\n"
+           "              JSON with -J\n"
+           "  --stream-functions  write out each function's SPIR-V as soon as it's\n"
+           "              translated, freeing its IR, for less memory on large shaders;\n"
+           "              the same SPIR-V (ids aside, with -O), from one thread;\n"
+           "              requires a binary option (e.g., -V)\n"
+           "  --mediump-16bit  hold mediump and lowp values in 16-bit ints and floats,\n"
+           "              converting them to 32 bits for memory others see, arrays,\n"
+           "              structures, matrices, and function parameters; requires a\n"
+           "              binary option (e.g., -V)\n"
+           "  --numa      pin the worker threads to the machine's NUMA nodes in turn,\n"
+           "              each node keeping its own copy of the built-in symbol tables\n"
+           "              and its own page cache; requires -t\n"
            );
 
     exit(EFailUsage);
@@ -1079,6 +1907,30 @@ char** ReadFileData(const char* fileName)
     return return_data;
 }
 
+//
+//   Map a file read-only, for handing straight to TShader::setStringsWithLengths()
+//   without copying it.  The result is not null terminated.
+//
+const char* MapFileData(const char* fileName, int& length)
+{
+    size_t size;
+    const char* data = glslang::OS_MapFile(fileName, size);
+    if (data == nullptr)
+        Error("unable to open input file");
+    if (size > INT_MAX) {
+        glslang::OS_UnmapFile(data, size);
+        Error("input file too large");
+    }
+    length = (int)size;
+
+    return data;
+}
+
+void UnmapFileData(const char* data, int length)
+{
+    glslang::OS_UnmapFile(data, (size_t)length);
+}
+
 void FreeFileData(char** data)
 {
     for(int i = 0; i < NumShaderStrings; i++)
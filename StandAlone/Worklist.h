@@ -35,9 +35,10 @@
 #ifndef WORKLIST_H_INCLUDED
 #define WORKLIST_H_INCLUDED
 
-#include "osinclude.h"
+#include <atomic>
+#include <mutex>
 #include <string>
-#include <list>
+#include <vector>
 
 namespace glslang {
 
@@ -51,46 +52,52 @@ namespace glslang {
         std::string resultsIndex;
     };
 
+    //
+    // Work items are appended while setting up, and then consumed by any number
+    // of worker threads.  Removal is lock free: it is a single atomic bump of the
+    // read cursor, so the cost of dispatch does not grow with the worker count.
+    //
+    // add() may be called concurrently with other add() calls, but all adding must
+    // complete before any thread starts calling remove().
+    //
     class TWorklist {
     public:
-        TWorklist() { }
+        TWorklist() : next(0) { }
         virtual ~TWorklist() { }
 
         void add(TWorkItem* item)
         {
-            GetGlobalLock();
-            
+            std::lock_guard<std::mutex> guard(addMutex);
+
             worklist.push_back(item);
-            
-            ReleaseGlobalLock();
         }
     
         bool remove(TWorkItem*& item)
         {
-            GetGlobalLock();
-            
-            if (worklist.empty())
+            size_t index = next.fetch_add(1, std::memory_order_relaxed);
+            if (index >= worklist.size())
                 return false;
-            item = worklist.front();
-            worklist.pop_front();
-            
-            ReleaseGlobalLock();
+            item = worklist[index];
 
             return true;
         }
 
         int size()
         {
-            return (int)worklist.size();
+            size_t taken = next.load(std::memory_order_relaxed);
+
+            return taken >= worklist.size() ? 0 : (int)(worklist.size() - taken);
         }
 
         bool empty()
         {
-            return worklist.empty();
+            return size() == 0;
         }
 
     protected:
-        std::list<TWorkItem*> worklist;
+        std::vector<TWorkItem*> worklist;
+        std::atomic<size_t> next;
+        std::mutex addMutex;
     };
 
 } // end namespace glslang
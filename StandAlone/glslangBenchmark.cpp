@@ -0,0 +1,421 @@
+//
+//Copyright (C) 2015 LunarG, Inc.
+//
+//All rights reserved.
+//
+//Redistribution and use in source and binary forms, with or without
+//modification, are permitted provided that the following conditions
+//are met:
+//
+//    Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+//    Redistributions in binary form must reproduce the above
+//    copyright notice, this list of conditions and the following
+//    disclaimer in the documentation and/or other materials provided
+//    with the distribution.
+//
+//    Neither the name of 3Dlabs Inc. Ltd. nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+//THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+//FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+//COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+//BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+//LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+//ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//POSSIBILITY OF SUCH DAMAGE.
+
+
+//
+// glslangBenchmark: compile corpora of shaders through the library many times,
+// reporting throughput, time per phase, and peak pool memory, and optionally
+// comparing them to a baseline saved by an earlier run.
+//
+// It stops at the linked tree.  SPIR-V generation is benchmarked by
+// glslangValidator --benchmark instead (Test/runbenchmark runs it over the
+// corpus), with one process per shader: translating a shader that hits
+// missing functionality ends the process, which would end a whole corpus here.
+//
+
+#include "ResourceLimits.h"
+#include "../glslang/Public/ShaderLang.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+    // A set of shaders compiled with the same messages, e.g., those of one list file.
+    struct TCorpus {
+        std::string name;
+        EShMessages messages;
+        bool preprocessOnly;
+        std::vector<std::string> fileNames;
+        std::vector<std::string> sources;      // parallel to fileNames
+        std::vector<EShLanguage> stages;       // parallel to fileNames
+    };
+
+    // What one run over a corpus measured.
+    struct TCorpusResult {
+        TCorpusResult() : shaders(0), seconds(0.0), poolPeakBytes(0)
+        {
+            for (int phase = 0; phase < EShPhaseCount; ++phase)
+                phaseSeconds[phase] = 0.0;
+        }
+
+        int shaders;                           // compiles, counting each iteration
+        double seconds;                        // wall clock of those compiles
+        double phaseSeconds[EShPhaseCount];
+        size_t poolPeakBytes;
+    };
+
+    const char* const phaseNames[EShPhaseCount] = {
+        "built-ins", "preprocess", "parse", "final-check", "link", "reflection"
+    };
+
+    TBuiltInResource Resources;
+
+    void usage()
+    {
+        std::cout << "Usage: glslangBenchmark [option]... [shader | -l list | -V list | -E list]...\n"
+                     "\n"
+                     "Compiles each shader, and each shader named in a list file (one per line, relative\n"
+                     "to the list file, with '#' starting a comment line), the given number of times:\n"
+                     "  -l <list>  parse and link the shaders of <list>, as glslangValidator -l does\n"
+                     "  -V <list>  the same with the SPIR-V and Vulkan rules, as glslangValidator -V does\n"
+                     "  -E <list>  only preprocess the shaders of <list>, as glslangValidator -E does\n"
+                     "\n"
+                     "Options:\n"
+                     "  -n <iterations>  times to compile each shader, after one warm-up pass (default 10)\n"
+                     "  -b <file>        compare the results to the baseline in <file>, failing if one\n"
+                     "                   it has regressed by more than the threshold\n"
+                     "  -t <percent>     the threshold for -b (default 10)\n"
+                     "  -w <file>        write the results to <file>, as a baseline for -b; its\n"
+                     "                   shaders/s are only comparable on the machine that wrote it\n"
+                     "\n"
+                     "Returns 0 on success, 1 for a usage or file error, and 2 for a regression.\n"
+                     "SPIR-V generation isn't timed; see glslangValidator --benchmark and Test/runbenchmark.\n";
+
+        exit(1);
+    }
+
+    bool FindStage(const std::string& name, EShLanguage& stage)
+    {
+        size_t ext = name.rfind('.');
+        if (ext == std::string::npos)
+            return false;
+
+        std::string suffix = name.substr(ext + 1);
+        if (suffix == "vert")
+            stage = EShLangVertex;
+        else if (suffix == "tesc")
+            stage = EShLangTessControl;
+        else if (suffix == "tese")
+            stage = EShLangTessEvaluation;
+        else if (suffix == "geom")
+            stage = EShLangGeometry;
+        else if (suffix == "frag")
+            stage = EShLangFragment;
+        else if (suffix == "comp")
+            stage = EShLangCompute;
+        else
+            return false;
+
+        return true;
+    }
+
+    bool ReadFile(const std::string& fileName, std::string& contents)
+    {
+        std::ifstream stream(fileName.c_str(), std::ios::binary);
+        if (! stream)
+            return false;
+
+        std::ostringstream text;
+        text << stream.rdbuf();
+        contents = text.str();
+
+        return true;
+    }
+
+    // Add 'fileName' to 'corpus' if it names a shader stage; returns false if it can't be read.
+    bool AddShader(TCorpus& corpus, const std::string& fileName)
+    {
+        EShLanguage stage;
+        if (! FindStage(fileName, stage)) {
+            std::cerr << "glslangBenchmark: skipping " << fileName << ", which has no stage extension\n";
+            return true;
+        }
+
+        std::string source;
+        if (! ReadFile(fileName, source)) {
+            std::cerr << "glslangBenchmark: can't read " << fileName << "\n";
+            return false;
+        }
+
+        corpus.fileNames.push_back(fileName);
+        corpus.sources.push_back(source);
+        corpus.stages.push_back(stage);
+
+        return true;
+    }
+
+    bool AddList(TCorpus& corpus, const std::string& listName)
+    {
+        std::string list;
+        if (! ReadFile(listName, list)) {
+            std::cerr << "glslangBenchmark: can't read " << listName << "\n";
+            return false;
+        }
+
+        const size_t sep = listName.find_last_of("/\\");
+        const std::string directory = sep == std::string::npos ? std::string() : listName.substr(0, sep + 1);
+
+        std::istringstream lines(list);
+        std::string line;
+        while (std::getline(lines, line)) {
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            if (line.empty() || line[0] == '#')
+                continue;
+            if (! AddShader(corpus, directory + line))
+                return false;
+        }
+
+        return true;
+    }
+
+    // Compile every shader of 'corpus' once, adding what it measured into 'result'.
+    void CompileCorpus(const TCorpus& corpus, TCorpusResult& result)
+    {
+        const EShMessages messages = (EShMessages)(corpus.messages | EShMsgTiming);
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        for (size_t s = 0; s < corpus.sources.size(); ++s) {
+            const char* source = corpus.sources[s].c_str();
+            glslang::TShader shader(corpus.stages[s]);
+            shader.setStrings(&source, 1);
+
+            if (corpus.preprocessOnly) {
+                std::string output;
+                shader.preprocess(&Resources, 100, ENoProfile, false, false, messages, &output, glslang::TShader::ForbidInclude());
+            } else if (shader.parse(&Resources, 100, false, messages)) {
+                glslang::TProgram program;
+                program.addShader(&shader);
+                program.link(messages);
+
+                const ShTimingStats& linkTiming = program.getTimingStats();
+                for (int phase = 0; phase < EShPhaseCount; ++phase)
+                    result.phaseSeconds[phase] += linkTiming.seconds[phase];
+                result.poolPeakBytes = std::max(result.poolPeakBytes, program.getMemoryStats().poolPeakBytes);
+            }
+
+            const ShTimingStats& timing = shader.getTimingStats();
+            for (int phase = 0; phase < EShPhaseCount; ++phase)
+                result.phaseSeconds[phase] += timing.seconds[phase];
+            result.poolPeakBytes = std::max(result.poolPeakBytes, shader.getMemoryStats().poolPeakBytes);
+            ++result.shaders;
+        }
+
+        result.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    double ShadersPerSecond(const TCorpusResult& result)
+    {
+        return result.seconds > 0.0 ? result.shaders / result.seconds : 0.0;
+    }
+
+    // The figures compared against a baseline, by name.
+    typedef std::map<std::string, double> TFigures;
+
+    void AddFigures(TFigures& figures, const std::string& name, const TCorpusResult& result)
+    {
+        figures[name + " shaders/s"] = ShadersPerSecond(result);
+        figures[name + " pool-peak-bytes"] = (double)result.poolPeakBytes;
+    }
+
+    void PrintResult(const std::string& name, const TCorpusResult& result, int shaders)
+    {
+        std::cout << name << ": " << shaders << " shaders, " << (long)ShadersPerSecond(result) << " shaders/s, peak pool "
+                  << result.poolPeakBytes << " bytes\n";
+        std::cout << "    ms per shader:";
+        for (int phase = 0; phase < EShPhaseCount; ++phase)
+            std::cout << " " << phaseNames[phase] << " " << (result.shaders > 0 ? 1000.0 * result.phaseSeconds[phase] / result.shaders : 0.0);
+        std::cout << "\n";
+    }
+
+    // Baselines are lines of "<figure name> <value>".
+    bool ReadBaseline(const std::string& fileName, TFigures& figures)
+    {
+        std::string text;
+        if (! ReadFile(fileName, text))
+            return false;
+
+        std::istringstream lines(text);
+        std::string line;
+        while (std::getline(lines, line)) {
+            if (line.empty() || line[0] == '#')
+                continue;
+            const size_t sep = line.rfind(' ');
+            if (sep == std::string::npos)
+                continue;
+            figures[line.substr(0, sep)] = atof(line.c_str() + sep + 1);
+        }
+
+        return true;
+    }
+
+    bool WriteBaseline(const std::string& fileName, const TFigures& figures, int iterations)
+    {
+        std::ofstream stream(fileName.c_str());
+        stream << "# glslangBenchmark -n " << iterations << "; shaders/s depends on the machine that wrote it\n";
+        stream.setf(std::ios::fixed);
+        stream.precision(0);
+        for (TFigures::const_iterator figure = figures.begin(); figure != figures.end(); ++figure)
+            stream << figure->first << " " << figure->second << "\n";
+
+        return stream.good();
+    }
+
+    // Returns the number of figures that regressed from 'baseline' by more than 'threshold' percent:
+    // throughput that fell, or memory that grew.  Only the figures the baseline has are compared, so
+    // one without shaders/s, like that for the benchmark target, checks memory alone.
+    int CompareToBaseline(const TFigures& figures, const TFigures& baseline, double threshold)
+    {
+        int regressions = 0;
+        for (TFigures::const_iterator figure = figures.begin(); figure != figures.end(); ++figure) {
+            TFigures::const_iterator base = baseline.find(figure->first);
+            if (base == baseline.end() || base->second <= 0.0)
+                continue;
+
+            const bool higherIsBetter = figure->first.find("shaders/s") != std::string::npos;
+            const double change = 100.0 * (figure->second - base->second) / base->second;
+            if ((higherIsBetter ? -change : change) > threshold) {
+                std::cout << "regression: " << figure->first << " " << (long)figure->second << " is " << std::abs(change)
+                          << "% " << (higherIsBetter ? "below" : "above") << " the baseline " << (long)base->second << "\n";
+                ++regressions;
+            }
+        }
+
+        return regressions;
+    }
+
+} // end anonymous namespace
+
+int main(int argc, char** argv)
+{
+    int iterations = 10;
+    double threshold = 10.0;
+    const char* baselineName = nullptr;
+    const char* writeName = nullptr;
+    std::vector<TCorpus> corpora;
+
+    TCorpus shaders;
+    shaders.name = "shaders";
+    shaders.messages = EShMsgDefault;
+    shaders.preprocessOnly = false;
+
+    for (int a = 1; a < argc; ++a) {
+        const std::string arg = argv[a];
+        if (arg.size() == 2 && arg[0] == '-') {
+            if (a + 1 == argc)
+                usage();
+            const char* value = argv[++a];
+            switch (arg[1]) {
+            case 'n': iterations = atoi(value); break;
+            case 't': threshold = atof(value);  break;
+            case 'b': baselineName = value;     break;
+            case 'w': writeName = value;        break;
+            case 'l':
+            case 'V':
+            case 'E':
+            {
+                TCorpus corpus;
+                corpus.name = value;
+                corpus.messages = arg[1] == 'V' ? (EShMessages)(EShMsgSpvRules | EShMsgVulkanRules) : EShMsgDefault;
+                corpus.preprocessOnly = arg[1] == 'E';
+                if (! AddList(corpus, value))
+                    return 1;
+                corpora.push_back(corpus);
+                break;
+            }
+            default:
+                usage();
+            }
+        } else if (! AddShader(shaders, arg))
+            return 1;
+    }
+    if (! shaders.fileNames.empty())
+        corpora.push_back(shaders);
+    if (corpora.empty() || iterations < 1 || threshold < 0.0)
+        usage();
+
+    char* config = new char[strlen(glslang::DefaultConfig) + 1];
+    strcpy(config, glslang::DefaultConfig);
+    glslang::DecodeResourceLimits(&Resources, config);
+    delete [] config;
+
+    glslang::InitializeProcess();
+
+    // One pass first, so the built-in symbol tables are made before timing.
+    std::vector<TCorpusResult> results(corpora.size());
+    for (size_t c = 0; c < corpora.size(); ++c)
+        CompileCorpus(corpora[c], results[c]);
+
+    results.assign(corpora.size(), TCorpusResult());
+    for (int i = 0; i < iterations; ++i) {
+        for (size_t c = 0; c < corpora.size(); ++c)
+            CompileCorpus(corpora[c], results[c]);
+    }
+
+    TFigures figures;
+    TCorpusResult total;
+    int totalShaders = 0;
+    for (size_t c = 0; c < corpora.size(); ++c) {
+        PrintResult(corpora[c].name, results[c], (int)corpora[c].fileNames.size());
+        AddFigures(figures, corpora[c].name, results[c]);
+
+        total.shaders += results[c].shaders;
+        total.seconds += results[c].seconds;
+        for (int phase = 0; phase < EShPhaseCount; ++phase)
+            total.phaseSeconds[phase] += results[c].phaseSeconds[phase];
+        total.poolPeakBytes = std::max(total.poolPeakBytes, results[c].poolPeakBytes);
+        totalShaders += (int)corpora[c].fileNames.size();
+    }
+    std::cout << "\n" << iterations << " iterations\n";
+    PrintResult("total", total, totalShaders);
+    AddFigures(figures, "total", total);
+
+    glslang::FinalizeProcess();
+
+    if (writeName && ! WriteBaseline(writeName, figures, iterations)) {
+        std::cerr << "glslangBenchmark: can't write " << writeName << "\n";
+        return 1;
+    }
+
+    if (baselineName) {
+        TFigures baseline;
+        if (! ReadBaseline(baselineName, baseline)) {
+            std::cerr << "glslangBenchmark: can't read " << baselineName << "\n";
+            return 1;
+        }
+        if (CompareToBaseline(figures, baseline, threshold) > 0)
+            return 2;
+        std::cout << "no regression of more than " << threshold << "% from " << baselineName << "\n";
+    }
+
+    return 0;
+}
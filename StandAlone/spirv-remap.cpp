@@ -34,11 +34,23 @@
 //
 
 #include <iostream>
+#include <iomanip>
 #include <fstream>
+#include <sstream>
 #include <cstring>
 #include <stdexcept>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
 
 #include "../SPIRV/SPVRemapper.h"
+#include "../SPIRV/SpvCache.h"
+#include "../SPIRV/SpvEncoding.h"
+#include "../SPIRV/SpvLinker.h"
+#include "../SPIRV/disassemble.h"
+#include "osinclude.h"
 
 namespace {
 
@@ -65,7 +77,12 @@ namespace {
         return (sepLoc == filename.npos) ? filename : filename.substr(sepLoc+1);
     }
 
+    // Serializes output between the workers of -j.
+    std::mutex outputMutex;
+
     void errHandler(const std::string& str) {
+        // Never unlocked: any other worker's error waits here until exit().
+        outputMutex.lock();
         std::cout << str << std::endl;
         exit(5);
     }
@@ -74,38 +91,81 @@ namespace {
         std::cout << str << std::endl;
     }
 
-    // Read word stream from disk
-    void read(std::vector<SpvWord>& spv, const std::string& inFilename, int verbosity)
-    {
-        std::ifstream fp;
-
-        if (verbosity > 0)
-            logHandler(std::string("  reading: ") + inFilename);
-
-        spv.clear();
-        fp.open(inFilename, std::fstream::in | std::fstream::binary);
+    // A remapper that logs to a given stream, so that with -j each file's log
+    // can be held until the logs of the files before it have been printed.
+    class TStreamRemapper : public spv::spirvbin_t {
+    public:
+        TStreamRemapper(int verbosity, std::ostream& out) : spv::spirvbin_t(verbosity), out(out) { }
+
+    protected:
+        virtual void msg(int minVerbosity, int indent, const std::string& txt) const
+        {
+            if (verbose >= minVerbosity)
+                out << std::string(indent, ' ') << txt << std::endl;
+        }
 
-        if (fp.fail())
-            errHandler("error opening file for read: ");
+        std::ostream& out;
+    };
 
-        // Reserve space (for efficiency, not for correctness)
-        fp.seekg(0, fp.end);
-        spv.reserve(size_t(fp.tellg()) / sizeof(SpvWord));
-        fp.seekg(0, fp.beg);
+    typedef std::vector<spv::spirvbin_t::passstats_t> TPassStats;
 
-        while (!fp.eof()) {
-            SpvWord inWord;
-            fp.read((char *)&inWord, sizeof(inWord));
+    // Print what each remapper pass did, for --stats
+    void printStats(const TPassStats& passes, std::ostream& out)
+    {
+        out << "    " << std::left << std::setw(20) << "pass" << std::right
+            << std::setw(12) << "ms" << std::setw(16) << "words removed" << std::setw(12) << "IDs mapped"
+            << std::setw(14) << "instructions" << std::endl;
+
+        for (const auto& pass : passes) {
+            out << "    " << std::left << std::setw(20) << pass.name << std::right
+                << std::setw(12) << std::fixed << std::setprecision(3) << pass.seconds * 1000.0
+                << std::setw(16) << pass.wordsRemoved << std::setw(12) << pass.idsMapped
+                << std::setw(14) << pass.instructions << std::endl;
+        }
+    }
 
-            if (!fp.eof()) {
-                spv.push_back(inWord);
-                if (fp.fail())
-                    errHandler(std::string("error reading file: ") + inFilename);
+    // The passes' stats summed over all the files, for --stats
+    class TStatsTotal {
+    public:
+        void add(const TPassStats& passes)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const auto& pass : passes) {
+                auto total = std::find_if(totals.begin(), totals.end(),
+                                          [&](const spv::spirvbin_t::passstats_t& t) { return strcmp(t.name, pass.name) == 0; });
+                if (total == totals.end())
+                    totals.push_back(pass);
+                else {
+                    total->seconds      += pass.seconds;
+                    total->wordsRemoved += pass.wordsRemoved;
+                    total->idsMapped    += pass.idsMapped;
+                    total->instructions += pass.instructions;
+                }
             }
         }
-    }
 
-    void write(std::vector<SpvWord>& spv, const std::string& outFile, int verbosity)
+        void print(std::ostream& out) const
+        {
+            out << "  stats: all files" << std::endl;
+            printStats(totals, out);
+        }
+
+    protected:
+        std::mutex mutex;
+        TPassStats totals;
+    };
+
+    // What to do with each input file
+    enum TMode {
+        ModeRemap,      // remap SPIR-V
+        ModeStore,      // remap SPIR-V, and store it as a manifest of sections
+        ModeAssemble,   // assemble SPIR-V from a manifest
+        ModeEncode,     // remap SPIR-V, and encode it compactly
+        ModeDecode,     // decode SPIR-V
+        ModeLink,       // link all the SPIR-V into one, and remap that
+    };
+
+    void write(const void* data, size_t size, const std::string& outFile, int verbosity, std::ostream& log)
     {
         if (outFile.empty())
             errHandler("missing output filename.");
@@ -113,18 +173,16 @@ namespace {
         std::ofstream fp;
 
         if (verbosity > 0)
-            logHandler(std::string("  writing: ") + outFile);
+            log << "  writing: " << outFile << std::endl;
 
         fp.open(outFile, std::fstream::out | std::fstream::binary);
 
         if (fp.fail())
             errHandler(std::string("error opening file for write: ") + outFile);
 
-        for (auto word : spv) {
-            fp.write((char *)&word, sizeof(word));
-            if (fp.fail())
-                errHandler(std::string("error writing file: ") + outFile);
-        }
+        fp.write((const char *)data, size);
+        if (fp.fail())
+            errHandler(std::string("error writing file: ") + outFile);
 
         // file is closed by destructor
     }
@@ -144,29 +202,245 @@ namespace {
             << " [--opt (all|loadstore)]"
             << " [--strip-all | --strip all | -s]" 
             << " [--do-everything]" 
+            << " [-j N]"
+            << " [--store STOREDIR | --encode]"
+            << " [--stats]"
+            << " --input | -i file1 [file2...] --output|-o DESTDIR"
+            << std::endl;
+
+        std::cout << "  " << basename(name)
+            << " [-v[v[...]] | --verbose [int]]"
+            << " [-j N]"
+            << " --assemble STOREDIR"
+            << " --input | -i manifest1 [manifest2...] --output|-o DESTDIR"
+            << std::endl;
+
+        std::cout << "  " << basename(name)
+            << " [-v[v[...]] | --verbose [int]]"
+            << " [-j N]"
+            << " --decode"
+            << " --input | -i file1 [file2...] --output|-o DESTDIR"
+            << std::endl;
+
+        std::cout << "  " << basename(name)
+            << " [-v[v[...]] | --verbose [int]]"
+            << " [--map (all|types|names|funcs)]"
+            << " [--dce (all|types|funcs)]"
+            << " [--opt (all|loadstore)]"
+            << " [--strip-all | --strip all | -s]"
+            << " [--do-everything]"
+            << " [--stats]"
+            << " [--disassemble]"
+            << " --link NAME"
             << " --input | -i file1 [file2...] --output|-o DESTDIR"
             << std::endl;
 
+        std::cout << std::endl
+                  << "  -j N remaps N files at a time (0 for one per hardware thread);"
+                  << " the log is printed in file order" << std::endl
+                  << "  --store adds each remapped SPIR's sections to STOREDIR, sharing them"
+                  << " between SPIRs, and writes a manifest of them in place of the SPIR" << std::endl
+                  << "  --assemble writes the SPIR each manifest names, from its sections in STOREDIR" << std::endl
+                  << "  --encode writes each remapped SPIR in a compact encoding, which --decode reverses" << std::endl
+                  << "  --link links the SPIRs, resolving the functions they import (see glslangValidator"
+                  << " --library), and writes the remapped result as DESTDIR/NAME" << std::endl
+                  << "  --disassemble also prints the linked SPIR's disassembly" << std::endl
+                  << "  --stats prints the time, words removed, and IDs mapped of each remapping pass,"
+                  << " for each SPIR and in total"
+                  << std::endl << std::endl;
+
         std::cout << "  " << basename(name) << " [--version | -V]" << std::endl;
         std::cout << "  " << basename(name) << " [--help | -?]" << std::endl;
 
         exit(5);
     }
 
-    // grind through each SPIR in turn
-    void execute(const std::vector<std::string>& inputFile, const std::string& outputDir,
-        int opts, int verbosity)
+    // add a remapped SPIR to the store, and write the manifest to reassemble it from
+    void storeSpv(const SpvWord* spv, size_t count, const glslang::TSpvStore& store, const std::string& outFile,
+        int verbosity, std::ostream& log)
     {
+        std::vector<std::string> sections;
+        if (! store.add(spv, count, sections))
+            errHandler(std::string("error storing sections of: ") + outFile);
+
+        if (verbosity > 0)
+            log << "  writing manifest of " << sections.size() << " sections: " << outFile << std::endl;
+
+        if (! glslang::TSpvStore::writeManifest(outFile, sections))
+            errHandler(std::string("error writing file: ") + outFile);
+    }
+
+    // read, remap, and write one SPIR, or its manifest or encoding.  The
+    // remapping is done in place, in a private mapping of the file, so the
+    // binary is never copied into memory of our own, unless it's about to be
+    // written over.
+    void remapFile(const std::string& filename, const std::string& outputDir, int opts, int verbosity,
+        TMode mode, const glslang::TSpvStore& store, TStatsTotal* statsTotal, std::ostream& log)
+    {
+        if (verbosity > 0)
+            log << "  reading: " << filename << std::endl;
+
+        size_t size;
+        char* data = glslang::OS_MapFileCopy(filename.c_str(), size);
+        if (data == 0)
+            errHandler(std::string("error opening file for read: ") + filename);
+
+        SpvWord* spv = reinterpret_cast<SpvWord*>(data);
+        TStreamRemapper remapper(verbosity, log);
+        const size_t count = remapper.remap(spv, size / sizeof(SpvWord), opts);
+
+        if (statsTotal != nullptr) {
+            log << "  stats: " << filename << std::endl;
+            printStats(remapper.getStats(), log);
+            statsTotal->add(remapper.getStats());
+        }
+
+        const std::string outfile = outputDir + path_sep_char() + basename(filename);
+
+        if (mode == ModeStore) {
+            storeSpv(spv, count, store, outfile, verbosity, log);
+            glslang::OS_UnmapFile(data, size);
+        } else if (mode == ModeEncode) {
+            std::vector<unsigned char> encoded;
+            const bool isSpv = spv::EncodeSpv(spv, count, encoded);
+            glslang::OS_UnmapFile(data, size);
+            if (! isSpv)
+                errHandler(std::string("error encoding file: ") + filename);
+            write(encoded.data(), encoded.size(), outfile, verbosity, log);
+        } else if (glslang::OS_SameFile(filename.c_str(), outfile.c_str())) {
+            // the mapping can't outlive the file being rewritten
+            std::vector<SpvWord> remapped(spv, spv + count);
+            glslang::OS_UnmapFile(data, size);
+            write(remapped.data(), remapped.size() * sizeof(SpvWord), outfile, verbosity, log);
+        } else {
+            write(spv, count * sizeof(SpvWord), outfile, verbosity, log);
+            glslang::OS_UnmapFile(data, size);
+        }
+    }
+
+    // read one encoded SPIR, and write it decoded
+    void decodeFile(const std::string& filename, const std::string& outputDir, int verbosity, std::ostream& log)
+    {
+        if (verbosity > 0)
+            log << "  reading: " << filename << std::endl;
+
+        size_t size;
+        const char* data = glslang::OS_MapFile(filename.c_str(), size);
+        if (data == 0)
+            errHandler(std::string("error opening file for read: ") + filename);
+
+        std::vector<SpvWord> spv;
+        const bool decoded = spv::DecodeSpv(reinterpret_cast<const unsigned char*>(data), size, spv);
+        glslang::OS_UnmapFile(data, size);
+        if (! decoded)
+            errHandler(std::string("error decoding file: ") + filename);
+
+        write(spv.data(), spv.size() * sizeof(SpvWord), outputDir + path_sep_char() + basename(filename), verbosity, log);
+    }
+
+    // read one manifest, and write the SPIR it names
+    void assembleFile(const std::string& filename, const std::string& outputDir, int verbosity,
+        const glslang::TSpvStore& store, std::ostream& log)
+    {
+        if (verbosity > 0)
+            log << "  reading manifest: " << filename << std::endl;
+
+        std::vector<std::string> sections;
+        if (! glslang::TSpvStore::readManifest(filename, sections))
+            errHandler(std::string("error reading manifest: ") + filename);
+
+        std::vector<SpvWord> spv;
+        if (! store.assemble(sections, spv))
+            errHandler(std::string("missing sections for manifest: ") + filename);
+
+        write(spv.data(), spv.size() * sizeof(SpvWord), outputDir + path_sep_char() + basename(filename), verbosity, log);
+    }
+
+    // read all the SPIRs, link them into one, and write it remapped
+    void linkFiles(const std::vector<std::string>& inputFile, const std::string& outFile, int opts, int verbosity,
+        bool stats, bool disassemble)
+    {
+        std::vector<std::vector<SpvWord>> modules;
         for (const auto& filename : inputFile) {
-            std::vector<SpvWord> spv;
-            read(spv, filename, verbosity);
-            spv::spirvbin_t(verbosity).remap(spv, opts);
+            if (verbosity > 0)
+                std::cout << "  reading: " << filename << std::endl;
 
-            const std::string outfile = outputDir + path_sep_char() + basename(filename);
+            size_t size;
+            const char* data = glslang::OS_MapFile(filename.c_str(), size);
+            if (data == 0)
+                errHandler(std::string("error opening file for read: ") + filename);
 
-            write(spv, outfile, verbosity);
+            const SpvWord* spv = reinterpret_cast<const SpvWord*>(data);
+            modules.push_back(std::vector<SpvWord>(spv, spv + size / sizeof(SpvWord)));
+            glslang::OS_UnmapFile(data, size);
         }
 
+        std::vector<SpvWord> linked;
+        std::string errors;
+        if (! spv::LinkSpv(modules, linked, errors)) {
+            errors.pop_back();
+            errHandler("error linking: " + errors);
+        }
+
+        TStreamRemapper remapper(verbosity, std::cout);
+        remapper.remap(linked, opts);
+
+        if (stats) {
+            std::cout << "  stats: " << outFile << std::endl;
+            printStats(remapper.getStats(), std::cout);
+        }
+
+        write(linked.data(), linked.size() * sizeof(SpvWord), outFile, verbosity, std::cout);
+
+        if (disassemble)
+            spv::Disassemble(std::cout, linked);
+    }
+
+    typedef std::function<void(const std::string& filename, std::ostream& log)> TFileProcessor;
+
+    // grind through each file in turn
+    void execute(const std::vector<std::string>& inputFile, const TFileProcessor& process, int verbosity)
+    {
+        for (const auto& filename : inputFile)
+            process(filename, std::cout);
+
+        if (verbosity > 0)
+            std::cout << "Done: " << inputFile.size() << " file(s) processed" << std::endl;
+    }
+
+    // grind through the files on 'jobs' threads; each file's log is printed
+    // once it and every file before it are done
+    void executeParallel(const std::vector<std::string>& inputFile, const TFileProcessor& process,
+        int verbosity, int jobs)
+    {
+        if (jobs == 0)
+            jobs = int(std::thread::hardware_concurrency());
+        jobs = std::max(1, std::min(jobs, int(inputFile.size())));
+
+        std::vector<std::ostringstream> logs(inputFile.size());
+        std::vector<bool>               done(inputFile.size(), false);
+        size_t                          nextToPrint = 0;
+        std::atomic<size_t>             nextFile(0);
+
+        const auto worker = [&]() {
+            for (size_t f = nextFile++; f < inputFile.size(); f = nextFile++) {
+                process(inputFile[f], logs[f]);
+
+                std::lock_guard<std::mutex> lock(outputMutex);
+                done[f] = true;
+                for (; nextToPrint < inputFile.size() && done[nextToPrint]; ++nextToPrint) {
+                    std::cout << logs[nextToPrint].str();
+                    logs[nextToPrint].str(std::string());
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < jobs; ++t)
+            threads.push_back(std::thread(worker));
+        for (auto& thread : threads)
+            thread.join();
+
         if (verbosity > 0)
             std::cout << "Done: " << inputFile.size() << " file(s) processed" << std::endl;
     }
@@ -175,13 +449,23 @@ namespace {
     void parseCmdLine(int argc, char** argv, std::vector<std::string>& inputFile,
         std::string& outputDir,
         int& options,
-        int& verbosity)
+        int& verbosity,
+        int& jobs,
+        TMode& mode,
+        std::string& storeDir,
+        std::string& linkName,
+        bool& stats,
+        bool& disassemble)
     {
         if (argc < 2)
             usage(argv[0]);
 
         verbosity  = 0;
         options    = spv::spirvbin_t::NONE;
+        jobs       = 1;
+        mode       = ModeRemap;
+        stats      = false;
+        disassemble = false;
 
         // Parse command line.
         // boost::program_options would be quite a bit nicer, but we don't want to
@@ -224,6 +508,52 @@ namespace {
                     }
                 }
             }
+            else if (arg == "-j") {
+                if (++a >= argc)
+                    usage(argv[0], "-j requires an argument");
+
+                char* end_ptr = 0;
+                jobs = ::strtol(argv[a], &end_ptr, 10);
+                if (*end_ptr != '\0' || end_ptr == argv[a] || jobs < 0)
+                    usage(argv[0], "-j requires a number of jobs, or 0 for one per hardware thread");
+                ++a;
+            }
+            else if (arg == "--store" || arg == "--assemble") {
+                if (++a >= argc)
+                    usage(argv[0], (arg + " requires a store directory").c_str());
+                if (mode != ModeRemap)
+                    usage(argv[0], "--store, --assemble, --encode, --decode, and --link can't be combined");
+
+                mode = arg == "--assemble" ? ModeAssemble : ModeStore;
+                storeDir = argv[a++];
+
+                while (!storeDir.empty() && storeDir.back() == path_sep_char())
+                    storeDir.pop_back();
+            }
+            else if (arg == "--stats") {
+                stats = true;
+                ++a;
+            }
+            else if (arg == "--disassemble") {
+                disassemble = true;
+                ++a;
+            }
+            else if (arg == "--encode" || arg == "--decode") {
+                if (mode != ModeRemap)
+                    usage(argv[0], "--store, --assemble, --encode, --decode, and --link can't be combined");
+
+                mode = arg == "--decode" ? ModeDecode : ModeEncode;
+                ++a;
+            }
+            else if (arg == "--link") {
+                if (++a >= argc)
+                    usage(argv[0], "--link requires the name of the linked file");
+                if (mode != ModeRemap)
+                    usage(argv[0], "--store, --assemble, --encode, --decode, and --link can't be combined");
+
+                mode = ModeLink;
+                linkName = argv[a++];
+            }
             else if (arg == "--version" || arg == "-V") {
                 std::cout << basename(argv[0]) << " version 0.97 " << __DATE__ << " " << __TIME__ << std::endl;
                 exit(0);
@@ -316,6 +646,12 @@ int main(int argc, char** argv)
     std::string              outputDir;
     int                      opts;
     int                      verbosity;
+    int                      jobs;
+    TMode                    mode;
+    std::string              storeDir;
+    std::string              linkName;
+    bool                     stats;
+    bool                     disassemble;
 
 #ifdef use_cpp11
     // handle errors by exiting
@@ -328,15 +664,47 @@ int main(int argc, char** argv)
     if (argc < 2)
         usage(argv[0]);
 
-    parseCmdLine(argc, argv, inputFile, outputDir, opts, verbosity);
+    parseCmdLine(argc, argv, inputFile, outputDir, opts, verbosity, jobs, mode, storeDir, linkName, stats, disassemble);
 
     if (outputDir.empty())
         usage(argv[0], "Output directory required");
 
+    if (mode == ModeLink) {
+        linkFiles(inputFile, outputDir + path_sep_char() + linkName, opts, verbosity, stats, disassemble);
+        return 0;
+    }
+
     std::string errmsg;
 
-    // Main operations: read, remap, and write.
-    execute(inputFile, outputDir, opts, verbosity);
+    const glslang::TSpvStore store(storeDir);
+    TStatsTotal statsTotal;
+    TFileProcessor process;
+    switch (mode) {
+    case ModeAssemble:
+        process = [&](const std::string& filename, std::ostream& log) {
+            assembleFile(filename, outputDir, verbosity, store, log);
+        };
+        break;
+    case ModeDecode:
+        process = [&](const std::string& filename, std::ostream& log) {
+            decodeFile(filename, outputDir, verbosity, log);
+        };
+        break;
+    default:
+        process = [&](const std::string& filename, std::ostream& log) {
+            remapFile(filename, outputDir, opts, verbosity, mode, store, stats ? &statsTotal : nullptr, log);
+        };
+        break;
+    }
+
+    // Main operations: read, remap, and write (or store, assemble, encode, or decode).
+    if (jobs == 1)
+        execute(inputFile, process, verbosity);
+    else
+        executeParallel(inputFile, process, verbosity, jobs);
+
+    if (stats && mode != ModeAssemble && mode != ModeDecode)
+        statsTotal.print(std::cout);
 
     // If we get here, everything went OK!  Nothing more to be done.
 }
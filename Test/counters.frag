@@ -0,0 +1,20 @@
+#version 450
+
+#define SCALE(x) ((x) * 2.0)
+#define BIAS 0.5
+
+layout(location = 0) in vec4 color;
+layout(location = 1) flat in int count;
+layout(location = 0) out vec4 fragColor;
+
+float weight(float f)
+{
+    return SCALE(f) + BIAS;
+}
+
+void main()
+{
+    float w = weight(float(count));
+    float m = max(color.x, count);  // no exact match, so max() is found by conversion
+    fragColor = color * w + vec4(SCALE(m), BIAS, 0.0, 1.0);
+}
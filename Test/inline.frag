@@ -0,0 +1,50 @@
+#version 450
+
+uniform float u;
+in vec4 color;
+out vec4 outColor;
+
+float scale(float x, float s) { return x * s; }
+float square(float x) { return x * x; }
+float lengthSquared(vec2 v) { return square(v.x) + square(v.y); }
+vec3 tint(vec3 c) { return c * vec3(0.5, 0.25, 2.0); }
+float unused(float x) { return x + 1.0; }
+
+void split(float x, out float whole, out float part)
+{
+    part = modf(x, whole);
+}
+
+float accumulate(float x)
+{
+    float sum = 0.0;
+    for (int i = 0; i < 4; ++i)
+        sum += x;
+    return sum;
+}
+
+void main()
+{
+    const float k = scale(2.0, 3.0);     // folds to 6.0
+    float b = k + 1.0;                   // then this to 7.0
+    float l = lengthSquared(vec2(3.0, 4.0));
+    int n = 2;
+    vec4 v = color * b;
+
+    v.x = scale(v.y, float(n));          // inlined, not folded
+    v.y = square(u + v.z);               // argument read twice isn't simple: not inlined
+    float i = 1.0;
+    v.z = scale(i++, 2.0);               // argument with a side effect: not inlined
+
+    float whole;
+    float part = modf(l, whole);         // 'whole' is written by modf(): not propagated
+    float w2, p2;
+    split(v.w, w2, p2);                  // 'out' parameters: not inlined
+
+    if (l > 20.0)                        // constant test: only the taken branch is kept
+        v += vec4(1.0);
+    else
+        v -= vec4(1.0);
+
+    outColor = vec4(tint(v.xyz), l) + vec4(whole, part, accumulate(w2), p2);
+}
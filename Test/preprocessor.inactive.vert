@@ -0,0 +1,31 @@
+#version 310 es
+#define A 1
+
+#if 0
+  int x = 0x12345678912345; "a string // with /* markers
+  float f = 1e99999; // #else
+/* a comment hiding
+#else
+   */ #error not a directive, the comment makes it the first token
+foo /*
+ */ #error preceded by a token
+  \
+#error continued from a blank line
+#ifdef A
+#error nested
+#else
+#error nested else
+#endif
+   # /* */ elif A
+#define C 3
+#endif
+
+#ifndef A
+bad
+#elif A == 1
+/**/	# define B 2
+#else
+bad
+#endif
+
+void main() { gl_Position = vec4(B, C, 0, 1); }
@@ -0,0 +1,28 @@
+#version 450
+
+struct Light {
+    vec4 color;
+    vec3 direction;
+};
+
+layout(binding = 0) uniform Lights {
+    Light lights[8];
+    int numLights;
+} ubo;
+
+in vec3 normal;
+in vec2 uv;
+
+out vec4 color;
+
+void main()
+{
+    vec4 sum = vec4(0.0);
+    for (int i = 0; i < ubo.numLights; ++i) {
+        float d = max(dot(normal, ubo.lights[i].direction), 0.0);
+        sum += ubo.lights[i].color * d + ubo.lights[i].color * (uv.x * uv.y);
+        sum += ubo.lights[i].color * (uv.y * uv.x);
+    }
+
+    color = sum;
+}
@@ -0,0 +1,15 @@
+#version 450
+
+layout(location = 0) in float inF;
+layout(location = 0) out vec4 outColor;
+
+float leaf(float x) { return x * 3.0; }
+float reached(float x) { return leaf(x) + 1.0; }
+
+float deadLeaf(float x) { return x - 4.0; }
+float dead(float x) { return deadLeaf(x) * reached(x); }
+
+void main()
+{
+    outColor = vec4(reached(inF));
+}
@@ -0,0 +1,45 @@
+#version 450
+
+uniform vec4 bigColor;
+uniform int Count;
+uniform float scale[4];
+
+in vec4 BaseColor;
+in float f;
+
+out vec4 color;
+
+float helper(float a, out float b)
+{
+    b = a * 2.0;
+    return a + b;
+}
+
+void main()
+{
+    vec4 c = BaseColor;
+    float s = 0.0;
+    int i = 0;
+    bool done;
+
+    while (i < Count) {
+        if (c.x > f)
+            c += bigColor;
+        else
+            c -= bigColor;
+        s += scale[1] * scale[1];
+        ++i;
+    }
+
+    if (s > 1.0)
+        done = true;
+
+    float localArray[2];
+    localArray[0] = s;
+    localArray[1] = localArray[0] + localArray[0];
+
+    float outParam;
+    s += helper(s, outParam) + outParam;
+
+    color = c * s + vec4(localArray[1]) + (done ? vec4(1.0) : vec4(0.0));
+}
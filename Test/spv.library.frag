@@ -0,0 +1,20 @@
+#version 450
+
+float scale(float x);
+
+float square(float x)
+{
+    return x * x;
+}
+
+vec4 shade(vec4 c, inout float w)
+{
+    w = square(w);
+    return c * scale(w);
+}
+
+vec4 shade(vec4 c)
+{
+    float w = 2.0;
+    return shade(c, w);
+}
@@ -0,0 +1,16 @@
+#version 450
+
+layout(location = 0) in vec4 color;
+layout(location = 0) out vec4 fragColor;
+
+vec4 shade(vec4 c);
+
+float scale(float x)
+{
+    return x * 0.5;
+}
+
+void main()
+{
+    fragColor = shade(color);
+}
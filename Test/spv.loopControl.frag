@@ -0,0 +1,28 @@
+#version 450
+
+uniform float uf;
+in vec4 inColor;
+out vec4 outColor;
+
+void main()
+{
+    vec4 color = inColor;
+
+    #pragma loop(unroll)
+    for (int i = 0; i < 4; ++i) {
+        #pragma loop(dont_unroll)
+        while (color.x < uf)
+            color.x += 1.0;
+        color.y += 0.5;
+    }
+
+    #pragma loop(dont_unroll)
+    do {
+        color.z -= 1.0;
+    } while (color.z > uf);
+
+    for (int j = 0; j < 2; ++j)
+        color.w += uf;
+
+    outColor = color;
+}
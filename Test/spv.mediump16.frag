@@ -0,0 +1,51 @@
+#version 310 es
+precision mediump float;
+precision mediump int;
+
+in vec4 color;
+flat in ivec2 texel;
+in highp vec2 coord;
+
+uniform sampler2D tex;
+uniform highp mat2 rotation;
+uniform mediump float scales[4];
+
+out vec4 fragColor;
+
+mediump float total;
+
+lowp float weigh(mediump float a, highp float b)
+{
+    return a * b + 0.25;
+}
+
+void main()
+{
+    mediump vec4 c = color * 0.5;
+    highp float h = coord.x;
+    mediump float m = c.y + h;
+    lowp int i = texel.x;
+    mediump uint u = uint(i) + 3u;
+
+    c.xy = rotation * c.zw;
+    c += texture(tex, coord * m);
+
+    for (mediump int n = 0; n < 4; ++n)
+        total += scales[n] * c[n & 3];
+
+    bool b = m > h;
+    float s = b ? sin(m) : cos(m);
+    float whole;
+    float f = modf(s, whole);
+
+    switch (i) {
+    case 1:
+        f = dot(c.xyz, vec3(1.0, 2.0, 3.0));
+        break;
+    default:
+        f = mix(f, weigh(f, h), 0.75);
+        break;
+    }
+
+    fragColor = vec4(total + f, float(u), whole, float(b));
+}
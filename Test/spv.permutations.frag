@@ -0,0 +1,12 @@
+#version 450
+
+layout(location = 0) out vec4 color;
+
+void main()
+{
+#ifdef RED
+    color = vec4(SCALE, 0.0, 0.0, 1.0);
+#else
+    color = vec4(0.0, 0.0, SCALE, 1.0);
+#endif
+}
@@ -0,0 +1,14 @@
+#version 450
+
+layout(constant_id = 2047) const int largeId = 4;
+layout(constant_id = 2147483647) const float largestId = 1.0;
+layout(constant_id = -1) const int negativeId = 1;
+
+float sized[largeId];                   // ERROR, spec constant array size
+const int twice = largeId * 2;          // ERROR, global const initialized from a spec constant
+
+void main()
+{
+    float local[largeId];               // ERROR, spec constant array size
+    gl_Position = vec4(largestId);
+}
@@ -0,0 +1,24 @@
+#version 400
+
+layout(constant_id = 16) const int arraySize = 5;
+layout(constant_id = 17) const float scale = 2.0;
+layout(constant_id = 18) const bool useColor = true;
+layout(constant_id = 19) const uint tileWidth = 8u;
+layout(constant_id = 20) const float unused = 1.0;
+const float notSpecialized = 2.0;
+
+uniform vec4 ucol[5];
+in vec4 dupIn;
+out vec4 color;
+
+void main()
+{
+    vec4 pos = vec4(scale);
+    vec2 tile = vec2(scale, notSpecialized);
+    uvec3 tiles = uvec3(tileWidth, tileWidth, 1u);
+    if (useColor)
+        color = ucol[arraySize - 1] * scale;
+    else
+        color = dupIn * notSpecialized;
+    gl_Position = pos * vec4(tile, float(tiles.x), 1.0);
+}
@@ -0,0 +1,11 @@
+#version 450
+
+in vec4 used;
+layout(location = 3) in vec2 renamed;   // reads byLocation
+
+out vec4 color;
+
+void main()
+{
+    color = used + vec4(renamed, 0.0, 0.0);
+}
@@ -0,0 +1,20 @@
+#version 450
+
+layout(location = 0) in vec4 position;
+
+out vec4 used;
+out vec4 unused;                    // not read by the fragment shader: trimmed with its store
+out float readBack;                 // not read by the fragment shader, but by this shader: trimmed
+layout(location = 3) out vec2 byLocation;
+out Block { vec4 member; } blockOut;
+
+void main()
+{
+    used = position;
+    unused = position * 2.0;
+    readBack = position.x;
+    used.x += readBack;
+    byLocation = position.xy;
+    blockOut.member = position;
+    gl_Position = position;
+}
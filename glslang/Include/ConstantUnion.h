@@ -419,55 +419,67 @@ class TConstUnionArray {
 public:
     POOL_ALLOCATOR_NEW_DELETE(GetThreadPoolAllocator())
 
-    TConstUnionArray() : unionArray(nullptr) { }
-    virtual ~TConstUnionArray() { }
+    TConstUnionArray() : unionArray(nullptr), start(0), count(0) { }
 
-    explicit TConstUnionArray(int size)
+    explicit TConstUnionArray(int size) : start(0), count(size)
     {
         if (size == 0)
             unionArray = nullptr;
         else
             unionArray =  new TConstUnionVector(size);
     }
-    TConstUnionArray(const TConstUnionArray& a) : unionArray(a.unionArray) { }
-    TConstUnionArray(const TConstUnionArray& a, int start, int size)
+    TConstUnionArray(const TConstUnionArray& a) : unionArray(a.unionArray), start(a.start), count(a.count) { }
+
+    // Use this constructor to share a slice of another array; nothing is copied.
+    TConstUnionArray(const TConstUnionArray& a, int first, int size) :
+        unionArray(size == 0 ? nullptr : a.unionArray), start(size == 0 ? 0 : a.start + first), count(size)
     {
-        unionArray = new TConstUnionVector(size);
-        for (int i = 0; i < size; ++i)
-            (*unionArray)[i] = a[start + i];
+        assert(first >= 0 && first + size <= a.size());
     }
 
     // Use this constructor for a smear operation
-    TConstUnionArray(int size, const TConstUnion& val)
+    TConstUnionArray(int size, const TConstUnion& val) : start(0), count(size)
     {
         unionArray = new TConstUnionVector(size, val);
     }
 
-    int size() const { return unionArray ? (int)unionArray->size() : 0; }
-    TConstUnion& operator[](size_t index) { return (*unionArray)[index]; }
-    const TConstUnion& operator[](size_t index) const { return (*unionArray)[index]; }
+    // Make this an unshared copy of 'copyOf'
+    void deepCopy(const TConstUnionArray& copyOf)
+    {
+        start = 0;
+        count = copyOf.count;
+        if (count == 0)
+            unionArray = nullptr;
+        else {
+            unionArray = new TConstUnionVector(count);
+            std::copy(copyOf.unionArray->begin() + copyOf.start, copyOf.unionArray->begin() + copyOf.start + count,
+                      unionArray->begin());
+        }
+    }
+
+    int size() const { return count; }
+    TConstUnion& operator[](size_t index) { return (*unionArray)[start + index]; }
+    const TConstUnion& operator[](size_t index) const { return (*unionArray)[start + index]; }
     bool operator==(const TConstUnionArray& rhs) const
     {
         // this includes the case that both are unallocated
-        if (unionArray == rhs.unionArray)
+        if (unionArray == rhs.unionArray && start == rhs.start && count == rhs.count)
             return true;
 
-        if (! unionArray || ! rhs.unionArray)
-            return false;
-
-        if (! unionArray || ! rhs.unionArray)
+        if (! unionArray || ! rhs.unionArray || count != rhs.count)
             return false;
 
-        return *unionArray == *rhs.unionArray;
+        return std::equal(unionArray->begin() + start, unionArray->begin() + start + count,
+                          rhs.unionArray->begin() + rhs.start);
     }
     bool operator!=(const TConstUnionArray& rhs) const { return ! operator==(rhs); }
 
     double dot(const TConstUnionArray& rhs)
     {
-        assert(rhs.unionArray->size() == unionArray->size());
+        assert(rhs.count == count);
         double sum = 0.0;
 
-        for (size_t comp = 0; comp < unionArray->size(); ++comp)
+        for (int comp = 0; comp < count; ++comp)
             sum += (*this)[comp].getDConst() * rhs[comp].getDConst();
 
         return sum;
@@ -477,7 +489,9 @@ public:
 
 protected:
     typedef TVector<TConstUnion> TConstUnionVector;
-    TConstUnionVector* unionArray;
+    TConstUnionVector* unionArray;  // can be shared by several arrays, each seeing a slice of it
+    int start;                      // where this array's slice starts in unionArray
+    int count;                      // how many components are in the slice
 };
 
 } // end namespace glslang
@@ -58,7 +58,23 @@ enum TOutputStream {
     EDebugger = 0x01,
     EStdOut = 0x02,
     EString = 0x04,
+    EWriter = 0x08,
 };
+
+//
+// Function info sink output can be streamed to, as it's appended, so a large
+// log (e.g., the AST dump) is written incrementally instead of held in memory.
+// 'text' is not nul-terminated.
+//
+typedef void (*TInfoSinkWriter)(void* context, const char* text, size_t length);
+
+//
+// Function diagnostics (messages with a prefix) can be given to as they're made,
+// instead of being appended to the log.  Those without a location get one with
+// a null name and line 0.
+//
+typedef void (*TInfoSinkDiagnostic)(void* context, TPrefixType, const TSourceLoc&, const char* message);
+
 //
 // Encapsulate info logs for all objects that have them.
 //
@@ -67,7 +83,7 @@ enum TOutputStream {
 //
 class TInfoSinkBase {
 public:
-    TInfoSinkBase() : outputStream(4) {}
+    TInfoSinkBase() : outputStream(4), writer(nullptr), writerContext(nullptr), diagnostic(nullptr), diagnosticContext(nullptr) {}
     void erase() { sink.erase(); }
     TInfoSinkBase& operator<<(const TPersistString& t) { append(t); return *this; }
     TInfoSinkBase& operator<<(char c)                  { append(1, c); return *this; }
@@ -104,11 +120,21 @@ public:
         append(": ");
     }
     void message(TPrefixType message, const char* s) {
+        if (diagnostic && message != EPrefixNone) {
+            TSourceLoc loc;
+            loc.init();
+            diagnostic(diagnosticContext, message, loc, s);
+            return;
+        }
         prefix(message);
         append(s);
         append("\n");
     }
     void message(TPrefixType message, const char* s, const TSourceLoc& loc) {
+        if (diagnostic && message != EPrefixNone) {
+            diagnostic(diagnosticContext, message, loc, s);
+            return;
+        }
         prefix(message);
         location(loc);
         append(s);
@@ -120,6 +146,23 @@ public:
         outputStream = output;
     }
 
+    // Stream the output to 'w' instead of keeping it in the string, which then
+    // stays empty; a null 'w' goes back to the string.
+    void setWriter(TInfoSinkWriter w, void* context)
+    {
+        writer = w;
+        writerContext = context;
+        outputStream = w ? EWriter : EString;
+    }
+
+    // Give the diagnostics of message() to 'd' instead of appending them; a null
+    // 'd' goes back to appending them.
+    void setDiagnosticCallback(TInfoSinkDiagnostic d, void* context)
+    {
+        diagnostic = d;
+        diagnosticContext = context;
+    }
+
 protected:
     void append(const char* s); 
 
@@ -132,6 +175,10 @@ protected:
     void appendToStream(const char* s);
     TPersistString sink;
     int outputStream;
+    TInfoSinkWriter writer;
+    void* writerContext;
+    TInfoSinkDiagnostic diagnostic;
+    void* diagnosticContext;
 };
 
 } // end namespace glslang
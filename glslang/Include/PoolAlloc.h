@@ -174,7 +174,57 @@ public:
     // Call allocate() to actually acquire memory.  Returns 0 if no memory
     // available, otherwise a properly aligned pointer to 'numBytes' of memory.
     //
-    void* allocate(size_t numBytes);
+    // Without guard blocks, the common case of carving from the current page
+    // is a bump of currentPageOffset, inlined here; everything else, including
+    // all guard block tracking, is done out of line by allocateSlow().
+    //
+    void* allocate(size_t numBytes)
+    {
+#ifndef GUARD_BLOCKS
+        size_t endOffset = currentPageOffset + numBytes;
+        if (endOffset <= pageSize) {
+            ++numCalls;
+            totalBytes += numBytes;
+
+            unsigned char* memory = reinterpret_cast<unsigned char*>(inUseList) + currentPageOffset;
+            currentPageOffset = (endOffset + alignmentMask) & ~alignmentMask;
+
+            return memory;
+        }
+#endif
+
+        return allocateSlow(numBytes);
+    }
+
+    // allocate() for an AST node, also counting it
+    void* allocateNode(size_t numBytes)
+    {
+        ++numNodes;
+        return allocate(numBytes);
+    }
+
+    //
+    // Single pages released by any pool allocator, when it is destroyed, are
+    // kept in a process-wide cache of up to 'bytes' bytes, and reused by pools
+    // with the same page size before going to the OS for a new page.  0, the
+    // default, disables the cache.  Lowering the limit frees cached pages
+    // above it.  Each NUMA node a thread is on (see SetThreadMemoryNode()) has
+    // a cache of its own, of up to 'bytes' bytes, so pages stay on their node.
+    //
+    static void setPageCacheLimit(size_t bytes);
+
+    //
+    // Statistics: allocate() calls and bytes requested, AST nodes, pages obtained,
+    // and the bytes of pages currently held (in use or popped but kept
+    // for reuse) along with their high-water mark since resetPeak().
+    //
+    int getNumCalls() const { return numCalls; }
+    int getNumNodes() const { return numNodes; }
+    size_t getTotalBytes() const { return totalBytes; }
+    int getNumPages() const { return numPages; }
+    size_t getHeldBytes() const { return heldBytes; }
+    size_t getPeakHeldBytes() const { return peakHeldBytes; }
+    void resetPeak() { peakHeldBytes = heldBytes; }
 
     //
     // There is no deallocate.  The point of this class is that
@@ -213,6 +263,16 @@ protected:
     };
     typedef std::vector<tAllocState> tAllocStack;
 
+    void* allocateSlow(size_t numBytes);
+    void freePage(char* memory, size_t pageCount);
+    void notePageObtained(size_t pageCount)
+    {
+        ++numPages;
+        heldBytes += pageCount * pageSize;
+        if (heldBytes > peakHeldBytes)
+            peakHeldBytes = heldBytes;
+    }
+
     // Track allocations if and only if we're using guard blocks
 #ifndef GUARD_BLOCKS
     void* initializeAllocation(tHeader*, unsigned char* memory, size_t) {
@@ -239,7 +299,11 @@ protected:
     tAllocStack stack;      // stack of where to allocate from, to partition pool
 
     int numCalls;           // just an interesting statistic
+    int numNodes;           // allocateNode() calls, for TParseLimits::maxNodes
     size_t totalBytes;      // just an interesting statistic
+    int numPages;           // pages obtained, single or multi-page
+    size_t heldBytes;       // bytes of pages in the inUseList and freeList
+    size_t peakHeldBytes;   // high-water mark of heldBytes
 private:
     TPoolAllocator& operator=(const TPoolAllocator&);  // dont allow assignment operator
     TPoolAllocator(const TPoolAllocator&);  // dont allow default copy constructor
@@ -257,10 +321,20 @@ extern TPoolAllocator& GetThreadPoolAllocator();
 struct TThreadMemoryPools
 {
         TPoolAllocator* threadPoolAllocator;
+        int memoryNode;
 };
 
 void SetThreadPoolAllocator(TPoolAllocator& poolAllocator);
 
+//
+// The NUMA node the thread is pinned to, for the page cache and the built-in
+// symbol tables to keep the thread's memory on; 0 for a thread not pinned.
+// Nodes from MaxMemoryNodes on share node 0's.
+//
+const int MaxMemoryNodes = 8;
+void SetThreadMemoryNode(int node);
+int GetThreadMemoryNode();
+
 //
 // This STL compatible allocator is intended to be used as the allocator
 // parameter to templatized STL containers, like vector and map.
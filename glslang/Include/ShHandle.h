@@ -47,11 +47,49 @@
 #include "../Public/ShaderLang.h"
 #include "../MachineIndependent/Versions.h"
 #include "InfoSink.h"
+#include "PoolAlloc.h"
+
+#include <chrono>
 
 class TCompiler;
 class TLinker;
 class TUniformMap;
 
+namespace glslang {
+
+//
+// Adds the wall time and pool allocations from its construction to its
+// destruction into a phase of 'stats', when 'stats' is not null.
+//
+class TPhaseTimer {
+public:
+    TPhaseTimer(ShTimingStats* s, EShPhase p) : stats(s), phase(p)
+    {
+        if (stats) {
+            start = std::chrono::steady_clock::now();
+            startCalls = GetThreadPoolAllocator().getNumCalls();
+        }
+    }
+    ~TPhaseTimer()
+    {
+        if (stats) {
+            stats->seconds[phase] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            stats->poolAllocations[phase] += GetThreadPoolAllocator().getNumCalls() - startCalls;
+        }
+    }
+
+protected:
+    TPhaseTimer(TPhaseTimer&);
+    TPhaseTimer& operator=(TPhaseTimer&);
+
+    ShTimingStats* stats;
+    EShPhase phase;
+    std::chrono::steady_clock::time_point start;
+    int startCalls;
+};
+
+} // end namespace glslang
+
 //
 // The base class used to back handles returned to the driver.
 //
@@ -86,7 +124,12 @@ class TIntermNode;
 //
 class TCompiler : public TShHandleBase {
 public:
-    TCompiler(EShLanguage l, TInfoSink& sink) : infoSink(sink) , language(l), haveValidObjectCode(false) { }
+    TCompiler(EShLanguage l, TInfoSink& sink) : infoSink(sink) , language(l), haveValidObjectCode(false)
+    {
+        memset(&memoryStats, 0, sizeof(memoryStats));
+        memset(&timingStats, 0, sizeof(timingStats));
+        memset(&counterStats, 0, sizeof(counterStats));
+    }
     virtual ~TCompiler() { }
     EShLanguage getLanguage() { return language; }
     virtual TInfoSink& getInfoSink() { return infoSink; }
@@ -97,6 +140,9 @@ public:
     virtual bool linkable() { return haveValidObjectCode; }
     
     TInfoSink& infoSink;
+    ShMemoryStats memoryStats;   // of the most recent compile
+    ShTimingStats timingStats;   // of the most recent compile, if timed
+    ShCounterStats counterStats; // of the most recent compile, if counted
 protected:
     TCompiler& operator=(TCompiler&);
 
@@ -167,8 +167,18 @@ struct TTypeLoc {
 };
 typedef TVector<TTypeLoc> TTypeList;
 
+// What the types of a tree being copied share, mapped to their copies;
+// see TType::deepCopy(const TType&, TTypeCopies&).
+struct TTypeCopies {
+    std::unordered_map<const TArraySizes*, TArraySizes*> arraySizes;
+    std::unordered_map<const TTypeList*, TTypeList*> structures;
+};
+
 typedef TVector<TString*> TIdentifierList;
 
+class TSnapshotWriter;
+class TSnapshotReader;
+
 //
 // Following are a series of helper enums for managing layouts and qualifiers,
 // used for TPublicType, TType, others.
@@ -497,6 +507,8 @@ public:
         layoutXfbStride = layoutXfbStrideEnd;
         layoutXfbOffset = layoutXfbOffsetEnd;
 
+        layoutSpecConstantIndex = layoutSpecConstantIndexEnd;
+
         layoutFormat = ElfNone;
     }
     bool hasLayout() const
@@ -506,10 +518,9 @@ public:
                hasBinding() ||
                hasStream() ||
                hasXfb() ||
-               hasFormat();
+               hasFormat() ||
+               hasSpecConstantId();
     }
-    TLayoutMatrix  layoutMatrix  : 3;
-    TLayoutPacking layoutPacking : 4;
     int layoutOffset;
     int layoutAlign;
 
@@ -519,12 +530,15 @@ public:
                  unsigned int layoutComponent        : 3;
     static const unsigned int layoutComponentEnd =     4;
 
-                 unsigned int layoutSet              : 7;
+                 unsigned int layoutSet              : 6;
     static const unsigned int layoutSetEnd      =   0x3F;
 
                  unsigned int layoutBinding          : 8;
     static const unsigned int layoutBindingEnd =    0xFF;
 
+    // after layoutBinding, to share its word
+    TLayoutMatrix  layoutMatrix  : 3;
+
                  unsigned int layoutIndex           :  8;
     static const unsigned int layoutIndexEnd =      0xFF;
 
@@ -542,6 +556,15 @@ public:
 
     TLayoutFormat layoutFormat                      :  8;
 
+    // after layoutXfbOffset and layoutFormat, to share their word
+    TLayoutPacking layoutPacking : 4;
+
+    // A SpecId is a 32-bit literal, too wide to keep here without growing
+    // every TType.  The ids in use are kept in a table instead, for the
+    // life of the process, and this indexes it; see setSpecConstantId().
+                 unsigned int layoutSpecConstantIndex : 10;
+    static const unsigned int layoutSpecConstantIndexEnd = 0x3FF;
+
     bool hasUniformLayout() const
     {
         return hasMatrix() ||
@@ -596,6 +619,12 @@ public:
     {
         return layoutStream != layoutStreamEnd;
     }
+    bool hasSpecConstantId() const
+    {
+        return layoutSpecConstantIndex != layoutSpecConstantIndexEnd;
+    }
+    bool setSpecConstantId(unsigned int);  // false if the table is full
+    unsigned int getSpecConstantId() const;
     bool hasFormat() const
     {
         return layoutFormat != ElfNone;
@@ -1036,6 +1065,40 @@ public:
             typeName = NewPoolTString(copyOf.typeName->c_str());
     }
     
+    // Deep copy for copying a whole tree: types that shared array sizes or a
+    // structure still share the copies of them, looked up in 'copies'.  Names
+    // don't change after parsing, so those stay shared with the original.
+    void deepCopy(const TType& copyOf, TTypeCopies& copies)
+    {
+        shallowCopy(copyOf);
+
+        if (copyOf.arraySizes) {
+            TArraySizes*& copy = copies.arraySizes[copyOf.arraySizes];
+            if (copy == nullptr) {
+                copy = new TArraySizes;
+                *copy = *copyOf.arraySizes;
+            }
+            arraySizes = copy;
+        }
+
+        if (copyOf.structure) {
+            auto copy = copies.structures.find(copyOf.structure);
+            if (copy != copies.structures.end())
+                structure = copy->second;
+            else {
+                structure = new TTypeList;
+                copies.structures[copyOf.structure] = structure;
+                for (unsigned int i = 0; i < copyOf.structure->size(); ++i) {
+                    TTypeLoc typeLoc;
+                    typeLoc.loc = (*copyOf.structure)[i].loc;
+                    typeLoc.type = new TType();
+                    typeLoc.type->deepCopy(*(*copyOf.structure)[i].type, copies);
+                    structure->push_back(typeLoc);
+                }
+            }
+        }
+    }
+
     TType* clone()
     {
         TType *newType = new TType();
@@ -1044,6 +1107,10 @@ public:
         return newType;
     }
 
+    // For the built-in symbol table snapshots; see TSnapshotWriter in SymbolTable.h.
+    void write(TSnapshotWriter&) const;
+    bool read(TSnapshotReader&);
+
     // Merge type from parent, where a parentType is at the beginning of a declaration,
     // establishing some characteristics for all subsequent names, while this type
     // is on the individual names.
@@ -1285,6 +1352,8 @@ public:
                     p += snprintf(p, end - p, "xfb_offset=%d ", qualifier.layoutXfbOffset);
                 if (qualifier.hasXfbStride())
                     p += snprintf(p, end - p, "xfb_stride=%d ", qualifier.layoutXfbStride);
+                if (qualifier.hasSpecConstantId())
+                    p += snprintf(p, end - p, "constant_id=%u ", qualifier.getSpecConstantId());
                 p += snprintf(p, end - p, ") ");
             }
         }
@@ -1493,6 +1562,14 @@ protected:
     TString *typeName;          // for structure type name
 };
 
+// Every typed AST node holds a TType, so a wider qualifier costs memory
+// everywhere; don't let either grow by accident.  (MSVC doesn't share a
+// word between bit-fields of different types, so its sizes differ.)
+#ifndef _MSC_VER
+static_assert(sizeof(TQualifier) == 24, "TQualifier has grown");
+static_assert(sizeof(TType) == 5 * sizeof(void*) + 32, "TType has grown");
+#endif
+
 } // end namespace glslang
 
 #endif // _TYPES_INCLUDED_
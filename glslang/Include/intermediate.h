@@ -439,7 +439,15 @@ class TIntermSymbol;
 //
 class TIntermNode {
 public:
-    POOL_ALLOCATOR_NEW_DELETE(glslang::GetThreadPoolAllocator())
+    // POOL_ALLOCATOR_NEW_DELETE(), but with the nodes counted by the pool, for TParseLimits
+    void* operator new(size_t s) { return glslang::GetThreadPoolAllocator().allocateNode(s); }
+    void* operator new(size_t, void *_Where) { return (_Where); }
+    void operator delete(void*) { }
+    void operator delete(void *, void *) { }
+    void* operator new[](size_t s) { return glslang::GetThreadPoolAllocator().allocate(s); }
+    void* operator new[](size_t, void *_Where) { return (_Where); }
+    void operator delete[](void*) { }
+    void operator delete[](void *, void *) { }
 
     TIntermNode() { loc.init(); }
     virtual const glslang::TSourceLoc& getLoc() const { return loc; }
@@ -514,6 +522,15 @@ protected:
     TType type;
 };
 
+//
+// Unrolling hint for a loop, from '#pragma loop(unroll)' or '#pragma loop(dont_unroll)'.
+//
+enum TLoopControl {
+    ELoopControlNone,
+    ELoopControlUnroll,
+    ELoopControlDontUnroll,
+};
+
 //
 // Handle for, do-while, and while loops.
 //
@@ -523,17 +540,23 @@ public:
         body(aBody),
         test(aTest),
         terminal(aTerminal),
-        first(testFirst) { }
+        first(testFirst),
+        control(ELoopControlNone) { }
     virtual void traverse(TIntermTraverser*);
     TIntermNode*  getBody() const { return body; }
     TIntermTyped* getTest() const { return test; }
     TIntermTyped* getTerminal() const { return terminal; }
+    void setTest(TIntermTyped* t) { test = t; }
+    void setTerminal(TIntermTyped* t) { terminal = t; }
     bool testFirst() const { return first; }
+    void setLoopControl(TLoopControl c) { control = c; }
+    TLoopControl getLoopControl() const { return control; }
 protected:
     TIntermNode* body;       // code to loop over
     TIntermTyped* test;      // exit condition associated with loop, could be 0 for 'for' loops
     TIntermTyped* terminal;  // exists for for-loops
     bool first;              // true for while and for, not for do-while
+    TLoopControl control;    // unrolling hint
 };
 
 //
@@ -549,6 +572,7 @@ public:
     virtual void traverse(TIntermTraverser*);
     TOperator getFlowOp() const { return flowOp; }
     TIntermTyped* getExpression() const { return expression; }
+    void setExpression(TIntermTyped* e) { expression = e; }
 protected:
     TOperator flowOp;
     TIntermTyped* expression;
@@ -784,7 +808,6 @@ class TIntermAggregate : public TIntermOperator {
 public:
     TIntermAggregate() : TIntermOperator(EOpNull), userDefined(false), pragmaTable(0) { }
     TIntermAggregate(TOperator o) : TIntermOperator(o), pragmaTable(0) { }
-    ~TIntermAggregate() { delete pragmaTable; }
     virtual       TIntermAggregate* getAsAggregate()       { return this; }
     virtual const TIntermAggregate* getAsAggregate() const { return this; }
     virtual void setOperator(TOperator o) { op = o; }
@@ -802,6 +825,7 @@ public:
     bool getOptimize() const { return optimize; }
     bool getDebug() const { return debug; }
     void addToPragmaTable(const TPragmaTable& pTable);
+    bool hasPragmaTable() const { return pragmaTable != 0; }
     const TPragmaTable& getPragmaTable() const { return *pragmaTable; }
 protected:
     TIntermAggregate(const TIntermAggregate&); // disallow copy constructor
@@ -828,6 +852,9 @@ public:
     virtual TIntermTyped* getCondition() const { return condition; }
     virtual TIntermNode* getTrueBlock() const { return trueBlock; }
     virtual TIntermNode* getFalseBlock() const { return falseBlock; }
+    void setCondition(TIntermTyped* c) { condition = c; }
+    void setTrueBlock(TIntermNode* b) { trueBlock = b; }
+    void setFalseBlock(TIntermNode* b) { falseBlock = b; }
     virtual       TIntermSelection* getAsSelectionNode()       { return this; }
     virtual const TIntermSelection* getAsSelectionNode() const { return this; }
 protected:
@@ -848,6 +875,7 @@ public:
     virtual void traverse(TIntermTraverser*);
     virtual TIntermNode* getCondition() const { return condition; }
     virtual TIntermAggregate* getBody() const { return body; }
+    void setCondition(TIntermTyped* c) { condition = c; }
     virtual       TIntermSwitch* getAsSwitchNode()       { return this; }
     virtual const TIntermSwitch* getAsSwitchNode() const { return this; }
 protected:
@@ -862,6 +890,18 @@ enum TVisit
     EvPostVisit
 };
 
+// The kinds of node with children, for TIntermTraverser's stack.
+enum TTraverseKind
+{
+    EtkBinary,
+    EtkUnary,
+    EtkAggregate,
+    EtkSelection,
+    EtkLoop,
+    EtkBranch,
+    EtkSwitch
+};
+
 //
 // For traversing the tree.  User should derive from this, 
 // put their traversal specific data in it, and then pass
@@ -887,7 +927,8 @@ public:
             postVisit(postVisit),
             rightToLeft(rightToLeft),
             depth(0),
-            maxDepth(0) { }
+            maxDepth(0),
+            descending(false) { }
     virtual ~TIntermTraverser() { }
 
     virtual void visitSymbol(TIntermSymbol*)               { }
@@ -920,6 +961,27 @@ public:
         return path.size() == 0 ? NULL : path.back();
     }
 
+    //
+    // For the nodes' traverse() methods.  Past a depth of MaxRecursion, rather
+    // than recursing, a node hands its children to traverseChildren(), which
+    // keeps its own stack of the nodes being traversed, so deep trees don't
+    // use up the thread's stack.  Shallower, recursing is faster.
+    //
+    // beginTraverse() returns true if traverseChildren() is calling the node,
+    // rather than a parent recursing, or a visit function or other code
+    // starting a new traversal.
+    //
+    static const int MaxRecursion = 64;
+    bool beginTraverse()
+    {
+        bool nested = descending;
+        descending = false;
+
+        return nested;
+    }
+    bool useStack(bool nested) const { return nested || depth >= MaxRecursion; }
+    void traverseChildren(TIntermNode*, TTraverseKind, bool nested);
+
     const bool preVisit;
     const bool inVisit;
     const bool postVisit;
@@ -933,6 +995,43 @@ protected:
 
     // All the nodes from root to the current node's parent during traversing.
     TVector<TIntermNode *> path;
+
+    // A node whose children are being traversed.
+    struct TFrame {
+        TIntermNode* node;
+        TTraverseKind kind;
+        int next;       // how many of its children have been started
+        bool visit;     // cleared when an in-visit stops the traversal
+    };
+    TIntermNode* nextChild(TFrame&);
+    void postVisitFrame(const TFrame&);
+
+    std::vector<TFrame> frames;
+    bool descending;    // the next traverse() is for a child taken off 'frames'
+};
+
+//
+// Runs several traversers over a tree in as few walks as possible, instead
+// of each walking the whole tree on its own.  Each traverser gets the same
+// visits, in the same order, with the same depth and getParentNode(), as if
+// it had walked the tree alone, and a subtree one of them skips is skipped
+// just for that one.  The traversers with rightToLeft set share one walk,
+// and those without share another.
+//
+// A visit function that traverses children itself still works, but walks
+// those children on its own.
+//
+class TIntermPassManager {
+public:
+    POOL_ALLOCATOR_NEW_DELETE(glslang::GetThreadPoolAllocator())
+    TIntermPassManager() { }
+    virtual ~TIntermPassManager() { }
+
+    void add(TIntermTraverser* pass) { passes.push_back(pass); }
+    void run(TIntermNode* root);
+
+protected:
+    std::vector<TIntermTraverser*> passes;
 };
 
 } // end namespace glslang
@@ -65,6 +65,39 @@ bool isInf(double x)
 
 const double pi = 3.1415926535897932384626433832795;
 
+struct TAddOp { template<class T> T operator()(T a, T b) const { return a + b; } };
+struct TSubOp { template<class T> T operator()(T a, T b) const { return a - b; } };
+struct TMulOp { template<class T> T operator()(T a, T b) const { return a * b; } };
+
+//
+// Fold a component-wise arithmetic operation, picking the component
+// representation once for the whole array instead of once per component.
+//
+// Returns false for a basic type it doesn't handle.
+//
+template<class Op>
+bool FoldComponentWise(TBasicType basicType, const TConstUnionArray& left, const TConstUnionArray& right,
+                       TConstUnionArray& result, int numComps, Op op)
+{
+    switch (basicType) {
+    case EbtFloat:
+    case EbtDouble:
+        for (int i = 0; i < numComps; i++)
+            result[i].setDConst(op(left[i].getDConst(), right[i].getDConst()));
+        return true;
+    case EbtInt:
+        for (int i = 0; i < numComps; i++)
+            result[i].setIConst(op(left[i].getIConst(), right[i].getIConst()));
+        return true;
+    case EbtUint:
+        for (int i = 0; i < numComps; i++)
+            result[i].setUConst(op(left[i].getUConst(), right[i].getUConst()));
+        return true;
+    default:
+        return false;
+    }
+}
+
 } // end anonymous namespace
 
 
@@ -136,19 +169,25 @@ TIntermTyped* TIntermConstantUnion::fold(TOperator op, const TIntermTyped* const
 
     switch(op) {
     case EOpAdd:
-        for (int i = 0; i < newComps; i++)
-            newConstArray[i] = unionArray[i] + rightUnionArray[i];
+        if (! FoldComponentWise(returnType.getBasicType(), unionArray, rightUnionArray, newConstArray, newComps, TAddOp())) {
+            for (int i = 0; i < newComps; i++)
+                newConstArray[i] = unionArray[i] + rightUnionArray[i];
+        }
         break;
     case EOpSub:
-        for (int i = 0; i < newComps; i++)
-            newConstArray[i] = unionArray[i] - rightUnionArray[i];
+        if (! FoldComponentWise(returnType.getBasicType(), unionArray, rightUnionArray, newConstArray, newComps, TSubOp())) {
+            for (int i = 0; i < newComps; i++)
+                newConstArray[i] = unionArray[i] - rightUnionArray[i];
+        }
         break;
 
     case EOpMul:
     case EOpVectorTimesScalar:
     case EOpMatrixTimesScalar:
-        for (int i = 0; i < newComps; i++)
-            newConstArray[i] = unionArray[i] * rightUnionArray[i];
+        if (! FoldComponentWise(returnType.getBasicType(), unionArray, rightUnionArray, newConstArray, newComps, TMulOp())) {
+            for (int i = 0; i < newComps; i++)
+                newConstArray[i] = unionArray[i] * rightUnionArray[i];
+        }
         break;
     case EOpMatrixTimesMatrix:
         for (int row = 0; row < getMatrixRows(); row++) {
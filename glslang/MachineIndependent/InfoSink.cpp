@@ -52,6 +52,9 @@ void TInfoSinkBase::append(const char* s)
 
     if (outputStream & EStdOut)
         fprintf(stdout, "%s", s);
+
+    if (outputStream & EWriter)
+        writer(writerContext, s, strlen(s));
 }
 
 void TInfoSinkBase::append(int count, char c)       
@@ -72,6 +75,11 @@ void TInfoSinkBase::append(int count, char c)
 
     if (outputStream & EStdOut)
         fprintf(stdout, "%c", c);
+
+    if (outputStream & EWriter) {
+        for (int i = 0; i < count; ++i)
+            writer(writerContext, &c, 1);
+    }
 }
 
 void TInfoSinkBase::append(const TPersistString& t) 
@@ -88,6 +96,9 @@ void TInfoSinkBase::append(const TPersistString& t)
 
     if (outputStream & EStdOut)
         fprintf(stdout, "%s", t.c_str());
+
+    if (outputStream & EWriter)
+        writer(writerContext, t.c_str(), t.size());
 }
 
 void TInfoSinkBase::append(const TString& t)
@@ -104,6 +115,9 @@ void TInfoSinkBase::append(const TString& t)
 
     if (outputStream & EStdOut)
         fprintf(stdout, "%s", t.c_str());
+
+    if (outputStream & EWriter)
+        writer(writerContext, t.c_str(), t.size());
 }
 
 } // end namespace glslang
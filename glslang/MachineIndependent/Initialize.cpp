@@ -2824,7 +2824,7 @@ void TBuiltIns::initialize(const TBuiltInResource &resources, int version, EProf
 void SpecialQualifier(const char* name, TStorageQualifier qualifier, TBuiltInVariable builtIn, TSymbolTable& symbolTable)
 {
     TSymbol* symbol = symbolTable.find(name);
-    if (symbol) {
+    if (symbol && ! symbol->isReadOnly()) {
         TQualifier& symQualifier = symbol->getWritableType().getQualifier();
         symQualifier.storage = qualifier;
         symQualifier.builtIn = builtIn;
@@ -2844,7 +2844,7 @@ void SpecialQualifier(const char* name, TStorageQualifier qualifier, TBuiltInVar
 void BuiltInVariable(const char* name, TBuiltInVariable builtIn, TSymbolTable& symbolTable)
 {
     TSymbol* symbol = symbolTable.find(name);
-    if (! symbol)
+    if (! symbol || symbol->isReadOnly())
         return;
 
     TQualifier& symQualifier = symbol->getWritableType().getQualifier();
@@ -2861,7 +2861,7 @@ void BuiltInVariable(const char* name, TBuiltInVariable builtIn, TSymbolTable& s
 void BuiltInVariable(const char* blockName, const char* name, TBuiltInVariable builtIn, TSymbolTable& symbolTable)
 {
     TSymbol* symbol = symbolTable.find(blockName);
-    if (! symbol)
+    if (! symbol || symbol->isReadOnly())
         return;
 
     TTypeList& structure = *symbol->getWritableType().getWritableStruct();
@@ -3442,6 +3442,8 @@ void IdentifyBuiltIns(int version, EProfile profile, EShLanguage language, TSymb
     default:
         assert(false && "Language not supported");
     }
+
+    symbolTable.relateRecordedOperators();
 }
 
 //
@@ -0,0 +1,637 @@
+//
+//Copyright (C) 2015 LunarG, Inc.
+//
+//All rights reserved.
+//
+//Redistribution and use in source and binary forms, with or without
+//modification, are permitted provided that the following conditions
+//are met:
+//
+//    Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//
+//    Redistributions in binary form must reproduce the above
+//    copyright notice, this list of conditions and the following
+//    disclaimer in the documentation and/or other materials provided
+//    with the distribution.
+//
+//    Neither the name of 3Dlabs Inc. Ltd. nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+//THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+//FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+//COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+//BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+//CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+//LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+//ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//POSSIBILITY OF SUCH DAMAGE.
+//
+
+//
+// Link-time inlining of small functions, and propagation of constants
+// through them and through the locals they initialize, for EShMsgInline.
+//
+
+#include "localintermediate.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+namespace glslang {
+
+namespace {
+
+// An inlined function returns an expression of at most this many nodes.
+// Inlining and folding is repeated at most MaxInlinePasses times, as each
+// pass can make functions inlinable, by inlining the calls they make.
+const int MaxInlinedNodes = 16;
+const int MaxInlinePasses = 4;
+
+typedef std::map<int, TIntermTyped*> TSubstitutes;
+typedef std::map<int, TIntermConstantUnion*> TConstants;
+
+// Counts the nodes of an expression, and how often each symbol is read in it.
+class TCountTraverser : public TIntermTraverser {
+public:
+    TCountTraverser() : nodes(0) { }
+
+    virtual void visitSymbol(TIntermSymbol* node)                   { ++nodes; ++reads[node->getId()]; }
+    virtual void visitConstantUnion(TIntermConstantUnion*)          { ++nodes; }
+    virtual bool visitBinary(TVisit, TIntermBinary*)                { ++nodes; return true; }
+    virtual bool visitUnary(TVisit, TIntermUnary*)                  { ++nodes; return true; }
+    virtual bool visitAggregate(TVisit, TIntermAggregate*)          { ++nodes; return true; }
+    virtual bool visitSelection(TVisit, TIntermSelection*)          { ++nodes; return true; }
+
+    int nodes;
+    std::map<int, int> reads;
+};
+
+// Whether reading 'node' again is no more expensive than reading a variable:
+// it's a variable or constant, or a component or swizzle of one.
+bool IsCheapToRead(TIntermTyped* node)
+{
+    while (node->getAsBinaryNode()) {
+        switch (node->getAsBinaryNode()->getOp()) {
+        case EOpIndexDirect:
+        case EOpIndexDirectStruct:
+        case EOpVectorSwizzle:
+            node = node->getAsBinaryNode()->getLeft();
+            break;
+        default:
+            return false;
+        }
+    }
+
+    return node->getAsSymbolNode() != nullptr || node->getAsConstantUnion() != nullptr;
+}
+
+// A function whose calls can be inlined: its body is a single return of an
+// expression free of side effects, and its parameters are all input only.
+struct TInlineFunction {
+    const TIntermSequence* parameters;
+    TIntermTyped* expression;
+    std::map<int, int> reads;  // of each parameter, by id
+};
+
+typedef std::map<TString, TInlineFunction> TInlineFunctions;
+
+bool GetInlineFunction(TIntermAggregate* function, TInlineFunction& inlined)
+{
+    const TIntermSequence& sequence = function->getSequence();
+    if (sequence.size() != 2)
+        return false;
+    TIntermAggregate* parameters = sequence[0]->getAsAggregate();
+    TIntermAggregate* body = sequence[1]->getAsAggregate();
+    if (parameters == nullptr || body == nullptr || body->getOp() != EOpSequence || body->getSequence().size() != 1)
+        return false;
+    TIntermBranch* branch = body->getSequence()[0]->getAsBranchNode();
+    if (branch == nullptr || branch->getFlowOp() != EOpReturn || branch->getExpression() == nullptr)
+        return false;
+
+    for (size_t p = 0; p < parameters->getSequence().size(); ++p) {
+        TIntermSymbol* parameter = parameters->getSequence()[p]->getAsSymbolNode();
+        if (parameter == nullptr)
+            return false;
+        TStorageQualifier storage = parameter->getQualifier().storage;
+        if (storage != EvqIn && storage != EvqConstReadOnly)
+            return false;
+    }
+
+    // calls, to functions not inlined yet, count as side effects
+    if (TIntermediate::hasSideEffects(branch->getExpression()))
+        return false;
+
+    TCountTraverser count;
+    branch->getExpression()->traverse(&count);
+    if (count.nodes > MaxInlinedNodes)
+        return false;
+
+    inlined.parameters = &parameters->getSequence();
+    inlined.expression = branch->getExpression();
+    inlined.reads = count.reads;
+
+    return true;
+}
+
+// Finds a function's local variables that are assigned a constant where
+// they're declared and never written again, so their reads can be replaced by
+// the constant.  Arrays and structures are left alone, as are variables
+// indexed dynamically, which a constant can't be.
+class TConstantLocalTraverser : public TIntermTraverser {
+public:
+    virtual void visitSymbol(TIntermSymbol* node)
+    {
+        const TType& type = node->getType();
+        TStorageQualifier storage = type.getQualifier().storage;
+        if ((storage == EvqTemporary || storage == EvqConstReadOnly) && ! type.isArray() && ! type.isStruct())
+            locals.insert(node->getId());
+    }
+
+    virtual bool visitBinary(TVisit, TIntermBinary* node)
+    {
+        if (node->getOp() >= EOpAssign && node->getOp() <= EOpRightShiftAssign)
+            write(node->getLeft());
+        else if (node->getOp() == EOpIndexIndirect) {
+            TIntermSymbol* symbol = TIntermediate::getAssignedSymbol(node->getLeft());
+            if (symbol)
+                excluded.insert(symbol->getId());
+        }
+
+        return true;
+    }
+
+    virtual bool visitUnary(TVisit, TIntermUnary* node)
+    {
+        switch (node->getOp()) {
+        case EOpPostIncrement:
+        case EOpPostDecrement:
+        case EOpPreIncrement:
+        case EOpPreDecrement:
+            write(node->getOperand());
+            break;
+        default:
+            break;
+        }
+
+        return true;
+    }
+
+    virtual bool visitAggregate(TVisit, TIntermAggregate* node)
+    {
+        const TIntermSequence& children = node->getSequence();
+        if (node->getOp() == EOpParameters) {
+            // a parameter starts off with its argument, not its first assignment
+            for (size_t c = 0; c < children.size(); ++c) {
+                if (children[c]->getAsSymbolNode())
+                    excluded.insert(children[c]->getAsSymbolNode()->getId());
+            }
+        } else if (node->getOp() == EOpSequence) {
+            for (size_t c = 0; c < children.size(); ++c) {
+                TIntermBinary* assign = children[c]->getAsBinaryNode();
+                if (assign && assign->getOp() == EOpAssign && assign->getLeft()->getAsSymbolNode() && assign->getRight()->getAsConstantUnion())
+                    initializers[assign->getLeft()->getAsSymbolNode()->getId()] = assign->getRight()->getAsConstantUnion();
+            }
+        }
+
+        const TQualifierList& qualifiers = node->getQualifierList();
+        for (size_t q = 0; q < qualifiers.size() && q < children.size(); ++q) {
+            if ((qualifiers[q] == EvqOut || qualifiers[q] == EvqInOut) && children[q]->getAsTyped())
+                write(children[q]->getAsTyped());
+        }
+
+        return true;
+    }
+
+    void getConstants(TConstants& constants)
+    {
+        for (TConstants::const_iterator init = initializers.begin(); init != initializers.end(); ++init) {
+            if (locals.find(init->first) != locals.end() && excluded.find(init->first) == excluded.end() && writes[init->first] == 1)
+                constants[init->first] = init->second;
+        }
+    }
+
+protected:
+    void write(TIntermTyped* target)
+    {
+        TIntermSymbol* symbol = TIntermediate::getAssignedSymbol(target);
+        if (symbol)
+            ++writes[symbol->getId()];
+    }
+
+    std::set<int> locals;
+    std::set<int> excluded;
+    std::map<int, int> writes;
+    TConstants initializers;
+};
+
+// Rewrites a tree bottom up, replacing a node's children as it's post-visited:
+// calls to 'functions' are inlined, reads of the variables in 'constants' or
+// of the parameters in 'substitutes' are replaced by their values, and what
+// that made constant is folded.  Statements assigning the constants are
+// removed, as are those of a constant if-test not taken.  The root itself
+// is only rewritten by calling rewrite() on it.
+class TInlineTraverser : public TIntermTraverser {
+public:
+    TInlineTraverser(TIntermediate& i, const TInlineFunctions& f, const TConstants& c, const TSubstitutes* s = nullptr) :
+        TIntermTraverser(false, false, true), changed(false), intermediate(i), functions(f), constants(c), substitutes(s) { }
+
+    virtual bool visitBinary(TVisit, TIntermBinary* node)
+    {
+        // what's assigned to isn't read
+        if (node->getOp() < EOpAssign || node->getOp() > EOpRightShiftAssign)
+            node->setLeft(rewrite(node->getLeft()));
+        node->setRight(rewrite(node->getRight()));
+
+        return true;
+    }
+
+    virtual bool visitUnary(TVisit, TIntermUnary* node)
+    {
+        switch (node->getOp()) {
+        case EOpPostIncrement:
+        case EOpPostDecrement:
+        case EOpPreIncrement:
+        case EOpPreDecrement:
+            break;
+        default:
+            node->setOperand(rewrite(node->getOperand()));
+            break;
+        }
+
+        return true;
+    }
+
+    virtual bool visitAggregate(TVisit, TIntermAggregate* node)
+    {
+        TIntermSequence& children = node->getSequence();
+        const TQualifierList& qualifiers = node->getQualifierList();
+        for (size_t c = 0; c < children.size(); ++c) {
+            if (c >= qualifiers.size() || (qualifiers[c] != EvqOut && qualifiers[c] != EvqInOut))
+                children[c] = rewriteNode(children[c]);
+        }
+        if (node->getOp() == EOpSequence)
+            removeStatements(children);
+
+        return true;
+    }
+
+    virtual bool visitSelection(TVisit, TIntermSelection* node)
+    {
+        node->setCondition(rewrite(node->getCondition()));
+        node->setTrueBlock(rewriteNode(node->getTrueBlock()));
+        node->setFalseBlock(rewriteNode(node->getFalseBlock()));
+
+        return true;
+    }
+
+    virtual bool visitLoop(TVisit, TIntermLoop* node)
+    {
+        node->setTest(rewrite(node->getTest()));
+        node->setTerminal(rewrite(node->getTerminal()));
+
+        return true;
+    }
+
+    virtual bool visitBranch(TVisit, TIntermBranch* node)
+    {
+        node->setExpression(rewrite(node->getExpression()));
+
+        return true;
+    }
+
+    virtual bool visitSwitch(TVisit, TIntermSwitch* node)
+    {
+        node->setCondition(rewrite(node->getCondition()->getAsTyped()));
+
+        return true;
+    }
+
+    // Returns what replaces 'node', which may be 'node' itself.
+    TIntermTyped* rewrite(TIntermTyped* node)
+    {
+        if (node == nullptr)
+            return nullptr;
+
+        TIntermTyped* result;
+        if (node->getAsSymbolNode())
+            result = substitute(node->getAsSymbolNode());
+        else if (node->getAsAggregate() && node->getAsAggregate()->getOp() == EOpFunctionCall)
+            result = inlineCall(node->getAsAggregate());
+        else
+            result = fold(node);
+
+        if (result != node)
+            changed = true;
+
+        return result;
+    }
+
+    bool changed;
+
+protected:
+    TIntermNode* rewriteNode(TIntermNode* node)
+    {
+        if (node == nullptr || node->getAsTyped() == nullptr)
+            return node;
+
+        return rewrite(node->getAsTyped());
+    }
+
+    TIntermTyped* substitute(TIntermSymbol* symbol)
+    {
+        if (substitutes) {
+            TSubstitutes::const_iterator argument = substitutes->find(symbol->getId());
+            // each read takes a copy; the actual argument stays with the call
+            if (argument != substitutes->end())
+                return TIntermediate::copyTree(argument->second)->getAsTyped();
+        }
+
+        TStorageQualifier storage = symbol->getQualifier().storage;
+        TConstants::const_iterator constant = constants.find(symbol->getId());
+        if (constant != constants.end() && (storage == EvqTemporary || storage == EvqConstReadOnly))
+            return intermediate.addConstantUnion(constant->second->getConstArray(), constant->second->getType(), symbol->getLoc());
+
+        return symbol;
+    }
+
+    TIntermTyped* inlineCall(TIntermAggregate* call)
+    {
+        if (! call->isUserDefined())
+            return call;
+        TInlineFunctions::const_iterator function = functions.find(call->getName());
+        if (function == functions.end())
+            return call;
+
+        const TIntermSequence& parameters = *function->second.parameters;
+        const TIntermSequence& arguments = call->getSequence();
+        if (arguments.size() != parameters.size())
+            return call;
+
+        // each argument is evaluated once, so is free of side effects to be
+        // dropped or moved, and is cheap to read if it will be read again
+        TSubstitutes callSubstitutes;
+        for (size_t p = 0; p < parameters.size(); ++p) {
+            TIntermTyped* argument = arguments[p]->getAsTyped();
+            int id = parameters[p]->getAsSymbolNode()->getId();
+            std::map<int, int>::const_iterator reads = function->second.reads.find(id);
+            if (argument == nullptr || TIntermediate::hasSideEffects(argument))
+                return call;
+            if (reads != function->second.reads.end() && reads->second > 1 && ! IsCheapToRead(argument))
+                return call;
+            callSubstitutes[id] = argument;
+        }
+
+        // the function may be from another compilation unit, whose ids aren't those of this one
+        const TConstants noConstants;
+        TIntermTyped* expression = TIntermediate::copyTree(function->second.expression)->getAsTyped();
+        TInlineTraverser substitution(intermediate, functions, noConstants, &callSubstitutes);
+        expression->traverse(&substitution);
+
+        expression = substitution.rewrite(expression);
+        expression->setLoc(call->getLoc());
+
+        return expression;
+    }
+
+    TIntermTyped* fold(TIntermTyped* node)
+    {
+        if (node->getAsBinaryNode())
+            return foldBinary(node->getAsBinaryNode());
+
+        if (node->getAsUnaryNode()) {
+            TIntermUnary* unary = node->getAsUnaryNode();
+            TIntermConstantUnion* operand = unary->getOperand()->getAsConstantUnion();
+            if (operand == nullptr)
+                return node;
+            if (unary->getOp() >= EOpConvIntToBool && unary->getOp() <= EOpConvBoolToDouble)
+                return intermediate.promoteConstantUnion(unary->getBasicType(), operand);
+            TIntermTyped* folded = operand->fold(unary->getOp(), unary->getType());
+
+            return folded ? folded : node;
+        }
+
+        if (node->getAsAggregate()) {
+            // constructors and built-in functions, not sequences or calls
+            if (node->getAsAggregate()->getOp() <= EOpParameters)
+                return node;
+
+            return intermediate.fold(node->getAsAggregate());
+        }
+
+        // a ?: of a constant test is the one selected; an if-statement is left to
+        // removeStatements()
+        if (node->getAsSelectionNode() && node->getBasicType() != EbtVoid) {
+            TIntermSelection* selection = node->getAsSelectionNode();
+            TIntermConstantUnion* condition = selection->getCondition()->getAsConstantUnion();
+            if (condition == nullptr)
+                return node;
+
+            return condition->getConstArray()[0].getBConst() ? selection->getTrueBlock()->getAsTyped()
+                                                              : selection->getFalseBlock()->getAsTyped();
+        }
+
+        return node;
+    }
+
+    TIntermTyped* foldBinary(TIntermBinary* binary)
+    {
+        TIntermConstantUnion* left = binary->getLeft()->getAsConstantUnion();
+        if (left == nullptr)
+            return binary;
+
+        if (binary->getOp() == EOpVectorSwizzle) {
+            TIntermAggregate* selectors = binary->getRight()->getAsAggregate();
+            if (selectors == nullptr || selectors->getSequence().size() > 4)
+                return binary;
+            TVectorFields fields;
+            fields.num = (int)selectors->getSequence().size();
+            for (int f = 0; f < fields.num; ++f) {
+                TIntermConstantUnion* selector = selectors->getSequence()[f]->getAsConstantUnion();
+                if (selector == nullptr)
+                    return binary;
+                fields.offsets[f] = selector->getConstArray()[0].getIConst();
+            }
+
+            return intermediate.foldSwizzle(left, fields, binary->getLoc());
+        }
+
+        TIntermConstantUnion* right = binary->getRight()->getAsConstantUnion();
+        if (right == nullptr)
+            return binary;
+
+        switch (binary->getOp()) {
+        case EOpIndexDirect:
+        case EOpIndexIndirect:
+        case EOpIndexDirectStruct:
+        {
+            // an index made constant by propagation wasn't checked against the bounds
+            const TType& type = left->getType();
+            int size = type.isArray() ? type.getOuterArraySize() :
+                       type.isStruct() ? (int)type.getStruct()->size() :
+                       type.isMatrix() ? type.getMatrixCols() : type.getVectorSize();
+            int index = right->getConstArray()[0].getIConst();
+            if (index < 0 || index >= size)
+                return binary;
+
+            return intermediate.foldDereference(left, index, binary->getLoc());
+        }
+        default:
+        {
+            TIntermTyped* folded = left->fold(binary->getOp(), right);
+
+            return folded ? folded : binary;
+        }
+        }
+    }
+
+    // Remove the assignments of the constants propagated, the blocks left empty,
+    // and the if-statements of a constant test, leaving what they'd execute.
+    void removeStatements(TIntermSequence& statements)
+    {
+        size_t kept = 0;
+        for (size_t s = 0; s < statements.size(); ++s) {
+            TIntermNode* statement = statements[s];
+            TIntermSelection* selection = statement->getAsSelectionNode();
+            if (selection && selection->getBasicType() == EbtVoid && selection->getCondition()->getAsConstantUnion()) {
+                statement = selection->getCondition()->getAsConstantUnion()->getConstArray()[0].getBConst() ?
+                            selection->getTrueBlock() : selection->getFalseBlock();
+                changed = true;
+            }
+
+            TIntermBinary* assign = statement ? statement->getAsBinaryNode() : nullptr;
+            TIntermAggregate* block = statement ? statement->getAsAggregate() : nullptr;
+            if (statement == nullptr ||
+                (assign && assign->getOp() == EOpAssign && assign->getLeft()->getAsSymbolNode() &&
+                 constants.find(assign->getLeft()->getAsSymbolNode()->getId()) != constants.end()) ||
+                (block && block->getOp() == EOpSequence && block->getSequence().empty())) {
+                changed = true;
+                continue;
+            }
+
+            statements[kept++] = statement;
+        }
+        statements.resize(kept);
+    }
+
+    TIntermediate& intermediate;
+    const TInlineFunctions& functions;
+    const TConstants& constants;
+    const TSubstitutes* substitutes;
+
+    TInlineTraverser& operator=(TInlineTraverser&);
+};
+
+// Collects the names of the user functions called.
+class TCallTraverser : public TIntermTraverser {
+public:
+    virtual bool visitAggregate(TVisit, TIntermAggregate* node)
+    {
+        if (node->getOp() == EOpFunctionCall && node->isUserDefined())
+            callees.push_back(node->getName());
+
+        return true;
+    }
+
+    std::vector<TString> callees;
+};
+
+} // end anonymous namespace
+
+//
+// For EShMsgInline: inline the calls of functions returning a small expression
+// of their 'in' parameters, and fold what becomes constant, including locals
+// assigned a constant where declared and not written again, which are replaced
+// by it.  Afterwards, the functions main() no longer calls are removed, and the
+// call graph is made again from what's left.
+//
+void TIntermediate::inlineFunctions()
+{
+    if (numMains != (int)entryPoints.size() || treeRoot == nullptr)
+        return;
+
+    TIntermSequence& globals = treeRoot->getAsAggregate()->getSequence();
+    std::vector<TIntermAggregate*> definitions;
+    for (size_t g = 0; g < globals.size(); ++g) {
+        TIntermAggregate* function = globals[g]->getAsAggregate();
+        if (function && function->getOp() == EOpFunction)
+            definitions.push_back(function);
+    }
+
+    const TConstants noConstants;
+    bool changed = true;
+    for (int pass = 0; pass < MaxInlinePasses && changed; ++pass) {
+        changed = false;
+
+        TInlineFunctions functions;
+        for (size_t f = 0; f < definitions.size(); ++f) {
+            TInlineFunction inlined;
+            if (GetInlineFunction(definitions[f], inlined))
+                functions[definitions[f]->getName()] = inlined;
+        }
+
+        for (size_t f = 0; f < definitions.size(); ++f) {
+            TInlineTraverser inliner(*this, functions, noConstants);
+            definitions[f]->traverse(&inliner);
+
+            TConstantLocalTraverser locals;
+            definitions[f]->traverse(&locals);
+            TConstants constants;
+            locals.getConstants(constants);
+            if (! constants.empty()) {
+                TInlineTraverser propagator(*this, functions, constants);
+                definitions[f]->traverse(&propagator);
+                changed = changed || propagator.changed;
+            }
+            changed = changed || inliner.changed;
+        }
+    }
+
+    // the calls left, by caller
+    std::map<TString, std::vector<TString> > calls;
+    for (size_t f = 0; f < definitions.size(); ++f) {
+        TCallTraverser callees;
+        definitions[f]->traverse(&callees);
+        calls[definitions[f]->getName()].swap(callees.callees);
+    }
+
+    std::set<TString> reachable;
+    std::vector<TString> pending;
+    for (size_t e = 0; e < entryPoints.size(); ++e)
+        pending.push_back(TString(entryPoints[e].c_str()) + "(");
+    while (! pending.empty()) {
+        TString name = pending.back();
+        pending.pop_back();
+        if (! reachable.insert(name).second)
+            continue;
+        const std::vector<TString>& callees = calls[name];
+        pending.insert(pending.end(), callees.begin(), callees.end());
+    }
+
+    size_t kept = 0;
+    for (size_t g = 0; g < globals.size(); ++g) {
+        TIntermAggregate* function = globals[g]->getAsAggregate();
+        if (function && function->getOp() == EOpFunction && reachable.find(function->getName()) == reachable.end())
+            continue;
+        globals[kept++] = globals[g];
+    }
+    globals.resize(kept);
+
+    callGraph.clear();
+    for (std::set<TString>::const_iterator caller = reachable.begin(); caller != reachable.end(); ++caller) {
+        const std::vector<TString>& callees = calls[*caller];
+        std::set<TString> added;
+        for (size_t c = 0; c < callees.size(); ++c) {
+            if (added.insert(callees[c]).second)
+                callGraph.push_front(TCall(*caller, callees[c]));
+        }
+    }
+}
+
+} // end namespace glslang
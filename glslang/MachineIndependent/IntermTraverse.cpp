@@ -42,7 +42,11 @@ namespace glslang {
 //
 // Traverse the intermediate representation tree, and
 // call a node type specific function for each node.
-// Done recursively through the member function Traverse().
+// Done recursively through the member function traverse(),
+// until the tree gets deeper than TIntermTraverser::MaxRecursion;
+// below that, TIntermTraverser::traverseChildren() walks the
+// subtree with an explicit stack, so the depth of the tree
+// doesn't bound the thread's stack.
 // Node types can be skipped if their function to call is 0,
 // but their subtree will still be traversed.
 // Nodes with children can have their whole subtree skipped
@@ -56,18 +60,21 @@ namespace glslang {
 //
 // Traversal functions for terminals are straighforward....
 //
-void TIntermMethod::traverse(TIntermTraverser*)
+void TIntermMethod::traverse(TIntermTraverser* it)
 {
     // Tree should always resolve all methods as a non-method.
+    it->beginTraverse();
 }
 
 void TIntermSymbol::traverse(TIntermTraverser *it)
 {
+    it->beginTraverse();
     it->visitSymbol(this);
 }
 
 void TIntermConstantUnion::traverse(TIntermTraverser *it)
 {
+    it->beginTraverse();
     it->visitConstantUnion(this);
 }
 
@@ -76,6 +83,7 @@ void TIntermConstantUnion::traverse(TIntermTraverser *it)
 //
 void TIntermBinary::traverse(TIntermTraverser *it)
 {
+    const bool nested = it->beginTraverse();
     bool visit = true;
 
     //
@@ -84,6 +92,15 @@ void TIntermBinary::traverse(TIntermTraverser *it)
     if (it->preVisit)
         visit = it->visitBinary(EvPreVisit, this);
 
+    //
+    // Too deep in the tree, go through the traverser's stack instead
+    // of recursing.
+    //
+    if (visit && it->useStack(nested)) {
+        it->traverseChildren(this, EtkBinary, nested);
+        return;
+    }
+
     //
     // Visit the children, in the right order.
     //
@@ -126,11 +143,17 @@ void TIntermBinary::traverse(TIntermTraverser *it)
 //
 void TIntermUnary::traverse(TIntermTraverser *it)
 {
+    const bool nested = it->beginTraverse();
     bool visit = true;
 
     if (it->preVisit)
         visit = it->visitUnary(EvPreVisit, this);
 
+    if (visit && it->useStack(nested)) {
+        it->traverseChildren(this, EtkUnary, nested);
+        return;
+    }
+
     if (visit) {
         it->incrementDepth(this);
         operand->traverse(it);
@@ -146,11 +169,17 @@ void TIntermUnary::traverse(TIntermTraverser *it)
 //
 void TIntermAggregate::traverse(TIntermTraverser *it)
 {
+    const bool nested = it->beginTraverse();
     bool visit = true;
 
     if (it->preVisit)
         visit = it->visitAggregate(EvPreVisit, this);
 
+    if (visit && it->useStack(nested)) {
+        it->traverseChildren(this, EtkAggregate, nested);
+        return;
+    }
+
     if (visit) {
         it->incrementDepth(this);
 
@@ -186,11 +215,17 @@ void TIntermAggregate::traverse(TIntermTraverser *it)
 //
 void TIntermSelection::traverse(TIntermTraverser *it)
 {
+    const bool nested = it->beginTraverse();
     bool visit = true;
 
     if (it->preVisit)
         visit = it->visitSelection(EvPreVisit, this);
 
+    if (visit && it->useStack(nested)) {
+        it->traverseChildren(this, EtkSelection, nested);
+        return;
+    }
+
     if (visit) {
         it->incrementDepth(this);
         if (it->rightToLeft) {
@@ -218,11 +253,17 @@ void TIntermSelection::traverse(TIntermTraverser *it)
 //
 void TIntermLoop::traverse(TIntermTraverser *it)
 {
+    const bool nested = it->beginTraverse();
     bool visit = true;
 
     if (it->preVisit)
         visit = it->visitLoop(EvPreVisit, this);
 
+    if (visit && it->useStack(nested)) {
+        it->traverseChildren(this, EtkLoop, nested);
+        return;
+    }
+
     if (visit) {
         it->incrementDepth(this);
 
@@ -258,11 +299,17 @@ void TIntermLoop::traverse(TIntermTraverser *it)
 //
 void TIntermBranch::traverse(TIntermTraverser *it)
 {
+    const bool nested = it->beginTraverse();
     bool visit = true;
 
     if (it->preVisit)
         visit = it->visitBranch(EvPreVisit, this);
 
+    if (visit && expression && it->useStack(nested)) {
+        it->traverseChildren(this, EtkBranch, nested);
+        return;
+    }
+
     if (visit && expression) {
         it->incrementDepth(this);
         expression->traverse(it);
@@ -278,11 +325,17 @@ void TIntermBranch::traverse(TIntermTraverser *it)
 //
 void TIntermSwitch::traverse(TIntermTraverser* it)
 {
+    const bool nested = it->beginTraverse();
     bool visit = true;
 
     if (it->preVisit)
         visit = it->visitSwitch(EvPreVisit, this);
 
+    if (visit && it->useStack(nested)) {
+        it->traverseChildren(this, EtkSwitch, nested);
+        return;
+    }
+
     if (visit) {
         it->incrementDepth(this);
         if (it->rightToLeft) {
@@ -299,4 +352,296 @@ void TIntermSwitch::traverse(TIntermTraverser* it)
         it->visitSwitch(EvPostVisit, this);
 }
 
+//
+// Start traversing the children of 'node', which has been pre-visited.
+//
+// When 'nested', the node is itself a child taken from the stack by an
+// outer call of traverseChildren(), which will also take care of this
+// node's children.  Otherwise, this call owns the traversal, and returns
+// once the node has been post-visited.  (Visit functions can start their
+// own traversals; those stack up above the frames of the outer ones.)
+//
+void TIntermTraverser::traverseChildren(TIntermNode* node, TTraverseKind kind, bool nested)
+{
+    incrementDepth(node);
+    TFrame frame = { node, kind, 0, true };
+    frames.push_back(frame);
+    if (nested)
+        return;
+
+    const size_t base = frames.size() - 1;
+    while (frames.size() > base) {
+        TIntermNode* child = nextChild(frames.back());
+        if (child) {
+            descending = true;
+            child->traverse(this);
+            descending = false;
+        } else {
+            // all the children are done
+            frame = frames.back();
+            frames.pop_back();
+            decrementDepth();
+            if (frame.visit && postVisit)
+                postVisitFrame(frame);
+        }
+    }
+}
+
+//
+// Return the next child of 'frame' to traverse, or 0 when there are no
+// more, doing any in-visits that come before it.
+//
+TIntermNode* TIntermTraverser::nextChild(TFrame& frame)
+{
+    TIntermNode* child = 0;
+    while (child == 0) {
+        const int index = frame.next++;
+        switch (frame.kind) {
+        case EtkBinary:
+        {
+            TIntermBinary* binary = static_cast<TIntermBinary*>(frame.node);
+            TIntermNode* first  = rightToLeft ? binary->getRight() : binary->getLeft();
+            TIntermNode* second = rightToLeft ? binary->getLeft() : binary->getRight();
+            if (index == 0)
+                child = first;
+            else if (index == 1) {
+                if (inVisit)
+                    frame.visit = visitBinary(EvInVisit, binary);
+                if (! frame.visit)
+                    return 0;
+                child = second;
+            } else
+                return 0;
+            break;
+        }
+        case EtkUnary:
+            if (index > 0)
+                return 0;
+            child = static_cast<TIntermUnary*>(frame.node)->getOperand();
+            break;
+        case EtkAggregate:
+        {
+            TIntermAggregate* aggregate = static_cast<TIntermAggregate*>(frame.node);
+            TIntermSequence& sequence = aggregate->getSequence();
+
+            // in-visit after each child but the last
+            if (index > 0 && frame.visit && inVisit) {
+                TIntermNode* previous = rightToLeft ? sequence[sequence.size() - index] : sequence[index - 1];
+                if (previous != (rightToLeft ? sequence.front() : sequence.back()))
+                    frame.visit = visitAggregate(EvInVisit, aggregate);
+            }
+            if (index >= (int)sequence.size())
+                return 0;
+            child = rightToLeft ? sequence[sequence.size() - 1 - index] : sequence[index];
+            break;
+        }
+        case EtkSelection:
+        {
+            TIntermSelection* selection = static_cast<TIntermSelection*>(frame.node);
+            TIntermNode* children[] = { selection->getCondition(), selection->getTrueBlock(), selection->getFalseBlock() };
+            if (index > 2)
+                return 0;
+            child = children[rightToLeft ? 2 - index : index];
+            break;
+        }
+        case EtkLoop:
+        {
+            TIntermLoop* loop = static_cast<TIntermLoop*>(frame.node);
+            TIntermNode* children[] = { loop->getTest(), loop->getBody(), loop->getTerminal() };
+            if (index > 2)
+                return 0;
+            child = children[rightToLeft ? 2 - index : index];
+            break;
+        }
+        case EtkBranch:
+            if (index > 0)
+                return 0;
+            child = static_cast<TIntermBranch*>(frame.node)->getExpression();
+            break;
+        case EtkSwitch:
+        {
+            TIntermSwitch* switchNode = static_cast<TIntermSwitch*>(frame.node);
+            TIntermNode* children[] = { switchNode->getCondition(), switchNode->getBody() };
+            if (index > 1)
+                return 0;
+            child = children[rightToLeft ? 1 - index : index];
+            break;
+        }
+        }
+    }
+
+    return child;
+}
+
+//
+// Visit the node after the children, if requested and the traversal
+// hasn't been cancelled yet.
+//
+void TIntermTraverser::postVisitFrame(const TFrame& frame)
+{
+    switch (frame.kind) {
+    case EtkBinary:    visitBinary(EvPostVisit, static_cast<TIntermBinary*>(frame.node));       break;
+    case EtkUnary:     visitUnary(EvPostVisit, static_cast<TIntermUnary*>(frame.node));         break;
+    case EtkAggregate: visitAggregate(EvPostVisit, static_cast<TIntermAggregate*>(frame.node)); break;
+    case EtkSelection: visitSelection(EvPostVisit, static_cast<TIntermSelection*>(frame.node)); break;
+    case EtkLoop:      visitLoop(EvPostVisit, static_cast<TIntermLoop*>(frame.node));           break;
+    case EtkBranch:    visitBranch(EvPostVisit, static_cast<TIntermBranch*>(frame.node));       break;
+    case EtkSwitch:    visitSwitch(EvPostVisit, static_cast<TIntermSwitch*>(frame.node));       break;
+    }
+}
+
+//
+// Forwards each visit of one walk to all the traversers of a pass manager,
+// tracking for each the subtree it is skipping, if any, and its depth.
+//
+class TFusedTraverser : public TIntermTraverser {
+public:
+    TFusedTraverser(const std::vector<TIntermTraverser*>& traversers, bool inVisit, bool rightToLeft) :
+        TIntermTraverser(true, inVisit, true, rightToLeft)
+    {
+        for (size_t t = 0; t < traversers.size(); ++t) {
+            TPass pass = { traversers[t], 0, false, std::vector<TIntermNode*>() };
+            passes.push_back(pass);
+        }
+    }
+    virtual ~TFusedTraverser() { }
+
+    virtual void visitSymbol(TIntermSymbol* node)
+    {
+        for (size_t p = 0; p < passes.size(); ++p) {
+            if (passes[p].skipping == 0)
+                passes[p].traverser->visitSymbol(node);
+        }
+    }
+    virtual void visitConstantUnion(TIntermConstantUnion* node)
+    {
+        for (size_t p = 0; p < passes.size(); ++p) {
+            if (passes[p].skipping == 0)
+                passes[p].traverser->visitConstantUnion(node);
+        }
+    }
+    virtual bool visitBinary(TVisit visit, TIntermBinary* node)       { return forward(visit, node, &TIntermTraverser::visitBinary); }
+    virtual bool visitUnary(TVisit visit, TIntermUnary* node)         { return forward(visit, node, &TIntermTraverser::visitUnary); }
+    virtual bool visitSelection(TVisit visit, TIntermSelection* node) { return forward(visit, node, &TIntermTraverser::visitSelection); }
+    virtual bool visitAggregate(TVisit visit, TIntermAggregate* node) { return forward(visit, node, &TIntermTraverser::visitAggregate); }
+    virtual bool visitLoop(TVisit visit, TIntermLoop* node)           { return forward(visit, node, &TIntermTraverser::visitLoop); }
+    virtual bool visitSwitch(TVisit visit, TIntermSwitch* node)       { return forward(visit, node, &TIntermTraverser::visitSwitch); }
+    virtual bool visitBranch(TVisit visit, TIntermBranch* node)
+    {
+        return forward(visit, node, &TIntermTraverser::visitBranch, node->getExpression() != 0);
+    }
+
+protected:
+    struct TPass {
+        TIntermTraverser* traverser;
+        TIntermNode* skipping;          // root of the subtree the traverser said to skip, or 0
+        bool entered;                   // 'skipping' was skipped by an in-visit, after its depth was entered
+        std::vector<TIntermNode*> quiet; // aggregates an in-visit stopped, whose children still get traversed
+    };
+
+    //
+    // Do one visit of a node with children for every traverser that isn't
+    // skipping it, keeping each traverser's depth and path as the node's own
+    // traverse() would.  Only an aggregate goes on to its remaining children
+    // when an in-visit returns false.
+    //
+    template<class T>
+    bool forward(TVisit visit, T* node, bool (TIntermTraverser::*visitNode)(TVisit, T*), bool hasChildren = true)
+    {
+        const bool aggregate = node->getAsAggregate() != 0;
+        bool anyVisiting = false;
+
+        for (size_t p = 0; p < passes.size(); ++p) {
+            TPass& pass = passes[p];
+            TIntermTraverser* traverser = pass.traverser;
+            switch (visit) {
+            case EvPreVisit:
+                if (pass.skipping)
+                    break;
+                if (! traverser->preVisit || (traverser->*visitNode)(EvPreVisit, node)) {
+                    if (hasChildren)
+                        traverser->incrementDepth(node);
+                    anyVisiting = true;
+                } else {
+                    pass.skipping = node;
+                    pass.entered = false;
+                }
+                break;
+
+            case EvInVisit:
+                if (pass.skipping || ! traverser->inVisit || (! pass.quiet.empty() && pass.quiet.back() == node))
+                    break;
+                if (! (traverser->*visitNode)(EvInVisit, node)) {
+                    if (aggregate)
+                        pass.quiet.push_back(node);
+                    else {
+                        pass.skipping = node;
+                        pass.entered = true;
+                    }
+                }
+                break;
+
+            case EvPostVisit:
+            {
+                if (pass.skipping == node) {
+                    if (pass.entered)
+                        traverser->decrementDepth();
+                    pass.skipping = 0;
+                    break;
+                }
+                if (pass.skipping)
+                    break;
+                bool quieted = ! pass.quiet.empty() && pass.quiet.back() == node;
+                if (quieted)
+                    pass.quiet.pop_back();
+                if (hasChildren)
+                    traverser->decrementDepth();
+                if (! quieted && traverser->postVisit)
+                    (traverser->*visitNode)(EvPostVisit, node);
+                break;
+            }
+            }
+        }
+
+        // When every traverser is skipping the node, so can the walk, but
+        // then there is no post-visit to end their skipping.
+        if (visit == EvPreVisit && ! anyVisiting) {
+            for (size_t p = 0; p < passes.size(); ++p) {
+                if (passes[p].skipping == node)
+                    passes[p].skipping = 0;
+            }
+            return false;
+        }
+
+        return true;
+    }
+
+    std::vector<TPass> passes;
+};
+
+//
+// Walk the tree once for the left-to-right traversers and once for the
+// right-to-left ones.
+//
+void TIntermPassManager::run(TIntermNode* root)
+{
+    for (int rightToLeft = 0; rightToLeft < 2; ++rightToLeft) {
+        std::vector<TIntermTraverser*> group;
+        bool inVisit = false;
+        for (size_t p = 0; p < passes.size(); ++p) {
+            if (passes[p]->rightToLeft == (rightToLeft != 0)) {
+                group.push_back(passes[p]);
+                inVisit = inVisit || passes[p]->inVisit;
+            }
+        }
+
+        if (group.size() == 1)
+            root->traverse(group[0]);
+        else if (group.size() > 1) {
+            TFusedTraverser fused(group, inVisit, rightToLeft != 0);
+            root->traverse(&fused);
+        }
+    }
+}
+
 } // end namespace glslang
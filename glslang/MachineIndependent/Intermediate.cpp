@@ -506,8 +506,10 @@ TIntermTyped* TIntermediate::addConversion(TOperator op, const TType& type, TInt
             return 0;
     }
     
+    // A literal's constants are its own until it's in the tree, so it can be
+    // converted where it is, rather than folded into a new node and array.
     if (node->getAsConstantUnion())
-        return promoteConstantUnion(promoteTo, node->getAsConstantUnion());
+        return promoteConstantUnion(promoteTo, node->getAsConstantUnion(), node->getAsConstantUnion()->isLiteral());
 
     //
     // Add a new newNode for the conversion.
@@ -1493,12 +1495,18 @@ void TIntermTyped::propagatePrecision(TPrecisionQualifier newPrecision)
     }
 }
 
-TIntermTyped* TIntermediate::promoteConstantUnion(TBasicType promoteTo, TIntermConstantUnion* node) const
+//
+// Convert the constants of 'node' to 'promoteTo', into a new node, or with
+// 'inPlace', into 'node' itself, which must then be the only holder of its
+// constants.  Each component is read before it's written, so the arrays can
+// be the same.
+//
+TIntermTyped* TIntermediate::promoteConstantUnion(TBasicType promoteTo, TIntermConstantUnion* node, bool inPlace) const
 {
     const TConstUnionArray& rightUnionArray = node->getConstArray();
     int size = node->getType().computeNumComponents();
 
-    TConstUnionArray leftUnionArray(size);
+    TConstUnionArray leftUnionArray = inPlace ? rightUnionArray : TConstUnionArray(size);
 
     for (int i=0; i < size; i++) {
         switch (promoteTo) {
@@ -1605,16 +1613,27 @@ TIntermTyped* TIntermediate::promoteConstantUnion(TBasicType promoteTo, TIntermC
     }
     
     const TType& t = node->getType();
-    
-    return addConstantUnion(leftUnionArray, TType(promoteTo, t.getQualifier().storage, t.getVectorSize(), t.getMatrixCols(), t.getMatrixRows()), 
-                            node->getLoc());
+    TType promoted(promoteTo, t.getQualifier().storage, t.getVectorSize(), t.getMatrixCols(), t.getMatrixRows());
+    if (inPlace) {
+        // as a new node would be, it's no longer the literal in the source
+        node->setType(promoted);
+        node->setExpression();
+        return node;
+    }
+
+    return addConstantUnion(leftUnionArray, promoted, node->getLoc());
 }
 
 void TIntermAggregate::addToPragmaTable(const TPragmaTable& pTable)
 {
     assert(!pragmaTable);
-    pragmaTable = new TPragmaTable();
-    *pragmaTable = pTable;
+    // from the pool, like the rest of the tree, so copies of the tree made for
+    // linking don't need freeing
+    pragmaTable = new(GetThreadPoolAllocator().allocate(sizeof(TPragmaTable))) TPragmaTable;
+
+    // copy the strings too, making them from the current pool rather than that of pTable
+    for (TPragmaTable::const_iterator it = pTable.begin(); it != pTable.end(); ++it)
+        pragmaTable->insert(std::make_pair(TString(it->first.c_str()), TString(it->second.c_str())));
 }
 
 } // end namespace glslang
@@ -51,11 +51,13 @@ TParseContext::TParseContext(TSymbolTable& symt, TIntermediate& interm, bool pb,
                              bool fc, EShMessages m) :
             intermediate(interm), symbolTable(symt), infoSink(is), language(L),
             version(v), profile(p), forwardCompatible(fc), 
-            contextPragma(true, false), loopNestingLevel(0), structNestingLevel(0), controlFlowNestingLevel(0), statementNestingLevel(0),
+            contextPragma(true, false), loopControl(ELoopControlNone), loopNestingLevel(0), structNestingLevel(0), controlFlowNestingLevel(0), statementNestingLevel(0),
             postMainReturn(false),
             tokensBeforeEOF(false), limits(resources.limits), messages(m), currentScanner(nullptr),
             numErrors(0), parsingBuiltins(pb), afterEOF(false),
-            atomicUintOffsets(nullptr), anyIndexLimits(false)
+            atomicUintOffsets(nullptr), anyIndexLimits(false),
+            parseLimits(nullptr), parseStopped(false), numTokens(0), startNodes(0), startPoolBytes(0),
+            counterStats(nullptr)
 {
     // ensure we always have a linkage node, even if empty, to simplify tree topology algorithms
     linkage = new TIntermAggregate;
@@ -145,6 +147,55 @@ void TParseContext::setLimits(const TBuiltInResource& r)
         atomicUintOffsets[b] = 0;
 }
 
+//
+// Stop the parse once it reaches any of 'l', counting from now.
+//
+void TParseContext::setParseLimits(const TParseLimits& l)
+{
+    if (l.maxErrors == 0 && l.maxTokens == 0 && l.maxNodes == 0 && l.maxPoolBytes == 0)
+        return;
+
+    parseLimits = &l;
+    startNodes = GetThreadPoolAllocator().getNumNodes();
+    startPoolBytes = GetThreadPoolAllocator().getTotalBytes();
+}
+
+//
+// For the scanner: whether the parse is still within its limits, counting the
+// token about to be read.  Once not, the scanner gives end of input, so that
+// the parser stops soon.
+//
+bool TParseContext::withinParseLimits()
+{
+    if (parseLimits == nullptr)
+        return true;
+    if (parseStopped)
+        return false;
+
+    ++numTokens;
+    if (parseLimits->maxTokens > 0 && numTokens > parseLimits->maxTokens)
+        stopParse("token", parseLimits->maxTokens);
+    else if (parseLimits->maxNodes > 0 && GetThreadPoolAllocator().getNumNodes() - startNodes > parseLimits->maxNodes)
+        stopParse("AST node", parseLimits->maxNodes);
+    else if (parseLimits->maxPoolBytes > 0 && GetThreadPoolAllocator().getTotalBytes() - startPoolBytes > parseLimits->maxPoolBytes)
+        stopParse("pool byte", parseLimits->maxPoolBytes);
+
+    return ! parseStopped;
+}
+
+//
+// Give the error saying which limit was reached, and no diagnostics after it.
+//
+void TParseContext::stopParse(const char* limit, size_t value)
+{
+    // this error itself mustn't reach the error limit
+    const TParseLimits* limits = parseLimits;
+    parseLimits = nullptr;
+    error(getCurrentLoc(), "compilation stopped:", "", "reached the %s limit of %u", limit, (unsigned int)value);
+    parseLimits = limits;
+    parseStopped = true;
+}
+
 //
 // Parse an array of strings using yyparse, going through the
 // preprocessor to tokenize the shader strings, then through
@@ -157,7 +208,7 @@ bool TParseContext::parseShaderStrings(TPpContext& ppContext, TInputScanner& inp
     currentScanner = &input;
     ppContext.setInput(input, versionWillBeError);
     yyparse(this);
-    if (! parsingBuiltins)
+    if (! parsingBuiltins && ! parseStopped)
         finalErrorCheck();
 
     return numErrors == 0;
@@ -229,6 +280,30 @@ void TParseContext::handlePragma(const TSourceLoc& loc, const TVector<TString>&
             error(loc, "\")\" expected to end 'debug' pragma", "#pragma", "");
             return;
         }
+    } else if (tokens[0].compare("loop") == 0) {
+        if (tokens.size() != 4) {
+            error(loc, "loop pragma syntax is incorrect", "#pragma", "");
+            return;
+        }
+
+        if (tokens[1].compare("(") != 0) {
+            error(loc, "\"(\" expected after 'loop' keyword", "#pragma", "");
+            return;
+        }
+
+        if (tokens[2].compare("unroll") == 0)
+            loopControl = ELoopControlUnroll;
+        else if (tokens[2].compare("dont_unroll") == 0)
+            loopControl = ELoopControlDontUnroll;
+        else {
+            error(loc, "\"unroll\" or \"dont_unroll\" expected after '(' for 'loop' pragma", "#pragma", "");
+            return;
+        }
+
+        if (tokens[3].compare(")") != 0) {
+            error(loc, "\")\" expected to end 'loop' pragma", "#pragma", "");
+            return;
+        }
     }
 }
 
@@ -350,14 +425,19 @@ void TParseContext::outputMessage(const TSourceLoc& loc, const char* szReason,
     const int maxSize = MaxTokenLength + 200;
     char szExtraInfo[maxSize];
 
+    if (parseStopped)
+        return;
+
     safe_vsprintf(szExtraInfo, maxSize, szExtraInfoFormat, args);
 
-    infoSink.info.prefix(prefix);
-    infoSink.info.location(loc);
-    infoSink.info << "'" << szToken <<  "' : " << szReason << " " << szExtraInfo << "\n";
+    TString message("'");
+    message.append(szToken).append("' : ").append(szReason).append(" ").append(szExtraInfo);
+    infoSink.info.message(prefix, message.c_str(), loc);
 
     if (prefix == EPrefixError) {
         ++numErrors;
+        if (parseLimits && parseLimits->maxErrors > 0 && numErrors == parseLimits->maxErrors)
+            stopParse("error", parseLimits->maxErrors);
     }
 }
 
@@ -463,7 +543,16 @@ TIntermTyped* TParseContext::handleVariable(const TSourceLoc& loc, TSymbol* symb
         if (! variable)
             variable = new TVariable(string, TType(EbtVoid));
 
-        if (variable->getType().getQualifier().storage == EvqConst)
+        if (variable->getType().getQualifier().storage == EvqConst && variable->getType().getQualifier().hasSpecConstantId()) {
+            // A specialization constant's value is not known until pipeline creation, so it is
+            // not folded; it reads like a const parameter that still carries its default value.
+            TType specType(EbtVoid);
+            specType.shallowCopy(variable->getType());
+            specType.getQualifier().storage = EvqConstReadOnly;
+            TIntermSymbol* specSymbol = intermediate.addSymbol(variable->getUniqueId(), variable->getName(), specType, loc);
+            specSymbol->setConstArray(variable->getConstArray());
+            node = specSymbol;
+        } else if (variable->getType().getQualifier().storage == EvqConst)
             node = intermediate.addConstantUnion(variable->getConstArray(), variable->getType(), loc);
         else
             node = intermediate.addSymbol(*variable, loc);
@@ -922,6 +1011,7 @@ TFunction* TParseContext::handleFunctionDeclarator(const TSourceLoc& loc, TFunct
     // other forms of name collisions.
     if (! symbolTable.insert(function))
         error(loc, "function name is redeclaration of existing name", function.getName().c_str(), "");
+    conversionMatches.clear();
 
     //
     // If this is a redeclaration, it could also be a definition,
@@ -961,14 +1051,14 @@ TIntermAggregate* TParseContext::handleFunctionDefinition(const TSourceLoc& loc,
     functionReturnsValue = false;
 
     //
-    // Raise error message if main function takes any parameters or returns anything other than void
+    // Raise error message if main function (or another entry point) takes any parameters or returns anything other than void
     //
-    if (function.getName() == "main") {
+    if (intermediate.isEntryPointName(function.getName())) {
         if (function.getParamCount() > 0)
             error(loc, "function cannot take any parameter(s)", function.getName().c_str(), "");
         if (function.getType().getBasicType() != EbtVoid)
             error(loc, "", function.getType().getBasicTypeString().c_str(), "main function cannot return a value");
-        intermediate.addMainCount();
+        intermediate.addEntryPointDefinition(function.getName());
         inMain = true;
     } else
         inMain = false;
@@ -3388,6 +3478,22 @@ void TParseContext::structTypeCheck(const TSourceLoc& /*loc*/, TPublicType& publ
     }
 }
 
+//
+// A '#pragma loop(...)' applies to the next loop begun, not to any loop nested
+// inside it, so claim it when the loop begins and attach it when the loop is made.
+//
+void TParseContext::beginLoopControl()
+{
+    loopControlStack.push_back(loopControl);
+    loopControl = ELoopControlNone;
+}
+
+void TParseContext::endLoopControl(TIntermLoop* loop)
+{
+    loop->setLoopControl(loopControlStack.back());
+    loopControlStack.pop_back();
+}
+
 //
 // See if this loop satisfies the limitations for ES 2.0 (version 100) for loops in Appendex A:
 //
@@ -3809,6 +3915,12 @@ void TParseContext::setLayoutQualifier(const TSourceLoc& loc, TPublicType& publi
         else
             publicType.qualifier.layoutComponent = value;
         return;
+    } else if (id == "constant_id") {
+        if (! spirvRules())
+            error(loc, "only allowed when generating SPIR-V", id.c_str(), "");
+        if (! publicType.qualifier.setSpecConstantId(value))
+            error(loc, "too many different specialization-constant ids", id.c_str(), "");
+        return;
     } else if (id.compare(0, 4, "xfb_") == 0) {
         // "Any shader making any static use (after preprocessing) of any of these 
         // *xfb_* qualifiers will cause the shader to be in a transform feedback 
@@ -3967,6 +4079,9 @@ void TParseContext::mergeObjectLayoutQualifiers(TQualifier& dst, const TQualifie
             dst.layoutXfbStride = src.layoutXfbStride;
         if (src.hasXfbOffset())
             dst.layoutXfbOffset = src.layoutXfbOffset;
+
+        if (src.hasSpecConstantId())
+            dst.layoutSpecConstantIndex = src.layoutSpecConstantIndex;
     }
 }
 
@@ -4120,6 +4235,14 @@ void TParseContext::layoutTypeCheck(const TSourceLoc& loc, const TType& type)
             error(loc, "layout(binding=X) is required", "atomic_uint", "");
     }
 
+    // specialization constants are only scalars; composites of them are built with constructors
+    if (qualifier.hasSpecConstantId()) {
+        if (type.isArray() || type.isVector() || type.isMatrix() || type.getStruct() ||
+            (type.getBasicType() != EbtBool && type.getBasicType() != EbtInt && type.getBasicType() != EbtUint &&
+             type.getBasicType() != EbtFloat && type.getBasicType() != EbtDouble))
+            error(loc, "can only be applied to a scalar", "constant_id", "");
+    }
+
     // "The offset qualifier can only be used on block members of blocks..."
     if (qualifier.hasOffset()) {
         if (type.getBasicType() == EbtBlock)
@@ -4235,6 +4358,10 @@ void TParseContext::layoutQualifierCheck(const TSourceLoc& loc, const TQualifier
         if (qualifier.storage != EvqVaryingOut)
             error(loc, "can only be used on an output", "xfb layout qualifier", "");
     }
+    if (qualifier.hasSpecConstantId()) {
+        if (qualifier.storage != EvqConst)
+            error(loc, "can only be used on a const", "constant_id", "");
+    }
     if (qualifier.hasUniformLayout()) {
         if (! qualifier.isUniformOrBuffer()) {
             if (qualifier.hasMatrix() || qualifier.hasPacking())
@@ -4354,10 +4481,29 @@ const TFunction* TParseContext::findFunction120(const TSourceLoc& loc, const TFu
     // a match, it is a semantic error if there are multiple ways to apply these conversions to make the call match
     // more than one function."
 
+    // Calls with the same argument types resolve the same way, until a new declaration.
+    // Structure names aren't unique across scopes, so those calls aren't remembered.
+    bool memoize = true;
+    for (int i = 0; i < call.getParamCount(); ++i) {
+        if (call[i].type->getBasicType() == EbtStruct || call[i].type->getBasicType() == EbtBlock)
+            memoize = false;
+    }
+    if (memoize) {
+        TUnorderedMap<TString, std::pair<const TFunction*, bool> >::const_iterator match = conversionMatches.find(call.getMangledName());
+        if (match != conversionMatches.end()) {
+            builtIn = match->second.second;
+            return match->second.first;
+        }
+    }
+
     const TFunction* candidate = nullptr;
+    bool ambiguous = false;
     TVector<TFunction*> candidateList;
     symbolTable.findFunctionNameList(call.getMangledName(), candidateList, builtIn);
 
+    if (counterStats)
+        counterStats->overloadCandidates += (int)candidateList.size();
+
     for (TVector<TFunction*>::const_iterator it = candidateList.begin(); it != candidateList.end(); ++it) {
         const TFunction& function = *(*it);
 
@@ -4394,6 +4540,7 @@ const TFunction* TParseContext::findFunction120(const TSourceLoc& loc, const TFu
             if (candidate) {
                 // our second match, meaning ambiguity
                 error(loc, "ambiguous function signature match: multiple signatures match under implicit type conversion", call.getName().c_str(), "");
+                ambiguous = true;
             } else
                 candidate = &function;
         }
@@ -4401,6 +4548,8 @@ const TFunction* TParseContext::findFunction120(const TSourceLoc& loc, const TFu
 
     if (candidate == nullptr)
         error(loc, "no matching overloaded function found", call.getName().c_str(), "");
+    else if (memoize && ! ambiguous)
+        conversionMatches[call.getMangledName()] = std::make_pair(candidate, builtIn);
 
     return candidate;
 }
@@ -5591,22 +5740,19 @@ void TParseContext::wrapupSwitchSubsequence(TIntermAggregate* statements, TInter
         switchSequence->push_back(statements);
     }
     if (branchNode) {
-        // check all previous cases for the same label (or both are 'default')
-        for (unsigned int s = 0; s < switchSequence->size(); ++s) {
-            TIntermBranch* prevBranch = (*switchSequence)[s]->getAsBranchNode();
-            if (prevBranch) {
-                TIntermTyped* prevExpression = prevBranch->getExpression();
-                TIntermTyped* newExpression = branchNode->getAsBranchNode()->getExpression();
-                if (prevExpression == nullptr && newExpression == nullptr)
+        TIntermTyped* newExpression = branchNode->getAsBranchNode()->getExpression();
+        if (newExpression == nullptr) {
+            // check all previous labels for also being 'default'
+            for (unsigned int s = 0; s < switchSequence->size(); ++s) {
+                TIntermBranch* prevBranch = (*switchSequence)[s]->getAsBranchNode();
+                if (prevBranch && prevBranch->getExpression() == nullptr)
                     error(branchNode->getLoc(), "duplicate label", "default", "");
-                else if (prevExpression != nullptr &&
-                          newExpression != nullptr &&
-                         prevExpression->getAsConstantUnion() &&
-                          newExpression->getAsConstantUnion() &&
-                         prevExpression->getAsConstantUnion()->getConstArray()[0].getIConst() ==
-                          newExpression->getAsConstantUnion()->getConstArray()[0].getIConst())
-                    error(branchNode->getLoc(), "duplicated value", "case", "");
             }
+        } else if (newExpression->getAsConstantUnion()) {
+            // check the previous case values, without rescanning them, as there can be thousands
+            int value = newExpression->getAsConstantUnion()->getConstArray()[0].getIConst();
+            if (! switchCaseValues.back()->insert(std::make_pair(value, true)).second)
+                error(branchNode->getLoc(), "duplicated value", "case", "");
         }
         switchSequence->push_back(branchNode);
     }
@@ -70,6 +70,9 @@ public:
     virtual ~TParseContext();
 
     void setLimits(const TBuiltInResource&);
+    void setParseLimits(const TParseLimits&);
+    bool withinParseLimits();
+    void setCounterStats(ShCounterStats* stats) { counterStats = stats; }
     bool parseShaderStrings(TPpContext&, TInputScanner& input, bool versionWillBeError = false);
     void parserError(const char* s);     // for bison's yyerror
     const char* getPreamble();
@@ -169,6 +172,8 @@ public:
     void opaqueCheck(const TSourceLoc&, const TType&, const char* op);
     void structTypeCheck(const TSourceLoc&, TPublicType&);
     void inductiveLoopCheck(const TSourceLoc&, TIntermNode* init, TIntermLoop* loop);
+    void beginLoopControl();
+    void endLoopControl(TIntermLoop* loop);
     void arrayLimitCheck(const TSourceLoc&, const TString&, int size);
     void limitCheck(const TSourceLoc&, int value, const char* limit, const char* feature);
 
@@ -286,12 +291,15 @@ public:
 
     // Current state of parsing
     struct TPragma contextPragma;
+    TLoopControl loopControl;    // from a '#pragma loop(...)' not yet claimed by a loop
+    TList<TLoopControl> loopControlStack;  // the hints of the loops being parsed, innermost last
     int loopNestingLevel;        // 0 if outside all loops
     int structNestingLevel;      // 0 if outside blocks and structures
     int controlFlowNestingLevel; // 0 if outside all flow control
     int statementNestingLevel;   // 0 if outside all flow control or compound statements
     TList<TIntermSequence*> switchSequenceStack;  // case, node, case, case, node, ...; ensure only one node between cases;   stack of them for nesting
     TList<int> switchLevel;      // the statementNestingLevel the current switch statement is at, which must match the level of its case statements
+    TList<TMap<int, bool>*> switchCaseValues;  // the case values seen so far by each switch statement being parsed; stack of them for nesting
     bool inMain;                 // if inside a function, true if the function is main
     bool postMainReturn;         // if inside a function, true if the function is main and this is after a return statement
     const TType* currentFunctionType;  // the return type of the function that's currently being parsed
@@ -328,6 +336,22 @@ protected:
     bool anyIndexLimits;
     TVector<TIntermTyped*> needsIndexLimitationChecking;
 
+    // For setParseLimits(): the limits, if any, and what they're compared with
+    const TParseLimits* parseLimits;
+    bool parseStopped;           // a limit was reached
+    int numTokens;
+    int startNodes;
+    size_t startPoolBytes;
+    void stopParse(const char* limit, size_t value);
+
+    // For setCounterStats(): where overload candidates are counted, if anywhere
+    ShCounterStats* counterStats;
+
+    // findFunction120() matches that needed implicit conversions, and whether
+    // they were built in, by the call's mangled name.  Invalidated by any
+    // function declaration, which can change the candidates.
+    TUnorderedMap<TString, std::pair<const TFunction*, bool> > conversionMatches;
+
     //
     // Geometry shader input arrays:
     //  - array sizing is based on input primitive and/or explicit size
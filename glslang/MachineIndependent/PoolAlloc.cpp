@@ -38,13 +38,55 @@
 #include "../Include/InitializeGlobals.h"
 #include "osinclude.h"
 
+#include <atomic>
+#include <map>
+#include <mutex>
+
 namespace glslang {
 
+//
+// Where each thread's pools are found.  GetThreadPoolAllocator() is behind
+// every pool allocation, so a compiler's C++11 thread_local is used for it
+// when there is one, rather than a call to the OS's TLS.  Define
+// GLSLANG_OS_TLS_POOLS to use the OS's TLS anyway.
+//
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define GLSLANG_OS_TLS_POOLS
+#endif
+
+#ifdef GLSLANG_OS_TLS_POOLS
+
 OS_TLSIndex PoolIndex;
 
+inline TThreadMemoryPools* GetThreadMemoryPools()
+{
+    return static_cast<TThreadMemoryPools*>(OS_GetTLSValue(PoolIndex));
+}
+
+inline void SetThreadMemoryPools(TThreadMemoryPools* pools)
+{
+    OS_SetTLSValue(PoolIndex, pools);
+}
+
+#else
+
+thread_local TThreadMemoryPools* ThreadMemoryPools = nullptr;
+
+inline TThreadMemoryPools* GetThreadMemoryPools()
+{
+    return ThreadMemoryPools;
+}
+
+inline void SetThreadMemoryPools(TThreadMemoryPools* pools)
+{
+    ThreadMemoryPools = pools;
+}
+
+#endif
+
 void InitializeMemoryPools()
 {
-    TThreadMemoryPools* pools = static_cast<TThreadMemoryPools*>(OS_GetTLSValue(PoolIndex));    
+    TThreadMemoryPools* pools = GetThreadMemoryPools();
     if (pools)
         return;
 
@@ -53,49 +95,131 @@ void InitializeMemoryPools()
     TThreadMemoryPools* threadData = new TThreadMemoryPools();
     
     threadData->threadPoolAllocator = threadPoolAllocator;
+    threadData->memoryNode = 0;
     	
-    OS_SetTLSValue(PoolIndex, threadData);
+    SetThreadMemoryPools(threadData);
 }
 
 void FreeGlobalPools()
 {
     // Release the allocated memory for this thread.
-    TThreadMemoryPools* globalPools = static_cast<TThreadMemoryPools*>(OS_GetTLSValue(PoolIndex));    
+    TThreadMemoryPools* globalPools = GetThreadMemoryPools();
     if (! globalPools)
         return;
 	
     GetThreadPoolAllocator().popAll();
     delete &GetThreadPoolAllocator();       
     delete globalPools;
+
+    // so a later InitializeMemoryPools() on this thread makes new ones
+    SetThreadMemoryPools(nullptr);
 }
 
 bool InitializePoolIndex()
 {
+#ifdef GLSLANG_OS_TLS_POOLS
     // Allocate a TLS index.
     if ((PoolIndex = OS_AllocTLSIndex()) == OS_INVALID_TLS_INDEX)
         return false;
+#endif
 
     return true;
 }
 
 void FreePoolIndex()
 {
+#ifdef GLSLANG_OS_TLS_POOLS
     // Release the TLS index.
     OS_FreeTLSIndex(PoolIndex);
+#endif
 }
 
 TPoolAllocator& GetThreadPoolAllocator()
 {
-    TThreadMemoryPools* threadData = static_cast<TThreadMemoryPools*>(OS_GetTLSValue(PoolIndex));
-
-    return *threadData->threadPoolAllocator;
+    return *GetThreadMemoryPools()->threadPoolAllocator;
 }
 
 void SetThreadPoolAllocator(TPoolAllocator& poolAllocator)
 {
-    TThreadMemoryPools* threadData = static_cast<TThreadMemoryPools*>(OS_GetTLSValue(PoolIndex));
+    GetThreadMemoryPools()->threadPoolAllocator = &poolAllocator;
+}
+
+void SetThreadMemoryNode(int node)
+{
+    GetThreadMemoryPools()->memoryNode = node > 0 && node < MaxMemoryNodes ? node : 0;
+}
+
+int GetThreadMemoryNode()
+{
+    TThreadMemoryPools* pools = GetThreadMemoryPools();
+
+    return pools ? pools->memoryNode : 0;
+}
+
+namespace {
+
+//
+// The process-wide caches of released single pages, by page size, one per
+// memory node, each with its own lock.  They use the regular heap, as they
+// outlive any pool.
+//
+struct TPageCache {
+    TPageCache() : bytes(0) { }
+    std::mutex mutex;
+    std::map<size_t, std::vector<char*> > pages;
+    size_t bytes;
+};
+TPageCache PageCaches[MaxMemoryNodes];
+std::atomic<size_t> PageCacheLimit(0);
+
+// Returns a cached page of pageSize bytes from the thread's node, or 0 if there is none.
+char* TakeCachedPage(size_t pageSize)
+{
+    TPageCache& cache = PageCaches[GetThreadMemoryNode()];
+    std::lock_guard<std::mutex> guard(cache.mutex);
+
+    std::map<size_t, std::vector<char*> >::iterator it = cache.pages.find(pageSize);
+    if (it == cache.pages.end() || it->second.empty())
+        return 0;
+
+    char* page = it->second.back();
+    it->second.pop_back();
+    cache.bytes -= pageSize;
+
+    return page;
+}
+
+// Keeps the page for reuse on the thread's node, and returns false if its cache is full.
+bool CachePage(char* page, size_t pageSize)
+{
+    TPageCache& cache = PageCaches[GetThreadMemoryNode()];
+    std::lock_guard<std::mutex> guard(cache.mutex);
+
+    if (cache.bytes + pageSize > PageCacheLimit)
+        return false;
 
-    threadData->threadPoolAllocator = &poolAllocator;
+    cache.pages[pageSize].push_back(page);
+    cache.bytes += pageSize;
+
+    return true;
+}
+
+} // end anonymous namespace
+
+void TPoolAllocator::setPageCacheLimit(size_t bytes)
+{
+    PageCacheLimit = bytes;
+    for (int node = 0; node < MaxMemoryNodes; ++node) {
+        TPageCache& cache = PageCaches[node];
+        std::lock_guard<std::mutex> guard(cache.mutex);
+        for (std::map<size_t, std::vector<char*> >::iterator it = cache.pages.begin(); it != cache.pages.end(); ++it) {
+            while (cache.bytes > bytes && ! it->second.empty()) {
+                delete [] it->second.back();
+                it->second.pop_back();
+                cache.bytes -= it->first;
+            }
+        }
+    }
 }
 
 //
@@ -107,7 +231,12 @@ TPoolAllocator::TPoolAllocator(int growthIncrement, int allocationAlignment) :
     alignment(allocationAlignment),
     freeList(0),
     inUseList(0),
-    numCalls(0)
+    numCalls(0),
+    numNodes(0),
+    totalBytes(0),
+    numPages(0),
+    heldBytes(0),
+    peakHeldBytes(0)
 {
     //
     // Don't allow page sizes we know are smaller than all common
@@ -151,13 +280,14 @@ TPoolAllocator::~TPoolAllocator()
 {
 	while (inUseList) {
 	    tHeader* next = inUseList->nextPage;
+        size_t pageCount = inUseList->pageCount;
         inUseList->~tHeader();
-        delete [] reinterpret_cast<char*>(inUseList);
+        freePage(reinterpret_cast<char*>(inUseList), pageCount);
 	    inUseList = next;
 	}
 
     //
-    // Always delete the free list memory - it can't be being
+    // Always release the free list memory - it can't be being
     // (correctly) referenced, whether the pool allocator was
     // global or not.  We should not check the guard blocks
     // here, because we did it already when the block was
@@ -165,11 +295,21 @@ TPoolAllocator::~TPoolAllocator()
     //
     while (freeList) {
         tHeader* next = freeList->nextPage;
-        delete [] reinterpret_cast<char*>(freeList);
+        freePage(reinterpret_cast<char*>(freeList), 1);
         freeList = next;
     }
 }
 
+//
+// Give a page back, to the page cache of the thread's node if it is a single
+// page and there is room, otherwise to the OS.
+//
+void TPoolAllocator::freePage(char* memory, size_t pageCount)
+{
+    if (pageCount > 1 || ! CachePage(memory, pageSize))
+        delete [] memory;
+}
+
 const unsigned char TAllocation::guardBlockBeginVal = 0xfb;
 const unsigned char TAllocation::guardBlockEndVal   = 0xfe;
 const unsigned char TAllocation::userDataFill       = 0xcd;
@@ -239,9 +379,10 @@ void TPoolAllocator::pop()
         inUseList->~tHeader();
         
         tHeader* nextInUse = inUseList->nextPage;
-        if (inUseList->pageCount > 1)
+        if (inUseList->pageCount > 1) {
+            heldBytes -= inUseList->pageCount * pageSize;
             delete [] reinterpret_cast<char*>(inUseList);
-        else {
+        } else {
             inUseList->nextPage = freeList;
             freeList = inUseList;
         }
@@ -261,7 +402,11 @@ void TPoolAllocator::popAll()
         pop();
 }
 
-void* TPoolAllocator::allocate(size_t numBytes)
+//
+// The out-of-line part of allocate(): all allocations when using guard
+// blocks, and otherwise those that don't fit in the current page.
+//
+void* TPoolAllocator::allocateSlow(size_t numBytes)
 {
     // If we are using guard blocks, all allocations are bracketed by
     // them: [guardblock][allocation][guardblock].  numBytes is how
@@ -278,7 +423,7 @@ void* TPoolAllocator::allocate(size_t numBytes)
 
     //
     // Do the allocation, most likely case first, for efficiency.
-    // This step could be moved to be inline sometime.
+    // Without guard blocks, the inline allocate() already handled this case.
     //
     if (currentPageOffset + allocationSize <= pageSize) {
         //
@@ -304,6 +449,7 @@ void* TPoolAllocator::allocate(size_t numBytes)
         // Use placement-new to initialize header
         new(memory) tHeader(inUseList, (numBytesToAlloc + pageSize - 1) / pageSize);
         inUseList = memory;
+        notePageObtained(memory->pageCount);
 
         currentPageOffset = pageSize;  // make next allocation come from a new page
 
@@ -319,9 +465,12 @@ void* TPoolAllocator::allocate(size_t numBytes)
         memory = freeList;
         freeList = freeList->nextPage;
     } else {
-        memory = reinterpret_cast<tHeader*>(::new char[pageSize]);
+        memory = reinterpret_cast<tHeader*>(TakeCachedPage(pageSize));
+        if (memory == 0)
+            memory = reinterpret_cast<tHeader*>(::new char[pageSize]);
         if (memory == 0)
             return 0;
+        notePageObtained(1);
     }
 
     // Use placement-new to initialize header
@@ -286,6 +286,9 @@ protected:
 // This is the function the glslang parser (i.e., bison) calls to get its next token
 int yylex(YYSTYPE* glslangTokenDesc, glslang::TParseContext& parseContext)
 {
+    if (! parseContext.withinParseLimits())
+        return 0;
+
     glslang::TParserToken token(*glslangTokenDesc);
 
     return parseContext.getScanContext()->tokenize(parseContext.getPpContext(), token);
@@ -298,6 +301,56 @@ namespace {
 std::unordered_map<std::string, int>* KeywordMap = nullptr;
 std::unordered_set<std::string>* ReservedSet = nullptr;
 
+// KeywordMap and ReservedSet flattened into one open-addressed table, so that
+// classifying an identifier hashes its text in place instead of building a
+// std::string for each lookup.  Names point into the keys of the above.
+struct TKeywordEntry {
+    const char* name;   // 0 for an empty slot
+    size_t length;
+    int keyword;        // ReservedKeyword for a reserved word
+};
+const int ReservedKeyword = -1;
+TKeywordEntry* KeywordTable = nullptr;
+size_t KeywordTableMask = 0;
+
+// FNV-1a, also returning the length of 's'
+inline size_t HashKeyword(const char* s, size_t& length)
+{
+    unsigned hash = 2166136261U;
+    const char* c = s;
+    for (; *c; ++c) {
+        hash ^= (unsigned char)*c;
+        hash *= 16777619U;
+    }
+    length = c - s;
+
+    return hash;
+}
+
+void AddKeywordEntry(const std::string& name, int keyword)
+{
+    size_t length;
+    size_t slot = HashKeyword(name.c_str(), length) & KeywordTableMask;
+    while (KeywordTable[slot].name != 0 && strcmp(KeywordTable[slot].name, name.c_str()) != 0)
+        slot = (slot + 1) & KeywordTableMask;
+    KeywordTable[slot].name = name.c_str();
+    KeywordTable[slot].length = length;
+    KeywordTable[slot].keyword = keyword;
+}
+
+// Returns the keyword, ReservedKeyword, or 0 if 's' is neither.
+inline int LookUpKeyword(const char* s)
+{
+    size_t length;
+    size_t slot = HashKeyword(s, length) & KeywordTableMask;
+    for (; KeywordTable[slot].name != 0; slot = (slot + 1) & KeywordTableMask) {
+        if (KeywordTable[slot].length == length && memcmp(KeywordTable[slot].name, s, length) == 0)
+            return KeywordTable[slot].keyword;
+    }
+
+    return 0;
+}
+
 };
 
 namespace glslang {
@@ -517,6 +570,19 @@ void TScanContext::fillInKeywordMap()
     ReservedSet->insert("cast");
     ReservedSet->insert("namespace");
     ReservedSet->insert("using");
+
+    // Keep the table at most 1/4 full, so a lookup rarely probes twice
+    size_t tableSize = 1;
+    while (tableSize < 4 * (KeywordMap->size() + ReservedSet->size()))
+        tableSize *= 2;
+    KeywordTable = new TKeywordEntry[tableSize];
+    memset(KeywordTable, 0, tableSize * sizeof(TKeywordEntry));
+    KeywordTableMask = tableSize - 1;
+    for (auto it = KeywordMap->begin(); it != KeywordMap->end(); ++it)
+        AddKeywordEntry(it->first, it->second);
+    // reserved words take precedence, as when checked first
+    for (auto it = ReservedSet->begin(); it != ReservedSet->end(); ++it)
+        AddKeywordEntry(*it, ReservedKeyword);
 }
 
 void TScanContext::deleteKeywordMap()
@@ -525,6 +591,9 @@ void TScanContext::deleteKeywordMap()
     KeywordMap = nullptr;
     delete ReservedSet;
     ReservedSet = nullptr;
+    delete [] KeywordTable;
+    KeywordTable = nullptr;
+    KeywordTableMask = 0;
 }
 
 int TScanContext::tokenize(TPpContext* pp, TParserToken& token)
@@ -532,7 +601,10 @@ int TScanContext::tokenize(TPpContext* pp, TParserToken& token)
     do {
         parserToken = &token;
         TPpToken ppToken;
-        tokenText = pp->tokenize(&ppToken);
+        {
+            TPhaseTimer timer(timingStats, EShPhasePreprocess);
+            tokenText = pp->tokenize(&ppToken);
+        }
         if (tokenText == nullptr)
             return 0;
 
@@ -619,15 +691,14 @@ int TScanContext::tokenize(TPpContext* pp, TParserToken& token)
 
 int TScanContext::tokenizeIdentifier()
 {
-    if (ReservedSet->find(tokenText) != ReservedSet->end())
+    keyword = LookUpKeyword(tokenText);
+    if (keyword == ReservedKeyword)
         return reservedWord();
 
-    auto it = KeywordMap->find(tokenText);
-    if (it == KeywordMap->end()) {
+    if (keyword == 0) {
         // Should have an identifier of some sort
         return identifierOrType();
     }
-    keyword = it->second;
 
     switch (keyword) {
     case CONST:
@@ -36,6 +36,8 @@
 #ifndef _GLSLANG_SCAN_INCLUDED_
 #define _GLSLANG_SCAN_INCLUDED_
 
+#include <string.h>
+
 #include "Versions.h"
 
 namespace glslang {
@@ -145,6 +147,68 @@ public:
             --loc[currentSource].line;
     }
 
+    // Bulk version of get(), for hot loops over runs of ordinary characters:
+    // consume the characters, up to the end of the current string, for which
+    // inRun() is true, optionally copying up to maxCopy of them to copyTo.
+    // inRun() must be false for '\n', and for anything else get() callers
+    // treat specially.  Returns the number consumed.
+    template<class P> size_t getRun(P inRun, char* copyTo = nullptr, size_t maxCopy = 0)
+    {
+        if (currentSource >= numSources)
+            return 0;
+
+        const unsigned char* source = sources[currentSource];
+        size_t end = lengths[currentSource];
+        if (copyTo != nullptr)
+            end = std::min(end, currentChar + maxCopy);
+        size_t c = currentChar;
+        while (c < end && inRun(source[c]))
+            ++c;
+
+        size_t count = c - currentChar;
+        if (count > 0) {
+            if (copyTo != nullptr)
+                memcpy(copyTo, source + currentChar, count);
+            loc[currentSource].column += (int)count;
+            currentChar = c - 1;
+            advance();
+        }
+
+        return count;
+    }
+
+    // Like getRun(), but for the inside of a /* */ comment: consume up to the
+    // next '*', '\\' or '\r' in the current string, counting newlines.
+    size_t getCommentRun()
+    {
+        if (currentSource >= numSources)
+            return 0;
+
+        const unsigned char* source = sources[currentSource];
+        size_t end = lengths[currentSource];
+        size_t c = currentChar;
+        int& line = loc[currentSource].line;
+        int& column = loc[currentSource].column;
+        for (; c < end; ++c) {
+            unsigned char ch = source[c];
+            if (ch == '*' || ch == '\\' || ch == '\r')
+                break;
+            if (ch == '\n') {
+                ++line;
+                column = 0;
+            } else
+                ++column;
+        }
+
+        size_t count = c - currentChar;
+        if (count > 0) {
+            currentChar = c - 1;
+            advance();
+        }
+
+        return count;
+    }
+
     // for #line override
     void setLine(int newLine) { loc[getLastValidSourceIndex()].line = newLine; }
     void setFile(const char* filename) { loc[getLastValidSourceIndex()].name = filename; }
@@ -48,7 +48,7 @@ class TParserToken;
 
 class TScanContext {
 public:
-    explicit TScanContext(TParseContext& pc) : parseContext(pc), afterType(false), field(false) { }
+    explicit TScanContext(TParseContext& pc) : parseContext(pc), afterType(false), field(false), timingStats(nullptr) { }
     virtual ~TScanContext() { }
 
     static void fillInKeywordMap();
@@ -56,6 +56,9 @@ public:
 
     int tokenize(TPpContext*, TParserToken&);
 
+    // Charge the preprocessor's work to EShPhasePreprocess of 'stats'.
+    void setTimingStats(ShTimingStats* stats) { timingStats = stats; }
+
 protected:
     TScanContext(TScanContext&);
     TScanContext& operator=(TScanContext&);
@@ -81,6 +84,7 @@ protected:
 
     const char* tokenText;
     int keyword;
+    ShTimingStats* timingStats;
 };
 
 } // end namespace glslang
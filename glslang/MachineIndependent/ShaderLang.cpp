@@ -40,9 +40,17 @@
 // This is the platform independent interface between an OGL driver
 // and the shading language compiler/linker.
 //
+#include <ctype.h>
+#include <stddef.h>
 #include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
 #include <iostream>
+#include <mutex>
 #include <sstream>
+#include <thread>
+#include <unordered_map>
 #include "SymbolTable.h"
 #include "ParseHelper.h"
 #include "Scan.h"
@@ -50,6 +58,7 @@
 
 #include "../Include/ShHandle.h"
 #include "../../OGLCompilersDLL/InitializeDll.h"
+#include "osinclude.h"
 
 #include "preprocessor/PpContext.h"
 
@@ -119,8 +128,80 @@ enum EPrecisionClass {
 TSymbolTable* CommonSymbolTable[VersionCount][ProfileCount][EPcCount] = {};
 TSymbolTable* SharedSymbolTables[VersionCount][ProfileCount][EShLangCount] = {};
 
+// One lock per version/profile slot, so that different version/profile
+// combinations can be built concurrently.  The common tables of a slot are made
+// along with its first stage, and each other stage only when first compiled;
+// looking up an already built stage takes no lock at all.
+bool CommonSymbolTablesReady[VersionCount][ProfileCount];
+std::atomic<bool> SymbolTablesReady[VersionCount][ProfileCount][EShLangCount];
+std::mutex SymbolTablesMutex[VersionCount][ProfileCount];
+
+// A process-global symbol table per version per profile per stage per set of
+// resource values, adopting the shared tables and adding the built-ins that
+// depend on the resources.  Resources seldom change, so a compile copies its
+// context-specific level from here rather than parsing it, up to a limit of
+// kept tables; failures are kept as null.
+typedef std::unordered_map<std::string, TSymbolTable*> TContextSymbolTables;
+TContextSymbolTables ContextSymbolTables;
+std::mutex ContextSymbolTablesMutex;
+const size_t MaxContextSymbolTables = 64;
+
+// The tables of the built-in snapshot LoadBuiltInSnapshot() mapped, if any, for
+// SetupBuiltinSymbolTable() to read rather than parse the built-ins.  A table
+// is only read if the built-in text it was made from, 'hash', is this build's.
+struct TSnapshotTable {
+    const char* data;  // null if the snapshot doesn't have the table
+    size_t size;
+    unsigned long long hash;
+};
+TSnapshotTable SnapshotCommonTables[VersionCount][ProfileCount][EPcCount];
+TSnapshotTable SnapshotStageTables[VersionCount][ProfileCount][EShLangCount];
+const char* SnapshotData = nullptr;
+size_t SnapshotSize = 0;
+
 TPoolAllocator* PerProcessGPA = 0;
 
+// With NUMA sharding on (see SetNumaSharding()), each thread glslang starts to
+// compile on is pinned to the next node in turn.
+std::atomic<bool> NumaSharding(false);
+std::atomic<int> NextNumaNode(0);
+
+// Read-only copies of the shared tables above, one set per NUMA node but the
+// first (whose are the tables above), for threads pinned to that node to adopt
+// rather than reaching across nodes for every built-in lookup.  Each node's are
+// made the first time a thread on it needs them, into a pool of the node's own.
+TSymbolTable* NodeCommonSymbolTables[MaxMemoryNodes][VersionCount][ProfileCount][EPcCount] = {};
+std::atomic<TSymbolTable*> NodeSharedSymbolTables[MaxMemoryNodes][VersionCount][ProfileCount][EShLangCount];
+TPoolAllocator* NodePools[MaxMemoryNodes] = {};
+std::mutex NodeSymbolTablesMutex[MaxMemoryNodes];
+
+// Pin the calling thread, already initialized, to the node, and keep its memory there.
+bool PinThreadToNumaNode(int node)
+{
+    if (! OS_SetThreadNumaNode(node))
+        return false;
+
+    SetThreadMemoryNode(node);
+
+    return true;
+}
+
+//
+// InitThread() for a thread glslang starts to compile on, which is also pinned
+// to the next node when NUMA sharding is on and there is more than one node.
+//
+bool InitWorkerThread()
+{
+    if (! InitThread())
+        return false;
+
+    int nodes = OS_GetNumaNodeCount();
+    if (NumaSharding && nodes > 1)
+        PinThreadToNumaNode(NextNumaNode++ % nodes);
+
+    return true;
+}
+
 //
 // Parse and add to the given symbol table the content of the given shader string.
 //
@@ -159,63 +240,204 @@ bool InitializeSymbolTable(const TString& builtIns, int version, EProfile profil
     return true;
 }
 
+//
+// The TInfoSinkDiagnostic of TShader/TProgram::setDiagnosticCallback(), calling
+// the TDiagnosticCallback paired with its context.
+//
+void CallDiagnosticCallback(void* callback, TPrefixType prefix, const TSourceLoc& loc, const char* message)
+{
+    EShSeverity severity;
+    switch (prefix) {
+    case EPrefixWarning:       severity = EShSeverityWarning;       break;
+    case EPrefixInternalError: severity = EShSeverityInternalError; break;
+    case EPrefixUnimplemented: severity = EShSeverityUnimplemented; break;
+    case EPrefixNote:          severity = EShSeverityNote;          break;
+    default:                   severity = EShSeverityError;         break;
+    }
+
+    const std::pair<TDiagnosticCallback, void*>& target = *static_cast<const std::pair<TDiagnosticCallback, void*>*>(callback);
+    target.first(target.second, severity, loc, message);
+}
+
 int CommonIndex(EProfile profile, EShLanguage language)
 {
     return (profile == EEsProfile && language == EShLangFragment) ? EPcFragment : EPcGeneral;
 }
 
 //
-// To initialize per-stage shared tables, with the common table already complete.
+// Whether the stage has built-ins, and so a shared table, at this version/profile.
 //
-void InitializeStageSymbolTable(TBuiltIns& builtIns, int version, EProfile profile, EShLanguage language, TInfoSink& infoSink, TSymbolTable** commonTable, TSymbolTable** symbolTables)
+bool HasStageBuiltIns(int version, EProfile profile, EShLanguage language)
 {
-    (*symbolTables[language]).adoptLevels(*commonTable[CommonIndex(profile, language)]);
-    InitializeSymbolTable(builtIns.getStageString(language), version, profile, language, infoSink, *symbolTables[language]);
-    IdentifyBuiltIns(version, profile, language, *symbolTables[language]);
-    if (profile == EEsProfile && version >= 300)
-        (*symbolTables[language]).setNoBuiltInRedeclarations();
-    if (version == 110)
-        (*symbolTables[language]).setSeparateNameSpaces();
+    switch (language) {
+    case EShLangVertex:
+    case EShLangFragment:
+        return true;
+    case EShLangTessControl:
+    case EShLangTessEvaluation:
+    case EShLangGeometry:
+        return (profile != EEsProfile && version >= 150) ||
+               (profile == EEsProfile && version >= 310);
+    case EShLangCompute:
+        return (profile != EEsProfile && version >= 430) ||
+               (profile == EEsProfile && version >= 310);
+    default:
+        return false;
+    }
 }
 
 //
-// Initialize the full set of shareable symbol tables;
-// The common (cross-stage) and those shareable per-stage.
+// To initialize the common (cross-stage) tables.  The common built-ins are tagged
+// here, for every stage there is, so that a stage table can be made later, on
+// its own, adopting the read-only common table.
 //
-bool InitializeSymbolTables(TInfoSink& infoSink, TSymbolTable** commonTable,  TSymbolTable** symbolTables, int version, EProfile profile)
+void InitializeCommonSymbolTables(TBuiltIns& builtIns, TInfoSink& infoSink, TSymbolTable** commonTable, int version, EProfile profile)
 {
-    TBuiltIns builtIns;
-    builtIns.initialize(version, profile);
-
-    // do the common tables
     InitializeSymbolTable(builtIns.getCommonString(), version, profile, EShLangVertex, infoSink, *commonTable[EPcGeneral]);
     if (profile == EEsProfile)
         InitializeSymbolTable(builtIns.getCommonString(), version, profile, EShLangFragment, infoSink, *commonTable[EPcFragment]);
 
-    // do the per-stage tables
+    for (int stage = 0; stage < EShLangCount; ++stage) {
+        if (HasStageBuiltIns(version, profile, (EShLanguage)stage))
+            IdentifyBuiltIns(version, profile, (EShLanguage)stage, *commonTable[CommonIndex(profile, (EShLanguage)stage)]);
+    }
+}
+
+//
+// To initialize a per-stage shared table, with the common tables already complete.
+//
+void InitializeStageSymbolTable(TBuiltIns& builtIns, int version, EProfile profile, EShLanguage language, TInfoSink& infoSink, TSymbolTable** commonTable, TSymbolTable& symbolTable)
+{
+    symbolTable.adoptLevels(*commonTable[CommonIndex(profile, language)]);
+    InitializeSymbolTable(builtIns.getStageString(language), version, profile, language, infoSink, symbolTable);
+    IdentifyBuiltIns(version, profile, language, symbolTable);
+    if (profile == EEsProfile && version >= 300)
+        symbolTable.setNoBuiltInRedeclarations();
+    if (version == 110)
+        symbolTable.setSeparateNameSpaces();
+}
+
+//
+// A built-in snapshot is SnapshotHeader(), then each table: its version, its
+// profile, its kind (its stage, or EShLangCount plus its precision class for a
+// common table), the hash of its built-in text, its size, and its levels, as
+// TSymbolTable::writeOwnLevels() wrote them.
+//
+// The levels copy the bytes of qualifiers, samplers, and constants, so the
+// header has their layouts, along with the version of this format, and a
+// snapshot differing in any of them is refused.
+//
+const int SnapshotFormat = 1;
+const int SnapshotKindCount = EShLangCount + EPcCount;
 
-    // always have vertex and fragment
-    InitializeStageSymbolTable(builtIns, version, profile, EShLangVertex, infoSink, commonTable, symbolTables);
-    InitializeStageSymbolTable(builtIns, version, profile, EShLangFragment, infoSink, commonTable, symbolTables);
+std::string SnapshotHeader()
+{
+    std::string header("glslang built-in symbol tables");
+    TSnapshotWriter out(header);
+    out.putInt(SnapshotFormat);
+    out.putInt(0x01020304);  // byte order
+    out.putInt(sizeof(TSampler));
+    out.putInt(sizeof(TQualifier));
+    out.putInt(sizeof(TConstUnion));
+
+    return header;
+}
 
-    // check for tessellation
-    if ((profile != EEsProfile && version >= 150) ||
-        (profile == EEsProfile && version >= 310)) {
-        InitializeStageSymbolTable(builtIns, version, profile, EShLangTessControl, infoSink, commonTable, symbolTables);
-        InitializeStageSymbolTable(builtIns, version, profile, EShLangTessEvaluation, infoSink, commonTable, symbolTables);
+// 64-bit FNV-1a of built-in text, continuing from 'hash'
+unsigned long long HashBuiltIns(const TString& text, unsigned long long hash = 14695981039346656037ULL)
+{
+    for (size_t c = 0; c < text.size(); ++c) {
+        hash ^= (unsigned char)text[c];
+        hash *= 1099511628211ULL;
     }
 
-    // check for geometry
-    if ((profile != EEsProfile && version >= 150) ||
-        (profile == EEsProfile && version >= 310))
-        InitializeStageSymbolTable(builtIns, version, profile, EShLangGeometry, infoSink, commonTable, symbolTables);
+    return hash;
+}
 
-    // check for compute
-    if ((profile != EEsProfile && version >= 430) ||
-        (profile == EEsProfile && version >= 310))
-        InitializeStageSymbolTable(builtIns, version, profile, EShLangCompute, infoSink, commonTable, symbolTables);
+// The hash of what a table is parsed from.  A stage table is parsed on top of a
+// common table, so its hash is of both.
+unsigned long long CommonHash(const TBuiltIns& builtIns)
+{
+    return HashBuiltIns(builtIns.getCommonString());
+}
 
-    return true;
+unsigned long long StageHash(const TBuiltIns& builtIns, EShLanguage language)
+{
+    return HashBuiltIns(builtIns.getStageString(language), CommonHash(builtIns));
+}
+
+//
+// Read the common tables of the version/profile from the snapshot, into the
+// process-global pool, if it has them for this build's built-ins.  Returns
+// false if they have to be parsed instead.
+//
+bool ReadCommonSymbolTables(const TBuiltIns& builtIns, int versionIndex, int profileIndex, EProfile profile)
+{
+    // non-ES has only the general precision class
+    int precClasses = profile == EEsProfile ? EPcCount : 1;
+    unsigned long long hash = CommonHash(builtIns);
+    for (int precClass = 0; precClass < precClasses; ++precClass) {
+        const TSnapshotTable& snapshot = SnapshotCommonTables[versionIndex][profileIndex][precClass];
+        if (snapshot.data == nullptr || snapshot.hash != hash)
+            return false;
+    }
+
+    glslang::GetGlobalLock();
+    TPoolAllocator& previousAllocator = GetThreadPoolAllocator();
+    SetThreadPoolAllocator(*PerProcessGPA);
+
+    bool read = true;
+    for (int precClass = 0; precClass < precClasses && read; ++precClass) {
+        const TSnapshotTable& snapshot = SnapshotCommonTables[versionIndex][profileIndex][precClass];
+        TSnapshotReader in(snapshot.data, snapshot.size);
+        TSymbolTable* table = new TSymbolTable;
+        read = table->readOwnLevels(in) && in.atEnd() && ! table->isEmpty();
+        if (read) {
+            table->readOnly();
+            CommonSymbolTable[versionIndex][profileIndex][precClass] = table;
+        } else
+            delete table;
+    }
+    if (! read) {
+        for (int precClass = 0; precClass < precClasses; ++precClass) {
+            delete CommonSymbolTable[versionIndex][profileIndex][precClass];
+            CommonSymbolTable[versionIndex][profileIndex][precClass] = nullptr;
+        }
+    }
+
+    SetThreadPoolAllocator(previousAllocator);
+    glslang::ReleaseGlobalLock();
+
+    return read;
+}
+
+//
+// Likewise for the shared table of a stage, on top of the common table.
+//
+bool ReadStageSymbolTable(const TBuiltIns& builtIns, int versionIndex, int profileIndex, EProfile profile, EShLanguage language)
+{
+    const TSnapshotTable& snapshot = SnapshotStageTables[versionIndex][profileIndex][language];
+    if (snapshot.data == nullptr || snapshot.hash != StageHash(builtIns, language))
+        return false;
+
+    glslang::GetGlobalLock();
+    TPoolAllocator& previousAllocator = GetThreadPoolAllocator();
+    SetThreadPoolAllocator(*PerProcessGPA);
+
+    TSnapshotReader in(snapshot.data, snapshot.size);
+    TSymbolTable* table = new TSymbolTable;
+    table->adoptLevels(*CommonSymbolTable[versionIndex][profileIndex][CommonIndex(profile, language)]);
+    bool read = table->readOwnLevels(in) && in.atEnd();
+    if (read) {
+        table->readOnlyOwnLevels();
+        SharedSymbolTables[versionIndex][profileIndex][language] = table;
+    } else
+        delete table;
+
+    SetThreadPoolAllocator(previousAllocator);
+    glslang::ReleaseGlobalLock();
+
+    return read;
 }
 
 bool AddContextSpecificSymbols(const TBuiltInResource* resources, TInfoSink& infoSink, TSymbolTable& symbolTable, int version, EProfile profile, EShLanguage language)
@@ -223,12 +445,65 @@ bool AddContextSpecificSymbols(const TBuiltInResource* resources, TInfoSink& inf
     TBuiltIns builtIns;
     
     builtIns.initialize(*resources, version, profile, language);
-    InitializeSymbolTable(builtIns.getCommonString(), version, profile, language, infoSink, symbolTable);
+    if (! InitializeSymbolTable(builtIns.getCommonString(), version, profile, language, infoSink, symbolTable))
+        return false;
     IdentifyBuiltIns(version, profile, language, symbolTable, *resources);
 
     return true;
 }
 
+//
+// Find, or make, the cached 'sharedTable' plus context-specific symbols for the
+// given resources; see ContextSymbolTables.  Just the integer resources make
+// built-ins; the limits only affect checking.
+//
+// Returns nullptr when the compile has to add the symbols itself.
+//
+TSymbolTable* GetContextSymbolTable(TSymbolTable& sharedTable, const TBuiltInResource& resources, int version,
+                                    EProfile profile, EShLanguage language)
+{
+    std::string key((const char*)&resources, offsetof(TBuiltInResource, limits));
+    key.append((const char*)&version, sizeof(version));
+    key.append((const char*)&profile, sizeof(profile));
+    key.append((const char*)&language, sizeof(language));
+
+    std::lock_guard<std::mutex> guard(ContextSymbolTablesMutex);
+    TContextSymbolTables::const_iterator it = ContextSymbolTables.find(key);
+    if (it != ContextSymbolTables.end())
+        return it->second;
+    if (ContextSymbolTables.size() >= MaxContextSymbolTables)
+        return nullptr;
+
+    // As in SetupBuiltinSymbolTable(): build in a new pool, then copy to the
+    // process-global pool
+    TPoolAllocator& previousAllocator = GetThreadPoolAllocator();
+    TPoolAllocator* contextPoolAllocator = new TPoolAllocator();
+    SetThreadPoolAllocator(*contextPoolAllocator);
+
+    TInfoSink infoSink;
+    TSymbolTable* localTable = new TSymbolTable;
+    localTable->adoptLevels(sharedTable);
+    TSymbolTable* contextTable = nullptr;
+    if (AddContextSpecificSymbols(&resources, infoSink, *localTable, version, profile, language)) {
+        glslang::GetGlobalLock();
+        SetThreadPoolAllocator(*PerProcessGPA);
+        contextTable = new TSymbolTable;
+        contextTable->adoptLevels(sharedTable);
+        contextTable->copyTable(*localTable);
+        contextTable->readOnlyOwnLevels();
+        SetThreadPoolAllocator(*contextPoolAllocator);
+        glslang::ReleaseGlobalLock();
+    }
+
+    delete localTable;
+    delete contextPoolAllocator;
+    SetThreadPoolAllocator(previousAllocator);
+
+    ContextSymbolTables[key] = contextTable;
+
+    return contextTable;
+}
+
 //
 // To do this on the fly, we want to leave the current state of our thread's 
 // pool allocator intact, so:
@@ -239,70 +514,147 @@ bool AddContextSpecificSymbols(const TBuiltInResource* resources, TInfoSink& inf
 //  - Switch back to the original thread's pool
 //
 // This only gets done the first time any thread needs a particular symbol table
-// (lazy evaluation).
+// (lazy evaluation), and just for the stage needed, plus the common tables the
+// first time the version/profile is.
 //
-void SetupBuiltinSymbolTable(int version, EProfile profile)
+void SetupBuiltinSymbolTable(int version, EProfile profile, EShLanguage language)
 {
-    TInfoSink infoSink;
-
-    // Make sure only one thread tries to do this at a time
-    glslang::GetGlobalLock();
-
-    // See if it's already been done for this version/profile combination
+    // See if it's already been done for this version/profile/stage combination
     int versionIndex = MapVersionToIndex(version);
     int profileIndex = MapProfileToIndex(profile);
-    if (CommonSymbolTable[versionIndex][profileIndex][EPcGeneral]) {
-        glslang::ReleaseGlobalLock();
+    if (SymbolTablesReady[versionIndex][profileIndex][language].load(std::memory_order_acquire))
+        return;
 
+    // Make sure only one thread tries to do this at a time for this version/profile
+    std::lock_guard<std::mutex> slotGuard(SymbolTablesMutex[versionIndex][profileIndex]);
+    if (SymbolTablesReady[versionIndex][profileIndex][language].load(std::memory_order_relaxed))
         return;
-    }
+
+    TInfoSink infoSink;
 
     // Switch to a new pool
     TPoolAllocator& previousAllocator = GetThreadPoolAllocator();
     TPoolAllocator* builtInPoolAllocator = new TPoolAllocator();
     SetThreadPoolAllocator(*builtInPoolAllocator);
 
-    // Dynamically allocate the local symbol tables so we can control when they are deallocated WRT when the pool is popped.
-    TSymbolTable* commonTable[EPcCount];
-    TSymbolTable* stageTables[EShLangCount];
-    for (int precClass = 0; precClass < EPcCount; ++precClass)
-        commonTable[precClass] = new TSymbolTable;
-    for (int stage = 0; stage < EShLangCount; ++stage)
-        stageTables[stage] = new TSymbolTable;
+    TBuiltIns builtIns;
+    builtIns.initialize(version, profile);
 
-    // Generate the local symbol tables using the new pool
-    InitializeSymbolTables(infoSink, commonTable, stageTables, version, profile);
+    // A snapshot's tables are read, if it has them, rather than parsed
+    if (! CommonSymbolTablesReady[versionIndex][profileIndex] &&
+        ReadCommonSymbolTables(builtIns, versionIndex, profileIndex, profile))
+        CommonSymbolTablesReady[versionIndex][profileIndex] = true;
+
+    if (! CommonSymbolTablesReady[versionIndex][profileIndex]) {
+        // Dynamically allocate the local symbol tables so we can control when they are deallocated WRT when the pool is popped.
+        TSymbolTable* commonTable[EPcCount];
+        for (int precClass = 0; precClass < EPcCount; ++precClass)
+            commonTable[precClass] = new TSymbolTable;
+
+        // Generate the local symbol tables using the new pool
+        InitializeCommonSymbolTables(builtIns, infoSink, commonTable, version, profile);
+
+        // Switch to the process-global pool, which is shared by all slots, so
+        // the copy into it is still serialized across slots
+        glslang::GetGlobalLock();
+        SetThreadPoolAllocator(*PerProcessGPA);
+
+        // Copy the local symbol tables from the new pool to the global tables using the process-global pool
+        for (int precClass = 0; precClass < EPcCount; ++precClass) {
+            if (! commonTable[precClass]->isEmpty()) {
+                CommonSymbolTable[versionIndex][profileIndex][precClass] = new TSymbolTable;
+                CommonSymbolTable[versionIndex][profileIndex][precClass]->copyTable(*commonTable[precClass]);
+                CommonSymbolTable[versionIndex][profileIndex][precClass]->readOnly();
+            }
+        }
 
-    // Switch to the process-global pool
-    SetThreadPoolAllocator(*PerProcessGPA);
+        SetThreadPoolAllocator(*builtInPoolAllocator);
+        glslang::ReleaseGlobalLock();
 
-    // Copy the local symbol tables from the new pool to the global tables using the process-global pool
-    for (int precClass = 0; precClass < EPcCount; ++precClass) {
-        if (! commonTable[precClass]->isEmpty()) {
-            CommonSymbolTable[versionIndex][profileIndex][precClass] = new TSymbolTable;
-            CommonSymbolTable[versionIndex][profileIndex][precClass]->copyTable(*commonTable[precClass]);
-            CommonSymbolTable[versionIndex][profileIndex][precClass]->readOnly();
-        }
-    }
-    for (int stage = 0; stage < EShLangCount; ++stage) {
-        if (! stageTables[stage]->isEmpty()) {
-            SharedSymbolTables[versionIndex][profileIndex][stage] = new TSymbolTable;
-            SharedSymbolTables[versionIndex][profileIndex][stage]->adoptLevels(*CommonSymbolTable[versionIndex][profileIndex][CommonIndex(profile, (EShLanguage)stage)]);
-            SharedSymbolTables[versionIndex][profileIndex][stage]->copyTable(*stageTables[stage]);
-            SharedSymbolTables[versionIndex][profileIndex][stage]->readOnly();
-        }    
+        // Clean up the local tables before deleting the pool they used.
+        for (int precClass = 0; precClass < EPcCount; ++precClass)
+            delete commonTable[precClass];
+
+        CommonSymbolTablesReady[versionIndex][profileIndex] = true;
     }
 
-    // Clean up the local tables before deleting the pool they used.
-    for (int precClass = 0; precClass < EPcCount; ++precClass)
-        delete commonTable[precClass];
-    for (int stage = 0; stage < EShLangCount; ++stage)
-        delete stageTables[stage];
+    if (HasStageBuiltIns(version, profile, language) &&
+        ! ReadStageSymbolTable(builtIns, versionIndex, profileIndex, profile, language)) {
+        // The local stage table adopts the global common table, which is read-only
+        // and already tagged, so only the stage level is made in the new pool
+        TSymbolTable* stageTable = new TSymbolTable;
+        InitializeStageSymbolTable(builtIns, version, profile, language, infoSink,
+                                   CommonSymbolTable[versionIndex][profileIndex], *stageTable);
+
+        glslang::GetGlobalLock();
+        SetThreadPoolAllocator(*PerProcessGPA);
+
+        SharedSymbolTables[versionIndex][profileIndex][language] = new TSymbolTable;
+        SharedSymbolTables[versionIndex][profileIndex][language]->adoptLevels(*CommonSymbolTable[versionIndex][profileIndex][CommonIndex(profile, language)]);
+        SharedSymbolTables[versionIndex][profileIndex][language]->copyTable(*stageTable);
+        SharedSymbolTables[versionIndex][profileIndex][language]->readOnlyOwnLevels();
+
+        SetThreadPoolAllocator(*builtInPoolAllocator);
+        glslang::ReleaseGlobalLock();
+
+        delete stageTable;
+    }
 
     delete builtInPoolAllocator;
     SetThreadPoolAllocator(previousAllocator);
 
-    glslang::ReleaseGlobalLock();
+    SymbolTablesReady[versionIndex][profileIndex][language].store(true, std::memory_order_release);
+}
+
+//
+// The shared table of the stage, already set up, to adopt on this thread: a
+// copy on the thread's NUMA node, made now if it's the first, when the thread
+// is pinned to a node other than the first.  Returns null if the stage has no
+// built-ins of its own.
+//
+TSymbolTable* GetSharedSymbolTable(int version, EProfile profile, EShLanguage language)
+{
+    int versionIndex = MapVersionToIndex(version);
+    int profileIndex = MapProfileToIndex(profile);
+    TSymbolTable* sharedTable = SharedSymbolTables[versionIndex][profileIndex][language];
+    int node = GetThreadMemoryNode();
+    if (sharedTable == nullptr || node == 0)
+        return sharedTable;
+
+    std::atomic<TSymbolTable*>& nodeTable = NodeSharedSymbolTables[node][versionIndex][profileIndex][language];
+    TSymbolTable* table = nodeTable.load(std::memory_order_acquire);
+    if (table)
+        return table;
+
+    std::lock_guard<std::mutex> guard(NodeSymbolTablesMutex[node]);
+    table = nodeTable.load(std::memory_order_relaxed);
+    if (table)
+        return table;
+
+    // The copies are made by this thread, which is on the node, so first
+    // touching their pages puts those on the node too
+    TPoolAllocator& previousAllocator = GetThreadPoolAllocator();
+    if (NodePools[node] == nullptr)
+        NodePools[node] = new TPoolAllocator();
+    SetThreadPoolAllocator(*NodePools[node]);
+
+    int precClass = CommonIndex(profile, language);
+    TSymbolTable*& commonTable = NodeCommonSymbolTables[node][versionIndex][profileIndex][precClass];
+    if (commonTable == nullptr) {
+        commonTable = new TSymbolTable;
+        commonTable->copyTable(*CommonSymbolTable[versionIndex][profileIndex][precClass]);
+        commonTable->readOnly();
+    }
+
+    table = new TSymbolTable;
+    table->adoptLevels(*commonTable);
+    table->copyTable(*sharedTable);
+    table->readOnlyOwnLevels();
+
+    SetThreadPoolAllocator(previousAllocator);
+    nodeTable.store(table, std::memory_order_release);
+
+    return table;
 }
 
 bool DeduceVersionProfile(TInfoSink& infoSink, EShLanguage stage, bool versionNotFirst, int defaultVersion, int& version, EProfile& profile)
@@ -435,6 +787,34 @@ bool DeduceVersionProfile(TInfoSink& infoSink, EShLanguage stage, bool versionNo
     return correct;
 }
 
+//
+// Validate and normalize (version, profile) pairs the way a shader's #version
+// would be, for making their built-ins.  Returns false if any pair is not a
+// valid combination; the valid ones are still in 'work', each once.
+//
+bool NormalizeVersionProfiles(const std::vector<std::pair<int, EProfile> >& versionProfiles,
+                              std::vector<std::pair<int, EProfile> >& work)
+{
+    bool success = true;
+    for (size_t i = 0; i < versionProfiles.size(); ++i) {
+        TInfoSink infoSink;
+        int version = versionProfiles[i].first;
+        EProfile profile = versionProfiles[i].second;
+        // ES is implied by version 100, so allow naming it explicitly here
+        if (version == 100 && profile == EEsProfile)
+            profile = ENoProfile;
+        if (version == 0 || (MapVersionToIndex(version) == 0 && version != 100) ||
+            ! DeduceVersionProfile(infoSink, EShLangVertex, false, version, version, profile)) {
+            success = false;
+            continue;
+        }
+        if (std::find(work.begin(), work.end(), std::make_pair(version, profile)) == work.end())
+            work.push_back(std::make_pair(version, profile));
+    }
+
+    return success;
+}
+
 // This is the common setup and cleanup code for PreprocessDeferred and
 // CompileDeferred.
 // It takes any callable with a signature of
@@ -444,6 +824,34 @@ bool DeduceVersionProfile(TInfoSink& infoSink, EShLanguage stage, bool versionNo
 //                  EShOptimizationLevel , EShMessages );
 // Which returns false if a failure was detected and true otherwise.
 //
+//
+// Remembers a pool's statistics, so the usage since can be reported
+// as memory stats.
+//
+class TPoolMark {
+public:
+    explicit TPoolMark(TPoolAllocator& p) : pool(p), numCalls(p.getNumCalls()), totalBytes(p.getTotalBytes()),
+                                            numPages(p.getNumPages()), heldBytes(p.getHeldBytes())
+    {
+        pool.resetPeak();
+    }
+
+    void getMemoryStats(ShMemoryStats& stats) const
+    {
+        stats.poolBytes = pool.getTotalBytes() - totalBytes;
+        stats.poolPeakBytes = pool.getPeakHeldBytes() - heldBytes;
+        stats.poolAllocations = pool.getNumCalls() - numCalls;
+        stats.poolPages = pool.getNumPages() - numPages;
+    }
+
+protected:
+    TPoolAllocator& pool;
+    int numCalls;
+    size_t totalBytes;
+    int numPages;
+    size_t heldBytes;
+};
+
 template<typename ProcessingContext>
 bool ProcessDeferred(
     TCompiler* compiler,
@@ -464,7 +872,11 @@ bool ProcessDeferred(
     TIntermediate& intermediate, // returned tree, etc.
     ProcessingContext& processingContext,
     bool requireNonempty,
-    const TShader::Includer& includer
+    const TShader::Includer& includer,
+    const TPpSnapshot* preambleSnapshot = nullptr, // stands in for customPreamble, if made for this version/profile
+    const char* preambleSnapshotRest = nullptr,     // the part of customPreamble after what preambleSnapshot stands in for
+    std::unordered_set<std::string>* macroLookups = nullptr, // filled in with the macros the shader strings looked up
+    const TParseLimits* parseLimits = nullptr
     )
 {
     if (! InitThread())
@@ -473,6 +885,13 @@ bool ProcessDeferred(
     // This must be undone (.pop()) by the caller, after it finishes consuming the created tree.
     GetThreadPoolAllocator().push();
 
+    TPoolMark poolMark(GetThreadPoolAllocator());
+    memset(&compiler->memoryStats, 0, sizeof(compiler->memoryStats));
+    memset(&compiler->timingStats, 0, sizeof(compiler->timingStats));
+    ShTimingStats* timingStats = (messages & EShMsgTiming) ? &compiler->timingStats : nullptr;
+    memset(&compiler->counterStats, 0, sizeof(compiler->counterStats));
+    ShCounterStats* counterStats = (messages & EShMsgCounters) ? &compiler->counterStats : nullptr;
+
     if (numStrings == 0)
         return true;
     
@@ -544,21 +963,31 @@ bool ProcessDeferred(
 
     intermediate.setVersion(version);
     intermediate.setProfile(profile);
-    SetupBuiltinSymbolTable(version, profile);
-    
-    TSymbolTable* cachedTable = SharedSymbolTables[MapVersionToIndex(version)]
-                                                  [MapProfileToIndex(profile)]
-                                                  [compiler->getLanguage()];
-    
+
     // Dynamically allocate the symbol table so we can control when it is deallocated WRT the pool.
     TSymbolTable* symbolTableMemory = new TSymbolTable;
     TSymbolTable& symbolTable = *symbolTableMemory;
-    if (cachedTable)
-        symbolTable.adoptLevels(*cachedTable);
-    
-    // Add built-in symbols that are potentially context dependent;
-    // they get popped again further down.
-    AddContextSpecificSymbols(resources, compiler->infoSink, symbolTable, version, profile, compiler->getLanguage());
+    {
+        TPhaseTimer timer(timingStats, EShPhaseBuiltIns);
+        SetupBuiltinSymbolTable(version, profile, compiler->getLanguage());
+
+        TSymbolTable* cachedTable = GetSharedSymbolTable(version, profile, compiler->getLanguage());
+        TSymbolTable* contextTable = cachedTable ? GetContextSymbolTable(*cachedTable, *resources, version, profile,
+                                                                         compiler->getLanguage())
+                                                 : nullptr;
+        if (contextTable) {
+            // The compile may edit these built-ins in place, so it gets its own copy
+            symbolTable.adoptLevels(*cachedTable);
+            symbolTable.copyTable(*contextTable);
+        } else {
+            if (cachedTable)
+                symbolTable.adoptLevels(*cachedTable);
+
+            // Add built-in symbols that are potentially context dependent;
+            // they get popped again further down.
+            AddContextSpecificSymbols(resources, compiler->infoSink, symbolTable, version, profile, compiler->getLanguage());
+        }
+    }
     
     //
     // Now we can process the full shader under proper symbols and rules.
@@ -569,7 +998,13 @@ bool ProcessDeferred(
     TPpContext ppContext(parseContext, includer);
     parseContext.setScanContext(&scanContext);
     parseContext.setPpContext(&ppContext);
+    scanContext.setTimingStats(timingStats);
+    ppContext.setCounterStats(counterStats);
+    parseContext.setCounterStats(counterStats);
+    symbolTable.setCounterStats(counterStats);
     parseContext.setLimits(*resources);
+    if (parseLimits)
+        parseContext.setParseLimits(*parseLimits);
     if (! goodVersion)
         parseContext.addError();
     if (warnVersionNotFirst) {
@@ -580,12 +1015,14 @@ bool ProcessDeferred(
 
     parseContext.initializeExtensionBehavior();
 
+    bool useSnapshot = preambleSnapshot != nullptr && preambleSnapshot->version == version &&
+                       preambleSnapshot->profile == profile;
     
     // Fill in the strings as outlined above.
     strings[0] = parseContext.getPreamble();
     lengths[0] = strlen(strings[0]);
     names[0] = nullptr;
-    strings[1] = customPreamble;
+    strings[1] = useSnapshot ? (preambleSnapshotRest ? preambleSnapshotRest : "") : customPreamble;
     lengths[1] = strlen(strings[1]);
     names[1] = nullptr;
     assert(2 == numPre);
@@ -597,12 +1034,29 @@ bool ProcessDeferred(
     }
     TInputScanner fullInput(numStrings + numPre + numPost, strings, lengths, names, numPre, numPost);
 
+    if (useSnapshot) {
+        parseContext.setScanner(&fullInput);
+        ppContext.applySnapshot(*preambleSnapshot);
+    }
+
+    if (macroLookups)
+        ppContext.recordMacroLookups();
+
     // Push a new symbol allocation scope that will get used for the shader's globals.
     symbolTable.push();
 
+    const int startNodes = GetThreadPoolAllocator().getNumNodes();
     bool success = processingContext(parseContext, ppContext, fullInput,
                                      versionWillBeError, symbolTable,
                                      intermediate, optLevel, messages);
+    if (counterStats)
+        counterStats->nodes = GetThreadPoolAllocator().getNumNodes() - startNodes;
+
+    if (macroLookups)
+        ppContext.getMacroLookups(*macroLookups);
+
+    poolMark.getMemoryStats(compiler->memoryStats);
+    ppContext.getMemoryStats(compiler->memoryStats);
 
     // Clean up the symbol table. The AST is self-sufficient now.
     delete symbolTableMemory;
@@ -621,7 +1075,7 @@ bool ProcessDeferred(
 class SourceLineSynchronizer {
 public:
     SourceLineSynchronizer(const std::function<int()>& lastSourceIndex,
-                           std::stringstream* output)
+                           std::ostream* output)
       : getLastSourceIndex(lastSourceIndex), output(output), lastSource(-1), lastLine(0) {}
 //    SourceLineSynchronizer(const SourceLineSynchronizer&) = delete;
 //    SourceLineSynchronizer& operator=(const SourceLineSynchronizer&) = delete;
@@ -636,7 +1090,7 @@ public:
             // used. We also need to output a newline to separate the output
             // from the previous source string (if there is one).
             if (lastSource != -1 || lastLine != 0)
-                *output << std::endl;
+                *output << '\n';
             lastSource = getLastSourceIndex();
             lastLine = -1;
             return true;
@@ -651,7 +1105,7 @@ public:
         syncToMostRecentString();
         const bool newLineStarted = lastLine < tokenLine;
         for (; lastLine < tokenLine; ++lastLine) {
-            if (lastLine > 0) *output << std::endl;
+            if (lastLine > 0) *output << '\n';
         }
         return newLineStarted;
     }
@@ -664,7 +1118,7 @@ private:
     // read tokens from.
     const std::function<int()> getLastSourceIndex;
     // output stream for newlines.
-    std::stringstream* output;
+    std::ostream* output;
     // lastSource is the source string index (starting from 0) of the last token
     // processed. It is tracked in order for newlines to be inserted when a new
     // source string starts. -1 means we haven't started processing any source
@@ -679,14 +1133,17 @@ private:
 
 // DoPreprocessing is a valid ProcessingContext template argument,
 // which only performs the preprocessing step of compilation.
-// It places the result in the "string" argument to its constructor.
+// It writes the result to the stream given to its constructor as it goes,
+// so nothing but the stream's own buffering holds the output.
 struct DoPreprocessing {
-    explicit DoPreprocessing(std::string* string): outputString(string) {}
+    DoPreprocessing(std::ostream& stream, ShTimingStats* timing) : output(stream), timingStats(timing) {}
     bool operator()(TParseContext& parseContext, TPpContext& ppContext,
                     TInputScanner& input, bool versionWillBeError,
                     TSymbolTable& , TIntermediate& ,
                     EShOptimizationLevel , EShMessages )
     {
+        TPhaseTimer timer(timingStats, EShPhasePreprocess);
+
         // This is a list of tokens that do not require a space before or after.
         static const std::string unNeededSpaceTokens = ";()[]";
         static const std::string noSpaceBeforeTokens = ",";
@@ -695,7 +1152,7 @@ struct DoPreprocessing {
         parseContext.setScanner(&input);
         ppContext.setInput(input, versionWillBeError);
 
-        std::stringstream outputStream;
+        std::ostream& outputStream = output;
         SourceLineSynchronizer lineSync(
             std::bind(&TInputScanner::getLastValidSourceIndex, &input), &outputStream);
 
@@ -723,7 +1180,7 @@ struct DoPreprocessing {
                 // directive. So the new line number for the current line is
                 newLineNum -= 1;
             }
-            outputStream << std::endl;
+            outputStream << '\n';
             // And we are at the next line of the #line directive now.
             lineSync.setLineNum(newLineNum + 1);
         });
@@ -776,8 +1233,7 @@ struct DoPreprocessing {
             lastToken = token.token;
             outputStream << tok;
         }
-        outputStream << std::endl;
-        *outputString = outputStream.str();
+        outputStream << '\n';
 
         bool success = true;
         if (parseContext.getNumErrors() > 0) {
@@ -787,31 +1243,47 @@ struct DoPreprocessing {
         }
         return success;
     }
-    std::string* outputString;
+    std::ostream& output;
+    ShTimingStats* timingStats;
 };
 
 // DoFullParse is a valid ProcessingConext template argument for fully
 // parsing the shader.  It populates the "intermediate" with the AST.
 struct DoFullParse{
+  explicit DoFullParse(ShTimingStats* timing) : timingStats(timing) { }
   bool operator()(TParseContext& parseContext, TPpContext& ppContext,
                   TInputScanner& fullInput, bool versionWillBeError,
                   TSymbolTable& symbolTable, TIntermediate& intermediate,
                   EShOptimizationLevel optLevel, EShMessages messages) 
     {
         bool success = true;
-        // Parse the full shader.
-        if (! parseContext.parseShaderStrings(ppContext, fullInput, versionWillBeError))
-            success = false;
-        intermediate.addSymbolLinkageNodes(parseContext.linkage, parseContext.language, symbolTable);
+        // Parse the full shader.  The parser pulls tokens from the preprocessor,
+        // which charges itself to EShPhasePreprocess, so take that back out of parsing.
+        double preprocessSeconds = timingStats ? timingStats->seconds[EShPhasePreprocess] : 0.0;
+        int preprocessAllocations = timingStats ? timingStats->poolAllocations[EShPhasePreprocess] : 0;
+        {
+            TPhaseTimer timer(timingStats, EShPhaseParse);
+            if (! parseContext.parseShaderStrings(ppContext, fullInput, versionWillBeError))
+                success = false;
+        }
+        if (timingStats) {
+            timingStats->seconds[EShPhaseParse] -= timingStats->seconds[EShPhasePreprocess] - preprocessSeconds;
+            timingStats->poolAllocations[EShPhaseParse] -= timingStats->poolAllocations[EShPhasePreprocess] - preprocessAllocations;
+        }
 
-        if (success && intermediate.getTreeRoot()) {
-            if (optLevel == EShOptNoGeneration)
-                parseContext.infoSink.info.message(EPrefixNone, "No errors.  No code generation or linking was requested.");
-            else
-                success = intermediate.postProcess(intermediate.getTreeRoot(), parseContext.language);
-        } else if (! success) {
-            parseContext.infoSink.info.prefix(EPrefixError);
-            parseContext.infoSink.info << parseContext.getNumErrors() << " compilation errors.  No code generated.\n\n";
+        {
+            TPhaseTimer timer(timingStats, EShPhaseFinalCheck);
+            intermediate.addSymbolLinkageNodes(parseContext.linkage, parseContext.language, symbolTable);
+
+            if (success && intermediate.getTreeRoot()) {
+                if (optLevel == EShOptNoGeneration)
+                    parseContext.infoSink.info.message(EPrefixNone, "No errors.  No code generation or linking was requested.");
+                else
+                    success = intermediate.postProcess(intermediate.getTreeRoot(), parseContext.language);
+            } else if (! success) {
+                parseContext.infoSink.info.prefix(EPrefixError);
+                parseContext.infoSink.info << parseContext.getNumErrors() << " compilation errors.  No code generated.\n\n";
+            }
         }
 
         if (messages & EShMsgAST)
@@ -819,6 +1291,44 @@ struct DoFullParse{
 
         return success;
     }
+    ShTimingStats* timingStats;
+};
+
+// DoPreambleSnapshot is a valid ProcessingContext template argument for
+// preprocessing a custom preamble into a TPpSnapshot (see TPreamble).  The
+// shader itself should be empty.
+struct DoPreambleSnapshot {
+    explicit DoPreambleSnapshot(TPpSnapshot& s) : snapshot(s) {}
+    bool operator()(TParseContext& parseContext, TPpContext& ppContext,
+                    TInputScanner& input, bool versionWillBeError,
+                    TSymbolTable& , TIntermediate& intermediate,
+                    EShOptimizationLevel , EShMessages )
+    {
+        parseContext.setScanner(&input);
+        ppContext.setInput(input, versionWillBeError);
+        ppContext.recordPreamble(&snapshot);
+
+        // These have effects a snapshot doesn't record
+        parseContext.setPragmaCallback([&parseContext](int, const TVector<TString>&) {
+            parseContext.ppError(parseContext.getCurrentLoc(), "not supported in a preprocessed preamble", "#pragma", "");
+        });
+        parseContext.setLineCallback([&parseContext](int, int, bool, int, const char*) {
+            parseContext.ppError(parseContext.getCurrentLoc(), "not supported in a preprocessed preamble", "#line", "");
+        });
+
+        TPpToken token;
+        if (const char* tok = ppContext.tokenize(&token))
+            parseContext.ppError(token.loc, "only preprocessor directives are allowed in a preprocessed preamble", tok, "");
+        if (! snapshot.replayable)
+            parseContext.ppError(parseContext.getCurrentLoc(), "a preprocessed preamble can't change a predefined macro", "", "");
+
+        snapshot.version = intermediate.getVersion();
+        snapshot.profile = intermediate.getProfile();
+        snapshot.defined.clear();
+
+        return parseContext.getNumErrors() == 0;
+    }
+    TPpSnapshot& snapshot;
 };
 
 // Take a single compilation unit, and run the preprocessor on it.
@@ -841,9 +1351,9 @@ bool PreprocessDeferred(
     EShMessages messages,       // warnings/errors/AST; things to print out
     const TShader::Includer& includer,
     TIntermediate& intermediate, // returned tree, etc.
-    std::string* outputString)
+    std::ostream& outputStream)
 {
-    DoPreprocessing parser(outputString);
+    DoPreprocessing parser(outputStream, (messages & EShMsgTiming) ? &compiler->timingStats : nullptr);
     return ProcessDeferred(compiler, shaderStrings, numStrings, inputLengths, stringNames,
                            preamble, optLevel, resources, defaultVersion,
                            defaultProfile, forceDefaultVersionAndProfile,
@@ -878,14 +1388,18 @@ bool CompileDeferred(
     bool forwardCompatible,     // give errors for use of deprecated features
     EShMessages messages,       // warnings/errors/AST; things to print out
     TIntermediate& intermediate,// returned tree, etc.
-    const TShader::Includer& includer)
+    const TShader::Includer& includer,
+    const TPpSnapshot* preambleSnapshot = nullptr,
+    const char* preambleSnapshotRest = nullptr,
+    std::unordered_set<std::string>* macroLookups = nullptr,
+    const TParseLimits* parseLimits = nullptr)
 {
-    DoFullParse parser;
+    DoFullParse parser((messages & EShMsgTiming) ? &compiler->timingStats : nullptr);
     return ProcessDeferred(compiler, shaderStrings, numStrings, inputLengths, stringNames,
                            preamble, optLevel, resources, defaultVersion,
                            defaultProfile, forceDefaultVersionAndProfile,
                            forwardCompatible, messages, intermediate, parser,
-                           true, includer);
+                           true, includer, preambleSnapshot, preambleSnapshotRest, macroLookups, parseLimits);
 }
 
 } // end anonymous namespace for local functions
@@ -905,6 +1419,7 @@ int ShInitialize()
         PerProcessGPA = new TPoolAllocator();
 
     glslang::TScanContext::fillInKeywordMap();
+    glslang::TPpContext::fillInFixedAtoms();
 
     return 1;
 }
@@ -964,6 +1479,27 @@ void ShDestruct(ShHandle handle)
 //
 int __fastcall ShFinalize()
 {
+    for (TContextSymbolTables::iterator it = ContextSymbolTables.begin(); it != ContextSymbolTables.end(); ++it)
+        delete it->second;
+    ContextSymbolTables.clear();
+
+    for (int node = 0; node < MaxMemoryNodes; ++node) {
+        for (int version = 0; version < VersionCount; ++version) {
+            for (int p = 0; p < ProfileCount; ++p) {
+                for (int lang = 0; lang < EShLangCount; ++lang) {
+                    delete NodeSharedSymbolTables[node][version][p][lang].load();
+                    NodeSharedSymbolTables[node][version][p][lang] = nullptr;
+                }
+                for (int pc = 0; pc < EPcCount; ++pc) {
+                    delete NodeCommonSymbolTables[node][version][p][pc];
+                    NodeCommonSymbolTables[node][version][p][pc] = nullptr;
+                }
+            }
+        }
+        delete NodePools[node];
+        NodePools[node] = nullptr;
+    }
+
     for (int version = 0; version < VersionCount; ++version) {
         for (int p = 0; p < ProfileCount; ++p) {
             for (int lang = 0; lang < EShLangCount; ++lang) {
@@ -979,6 +1515,9 @@ int __fastcall ShFinalize()
                 delete CommonSymbolTable[version][p][pc];
                 CommonSymbolTable[version][p][pc] = 0;
             }
+            CommonSymbolTablesReady[version][p] = false;
+            for (int lang = 0; lang < EShLangCount; ++lang)
+                SymbolTablesReady[version][p][lang] = false;
         }
     }
 
@@ -989,6 +1528,17 @@ int __fastcall ShFinalize()
     }
 
     glslang::TScanContext::deleteKeywordMap();
+    glslang::TPpContext::deleteFixedAtoms();
+
+    TPoolAllocator::setPageCacheLimit(0);
+
+    if (SnapshotData) {
+        OS_UnmapFile(SnapshotData, SnapshotSize);
+        SnapshotData = nullptr;
+        SnapshotSize = 0;
+        memset(SnapshotCommonTables, 0, sizeof(SnapshotCommonTables));
+        memset(SnapshotStageTables, 0, sizeof(SnapshotStageTables));
+    }
 
     return 1;
 }
@@ -1110,47 +1660,109 @@ void ShSetEncryptionMethod(ShHandle handle)
 }
 
 //
-// Return any compiler/linker/uniformmap log of messages for the application.
+// Return the memory used by the most recent compile of a compiler object.
 //
-const char* ShGetInfoLog(const ShHandle handle)
+// Return:  non-zero if the handle is a compiler object.
+//
+int ShGetMemoryStats(const ShHandle handle, ShMemoryStats* stats)
 {
-    if (!InitThread())
-        return 0;
-
-    if (handle == 0)
+    if (handle == 0 || stats == 0)
         return 0;
 
     TShHandleBase* base = static_cast<TShHandleBase*>(handle);
-    TInfoSink* infoSink;
-
-    if (base->getAsCompiler())
-        infoSink = &(base->getAsCompiler()->getInfoSink());
-    else if (base->getAsLinker())
-        infoSink = &(base->getAsLinker()->getInfoSink());
-    else
+    TCompiler* compiler = base->getAsCompiler();
+    if (compiler == 0)
         return 0;
 
-    infoSink->info << infoSink->debug.c_str();
-    return infoSink->info.c_str();
+    *stats = compiler->memoryStats;
+
+    return 1;
 }
 
 //
-// Return the resulting binary code from the link process.  Structure
-// is machine dependent.
+// Return the per-phase timing of the most recent compile of a compiler object,
+// all zero unless it was given EShMsgTiming.
 //
-const void* ShGetExecutable(const ShHandle handle)
+// Return:  non-zero if the handle is a compiler object.
+//
+int ShGetTimingStats(const ShHandle handle, ShTimingStats* stats)
 {
-    if (!InitThread())
+    if (handle == 0 || stats == 0)
         return 0;
 
-    if (handle == 0)
+    TShHandleBase* base = static_cast<TShHandleBase*>(handle);
+    TCompiler* compiler = base->getAsCompiler();
+    if (compiler == 0)
         return 0;
 
-    TShHandleBase* base = reinterpret_cast<TShHandleBase*>(handle);
-    
-    TLinker* linker = static_cast<TLinker*>(base->getAsLinker());
-    if (linker == 0)
-        return 0;
+    *stats = compiler->timingStats;
+
+    return 1;
+}
+
+//
+// Return the inner-loop counts of the most recent compile of a compiler object,
+// all zero unless it was given EShMsgCounters.
+//
+// Return:  non-zero if the handle is a compiler object.
+//
+int ShGetCounterStats(const ShHandle handle, ShCounterStats* stats)
+{
+    if (handle == 0 || stats == 0)
+        return 0;
+
+    TShHandleBase* base = static_cast<TShHandleBase*>(handle);
+    TCompiler* compiler = base->getAsCompiler();
+    if (compiler == 0)
+        return 0;
+
+    *stats = compiler->counterStats;
+
+    return 1;
+}
+
+//
+// Return any compiler/linker/uniformmap log of messages for the application.
+//
+const char* ShGetInfoLog(const ShHandle handle)
+{
+    if (!InitThread())
+        return 0;
+
+    if (handle == 0)
+        return 0;
+
+    TShHandleBase* base = static_cast<TShHandleBase*>(handle);
+    TInfoSink* infoSink;
+
+    if (base->getAsCompiler())
+        infoSink = &(base->getAsCompiler()->getInfoSink());
+    else if (base->getAsLinker())
+        infoSink = &(base->getAsLinker()->getInfoSink());
+    else
+        return 0;
+
+    infoSink->info << infoSink->debug.c_str();
+    return infoSink->info.c_str();
+}
+
+//
+// Return the resulting binary code from the link process.  Structure
+// is machine dependent.
+//
+const void* ShGetExecutable(const ShHandle handle)
+{
+    if (!InitThread())
+        return 0;
+
+    if (handle == 0)
+        return 0;
+
+    TShHandleBase* base = reinterpret_cast<TShHandleBase*>(handle);
+    
+    TLinker* linker = static_cast<TLinker*>(base->getAsLinker());
+    if (linker == 0)
+        return 0;
 
     return linker->getObjectCode();
 }
@@ -1281,6 +1893,207 @@ void FinalizeProcess()
     ShFinalize();
 }
 
+void FinalizeProcessForExit()
+{
+    // The rest is left for the exit, see ShaderLang.h, but cached pages are only
+    // reachable from a map that is destroyed at exit, so they're freed now; there
+    // are few of them.
+    TPoolAllocator::setPageCacheLimit(0);
+}
+
+void SetPoolPageCacheSize(size_t bytes)
+{
+    TPoolAllocator::setPageCacheLimit(bytes);
+}
+
+int GetNumaNodeCount()
+{
+    return OS_GetNumaNodeCount();
+}
+
+void SetNumaSharding(bool shard)
+{
+    NumaSharding = shard;
+}
+
+bool SetThreadNumaNode(int node)
+{
+    if (node < 0 || node >= OS_GetNumaNodeCount() || ! InitThread())
+        return false;
+
+    return PinThreadToNumaNode(node);
+}
+
+TPoolAllocator* CreatePool(int pageSize)
+{
+    return new TPoolAllocator(pageSize);
+}
+
+void ResetPool(TPoolAllocator* pool)
+{
+    // popAll() also undoes the constructor's push(), so redo it, for a pool
+    // as good as new other than having its pages already
+    pool->popAll();
+    pool->push();
+}
+
+void DestroyPool(TPoolAllocator* pool)
+{
+    delete pool;
+}
+
+bool InitializeBuiltIns(const std::vector<std::pair<int, EProfile> >& versionProfiles, int numThreads)
+{
+    std::vector<std::pair<int, EProfile> > work;
+    bool success = NormalizeVersionProfiles(versionProfiles, work);
+
+    if (numThreads <= 0)
+        numThreads = (int)std::thread::hardware_concurrency();
+    if (numThreads > (int)work.size())
+        numThreads = (int)work.size();
+    if (numThreads < 1)
+        numThreads = 1;
+
+    std::atomic<size_t> next(0);
+    auto build = [&work, &next]() {
+        for (size_t w = next++; w < work.size(); w = next++) {
+            for (int stage = 0; stage < EShLangCount; ++stage)
+                SetupBuiltinSymbolTable(work[w].first, work[w].second, (EShLanguage)stage);
+        }
+    };
+    auto worker = [&build]() {
+        if (! InitThread())
+            return;
+        build();
+        DetachThread();
+    };
+
+    // The calling thread is one of the workers
+    std::vector<std::thread> threads;
+    for (int t = 1; t < numThreads; ++t)
+        threads.push_back(std::thread(worker));
+    if (InitThread())
+        build();
+    else
+        success = false;
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+
+    return success;
+}
+
+bool SaveBuiltInSnapshot(const char* fileName, const std::vector<std::pair<int, EProfile> >& versionProfiles)
+{
+    std::vector<std::pair<int, EProfile> > work;
+    bool success = NormalizeVersionProfiles(versionProfiles, work);
+    if (! InitializeBuiltIns(work))
+        success = false;
+
+    // The built-in text, for its hashes, is made in a pool of its own, as when it's parsed
+    TPoolAllocator& previousAllocator = GetThreadPoolAllocator();
+    TPoolAllocator* textPoolAllocator = new TPoolAllocator();
+    SetThreadPoolAllocator(*textPoolAllocator);
+
+    std::string snapshot = SnapshotHeader();
+    TSnapshotWriter out(snapshot);
+    for (size_t w = 0; w < work.size(); ++w) {
+        int version = work[w].first;
+        EProfile profile = work[w].second;
+        int versionIndex = MapVersionToIndex(version);
+        int profileIndex = MapProfileToIndex(profile);
+        TBuiltIns builtIns;
+        builtIns.initialize(version, profile);
+
+        for (int kind = 0; kind < SnapshotKindCount; ++kind) {
+            const TSymbolTable* table;
+            unsigned long long hash;
+            if (kind < EShLangCount) {
+                table = SharedSymbolTables[versionIndex][profileIndex][kind];
+                hash = StageHash(builtIns, (EShLanguage)kind);
+            } else {
+                table = CommonSymbolTable[versionIndex][profileIndex][kind - EShLangCount];
+                hash = CommonHash(builtIns);
+            }
+            if (table == nullptr)
+                continue;
+
+            std::string levels;
+            TSnapshotWriter levelsOut(levels);
+            table->writeOwnLevels(levelsOut);
+
+            unsigned long long size = levels.size();
+            out.putInt(version);
+            out.putInt(profile);
+            out.putInt(kind);
+            out.putBytes(&hash, sizeof(hash));
+            out.putBytes(&size, sizeof(size));
+            out.putBytes(levels.data(), levels.size());
+        }
+    }
+
+    delete textPoolAllocator;
+    SetThreadPoolAllocator(previousAllocator);
+
+    std::ofstream file(fileName, std::ios::binary);
+    file.write(snapshot.data(), snapshot.size());
+    file.close();
+
+    return success && ! file.fail();
+}
+
+bool LoadBuiltInSnapshot(const char* fileName)
+{
+    if (SnapshotData)
+        return false;
+
+    size_t size = 0;
+    const char* data = OS_MapFile(fileName, size);
+    if (data == nullptr)
+        return false;
+
+    // Find all the tables before using any, so a bad snapshot is refused whole
+    std::string header = SnapshotHeader();
+    bool valid = size >= header.size() && memcmp(data, header.data(), header.size()) == 0;
+    std::vector<std::pair<TSnapshotTable*, TSnapshotTable> > tables;
+    TSnapshotReader in(data + header.size(), valid ? size - header.size() : 0);
+    while (valid && ! in.atEnd()) {
+        int version = in.getInt();
+        EProfile profile = (EProfile)in.getInt();
+        int kind = in.getInt();
+        TSnapshotTable table;
+        unsigned long long tableSize = 0;
+        in.getBytes(&table.hash, sizeof(table.hash));
+        in.getBytes(&tableSize, sizeof(tableSize));
+        table.size = (size_t)tableSize;
+        table.data = in.skipBytes(table.size);
+
+        int versionIndex = MapVersionToIndex(version);
+        int profileIndex = MapProfileToIndex(profile);
+        if (in.failed() || table.size != tableSize || (versionIndex == 0 && version != 100) ||
+            (profileIndex == 0 && profile != ENoProfile) || kind < 0 || kind >= SnapshotKindCount) {
+            valid = false;
+            break;
+        }
+
+        if (kind < EShLangCount)
+            tables.push_back(std::make_pair(&SnapshotStageTables[versionIndex][profileIndex][kind], table));
+        else
+            tables.push_back(std::make_pair(&SnapshotCommonTables[versionIndex][profileIndex][kind - EShLangCount], table));
+    }
+
+    if (! valid) {
+        OS_UnmapFile(data, size);
+        return false;
+    }
+
+    for (size_t t = 0; t < tables.size(); ++t)
+        *tables[t].first = tables[t].second;
+    SnapshotData = data;
+    SnapshotSize = size;
+
+    return true;
+}
+
 class TDeferredCompiler : public TCompiler {
 public:
     TDeferredCompiler(EShLanguage s, TInfoSink& i) : TCompiler(s, i) { }
@@ -1288,7 +2101,9 @@ public:
 };
 
 TShader::TShader(EShLanguage s) 
-    : pool(0), stage(s), lengths(nullptr), stringNames(nullptr), preamble("")
+    : pool(0), stage(s), lengths(nullptr), stringNames(nullptr), preamble(""), preprocessedPreamble(nullptr),
+      preambleRest(nullptr), macroLookups(nullptr), poolPageSize(8*1024), callerPool(false),
+      diagnosticCallback(nullptr, nullptr)
 {
     infoSink = new TInfoSink;
     compiler = new TDeferredCompiler(stage, *infoSink);
@@ -1300,7 +2115,13 @@ TShader::~TShader()
     delete infoSink;
     delete compiler;
     delete intermediate;
-    delete pool;
+    if (! callerPool)
+        delete pool;
+}
+
+void TShader::setEntryPoints(const char* const* names, int n)
+{
+    intermediate->setEntryPoints(std::vector<std::string>(names, names + n));
 }
 
 void TShader::setStrings(const char* const* s, int n)
@@ -1317,6 +2138,18 @@ void TShader::setStringsWithLengths(const char* const* s, const int* l, int n)
     lengths = l;
 }
 
+void TShader::setPreamble(const TPreamble& p, const char* s)
+{
+    combinedPreamble = p.getText();
+    combinedPreamble += "\n";
+    const size_t restStart = combinedPreamble.size();
+    combinedPreamble += s;
+
+    preamble = combinedPreamble.c_str();
+    preprocessedPreamble = &p;
+    preambleRest = combinedPreamble.c_str() + restStart;
+}
+
 void TShader::setStringsWithLengthsAndNames(
     const char* const* s, const int* l, const char* const* names, int n)
 {
@@ -1337,7 +2170,8 @@ bool TShader::parse(const TBuiltInResource* builtInResources, int defaultVersion
     if (! InitThread())
         return false;
     
-    pool = new TPoolAllocator();
+    if (! callerPool)
+        pool = new TPoolAllocator(poolPageSize);
     SetThreadPoolAllocator(*pool);
     if (! preamble)
         preamble = "";
@@ -1345,7 +2179,9 @@ bool TShader::parse(const TBuiltInResource* builtInResources, int defaultVersion
     return CompileDeferred(compiler, strings, numStrings, lengths, stringNames,
                            preamble, EShOptNone, builtInResources, defaultVersion,
                            defaultProfile, forceDefaultVersionAndProfile,
-                           forwardCompatible, messages, *intermediate, includer);
+                           forwardCompatible, messages, *intermediate, includer,
+                           preprocessedPreamble ? preprocessedPreamble->snapshot : nullptr,
+                           preambleRest, macroLookups, &parseLimits);
 }
 
 bool TShader::parse(const TBuiltInResource* builtInResources, int defaultVersion, bool forwardCompatible, EShMessages messages)
@@ -1361,11 +2197,29 @@ bool TShader::preprocess(const TBuiltInResource* builtInResources,
                          bool forwardCompatible, EShMessages message,
                          std::string* output_string,
                          const TShader::Includer& includer)
+{
+    std::stringstream outputStream;
+    bool success = preprocess(builtInResources, defaultVersion, defaultProfile, forceDefaultVersionAndProfile,
+                              forwardCompatible, message, outputStream, includer);
+    *output_string = outputStream.str();
+
+    return success;
+}
+
+// Write the result of preprocessing ShaderStrings to a stream as it is produced.
+// Returns true if all extensions, pragmas and version strings were valid.
+bool TShader::preprocess(const TBuiltInResource* builtInResources,
+                         int defaultVersion, EProfile defaultProfile,
+                         bool forceDefaultVersionAndProfile,
+                         bool forwardCompatible, EShMessages message,
+                         std::ostream& outputStream,
+                         const TShader::Includer& includer)
 {
     if (! InitThread())
         return false;
 
-    pool = new TPoolAllocator();
+    if (! callerPool)
+        pool = new TPoolAllocator(poolPageSize);
     SetThreadPoolAllocator(*pool);
     if (! preamble)
         preamble = "";
@@ -1373,7 +2227,7 @@ bool TShader::preprocess(const TBuiltInResource* builtInResources,
     return PreprocessDeferred(compiler, strings, numStrings, lengths, stringNames, preamble,
                               EShOptNone, builtInResources, defaultVersion,
                               defaultProfile, forceDefaultVersionAndProfile,
-                              forwardCompatible, message, includer, *intermediate, output_string);
+                              forwardCompatible, message, includer, *intermediate, outputStream);
 }
 
 const char* TShader::getInfoLog()
@@ -1386,8 +2240,116 @@ const char* TShader::getInfoDebugLog()
     return infoSink->debug.c_str();
 }
 
-TProgram::TProgram() : pool(0), reflection(0), linked(false)
+void TShader::setDebugLogWriter(TLogWriter writer, void* context)
+{
+    infoSink->debug.setWriter(writer, context);
+}
+
+void TShader::setDiagnosticCallback(TDiagnosticCallback callback, void* context)
+{
+    diagnosticCallback = std::make_pair(callback, context);
+    infoSink->info.setDiagnosticCallback(callback ? CallDiagnosticCallback : nullptr, &diagnosticCallback);
+}
+
+const ShMemoryStats& TShader::getMemoryStats() const
+{
+    return compiler->memoryStats;
+}
+
+const ShTimingStats& TShader::getTimingStats() const
+{
+    return compiler->timingStats;
+}
+
+const ShCounterStats& TShader::getCounterStats() const
 {
+    return compiler->counterStats;
+}
+
+std::pair<std::string, std::string> TShader::CachingIncluder::include(const char* filename) const
+{
+    {
+        std::lock_guard<std::mutex> guard(cacheMutex);
+        auto it = cache.find(filename);
+        if (it != cache.end())
+            return it->second;
+    }
+
+    // Resolve without holding the lock, so other files can be resolved meanwhile;
+    // racing threads may both resolve the same file, and one result is kept.
+    std::pair<std::string, std::string> result = includer.include(filename);
+    if (! result.first.empty()) {
+        std::lock_guard<std::mutex> guard(cacheMutex);
+        cache.insert(std::make_pair(std::string(filename), result));
+    }
+
+    return result;
+}
+
+TPreamble::TPreamble() : snapshot(nullptr)
+{
+}
+
+TPreamble::~TPreamble()
+{
+    delete snapshot;
+}
+
+//
+// Preprocess 'preambleText' as the custom preamble of an empty shader, with
+// the given version and profile forced, recording what it does.
+//
+// Returns true for success.
+//
+bool TPreamble::build(const char* preambleText, EShLanguage stage, const TBuiltInResource* builtInResources,
+                      int version, EProfile profile, EShMessages messages)
+{
+    delete snapshot;
+    snapshot = nullptr;
+    text = preambleText ? preambleText : "";
+    infoLog.clear();
+
+    if (! InitThread())
+        return false;
+
+    // Nothing from the pool is kept, so use a scratch one
+    TPoolAllocator& previousAllocator = GetThreadPoolAllocator();
+    TPoolAllocator* buildPool = new TPoolAllocator();
+    SetThreadPoolAllocator(*buildPool);
+
+    TPpSnapshot* recorded = new TPpSnapshot;
+    bool success;
+    {
+        TInfoSink buildInfoSink;
+        TDeferredCompiler buildCompiler(stage, buildInfoSink);
+        TIntermediate buildIntermediate(stage);
+        TShader::ForbidInclude forbidInclude;
+        DoPreambleSnapshot recorder(*recorded);
+        const char* emptyShader = "";
+
+        success = ProcessDeferred(&buildCompiler, &emptyShader, 1, nullptr, nullptr,
+                                  text.c_str(), EShOptNone, builtInResources, version,
+                                  profile, true, false, messages, buildIntermediate, recorder,
+                                  false, forbidInclude);
+        infoLog = buildInfoSink.info.c_str();
+    }
+
+    delete buildPool;
+    SetThreadPoolAllocator(previousAllocator);
+
+    if (success)
+        snapshot = recorded;
+    else
+        delete recorded;
+
+    return success;
+}
+
+TProgram::TProgram() : pool(0), reflection(0), linked(false), poolPageSize(8*1024), callerPool(false),
+                       timing(false), diagnosticCallback(nullptr, nullptr)
+{
+    memset(&memoryStats, 0, sizeof(memoryStats));
+    memset(&timingStats, 0, sizeof(timingStats));
     infoSink = new TInfoSink;
     for (int s = 0; s < EShLangCount; ++s) {
         intermediate[s] = 0;
@@ -1404,7 +2366,63 @@ TProgram::~TProgram()
         if (newedIntermediate[s])
             delete intermediate[s];
 
-    delete pool;
+    if (! callerPool)
+        delete pool;
+}
+
+//
+// Parse every shader added to the program, each on its own thread, up to
+// numThreads at a time.  The shaders only share the built-in symbol tables,
+// which are read-only once built, and each parses into its own pool.
+//
+// Return true if all the shaders parsed.
+//
+bool TProgram::parseShaders(const TBuiltInResource* builtInResources, int defaultVersion, bool forwardCompatible,
+                            EShMessages messages, int numThreads)
+{
+    std::vector<TShader*> shaders;
+    for (int s = 0; s < EShLangCount; ++s)
+        shaders.insert(shaders.end(), stages[s].begin(), stages[s].end());
+
+    if (numThreads <= 0)
+        numThreads = (int)std::thread::hardware_concurrency();
+    if (numThreads > (int)shaders.size())
+        numThreads = (int)shaders.size();
+    if (numThreads < 1)
+        numThreads = 1;
+
+    std::atomic<size_t> next(0);
+    std::atomic<bool> success(true);
+    auto parse = [&]() {
+        // parse() leaves the thread on the shader's pool; put back the thread's own
+        TPoolAllocator& previousAllocator = GetThreadPoolAllocator();
+        for (size_t s = next++; s < shaders.size(); s = next++) {
+            if (! shaders[s]->parse(builtInResources, defaultVersion, forwardCompatible, messages))
+                success = false;
+        }
+        SetThreadPoolAllocator(previousAllocator);
+    };
+    auto worker = [&]() {
+        if (! InitWorkerThread()) {
+            success = false;
+            return;
+        }
+        parse();
+        DetachThread();
+    };
+
+    // The calling thread is one of the workers
+    std::vector<std::thread> threads;
+    for (int t = 1; t < numThreads; ++t)
+        threads.push_back(std::thread(worker));
+    if (InitThread())
+        parse();
+    else
+        success = false;
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+
+    return success;
 }
 
 //
@@ -1421,9 +2439,12 @@ bool TProgram::link(EShMessages messages)
 
     bool error = false;
     
-    pool = new TPoolAllocator();
+    if (! callerPool)
+        pool = new TPoolAllocator(poolPageSize);
     SetThreadPoolAllocator(*pool);
+    TPoolMark poolMark(*pool);
 
+    timing = (messages & EShMsgTiming) != 0;
     for (int s = 0; s < EShLangCount; ++s) {
         if (! linkStage((EShLanguage)s, messages))
             error = true;
@@ -1431,6 +2452,37 @@ bool TProgram::link(EShMessages messages)
 
     // TODO: Link: cross-stage error checking
 
+    // Trim each stage's outputs to what the next stage present reads; without a
+    // next stage, nothing is known to be unread.
+    if (! error && (messages & EShMsgTrimInterface) && ! (messages & EShMsgLibrary)) {
+        TIntermediate* nextStage = nullptr;
+        for (int s = EShLangFragment; s >= EShLangVertex; --s) {
+            if (! intermediate[s])
+                continue;
+            if (nextStage)
+                intermediate[s]->trimOutputs(*nextStage);
+            nextStage = intermediate[s];
+        }
+    }
+
+    // Then inline, which can fold away reads of what trimming made private
+    if (! error && (messages & EShMsgInline) && ! (messages & EShMsgLibrary)) {
+        for (int s = 0; s < EShLangCount; ++s) {
+            if (intermediate[s])
+                intermediate[s]->inlineFunctions();
+        }
+    }
+
+    // after any trimming or inlining, which change the trees
+    if (messages & EShMsgAST) {
+        for (int s = 0; s < EShLangCount; ++s) {
+            if (intermediate[s])
+                intermediate[s]->output(*infoSink, true);
+        }
+    }
+
+    poolMark.getMemoryStats(memoryStats);
+
     return ! error;
 }
 
@@ -1445,28 +2497,30 @@ bool TProgram::linkStage(EShLanguage stage, EShMessages messages)
         return true;
 
     //
-    // Be efficient for the common single compilation unit per stage case,
-    // reusing it's TIntermediate instead of merging into a new one.
+    // Link copies, in the program's pool, leaving the shaders unchanged so they
+    // can be linked into other programs too.  For the common single compilation
+    // unit per stage case, the copy is all there is to do, instead of merging.
     //
     if (stages[stage].size() == 1)
-        intermediate[stage] = stages[stage].front()->intermediate;
-    else {
+        intermediate[stage] = new TIntermediate(*stages[stage].front()->intermediate);
+    else
         intermediate[stage] = new TIntermediate(stage);
-        newedIntermediate[stage] = true;
-    }
+    newedIntermediate[stage] = true;
 
     infoSink->info << "\nLinked " << StageName(stage) << " stage:\n\n";
 
-    if (stages[stage].size() > 1) {
-        std::list<TShader*>::const_iterator it;
-        for (it = stages[stage].begin(); it != stages[stage].end(); ++it)
-            intermediate[stage]->merge(*infoSink, *(*it)->intermediate);
-    }
-
-    intermediate[stage]->finalCheck(*infoSink);
+    {
+        TPhaseTimer timer(timing ? &timingStats : nullptr, EShPhaseLink);
+        if (stages[stage].size() > 1) {
+            std::list<TShader*>::const_iterator it;
+            for (it = stages[stage].begin(); it != stages[stage].end(); ++it)
+                intermediate[stage]->merge(*infoSink, *(*it)->intermediate);
+        }
 
-    if (messages & EShMsgAST)
-        intermediate[stage]->output(*infoSink, true);
+        if (messages & EShMsgLibrary)
+            intermediate[stage]->setLibrary();
+        intermediate[stage]->finalCheck(*infoSink);
+    }
 
     return intermediate[stage]->getNumErrors() == 0;
 }
@@ -1481,38 +2535,567 @@ const char* TProgram::getInfoDebugLog()
     return infoSink->debug.c_str();
 }
 
+void TProgram::setDebugLogWriter(TLogWriter writer, void* context)
+{
+    infoSink->debug.setWriter(writer, context);
+}
+
+void TProgram::setDiagnosticCallback(TDiagnosticCallback callback, void* context)
+{
+    diagnosticCallback = std::make_pair(callback, context);
+    infoSink->info.setDiagnosticCallback(callback ? CallDiagnosticCallback : nullptr, &diagnosticCallback);
+}
+
+ShMemoryStats TProgram::getMemoryStats() const
+{
+    return memoryStats;
+}
+
+//
+// Permutation compiles.
+//
+
+namespace {
+
+// Whether a permutation define can be told apart by macro lookups: names the
+// system preamble may define, or values changing the lines of the preamble,
+// could change results without the source looking the name up.
+bool ShareableDefine(const std::string& name, const std::string& value)
+{
+    if (name.empty() || ! (isalpha((unsigned char)name[0]) || name[0] == '_'))
+        return false;
+    for (size_t c = 1; c < name.size(); ++c) {
+        if (! (isalnum((unsigned char)name[c]) || name[c] == '_'))
+            return false;
+    }
+    if (name.compare(0, 3, "GL_") == 0 || name.find("__") != std::string::npos)
+        return false;
+
+    return value.find_first_of("\r\n") == std::string::npos && (value.empty() || value[value.size() - 1] != '\\');
+}
+
+}; // end anonymous namespace
+
+TPermutations::TPermutations(EShLanguage s, const char* text) :
+    stage(s), source(text ? text : ""), includer(nullptr), commonPreamble(nullptr),
+    resources(nullptr), defaultVersion(0), defaultProfile(ENoProfile), forwardCompatible(false),
+    messages(EShMsgDefault), compileIncluder(nullptr), linked(nullptr)
+{
+}
+
+TPermutations::~TPermutations()
+{
+    delete commonPreamble;
+}
+
+int TPermutations::addPermutation(const TDefines& defines)
+{
+    TPermutation permutation;
+    permutation.shareable = true;
+    permutation.compiledAs = -1;
+    permutation.success = false;
+    for (size_t d = 0; d < defines.size(); ++d) {
+        const std::string& name = defines[d].first;
+        const std::string& value = defines[d].second;
+        if (! ShareableDefine(name, value) || ! permutation.defines.insert(std::make_pair(name, value)).second)
+            permutation.shareable = false;
+        permutation.preamble += "#define " + name;
+        if (! value.empty())
+            permutation.preamble += " " + value;
+        permutation.preamble += "\n";
+    }
+    permutations.push_back(permutation);
+
+    return (int)permutations.size() - 1;
+}
+
+int TPermutations::getNumCompiles() const
+{
+    int compiles = 0;
+    for (int p = 0; p < (int)permutations.size(); ++p) {
+        if (permutations[p].compiledAs == p)
+            ++compiles;
+    }
+
+    return compiles;
+}
+
+//
+// Whether 'permutation' gets the results of the already compiled 'compiled'.
+// Preprocessing only depends on the macros it looks up, so the two compiles go
+// the same way when every define they differ in went unseen by 'compiled'.
+//
+bool TPermutations::sameResults(const TPermutation& permutation, const TPermutation& compiled) const
+{
+    if (! permutation.shareable || ! compiled.shareable || ! compiled.success)
+        return false;
+
+    for (auto it = permutation.defines.begin(); it != permutation.defines.end(); ++it) {
+        auto other = compiled.defines.find(it->first);
+        if ((other == compiled.defines.end() || other->second != it->second) &&
+            compiled.lookups.find(it->first) != compiled.lookups.end())
+            return false;
+    }
+    for (auto it = compiled.defines.begin(); it != compiled.defines.end(); ++it) {
+        if (permutation.defines.find(it->first) == permutation.defines.end() &&
+            compiled.lookups.find(it->first) != compiled.lookups.end())
+            return false;
+    }
+
+    return true;
+}
+
+//
+// Parse and link one permutation, on the current thread, then hand the program
+// to the 'linked' function.  Also gives the version and profile the source
+// asked for, if wanted.
+//
+// Returns true for success.
+//
+bool TPermutations::compileOne(int p, int* version, EProfile* profile)
+{
+    TPermutation& permutation = permutations[p];
+    TPoolAllocator& previousAllocator = GetThreadPoolAllocator();
+    const char* text = source.c_str();
+    std::string preambleText;
+
+    TShader shader(stage);
+    TProgram program;
+    shader.setStrings(&text, 1);
+    if (commonPreamble)
+        shader.setPreamble(*commonPreamble, permutation.preamble.c_str());
+    else {
+        preambleText = commonText + "\n" + permutation.preamble;
+        shader.setPreamble(preambleText.c_str());
+    }
+    if (permutation.shareable)
+        shader.setMacroLookups(&permutation.lookups);
+
+    bool success = shader.parse(resources, defaultVersion, defaultProfile, false, forwardCompatible, messages,
+                                *compileIncluder);
+    permutation.infoLog = shader.getInfoLog();
+    if (version) {
+        *version = shader.intermediate->getVersion();
+        *profile = shader.intermediate->getProfile();
+    }
+    if (success) {
+        program.addShader(&shader);
+        success = program.link(messages);
+        permutation.infoLog += program.getInfoLog();
+        if (success && *linked)
+            success = (*linked)(p, program);
+    }
+    SetThreadPoolAllocator(previousAllocator);
+    permutation.success = success;
+
+    return success;
+}
+
+//
+// Compile the first permutation on the calling thread, which also builds the
+// built-in symbol tables and tells the version to preprocess the common
+// preamble for.  The rest go to up to numThreads threads, each first looking
+// for an earlier compile whose results it shares.
+//
+// Returns true if all the permutations compiled.
+//
+bool TPermutations::compile(const TBuiltInResource* builtInResources, int version, EProfile profile,
+                            bool forwardCompat, EShMessages compileMessages, const TLinked& linkedFunction,
+                            int numThreads)
+{
+    if (! InitThread())
+        return false;
+
+    resources = builtInResources;
+    defaultVersion = version;
+    defaultProfile = profile;
+    forwardCompatible = forwardCompat;
+    messages = compileMessages;
+    linked = &linkedFunction;
+    TShader::ForbidInclude forbidInclude;
+    TShader::CachingIncluder cachingIncluder(includer ? *includer : forbidInclude);
+    compileIncluder = &cachingIncluder;
+    delete commonPreamble;
+    commonPreamble = nullptr;
+    for (size_t p = 0; p < permutations.size(); ++p) {
+        permutations[p].compiledAs = -1;
+        permutations[p].success = false;
+        permutations[p].infoLog.clear();
+        permutations[p].lookups.clear();
+    }
+    if (permutations.empty())
+        return true;
+
+    // #version comes first, so no define changes it
+    std::atomic<bool> success(true);
+    int sourceVersion;
+    EProfile sourceProfile;
+    permutations[0].compiledAs = 0;
+    if (! compileOne(0, &sourceVersion, &sourceProfile))
+        success = false;
+    if (! commonText.empty()) {
+        commonPreamble = new TPreamble;
+        if (! commonPreamble->build(commonText.c_str(), stage, resources, sourceVersion, sourceProfile, compileMessages)) {
+            delete commonPreamble;
+            commonPreamble = nullptr;
+        }
+    }
+
+    std::mutex compiledMutex;
+    std::vector<int> compiled;
+    if (permutations[0].shareable && permutations[0].success)
+        compiled.push_back(0);
+    std::atomic<size_t> next(1);
+    auto compileRest = [&]() {
+        for (size_t p = next++; p < permutations.size(); p = next++) {
+            TPermutation& permutation = permutations[p];
+            {
+                std::lock_guard<std::mutex> guard(compiledMutex);
+                for (size_t c = 0; c < compiled.size(); ++c) {
+                    if (sameResults(permutation, permutations[compiled[c]])) {
+                        permutation.compiledAs = compiled[c];
+                        permutation.success = true;
+                        break;
+                    }
+                }
+            }
+            if (permutation.compiledAs >= 0)
+                continue;
+
+            permutation.compiledAs = (int)p;
+            if (! compileOne((int)p))
+                success = false;
+            else if (permutation.shareable) {
+                std::lock_guard<std::mutex> guard(compiledMutex);
+                compiled.push_back((int)p);
+            }
+        }
+    };
+    auto worker = [&]() {
+        if (! InitWorkerThread()) {
+            success = false;
+            return;
+        }
+        compileRest();
+        DetachThread();
+    };
+
+    if (numThreads <= 0)
+        numThreads = (int)std::thread::hardware_concurrency();
+    if (numThreads > (int)permutations.size() - 1)
+        numThreads = (int)permutations.size() - 1;
+
+    // The calling thread is one of the workers
+    std::vector<std::thread> threads;
+    for (int t = 1; t < numThreads; ++t)
+        threads.push_back(std::thread(worker));
+    compileRest();
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+
+    return success;
+}
+
+//
+// Batch compiles.
+//
+
+namespace {
+
+//
+// Parse and link one job, on the current thread, then fill in its result.
+//
+// Returns true for success.
+//
+bool CompileJob(int jobIndex, const TBatch::TJob& job, const TShader::Includer* includer,
+                const TBatch::TLinked& linked, TBatch::TResult& result)
+{
+    TPoolAllocator& previousAllocator = GetThreadPoolAllocator();
+    const char* text = job.source.c_str();
+    TShader::ForbidInclude forbidInclude;
+
+    TShader shader(job.stage);
+    TProgram program;
+    shader.setStrings(&text, 1);
+    shader.setPreamble(job.preamble.c_str());
+    bool success = shader.parse(job.resources, job.defaultVersion, job.defaultProfile, false, job.forwardCompatible,
+                                job.messages, includer ? *includer : forbidInclude);
+    result.infoLog = shader.getInfoLog();
+    if (success) {
+        program.addShader(&shader);
+        success = program.link(job.messages);
+        result.infoLog += program.getInfoLog();
+        if (success && job.reflection) {
+            success = program.buildReflection();
+            if (success) {
+                program.getUniformTable(result.uniforms);
+                program.getUniformBlockTable(result.uniformBlocks);
+            }
+        }
+        if (success && linked)
+            success = linked(jobIndex, program, result);
+    }
+    SetThreadPoolAllocator(previousAllocator);
+    result.success = success;
+
+    return success;
+}
+
+}; // end anonymous namespace
+
+//
+// Jobs are taken largest source first, each by whichever thread is free next,
+// so one long job doesn't start last and hold up the whole batch.
+//
+bool TBatch::compile(const TLinked& linked, int numThreads)
+{
+    results.clear();
+    results.resize(jobs.size());
+
+    std::vector<int> order(jobs.size());
+    for (size_t j = 0; j < jobs.size(); ++j)
+        order[j] = (int)j;
+    std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+        return jobs[a].source.size() + jobs[a].preamble.size() > jobs[b].source.size() + jobs[b].preamble.size();
+    });
+
+    if (numThreads <= 0)
+        numThreads = (int)std::thread::hardware_concurrency();
+    if (numThreads > (int)jobs.size())
+        numThreads = (int)jobs.size();
+
+    std::atomic<size_t> next(0);
+    std::atomic<bool> success(true);
+    auto compileJobs = [&]() {
+        for (size_t j = next++; j < order.size(); j = next++) {
+            if (! CompileJob(order[j], jobs[order[j]], includer, linked, results[order[j]]))
+                success = false;
+        }
+    };
+    auto worker = [&]() {
+        if (! InitWorkerThread()) {
+            success = false;
+            return;
+        }
+        compileJobs();
+        DetachThread();
+    };
+
+    // The calling thread is one of the workers
+    std::vector<std::thread> threads;
+    for (int t = 1; t < numThreads; ++t)
+        threads.push_back(std::thread(worker));
+    if (InitThread())
+        compileJobs();
+    else
+        success = false;
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+
+    return success;
+}
+
+TAsyncCompiler::TAsyncCompiler(int numThreads, const TBatch::TLinked& l) :
+    linked(l), includer(nullptr), nextTicket(0), running(0), shuttingDown(false)
+{
+    if (numThreads <= 0)
+        numThreads = (int)std::thread::hardware_concurrency();
+    if (numThreads < 1)
+        numThreads = 1;
+    for (int t = 0; t < numThreads; ++t)
+        threads.push_back(std::thread(&TAsyncCompiler::work, this));
+}
+
+TAsyncCompiler::~TAsyncCompiler()
+{
+    {
+        std::lock_guard<std::mutex> guard(queueMutex);
+        shuttingDown = true;
+        queue.clear();
+    }
+    queueChanged.notify_all();
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+}
+
+int TAsyncCompiler::submit(const TBatch::TJob& job, const TDone& done)
+{
+    TQueued queued;
+    queued.job = job;
+    queued.done = done;
+    {
+        std::lock_guard<std::mutex> guard(queueMutex);
+        queued.ticket = nextTicket++;
+        queue.push_back(queued);
+    }
+    queueChanged.notify_all();
+
+    return queued.ticket;
+}
+
+bool TAsyncCompiler::cancel(int ticket)
+{
+    {
+        std::lock_guard<std::mutex> guard(queueMutex);
+        std::list<TQueued>::iterator it = queue.begin();
+        while (it != queue.end() && it->ticket != ticket)
+            ++it;
+        if (it == queue.end())
+            return false;
+        queue.erase(it);
+    }
+    queueChanged.notify_all();
+
+    return true;
+}
+
+void TAsyncCompiler::wait()
+{
+    std::unique_lock<std::mutex> lock(queueMutex);
+    queueChanged.wait(lock, [this]() { return queue.empty() && running == 0; });
+}
+
+//
+// A worker thread: compile queued jobs until shutting down.
+//
+void TAsyncCompiler::work()
+{
+    bool initialized = InitWorkerThread();
+
+    std::unique_lock<std::mutex> lock(queueMutex);
+    for (;;) {
+        queueChanged.wait(lock, [this]() { return shuttingDown || ! queue.empty(); });
+        if (shuttingDown)
+            break;
+
+        TQueued queued = queue.front();
+        queue.pop_front();
+        ++running;
+        lock.unlock();
+
+        TBatch::TResult result;
+        if (initialized)
+            CompileJob(queued.ticket, queued.job, includer, linked, result);
+        else
+            result.infoLog = "Internal error: could not set up the compile thread\n";
+        if (queued.done)
+            queued.done(queued.ticket, result);
+
+        lock.lock();
+        --running;
+        queueChanged.notify_all();
+    }
+    lock.unlock();
+
+    if (initialized)
+        DetachThread();
+}
+
 //
 // Reflection implementation.
 //
 
-bool TProgram::buildReflection()
+bool TProgram::buildReflection(int numThreads)
 {    
     if (! linked || reflection)
         return false;
 
+    TPhaseTimer timer(timing ? &timingStats : nullptr, EShPhaseReflection);
     reflection = new TReflection;
 
+    std::vector<int> stageList;
     for (int s = 0; s < EShLangCount; ++s) {
-        if (intermediate[s]) {
-            if (! reflection->addStage((EShLanguage)s, *intermediate[s]))
+        if (intermediate[s])
+            stageList.push_back(s);
+    }
+
+    if (numThreads <= 0)
+        numThreads = (int)std::thread::hardware_concurrency();
+    if (numThreads > (int)stageList.size())
+        numThreads = (int)stageList.size();
+    if (numThreads <= 1) {
+        for (size_t s = 0; s < stageList.size(); ++s) {
+            if (! reflection->addStage((EShLanguage)stageList[s], *intermediate[stageList[s]]))
                 return false;
         }
+
+        return true;
     }
 
-    return true;
+    // Collect each stage into its own database, then merge them in stage order.
+    // Worker threads collect into pools of their own, which must outlive the merge.
+    TReflection* stageReflections[EShLangCount] = {};
+    for (size_t i = 0; i < stageList.size(); ++i)
+        stageReflections[stageList[i]] = new TReflection;
+    bool collected[EShLangCount] = {};
+    TPoolAllocator* stagePools[EShLangCount] = {};
+    std::atomic<size_t> next(0);
+    auto collect = [&](bool ownPools) {
+        TPoolAllocator& previousAllocator = GetThreadPoolAllocator();
+        for (size_t i = next++; i < stageList.size(); i = next++) {
+            int s = stageList[i];
+            if (ownPools) {
+                stagePools[s] = new TPoolAllocator();
+                SetThreadPoolAllocator(*stagePools[s]);
+            }
+            collected[s] = stageReflections[s]->collectStage(*intermediate[s]);
+        }
+        SetThreadPoolAllocator(previousAllocator);
+    };
+    auto worker = [&]() {
+        if (! InitThread())
+            return;
+        collect(true);
+        DetachThread();
+    };
+
+    // The calling thread is one of the workers, using the program's pool
+    std::vector<std::thread> threads;
+    for (int t = 1; t < numThreads; ++t)
+        threads.push_back(std::thread(worker));
+    collect(false);
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+
+    bool success = true;
+    for (size_t i = 0; i < stageList.size() && success; ++i) {
+        int s = stageList[i];
+        if (collected[s])
+            reflection->merge(*stageReflections[s]);
+        else
+            success = false;
+    }
+
+    // the stage databases' strings live in the stage pools, so go first
+    for (int s = 0; s < EShLangCount; ++s) {
+        delete stageReflections[s];
+        delete stagePools[s];
+    }
+
+    return success;
 }
 
-int TProgram::getNumLiveUniformVariables()           { return reflection->getNumUniforms(); }
-int TProgram::getNumLiveUniformBlocks()              { return reflection->getNumUniformBlocks(); }
-const char* TProgram::getUniformName(int index)      { return reflection->getUniform(index).name.c_str(); }
-const char* TProgram::getUniformBlockName(int index) { return reflection->getUniformBlock(index).name.c_str(); }
-int TProgram::getUniformBlockSize(int index)         { return reflection->getUniformBlock(index).size; }
-int TProgram::getUniformIndex(const char* name)      { return reflection->getIndex(name); }
-int TProgram::getUniformBlockIndex(int index)        { return reflection->getUniform(index).index; }
-int TProgram::getUniformType(int index)              { return reflection->getUniform(index).glDefineType; }
-int TProgram::getUniformBufferOffset(int index)      { return reflection->getUniform(index).offset; }
-int TProgram::getUniformArraySize(int index)         { return reflection->getUniform(index).size; }
+TReflection* TProgram::getReflection()
+{
+    if (! reflection)
+        buildReflection();
+
+    return reflection;
+}
 
-void TProgram::dumpReflection()                      { reflection->dump(); }
+int TProgram::getNumLiveUniformVariables()           { return getReflection()->getNumUniforms(); }
+int TProgram::getNumLiveUniformBlocks()              { return getReflection()->getNumUniformBlocks(); }
+const char* TProgram::getUniformName(int index)      { return getReflection()->getUniform(index).name.c_str(); }
+const char* TProgram::getUniformBlockName(int index) { return getReflection()->getUniformBlock(index).name.c_str(); }
+int TProgram::getUniformBlockSize(int index)         { return getReflection()->getUniformBlock(index).size; }
+int TProgram::getUniformIndex(const char* name)      { return getReflection()->getIndex(name); }
+int TProgram::getUniformBlockIndex(int index)        { return getReflection()->getUniform(index).index; }
+int TProgram::getUniformType(int index)              { return getReflection()->getUniform(index).glDefineType; }
+int TProgram::getUniformBufferOffset(int index)      { return getReflection()->getUniform(index).offset; }
+int TProgram::getUniformArraySize(int index)         { return getReflection()->getUniform(index).size; }
+void TProgram::getUniformTable(TReflectionTable& table)      { getReflection()->getUniformTable(table); }
+void TProgram::getUniformBlockTable(TReflectionTable& table) { getReflection()->getUniformBlockTable(table); }
+
+void TProgram::dumpReflection()                      { getReflection()->dump(); }
 
 } // end namespace glslang
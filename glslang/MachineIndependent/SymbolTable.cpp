@@ -41,8 +41,50 @@
 
 #include "SymbolTable.h"
 
+#include <mutex>
+
 namespace glslang {
 
+//
+// The specialization-constant ids qualifiers index (see
+// TQualifier::layoutSpecConstantIndex).  An id is added the first time
+// anything asks for it, and stays for the life of the process, so an
+// index means the same in every compile, on every thread.
+//
+namespace {
+
+std::mutex SpecConstantIdsMutex;
+unsigned int SpecConstantIds[TQualifier::layoutSpecConstantIndexEnd];
+unsigned int NumSpecConstantIds = 0;
+
+} // end anonymous namespace
+
+bool TQualifier::setSpecConstantId(unsigned int id)
+{
+    std::lock_guard<std::mutex> guard(SpecConstantIdsMutex);
+
+    unsigned int index = 0;
+    while (index < NumSpecConstantIds && SpecConstantIds[index] != id)
+        ++index;
+    if (index == NumSpecConstantIds) {
+        if (NumSpecConstantIds == layoutSpecConstantIndexEnd)
+            return false;
+        SpecConstantIds[NumSpecConstantIds++] = id;
+    }
+    layoutSpecConstantIndex = index;
+
+    return true;
+}
+
+unsigned int TQualifier::getSpecConstantId() const
+{
+    assert(hasSpecConstantId());
+
+    std::lock_guard<std::mutex> guard(SpecConstantIdsMutex);
+
+    return SpecConstantIds[layoutSpecConstantIndex];
+}
+
 //
 // TType helper function needs a place to live.
 //
@@ -182,21 +224,46 @@ TSymbolTableLevel::~TSymbolTableLevel()
 }
 
 //
-// Change all function entries in the table with the non-mangled name
-// to be related to the provided built-in operation.
+// Change all function entries in the table with a non-mangled name in
+// 'relations' to be related to its built-in operation.
 //
-void TSymbolTableLevel::relateToOperator(const char* name, TOperator op)
+// This is one walk down 'level', where the overloads of a name are adjacent
+// (their mangled names all start with "name("), looking up each name once.
+//
+void TSymbolTableLevel::relateToOperators(const TOperatorRelations& relations)
 {
-    tLevel::const_iterator candidate = level.lower_bound(name);
-    while (candidate != level.end()) {
+    assert(! indexed);
+
+    const TString* groupName = nullptr;
+    TString::size_type groupLength = 0;
+    bool related = false;
+    TOperator op = EOpNull;
+    for (tLevel::const_iterator candidate = level.begin(); candidate != level.end(); ++candidate) {
         const TString& candidateName = (*candidate).first;
         TString::size_type parenAt = candidateName.find_first_of('(');
-        if (parenAt != candidateName.npos && candidateName.compare(0, parenAt, name) == 0) {
-            TFunction* function = (*candidate).second->getAsFunction();
-            function->relateToOperator(op);
-        } else
-            break;
-        ++candidate;
+        if (parenAt == candidateName.npos)
+            continue;
+
+        if (groupName == nullptr || parenAt != groupLength || groupName->compare(0, parenAt, candidateName, 0, parenAt) != 0) {
+            // first overload of a new name
+            groupName = &candidateName;
+            groupLength = parenAt;
+            int low = 0;
+            int high = (int)relations.size();
+            while (low < high) {
+                int mid = (low + high) / 2;
+                if (relations[mid].first.compare(0, relations[mid].first.npos, candidateName.c_str(), parenAt) < 0)
+                    low = mid + 1;
+                else
+                    high = mid;
+            }
+            related = low < (int)relations.size() && relations[low].first.compare(0, relations[low].first.npos, candidateName.c_str(), parenAt) == 0;
+            if (related)
+                op = relations[low].second;
+        }
+
+        if (related)
+            (*candidate).second->getAsFunction()->relateToOperator(op);
     }
 }
 
@@ -204,6 +271,15 @@ void TSymbolTableLevel::relateToOperator(const char* name, TOperator op)
 // Should only be used for a version/profile that actually needs the extension(s).
 void TSymbolTableLevel::setFunctionExtensions(const char* name, int num, const char* const extensions[])
 {
+    if (indexed) {
+        tOverloadMap::iterator it = overloads.find(name);
+        if (it != overloads.end()) {
+            for (unsigned int f = 0; f < it->second.size(); ++f)
+                it->second[f]->setExtensions(num, extensions);
+        }
+        return;
+    }
+
     tLevel::const_iterator candidate = level.lower_bound(name);
     while (candidate != level.end()) {
         const TString& candidateName = (*candidate).first;
@@ -224,31 +300,65 @@ void TSymbolTableLevel::readOnly()
 {
     for (tLevel::iterator it = level.begin(); it != level.end(); ++it)
         (*it).second->makeReadOnly();
+
+    if (! indexed)
+        buildIndex();
+}
+
+//
+// Build the hashed lookup and the overload index from 'level'.  Overloads are
+// gathered in 'level' order, so lookups return them in the same order the
+// ordered prefix scan did.
+//
+void TSymbolTableLevel::buildIndex()
+{
+    hashedLevel.reserve(level.size());
+    for (tLevel::const_iterator it = level.begin(); it != level.end(); ++it) {
+        hashedLevel[it->first] = it->second;
+
+        TString::size_type parenAt = it->first.find_first_of('(');
+        if (parenAt != it->first.npos)
+            overloads[TString(it->first, 0, parenAt)].push_back(it->second->getAsFunction());
+    }
+    indexed = true;
+}
+
+void TSymbolTableLevel::dropIndex()
+{
+    hashedLevel.clear();
+    overloads.clear();
+    indexed = false;
 }
 
 //
 // Copy a symbol, but the copy is writable; call readOnly() afterward if that's not desired.
 //
-TSymbol::TSymbol(const TSymbol& copyOf)
+// With shareStorage, the name is not reallocated in the current pool; only do this
+// when copyOf's memory outlives the copy.
+//
+TSymbol::TSymbol(const TSymbol& copyOf, bool shareStorage)
 {
-    name = NewPoolTString(copyOf.name->c_str());
+    name = shareStorage ? copyOf.name : NewPoolTString(copyOf.name->c_str());
     uniqueId = copyOf.uniqueId;
     writable = true;
 }
 
-TVariable::TVariable(const TVariable& copyOf) : TSymbol(copyOf)
+TVariable::TVariable(const TVariable& copyOf, bool shareStorage) : TSymbol(copyOf, shareStorage)
 {	
     type.deepCopy(copyOf.type);
     userType = copyOf.userType;
     numExtensions = 0;
     extensions = 0;
-    if (copyOf.numExtensions > 0)
+    if (shareStorage) {
+        // the extension list is never edited in place, only set once
+        numExtensions = copyOf.numExtensions;
+        extensions = copyOf.extensions;
+    } else if (copyOf.numExtensions > 0)
         setExtensions(copyOf.numExtensions, copyOf.extensions);
 
     if (! copyOf.unionArray.empty()) {
         assert(! copyOf.type.isStruct());
-        TConstUnionArray newArray(copyOf.unionArray, 0, copyOf.unionArray.size());
-        unionArray = newArray;
+        unionArray.deepCopy(copyOf.unionArray);
     }
 }
 
@@ -259,6 +369,19 @@ TVariable* TVariable::clone() const
     return variable;
 }
 
+//
+// Make a writable copy of a shared (e.g., built-in) variable for the current
+// compile to edit.  Only the type, which is what gets edited, is deep copied;
+// the rest is shared with the original, which lives at least as long as the
+// current compile.
+//
+TVariable* TVariable::editableClone() const
+{
+    TVariable *variable = new TVariable(*this, true);
+
+    return variable;
+}
+
 TFunction::TFunction(const TFunction& copyOf) : TSymbol(copyOf)
 {	
     for (unsigned int i = 0; i < copyOf.parameters.size(); ++i) {
@@ -269,7 +392,7 @@ TFunction::TFunction(const TFunction& copyOf) : TSymbol(copyOf)
 
     numExtensions = 0;
     extensions = 0;
-    if (copyOf.extensions > 0)
+    if (copyOf.numExtensions > 0)
         setExtensions(copyOf.numExtensions, copyOf.extensions);
     returnType.deepCopy(copyOf.returnType);
     mangledName = copyOf.mangledName;
@@ -332,4 +455,299 @@ void TSymbolTable::copyTable(const TSymbolTable& copyOf)
         table.push_back(copyOf.table[i]->clone());
 }
 
+//
+// Snapshots of the built-in levels; see TSnapshotWriter.  What's written is
+// what clone() copies.
+//
+
+void TType::write(TSnapshotWriter& out) const
+{
+    out.putInt(basicType);
+    out.putInt(vectorSize);
+    out.putInt(matrixCols);
+    out.putInt(matrixRows);
+    out.putBytes(&sampler, sizeof(sampler));
+    out.putBytes(&qualifier, sizeof(qualifier));
+
+    if (out.putShared(arraySizes, out.arraySizes)) {
+        out.putInt(arraySizes->getNumDims());
+        for (int d = 0; d < arraySizes->getNumDims(); ++d)
+            out.putInt(arraySizes->getDimSize(d));
+        out.putInt(arraySizes->getImplicitSize());
+    }
+
+    if (out.putShared(structure, out.structures)) {
+        out.putInt((int)structure->size());
+        for (unsigned int m = 0; m < structure->size(); ++m) {
+            const TTypeLoc& member = (*structure)[m];
+            out.putString(member.loc.name);
+            out.putInt(member.loc.string);
+            out.putInt(member.loc.line);
+            out.putInt(member.loc.column);
+            member.type->write(out);
+        }
+    }
+
+    out.putString(fieldName);
+    out.putString(typeName);
+}
+
+bool TType::read(TSnapshotReader& in)
+{
+    basicType = (TBasicType)in.getInt();
+    vectorSize = in.getInt();
+    matrixCols = in.getInt();
+    matrixRows = in.getInt();
+    in.getBytes(&sampler, sizeof(sampler));
+    in.getBytes(&qualifier, sizeof(qualifier));
+
+    if (! in.getShared(in.arraySizes, arraySizes)) {
+        arraySizes = new TArraySizes;
+        in.arraySizes.push_back(arraySizes);
+        int dims = in.getInt();
+        for (int d = 0; d < dims && ! in.failed(); ++d)
+            arraySizes->addInnerSize(in.getInt());
+        arraySizes->setImplicitSize(in.getInt());
+    }
+
+    if (! in.getShared(in.structures, structure)) {
+        structure = new TTypeList;
+        in.structures.push_back(structure);
+        int members = in.getInt();
+        for (int m = 0; m < members && ! in.failed(); ++m) {
+            TTypeLoc member;
+            const TString* name = in.getString();
+            member.loc.name = name ? name->c_str() : nullptr;
+            member.loc.string = in.getInt();
+            member.loc.line = in.getInt();
+            member.loc.column = in.getInt();
+            member.type = new TType;
+            member.type->read(in);
+            structure->push_back(member);
+        }
+    }
+
+    fieldName = in.getString();
+    typeName = in.getString();
+
+    return ! in.failed();
+}
+
+void TSymbol::writeSymbol(TSnapshotWriter& out) const
+{
+    out.putString(name);
+    out.putInt(uniqueId);
+    out.putInt(numExtensions);
+    for (int e = 0; e < numExtensions; ++e)
+        out.putString(extensions[e]);
+}
+
+void TSymbol::readSymbol(TSnapshotReader& in)
+{
+    name = in.getString();
+    if (name == nullptr)
+        in.fail();
+    uniqueId = in.getInt();
+
+    int num = in.getInt();
+    if (num < 0)
+        in.fail();
+    std::vector<const char*> exts;
+    for (int e = 0; e < num && ! in.failed(); ++e) {
+        const TString* ext = in.getString();
+        if (ext)
+            exts.push_back(ext->c_str());
+        else
+            in.fail();
+    }
+    if (! exts.empty() && ! in.failed())
+        setExtensions((int)exts.size(), &exts[0]);
+}
+
+void TVariable::write(TSnapshotWriter& out) const
+{
+    out.beginSymbol();
+    writeSymbol(out);
+    type.write(out);
+    out.putInt(userType);
+    out.putInt(unionArray.size());
+    for (int c = 0; c < unionArray.size(); ++c)
+        out.putBytes(&unionArray[c], sizeof(TConstUnion));
+}
+
+TVariable* TVariable::read(TSnapshotReader& in)
+{
+    in.beginSymbol();
+    TVariable* variable = new TVariable(nullptr, TType());
+    variable->readSymbol(in);
+    variable->type.read(in);
+    variable->userType = in.getInt() != 0;
+
+    int size = in.getInt();
+    if (size < 0 || ! in.hasBytes(size * sizeof(TConstUnion)))
+        in.fail();
+    else if (size > 0) {
+        TConstUnionArray unionArray(size);
+        for (int c = 0; c < size; ++c)
+            in.getBytes(&unionArray[c], sizeof(TConstUnion));
+        variable->unionArray = unionArray;
+    }
+
+    return variable;
+}
+
+void TFunction::write(TSnapshotWriter& out) const
+{
+    out.beginSymbol();
+    writeSymbol(out);
+    returnType.write(out);
+    out.putString(&mangledName);
+    out.putInt(op);
+    out.putInt(defined);
+    out.putInt(prototyped);
+    out.putInt((int)parameters.size());
+    for (unsigned int p = 0; p < parameters.size(); ++p) {
+        out.putString(parameters[p].name);
+        parameters[p].type->write(out);
+    }
+}
+
+TFunction* TFunction::read(TSnapshotReader& in)
+{
+    in.beginSymbol();
+    TFunction* function = new TFunction(EOpNull);
+    function->readSymbol(in);
+    function->returnType.read(in);
+    const TString* mangledName = in.getString();
+    if (mangledName)
+        function->mangledName = *mangledName;
+    else
+        in.fail();
+    function->op = (TOperator)in.getInt();
+    function->defined = in.getInt() != 0;
+    function->prototyped = in.getInt() != 0;
+
+    int params = in.getInt();
+    for (int p = 0; p < params && ! in.failed(); ++p) {
+        TParameter param;
+        param.name = in.getString();
+        param.type = new TType;
+        param.type->read(in);
+        function->parameters.push_back(param);
+    }
+
+    return function;
+}
+
+// what follows each name of a level in a snapshot
+enum TSnapshotSymbol {
+    EssVariable,
+    EssFunction,
+    EssAnonMember,  // and, before its first member, its container
+};
+
+void TSymbolTableLevel::write(TSnapshotWriter& out) const
+{
+    out.putInt(anonId);
+    out.putInt((int)level.size());
+    std::set<int> containersWritten;
+    for (tLevel::const_iterator it = level.begin(); it != level.end(); ++it) {
+        out.putString(&it->first);
+        const TAnonMember* anon = it->second->getAsAnonMember();
+        if (anon) {
+            out.putInt(EssAnonMember);
+            out.putInt(anon->getAnonId());
+            out.putInt(anon->getMemberNumber());
+            bool first = containersWritten.insert(anon->getAnonId()).second;
+            out.putInt(first);
+            if (first)
+                anon->getAnonContainer().write(out);
+        } else if (it->second->getAsFunction()) {
+            out.putInt(EssFunction);
+            it->second->getAsFunction()->write(out);
+        } else {
+            out.putInt(EssVariable);
+            it->second->getAsVariable()->write(out);
+        }
+    }
+}
+
+bool TSymbolTableLevel::read(TSnapshotReader& in)
+{
+    assert(level.empty());
+
+    anonId = in.getInt();
+    int symbols = in.getInt();
+    std::map<int, const TVariable*> containers;
+    for (int s = 0; s < symbols && ! in.failed(); ++s) {
+        const TString* name = in.getString();
+        TSymbol* symbol = nullptr;
+        switch (in.getInt()) {
+        case EssVariable:
+            symbol = TVariable::read(in);
+            break;
+        case EssFunction:
+            symbol = TFunction::read(in);
+            break;
+        case EssAnonMember:
+        {
+            int id = in.getInt();
+            unsigned int member = (unsigned int)in.getInt();
+            const TVariable*& container = containers[id];
+            if (in.getInt() != 0) {
+                // the first member of its container
+                if (container)
+                    in.fail();
+                container = TVariable::read(in);
+            }
+            if (container && ! in.failed() && container->getType().getStruct() &&
+                member < container->getType().getStruct()->size()) {
+                const TTypeList& types = *container->getType().getStruct();
+                symbol = new TAnonMember(&types[member].type->getFieldName(), member, *container, id);
+            } else
+                in.fail();
+            break;
+        }
+        default:
+            in.fail();
+            break;
+        }
+
+        if (name == nullptr || in.failed() || ! level.insert(tLevelPair(*name, symbol)).second)
+            in.fail();
+    }
+
+    return ! in.failed();
+}
+
+void TSymbolTable::writeOwnLevels(TSnapshotWriter& out) const
+{
+    assert(operatorRelations.empty());
+
+    out.putInt(uniqueId);
+    out.putInt(noBuiltInRedeclarations);
+    out.putInt(separateNameSpaces);
+    out.putInt((int)(table.size() - adoptedLevels));
+    for (unsigned int level = adoptedLevels; level < table.size(); ++level)
+        table[level]->write(out);
+}
+
+bool TSymbolTable::readOwnLevels(TSnapshotReader& in)
+{
+    assert(table.size() == adoptedLevels);
+
+    uniqueId = in.getInt();
+    noBuiltInRedeclarations = in.getInt() != 0;
+    separateNameSpaces = in.getInt() != 0;
+    int levels = in.getInt();
+    if (levels < 0)
+        in.fail();
+    for (int level = 0; level < levels && ! in.failed(); ++level) {
+        push();
+        table.back()->read(in);
+    }
+
+    return ! in.failed();
+}
+
 } // end namespace glslang
@@ -70,6 +70,167 @@
 
 namespace glslang {
 
+//
+// Writing and reading built-in symbol table levels as bytes, for the snapshots
+// of SaveBuiltInSnapshot() and LoadBuiltInSnapshot().  The bytes hold no
+// pointers, so they can be read from wherever they are mapped, but they are in
+// the writer's byte order and structure layouts: a snapshot is only for the
+// build of glslang that wrote it.
+//
+// The array sizes and structures a symbol's types share are written once, and
+// then referred to by the order they were first written in.
+//
+class TSnapshotWriter {
+public:
+    explicit TSnapshotWriter(std::string& o) : out(o) { }
+
+    void putBytes(const void* bytes, size_t size) { out.append(static_cast<const char*>(bytes), size); }
+    void putInt(int i) { putBytes(&i, sizeof(i)); }
+    void putString(const char* s)
+    {
+        if (s == nullptr)
+            putInt(-1);
+        else {
+            int length = (int)strlen(s);
+            putInt(length);
+            putBytes(s, length + 1);
+        }
+    }
+    void putString(const TString* s) { putString(s ? s->c_str() : nullptr); }
+
+    // Writes -1 for none, the index of one already written, or the next index;
+    // true for the last, when the caller writes it now.
+    bool putShared(const void* shared, std::unordered_map<const void*, int>& written)
+    {
+        if (shared == nullptr) {
+            putInt(-1);
+            return false;
+        }
+
+        std::unordered_map<const void*, int>::const_iterator it = written.find(shared);
+        if (it != written.end()) {
+            putInt(it->second);
+            return false;
+        }
+
+        int index = (int)written.size();
+        written[shared] = index;
+        putInt(index);
+
+        return true;
+    }
+
+    // start of a symbol: its types share nothing with the symbols before it
+    void beginSymbol()
+    {
+        arraySizes.clear();
+        structures.clear();
+    }
+
+    std::unordered_map<const void*, int> arraySizes;
+    std::unordered_map<const void*, int> structures;
+
+protected:
+    TSnapshotWriter(const TSnapshotWriter&);
+    TSnapshotWriter& operator=(const TSnapshotWriter&);
+
+    std::string& out;
+};
+
+//
+// Reads what TSnapshotWriter wrote, making the symbols in the current pool.
+// Running off the end, or meeting something that can't have been written,
+// fails the read; see failed().
+//
+class TSnapshotReader {
+public:
+    TSnapshotReader(const char* data, size_t size) : next(data), end(data + size), bad(false) { }
+
+    bool getBytes(void* bytes, size_t size)
+    {
+        if (bad || (size_t)(end - next) < size) {
+            bad = true;
+            return false;
+        }
+        memcpy(bytes, next, size);
+        next += size;
+        return true;
+    }
+    int getInt()
+    {
+        int i = 0;
+        getBytes(&i, sizeof(i));
+        return i;
+    }
+    // null for a null string, or on failure
+    TString* getString()
+    {
+        int length = getInt();
+        if (bad || length < 0 || (size_t)(end - next) <= (size_t)length || next[length] != '\0') {
+            bad = bad || length != -1;
+            return nullptr;
+        }
+        TString* s = NewPoolTString(next);
+        next += length + 1;
+        return s;
+    }
+
+    // Reads the index putShared() wrote; false when it's of a new one, for the
+    // caller to read now and add to 'read'.  Otherwise 'shared' is the one in
+    // 'read', or null for none (or on failure).
+    template<class T> bool getShared(std::vector<T*>& read, T*& shared)
+    {
+        int index = getInt();
+        shared = nullptr;
+        if (bad || index < -1 || index > (int)read.size()) {
+            bad = true;
+            return true;
+        }
+        if (index >= 0 && index < (int)read.size()) {
+            shared = read[index];
+            return true;
+        }
+
+        return index == -1;
+    }
+
+    // whether at least 'size' bytes are left to read
+    bool hasBytes(size_t size) const { return ! bad && (size_t)(end - next) >= size; }
+
+    // the next 'size' bytes, skipped over; null on failure
+    const char* skipBytes(size_t size)
+    {
+        if (! hasBytes(size)) {
+            bad = true;
+            return nullptr;
+        }
+        const char* skipped = next;
+        next += size;
+        return skipped;
+    }
+
+    void fail() { bad = true; }
+    bool failed() const { return bad; }
+    bool atEnd() const { return next == end; }
+
+    void beginSymbol()
+    {
+        arraySizes.clear();
+        structures.clear();
+    }
+
+    std::vector<TArraySizes*> arraySizes;
+    std::vector<TTypeList*> structures;
+
+protected:
+    TSnapshotReader(const TSnapshotReader&);
+    TSnapshotReader& operator=(const TSnapshotReader&);
+
+    const char* next;
+    const char* end;
+    bool bad;
+};
+
 //
 // Symbol base class.  (Can build functions or variables out of these...)
 //
@@ -114,9 +275,13 @@ public:
     virtual void makeReadOnly() { writable = false; }
 
 protected:
-    explicit TSymbol(const TSymbol&);
+    explicit TSymbol(const TSymbol&, bool shareStorage = false);
     TSymbol& operator=(const TSymbol&);
 
+    // the name, unique id, and extensions, for a snapshot
+    void writeSymbol(TSnapshotWriter&) const;
+    void readSymbol(TSnapshotReader&);
+
     const TString *name;
     unsigned int uniqueId;      // For cross-scope comparing during code generation
 
@@ -146,6 +311,7 @@ class TVariable : public TSymbol {
 public:
     TVariable(const TString *name, const TType& t, bool uT = false ) : TSymbol(name), userType(uT) { type.shallowCopy(t); }
     virtual TVariable* clone() const;
+    virtual TVariable* editableClone() const;
     virtual ~TVariable() { }
 
     virtual TVariable* getAsVariable() { return this; }
@@ -158,9 +324,11 @@ public:
     virtual void setConstArray(const TConstUnionArray& constArray) { unionArray = constArray; }
 
     virtual void dump(TInfoSink &infoSink) const;
+    void write(TSnapshotWriter&) const;
+    static TVariable* read(TSnapshotReader&);
 
 protected:
-    explicit TVariable(const TVariable&);
+    explicit TVariable(const TVariable&, bool shareStorage = false);
     TVariable& operator=(const TVariable&);
 
     TType type;
@@ -229,6 +397,8 @@ public:
     virtual const TParameter& operator[](int i) const { return parameters[i]; }
 
     virtual void dump(TInfoSink &infoSink) const;
+    void write(TSnapshotWriter&) const;
+    static TFunction* read(TSnapshotReader&);
 
 protected:
     explicit TFunction(const TFunction&);
@@ -287,7 +457,7 @@ protected:
 class TSymbolTableLevel {
 public:
     POOL_ALLOCATOR_NEW_DELETE(GetThreadPoolAllocator())
-    TSymbolTableLevel() : defaultPrecision(0), anonId(0) { }
+    TSymbolTableLevel() : defaultPrecision(0), anonId(0), indexed(false) { }
     ~TSymbolTableLevel();
 
     bool insert(TSymbol& symbol, bool separateNameSpaces)
@@ -295,6 +465,9 @@ public:
         //
         // returning true means symbol was added to the table with no semantic errors
         //
+        if (indexed)
+            dropIndex();
+
         tInsertResult result;
         const TString& name = symbol.getName();
         if (name == "") {
@@ -340,6 +513,11 @@ public:
 
     TSymbol* find(const TString& name) const
     {
+        if (indexed) {
+            tHashedLevel::const_iterator it = hashedLevel.find(name);
+            return it == hashedLevel.end() ? 0 : it->second;
+        }
+
         tLevel::const_iterator it = level.find(name);
         if (it == level.end()) 
             return 0;
@@ -350,6 +528,13 @@ public:
     void findFunctionNameList(const TString& name, TVector<TFunction*>& list)
     {
         size_t parenAt = name.find_first_of('(');
+        if (indexed) {
+            tOverloadMap::const_iterator it = overloads.find(TString(name, 0, parenAt));
+            if (it != overloads.end())
+                list.insert(list.end(), it->second.begin(), it->second.end());
+            return;
+        }
+
         TString base(name, 0, parenAt + 1);
 
         tLevel::const_iterator begin = level.lower_bound(base);
@@ -362,6 +547,9 @@ public:
     // See if there is already a function in the table having the given non-function-style name.
     bool hasFunctionName(const TString& name) const
     {
+        if (indexed)
+            return overloads.find(name) != overloads.end();
+
         tLevel::const_iterator candidate = level.lower_bound(name);
         if (candidate != level.end()) {
             const TString& candidateName = (*candidate).first;
@@ -378,6 +566,20 @@ public:
     // Return true if name is found, and set variable to true if the name was a variable.
     bool findFunctionVariableName(const TString& name, bool& variable) const
     {
+        if (indexed) {
+            // '(' sorts before any identifier character, so the ordered walk below
+            // finds an exact variable match first, then the overloads of the name
+            if (hashedLevel.find(name) != hashedLevel.end()) {
+                variable = true;
+                return true;
+            }
+            if (overloads.find(name) != overloads.end()) {
+                variable = false;
+                return true;
+            }
+            return false;
+        }
+
         tLevel::const_iterator candidate = level.lower_bound(name);
         if (candidate != level.end()) {
             const TString& candidateName = (*candidate).first;
@@ -429,11 +631,17 @@ public:
             p[t] = defaultPrecision[t];
     }
 
-    void relateToOperator(const char* name, TOperator op);
+    // Built-in function names and their operators, sorted by name, with one
+    // entry per name.
+    typedef std::vector<std::pair<std::string, TOperator> > TOperatorRelations;
+    void relateToOperators(const TOperatorRelations&);
     void setFunctionExtensions(const char* name, int num, const char* const extensions[]);
     void dump(TInfoSink &infoSink) const;
     TSymbolTableLevel* clone() const;
+    void write(TSnapshotWriter&) const;
+    bool read(TSnapshotReader&);
     void readOnly();
+    bool isReadOnly() const { return indexed; }
 
 protected:
     explicit TSymbolTableLevel(TSymbolTableLevel&);
@@ -443,14 +651,26 @@ protected:
     typedef const tLevel::value_type tLevelPair;
     typedef std::pair<tLevel::iterator, bool> tInsertResult;
 
+    // Hashed views of 'level', built by readOnly() for levels that no longer change
+    // (the built-ins), so lookups don't walk a tree of thousands of mangled names.
+    typedef TUnorderedMap<TString, TSymbol*> tHashedLevel;
+    typedef TUnorderedMap<TString, TVector<TFunction*> > tOverloadMap;
+
+    void buildIndex();
+    void dropIndex();
+
     tLevel level;  // named mappings
+    tHashedLevel hashedLevel;  // mangled name -> symbol, valid when 'indexed'
+    tOverloadMap overloads;    // unmangled function name -> overloads, in 'level' order
     TPrecisionQualifier *defaultPrecision;
     int anonId;
+    bool indexed;
 };
 
 class TSymbolTable {
 public:
-    TSymbolTable() : uniqueId(0), noBuiltInRedeclarations(false), separateNameSpaces(false), adoptedLevels(0)
+    TSymbolTable() : uniqueId(0), noBuiltInRedeclarations(false), separateNameSpaces(false), adoptedLevels(0),
+                     counterStats(nullptr)
     {
         //
         // This symbol table cannot be used until push() is called.
@@ -496,6 +716,9 @@ public:
 
     void setNoBuiltInRedeclarations() { noBuiltInRedeclarations = true; }
     void setSeparateNameSpaces() { separateNameSpaces = true; }
+
+    // Count the find() calls, and the names they miss, in 'stats', if not null.
+    void setCounterStats(ShCounterStats* stats) { counterStats = stats; }
     
     void push()
     {
@@ -555,13 +778,13 @@ public:
     TSymbol* copyUpDeferredInsert(TSymbol* shared)
     {
         if (shared->getAsVariable()) {
-            TSymbol* copy = shared->clone();
+            TSymbol* copy = shared->getAsVariable()->editableClone();
             copy->setUniqueId(shared->getUniqueId());
             return copy;
         } else {
             const TAnonMember* anon = shared->getAsAnonMember();
             assert(anon);
-            TVariable* container = anon->getAnonContainer().clone();
+            TVariable* container = anon->getAnonContainer().editableClone();
             container->changeName(NewPoolTString(""));
             container->setUniqueId(anon->getAnonContainer().getUniqueId());
             return container;
@@ -593,6 +816,11 @@ public:
             *builtIn = isBuiltInLevel(level);
         if (currentScope)
             *currentScope = isGlobalLevel(currentLevel()) || level == currentLevel();  // consider shared levels as "current scope" WRT user globals
+        if (counterStats) {
+            ++counterStats->symbolLookups;
+            if (symbol == 0)
+                ++counterStats->symbolMisses;
+        }
 
         return symbol;
     }
@@ -635,22 +863,53 @@ public:
         } while (level >= 0);
     }
 
+    //
+    // Tagging built-ins leaves alone the read-only levels: they are shared
+    // built-ins, tagged already, when they were made.
+    //
+    // Relating functions to operators is batched: relateToOperator() just
+    // records the relation, and relateRecordedOperators() makes all of them in
+    // one pass over each level, rather than searching a level for each name.
+    // As when they were made one at a time, a later relation of a name wins.
+    //
     void relateToOperator(const char* name, TOperator op)
     {
-        for (unsigned int level = 0; level < table.size(); ++level)
-            table[level]->relateToOperator(name, op);
+        operatorRelations.push_back(std::make_pair(std::string(name), op));
+    }
+
+    void relateRecordedOperators()
+    {
+        if (operatorRelations.empty())
+            return;
+
+        // sort by name, keeping just the last relation of each
+        std::stable_sort(operatorRelations.begin(), operatorRelations.end(), lessRelationName);
+        TSymbolTableLevel::TOperatorRelations relations;
+        for (unsigned int r = 0; r < operatorRelations.size(); ++r) {
+            if (r + 1 < operatorRelations.size() && operatorRelations[r + 1].first == operatorRelations[r].first)
+                continue;
+            relations.push_back(operatorRelations[r]);
+        }
+        operatorRelations.clear();
+
+        for (unsigned int level = 0; level < table.size(); ++level) {
+            if (! table[level]->isReadOnly())
+                table[level]->relateToOperators(relations);
+        }
     }
     
     void setFunctionExtensions(const char* name, int num, const char* const extensions[])
     {
-        for (unsigned int level = 0; level < table.size(); ++level)
-            table[level]->setFunctionExtensions(name, num, extensions);
+        for (unsigned int level = 0; level < table.size(); ++level) {
+            if (! table[level]->isReadOnly())
+                table[level]->setFunctionExtensions(name, num, extensions);
+        }
     }
 
     void setVariableExtensions(const char* name, int num, const char* const extensions[])
     {
         TSymbol* symbol = find(TString(name));
-        if (symbol)
+        if (symbol && ! symbol->isReadOnly())
             symbol->setExtensions(num, extensions);
     }
 
@@ -658,6 +917,11 @@ public:
     void dump(TInfoSink &infoSink) const;
     void copyTable(const TSymbolTable& copyOf);
 
+    // Like copyTable(), but to and from a snapshot: the levels that aren't
+    // adopted are written, and read back on top of the same adopted levels.
+    void writeOwnLevels(TSnapshotWriter&) const;
+    bool readOwnLevels(TSnapshotReader&);
+
     void setPreviousDefaultPrecisions(TPrecisionQualifier *p) { table[currentLevel()]->setPreviousDefaultPrecisions(p); }
 
     void readOnly()
@@ -666,17 +930,32 @@ public:
             table[level]->readOnly();
     }
 
+    // Like readOnly(), but leaves alone the adopted levels, which may already be
+    // in use by other threads.
+    void readOnlyOwnLevels()
+    {
+        for (unsigned int level = adoptedLevels; level < table.size(); ++level)
+            table[level]->readOnly();
+    }
+
 protected:
     TSymbolTable(TSymbolTable&);
     TSymbolTable& operator=(TSymbolTableLevel&);
 
     int currentLevel() const { return static_cast<int>(table.size()) - 1; }
 
+    static bool lessRelationName(const std::pair<std::string, TOperator>& a, const std::pair<std::string, TOperator>& b)
+    {
+        return a.first < b.first;
+    }
+
     std::vector<TSymbolTableLevel*> table;
     int uniqueId;     // for unique identification in code generation
     bool noBuiltInRedeclarations;
     bool separateNameSpaces;
     unsigned int adoptedLevels;
+    ShCounterStats* counterStats;
+    TSymbolTableLevel::TOperatorRelations operatorRelations;  // recorded by relateToOperator(), not yet made
 };
 
 } // end namespace glslang
@@ -2192,6 +2192,7 @@ switch_statement
         ++parseContext.statementNestingLevel;
         parseContext.switchSequenceStack.push_back(new TIntermSequence);
         parseContext.switchLevel.push_back(parseContext.statementNestingLevel);
+        parseContext.switchCaseValues.push_back(new TMap<int, bool>);
         parseContext.symbolTable.push();
     }
     LEFT_BRACE switch_statement_list RIGHT_BRACE {
@@ -2199,6 +2200,8 @@ switch_statement
         delete parseContext.switchSequenceStack.back();
         parseContext.switchSequenceStack.pop_back();
         parseContext.switchLevel.pop_back();
+        delete parseContext.switchCaseValues.back();
+        parseContext.switchCaseValues.pop_back();
         parseContext.symbolTable.pop(&parseContext.defaultPrecision[0]);
         --parseContext.statementNestingLevel;
         --parseContext.controlFlowNestingLevel;
@@ -2243,18 +2246,22 @@ iteration_statement
         if (! parseContext.limits.whileLoops)
             parseContext.error($1.loc, "while loops not available", "limitation", "");
         parseContext.symbolTable.push();
+        parseContext.beginLoopControl();
         ++parseContext.loopNestingLevel;
         ++parseContext.statementNestingLevel;
         ++parseContext.controlFlowNestingLevel;
     }
       condition RIGHT_PAREN statement_no_new_scope {
         parseContext.symbolTable.pop(&parseContext.defaultPrecision[0]);
-        $$ = parseContext.intermediate.addLoop($6, $4, 0, true, $1.loc);
+        TIntermLoop* whileLoop = parseContext.intermediate.addLoop($6, $4, 0, true, $1.loc);
+        parseContext.endLoopControl(whileLoop);
+        $$ = whileLoop;
         --parseContext.loopNestingLevel;
         --parseContext.statementNestingLevel;
         --parseContext.controlFlowNestingLevel;
     }
     | DO {
+        parseContext.beginLoopControl();
         ++parseContext.loopNestingLevel;
         ++parseContext.statementNestingLevel;
         ++parseContext.controlFlowNestingLevel;
@@ -2265,13 +2272,16 @@ iteration_statement
 
         parseContext.boolCheck($8.loc, $6);
 
-        $$ = parseContext.intermediate.addLoop($3, $6, 0, false, $4.loc);
+        TIntermLoop* doLoop = parseContext.intermediate.addLoop($3, $6, 0, false, $4.loc);
+        parseContext.endLoopControl(doLoop);
+        $$ = doLoop;
         --parseContext.loopNestingLevel;
         --parseContext.statementNestingLevel;
         --parseContext.controlFlowNestingLevel;
     }
     | FOR LEFT_PAREN {
         parseContext.symbolTable.push();
+        parseContext.beginLoopControl();
         ++parseContext.loopNestingLevel;
         ++parseContext.statementNestingLevel;
         ++parseContext.controlFlowNestingLevel;
@@ -2280,6 +2290,7 @@ iteration_statement
         parseContext.symbolTable.pop(&parseContext.defaultPrecision[0]);
         $$ = parseContext.intermediate.makeAggregate($4, $2.loc);
         TIntermLoop* forLoop = parseContext.intermediate.addLoop($7, reinterpret_cast<TIntermTyped*>($5.node1), reinterpret_cast<TIntermTyped*>($5.node2), true, $1.loc);
+        parseContext.endLoopControl(forLoop);
         if (! parseContext.limits.nonInductiveForLoops)
             parseContext.inductiveLoopCheck($1.loc, $4, forLoop);
         $$ = parseContext.intermediate.growAggregate($$, forLoop, $1.loc);
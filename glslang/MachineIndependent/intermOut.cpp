@@ -613,7 +613,12 @@ bool TOutputTraverser::visitLoop(TVisit /* visit */, TIntermLoop* node)
     out.debug << "Loop with condition ";
     if (! node->testFirst())
         out.debug << "not ";
-    out.debug << "tested first\n";
+    out.debug << "tested first";
+    if (node->getLoopControl() == ELoopControlUnroll)
+        out.debug << ": Unroll";
+    else if (node->getLoopControl() == ELoopControlDontUnroll)
+        out.debug << ": DontUnroll";
+    out.debug << "\n";
 
     ++depth;
 
@@ -54,8 +54,9 @@ namespace glslang {
 //
 void TIntermediate::error(TInfoSink& infoSink, const char* message)
 {
-    infoSink.info.prefix(EPrefixError);
-    infoSink.info << "Linking " << StageName(language) << " stage: " << message << "\n";
+    TString text("Linking ");
+    text.append(StageName(language)).append(" stage: ").append(message);
+    infoSink.info.message(EPrefixError, text.c_str());
 
     ++numErrors;
 }
@@ -65,13 +66,220 @@ void TIntermediate::error(TInfoSink& infoSink, const char* message)
 // expression values must be the same, or a link-time error results."
 
 //
-// Merge the information from 'unit' into 'this'
+// Copy a compiled unit for linking.  Everything linking can change is copied,
+// in the current pool; that is, the tree, the types it has (keeping what they
+// share), and the call graph.  Strings are copied through c_str(), since a copied
+// TString would keep allocating from the unit's pool.
 //
-void TIntermediate::merge(TInfoSink& infoSink, TIntermediate& unit)
+TIntermediate::TIntermediate(const TIntermediate& unit) :
+    language(unit.language), treeRoot(0), profile(unit.profile), version(unit.version),
+    requestedExtensions(unit.requestedExtensions), resources(unit.resources),
+    numMains(unit.numMains), entryPoints(unit.entryPoints), explicitEntryPoints(unit.explicitEntryPoints),
+    definedEntryPoints(unit.definedEntryPoints), numErrors(unit.numErrors), recursive(unit.recursive), library(unit.library),
+    invocations(unit.invocations), vertices(unit.vertices),
+    inputPrimitive(unit.inputPrimitive), outputPrimitive(unit.outputPrimitive),
+    pixelCenterInteger(unit.pixelCenterInteger), originUpperLeft(unit.originUpperLeft),
+    vertexSpacing(unit.vertexSpacing), vertexOrder(unit.vertexOrder), pointMode(unit.pointMode),
+    earlyFragmentTests(unit.earlyFragmentTests), depthLayout(unit.depthLayout), depthReplacing(unit.depthReplacing),
+    blendEquations(unit.blendEquations), xfbMode(unit.xfbMode),
+    usedAtomics(unit.usedAtomics), usedAtomicsIndex(unit.usedAtomicsIndex), xfbBuffers(unit.xfbBuffers)
+{
+    for (int i = 0; i < 3; ++i)
+        localSize[i] = unit.localSize[i];
+    for (int i = 0; i < 4; ++i) {
+        usedIo[i] = unit.usedIo[i];
+        usedIoIndex[i] = unit.usedIoIndex[i];
+    }
+    copyCallGraphAndIo(unit);
+    if (unit.treeRoot)
+        treeRoot = copyTree(unit.treeRoot);
+}
+
+//
+// Copy a tree, for linking without changing the original.  Copies are made
+// bottom up, as nodes are post-visited, so the traverser's stack, not the
+// thread's, bounds the depth.  A node's copied children are the last ones
+// on 'copies', in the order the traversal visits them.
+//
+class TTreeCopier : public TIntermTraverser {
+public:
+    TTreeCopier() : TIntermTraverser(false, false, true) { }
+
+    TIntermNode* getCopy() const { return copies.empty() ? 0 : copies.back(); }
+
+    virtual void visitSymbol(TIntermSymbol* symbol)
+    {
+        TIntermSymbol* copy = new TIntermSymbol(symbol->getId(), symbol->getName(), copyType(symbol->getType()));
+        copy->setConstArray(symbol->getConstArray());
+        copy->setLoc(symbol->getLoc());
+        copies.push_back(copy);
+    }
+
+    virtual void visitConstantUnion(TIntermConstantUnion* constant)
+    {
+        TIntermConstantUnion* copy = new TIntermConstantUnion(constant->getConstArray(), copyType(constant->getType()));
+        if (constant->isLiteral())
+            copy->setLiteral();
+        copy->setLoc(constant->getLoc());
+        copies.push_back(copy);
+    }
+
+    virtual bool visitBinary(TVisit, TIntermBinary* binary)
+    {
+        TIntermBinary* copy = new TIntermBinary(binary->getOp());
+        copy->setRight(copyOf(binary->getRight()));
+        copy->setLeft(copyOf(binary->getLeft()));
+        push(copy, binary);
+        return true;
+    }
+
+    virtual bool visitUnary(TVisit, TIntermUnary* unary)
+    {
+        TIntermUnary* copy = new TIntermUnary(unary->getOp());
+        copy->setOperand(copyOf(unary->getOperand()));
+        push(copy, unary);
+        return true;
+    }
+
+    virtual bool visitAggregate(TVisit, TIntermAggregate* aggregate)
+    {
+        TIntermAggregate* copy = new TIntermAggregate;
+        copy->setOperator(aggregate->getOp());
+        const TIntermSequence& children = aggregate->getSequence();
+        TIntermSequence& sequence = copy->getSequence();
+        sequence.resize(children.size());
+        for (size_t c = sequence.size(); c > 0; --c)
+            sequence[c - 1] = copyOf(children[c - 1]);
+        copy->setName(aggregate->getName());
+        if (aggregate->isUserDefined())
+            copy->setUserDefined();
+        copy->setOptimize(aggregate->getOptimize());
+        copy->setDebug(aggregate->getDebug());
+        const TQualifierList& qualifiers = aggregate->getQualifierList();
+        copy->getQualifierList().insert(copy->getQualifierList().end(), qualifiers.begin(), qualifiers.end());
+        if (aggregate->hasPragmaTable())
+            copy->addToPragmaTable(aggregate->getPragmaTable());
+        push(copy, aggregate);
+        return true;
+    }
+
+    virtual bool visitSelection(TVisit, TIntermSelection* selection)
+    {
+        TIntermNode* falseBlock = copyOf(selection->getFalseBlock());
+        TIntermNode* trueBlock = copyOf(selection->getTrueBlock());
+        TIntermTyped* condition = copyOf(selection->getCondition());
+        TIntermSelection* copy = new TIntermSelection(condition, trueBlock, falseBlock, copyType(selection->getType()));
+        copy->setLoc(selection->getLoc());
+        copies.push_back(copy);
+        return true;
+    }
+
+    virtual bool visitLoop(TVisit, TIntermLoop* loop)
+    {
+        TIntermTyped* terminal = copyOf(loop->getTerminal());
+        TIntermNode* body = copyOf(loop->getBody());
+        TIntermTyped* test = copyOf(loop->getTest());
+        TIntermLoop* copy = new TIntermLoop(body, test, terminal, loop->testFirst());
+        copy->setLoopControl(loop->getLoopControl());
+        copy->setLoc(loop->getLoc());
+        copies.push_back(copy);
+        return true;
+    }
+
+    virtual bool visitBranch(TVisit, TIntermBranch* branch)
+    {
+        TIntermBranch* copy = new TIntermBranch(branch->getFlowOp(), copyOf(branch->getExpression()));
+        copy->setLoc(branch->getLoc());
+        copies.push_back(copy);
+        return true;
+    }
+
+    virtual bool visitSwitch(TVisit, TIntermSwitch* switchNode)
+    {
+        TIntermAggregate* body = copyOf(switchNode->getBody());
+        TIntermTyped* condition = copyOf(switchNode->getCondition()->getAsTyped());
+        TIntermSwitch* copy = new TIntermSwitch(condition, body);
+        copy->setLoc(switchNode->getLoc());
+        copies.push_back(copy);
+        return true;
+    }
+
+protected:
+    // The result is only good until the next call; nodes take a shallow copy of it.
+    const TType& copyType(const TType& type)
+    {
+        typeCopy.deepCopy(type, typeCopies);
+        return typeCopy;
+    }
+
+    void push(TIntermOperator* copy, TIntermOperator* node)
+    {
+        copy->setType(copyType(node->getType()));
+        copy->setLoc(node->getLoc());
+        copies.push_back(copy);
+    }
+
+    // Take the copy of the given child.  Children are taken last to first, the
+    // reverse of the traversal.  Method nodes, left only by erroneous shaders,
+    // aren't visited, so aren't copied; they are never changed, so are shared.
+    template<class T> T* copyOf(T* child)
+    {
+        if (child == 0 || child->getAsMethodNode())
+            return child;
+
+        TIntermNode* copy = copies.back();
+        copies.pop_back();
+
+        return static_cast<T*>(copy);
+    }
+
+    std::vector<TIntermNode*> copies;
+    TTypeCopies typeCopies;
+    TType typeCopy;
+};
+
+TIntermNode* TIntermediate::copyTree(TIntermNode* root)
+{
+    TTreeCopier copier;
+    root->traverse(&copier);
+
+    return copier.getCopy();
+}
+
+//
+// Take the unit's calls and accessed I/O names, copying the strings into the current pool.
+//
+void TIntermediate::copyCallGraphAndIo(const TIntermediate& unit)
+{
+    for (TGraph::const_iterator call = unit.callGraph.begin(); call != unit.callGraph.end(); ++call) {
+        callGraph.push_back(TCall(TString(call->caller.c_str()), TString(call->callee.c_str())));
+        callGraph.back().visited = call->visited;
+        callGraph.back().currentPath = call->currentPath;
+        callGraph.back().errorGiven = call->errorGiven;
+    }
+    for (std::set<TString>::const_iterator name = unit.ioAccessed.begin(); name != unit.ioAccessed.end(); ++name)
+        ioAccessed.insert(TString(name->c_str()));
+}
+
+//
+// Merge the information from 'unit' into 'this'.  'unit' itself is not changed;
+// its tree is copied for merging.
+//
+void TIntermediate::merge(TInfoSink& infoSink, const TIntermediate& unit)
 {
     numMains += unit.numMains;
+    if (unit.explicitEntryPoints) {
+        if (! explicitEntryPoints)
+            entryPoints.clear();
+        explicitEntryPoints = true;
+        for (size_t e = 0; e < unit.entryPoints.size(); ++e) {
+            if (std::find(entryPoints.begin(), entryPoints.end(), unit.entryPoints[e]) == entryPoints.end())
+                entryPoints.push_back(unit.entryPoints[e]);
+        }
+    }
+    definedEntryPoints.insert(unit.definedEntryPoints.begin(), unit.definedEntryPoints.end());
     numErrors += unit.numErrors;
-    callGraph.insert(callGraph.end(), unit.callGraph.begin(), unit.callGraph.end());
+    copyCallGraphAndIo(unit);
 
     if ((profile != EEsProfile && unit.profile == EEsProfile) ||
         (profile == EEsProfile && unit.profile != EEsProfile))
@@ -147,8 +355,10 @@ void TIntermediate::merge(TInfoSink& infoSink, TIntermediate& unit)
     if (unit.treeRoot == 0)
         return;
 
+    TIntermNode* unitRoot = copyTree(unit.treeRoot);
+
     if (treeRoot == 0) {
-        treeRoot = unit.treeRoot;
+        treeRoot = unitRoot;
         version = unit.version;
         requestedExtensions = unit.requestedExtensions;
         return;
@@ -161,16 +371,14 @@ void TIntermediate::merge(TInfoSink& infoSink, TIntermediate& unit)
 
     // Get the top-level globals of each unit
     TIntermSequence& globals = treeRoot->getAsAggregate()->getSequence();
-    TIntermSequence& unitGlobals = unit.treeRoot->getAsAggregate()->getSequence();
+    TIntermSequence& unitGlobals = unitRoot->getAsAggregate()->getSequence();
 
     // Get the linker-object lists
     TIntermSequence& linkerObjects = findLinkerObjects();
-    TIntermSequence& unitLinkerObjects = unit.findLinkerObjects();
+    TIntermSequence& unitLinkerObjects = unitGlobals.back()->getAsAggregate()->getSequence();
 
     mergeBodies(infoSink, globals, unitGlobals);
     mergeLinkerObjects(infoSink, linkerObjects, unitLinkerObjects);
-
-    ioAccessed.insert(unit.ioAccessed.begin(), unit.ioAccessed.end());
 }
 
 //
@@ -179,17 +387,23 @@ void TIntermediate::merge(TInfoSink& infoSink, TIntermediate& unit)
 //
 void TIntermediate::mergeBodies(TInfoSink& infoSink, TIntermSequence& globals, const TIntermSequence& unitGlobals)
 {
-    // TODO: link-time performance: Processing in alphabetical order will be faster
+    // Count the unit's bodies by signature, so each body here is checked with one lookup
+    std::unordered_map<TString, int> unitBodies;
+    for (unsigned int unitChild = 0; unitChild < unitGlobals.size() - 1; ++unitChild) {
+        TIntermAggregate* unitBody = unitGlobals[unitChild]->getAsAggregate();
+        if (unitBody && unitBody->getOp() == EOpFunction)
+            ++unitBodies[unitBody->getName()];
+    }
 
     // Error check the global objects, not including the linker objects
-    for (unsigned int child = 0; child < globals.size() - 1; ++child) {
-        for (unsigned int unitChild = 0; unitChild < unitGlobals.size() - 1; ++unitChild) {
-            TIntermAggregate* body = globals[child]->getAsAggregate();
-            TIntermAggregate* unitBody = unitGlobals[unitChild]->getAsAggregate();
-            if (body && unitBody && body->getOp() == EOpFunction && unitBody->getOp() == EOpFunction && body->getName() == unitBody->getName()) {
-                error(infoSink, "Multiple function bodies in multiple compilation units for the same signature in the same stage:");
-                infoSink.info << "    " << globals[child]->getAsAggregate()->getName() << "\n";
-            }
+    for (unsigned int child = 0; child < globals.size() - 1 && ! unitBodies.empty(); ++child) {
+        TIntermAggregate* body = globals[child]->getAsAggregate();
+        if (! body || body->getOp() != EOpFunction)
+            continue;
+        auto unitBody = unitBodies.find(body->getName());
+        for (int duplicate = 0; unitBody != unitBodies.end() && duplicate < unitBody->second; ++duplicate) {
+            error(infoSink, "Multiple function bodies in multiple compilation units for the same signature in the same stage:");
+            infoSink.info << "    " << body->getName() << "\n";
         }
     }
 
@@ -203,33 +417,42 @@ void TIntermediate::mergeBodies(TInfoSink& infoSink, TIntermSequence& globals, c
 //
 void TIntermediate::mergeLinkerObjects(TInfoSink& infoSink, TIntermSequence& linkerObjects, const TIntermSequence& unitLinkerObjects)
 {
+    // Index the objects already here by name, so each unit object is matched with
+    // one lookup.  A name normally appears once, but keep them all, in order.
+    std::unordered_map<TString, std::vector<TIntermSymbol*> > symbolsByName;
+    symbolsByName.reserve(linkerObjects.size());
+    for (std::size_t linkObj = 0; linkObj < linkerObjects.size(); ++linkObj) {
+        TIntermSymbol* symbol = linkerObjects[linkObj]->getAsSymbolNode();
+        assert(symbol);
+        symbolsByName[symbol->getName()].push_back(symbol);
+    }
+
     // Error check and merge the linker objects (duplicates should not be created)
-    std::size_t initialNumLinkerObjects = linkerObjects.size();
     for (unsigned int unitLinkObj = 0; unitLinkObj < unitLinkerObjects.size(); ++unitLinkObj) {
         bool merge = true;
-        for (std::size_t linkObj = 0; linkObj < initialNumLinkerObjects; ++linkObj) {
-            TIntermSymbol* symbol = linkerObjects[linkObj]->getAsSymbolNode();
-            TIntermSymbol* unitSymbol = unitLinkerObjects[unitLinkObj]->getAsSymbolNode();
-            assert(symbol && unitSymbol);
-            if (symbol->getName() == unitSymbol->getName()) {
-                // filter out copy
-                merge = false;
-
-                // but if one has an initializer and the other does not, update
-                // the initializer
-                if (symbol->getConstArray().empty() && ! unitSymbol->getConstArray().empty())
-                    symbol->setConstArray(unitSymbol->getConstArray());
-
-                // Similarly for binding
-                if (! symbol->getQualifier().hasBinding() && unitSymbol->getQualifier().hasBinding())
-                    symbol->getQualifier().layoutBinding = unitSymbol->getQualifier().layoutBinding;
-
-                // Update implicit array sizes
-                mergeImplicitArraySizes(symbol->getWritableType(), unitSymbol->getType());
-
-                // Check for consistent types/qualification/initializers etc.
-                mergeErrorCheck(infoSink, *symbol, *unitSymbol, false);
-            }
+        TIntermSymbol* unitSymbol = unitLinkerObjects[unitLinkObj]->getAsSymbolNode();
+        assert(unitSymbol);
+        auto symbols = symbolsByName.find(unitSymbol->getName());
+        for (std::size_t linkObj = 0; symbols != symbolsByName.end() && linkObj < symbols->second.size(); ++linkObj) {
+            TIntermSymbol* symbol = symbols->second[linkObj];
+
+            // filter out copy
+            merge = false;
+
+            // but if one has an initializer and the other does not, update
+            // the initializer
+            if (symbol->getConstArray().empty() && ! unitSymbol->getConstArray().empty())
+                symbol->setConstArray(unitSymbol->getConstArray());
+
+            // Similarly for binding
+            if (! symbol->getQualifier().hasBinding() && unitSymbol->getQualifier().hasBinding())
+                symbol->getQualifier().layoutBinding = unitSymbol->getQualifier().layoutBinding;
+
+            // Update implicit array sizes
+            mergeImplicitArraySizes(symbol->getWritableType(), unitSymbol->getType());
+
+            // Check for consistent types/qualification/initializers etc.
+            mergeErrorCheck(infoSink, *symbol, *unitSymbol, false);
         }
         if (merge)
             linkerObjects.push_back(unitLinkerObjects[unitLinkObj]);
@@ -350,8 +573,17 @@ void TIntermediate::mergeErrorCheck(TInfoSink& infoSink, const TIntermSymbol& sy
 //
 void TIntermediate::finalCheck(TInfoSink& infoSink)
 {   
-    if (numMains < 1)
-        error(infoSink, "Missing entry point: Each stage requires one \"void main()\" entry point");
+    if (! library) {
+        if (! explicitEntryPoints) {
+            if (numMains < 1)
+                error(infoSink, "Missing entry point: Each stage requires one \"void main()\" entry point");
+        } else {
+            for (size_t e = 0; e < entryPoints.size(); ++e) {
+                if (! isEntryPointDefined(entryPoints[e]))
+                    error(infoSink, ("Missing entry point: no \"void " + entryPoints[e] + "()\" is defined").c_str());
+            }
+        }
+    }
 
     // recursion checking
     checkCallGraphCycles(infoSink);
@@ -377,8 +609,8 @@ void TIntermediate::finalCheck(TInfoSink& infoSink)
         // compile-time or link-time error to have different values specified for the stride for the same buffer."
         if (xfbBuffers[b].stride != TQualifier::layoutXfbStrideEnd && xfbBuffers[b].implicitStride > xfbBuffers[b].stride) {
             error(infoSink, "xfb_stride is too small to hold all buffer entries:");
-            infoSink.info.prefix(EPrefixError);
-            infoSink.info << "    xfb_buffer " << (unsigned int)b << ", xfb_stride " << xfbBuffers[b].stride << ", minimum stride needed: " << xfbBuffers[b].implicitStride << "\n";
+            infoSink.info.message(EPrefixError, ("    xfb_buffer " + String((int)b) + ", xfb_stride " + String(xfbBuffers[b].stride) +
+                                                 ", minimum stride needed: " + String(xfbBuffers[b].implicitStride)).c_str());
         }
         if (xfbBuffers[b].stride == TQualifier::layoutXfbStrideEnd)
             xfbBuffers[b].stride = xfbBuffers[b].implicitStride;
@@ -388,20 +620,18 @@ void TIntermediate::finalCheck(TInfoSink& infoSink)
         // multiple of 4, or a compile-time or link-time error results."
         if (xfbBuffers[b].containsDouble && ! IsMultipleOfPow2(xfbBuffers[b].stride, 8)) {
             error(infoSink, "xfb_stride must be multiple of 8 for buffer holding a double:");
-            infoSink.info.prefix(EPrefixError);
-            infoSink.info << "    xfb_buffer " << (unsigned int)b << ", xfb_stride " << xfbBuffers[b].stride << "\n";
+            infoSink.info.message(EPrefixError, ("    xfb_buffer " + String((int)b) + ", xfb_stride " + String(xfbBuffers[b].stride)).c_str());
         } else if (! IsMultipleOfPow2(xfbBuffers[b].stride, 4)) {
             error(infoSink, "xfb_stride must be multiple of 4:");
-            infoSink.info.prefix(EPrefixError);
-            infoSink.info << "    xfb_buffer " << (unsigned int)b << ", xfb_stride " << xfbBuffers[b].stride << "\n";
+            infoSink.info.message(EPrefixError, ("    xfb_buffer " + String((int)b) + ", xfb_stride " + String(xfbBuffers[b].stride)).c_str());
         }
 
         // "The resulting stride (implicit or explicit), when divided by 4, must be less than or equal to the 
         // implementation-dependent constant gl_MaxTransformFeedbackInterleavedComponents."
         if (xfbBuffers[b].stride > (unsigned int)(4 * resources.maxTransformFeedbackInterleavedComponents)) {
             error(infoSink, "xfb_stride is too large:");
-            infoSink.info.prefix(EPrefixError);
-            infoSink.info << "    xfb_buffer " << (unsigned int)b << ", components (1/4 stride) needed are " << xfbBuffers[b].stride/4 << ", gl_MaxTransformFeedbackInterleavedComponents is " << resources.maxTransformFeedbackInterleavedComponents << "\n";
+            infoSink.info.message(EPrefixError, ("    xfb_buffer " + String((int)b) + ", components (1/4 stride) needed are " + String(xfbBuffers[b].stride/4) +
+                                                 ", gl_MaxTransformFeedbackInterleavedComponents is " + String(resources.maxTransformFeedbackInterleavedComponents)).c_str());
         }
     }
 
@@ -534,6 +764,33 @@ void TIntermediate::checkCallGraphCycles(TInfoSink& infoSink)
     } while (newRoot);  // redundant loop check; should always exit via the 'break' above
 }
 
+//
+// Find the mangled names of the functions the entry point (main(), by
+// default) can end up calling, directly or not, so code generation can leave
+// out the rest.  (User functions can't be called from global initializers.)
+//
+void TIntermediate::getReachableFunctions(std::unordered_set<std::string>& names, const std::string& entryPoint) const
+{
+    std::vector<std::string> pending;
+    pending.push_back(entryPoint + "(");
+
+    // The graph is a list of edges, grouped by caller; index it by caller
+    // once instead of scanning it for every function reached.
+    std::unordered_multimap<std::string, std::string> callees;
+    for (TGraph::const_iterator call = callGraph.begin(); call != callGraph.end(); ++call)
+        callees.insert(std::make_pair(std::string(call->caller.c_str()), std::string(call->callee.c_str())));
+
+    while (! pending.empty()) {
+        std::string name = pending.back();
+        pending.pop_back();
+        if (! names.insert(name).second)
+            continue;
+        auto range = callees.equal_range(name);
+        for (auto callee = range.first; callee != range.second; ++callee)
+            pending.push_back(callee->second);
+    }
+}
+
 //
 // Satisfy rules for location qualifiers on inputs and outputs
 //
@@ -596,6 +853,283 @@ bool TIntermediate::userOutputUsed() const
     return found;
 }
 
+namespace {
+
+// Finds whether evaluating a subtree can do anything other than produce its
+// value, so that it can be dropped when the value isn't needed.  Anything
+// not known to be free of side effects is taken to have them.
+class TSideEffectTraverser : public TIntermTraverser {
+public:
+    TSideEffectTraverser() : sideEffects(false) { }
+
+    virtual bool visitUnary(TVisit, TIntermUnary* node)
+    {
+        switch (node->getOp()) {
+        case EOpPostIncrement:
+        case EOpPostDecrement:
+        case EOpPreIncrement:
+        case EOpPreDecrement:
+            sideEffects = true;
+            break;
+        default:
+            break;
+        }
+
+        return ! sideEffects;
+    }
+
+    virtual bool visitBinary(TVisit, TIntermBinary* node)
+    {
+        if (node->getOp() >= EOpAssign && node->getOp() <= EOpRightShiftAssign)
+            sideEffects = true;
+
+        // a swizzle's selectors are a sequence of constants, not of statements
+        if (node->getOp() == EOpVectorSwizzle && ! sideEffects) {
+            node->getLeft()->traverse(this);
+            return false;
+        }
+
+        return ! sideEffects;
+    }
+
+    virtual bool visitAggregate(TVisit, TIntermAggregate* node)
+    {
+        // built-in functions before EmitVertex() only compute their result
+        const TOperator op = node->getOp();
+        if (! ((op >= EOpRadians && op < EOpEmitVertex) || op == EOpAny || op == EOpAll ||
+               (op > EOpConstructGuardStart && op < EOpConstructGuardEnd) || node->isTexture()))
+            sideEffects = true;
+
+        // but some, like modf(), also store through 'out' arguments
+        const TQualifierList& qualifiers = node->getQualifierList();
+        for (size_t q = 0; q < qualifiers.size(); ++q) {
+            if (qualifiers[q] == EvqOut || qualifiers[q] == EvqInOut)
+                sideEffects = true;
+        }
+
+        return ! sideEffects;
+    }
+
+    virtual bool visitLoop(TVisit, TIntermLoop*)       { sideEffects = true; return false; }
+    virtual bool visitBranch(TVisit, TIntermBranch*)   { sideEffects = true; return false; }
+    virtual bool visitSwitch(TVisit, TIntermSwitch*)   { sideEffects = true; return false; }
+
+    bool sideEffects;
+};
+
+} // end anonymous namespace
+
+bool TIntermediate::hasSideEffects(TIntermNode* node)
+{
+    TSideEffectTraverser it;
+    node->traverse(&it);
+
+    return it.sideEffects;
+}
+
+// The variable an assignment to 'target' stores into: the symbol under any
+// indexing, struct selection, or swizzle.
+TIntermSymbol* TIntermediate::getAssignedSymbol(TIntermTyped* target)
+{
+    while (target->getAsBinaryNode()) {
+        switch (target->getAsBinaryNode()->getOp()) {
+        case EOpIndexDirect:
+        case EOpIndexIndirect:
+        case EOpIndexDirectStruct:
+        case EOpVectorSwizzle:
+            target = target->getAsBinaryNode()->getLeft();
+            break;
+        default:
+            return nullptr;
+        }
+    }
+
+    return target->getAsSymbolNode();
+}
+
+namespace {
+
+// Collects the names and locations of the pipeline inputs a stage reads.
+class TInputReadTraverser : public TIntermTraverser {
+public:
+    TInputReadTraverser(const TIntermediate& i) : intermediate(i) { }
+
+    virtual void visitSymbol(TIntermSymbol* node)
+    {
+        const TQualifier& qualifier = node->getQualifier();
+        if (qualifier.storage != EvqVaryingIn)
+            return;
+
+        names.insert(node->getName());
+        if (qualifier.hasLocation()) {
+            int size;
+            if (node->getType().isArray() && qualifier.isArrayedIo(intermediate.getStage())) {
+                TType elementType(node->getType(), 0);
+                size = intermediate.computeTypeLocationSize(elementType);
+            } else
+                size = intermediate.computeTypeLocationSize(node->getType());
+            for (int l = 0; l < size; ++l)
+                locations.insert(qualifier.layoutLocation + l);
+        }
+    }
+
+    const TIntermediate& intermediate;
+    std::set<TString> names;
+    std::set<int> locations;
+
+protected:
+    TInputReadTraverser& operator=(TInputReadTraverser&);
+};
+
+// Finds the variables, by id, read anywhere other than the linker objects;
+// being assigned to (possibly in part) isn't a read.
+class TReadTraverser : public TIntermTraverser {
+public:
+    virtual bool visitBinary(TVisit, TIntermBinary* node)
+    {
+        if (node->getOp() == EOpAssign) {
+            TIntermSymbol* symbol = TIntermediate::getAssignedSymbol(node->getLeft());
+            if (symbol)
+                assigned.insert(symbol);
+        }
+
+        return true;
+    }
+
+    virtual bool visitAggregate(TVisit, TIntermAggregate* node)
+    {
+        return node->getOp() != EOpLinkerObjects;
+    }
+
+    virtual void visitSymbol(TIntermSymbol* node)
+    {
+        if (assigned.find(node) == assigned.end())
+            read.insert(node->getId());
+    }
+
+    std::set<const TIntermSymbol*> assigned;
+    std::set<int> read;
+};
+
+// Makes the outputs in 'trimmed' globals of the stage, and removes the
+// statements that only store to those of them in 'unread'.
+class TTrimOutputsTraverser : public TIntermTraverser {
+public:
+    TTrimOutputsTraverser(const std::set<int>& t, const std::set<int>& u) : trimmed(t), unread(u) { }
+
+    virtual void visitSymbol(TIntermSymbol* node)
+    {
+        if (trimmed.find(node->getId()) == trimmed.end())
+            return;
+
+        TQualifier& qualifier = node->getQualifier();
+        const TPrecisionQualifier precision = qualifier.precision;
+        qualifier.clear();
+        qualifier.storage = EvqGlobal;
+        qualifier.precision = precision;
+    }
+
+    virtual bool visitAggregate(TVisit, TIntermAggregate* node)
+    {
+        if (node->getOp() != EOpSequence)
+            return true;
+
+        TIntermSequence& statements = node->getSequence();
+        size_t kept = 0;
+        for (size_t s = 0; s < statements.size(); ++s) {
+            if (! isUnreadStore(statements[s]))
+                statements[kept++] = statements[s];
+        }
+        statements.resize(kept);
+
+        return true;
+    }
+
+    const std::set<int>& trimmed;
+    const std::set<int>& unread;
+
+protected:
+    bool isUnreadStore(TIntermNode* statement) const
+    {
+        TIntermBinary* assign = statement->getAsBinaryNode();
+        if (! assign || assign->getOp() != EOpAssign)
+            return false;
+
+        TIntermSymbol* symbol = TIntermediate::getAssignedSymbol(assign->getLeft());
+
+        return symbol && unread.find(symbol->getId()) != unread.end() &&
+               ! TIntermediate::hasSideEffects(assign->getLeft()) && ! TIntermediate::hasSideEffects(assign->getRight());
+    }
+
+    TTrimOutputsTraverser& operator=(TTrimOutputsTraverser&);
+};
+
+} // end anonymous namespace
+
+//
+// Cross-stage interface trimming, for EShMsgTrimInterface: the user-declared
+// outputs of this stage that 'nextStage' never reads, by name or by location,
+// become globals private to this stage, and the statements only storing to
+// those this stage doesn't read itself are removed.  Built-in outputs, blocks,
+// and outputs captured by transform feedback are kept, as someone other than
+// the next stage can see them.
+//
+void TIntermediate::trimOutputs(const TIntermediate& nextStage)
+{
+    if (numMains != 1 || nextStage.numMains != 1 || nextStage.entryPoints.size() != 1 || language == EShLangTessControl)
+        return;
+
+    // what the next stage reads, from the functions reachable from its main()
+    std::unordered_set<std::string> reachable;
+    nextStage.getReachableFunctions(reachable, nextStage.entryPoints.front());
+    TInputReadTraverser inputs(nextStage);
+    TIntermSequence& nextGlobals = nextStage.treeRoot->getAsAggregate()->getSequence();
+    for (size_t f = 0; f < nextGlobals.size(); ++f) {
+        TIntermAggregate* function = nextGlobals[f]->getAsAggregate();
+        if (function && function->getOp() == EOpFunction && reachable.find(function->getName().c_str()) != reachable.end())
+            function->traverse(&inputs);
+    }
+
+    std::set<int> trimmed;
+    TIntermSequence& linkerObjects = findLinkerObjects();
+    size_t kept = 0;
+    for (size_t i = 0; i < linkerObjects.size(); ++i) {
+        TIntermSymbol* symbol = linkerObjects[i]->getAsSymbolNode();
+        const TQualifier& qualifier = symbol->getQualifier();
+        bool read = true;
+        if (qualifier.storage == EvqVaryingOut && qualifier.builtIn == EbvNone && symbol->getName().compare(0, 3, "gl_") != 0 &&
+            symbol->getBasicType() != EbtBlock && ! qualifier.hasXfbOffset() && inputs.names.find(symbol->getName()) == inputs.names.end()) {
+            read = false;
+            if (qualifier.hasLocation()) {
+                int size = computeTypeLocationSize(symbol->getType());
+                for (int l = 0; l < size; ++l) {
+                    if (inputs.locations.find(qualifier.layoutLocation + l) != inputs.locations.end())
+                        read = true;
+                }
+            }
+        }
+        if (read)
+            linkerObjects[kept++] = linkerObjects[i];
+        else
+            trimmed.insert(symbol->getId());
+    }
+    linkerObjects.resize(kept);
+
+    if (trimmed.empty())
+        return;
+
+    TReadTraverser reads;
+    treeRoot->traverse(&reads);
+    std::set<int> unread;
+    for (std::set<int>::const_iterator id = trimmed.begin(); id != trimmed.end(); ++id) {
+        if (reads.read.find(*id) == reads.read.end())
+            unread.insert(*id);
+    }
+
+    TTrimOutputsTraverser trim(trimmed, unread);
+    treeRoot->traverse(&trim);
+}
+
 // Accumulate locations used for inputs, outputs, and uniforms, and check for collisions
 // as the accumulation is done.
 //
@@ -645,18 +1179,24 @@ int TIntermediate::addUsedLocation(const TQualifier& qualifier, const TType& typ
 
     // check for collisions, except for vertex inputs on desktop
     if (! (profile != EEsProfile && language == EShLangVertex && qualifier.isPipeInput())) {
-        for (size_t r = 0; r < usedIo[set].size(); ++r) {
-            if (range.overlap(usedIo[set][r])) {
+        // report the earliest accumulated range that collides, as a full scan would
+        std::vector<int> candidates;
+        usedIoIndex[set].findCandidates(locationRange, candidates);
+        std::sort(candidates.begin(), candidates.end());
+        for (size_t c = 0; c < candidates.size(); ++c) {
+            const TIoRange& used = usedIo[set][candidates[c]];
+            if (range.overlap(used)) {
                 // there is a collision; pick one
-                return std::max(locationRange.start, usedIo[set][r].location.start);
-            } else if (locationRange.overlap(usedIo[set][r].location) && type.getBasicType() != usedIo[set][r].basicType) {
+                return std::max(locationRange.start, used.location.start);
+            } else if (locationRange.overlap(used.location) && type.getBasicType() != used.basicType) {
                 // aliased-type mismatch
                 typeCollision = true;
-                return std::max(locationRange.start, usedIo[set][r].location.start);
+                return std::max(locationRange.start, used.location.start);
             }
         }
     }
 
+    usedIoIndex[set].add(locationRange, (int)usedIo[set].size());
     usedIo[set].push_back(range);
 
     return -1; // no collision
@@ -673,14 +1213,19 @@ int TIntermediate::addUsedOffsets(int binding, int offset, int numOffsets)
     TRange offsetRange(offset, offset + numOffsets - 1);
     TOffsetRange range(bindingRange, offsetRange);
 
-    // check for collisions, except for vertex inputs on desktop
-    for (size_t r = 0; r < usedAtomics.size(); ++r) {
-        if (range.overlap(usedAtomics[r])) {
+    // check for collisions, only atomics sharing this binding can collide
+    TRangeIndex& offsetIndex = usedAtomicsIndex[binding];
+    std::vector<int> candidates;
+    offsetIndex.findCandidates(offsetRange, candidates);
+    std::sort(candidates.begin(), candidates.end());
+    for (size_t c = 0; c < candidates.size(); ++c) {
+        if (range.overlap(usedAtomics[candidates[c]])) {
             // there is a collision; pick one
-            return std::max(offset, usedAtomics[r].offset.start);
+            return std::max(offset, usedAtomics[candidates[c]].offset.start);
         }
     }
 
+    offsetIndex.add(offsetRange, (int)usedAtomics.size());
     usedAtomics.push_back(range);
 
     return -1; // no collision
@@ -705,11 +1250,26 @@ int TIntermediate::computeTypeLocationSize(const TType& type) const
     // "The locations consumed by block and structure members are determined by applying the rules above 
     // recursively..."    
     if (type.isStruct()) {
+        // a structure's members take the same locations wherever it's used (a
+        // block's might not, if sized implicitly), so do each just once
+        const TTypeList* memberList = type.getStruct();
+        if (type.getBasicType() == EbtStruct) {
+            std::lock_guard<std::mutex> guard(structCachesMutex);
+            std::map<const TTypeList*, int>::const_iterator cached = structLocationSizes.find(memberList);
+            if (cached != structLocationSizes.end())
+                return cached->second;
+        }
+
         int size = 0;
-        for (int member = 0; member < (int)type.getStruct()->size(); ++member) {
+        for (int member = 0; member < (int)memberList->size(); ++member) {
             TType memberType(type, member);
             size += computeTypeLocationSize(memberType);
         }
+        if (type.getBasicType() == EbtStruct) {
+            std::lock_guard<std::mutex> guard(structCachesMutex);
+            structLocationSizes[memberList] = size;
+        }
+
         return size;
     }
 
@@ -792,9 +1352,20 @@ unsigned int TIntermediate::computeTypeXfbSize(const TType& type, bool& contains
     }
 
     if (type.isStruct()) {
+        const TTypeList* memberList = type.getStruct();
+        if (type.getBasicType() == EbtStruct) {
+            std::lock_guard<std::mutex> guard(structCachesMutex);
+            TStructXfbSizes::const_iterator cached = structXfbSizes.find(memberList);
+            if (cached != structXfbSizes.end()) {
+                if (cached->second.second)
+                    containsDouble = true;
+                return cached->second.first;
+            }
+        }
+
         unsigned int size = 0;
         bool structContainsDouble = false;
-        for (int member = 0; member < (int)type.getStruct()->size(); ++member) {
+        for (int member = 0; member < (int)memberList->size(); ++member) {
             TType memberType(type, member);
             // "... if applied to 
             // an aggregate containing a double, the offset must also be a multiple of 8, 
@@ -812,6 +1383,11 @@ unsigned int TIntermediate::computeTypeXfbSize(const TType& type, bool& contains
             containsDouble = true;
             RoundToPow2(size, 8);
         }
+        if (type.getBasicType() == EbtStruct) {
+            std::lock_guard<std::mutex> guard(structCachesMutex);
+            structXfbSizes[memberList] = std::make_pair(size, structContainsDouble);
+        }
+
         return size;
     }
 
@@ -855,7 +1431,12 @@ int TIntermediate::getBaseAlignmentScalar(const TType& type, int& size)
 //
 // The size is returned in the 'size' parameter
 // Return value is the alignment of the type.
-int TIntermediate::getBaseAlignment(const TType& type, int& size, bool std140)
+//
+// A structure is laid out the same wherever it's used, so each is only laid
+// out once, for each of std140 and std430; later requests are looked up.
+// The lookup is locked, not the layout, since SPIR-V forks ask at once; two
+// forks may both lay out a structure, getting the same answer.
+int TIntermediate::getBaseAlignment(const TType& type, int& size, bool std140) const
 {
     int alignment;
 
@@ -928,6 +1509,14 @@ int TIntermediate::getBaseAlignment(const TType& type, int& size, bool std140)
     // rule 9
     if (type.getBasicType() == EbtStruct) {
         const TTypeList& memberList = *type.getStruct();
+        {
+            std::lock_guard<std::mutex> guard(structCachesMutex);
+            TStructLayouts::const_iterator cached = structLayouts.find(std::make_pair(&memberList, std140));
+            if (cached != structLayouts.end()) {
+                size = cached->second.second;
+                return cached->second.first;
+            }
+        }
 
         size = 0;
         int maxAlignment = std140 ? baseAlignmentVec4Std140 : 0;
@@ -938,6 +1527,8 @@ int TIntermediate::getBaseAlignment(const TType& type, int& size, bool std140)
             RoundToPow2(size, memberAlignment);         
             size += memberSize;
         }
+        std::lock_guard<std::mutex> guard(structCachesMutex);
+        structLayouts[std::make_pair(&memberList, std140)] = std::make_pair(maxAlignment, size);
 
         return maxAlignment;
     }
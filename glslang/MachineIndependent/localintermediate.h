@@ -40,7 +40,9 @@
 #include "Versions.h"
 
 #include <algorithm>
+#include <mutex>
 #include <set>
+#include <unordered_set>
 
 class TInfoSink;
 
@@ -77,6 +79,27 @@ struct TRange {
     int last;
 };
 
+// An index of ranges by where they start, so the ranges possibly overlapping a new one
+// can be found without looking at all of them.  A range can only overlap the query if it
+// starts within the query, or no more than the size of the largest range before it.
+struct TRangeIndex {
+    TRangeIndex() : maxSize(1) { }
+    void add(const TRange& range, int id)
+    {
+        starts[range.start].push_back(id);
+        maxSize = std::max(maxSize, range.last - range.start + 1);
+    }
+    // Append the ids of ranges that might overlap 'range', in no particular order.
+    void findCandidates(const TRange& range, std::vector<int>& ids) const
+    {
+        std::map<int, std::vector<int> >::const_iterator it = starts.lower_bound(range.start - (maxSize - 1));
+        for (; it != starts.end() && it->first <= range.last; ++it)
+            ids.insert(ids.end(), it->second.begin(), it->second.end());
+    }
+    std::map<int, std::vector<int> > starts;
+    int maxSize;
+};
+
 // An IO range is a 3-D rectangle; the set of (location, component, index) triples all lying
 // within the same location range, component range, and index value.  Locations don't alias unless
 // all other dimensions of their range overlap.
@@ -125,7 +148,7 @@ class TVariable;
 class TIntermediate {
 public:
     explicit TIntermediate(EShLanguage l, int v = 0, EProfile p = ENoProfile) : language(l), treeRoot(0), profile(p), version(v), 
-        numMains(0), numErrors(0), recursive(false),
+        numMains(0), entryPoints(1, "main"), explicitEntryPoints(false), numErrors(0), recursive(false), library(false),
         invocations(0), vertices(0), inputPrimitive(ElgNone), outputPrimitive(ElgNone), pixelCenterInteger(false), originUpperLeft(false),
         vertexSpacing(EvsNone), vertexOrder(EvoNone), pointMode(false), earlyFragmentTests(false), depthLayout(EldNone), depthReplacing(false), blendEquations(0), xfbMode(false)
     {
@@ -134,6 +157,10 @@ public:
         localSize[2] = 1;
         xfbBuffers.resize(TQualifier::layoutXfbBufferEnd);
     }
+    // A copy of a compiled unit, for linking: linking changes only the copy, so the
+    // unit can be linked into any number of other programs, also concurrently.  The
+    // copy still reads the unit's names and constant values, so the unit must outlive it.
+    TIntermediate(const TIntermediate& unit);
     void setLimits(const TBuiltInResource& r) { resources = r; }
 
     bool postProcess(TIntermNode*, EShLanguage);
@@ -152,8 +179,27 @@ public:
     TIntermNode* getTreeRoot() const { return treeRoot; }
     void addMainCount() { ++numMains; }
     int getNumMains() const { return numMains; }
+
+    // The functions acting as main(), 'main' unless set otherwise; a compute
+    // library can define several kernels, each of which GlslangToSpv() can make
+    // the entry point of its own module.  getNumMains() counts the definitions.
+    void setEntryPoints(const std::vector<std::string>& names) { entryPoints = names; explicitEntryPoints = true; }
+    const std::vector<std::string>& getEntryPoints() const { return entryPoints; }
+    bool isEntryPointName(const TString& name) const
+    {
+        for (size_t e = 0; e < entryPoints.size(); ++e) {
+            if (name == entryPoints[e].c_str())
+                return true;
+        }
+        return false;
+    }
+    void addEntryPointDefinition(const TString& name) { ++numMains; definedEntryPoints.insert(name.c_str()); }
+    bool isEntryPointDefined(const std::string& name) const { return definedEntryPoints.find(name) != definedEntryPoints.end(); }
+
     int getNumErrors() const { return numErrors; }
     bool isRecursive() const { return recursive; }
+    void setLibrary() { library = true; }      // functions to link into other modules; main() is optional
+    bool isLibrary() const { return library; }
     
     TIntermSymbol* addSymbol(int Id, const TString&, const TType&, const TSourceLoc&);
     TIntermSymbol* addSymbol(const TVariable&, const TSourceLoc&);
@@ -179,7 +225,7 @@ public:
     TIntermConstantUnion* addConstantUnion(unsigned int, const TSourceLoc&, bool literal = false) const;
     TIntermConstantUnion* addConstantUnion(bool, const TSourceLoc&, bool literal = false) const;
     TIntermConstantUnion* addConstantUnion(double, TBasicType, const TSourceLoc&, bool literal = false) const;
-    TIntermTyped* promoteConstantUnion(TBasicType, TIntermConstantUnion*) const;
+    TIntermTyped* promoteConstantUnion(TBasicType, TIntermConstantUnion*, bool inPlace = false) const;
     bool parseConstTree(TIntermNode*, TConstUnionArray, TOperator, const TType&, bool singleConstantParam = false);
     TIntermLoop* addLoop(TIntermNode*, TIntermTyped*, TIntermTyped*, bool testFirst, const TSourceLoc&);
     TIntermBranch* addBranch(TOperator, const TSourceLoc&);
@@ -194,6 +240,9 @@ public:
 
     // Tree ops
     static const TIntermTyped* findLValueBase(const TIntermTyped*, bool swizzleOkay);
+    static bool hasSideEffects(TIntermNode*);
+    static TIntermSymbol* getAssignedSymbol(TIntermTyped*);
+    static TIntermNode* copyTree(TIntermNode*);
 
     // Linkage related
     void addSymbolLinkageNodes(TIntermAggregate*& linkage, EShLanguage, TSymbolTable&);
@@ -283,8 +332,11 @@ public:
     unsigned int getBlendEquations() const { return blendEquations; }
 
     void addToCallGraph(TInfoSink&, const TString& caller, const TString& callee);
-    void merge(TInfoSink&, TIntermediate&);
+    void getReachableFunctions(std::unordered_set<std::string>& names, const std::string& entryPoint = "main") const;
+    void merge(TInfoSink&, const TIntermediate&);
     void finalCheck(TInfoSink&);
+    void trimOutputs(const TIntermediate& nextStage);
+    void inlineFunctions();
 
     void addIoAccessed(const TString& name) { ioAccessed.insert(name); }
     bool inIoAccessed(const TString& name) const { return ioAccessed.find(name) != ioAccessed.end(); }
@@ -302,7 +354,7 @@ public:
     }
     int addXfbBufferOffset(const TType&);
     unsigned int computeTypeXfbSize(const TType&, bool& containsDouble) const;
-    static int getBaseAlignment(const TType&, int& size, bool std140);
+    int getBaseAlignment(const TType&, int& size, bool std140) const;
 
 protected:
     void error(TInfoSink& infoSink, const char*);
@@ -313,6 +365,7 @@ protected:
     void checkCallGraphCycles(TInfoSink&);
     void inOutLocationCheck(TInfoSink&);
     TIntermSequence& findLinkerObjects() const;
+    void copyCallGraphAndIo(const TIntermediate&);
     bool userOutputUsed() const;
     static int getBaseAlignmentScalar(const TType&, int& size);
 
@@ -323,8 +376,12 @@ protected:
     std::set<std::string> requestedExtensions;  // cumulation of all enabled or required extensions; not connected to what subset of the shader used them
     TBuiltInResource resources;
     int numMains;
+    std::vector<std::string> entryPoints;
+    bool explicitEntryPoints;                // entryPoints was set, rather than just 'main'
+    std::set<std::string> definedEntryPoints;
     int numErrors;
     bool recursive;
+    bool library;
     int invocations;
     int vertices;
     TLayoutGeometry inputPrimitive;
@@ -347,8 +404,18 @@ protected:
     std::set<TString> ioAccessed;           // set of names of statically read/written I/O that might need extra checking
     std::vector<TIoRange> usedIo[4];        // sets of used locations, one for each of in, out, uniform, and buffers
     std::vector<TOffsetRange> usedAtomics;  // sets of bindings used by atomic counters
+    TRangeIndex usedIoIndex[4];             // usedIo[] indexed by location
+    std::map<int, TRangeIndex> usedAtomicsIndex; // usedAtomics indexed by binding, then offset
     std::vector<TXfbBuffer> xfbBuffers;     // all the data we need to track per xfb buffer
 
+    // what's been worked out about the structures (not blocks) asked about, by member list
+    typedef std::map<std::pair<const TTypeList*, bool>, std::pair<int, int> > TStructLayouts;
+    typedef std::map<const TTypeList*, std::pair<unsigned int, bool> > TStructXfbSizes;
+    mutable TStructLayouts structLayouts;                         // alignment and size, for std140 (true) or std430
+    mutable std::map<const TTypeList*, int> structLocationSizes;
+    mutable TStructXfbSizes structXfbSizes;                       // size, and whether it contains a double
+    mutable std::mutex structCachesMutex;                         // SPIR-V forks share the intermediate
+
 private:
     void operator=(TIntermediate&); // prevent assignments
 };
@@ -174,6 +174,7 @@ int TPpContext::CPPdefine(TPpToken* ppToken)
 
     // check for duplicate definition
     symb = LookUpSymbol(defAtom);
+    const bool existed = symb != nullptr;
     if (symb) {
         if (! symb->mac.undef) {
             // Already defined -- need to make sure they are identical:
@@ -208,6 +209,9 @@ int TPpContext::CPPdefine(TPpToken* ppToken)
     delete symb->mac.body;
     symb->mac = mac;
 
+    if (recordingPreamble(defineLoc))
+        recordDefine(defAtom, symb->mac, existed);
+
     return '\n';
 }
 
@@ -228,6 +232,8 @@ int TPpContext::CPPundef(TPpToken* ppToken)
     if (symb) {
         symb->mac.undef = 1;
     }
+    if (recordingPreamble(ppToken->loc))
+        recordUndef(ppToken->atom, symb != nullptr);
     token = scanToken(ppToken);
     if (token != '\n')
         parseContext.ppError(ppToken->loc, "can only be followed by a single macro name", "#undef", "");
@@ -244,6 +250,10 @@ int TPpContext::CPPelse(int matchelse, TPpToken* ppToken)
 {
     int atom;
     int depth = 0;
+
+    // Only directives matter here, so let the input pass over the lines
+    // without one, rather than scanning every token on them.
+    inputStack.back()->skipToDirective();
     int token = scanToken(ppToken);
 
     while (token != EndOfInput) {
@@ -254,6 +264,7 @@ int TPpContext::CPPelse(int matchelse, TPpToken* ppToken)
             if (token == EndOfInput)
                 return token;
 
+            inputStack.back()->skipToDirective();
             token = scanToken(ppToken);
             continue;
         }
@@ -827,6 +838,8 @@ int TPpContext::CPPextension(TPpToken* ppToken)
 
     parseContext.updateExtensionBehavior(line, extensionName, ppToken->name);
     parseContext.notifyExtensionDirective(line, extensionName, ppToken->name);
+    if (recordingPreamble(ppToken->loc))
+        recordExtension(line, extensionName, ppToken->name);
 
     token = scanToken(ppToken);
     if (token == '\n')
@@ -1136,6 +1149,8 @@ int TPpContext::MacroExpand(int atom, TPpToken* ppToken, bool expandUndef, bool
     pushInput(in);
     sym->mac.busy = 1;
     RewindTokenStream(sym->mac.body);
+    if (counterStats)
+        ++counterStats->macroExpansions;
 
     return 1;
 }
@@ -125,21 +125,69 @@ const struct {
 
 };
 
+// The fixed atoms, shared by all TPpContexts.  After a single process-level
+// initialization, these are read only and thread safe.
+std::unordered_map<std::string, int>* FixedAtomMap = nullptr;
+const char** FixedAtomStrings = nullptr;  // indexed by atom, up to PpAtomLast
+
 } // end anonymous namespace
 
 namespace glslang {
 
+//
+// Build the process-wide table of fixed atoms; see fillInKeywordMap().
+//
+void TPpContext::fillInFixedAtoms()
+{
+    if (FixedAtomMap != nullptr) {
+        // should be called only once per process
+        return;
+    }
+    FixedAtomMap = new std::unordered_map<std::string, int>;
+    FixedAtomStrings = new const char*[PpAtomLast];
+    for (int atom = 0; atom < PpAtomLast; ++atom)
+        FixedAtomStrings[atom] = nullptr;
+
+    // Add single character tokens to the atom table:
+    const char* s = "~!%^&*()-+=|,.<>/?;:[]{}#\\";
+    while (*s) {
+        auto it = FixedAtomMap->insert(std::make_pair(std::string(1, *s), (int)s[0])).first;
+        FixedAtomStrings[(int)s[0]] = it->first.c_str();
+        s++;
+    }
+
+    // Add multiple character scanner tokens :
+    for (size_t ii = 0; ii < sizeof(tokens)/sizeof(tokens[0]); ii++) {
+        (*FixedAtomMap)[tokens[ii].str] = tokens[ii].val;
+        FixedAtomStrings[tokens[ii].val] = tokens[ii].str;
+    }
+}
+
+void TPpContext::deleteFixedAtoms()
+{
+    delete FixedAtomMap;
+    FixedAtomMap = nullptr;
+    delete [] FixedAtomStrings;
+    FixedAtomStrings = nullptr;
+}
+
 //
 // Map a new or existing string to an atom, inventing a new atom if necessary.
 //
 int TPpContext::LookUpAddString(const char* s)
 {
+    // This compile's own atoms are the common case; the fixed ones are
+    // only needed for names not seen yet.
     auto it = atomMap.find(s);
-    if (it == atomMap.end()) {
-        AddAtomFixed(s, nextAtom);
-        return nextAtom++;
-    } else
+    if (it != atomMap.end())
         return it->second;
+
+    auto fixed = FixedAtomMap->find(s);
+    if (fixed != FixedAtomMap->end())
+        return fixed->second;
+
+    AddAtomFixed(s, nextAtom);
+    return nextAtom++;
 }
 
 //
@@ -147,45 +195,35 @@ int TPpContext::LookUpAddString(const char* s)
 //
 const char* TPpContext::GetAtomString(int atom)
 {
-    if ((size_t)atom >= stringMap.size())
+    if (atom >= 0 && atom < PpAtomLast)
+        return FixedAtomStrings[atom] ? FixedAtomStrings[atom] : "<bad token>";
+
+    if (atom < 0 || (size_t)(atom - PpAtomLast) >= stringMap.size())
         return "<bad token>";
 
-    const TString* atomString = stringMap[atom];
+    const TString* atomString = stringMap[atom - PpAtomLast];
 
     return atomString ? atomString->c_str() : "<bad token>";
 }
 
 //
-// Add forced mapping of string to atom.
+// Add forced mapping of string to atom, for atoms of this compile.
 //
 void TPpContext::AddAtomFixed(const char* s, int atom)
 {
+    assert(atom >= PpAtomLast);
     auto it = atomMap.insert(std::pair<TString, int>(s, atom)).first;
-    if (stringMap.size() < (size_t)atom + 1)
-        stringMap.resize(atom + 100, 0);
-    stringMap[atom] = &it->first;
+    if (stringMap.size() < (size_t)(atom - PpAtomLast) + 1)
+        stringMap.resize(atom - PpAtomLast + 100, 0);
+    stringMap[atom - PpAtomLast] = &it->first;
 }
 
 //
-// Initialize the atom table.
+// Initialize the atom table.  The fixed atoms are shared, so only the
+// atoms of this compile need setting up.
 //
 void TPpContext::InitAtomTable()
 {
-    // Add single character tokens to the atom table:
-    const char* s = "~!%^&*()-+=|,.<>/?;:[]{}#\\";
-    char t[2];
-
-    t[1] = '\0';
-    while (*s) {
-        t[0] = *s;
-        AddAtomFixed(t, s[0]);
-        s++;
-    }
-
-    // Add multiple character scanner tokens :
-    for (size_t ii = 0; ii < sizeof(tokens)/sizeof(tokens[0]); ii++)
-        AddAtomFixed(tokens[ii].str, tokens[ii].val);
-
     nextAtom = PpAtomLast;
 }
 
@@ -78,13 +78,16 @@ NVIDIA HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "PpContext.h"
+#include "PpTokens.h"
 
 namespace glslang {
 
 TPpContext::TPpContext(TParseContext& pc, const TShader::Includer& inclr) : 
-    preamble(0), strings(0), parseContext(pc), includer(inclr), inComment(false)
+    preamble(0), strings(0), parseContext(pc), includer(inclr), inComment(false),
+    preambleSnapshot(0), recordingLookups(false), counterStats(0)
 {
     InitAtomTable();
     InitScanner();
@@ -117,4 +120,122 @@ void TPpContext::setInput(TInputScanner& input, bool versionWillBeError)
     versionSeen = false;
 }
 
+//
+// Preamble snapshots.  A predefined (system preamble) macro changed by the
+// custom preamble makes the snapshot unusable, because snapshots are applied
+// before the system preamble is processed.
+//
+void TPpContext::recordDefine(int atom, const MacroSymbol& mac, bool existed)
+{
+    TPpSnapshot::Directive directive;
+    directive.kind = TPpSnapshot::Directive::Define;
+    directive.name = GetAtomString(atom);
+    directive.functionLike = mac.args != 0;
+    for (int a = 0; a < mac.argc; ++a)
+        directive.args.push_back(GetAtomString(mac.args[a]));
+    for (size_t t = 0; t < mac.body->tokens.size(); ++t) {
+        const TokenStream::Token& token = mac.body->tokens[t];
+        switch (token.token) {
+        case PpAtomIdentifier:
+            directive.body.push_back(std::make_pair(token.token, std::string(GetAtomString(token.atom))));
+            break;
+        case PpAtomConstString:
+        case PpAtomConstInt:
+        case PpAtomConstUint:
+        case PpAtomConstFloat:
+        case PpAtomConstDouble:
+            directive.body.push_back(std::make_pair(token.token, std::string(&mac.body->text[token.text])));
+            break;
+        default:
+            directive.body.push_back(std::make_pair(token.token, std::string()));
+            break;
+        }
+    }
+
+    if (existed && preambleSnapshot->defined.find(directive.name) == preambleSnapshot->defined.end())
+        preambleSnapshot->replayable = false;
+    preambleSnapshot->defined.insert(directive.name);
+    preambleSnapshot->directives.push_back(directive);
+}
+
+void TPpContext::recordUndef(int atom, bool existed)
+{
+    TPpSnapshot::Directive directive;
+    directive.kind = TPpSnapshot::Directive::Undef;
+    directive.name = GetAtomString(atom);
+    directive.functionLike = false;
+
+    if (existed && preambleSnapshot->defined.find(directive.name) == preambleSnapshot->defined.end())
+        preambleSnapshot->replayable = false;
+    preambleSnapshot->directives.push_back(directive);
+}
+
+void TPpContext::recordExtension(int line, const char* extension, const char* behavior)
+{
+    TPpSnapshot::Directive directive;
+    directive.kind = TPpSnapshot::Directive::Extension;
+    directive.name = extension;
+    directive.functionLike = false;
+    directive.behavior = behavior;
+    directive.line = line;
+    preambleSnapshot->directives.push_back(directive);
+}
+
+void TPpContext::getMacroLookups(std::unordered_set<std::string>& names)
+{
+    for (std::unordered_set<int>::const_iterator atom = lookedUpAtoms.begin(); atom != lookedUpAtoms.end(); ++atom)
+        names.insert(GetAtomString(*atom));
+}
+
+void TPpContext::applySnapshot(const TPpSnapshot& snapshot)
+{
+    TPpToken ppToken;
+    for (size_t d = 0; d < snapshot.directives.size(); ++d) {
+        const TPpSnapshot::Directive& directive = snapshot.directives[d];
+        switch (directive.kind) {
+        case TPpSnapshot::Directive::Define:
+        {
+            MacroSymbol mac;
+            if (directive.functionLike) {
+                mac.argc = (int)directive.args.size();
+                mac.args = (int*)mem_Alloc(pool, mac.argc * sizeof(int));
+                for (int a = 0; a < mac.argc; ++a)
+                    mac.args[a] = LookUpAddString(directive.args[a].c_str());
+            }
+            mac.body = new TokenStream;
+            for (size_t t = 0; t < directive.body.size(); ++t) {
+                strcpy(ppToken.name, directive.body[t].second.c_str());
+                RecordToken(mac.body, directive.body[t].first, &ppToken);
+            }
+
+            int atom = LookUpAddString(directive.name.c_str());
+            Symbol* symb = LookUpSymbol(atom);
+            if (! symb)
+                symb = AddSymbol(atom);
+            delete symb->mac.body;
+            symb->mac = mac;
+            break;
+        }
+        case TPpSnapshot::Directive::Undef:
+        {
+            Symbol* symb = LookUpSymbol(LookUpAddString(directive.name.c_str()));
+            if (symb)
+                symb->mac.undef = 1;
+            break;
+        }
+        case TPpSnapshot::Directive::Extension:
+        {
+            // diagnose at the directive's place in the custom preamble
+            const TSourceLoc loc = parseContext.getCurrentLoc();
+            parseContext.setCurrentString(-1);
+            parseContext.setCurrentLine(directive.line);
+            parseContext.updateExtensionBehavior(directive.line, directive.name.c_str(), directive.behavior.c_str());
+            parseContext.setCurrentString(loc.string);
+            parseContext.setCurrentLine(loc.line);
+            break;
+        }
+        }
+    }
+}
+
 } // end namespace glslang
@@ -78,7 +78,11 @@ NVIDIA HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef PPCONTEXT_H
 #define PPCONTEXT_H
 
+#include <set>
+#include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "../ParseHelper.h"
 
@@ -116,6 +120,37 @@ public:
 
 class TInputScanner;
 
+//
+// The macro definitions and #extension settings of a custom preamble, recorded
+// in order while preprocessing it once, so they can be replayed into the
+// TPpContext of later compiles (see TPreamble in ShaderLang.h).  Names are
+// spelled out, because atoms are private to each TPpContext.  This is
+// persistent memory, not pool memory, and is read-only once recorded.
+//
+class TPpSnapshot {
+public:
+    struct Directive {
+        enum TKind { Define, Undef, Extension };
+        TKind kind;
+        std::string name;                 // of the macro or extension
+        bool functionLike;                // Define: has a parameter list, even if empty
+        std::vector<std::string> args;    // Define: parameter names
+        std::vector<std::pair<int, std::string> > body; // Define: token and spelling
+        std::string behavior;             // Extension
+        int line;                         // Extension
+    };
+
+    TPpSnapshot() : version(0), profile(ENoProfile), replayable(true) { }
+
+    int version;
+    EProfile profile;
+    std::vector<Directive> directives;
+
+    // Only used while recording
+    bool replayable;                 // false if a predefined macro was changed
+    std::set<std::string> defined;   // macros the preamble itself defined
+};
+
 // This class is the result of turning a huge pile of C code communicating through globals
 // into a class.  This was done to allowing instancing to attain thread safety.
 // Don't expect too much in terms of OO design.
@@ -126,6 +161,24 @@ public:
 
     void setPreamble(const char* preamble, size_t length);
 
+    // Process-wide table of the atoms every context starts with.
+    static void fillInFixedAtoms();
+    static void deleteFixedAtoms();
+
+    // Record the custom preamble's directives into 'snapshot' while processing.
+    void recordPreamble(TPpSnapshot* snapshot) { preambleSnapshot = snapshot; }
+    // Act on the directives of a recorded preamble, as if processing its text.
+    void applySnapshot(const TPpSnapshot&);
+
+    // Note the names of all macros, defined or not, looked up while processing
+    // the shader strings, which are what the preamble can affect.  Call
+    // getMacroLookups() when done.
+    void recordMacroLookups() { recordingLookups = true; }
+    void getMacroLookups(std::unordered_set<std::string>& names);
+
+    // Count the tokens made and the macros expanded in 'stats', if not null.
+    void setCounterStats(ShCounterStats* stats) { counterStats = stats; }
+
     const char* tokenize(TPpToken* ppToken);
 
     class tInput {
@@ -137,6 +190,11 @@ public:
         virtual int getch() = 0;
         virtual void ungetch() = 0;
 
+        // For skipping an inactive #if region: consume whole lines up to the
+        // next one starting with '#', if that can be done faster than scanning
+        // their tokens.  Inputs that can't just leave their tokens to be scanned.
+        virtual void skipToDirective() { }
+
         // Will be called when we start reading tokens from this instance
         virtual void notifyActivated() {}
         // Will be called when we do not read tokens from this instance anymore
@@ -160,9 +218,20 @@ public:
         inputStack.pop_back();
     }
 
+    // A recorded sequence of tokens, e.g., a macro body or argument.  Identifiers
+    // are interned and numbers converted when recorded, so playback is a walk
+    // down 'tokens' that doesn't re-lex anything.
     struct TokenStream {
+        struct Token {
+            int token;
+            int atom;      // for identifiers
+            int ival;      // for integer constants
+            double dval;   // for floating-point constants
+            size_t text;   // offset into 'text' of the spelling, for strings and numbers
+        };
         TokenStream() : current(0) { }
-        TVector<unsigned char> data;
+        TVector<Token> tokens;
+        TVector<char> text;  // nul-terminated spellings
         size_t current;
     };
 
@@ -171,8 +240,17 @@ public:
         uintptr_t           free, end;
         size_t              chunksize;
         uintptr_t           alignmask;
+        size_t              bytesAllocated;  // statistics, for getMemoryStats():
+        int                 numChunks;       //   requested bytes and chunks malloc'ed
     };
 
+    // Adds this context's preprocessor memory pool usage to 'stats'.
+    void getMemoryStats(ShMemoryStats& stats) const
+    {
+        stats.preprocessorBytes += pool->bytesAllocated;
+        stats.preprocessorChunks += pool->numChunks;
+    }
+
     //
     // From Pp.cpp
     //
@@ -321,9 +399,6 @@ protected:
     //
     // From PpTokens.cpp
     //
-    void lAddByte(TokenStream *fTok, unsigned char fVal);
-    int lReadByte(TokenStream *pTok);
-    void lUnreadByte(TokenStream *pTok);
     void RecordToken(TokenStream* pTok, int token, TPpToken* ppToken);
     void RewindTokenStream(TokenStream *pTok);
     int ReadToken(TokenStream* pTok, TPpToken* ppToken);
@@ -358,6 +433,7 @@ protected:
     public:
         tStringInput(TPpContext* pp, TInputScanner& i) : tInput(pp), input(&i) { }
         virtual int scan(TPpToken*);
+        virtual void skipToDirective();
 
         // Scanner used to get source stream characters.
         //  - Escaped newlines are handled here, invisibly to the caller.
@@ -502,6 +578,22 @@ protected:
     void mem_FreePool(MemoryPool*);
     void *mem_Alloc(MemoryPool* p, size_t size);
     int mem_AddCleanup(MemoryPool* p, void (*fn)(void *, void*), void* arg1, void* arg2);
+
+    //
+    // From PpContext.cpp
+    //
+    TPpSnapshot* preambleSnapshot;  // non-0 while recording a preamble
+
+    // The custom preamble is string -1 (see ProcessDeferred()).
+    bool recordingPreamble(const TSourceLoc& loc) const { return preambleSnapshot != 0 && loc.string == -1; }
+    void recordDefine(int atom, const MacroSymbol&, bool existed);
+    void recordUndef(int atom, bool existed);
+    void recordExtension(int line, const char* extension, const char* behavior);
+
+    bool recordingLookups;
+    std::unordered_set<int> lookedUpAtoms;
+
+    ShCounterStats* counterStats;  // for setCounterStats()
 };
 
 } // end namespace glslang
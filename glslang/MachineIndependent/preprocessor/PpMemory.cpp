@@ -115,6 +115,8 @@ TPpContext::MemoryPool* TPpContext::mem_CreatePool(size_t chunksize, unsigned in
     pool->alignmask = (uintptr_t)(align) - 1;  
     pool->free = ((uintptr_t)(pool + 1) + pool->alignmask) & ~pool->alignmask;
     pool->end = (uintptr_t)pool + chunksize;
+    pool->bytesAllocated = 0;
+    pool->numChunks = 1;
     
     return pool;
 }
@@ -135,6 +137,7 @@ void* TPpContext::mem_Alloc(MemoryPool *pool, size_t size)
     void *rv = (void *)pool->free;
     size = (size + pool->alignmask) & ~pool->alignmask;
     if (size <= 0) size = pool->alignmask;
+    pool->bytesAllocated += size;
     pool->free += size;
     if (pool->free > pool->end || pool->free < (uintptr_t)rv) {
         size_t minreq = (size + sizeof(struct chunk) + pool->alignmask) & ~pool->alignmask;
@@ -154,6 +157,7 @@ void* TPpContext::mem_Alloc(MemoryPool *pool, size_t size)
         }
         ch->next = pool->next;
         pool->next = ch;
+        ++pool->numChunks;
         rv = (void *)(((uintptr_t)(ch+1) + pool->alignmask) & ~pool->alignmask);
     }
     return rv;
@@ -231,6 +231,16 @@ int TPpContext::lFloatConst(int len, int ch, TPpToken* ppToken)
 //
 // Scanner used to tokenize source stream.
 //
+// Runs of characters tStringInput::getch() has nothing special to do for,
+// for TInputScanner::getRun()
+inline bool IsSpaceTab(int ch) { return ch == ' ' || ch == '\t'; }
+inline bool IsIdentifierChar(int ch)
+{
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '_';
+}
+inline bool IsLineCommentChar(int ch) { return ch != '\n' && ch != '\r' && ch != '\\'; }
+inline bool IsInactiveChar(int ch) { return IsLineCommentChar(ch) && ch != '/' && ch != '"'; }
+
 int TPpContext::tStringInput::scan(TPpToken* ppToken)
 {
     char* tokenText = ppToken->name;
@@ -246,6 +256,7 @@ int TPpContext::tStringInput::scan(TPpToken* ppToken)
     for (;;) {
         while (ch == ' ' || ch == '\t') {
             ppToken->space = true;
+            input->getRun(IsSpaceTab);
             ch = pp->getChar();
         }
 
@@ -271,6 +282,7 @@ int TPpContext::tStringInput::scan(TPpToken* ppToken)
             do {
                 if (len < MaxTokenLength) {
                     tokenText[len++] = (char)ch;
+                    len += (int)input->getRun(IsIdentifierChar, tokenText + len, MaxTokenLength - len);
                     ch = pp->getChar();
                 } else {
                     if (! AlreadyComplained) {
@@ -586,6 +598,7 @@ int TPpContext::tStringInput::scan(TPpToken* ppToken)
             if (ch == '/') {
                 pp->inComment = true;
                 do {
+                    input->getRun(IsLineCommentChar);
                     ch = pp->getChar();
                 } while (ch != '\n' && ch != EndOfInput);
                 ppToken->space = true;
@@ -600,6 +613,7 @@ int TPpContext::tStringInput::scan(TPpToken* ppToken)
                             pp->parseContext.ppError(ppToken->loc, "End of input in comment", "comment", "");
                             return ch;
                         }
+                        input->getCommentRun();
                         ch = pp->getChar();
                     }
                     ch = pp->getChar();
@@ -640,6 +654,82 @@ int TPpContext::tStringInput::scan(TPpToken* ppToken)
     }
 }
 
+//
+// Skip the lines of an inactive #if region, a character at a time, up to the
+// next line whose first token is '#', which is left for scan() to read.
+// Comments are followed as scan() follows them, since they can cross lines or
+// hide a '#', as are strings, since they can hide a comment; everything else
+// is passed over without being tokenized.
+//
+void TPpContext::tStringInput::skipToDirective()
+{
+    bool lineStart = true;
+    for (;;) {
+        input->getRun(lineStart ? IsSpaceTab : IsInactiveChar);
+        int ch = getch();
+        switch (ch) {
+        case EndOfInput:
+            return;
+        case '\n':
+            lineStart = true;
+            break;
+        case ' ':
+        case '\t':
+            break;
+        case '#':
+            if (lineStart) {
+                ungetch();
+                return;
+            }
+            break;
+        case '/':
+            ch = getch();
+            if (ch == '/') {
+                pp->inComment = true;
+                do {
+                    input->getRun(IsLineCommentChar);
+                    ch = getch();
+                } while (ch != '\n' && ch != EndOfInput);
+                pp->inComment = false;
+                if (ch == EndOfInput)
+                    return;
+                lineStart = true;
+            } else if (ch == '*') {
+                // like whitespace, leaves lineStart as it was
+                TSourceLoc loc = pp->parseContext.getCurrentLoc();
+                ch = getch();
+                do {
+                    while (ch != '*' && ch != EndOfInput) {
+                        input->getCommentRun();
+                        ch = getch();
+                    }
+                    if (ch != EndOfInput)
+                        ch = getch();
+                    if (ch == EndOfInput) {
+                        pp->parseContext.ppError(loc, "End of input in comment", "comment", "");
+                        return;
+                    }
+                } while (ch != '/');
+            } else {
+                ungetch();
+                lineStart = false;
+            }
+            break;
+        case '"':
+            do
+                ch = getch();
+            while (ch != '"' && ch != '\n' && ch != EndOfInput);
+            if (ch == EndOfInput)
+                return;
+            lineStart = ch == '\n';
+            break;
+        default:
+            lineStart = false;
+            break;
+        }
+    }
+}
+
 //
 // The main functional entry-point into the preprocessor, which will
 // scan the source strings to figure out and return the next processing token.
@@ -703,6 +793,8 @@ const char* TPpContext::tokenize(TPpToken* ppToken)
         if (tokenString) {
             if (tokenString[0] != 0)
                 parseContext.tokensBeforeEOF = 1;
+            if (counterStats)
+                ++counterStats->tokens;
 
             return tokenString;
         }
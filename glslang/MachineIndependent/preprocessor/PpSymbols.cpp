@@ -125,6 +125,10 @@ TPpContext::Symbol* TPpContext::AddSymbol(int atom)
 
 TPpContext::Symbol* TPpContext::LookUpSymbol(int atom)
 {
+    // the preambles are the negative strings
+    if (recordingLookups && parseContext.getCurrentLoc().string >= 0)
+        lookedUpAtoms.insert(atom);
+
     TSymbolMap::iterator it = symbols.find(atom);
     if (it == symbols.end())
         return nullptr;
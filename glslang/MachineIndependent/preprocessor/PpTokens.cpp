@@ -96,63 +96,58 @@ NVIDIA HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace glslang {
 
-void TPpContext::lAddByte(TokenStream *fTok, unsigned char fVal)
-{
-    fTok->data.push_back(fVal);
-}
-
-/*
-* Get the next byte from a stream.
-*/
-int TPpContext::lReadByte(TokenStream *pTok)
-{
-    if (pTok->current < pTok->data.size())
-        return pTok->data[pTok->current++];
-    else
-        return EndOfInput;
-}
-
-void TPpContext::lUnreadByte(TokenStream *pTok)
-{
-    if (pTok->current > 0)
-        --pTok->current;
-}
-
 /*
 * Add a token to the end of a list for later playback.
 */
 void TPpContext::RecordToken(TokenStream *pTok, int token, TPpToken* ppToken)
 {
-    const char* s;
-    char* str = NULL;
-
-    if (token > PpAtomMaxSingle)
-        lAddByte(pTok, (unsigned char)((token & 0x7f) + 0x80));
-    else
-        lAddByte(pTok, (unsigned char)(token & 0x7f));
+    TokenStream::Token recorded;
+    recorded.token = token;
+    recorded.atom = 0;
+    recorded.ival = 0;
+    recorded.dval = 0.0;
+    recorded.text = 0;
 
     switch (token) {
     case PpAtomIdentifier:
-    case PpAtomConstString:
-        s = ppToken->name;
-        while (*s)
-            lAddByte(pTok, (unsigned char) *s++);
-        lAddByte(pTok, 0);
+        recorded.atom = LookUpAddString(ppToken->name);
         break;
+    case PpAtomConstString:
     case PpAtomConstInt:
     case PpAtomConstUint:
     case PpAtomConstFloat:
     case PpAtomConstDouble:
-        str = ppToken->name;
-        while (*str) {
-            lAddByte(pTok, (unsigned char) *str);
-            str++;
+    {
+        const char* tokenText = ppToken->name;
+        size_t len = strlen(tokenText);
+        recorded.text = pTok->text.size();
+        pTok->text.insert(pTok->text.end(), tokenText, tokenText + len + 1);
+
+        switch (token) {
+        case PpAtomConstFloat:
+        case PpAtomConstDouble:
+            recorded.dval = atof(tokenText);
+            break;
+        case PpAtomConstInt:
+        case PpAtomConstUint:
+            if (len > 0 && tokenText[0] == '0') {
+                if (len > 1 && (tokenText[1] == 'x' || tokenText[1] == 'X'))
+                    recorded.ival = strtol(tokenText, 0, 16);
+                else
+                    recorded.ival = strtol(tokenText, 0, 8);
+            } else
+                recorded.ival = atoi(tokenText);
+            break;
+        default:
+            break;
         }
-        lAddByte(pTok, 0);
         break;
+    }
     default:
         break;
     }
+
+    pTok->tokens.push_back(recorded);
 }
 
 /*
@@ -168,71 +163,44 @@ void TPpContext::RewindTokenStream(TokenStream *pTok)
 */
 int TPpContext::ReadToken(TokenStream *pTok, TPpToken *ppToken)
 {
-    char* tokenText = ppToken->name;
-    int ltoken, len;
-    int ch;
-
-    ltoken = lReadByte(pTok);
     ppToken->loc = parseContext.getCurrentLoc();
-    if (ltoken > 127)
-        ltoken += 128;
-    switch (ltoken) {
-    case '#':        
-        if (lReadByte(pTok) == '#') {
+    if (pTok->current >= pTok->tokens.size())
+        return EndOfInput;
+
+    const TokenStream::Token& recorded = pTok->tokens[pTok->current++];
+    switch (recorded.token) {
+    case '#':
+        if (pTok->current < pTok->tokens.size() && pTok->tokens[pTok->current].token == '#') {
+            ++pTok->current;
             parseContext.requireProfile(ppToken->loc, ~EEsProfile, "token pasting (##)");
             parseContext.profileRequires(ppToken->loc, ~EEsProfile, 130, 0, "token pasting (##)");
             parseContext.error(ppToken->loc, "token pasting not implemented (internal error)", "##", "");
             //return PpAtomPaste;
             return ReadToken(pTok, ppToken);
-        } else
-            lUnreadByte(pTok);
+        }
         break;
-    case PpAtomConstString:
     case PpAtomIdentifier:
+        strcpy(ppToken->name, GetAtomString(recorded.atom));
+        ppToken->atom = recorded.atom;
+        break;
+    case PpAtomConstString:
+        strcpy(ppToken->name, &pTok->text[recorded.text]);
+        break;
     case PpAtomConstFloat:
     case PpAtomConstDouble:
+        strcpy(ppToken->name, &pTok->text[recorded.text]);
+        ppToken->dval = recorded.dval;
+        break;
     case PpAtomConstInt:
     case PpAtomConstUint:
-        len = 0;
-        ch = lReadByte(pTok);
-        while (ch != 0) {
-            if (len < MaxTokenLength) {
-                tokenText[len] = (char)ch;
-                len++;
-                ch = lReadByte(pTok);
-            } else {
-                parseContext.error(ppToken->loc, "token too long", "", "");
-                break;
-            }
-        }
-        tokenText[len] = 0;
-
-        switch (ltoken) {
-        case PpAtomIdentifier:
-            ppToken->atom = LookUpAddString(tokenText);
-            break;
-        case PpAtomConstString:
-            break;
-        case PpAtomConstFloat:
-        case PpAtomConstDouble:
-            strcpy(ppToken->name, tokenText);
-            ppToken->dval = atof(ppToken->name);
-            break;
-        case PpAtomConstInt:
-        case PpAtomConstUint:
-            strcpy(ppToken->name, tokenText);
-            if (len > 0 && tokenText[0] == '0') {
-                if (len > 1 && (tokenText[1] == 'x' || tokenText[1] == 'X'))
-                    ppToken->ival = strtol(ppToken->name, 0, 16);
-                else
-                    ppToken->ival = strtol(ppToken->name, 0, 8);
-            } else
-                ppToken->ival = atoi(ppToken->name);
-            break;
-        }
+        strcpy(ppToken->name, &pTok->text[recorded.text]);
+        ppToken->ival = recorded.ival;
+        break;
+    default:
+        break;
     }
 
-    return ltoken;
+    return recorded.token;
 }
 
 int TPpContext::tTokenInput::scan(TPpToken* ppToken)
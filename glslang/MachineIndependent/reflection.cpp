@@ -33,6 +33,8 @@
 //POSSIBILITY OF SUCH DAMAGE.
 //
 
+#include <string.h>
+
 #include "../Include/Common.h"
 #include "reflection.h"
 #include "localintermediate.h"
@@ -44,7 +46,8 @@
 // collection of functions to do a liveness traversal that note what uniforms are used
 // in semantically non-dead code.
 //
-// Can be used multiple times, once per stage, to grow a program reflection.
+// Can be used multiple times, once per stage, to grow a program reflection.  Each stage
+// is traversed into a database of its own, then merged in.
 //
 // High-level algorithm for one stage:
 //
@@ -87,11 +90,9 @@ public:
     // and only visit each function once.
     void addFunctionCall(TIntermAggregate* call)
     {
-        // just use the map to ensure we process each function at most once
-        if (reflection.nameToIndex.find(call->getName()) == reflection.nameToIndex.end()) {
-            reflection.nameToIndex[call->getName()] = -1;
+        // just use the set to ensure we process each function at most once
+        if (liveFunctions.insert(call->getName()).second)
             pushFunction(call->getName());
-        }
     }
 
     // Add a simple reference to a uniform variable to the uniform database, no dereference involved.
@@ -120,16 +121,21 @@ public:
         if (memberList[index].type->getQualifier().hasOffset())
             return memberList[index].type->getQualifier().layoutOffset;
 
-        int memberSize;
-        int offset = 0;
-        for (int m = 0; m <= index; ++m) {
-            int memberAlignment = intermediate.getBaseAlignment(*memberList[m].type, memberSize, type.getQualifier().layoutPacking == ElpStd140);
-            RoundToPow2(offset, memberAlignment);
-            if (m < index)
+        // the offsets of all the members are worked out together, the first time one is needed
+        const bool std140 = type.getQualifier().layoutPacking == ElpStd140;
+        std::vector<int>& offsets = memberOffsets[std::make_pair(&memberList, std140)];
+        if (offsets.empty()) {
+            int memberSize;
+            int offset = 0;
+            for (size_t m = 0; m < memberList.size(); ++m) {
+                int memberAlignment = intermediate.getBaseAlignment(*memberList[m].type, memberSize, std140);
+                RoundToPow2(offset, memberAlignment);
+                offsets.push_back(offset);
                 offset += memberSize;
+            }
         }
 
-        return offset;
+        return offsets[index];
     }
 
     // Calculate the block data size.
@@ -233,6 +239,7 @@ public:
         TReflection::TNameToIndex::const_iterator it = reflection.nameToIndex.find(name);
         if (it == reflection.nameToIndex.end()) {
             reflection.nameToIndex[name] = (int)reflection.indexToUniform.size();
+            reflection.additions.push_back((int)reflection.indexToUniform.size());
             reflection.indexToUniform.push_back(TObjectReflection(name, offset, mapToGlType(*terminalType), arraySize, blockIndex));
         } else if (arraySize > 1) {
             int& reflectedArraySize = reflection.indexToUniform[it->second].size;
@@ -329,6 +336,7 @@ public:
         if (reflection.nameToIndex.find(name) == reflection.nameToIndex.end()) {
             blockIndex = (int)reflection.indexToUniformBlock.size();
             reflection.nameToIndex[name] = blockIndex;
+            reflection.additions.push_back(-1 - blockIndex);
             reflection.indexToUniformBlock.push_back(TObjectReflection(name, -1, -1, size, -1));
         } else
             blockIndex = it->second;
@@ -618,6 +626,8 @@ public:
     const TIntermediate& intermediate;
     TReflection& reflection;
     std::set<const TIntermNode*> processedDerefs;
+    std::map<std::pair<const TTypeList*, bool>, std::vector<int> > memberOffsets;  // computed by getOffset()
+    std::unordered_set<TString> liveFunctions;
 
 protected:
     TLiveTraverser(TLiveTraverser&);
@@ -688,13 +698,32 @@ bool TLiveTraverser::visitSelection(TVisit /* visit */,  TIntermSelection* node)
 // Returns false if the input is too malformed to do this.
 bool TReflection::addStage(EShLanguage, const TIntermediate& intermediate)
 {
-    if (intermediate.getNumMains() != 1 || intermediate.isRecursive())
+    TReflection stageReflection;
+    if (! stageReflection.collectStage(intermediate))
+        return false;
+
+    merge(stageReflection);
+
+    return true;
+}
+
+// Fill an empty reflection database with the live symbols of just 'intermediate'.
+//
+// Returns false if the input is too malformed to do this.
+bool TReflection::collectStage(const TIntermediate& intermediate)
+{
+    const std::vector<std::string>& entryPoints = intermediate.getEntryPoints();
+    if (intermediate.getNumMains() != (int)entryPoints.size() || intermediate.isRecursive())
         return false;
 
     TLiveTraverser it(intermediate, *this);
 
-    // put main() on functions to process
-    it.pushFunction("main(");
+    // put main(), or each of the entry points, on functions to process
+    for (size_t e = 0; e < entryPoints.size(); ++e) {
+        TString name = TString(entryPoints[e].c_str()) + "(";
+        if (it.liveFunctions.insert(name).second)
+            it.pushFunction(name);
+    }
 
     // process all the functions
     while (! it.functions.empty()) {
@@ -706,6 +735,72 @@ bool TReflection::addStage(EShLanguage, const TIntermediate& intermediate)
     return true;
 }
 
+// Merge a database made by collectStage() into this one, giving the same indexes,
+// block indexes, and array sizes as if its stage had been traversed directly into this one.
+//
+// The stage may have been collected on another thread, so its names are copied out of
+// that thread's pool rather than shared.
+void TReflection::merge(const TReflection& stage)
+{
+    std::vector<int> blockIndexes(stage.indexToUniformBlock.size(), -1); // stage's block indexes to ours
+
+    for (size_t a = 0; a < stage.additions.size(); ++a) {
+        if (stage.additions[a] < 0) {
+            int stageIndex = -1 - stage.additions[a];
+            const TObjectReflection& block = stage.indexToUniformBlock[stageIndex];
+            TString name(block.name.c_str());
+            TNameToIndex::const_iterator it = nameToIndex.find(name);
+            if (it == nameToIndex.end()) {
+                blockIndexes[stageIndex] = (int)indexToUniformBlock.size();
+                nameToIndex[name] = blockIndexes[stageIndex];
+                additions.push_back(-1 - blockIndexes[stageIndex]);
+                indexToUniformBlock.push_back(TObjectReflection(name, block.offset, block.glDefineType, block.size, block.index));
+            } else
+                blockIndexes[stageIndex] = it->second;
+        } else {
+            const TObjectReflection& uniform = stage.indexToUniform[stage.additions[a]];
+            TString name(uniform.name.c_str());
+            TNameToIndex::const_iterator it = nameToIndex.find(name);
+            if (it == nameToIndex.end()) {
+                int blockIndex = uniform.index >= 0 ? blockIndexes[uniform.index] : uniform.index;
+                nameToIndex[name] = (int)indexToUniform.size();
+                additions.push_back((int)indexToUniform.size());
+                indexToUniform.push_back(TObjectReflection(name, uniform.offset, uniform.glDefineType, uniform.size, blockIndex));
+            } else if (uniform.size > 1) {
+                int& reflectedArraySize = indexToUniform[it->second].size;
+                reflectedArraySize = std::max(uniform.size, reflectedArraySize);
+            }
+        }
+    }
+}
+
+// Copy a list out into columns, sizing every column once.
+void TReflection::getTable(const TMapIndexToReflection& list, TReflectionTable& table)
+{
+    size_t nameBytes = 0;
+    for (size_t i = 0; i < list.size(); ++i)
+        nameBytes += list[i].name.size() + 1;
+
+    table.names.resize(nameBytes);
+    table.nameOffsets.resize(list.size());
+    table.types.resize(list.size());
+    table.offsets.resize(list.size());
+    table.sizes.resize(list.size());
+    table.blockIndexes.resize(list.size());
+
+    size_t nameOffset = 0;
+    for (size_t i = 0; i < list.size(); ++i) {
+        const TObjectReflection& object = list[i];
+        memcpy(&table.names[nameOffset], object.name.c_str(), object.name.size() + 1);
+        table.nameOffsets[i] = (int)nameOffset;
+        nameOffset += object.name.size() + 1;
+        table.types[i] = object.glDefineType;
+        table.offsets[i] = object.offset;
+        table.sizes[i] = object.size;
+        table.blockIndexes[i] = object.index;
+    }
+}
+
 void TReflection::dump()
 {
     printf("Uniform reflection:\n");
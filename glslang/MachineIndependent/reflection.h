@@ -37,6 +37,7 @@
 #define _REFLECTION_INCLUDED
 
 #include "../Public/ShaderLang.h"
+#include "../Include/Common.h"
 
 #include <list>
 #include <set>
@@ -73,6 +74,12 @@ public:
     // grow the reflection stage by stage
     bool addStage(EShLanguage, const TIntermediate&);
 
+    // addStage() in two steps: fill an empty database from just one stage, which needs
+    // nothing from the other stages and so can be done concurrently with them, then merge
+    // those into this one in stage order
+    bool collectStage(const TIntermediate&);
+    void merge(const TReflection& stage);
+
     // for mapping a uniform index to a uniform object's description
     int getNumUniforms() { return (int)indexToUniform.size(); }
     const TObjectReflection& getUniform(int i) const
@@ -103,19 +110,25 @@ public:
             return it->second;
     }
 
+    // fill in flat copies of the whole lists above
+    void getUniformTable(TReflectionTable& table) const { getTable(indexToUniform, table); }
+    void getUniformBlockTable(TReflectionTable& table) const { getTable(indexToUniformBlock, table); }
+
     void dump();
 
 protected:
     friend class glslang::TLiveTraverser;
 
-    // Need a TString hash: typedef std::unordered_map<TString, int> TNameToIndex;
-    typedef std::map<TString, int> TNameToIndex;
+    typedef std::unordered_map<TString, int> TNameToIndex;
     typedef std::vector<TObjectReflection> TMapIndexToReflection;
 
+    static void getTable(const TMapIndexToReflection&, TReflectionTable&);
+
     TObjectReflection badReflection; // return for queries of -1 or generally out of range; has expected descriptions with in it for this
-    TNameToIndex nameToIndex;        // maps names to indexes; can hold all types of data: uniform/buffer and which function names have been processed
+    TNameToIndex nameToIndex;        // maps names to indexes; can hold all types of data: uniform/buffer
     TMapIndexToReflection indexToUniform;
     TMapIndexToReflection indexToUniformBlock;
+    std::vector<int> additions;      // order names were added, for merge(): uniform i as i, uniform block b as -1 - b
 };
 
 } // end namespace glslang
@@ -38,6 +38,21 @@
 #include "osinclude.h"
 #include "../../../OGLCompilersDLL/InitializeDll.h"
 
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+// glslang's own unistd.h shadows the system one, which declares these
+extern "C" {
+    int dup(int);
+    int dup2(int, int);
+    int close(int);
+}
+
 namespace glslang {
 
 //
@@ -141,26 +156,251 @@ bool OS_FreeTLSIndex(OS_TLSIndex nIndex)
 		return false;
 }
 
-// TODO: non-windows: if we need these on linux, flesh them out
-void InitGlobalLock() { }
-void GetGlobalLock() { }
-void ReleaseGlobalLock() { }
+namespace {
+    pthread_mutex_t gMutex;
+}
+
+void InitGlobalLock()
+{
+    // recursive, to match the semantics of the Windows mutex
+    pthread_mutexattr_t mutexattr;
+    pthread_mutexattr_init(&mutexattr);
+    pthread_mutexattr_settype(&mutexattr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&gMutex, &mutexattr);
+    pthread_mutexattr_destroy(&mutexattr);
+}
+
+void GetGlobalLock()
+{
+    pthread_mutex_lock(&gMutex);
+}
+
+void ReleaseGlobalLock()
+{
+    pthread_mutex_unlock(&gMutex);
+}
+
+//
+// pthreads want a void* (*)(void*) entry point, so adapt the
+// TThreadEntrypoint through a small heap-allocated trampoline.
+//
+namespace {
+    struct TThreadStart {
+        TThreadEntrypoint entry;
+    };
+
+    void* EnterThread(void* arg)
+    {
+        TThreadStart* start = static_cast<TThreadStart*>(arg);
+        TThreadEntrypoint entry = start->entry;
+        delete start;
+        entry(0);
+
+        return 0;
+    }
+}
 
 void* OS_CreateThread(TThreadEntrypoint entry)
 {
-    return 0;
+    TThreadStart* start = new TThreadStart;
+    start->entry = entry;
+
+    pthread_t thread;
+    if (pthread_create(&thread, 0, EnterThread, start) != 0) {
+        delete start;
+        return 0;
+    }
+
+    return reinterpret_cast<void*>(thread);
 }
 
 void OS_WaitForAllThreads(void* threads, int numThreads)
 {
+    for (int t = 0; t < numThreads; ++t)
+        pthread_join(reinterpret_cast<pthread_t>(static_cast<void**>(threads)[t]), 0);
 }
 
 void OS_Sleep(int milliseconds)
 {
+    timespec duration;
+    duration.tv_sec = milliseconds / 1000;
+    duration.tv_nsec = (milliseconds % 1000) * 1000000;
+    nanosleep(&duration, 0);
 }
 
 void OS_DumpMemoryCounters()
 {
 }
 
+size_t OS_GetPeakMemory()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss;
+#else
+    // kilobytes everywhere else
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+#ifdef __linux__
+
+// Read a sysfs list like "0-3,8-11" into 'list'; false if the file can't be read.
+static bool ReadSysList(const char* fileName, std::vector<int>& list)
+{
+    FILE* file = fopen(fileName, "r");
+    if (file == 0)
+        return false;
+
+    int first;
+    while (fscanf(file, "%d", &first) == 1) {
+        int last = first;
+        int ch = fgetc(file);
+        if (ch == '-') {
+            if (fscanf(file, "%d", &last) != 1)
+                break;
+            ch = fgetc(file);
+        }
+        for (int n = first; n <= last; ++n)
+            list.push_back(n);
+        if (ch != ',')
+            break;
+    }
+    fclose(file);
+
+    return true;
+}
+
+// The processors of each online node that has any, in node order.
+static const std::vector<std::vector<int> >& GetNumaNodeCpus()
+{
+    static const std::vector<std::vector<int> > nodeCpus = []() {
+        std::vector<std::vector<int> > cpus;
+        std::vector<int> nodes;
+        if (ReadSysList("/sys/devices/system/node/online", nodes)) {
+            for (size_t n = 0; n < nodes.size(); ++n) {
+                char fileName[64];
+                snprintf(fileName, sizeof(fileName), "/sys/devices/system/node/node%d/cpulist", nodes[n]);
+                std::vector<int> list;
+                if (ReadSysList(fileName, list) && ! list.empty())
+                    cpus.push_back(list);
+            }
+        }
+        return cpus;
+    }();
+
+    return nodeCpus;
+}
+
+int OS_GetNumaNodeCount()
+{
+    int count = (int)GetNumaNodeCpus().size();
+
+    return count > 0 ? count : 1;
+}
+
+bool OS_SetThreadNumaNode(int node)
+{
+    const std::vector<std::vector<int> >& nodeCpus = GetNumaNodeCpus();
+    if (node < 0 || node >= (int)nodeCpus.size())
+        return false;
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (size_t c = 0; c < nodeCpus[node].size(); ++c) {
+        if (nodeCpus[node][c] < CPU_SETSIZE)
+            CPU_SET(nodeCpus[node][c], &cpus);
+    }
+
+    return sched_setaffinity(0, sizeof(cpus), &cpus) == 0;
+}
+
+#else
+
+int OS_GetNumaNodeCount()
+{
+    return 1;
+}
+
+bool OS_SetThreadNumaNode(int node)
+{
+    return false;
+}
+
+#endif
+
+static char* MapFile(const char* fileName, size_t& size, bool copy)
+{
+    // stdio rather than open()/close(): glslang's own unistd.h shadows the system one
+    FILE* file = fopen(fileName, "rb");
+    if (file == 0)
+        return 0;
+
+    struct stat info;
+    if (fstat(fileno(file), &info) != 0 || ! S_ISREG(info.st_mode)) {
+        fclose(file);
+        return 0;
+    }
+
+    size = (size_t)info.st_size;
+    if (size == 0) {
+        fclose(file);
+        static char empty[1];
+        return empty;
+    }
+
+    void* data = mmap(0, size, copy ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    fclose(file);
+    if (data == MAP_FAILED)
+        return 0;
+
+    return static_cast<char*>(data);
+}
+
+const char* OS_MapFile(const char* fileName, size_t& size)
+{
+    return MapFile(fileName, size, false);
+}
+
+char* OS_MapFileCopy(const char* fileName, size_t& size)
+{
+    return MapFile(fileName, size, true);
+}
+
+bool OS_SameFile(const char* fileName1, const char* fileName2)
+{
+    struct stat info1;
+    struct stat info2;
+
+    return stat(fileName1, &info1) == 0 && stat(fileName2, &info2) == 0 &&
+           info1.st_dev == info2.st_dev && info1.st_ino == info2.st_ino;
+}
+
+void OS_UnmapFile(const char* data, size_t size)
+{
+    if (size > 0)
+        munmap(const_cast<char*>(data), size);
+}
+
+FILE* OS_TakeStdout()
+{
+    fflush(stdout);
+    int out = dup(fileno(stdout));
+    if (out < 0)
+        return 0;
+    FILE* stream = fdopen(out, "wb");
+    if (stream == 0 || dup2(fileno(stderr), fileno(stdout)) < 0) {
+        if (stream)
+            fclose(stream);
+        else
+            close(out);
+        return 0;
+    }
+
+    return stream;
+}
+
 } // end namespace glslang
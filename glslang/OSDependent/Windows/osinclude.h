@@ -44,6 +44,9 @@
 #error Trying to include a windows specific file in a non windows build.
 #endif
 
+#include <stddef.h>
+#include <stdio.h>
+
 namespace glslang {
 
 //
@@ -70,6 +73,33 @@ void OS_Sleep(int milliseconds);
 
 void OS_DumpMemoryCounters();
 
+// The most memory the process has had resident, in bytes, or 0 if unknown.
+size_t OS_GetPeakMemory();
+
+// The NUMA nodes that have processors: how many there are (1 if the machine
+// isn't NUMA, or that can't be told), and pinning the calling thread to the
+// processors of one of them, numbered from 0 up to that count, so the memory
+// it first touches is that node's.  Returns false if the thread can't be pinned.
+int OS_GetNumaNodeCount();
+bool OS_SetThreadNumaNode(int node);
+
+// Read-only view of a whole file, or 0 if it can't be opened.  An empty file
+// gives a non-null pointer and a size of 0.  The view is not null terminated.
+const char* OS_MapFile(const char* fileName, size_t& size);
+void OS_UnmapFile(const char* data, size_t size);
+
+// As OS_MapFile(), but writable: writes go to the process's own copies of the
+// pages they touch, never to the file.  Unmap it with OS_UnmapFile().
+char* OS_MapFileCopy(const char* fileName, size_t& size);
+
+// Whether the two names are of the same existing file.
+bool OS_SameFile(const char* fileName1, const char* fileName2);
+
+// A binary stream onto the process's standard output, which from then on gets
+// nothing else: what's written to stdout goes to stderr instead.  Also puts
+// stdin in binary mode.  Returns 0 if it can't be done.
+FILE* OS_TakeStdout();
+
 } // end namespace glslang
 
 #endif // __OSINCLUDE_H
@@ -38,6 +38,8 @@
 #define VC_EXTRALEAN 1
 #include <windows.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <io.h>
 #include <process.h>
 #include <psapi.h>
 #include <stdio.h>
@@ -143,4 +145,131 @@ void OS_DumpMemoryCounters()
 #endif
 }
 
+size_t OS_GetPeakMemory()
+{
+    PROCESS_MEMORY_COUNTERS counters;
+    if (! GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+
+    return counters.PeakWorkingSetSize;
+}
+
+int OS_GetNumaNodeCount()
+{
+    ULONG highest;
+    if (! GetNumaHighestNodeNumber(&highest))
+        return 1;
+
+    int count = 0;
+    for (ULONG node = 0; node <= highest; ++node) {
+        ULONGLONG mask;
+        if (GetNumaNodeProcessorMask((UCHAR)node, &mask) && mask != 0)
+            ++count;
+    }
+
+    return count > 0 ? count : 1;
+}
+
+bool OS_SetThreadNumaNode(int node)
+{
+    ULONG highest;
+    if (node < 0 || ! GetNumaHighestNodeNumber(&highest))
+        return false;
+
+    // the node'th of those with processors (in the calling thread's processor group)
+    for (ULONG n = 0; n <= highest; ++n) {
+        ULONGLONG mask;
+        if (GetNumaNodeProcessorMask((UCHAR)n, &mask) && mask != 0 && node-- == 0)
+            return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)mask) != 0;
+    }
+
+    return false;
+}
+
+static char* MapFile(const char* fileName, size_t& size, bool copy)
+{
+    HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (file == INVALID_HANDLE_VALUE)
+        return 0;
+
+    LARGE_INTEGER fileSize;
+    if (! GetFileSizeEx(file, &fileSize)) {
+        CloseHandle(file);
+        return 0;
+    }
+
+    size = (size_t)fileSize.QuadPart;
+    if (size == 0) {
+        CloseHandle(file);
+        static char empty[1];
+        return empty;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, 0, copy ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, 0);
+    CloseHandle(file);
+    if (mapping == 0)
+        return 0;
+
+    // the view keeps the mapping alive
+    void* data = MapViewOfFile(mapping, copy ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+
+    return static_cast<char*>(data);
+}
+
+const char* OS_MapFile(const char* fileName, size_t& size)
+{
+    return MapFile(fileName, size, false);
+}
+
+char* OS_MapFileCopy(const char* fileName, size_t& size)
+{
+    return MapFile(fileName, size, true);
+}
+
+bool OS_SameFile(const char* fileName1, const char* fileName2)
+{
+    BY_HANDLE_FILE_INFORMATION info[2];
+    const char* names[2] = { fileName1, fileName2 };
+    for (int f = 0; f < 2; ++f) {
+        HANDLE file = CreateFileA(names[f], 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0,
+                                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        const bool got = GetFileInformationByHandle(file, &info[f]) != 0;
+        CloseHandle(file);
+        if (! got)
+            return false;
+    }
+
+    return info[0].dwVolumeSerialNumber == info[1].dwVolumeSerialNumber &&
+           info[0].nFileIndexHigh == info[1].nFileIndexHigh &&
+           info[0].nFileIndexLow == info[1].nFileIndexLow;
+}
+
+void OS_UnmapFile(const char* data, size_t size)
+{
+    if (size > 0)
+        UnmapViewOfFile(data);
+}
+
+FILE* OS_TakeStdout()
+{
+    fflush(stdout);
+    _setmode(_fileno(stdin), _O_BINARY);
+    int out = _dup(_fileno(stdout));
+    if (out < 0)
+        return 0;
+    FILE* stream = _fdopen(out, "wb");
+    if (stream == 0 || _dup2(_fileno(stderr), _fileno(stdout)) < 0) {
+        if (stream)
+            fclose(stream);
+        else
+            _close(out);
+        return 0;
+    }
+
+    return stream;
+}
+
 } // namespace glslang
@@ -37,6 +37,8 @@
 #include "../Include/ResourceLimits.h"
 #include "../MachineIndependent/Versions.h"
 
+#include <stddef.h>
+
 #ifdef _WIN32
 #define C_DECL __cdecl
 //#ifdef SH_EXPORTING
@@ -132,8 +134,24 @@ enum EShMessages {
     EShMsgSpvRules         = (1 << 3),  // issue messages for SPIR-V generation
     EShMsgVulkanRules      = (1 << 4),  // issue messages for Vulkan-requirements of GLSL for SPIR-V
     EShMsgOnlyPreprocessor = (1 << 5),  // only print out errors produced by the preprocessor
+    EShMsgTiming           = (1 << 6),  // record the time spent in each phase (see ShTimingStats)
+    EShMsgLibrary          = (1 << 7),  // link a library: main() is optional, and SPIR-V exports and imports functions
+    EShMsgTrimInterface    = (1 << 8),  // link: make outputs the next stage doesn't read private, removing their stores
+    EShMsgInline           = (1 << 9),  // link: inline small functions, and fold the constants that propagates
+    EShMsgCounters         = (1 << 10), // count the work of the compiler's inner loops (see ShCounterStats)
 };
 
+//
+// Severity of a diagnostic given to a TDiagnosticCallback.
+//
+typedef enum {
+    EShSeverityWarning,
+    EShSeverityError,
+    EShSeverityInternalError,
+    EShSeverityUnimplemented,
+    EShSeverityNote,
+} EShSeverity;
+
 //
 // Build a table for bindings.  This can be used for locating
 // attributes, uniforms, globals, etc., as needed.
@@ -201,6 +219,58 @@ SH_IMPORT_EXPORT int ShLinkExt(
     const ShHandle h[],           // compiler objects to link together
     const int numHandles);
 
+//
+// Memory used by one compile or link, as seen by its allocators.
+//
+typedef struct {
+    size_t poolBytes;           // bytes requested from the pool allocator
+    size_t poolPeakBytes;       // high-water mark of pool pages held
+    int poolAllocations;        // number of pool allocation requests
+    int poolPages;              // number of pages the pool obtained
+    size_t preprocessorBytes;   // bytes requested from the preprocessor's memory pool
+    int preprocessorChunks;     // number of chunks the preprocessor's memory pool obtained
+} ShMemoryStats;
+
+//
+// Phases of a compile or link, for ShTimingStats.
+//
+typedef enum {
+    EShPhaseBuiltIns,       // setting up the built-in symbol tables for the shader
+    EShPhasePreprocess,     // preprocessing, including that done on demand while parsing
+    EShPhaseParse,          // parsing and semantic checking, excluding preprocessing
+    EShPhaseFinalCheck,     // end-of-compile linkage and post-processing of the tree
+    EShPhaseLink,           // merging compilation units and whole-stage checks
+    EShPhaseReflection,     // building the reflection database
+    EShPhaseCount,
+} EShPhase;
+
+//
+// Wall-clock seconds and pool allocations spent in each phase of a compile or
+// link, recorded when EShMsgTiming is given.  Allocations are those from the
+// compile's or link's own pool.
+//
+typedef struct {
+    double seconds[EShPhaseCount];
+    int poolAllocations[EShPhaseCount];
+} ShTimingStats;
+
+//
+// Counts of the work done by the inner loops of one compile, recorded when
+// EShMsgCounters is given, for relating a slow shader to what the compiler
+// did with it.  The SPIR-V counts are added in by GlslangToSpv(), when its
+// SpvOptions::counters is given the compile's counts.
+//
+typedef struct {
+    int tokens;                 // tokens the preprocessor gave the scanner
+    int macroExpansions;        // expansions of defined macros
+    int symbolLookups;          // TSymbolTable::find() calls
+    int symbolMisses;           // of those, the names not found
+    int overloadCandidates;     // functions tried for calls having no exact match
+    int nodes;                  // AST nodes made
+    int spvInstructions;        // SPIR-V instructions made by spv::Builder
+    int remapInstructions;      // instructions walked by the remapper, over all its passes
+} ShCounterStats;
+
 //
 // ShSetEncrpytionMethod is a place-holder for specifying
 // how source code is encrypted.
@@ -212,6 +282,9 @@ SH_IMPORT_EXPORT void ShSetEncryptionMethod(ShHandle);
 // available in the object passed down, or the object is bad.
 //
 SH_IMPORT_EXPORT const char* ShGetInfoLog(const ShHandle);
+SH_IMPORT_EXPORT int ShGetMemoryStats(const ShHandle, ShMemoryStats*);  // of the last ShCompile()
+SH_IMPORT_EXPORT int ShGetTimingStats(const ShHandle, ShTimingStats*);  // of the last ShCompile() with EShMsgTiming
+SH_IMPORT_EXPORT int ShGetCounterStats(const ShHandle, ShCounterStats*);  // of the last ShCompile() with EShMsgCounters
 SH_IMPORT_EXPORT const void* ShGetExecutable(const ShHandle);
 SH_IMPORT_EXPORT int ShSetVirtualAttributeBindings(const ShHandle, const ShBindingTable*);   // to detect user aliasing
 SH_IMPORT_EXPORT int ShSetFixedAttributeBindings(const ShHandle, const ShBindingTable*);     // to force any physical mappings
@@ -247,9 +320,17 @@ SH_IMPORT_EXPORT int ShGetUniformLocation(const ShHandle uniformMap, const char*
 // (treeRoot in TIntermediate) level, and then a full stage can be lowered.
 //
 
+#include <condition_variable>
+#include <functional>
+#include <iosfwd>
 #include <list>
+#include <map>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_set>
 #include <utility>
+#include <vector>
 
 class TCompiler;
 class TInfoSink;
@@ -262,6 +343,7 @@ const char* GetGlslVersionString();
 class TIntermediate;
 class TProgram;
 class TPoolAllocator;
+struct TSourceLoc;
 
 // Call this exactly once per process before using anything else
 bool InitializeProcess();
@@ -269,14 +351,138 @@ bool InitializeProcess();
 // Call once per process to tear down everything
 void FinalizeProcess();
 
+// Call instead of FinalizeProcess() when the process is about to exit, to skip
+// freeing the structures that live as long as the process does: the built-in
+// symbol tables, their pool, and the keyword and atom tables.  The exit
+// reclaims them all at once; until then they stay reachable from glslang's
+// globals, so leak checkers count them as in use rather than leaked.
+//
+// Nothing may be compiled after this call.
+void FinalizeProcessForExit();
+
+// Optionally call after InitializeProcess() to build the built-in symbol tables
+// of every stage for each (version, profile) pair now, instead of lazily on the
+// first compile of each stage that needs them.  The pairs are spread across up
+// to numThreads threads; 0 means one thread per hardware thread.
+//
+// Returns false if any pair is not a valid version/profile combination; the
+// valid ones are still built.
+bool InitializeBuiltIns(const std::vector<std::pair<int, EProfile> >& versionProfiles, int numThreads = 0);
+
+// Optionally read the built-in symbol tables from a snapshot file, rather than
+// parsing their built-in text at the first compile needing them, to start
+// faster.  SaveBuiltInSnapshot() builds the tables, as InitializeBuiltIns()
+// does, and writes them to the file.  It returns false if a pair isn't valid
+// (the valid ones are still written) or the file can't be written.
+//
+// LoadBuiltInSnapshot() maps such a file, for each table to be read from it
+// when first needed.  Call it at most once, after InitializeProcess() and
+// before compiling.  A table the snapshot doesn't have, or made from other
+// built-in text than this build's, is parsed as usual, as are the built-ins
+// that depend on the TBuiltInResource.  Returns false, using none of it, if the
+// file can't be mapped or isn't a snapshot in this build's format.
+bool SaveBuiltInSnapshot(const char* fileName, const std::vector<std::pair<int, EProfile> >& versionProfiles);
+bool LoadBuiltInSnapshot(const char* fileName);
+
+// Optionally keep up to 'bytes' of the memory pages released by finished
+// TShader and TProgram objects in a process-wide cache, so later compiles
+// reuse them instead of going back to the OS.  0 (the default) disables the
+// cache; lowering the size frees cached pages above it.  Threads pinned to a
+// NUMA node (see below) have a cache of up to 'bytes' for each node.
+void SetPoolPageCacheSize(size_t bytes);
+
+// NUMA sharding: the number of NUMA nodes with processors (1 when the machine
+// isn't NUMA), and pinning the calling thread to the processors of one of them,
+// numbered from 0.  A pinned thread reuses pages cached on its node, and adopts
+// a copy of the built-in symbol tables on its node, made by the first compile
+// there, instead of the one copy every other node reads across the machine.
+// SetThreadNumaNode() returns false if the thread can't be pinned.
+//
+// With SetNumaSharding(true), the threads glslang starts itself to compile on
+// (parseShaders(), TPermutations, TBatch, TAsyncCompiler) are pinned to each
+// node in turn; the calling thread is left as it is.
+int GetNumaNodeCount();
+void SetNumaSharding(bool shard);
+bool SetThreadNumaNode(int node);
+
+// Pools a caller owns, to give to TShader::setPool() and TProgram::setPool() so
+// that compiles reuse them, rather than each shader and program making and
+// freeing a pool of its own.  A pool isn't tied to a thread, but is used by one
+// compile or link at a time.
+TPoolAllocator* CreatePool(int pageSize = 8*1024);
+
+// Free everything allocated from 'pool', keeping its pages for the next use.
+// Only call once the shaders and programs that used the pool are destroyed.
+void ResetPool(TPoolAllocator* pool);
+
+void DestroyPool(TPoolAllocator* pool);
+
+class TPpSnapshot;
+
+// A custom preamble (see TShader::setPreamble()) preprocessed once, so that
+// many TShader objects, on any threads, can take its macros and #extension
+// settings without preprocessing its text again.  The text may hold only
+// preprocessor directives, and must not #pragma, #line, or change a predefined
+// macro.  The result is for one version and profile; a shader whose version
+// or profile turns out different processes the text as usual.
+//
+// build() returns false, with the reason in the info log, when the text can't
+// be preprocessed this way; shaders then fall back to using the text.  Once
+// built, the object is read-only and must outlive the shaders using it.
+class TPreamble {
+public:
+    TPreamble();
+    virtual ~TPreamble();
+    bool build(const char* text, EShLanguage, const TBuiltInResource*, int version, EProfile, EShMessages);
+
+    const char* getText() const { return text.c_str(); }
+    const char* getInfoLog() const { return infoLog.c_str(); }
+
+protected:
+    std::string text;
+    std::string infoLog;
+    TPpSnapshot* snapshot;
+
+    friend class TShader;
+
+private:
+    TPreamble(TPreamble&);
+    TPreamble& operator=(TPreamble&);
+};
+
+// Function the debug log of a shader or program, which holds the AST printed
+// for EShMsgAST, can be streamed to as it's made; see setDebugLogWriter().
+// 'text' is not nul-terminated.
+typedef void (*TLogWriter)(void* context, const char* text, size_t length);
+
+// Function the diagnostics of a shader or program can be given to, as they're
+// made, instead of being appended to its info log; see setDiagnosticCallback().
+// 'loc' (see glslang/Include/Common.h) is where the diagnostic is, with a null
+// name and line 0 for those about no location, like link errors.  'message'
+// has neither the severity nor the location in it.
+typedef void (*TDiagnosticCallback)(void* context, EShSeverity, const TSourceLoc& loc, const char* message);
+
+// Limits on the work TShader::parse() does, so that one bad shader can't take
+// unbounded time or memory; 0 means no limit.  When one is reached, the parse
+// stops, with an error saying which, and fails.
+struct TParseLimits {
+    TParseLimits() : maxErrors(0), maxTokens(0), maxNodes(0), maxPoolBytes(0) { }
+    int maxErrors;          // errors; the parse stops at this many
+    int maxTokens;          // tokens read by the parser
+    int maxNodes;           // AST nodes made
+    size_t maxPoolBytes;    // bytes the parse allocates from the shader's pool
+};
+
 // Make one TShader per shader that you will link into a program.  Then provide
 // the shader through setStrings() or setStringsWithLengths(), then call parse(),
 // then query the info logs.
 // Optionally use setPreamble() to set a special shader string that will be
-// processed before all others but won't affect the validity of #version.
+// processed before all others but won't affect the validity of #version, or
+// a TPreamble that already preprocessed such a string.
 //
-// N.B.: Does not yet support having the same TShader instance being linked into
-// multiple programs.
+// Linking doesn't change a TShader, so one parsed TShader can be linked into any
+// number of programs without parsing it again, and those programs can link
+// concurrently, each on its own thread.
 //
 // N.B.: Destruct a linked program *before* destructing the shaders linked into it.
 //
@@ -288,7 +494,32 @@ public:
     void setStringsWithLengths(const char* const* s, const int* l, int n);
     void setStringsWithLengthsAndNames(
         const char* const* s, const int* l, const char* const* names, int n);
-    void setPreamble(const char* s) { preamble = s; }
+    void setPreamble(const char* s) { preamble = s; preprocessedPreamble = nullptr; preambleRest = nullptr; }
+    void setPreamble(const TPreamble& p) { preamble = p.getText(); preprocessedPreamble = &p; preambleRest = nullptr; }
+    // The preprocessed 'p' followed by text 's', for a preamble that is mostly the same
+    // across shaders.  's' is copied.
+    void setPreamble(const TPreamble& p, const char* s);
+
+    // The functions to act as main(), which need not include it: several compute
+    // kernels in one source, say, parsed once.  Each is checked as main() would be,
+    // and each gets its own SPIR-V module (see SpvOptions::entryPoint), without
+    // the functions only the others call.  Call before parse().
+    void setEntryPoints(const char* const* names, int n);
+
+    // Optionally have parse() fill in the names of all macros, defined or not, that
+    // preprocessing the shader strings looked up.  Shaders whose preambles agree on
+    // each of these (and don't differ otherwise) get the same results.
+    void setMacroLookups(std::unordered_set<std::string>* names) { macroLookups = names; }
+
+    // Granularity, in bytes, at which the shader's memory pool grows; larger
+    // pages mean fewer OS allocations for large shaders.  Takes effect on the
+    // next parse() or preprocess().
+    void setPoolPageSize(int bytes) { poolPageSize = bytes; }
+
+    // Parse into 'pool', made by CreatePool(), rather than a pool of the shader's
+    // own; call before parse() or preprocess().  The caller keeps ownership: the
+    // pool must outlive the shader and any program it's linked into.
+    void setPool(TPoolAllocator* p) { pool = p; callerPool = p != nullptr; }
 
     // Interface to #include handlers.
     class Includer {
@@ -308,6 +539,24 @@ public:
         }
     };
 
+    // Remembers what another Includer returned for each file name, so a batch of
+    // shaders including the same headers asks for each of them only once.
+    // Failures are not remembered.  It is thread safe, so one can be shared by
+    // all the shaders of a batch; make a new one when files may have changed.
+    class CachingIncluder : public Includer {
+    public:
+        explicit CachingIncluder(const Includer& i) : includer(i) { }
+        std::pair<std::string, std::string> include(const char* filename) const override;
+
+    protected:
+        const Includer& includer;
+        mutable std::mutex cacheMutex;
+        mutable std::map<std::string, std::pair<std::string, std::string> > cache;
+
+    private:
+        CachingIncluder& operator=(CachingIncluder&);
+    };
+
     bool parse(const TBuiltInResource*, int defaultVersion, EProfile defaultProfile, bool forceDefaultVersionAndProfile,
                bool forwardCompatible, EShMessages, const Includer& = ForbidInclude());
 
@@ -319,9 +568,35 @@ public:
                     bool forwardCompatible, EShMessages message, std::string* outputString,
                     const TShader::Includer& includer);
 
+    // Same as above, but writes the preprocessed text to outputStream as it is
+    // produced instead of collecting it, e.g., to go straight to a file.  On
+    // failure, the stream may hold partial output.
+    bool preprocess(const TBuiltInResource* builtInResources,
+                    int defaultVersion, EProfile defaultProfile, bool forceDefaultVersionAndProfile,
+                    bool forwardCompatible, EShMessages message, std::ostream& outputStream,
+                    const TShader::Includer& includer);
+
     const char* getInfoLog();
     const char* getInfoDebugLog();
 
+    // Stream the debug log to 'writer' as it's made, instead of keeping it for
+    // getInfoDebugLog(), which then returns an empty string.  A large AST dump
+    // then takes no more memory than a small one.
+    void setDebugLogWriter(TLogWriter writer, void* context);
+
+    // Give each error, warning, and note to 'callback' as it's made, instead of
+    // appending it to the info log, which then keeps just the rest, like the
+    // count of errors.  With TProgram::parseShaders(), each shader's callback
+    // is called on the thread parsing it.
+    void setDiagnosticCallback(TDiagnosticCallback callback, void* context);
+
+    // Limits for the following parse() calls; see TParseLimits.
+    void setParseLimits(const TParseLimits& limits) { parseLimits = limits; }
+
+    const ShMemoryStats& getMemoryStats() const;  // of the last parse() or preprocess()
+    const ShTimingStats& getTimingStats() const;  // of the last parse() or preprocess() with EShMsgTiming
+    const ShCounterStats& getCounterStats() const;  // of the last parse() or preprocess() with EShMsgCounters
+
     EShLanguage getStage() const { return stage; }
 
 protected:
@@ -343,9 +618,18 @@ protected:
     const int* lengths;
     const char* const* stringNames;
     const char* preamble;
+    const TPreamble* preprocessedPreamble;
+    const char* preambleRest;       // what follows preprocessedPreamble, if anything
+    std::string combinedPreamble;   // preprocessedPreamble's text and preambleRest, for when it can't be used
+    std::unordered_set<std::string>* macroLookups;
     int numStrings;
+    int poolPageSize;
+    bool callerPool;                // pool was given by setPool(), so isn't the shader's to free
+    std::pair<TDiagnosticCallback, void*> diagnosticCallback;
+    TParseLimits parseLimits;
 
     friend class TProgram;
+    friend class TPermutations;
 
 private:
     TShader& operator=(TShader&);
@@ -353,9 +637,23 @@ private:
 
 class TReflection;
 
+// A whole reflection list (all live uniforms, or all live uniform blocks) as flat,
+// parallel columns, entry i of each column describing the object with index i.
+// Entry i's name is the nul-terminated string starting at &names[nameOffsets[i]].
+// Columns hold the same values the per-index queries return; for blocks, 'sizes'
+// is the block data size, and the other columns hold -1.
+struct TReflectionTable {
+    std::vector<char> names;
+    std::vector<int> nameOffsets;
+    std::vector<int> types;
+    std::vector<int> offsets;
+    std::vector<int> sizes;
+    std::vector<int> blockIndexes;
+};
+
 // Make one TProgram per set of shaders that will get linked together.  Add all 
 // the shaders that are to be linked together.  After calling shader.parse()
-// for all shaders, call link().
+// for all shaders, or parseShaders() once, call link().
 //
 // N.B.: Destruct a linked program *before* destructing the shaders linked into it.
 //
@@ -365,15 +663,36 @@ public:
     virtual ~TProgram();
     void addShader(TShader* shader) { stages[shader->stage].push_back(shader); }
 
+    // Granularity, in bytes, at which the program's memory pool grows.
+    // Takes effect on link().
+    void setPoolPageSize(int bytes) { poolPageSize = bytes; }
+
+    // Link into 'pool', made by CreatePool(), rather than a pool of the program's
+    // own; see TShader::setPool().  It can be the pool of the shaders.
+    void setPool(TPoolAllocator* p) { pool = p; callerPool = p != nullptr; }
+
+    // Instead of calling parse() on each shader added, parse them all
+    // concurrently, on up to numThreads threads (0 means one per hardware
+    // thread).  Returns true if every shader parsed; each shader's info log
+    // has its own errors.
+    bool parseShaders(const TBuiltInResource*, int defaultVersion, bool forwardCompatible, EShMessages, int numThreads = 0);
+
     // Link Validation interface
     bool link(EShMessages);
     const char* getInfoLog();
     const char* getInfoDebugLog();
+    void setDebugLogWriter(TLogWriter writer, void* context);  // see TShader::setDebugLogWriter()
+    void setDiagnosticCallback(TDiagnosticCallback callback, void* context);  // see TShader::setDiagnosticCallback()
+    ShMemoryStats getMemoryStats() const;  // of link(), excluding the shaders' own memory
+    const ShTimingStats& getTimingStats() const { return timingStats; }  // of link() and buildReflection() with EShMsgTiming
 
     TIntermediate* getIntermediate(EShLanguage stage) const { return intermediate[stage]; }
 
     // Reflection Interface
-    bool buildReflection();                          // call first, to do liveness analysis, index mapping, etc.; returns false on failure
+    // buildReflection() does the liveness analysis, index mapping, etc., walking the
+    // stages on up to numThreads threads (0 means one per hardware thread); the indexes
+    // don't depend on the thread count.  The queries below call it if it hasn't been.
+    bool buildReflection(int numThreads = 1);        // returns false on failure
     int getNumLiveUniformVariables();                // can be used for glGetProgramiv(GL_ACTIVE_UNIFORMS)
     int getNumLiveUniformBlocks();                   // can be used for glGetProgramiv(GL_ACTIVE_UNIFORM_BLOCKS)
     const char* getUniformName(int index);           // can be used for "name" part of glGetActiveUniform()
@@ -384,23 +703,227 @@ public:
     int getUniformType(int index);                   // can be used for glGetActiveUniformsiv(GL_UNIFORM_TYPE)
     int getUniformBufferOffset(int index);           // can be used for glGetActiveUniformsiv(GL_UNIFORM_OFFSET)
     int getUniformArraySize(int index);              // can be used for glGetActiveUniformsiv(GL_UNIFORM_SIZE)
+    void getUniformTable(TReflectionTable&);         // all of the above for every uniform at once
+    void getUniformBlockTable(TReflectionTable&);    // all of the above for every uniform block at once
     void dumpReflection();
 
 protected:
     bool linkStage(EShLanguage, EShMessages);
+    TReflection* getReflection();
 
     TPoolAllocator* pool;
     std::list<TShader*> stages[EShLangCount];
     TIntermediate* intermediate[EShLangCount];
-    bool newedIntermediate[EShLangCount];      // track which intermediate were "new" versus reusing a singleton unit in a stage
+    bool newedIntermediate[EShLangCount];      // track which intermediate were "new"
     TInfoSink* infoSink;
     TReflection* reflection;
     bool linked;
+    int poolPageSize;
+    bool callerPool;            // pool was given by setPool(), so isn't the program's to free
+    ShMemoryStats memoryStats;  // of link()
+    bool timing;                // link() was given EShMsgTiming
+    ShTimingStats timingStats;
+    std::pair<TDiagnosticCallback, void*> diagnosticCallback;
 
 private:
     TProgram& operator=(TProgram&);
 };
 
+//
+// Compiles one shader source under many sets of #define flags (permutations),
+// doing once what doesn't depend on the flags:
+//  - the built-in symbol tables are built by a first compile, before the
+//    rest spread across threads;
+//  - the common preamble is preprocessed once (see TPreamble), with just each
+//    permutation's own #defines preprocessed per compile;
+//  - #include files are read once (see TShader::CachingIncluder);
+//  - a permutation differing from an already compiled one only in flags that
+//    compile never looked up gets the same results without compiling again.
+//
+// Each compile parses and links the permutation, then calls the optional
+// 'linked' function, on the compiling thread, to turn the program into output,
+// like SPIR-V; see also PermutationsToSpv().  It returns false on failure.
+//
+class TPermutations {
+public:
+    typedef std::vector<std::pair<std::string, std::string> > TDefines;  // names and values, "" for just defined
+    typedef std::function<bool(int permutation, TProgram&)> TLinked;
+
+    TPermutations(EShLanguage, const char* source);
+    virtual ~TPermutations();
+
+    // Text before each permutation's #defines, like a TShader preamble.
+    void setCommonPreamble(const char* text) { commonText = text; }
+    void setIncluder(const TShader::Includer& i) { includer = &i; }
+    // Returns the index of the new permutation.
+    int addPermutation(const TDefines&);
+
+    // Compile every permutation, on up to numThreads threads (0 means one per
+    // hardware thread).  Which compiles get shared can vary with the thread
+    // count, but the results can't.  Returns true if all permutations compiled.
+    bool compile(const TBuiltInResource*, int defaultVersion, EProfile defaultProfile, bool forwardCompatible,
+                 EShMessages, const TLinked& linked = TLinked(), int numThreads = 0);
+
+    EShLanguage getStage() const { return stage; }
+    int getNumPermutations() const { return (int)permutations.size(); }
+    int getNumCompiles() const;                  // of the last compile(); the rest were shared
+    int getCompiledAs(int permutation) const { return permutations[permutation].compiledAs; }  // itself, if compiled
+    bool succeeded(int permutation) const { return permutations[permutation].success; }
+    const char* getInfoLog(int permutation) const { return permutations[getCompiledAs(permutation)].infoLog.c_str(); }
+
+protected:
+    struct TPermutation {
+        std::map<std::string, std::string> defines;
+        std::string preamble;                       // the #defines, as text
+        bool shareable;                             // all names allowed, none repeated
+        int compiledAs;
+        bool success;
+        std::string infoLog;
+        std::unordered_set<std::string> lookups;    // macros its compile looked up, if shareable
+    };
+
+    bool compileOne(int permutation, int* version = nullptr, EProfile* profile = nullptr);
+    bool sameResults(const TPermutation&, const TPermutation& compiled) const;
+
+    const EShLanguage stage;
+    std::string source;
+    std::string commonText;
+    const TShader::Includer* includer;
+    std::vector<TPermutation> permutations;
+    TPreamble* commonPreamble;
+
+    // compile() settings, for compileOne()
+    const TBuiltInResource* resources;
+    int defaultVersion;
+    EProfile defaultProfile;
+    bool forwardCompatible;
+    EShMessages messages;
+    const TShader::Includer* compileIncluder;
+    const TLinked* linked;
+
+private:
+    TPermutations(TPermutations&);
+    TPermutations& operator=(TPermutations&);
+};
+
+//
+// Compiles a batch of independent shaders, each as its own single-stage
+// program, on a pool of threads it owns.  Add the jobs, then call compile(),
+// then read each job's result.  The threads are set up and torn down inside
+// compile(), including their memory pools, so the caller needs no thread
+// handling of its own.
+//
+// Each compile parses and links the job's shader, optionally fills in the
+// reflection tables, then calls the optional 'linked' function, on the
+// compiling thread, to turn the program into output; BatchToSpv() uses it
+// to fill in the SPIR-V of each result.
+//
+class TBatch {
+public:
+    struct TJob {
+        TJob() : stage(EShLangVertex), resources(nullptr), defaultVersion(100), defaultProfile(ENoProfile),
+                 forwardCompatible(false), messages(EShMsgDefault), reflection(true) { }
+        EShLanguage stage;
+        std::string source;
+        std::string preamble;
+        const TBuiltInResource* resources;
+        int defaultVersion;
+        EProfile defaultProfile;
+        bool forwardCompatible;
+        EShMessages messages;
+        bool reflection;                 // fill in the result's uniform tables
+    };
+    struct TResult {
+        TResult() : success(false) { }
+        bool success;
+        std::string infoLog;             // the shader's log, then the program's
+        std::vector<unsigned int> spirv;
+        TReflectionTable uniforms;
+        TReflectionTable uniformBlocks;
+    };
+    typedef std::function<bool(int job, TProgram&, TResult&)> TLinked;
+
+    TBatch() : includer(nullptr) { }
+    virtual ~TBatch() { }
+
+    // Shared by all jobs, and called on any thread; see TShader::CachingIncluder.
+    void setIncluder(const TShader::Includer& i) { includer = &i; }
+    // Returns the index of the new job.
+    int addJob(const TJob& job) { jobs.push_back(job); return (int)jobs.size() - 1; }
+
+    // Compile every job, on up to numThreads threads (0 means one per hardware
+    // thread); results don't depend on the thread count.  Returns true if all
+    // jobs compiled.
+    bool compile(const TLinked& linked = TLinked(), int numThreads = 0);
+
+    int getNumJobs() const { return (int)jobs.size(); }
+    const TJob& getJob(int job) const { return jobs[job]; }
+    const TResult& getResult(int job) const { return results[job]; }
+
+protected:
+    const TShader::Includer* includer;
+    std::vector<TJob> jobs;
+    std::vector<TResult> results;
+
+private:
+    TBatch(TBatch&);
+    TBatch& operator=(TBatch&);
+};
+
+//
+// Compiles TBatch jobs in the background, on numThreads threads it keeps for
+// its lifetime, so the submitting thread never waits on a compile.
+//
+// submit() queues a job and returns its ticket right away.  When the job is
+// done, its 'done' function is called with the ticket and result, on the
+// worker thread that compiled it, after the optional 'linked' function given
+// at construction (see TBatch), which gets the ticket as the job.  Use
+// LinkedToSpv() as that function to get SPIR-V.  Jobs start in submission order.
+//
+// A queued job can be cancelled; a cancelled job's 'done' is never called.
+// Destructing the compiler cancels all queued jobs and waits for the running
+// ones to finish.
+//
+class TAsyncCompiler {
+public:
+    typedef std::function<void(int ticket, const TBatch::TResult&)> TDone;
+
+    explicit TAsyncCompiler(int numThreads = 1, const TBatch::TLinked& linked = TBatch::TLinked());
+    virtual ~TAsyncCompiler();
+
+    // Used by all jobs, from the worker threads; set before submitting.
+    void setIncluder(const TShader::Includer& i) { includer = &i; }
+
+    int submit(const TBatch::TJob&, const TDone&);
+    // Returns true if the job was still queued, and now won't run.
+    bool cancel(int ticket);
+    // Returns once every job submitted so far is done or cancelled.
+    void wait();
+
+protected:
+    struct TQueued {
+        int ticket;
+        TBatch::TJob job;
+        TDone done;
+    };
+
+    void work();
+
+    const TBatch::TLinked linked;
+    const TShader::Includer* includer;
+    std::mutex queueMutex;
+    std::condition_variable queueChanged;   // a job was queued, one finished, or shutting down
+    std::list<TQueued> queue;
+    int nextTicket;
+    int running;                            // jobs taken off the queue and not done yet
+    bool shuttingDown;
+    std::vector<std::thread> threads;
+
+private:
+    TAsyncCompiler(TAsyncCompiler&);
+    TAsyncCompiler& operator=(TAsyncCompiler&);
+};
+
 } // end namespace glslang
 
 #endif // _COMPILER_INTERFACE_INCLUDED_